@@ -0,0 +1,504 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-bench.c
+ * @brief Microbenchmarks of the host-side code run on every frame
+ *
+ * Each benchmark is calibrated to run for a fixed time per sample, then
+ * sampled several times; the median is reported along with the spread
+ * (median absolute deviation) so that noisy runs are easy to spot.
+ * The device benchmarks run against the sim driver unless another
+ * connstring is given.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "conf.h"
+#include "mirror-subr.h"
+#include "target-subr.h"
+#include "chips/pn53x.h"
+
+#include "nfc-utils.h"
+
+#define BENCH_MAX_SAMPLES 31
+#define BENCH_BUFSIZE 256
+
+struct bench {
+  const char *name;
+  void (*run)(size_t szIterations);
+  // Bytes processed per operation, 0 when throughput is meaningless
+  size_t szBytes;
+  // Whether the benchmark needs bench_device
+  bool bDevice;
+};
+
+// Keeps the compiler from optimizing the benchmarked calls away
+static volatile uint64_t sink;
+
+static uint8_t abtData[BENCH_BUFSIZE];
+static uint8_t abtPar[BENCH_BUFSIZE];
+static uint8_t abtFrame[BENCH_BUFSIZE + (BENCH_BUFSIZE / 8) + 1];
+static uint8_t abtOut[BENCH_BUFSIZE + 16];
+static size_t szFrameBits;
+static char acTarget[4096];
+static nfc_target ntBench;
+static char acConfFile[] = "/tmp/nfc-bench.conf.XXXXXX";
+static nfc_context *bench_context;
+static nfc_device *bench_device;
+
+// ISO14443A target as answered to InListPassiveTarget: Tg, ATQA, SAK, UID, ATS
+static const uint8_t abtTargetData[] = {
+  0x01, 0x00, 0x44, 0x20, 0x07, 0x04, 0x25, 0x9a, 0x62, 0x3e, 0x29, 0x80,
+  0x0c, 0x75, 0x77, 0x81, 0x02, 0x80, 0x31, 0x80, 0x66, 0xb0, 0x84, 0x12
+};
+
+static const char acConf[] =
+  "# libnfc configuration as shipped in libnfc.conf.sample\n"
+  "allow_autoscan = true\n"
+  "allow_intrusive_scan = false\n"
+  "log_level = 1\n"
+  "discovery_cache_ttl = 0\n"
+  "\n"
+  "device.name = \"microBuilder.eu\"\n"
+  "device.connstring = \"pn532_uart:/dev/ttyUSB0\"\n"
+  "device.optional = true\n";
+
+static uint64_t
+bench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void
+run_iso14443a_crc(size_t szIterations)
+{
+  uint8_t abtCrc[2];
+  while (szIterations--) {
+    iso14443a_crc(abtData, sizeof(abtData), abtCrc);
+    sink += abtCrc[0];
+  }
+}
+
+static void
+run_iso14443b_crc(size_t szIterations)
+{
+  uint8_t abtCrc[2];
+  while (szIterations--) {
+    iso14443b_crc(abtData, sizeof(abtData), abtCrc);
+    sink += abtCrc[0];
+  }
+}
+
+static void
+run_pn53x_wrap_frame(size_t szIterations)
+{
+  while (szIterations--)
+    sink += pn53x_wrap_frame(abtData, 64 * 8, abtPar, abtFrame);
+}
+
+static void
+run_pn53x_unwrap_frame(size_t szIterations)
+{
+  uint8_t abtRxPar[BENCH_BUFSIZE];
+  while (szIterations--)
+    sink += pn53x_unwrap_frame(abtFrame, szFrameBits, abtOut, abtRxPar);
+}
+
+static void
+run_pn53x_build_frame(size_t szIterations)
+{
+  size_t szOut;
+  while (szIterations--) {
+    pn53x_build_frame(abtOut, &szOut, abtData, 200);
+    sink += szOut;
+  }
+}
+
+static void
+run_pn53x_decode_target_data(size_t szIterations)
+{
+  nfc_target_info nti;
+  while (szIterations--) {
+    pn53x_decode_target_data(abtTargetData, sizeof(abtTargetData), PN532, NMT_ISO14443A, &nti);
+    sink += nti.nai.szUidLen;
+  }
+}
+
+static void
+run_snprint_nfc_target(size_t szIterations)
+{
+  while (szIterations--) {
+    snprint_nfc_target(acTarget, sizeof(acTarget), &ntBench, true);
+    sink += acTarget[0];
+  }
+}
+
+static void
+run_nfc_target_encode_tlv(size_t szIterations)
+{
+  while (szIterations--)
+    sink += nfc_target_encode((uint8_t *) acTarget, sizeof(acTarget), &ntBench, NTE_TLV);
+}
+
+static void
+run_nfc_target_encode_json(size_t szIterations)
+{
+  while (szIterations--)
+    sink += nfc_target_encode((uint8_t *) acTarget, sizeof(acTarget), &ntBench, NTE_JSON);
+}
+
+static void
+run_mirror(size_t szIterations)
+{
+  while (szIterations--) {
+    for (size_t i = 0; i < sizeof(abtData); i++)
+      sink += mirror(abtData[i]);
+  }
+}
+
+static void
+run_mirror64(size_t szIterations)
+{
+  uint64_t ui64 = 0x0123456789abcdefULL;
+  while (szIterations--)
+    ui64 = mirror64(ui64) + 1;
+  sink += ui64;
+}
+
+static void
+run_oddparity_bytes_ts(size_t szIterations)
+{
+  while (szIterations--) {
+    oddparity_bytes_ts(abtData, sizeof(abtData), abtPar);
+    sink += abtPar[0];
+  }
+}
+
+#ifdef CONFFILES
+static void
+run_conf_parse_file(size_t szIterations)
+{
+  while (szIterations--) {
+    nfc_registry_clear(&bench_context->registry);
+    conf_load_file(bench_context, acConfFile);
+    sink += bench_context->registry.szDevices;
+  }
+}
+#endif // CONFFILES
+
+static void
+run_device_select(size_t szIterations)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  nfc_target nt;
+  while (szIterations--) {
+    if (nfc_initiator_select_passive_target(bench_device, nm, NULL, 0, &nt) <= 0)
+      errx(EXIT_FAILURE, "nfc_initiator_select_passive_target: %s", nfc_strerror(bench_device));
+    sink += nt.nti.nai.szUidLen;
+  }
+}
+
+static void
+run_device_transceive(size_t szIterations)
+{
+  const uint8_t abtRead[] = { 0x30, 0x04 };
+  uint8_t abtRx[16];
+  while (szIterations--) {
+    if (nfc_initiator_transceive_bytes(bench_device, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), 0) < 0)
+      errx(EXIT_FAILURE, "nfc_initiator_transceive_bytes: %s", nfc_strerror(bench_device));
+    sink += abtRx[0];
+  }
+}
+
+static void
+bench_io_thread_done(nfc_device *pnd, int res, void *user_data)
+{
+  (void) pnd;
+  if (res < 0)
+    errx(EXIT_FAILURE, "nfc_io_thread_submit: %s", nfc_strerror(bench_device));
+  sink += *(uint8_t *) user_data;
+}
+
+static void
+run_device_io_thread(size_t szIterations)
+{
+  const nfc_io_thread_config config = { .cpu = -1 };
+  const uint8_t abtRead[] = { 0x30, 0x04 };
+  uint8_t abtRx[16];
+  nfc_io_thread *pit = nfc_io_thread_start(bench_device, &config);
+  if (pit == NULL)
+    err(EXIT_FAILURE, "nfc_io_thread_start");
+  while (szIterations--) {
+    nfc_io_thread_submit(pit, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), 0, bench_io_thread_done, abtRx);
+    nfc_io_thread_process(pit, -1);
+  }
+  nfc_io_thread_stop(pit);
+}
+
+static const struct bench benches[] = {
+  { "iso14443a_crc",            run_iso14443a_crc,            BENCH_BUFSIZE,         false },
+  { "iso14443b_crc",            run_iso14443b_crc,            BENCH_BUFSIZE,         false },
+  { "pn53x_wrap_frame",         run_pn53x_wrap_frame,         64,                    false },
+  { "pn53x_unwrap_frame",       run_pn53x_unwrap_frame,       64,                    false },
+  { "pn53x_build_frame",        run_pn53x_build_frame,        200,                   false },
+  { "pn53x_decode_target_data", run_pn53x_decode_target_data, sizeof(abtTargetData), false },
+  { "snprint_nfc_target",       run_snprint_nfc_target,       0,                     false },
+  { "nfc_target_encode_tlv",    run_nfc_target_encode_tlv,    0,                     false },
+  { "nfc_target_encode_json",   run_nfc_target_encode_json,   0,                     false },
+  { "mirror",                   run_mirror,                   BENCH_BUFSIZE,         false },
+  { "mirror64",                 run_mirror64,                 8,                     false },
+  { "oddparity_bytes_ts",       run_oddparity_bytes_ts,       BENCH_BUFSIZE,         false },
+#ifdef CONFFILES
+  { "conf_parse_file",          run_conf_parse_file,          sizeof(acConf) - 1,    false },
+#endif // CONFFILES
+  { "device_select",            run_device_select,            0,                     true },
+  { "device_transceive",        run_device_transceive,        16,                    true },
+  { "device_io_thread",         run_device_io_thread,         16,                    true },
+};
+
+static int
+bench_compare(const void *a, const void *b)
+{
+  const double da = *(const double *) a;
+  const double db = *(const double *) b;
+  return (da > db) - (da < db);
+}
+
+static void
+bench_measure(const struct bench *b, const uint64_t ui64SampleNs, const size_t szSamples)
+{
+  double adNs[BENCH_MAX_SAMPLES];
+  double adDev[BENCH_MAX_SAMPLES];
+  size_t szIterations = 1;
+  uint64_t ui64Elapsed;
+
+  // Calibrate the iteration count to fill one sample, which also warms caches up
+  for (;;) {
+    uint64_t ui64Start = bench_now_ns();
+    b->run(szIterations);
+    ui64Elapsed = bench_now_ns() - ui64Start;
+    if (ui64Elapsed >= ui64SampleNs / 2)
+      break;
+    szIterations *= 2;
+  }
+  if (ui64Elapsed < ui64SampleNs)
+    szIterations = (size_t)((double) szIterations * ui64SampleNs / (ui64Elapsed ? ui64Elapsed : 1));
+
+  for (size_t i = 0; i < szSamples; i++) {
+    uint64_t ui64Start = bench_now_ns();
+    b->run(szIterations);
+    adNs[i] = (double)(bench_now_ns() - ui64Start) / szIterations;
+  }
+
+  qsort(adNs, szSamples, sizeof(double), bench_compare);
+  const double dMedian = adNs[szSamples / 2];
+  for (size_t i = 0; i < szSamples; i++)
+    adDev[i] = (adNs[i] > dMedian) ? adNs[i] - dMedian : dMedian - adNs[i];
+  qsort(adDev, szSamples, sizeof(double), bench_compare);
+  const double dMad = adDev[szSamples / 2];
+
+  printf("%-26s %12.1f %12.1f %7.2f%% %10zu", b->name, dMedian, adNs[0], 100.0 * dMad / dMedian, szIterations);
+  if (b->szBytes)
+    printf(" %12.2f\n", (b->szBytes * 1e9 / dMedian) / (1024 * 1024));
+  else
+    printf(" %12s\n", "-");
+}
+
+static void
+bench_setup(void)
+{
+  for (size_t i = 0; i < sizeof(abtData); i++) {
+    abtData[i] = (uint8_t)(i * 37 + 11);
+    abtPar[i] = oddparity(abtData[i]);
+  }
+  szFrameBits = pn53x_wrap_frame(abtData, 64 * 8, abtPar, abtFrame);
+
+  ntBench.nm.nmt = NMT_ISO14443A;
+  ntBench.nm.nbr = NBR_106;
+  pn53x_decode_target_data(abtTargetData, sizeof(abtTargetData), PN532, NMT_ISO14443A, &ntBench.nti);
+
+  int fd = mkstemp(acConfFile);
+  if (fd < 0)
+    err(EXIT_FAILURE, "mkstemp");
+  if (write(fd, acConf, strlen(acConf)) != (ssize_t) strlen(acConf))
+    err(EXIT_FAILURE, "write");
+  close(fd);
+}
+
+static int
+bench_open_device(const char *pcConnstring)
+{
+  nfc_connstring connstring;
+  strncpy(connstring, pcConnstring, sizeof(connstring) - 1);
+  connstring[sizeof(connstring) - 1] = '\0';
+
+  bench_device = nfc_open(bench_context, connstring);
+  if (bench_device == NULL) {
+    warnx("unable to open %s, skipping device benchmarks", connstring);
+    return -1;
+  }
+
+  static uint8_t abtMemory[1024];
+  if ((strcmp(nfc_device_get_connstring(bench_device), "sim") == 0) ||
+      (strncmp(nfc_device_get_connstring(bench_device), "sim:", 4) == 0)) {
+    nfc_target nt;
+    memset(&nt, 0, sizeof(nt));
+    nt.nm.nmt = NMT_ISO14443A;
+    nt.nm.nbr = NBR_106;
+    nt.nti.nai.abtAtqa[1] = 0x04;
+    nt.nti.nai.btSak = 0x08;
+    nt.nti.nai.szUidLen = 4;
+    memcpy(nt.nti.nai.abtUid, "\xde\xad\xbe\xef", 4);
+    nfc_sim_attach_target(bench_device, &nt, abtMemory, sizeof(abtMemory));
+  }
+
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  nfc_target nt;
+  if ((nfc_initiator_init(bench_device) < 0) ||
+      (nfc_initiator_select_passive_target(bench_device, nm, NULL, 0, &nt) <= 0)) {
+    warnx("no ISO14443A target on %s, skipping device benchmarks", connstring);
+    nfc_close(bench_device);
+    bench_device = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+static void
+print_usage(const char *argv[])
+{
+  printf("Usage: %s [OPTIONS] [BENCHMARK...]\n", argv[0]);
+  printf("Options:\n");
+  printf("\t-h\tPrint this help message.\n");
+  printf("\t-l\tList the benchmarks.\n");
+  printf("\t-q\tQuick run (fewer, shorter samples), for CI.\n");
+  printf("\t-n N\tNumber of samples per benchmark (default: 15, max: %d).\n", BENCH_MAX_SAMPLES);
+  printf("\t-t MS\tDuration of a sample in milliseconds (default: 20).\n");
+  printf("\t-d CONNSTRING\tDevice used by the device_* benchmarks (default: sim).\n");
+  printf("\t\tA MIFARE Classic or Ultralight target must be present on real devices.\n");
+}
+
+int
+main(int argc, const char *argv[])
+{
+  size_t szSamples = 15;
+  uint64_t ui64SampleNs = 20 * 1000000;
+  const char *pcConnstring = "sim";
+  int arg;
+
+  for (arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-l")) {
+      for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+        printf("%s\n", benches[i].name);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-q")) {
+      szSamples = 5;
+      ui64SampleNs = 2 * 1000000;
+    } else if ((0 == strcmp(argv[arg], "-n")) && (arg + 1 < argc)) {
+      szSamples = atoi(argv[++arg]);
+      if ((szSamples < 1) || (szSamples > BENCH_MAX_SAMPLES))
+        errx(EXIT_FAILURE, "number of samples must be between 1 and %d", BENCH_MAX_SAMPLES);
+    } else if ((0 == strcmp(argv[arg], "-t")) && (arg + 1 < argc)) {
+      int iMs = atoi(argv[++arg]);
+      if (iMs < 1)
+        errx(EXIT_FAILURE, "sample duration must be positive");
+      ui64SampleNs = (uint64_t) iMs * 1000000;
+    } else if ((0 == strcmp(argv[arg], "-d")) && (arg + 1 < argc)) {
+      pcConnstring = argv[++arg];
+    } else if (argv[arg][0] == '-') {
+      print_usage(argv);
+      exit(EXIT_FAILURE);
+    } else {
+      break;
+    }
+  }
+
+  nfc_init(&bench_context);
+  if (bench_context == NULL)
+    errx(EXIT_FAILURE, "Unable to init libnfc (malloc)");
+
+  bench_setup();
+
+  printf("%-26s %12s %12s %8s %10s %12s\n", "benchmark", "ns/op", "min ns/op", "mad", "iterations", "MiB/s");
+  bool bDeviceTried = false;
+  int res = EXIT_SUCCESS;
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    const struct bench *b = &benches[i];
+    if (arg < argc) {
+      bool bSelected = false;
+      for (int j = arg; j < argc; j++)
+        bSelected |= (strcmp(argv[j], b->name) == 0);
+      if (!bSelected)
+        continue;
+    }
+    if (b->bDevice) {
+      if (!bDeviceTried) {
+        bDeviceTried = true;
+        // Only an explicit request for a device is worth failing for
+        if ((bench_open_device(pcConnstring) < 0) && (strcmp(pcConnstring, "sim") != 0))
+          res = EXIT_FAILURE;
+      }
+      if (bench_device == NULL)
+        continue;
+    }
+    bench_measure(b, ui64SampleNs, szSamples);
+  }
+
+  if (bench_device)
+    nfc_close(bench_device);
+  unlink(acConfFile);
+  nfc_exit(bench_context);
+  exit(res);
+}
@@ -0,0 +1,435 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-soak.c
+ * @brief Soak benchmark of the device open/use/close cycle
+ *
+ * Runs the loop of test/test_access_storm.c (list the devices, then open,
+ * init, list ISO14443A targets and close each of them) for as long as asked,
+ * against the hardware found and the sim driver. Every iteration is written
+ * out as one JSON line, flushed at once, so that a run killed after days still
+ * leaves all its records behind. The summary compares a window of iterations
+ * taken after warm-up with the latest one: latency drift, and growth of the
+ * RSS, heap, file descriptors (USB handles included) and threads.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <dirent.h>
+#include <err.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#  include <malloc.h>
+#endif
+
+#include <nfc/nfc.h>
+
+#define SOAK_MAX_DEVICES 8
+#define SOAK_MAX_TARGETS 8
+// Size of the compared windows, and of the warm-up before the first one
+#define SOAK_WINDOW 1000
+#define SOAK_QUICK_ITERATIONS 300
+
+enum soak_metric {
+  SOAK_LIST_DEVICES,
+  SOAK_OPEN,
+  SOAK_INIT,
+  SOAK_LIST_TARGETS,
+  SOAK_CLOSE,
+  SOAK_METRICS
+};
+
+static const char *const apcMetricNames[SOAK_METRICS] = {
+  "list_devices_us", "open_us", "init_us", "list_targets_us", "close_us"
+};
+
+// Process resources sampled after each iteration, -1 when unknown
+struct soak_usage {
+  long lRssKiB;
+  long lHeapBytes;
+  long lFds;
+  long lThreads;
+};
+
+struct soak_window {
+  uint32_t aui32Us[SOAK_METRICS][SOAK_WINDOW];
+  size_t szSamples;
+  size_t szNext;
+};
+
+static volatile sig_atomic_t quitting = 0;
+static struct soak_window swFirst, swLast;
+
+#ifdef __GLIBC__
+// Calls to the allocator, through the whole process: glibc lets the program
+// wrap it, the libc internal allocations are not seen
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+static volatile uint64_t ui64Allocs;
+
+void *
+malloc(size_t size)
+{
+  __atomic_add_fetch(&ui64Allocs, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+  __atomic_add_fetch(&ui64Allocs, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    __atomic_add_fetch(&ui64Allocs, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+#else
+static const uint64_t ui64Allocs = 0;
+#endif
+
+static void
+stop_soak(int sig)
+{
+  (void) sig;
+  quitting = 1;
+}
+
+static uint64_t
+soak_now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000) + ts.tv_nsec / 1000;
+}
+
+static long
+soak_count_fds(void)
+{
+  DIR *dir = opendir("/proc/self/fd");
+  if (dir == NULL)
+    return -1;
+  long lFds = 0;
+  while (readdir(dir) != NULL)
+    lFds++;
+  closedir(dir);
+  // ".", ".." and the descriptor of dir itself
+  return lFds - 3;
+}
+
+static void
+soak_get_usage(struct soak_usage *psu)
+{
+  char acLine[128];
+  FILE *f;
+
+  psu->lRssKiB = -1;
+  psu->lThreads = -1;
+  if ((f = fopen("/proc/self/status", "r")) != NULL) {
+    while (fgets(acLine, sizeof(acLine), f)) {
+      if (strncmp(acLine, "VmRSS:", 6) == 0)
+        psu->lRssKiB = strtol(acLine + 6, NULL, 10);
+      else if (strncmp(acLine, "Threads:", 8) == 0)
+        psu->lThreads = strtol(acLine + 8, NULL, 10);
+    }
+    fclose(f);
+  }
+  psu->lFds = soak_count_fds();
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+  psu->lHeapBytes = (long) mallinfo2().uordblks;
+#else
+  psu->lHeapBytes = -1;
+#endif
+}
+
+static void
+soak_window_add(struct soak_window *psw, const uint32_t aui32Us[SOAK_METRICS])
+{
+  for (int m = 0; m < SOAK_METRICS; m++)
+    psw->aui32Us[m][psw->szNext] = aui32Us[m];
+  psw->szNext = (psw->szNext + 1) % SOAK_WINDOW;
+  if (psw->szSamples < SOAK_WINDOW)
+    psw->szSamples++;
+}
+
+static int
+cmp_uint32(const void *a, const void *b)
+{
+  const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t
+soak_window_median(const struct soak_window *psw, const int m)
+{
+  static uint32_t aui32Sorted[SOAK_WINDOW];
+  if (psw->szSamples == 0)
+    return 0;
+  memcpy(aui32Sorted, psw->aui32Us[m], psw->szSamples * sizeof(uint32_t));
+  qsort(aui32Sorted, psw->szSamples, sizeof(uint32_t), cmp_uint32);
+  return aui32Sorted[psw->szSamples / 2];
+}
+
+static void
+soak_attach_sim_target(nfc_device *pnd)
+{
+  static uint8_t abtMemory[64 * 4];
+  nfc_target nt;
+
+  memset(&nt, 0, sizeof(nt));
+  nt.nm.nmt = NMT_ISO14443A;
+  nt.nm.nbr = NBR_106;
+  nt.nti.nai.abtAtqa[1] = 0x44;
+  nt.nti.nai.szUidLen = 7;
+  memcpy(nt.nti.nai.abtUid, "\x04\x50\x4f\x41\x4b\x00\x01", 7);
+  nfc_sim_attach_target(pnd, &nt, abtMemory, sizeof(abtMemory));
+}
+
+static bool
+soak_is_sim(const char *pcConnstring)
+{
+  return (strcmp(pcConnstring, "sim") == 0) || (strncmp(pcConnstring, "sim:", 4) == 0);
+}
+
+static void
+print_usage(const char *argv[])
+{
+  printf("Usage: %s [OPTIONS]\n", argv[0]);
+  printf("Options:\n");
+  printf("\t-h\tPrint this help message.\n");
+  printf("\t-q\tQuick run (%d iterations, windows of 100), failing on any leak, for CI.\n", SOAK_QUICK_ITERATIONS);
+  printf("\t-n N\tNumber of iterations (default: 0, until interrupted).\n");
+  printf("\t-i MS\tPause between iterations in milliseconds (default: 0).\n");
+  printf("\t-o FILE\tAppend the iteration records to FILE (default: standard output).\n");
+  printf("\t-d CONNSTRING\tAlso open this device at each iteration (default: sim), may be repeated.\n");
+  printf("\t-H\tHardware only, do not open the sim driver.\n");
+}
+
+int
+main(int argc, const char *argv[])
+{
+  nfc_connstring acExtra[SOAK_MAX_DEVICES];
+  size_t szExtra = 0;
+  bool bQuick = false;
+  bool bSim = true;
+  uint64_t ui64Iterations = 0;
+  unsigned int uiPauseMs = 0;
+  size_t szWindow = SOAK_WINDOW;
+  FILE *out = stdout;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-q")) {
+      bQuick = true;
+      ui64Iterations = SOAK_QUICK_ITERATIONS;
+      szWindow = SOAK_QUICK_ITERATIONS / 3;
+    } else if (0 == strcmp(argv[arg], "-H")) {
+      bSim = false;
+    } else if ((0 == strcmp(argv[arg], "-n")) && (arg + 1 < argc)) {
+      ui64Iterations = strtoull(argv[++arg], NULL, 10);
+    } else if ((0 == strcmp(argv[arg], "-i")) && (arg + 1 < argc)) {
+      uiPauseMs = atoi(argv[++arg]);
+    } else if ((0 == strcmp(argv[arg], "-o")) && (arg + 1 < argc)) {
+      if ((out = fopen(argv[++arg], "a")) == NULL)
+        err(EXIT_FAILURE, "%s", argv[arg]);
+    } else if ((0 == strcmp(argv[arg], "-d")) && (arg + 1 < argc)) {
+      if (szExtra == SOAK_MAX_DEVICES)
+        errx(EXIT_FAILURE, "at most %d devices", SOAK_MAX_DEVICES);
+      strncpy(acExtra[szExtra], argv[++arg], sizeof(acExtra[szExtra]) - 1);
+      acExtra[szExtra++][sizeof(acExtra[0]) - 1] = '\0';
+    } else {
+      print_usage(argv);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (bSim && (szExtra == 0))
+    strcpy(acExtra[szExtra++], "sim");
+  // Records are only worth printing on a full run, or when asked for
+  if (bQuick && (out == stdout))
+    out = NULL;
+
+  signal(SIGINT, stop_soak);
+  signal(SIGTERM, stop_soak);
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL)
+    errx(EXIT_FAILURE, "Unable to init libnfc (malloc)");
+
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  const uint64_t ui64Start = soak_now_us();
+  struct soak_usage suWarm = { -1, -1, -1, -1 }, suNow = suWarm;
+  uint64_t ui64Errors = 0;
+  uint64_t n;
+
+  if (out)
+    fprintf(out, "{\"start\":true,\"libnfc\":\"%s\",\"pid\":%ld}\n", nfc_version(), (long) getpid());
+  for (n = 0; !quitting && ((ui64Iterations == 0) || (n < ui64Iterations)); n++) {
+    nfc_connstring connstrings[SOAK_MAX_DEVICES * 2];
+    uint32_t aui32Us[SOAK_METRICS] = { 0 };
+    uint64_t ui64T0, ui64T1;
+    int iErrors = 0;
+    int iTargets = 0;
+    const uint64_t ui64AllocsBefore = ui64Allocs;
+
+    ui64T0 = soak_now_us();
+    size_t szDevices = nfc_list_devices(context, connstrings, SOAK_MAX_DEVICES);
+    aui32Us[SOAK_LIST_DEVICES] = soak_now_us() - ui64T0;
+    const size_t szHardware = szDevices;
+    for (size_t i = 0; i < szExtra; i++)
+      memcpy(connstrings[szDevices++], acExtra[i], sizeof(nfc_connstring));
+
+    // Per device phases are summed over the devices
+    for (size_t i = 0; i < szDevices; i++) {
+      nfc_target ant[SOAK_MAX_TARGETS];
+      nfc_device *pnd;
+      int res;
+
+      ui64T0 = soak_now_us();
+      pnd = nfc_open(context, connstrings[i]);
+      ui64T1 = soak_now_us();
+      aui32Us[SOAK_OPEN] += ui64T1 - ui64T0;
+      if (pnd == NULL) {
+        warnx("iteration %" PRIu64 ": unable to open %s", n, connstrings[i]);
+        iErrors++;
+        continue;
+      }
+      if (soak_is_sim(connstrings[i]))
+        soak_attach_sim_target(pnd);
+
+      ui64T0 = soak_now_us();
+      res = nfc_initiator_init(pnd);
+      ui64T1 = soak_now_us();
+      aui32Us[SOAK_INIT] += ui64T1 - ui64T0;
+      if (res < 0) {
+        warnx("iteration %" PRIu64 ": nfc_initiator_init on %s: %s", n, connstrings[i], nfc_strerror(pnd));
+        iErrors++;
+      } else {
+        res = nfc_initiator_list_passive_targets(pnd, nm, ant, SOAK_MAX_TARGETS);
+        ui64T0 = soak_now_us();
+        aui32Us[SOAK_LIST_TARGETS] += ui64T0 - ui64T1;
+        if (res < 0) {
+          warnx("iteration %" PRIu64 ": nfc_initiator_list_passive_targets on %s: %s", n, connstrings[i], nfc_strerror(pnd));
+          iErrors++;
+        } else {
+          iTargets += res;
+        }
+      }
+
+      ui64T0 = soak_now_us();
+      nfc_close(pnd);
+      aui32Us[SOAK_CLOSE] += soak_now_us() - ui64T0;
+    }
+    ui64Errors += iErrors;
+    soak_get_usage(&suNow);
+
+    if (out) {
+      fprintf(out, "{\"iteration\":%" PRIu64 ",\"time_s\":%.3f,\"devices\":%zu,\"hardware\":%zu,\"targets\":%d,\"errors\":%d",
+              n, (soak_now_us() - ui64Start) / 1e6, szDevices, szHardware, iTargets, iErrors);
+      for (int m = 0; m < SOAK_METRICS; m++)
+        fprintf(out, ",\"%s\":%" PRIu32, apcMetricNames[m], aui32Us[m]);
+      fprintf(out, ",\"allocs\":%" PRIu64 ",\"heap_bytes\":%ld,\"rss_kib\":%ld,\"fds\":%ld,\"threads\":%ld}\n",
+              ui64Allocs - ui64AllocsBefore, suNow.lHeapBytes, suNow.lRssKiB, suNow.lFds, suNow.lThreads);
+      fflush(out);
+    }
+
+    // The first window starts once caches and lazy initializations settled
+    if (n + 1 == szWindow)
+      suWarm = suNow;
+    if ((n >= szWindow) && (n < 2 * szWindow))
+      soak_window_add(&swFirst, aui32Us);
+    if (n >= 2 * szWindow)
+      soak_window_add(&swLast, aui32Us);
+
+    if (uiPauseMs) {
+      struct timespec ts = { uiPauseMs / 1000, (long)(uiPauseMs % 1000) * 1000000 };
+      nanosleep(&ts, NULL);
+    }
+  }
+  if (out && (out != stdout))
+    fclose(out);
+  nfc_exit(context);
+
+  fprintf(stderr, "%" PRIu64 " iterations in %.1f s, %" PRIu64 " errors\n", n, (soak_now_us() - ui64Start) / 1e6, ui64Errors);
+  if (swLast.szSamples == 0) {
+    fprintf(stderr, "Too few iterations to compare: at least %zu are needed\n", 2 * szWindow + 1);
+    exit(((ui64Errors > 0) || bQuick) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  fprintf(stderr, "%-16s %12s %12s %8s\n", "median", "after warm-up", "latest", "drift");
+  for (int m = 0; m < SOAK_METRICS; m++) {
+    const uint32_t ui32First = soak_window_median(&swFirst, m);
+    const uint32_t ui32Last = soak_window_median(&swLast, m);
+    fprintf(stderr, "%-16s %12" PRIu32 " %12" PRIu32 " %+7.1f%%\n", apcMetricNames[m], ui32First, ui32Last,
+            ui32First ? 100.0 * ((double) ui32Last - ui32First) / ui32First : 0.0);
+  }
+
+  const long alWarm[] = { suWarm.lRssKiB, suWarm.lHeapBytes, suWarm.lFds, suWarm.lThreads };
+  const long alNow[] = { suNow.lRssKiB, suNow.lHeapBytes, suNow.lFds, suNow.lThreads };
+  const char *const apcUsage[] = { "rss_kib", "heap_bytes", "fds", "threads" };
+  bool bLeak = false;
+  fprintf(stderr, "%-16s %12s %12s %8s\n", "usage", "after warm-up", "latest", "growth");
+  for (size_t u = 0; u < sizeof(alNow) / sizeof(alNow[0]); u++) {
+    if ((alWarm[u] < 0) || (alNow[u] < 0))
+      continue;
+    fprintf(stderr, "%-16s %12ld %12ld %+8ld\n", apcUsage[u], alWarm[u], alNow[u], alNow[u] - alWarm[u]);
+  }
+  // Descriptors and threads are exact counts: any growth is a leak. RSS moves
+  // with the allocator, the heap is worth a look but only fails a quick run
+  if ((suNow.lFds > suWarm.lFds) || (suNow.lThreads > suWarm.lThreads))
+    bLeak = true;
+  if (bQuick && (suNow.lHeapBytes > suWarm.lHeapBytes))
+    bLeak = true;
+  if (bLeak)
+    fprintf(stderr, "Resources grew after warm-up: possible leak\n");
+  exit(((ui64Errors > 0) || bLeak) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
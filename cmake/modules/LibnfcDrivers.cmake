@@ -1,3 +1,7 @@
+IF(NOT WIN32)
+  SET(LIBNFC_DRIVER_PLUGINS OFF CACHE BOOL "Build the drivers depending on libusb or PC/SC as plugins loaded on demand")
+ENDIF(NOT WIN32)
+
 SET(LIBNFC_DRIVER_ACR122_PCSC OFF CACHE BOOL "Enable ACR122 support (Depends on PC/SC)")
 SET(LIBNFC_DRIVER_ACR122_USB ON CACHE BOOL "Enable ACR122 support (Direct USB connection)")
 SET(LIBNFC_DRIVER_ACR122S ON CACHE BOOL "Enable ACR122S support (Use serial port)")
@@ -11,17 +15,73 @@ ELSE(WIN32)
 ENDIF(WIN32)
 SET(LIBNFC_DRIVER_PN532_UART ON CACHE BOOL "Enable PN532 UART support (Use serial port)")
 SET(LIBNFC_DRIVER_PN53X_USB ON CACHE BOOL "Enable PN531 and PN531 USB support (Depends on libusb)")
+IF(WIN32)
+  SET(LIBNFC_WINUSB OFF CACHE BOOL "Drive USB devices through WinUSB instead of libusb-win32")
+ENDIF(WIN32)
+SET(LIBNFC_DRIVER_REPLAY ON CACHE BOOL "Enable replay of pcapng captures (Virtual device)")
+SET(LIBNFC_DRIVER_SIM ON CACHE BOOL "Enable simulated PN532 support (Virtual device)")
+IF(WIN32)
+  SET(LIBNFC_DRIVER_TCP OFF CACHE BOOL "Enable remote devices support (Use TCP connection)")
+  SET(LIBNFC_DRIVER_NFCD OFF CACHE BOOL "Enable devices shared by nfc-daemon support (Depends on tcp driver)")
+ELSE(WIN32)
+  SET(LIBNFC_DRIVER_TCP ON CACHE BOOL "Enable remote devices support (Use TCP connection)")
+  SET(LIBNFC_DRIVER_NFCD ON CACHE BOOL "Enable devices shared by nfc-daemon support (Depends on tcp driver)")
+ENDIF(WIN32)
+
+# Firmware-like builds: exactly one driver, called without going through the driver tables
+SET(LIBNFC_SINGLE_DRIVER "" CACHE STRING "Build only this driver (e.g. pn532_spi) and bind it at compile time")
+IF(LIBNFC_SINGLE_DRIVER)
+  IF(LIBNFC_DRIVER_PLUGINS)
+    MESSAGE(FATAL_ERROR "LIBNFC_SINGLE_DRIVER can not be used with LIBNFC_DRIVER_PLUGINS")
+  ENDIF(LIBNFC_DRIVER_PLUGINS)
+  IF(LIBNFC_SINGLE_DRIVER STREQUAL "nfcd")
+    MESSAGE(FATAL_ERROR "nfcd driver requires the tcp driver, it can not be the single driver")
+  ENDIF(LIBNFC_SINGLE_DRIVER STREQUAL "nfcd")
+  FOREACH(DRIVER acr122_pcsc acr122_usb acr122s arygon pn532_i2c pn532_spi pn532_uart pn53x_usb replay sim tcp nfcd)
+    STRING(TOUPPER ${DRIVER} DRIVER_OPTION)
+    IF(DRIVER STREQUAL LIBNFC_SINGLE_DRIVER)
+      SET(LIBNFC_DRIVER_${DRIVER_OPTION} ON)
+      SET(SINGLE_DRIVER_FOUND TRUE)
+    ELSE(DRIVER STREQUAL LIBNFC_SINGLE_DRIVER)
+      SET(LIBNFC_DRIVER_${DRIVER_OPTION} OFF)
+    ENDIF(DRIVER STREQUAL LIBNFC_SINGLE_DRIVER)
+  ENDFOREACH(DRIVER)
+  IF(NOT SINGLE_DRIVER_FOUND)
+    MESSAGE(FATAL_ERROR "Unknown driver ${LIBNFC_SINGLE_DRIVER}")
+  ENDIF(NOT SINGLE_DRIVER_FOUND)
+
+  ADD_DEFINITIONS("-DNFC_SINGLE_DRIVER=${LIBNFC_SINGLE_DRIVER}_driver")
+  # I/O of the PN53x based drivers
+  IF(LIBNFC_SINGLE_DRIVER STREQUAL "arygon")
+    ADD_DEFINITIONS("-DNFC_SINGLE_PN53X_IO=arygon_tama_io")
+  ELSEIF(NOT LIBNFC_SINGLE_DRIVER STREQUAL "tcp")
+    ADD_DEFINITIONS("-DNFC_SINGLE_PN53X_IO=${LIBNFC_SINGLE_DRIVER}_io")
+  ENDIF(LIBNFC_SINGLE_DRIVER STREQUAL "arygon")
+ENDIF(LIBNFC_SINGLE_DRIVER)
 
 IF(LIBNFC_DRIVER_ACR122_PCSC)
   FIND_PACKAGE(PCSC REQUIRED)
-  ADD_DEFINITIONS("-DDRIVER_ACR122_PCSC_ENABLED")
-  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/acr122_pcsc")
+  IF(LIBNFC_DRIVER_PLUGINS)
+    ADD_DEFINITIONS("-DDRIVER_ACR122_PCSC_PLUGIN")
+    SET(PLUGIN_PCSC_SOURCES ${PLUGIN_PCSC_SOURCES} "drivers/acr122_pcsc")
+  ELSE(LIBNFC_DRIVER_PLUGINS)
+    ADD_DEFINITIONS("-DDRIVER_ACR122_PCSC_ENABLED")
+    SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/acr122_pcsc")
+  ENDIF(LIBNFC_DRIVER_PLUGINS)
 ENDIF(LIBNFC_DRIVER_ACR122_PCSC)
 
 IF(LIBNFC_DRIVER_ACR122_USB)
-  FIND_PACKAGE(LIBUSB REQUIRED)
-  ADD_DEFINITIONS("-DDRIVER_ACR122_USB_ENABLED")
-  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/acr122_usb")
+  IF(NOT LIBNFC_WINUSB)
+    FIND_PACKAGE(LIBUSB REQUIRED)
+  ENDIF(NOT LIBNFC_WINUSB)
+  IF(LIBNFC_DRIVER_PLUGINS)
+    ADD_DEFINITIONS("-DDRIVER_ACR122_USB_PLUGIN")
+    SET(PLUGIN_USB_SOURCES ${PLUGIN_USB_SOURCES} "drivers/acr122_usb")
+  ELSE(LIBNFC_DRIVER_PLUGINS)
+    ADD_DEFINITIONS("-DDRIVER_ACR122_USB_ENABLED")
+    SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/acr122_usb")
+  ENDIF(LIBNFC_DRIVER_PLUGINS)
+  SET(USB_REQUIRED TRUE)
 ENDIF(LIBNFC_DRIVER_ACR122_USB)
 
 IF(LIBNFC_DRIVER_ACR122S)
@@ -55,10 +115,49 @@ IF(LIBNFC_DRIVER_PN532_UART)
 ENDIF(LIBNFC_DRIVER_PN532_UART)
 
 IF(LIBNFC_DRIVER_PN53X_USB)
-  FIND_PACKAGE(LIBUSB REQUIRED)
-  ADD_DEFINITIONS("-DDRIVER_PN53X_USB_ENABLED")
-  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/pn53x_usb")
+  IF(NOT LIBNFC_WINUSB)
+    FIND_PACKAGE(LIBUSB REQUIRED)
+  ENDIF(NOT LIBNFC_WINUSB)
+  IF(LIBNFC_DRIVER_PLUGINS)
+    ADD_DEFINITIONS("-DDRIVER_PN53X_USB_PLUGIN")
+    SET(PLUGIN_USB_SOURCES ${PLUGIN_USB_SOURCES} "drivers/pn53x_usb")
+  ELSE(LIBNFC_DRIVER_PLUGINS)
+    ADD_DEFINITIONS("-DDRIVER_PN53X_USB_ENABLED")
+    SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/pn53x_usb")
+  ENDIF(LIBNFC_DRIVER_PLUGINS)
   SET(USB_REQUIRED TRUE)
 ENDIF(LIBNFC_DRIVER_PN53X_USB)
 
+IF(USB_REQUIRED AND LIBNFC_WINUSB)
+  ADD_DEFINITIONS("-DLIBNFC_WINUSB")
+ENDIF(USB_REQUIRED AND LIBNFC_WINUSB)
+
+IF(LIBNFC_DRIVER_REPLAY)
+  ADD_DEFINITIONS("-DDRIVER_REPLAY_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/replay")
+ENDIF(LIBNFC_DRIVER_REPLAY)
+
+IF(LIBNFC_DRIVER_SIM)
+  ADD_DEFINITIONS("-DDRIVER_SIM_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/sim")
+ENDIF(LIBNFC_DRIVER_SIM)
+
+IF(LIBNFC_DRIVER_TCP)
+  ADD_DEFINITIONS("-DDRIVER_TCP_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/tcp")
+ENDIF(LIBNFC_DRIVER_TCP)
+
+IF(LIBNFC_DRIVER_NFCD)
+  IF(NOT LIBNFC_DRIVER_TCP)
+    MESSAGE(FATAL_ERROR "LIBNFC_DRIVER_NFCD requires LIBNFC_DRIVER_TCP")
+  ENDIF(NOT LIBNFC_DRIVER_TCP)
+  ADD_DEFINITIONS("-DDRIVER_NFCD_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/nfcd")
+ENDIF(LIBNFC_DRIVER_NFCD)
+
+IF(PLUGIN_USB_SOURCES OR PLUGIN_PCSC_SOURCES)
+  ADD_DEFINITIONS("-DDRIVER_PLUGINS")
+  SET(LIBNFC_PLUGINDIR "${CMAKE_INSTALL_PREFIX}/${CMAKE_INSTALL_LIBDIR}/libnfc" CACHE PATH "Directory of the driver plugins")
+ENDIF(PLUGIN_USB_SOURCES OR PLUGIN_PCSC_SOURCES)
+
 INCLUDE_DIRECTORIES(${CMAKE_CURRENT_SOURCE_DIR}/libnfc/drivers)
@@ -49,12 +49,61 @@
 #include "contrib/windows.h"
 #define delay_ms( X ) Sleep( X )
 
+// Enough to hold the longest PN53x extended frame
+#define UART_RX_BUFFER_SIZE 512
+
+/*
+ * All I/O is overlapped. A read into abtRxBuf stays posted whenever that
+ * buffer is empty: its event, signaled once bytes came in, is what receives
+ * wait on (along with the abort event) and what uart_get_fd() hands out, so
+ * that one thread can wait for several ports.
+ */
 struct serial_port_windows {
   HANDLE  hPort;                // Serial port handle
   DCB     dcb;                  // Device control settings
   COMMTIMEOUTS ct;              // Serial port time-out configuration
+  HANDLE  hAbort;               // Auto-reset event set by uart_abort()
+  OVERLAPPED ovRead;            // Read posted into abtRxBuf
+  OVERLAPPED ovWrite;
+  bool    bReadPending;         // ovRead is posted and not collected yet
+  uint8_t abtRxBuf[UART_RX_BUFFER_SIZE]; // Bytes received but not yet requested
+  size_t  szRxPos;              // Position of the first pending byte in abtRxBuf
+  size_t  szRxLen;              // Count of pending bytes in abtRxBuf
 };
 
+#define UART_DATA( X ) ((struct serial_port_windows *) X)
+
+// Posts a read, which completes as soon as at least one byte is there
+static int
+uart_post_read(struct serial_port_windows *spw)
+{
+  DWORD dwRead;
+
+  if (spw->bReadPending || spw->szRxLen)
+    return NFC_SUCCESS;
+  spw->szRxPos = 0;
+  // Completed at once or not, the result is collected by GetOverlappedResult()
+  if (!ReadFile(spw->hPort, spw->abtRxBuf, sizeof(spw->abtRxBuf), &dwRead, &spw->ovRead) && (GetLastError() != ERROR_IO_PENDING)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "ReadFile error: %lu", GetLastError());
+    return NFC_EIO;
+  }
+  spw->bReadPending = true;
+  return NFC_SUCCESS;
+}
+
+// Cancels the posted read, e.g. before purging the port
+static void
+uart_cancel_read(struct serial_port_windows *spw)
+{
+  DWORD dwRead;
+
+  if (!spw->bReadPending)
+    return;
+  CancelIo(spw->hPort);
+  GetOverlappedResult(spw->hPort, &spw->ovRead, &dwRead, TRUE);
+  spw->bReadPending = false;
+}
+
 serial_port
 uart_open(const char *pcPortName)
 {
@@ -64,13 +113,21 @@ uart_open(const char *pcPortName)
   if (sp == 0)
     return INVALID_SERIAL_PORT;
 
-  // Copy the input "com?" to "\\.\COM?" format
+  // Copy the input "com?" to "\\\\.\\COM?" format
   sprintf(acPortName, "\\\\.\\%s", pcPortName);
   _strupr(acPortName);
 
+  sp->bReadPending = false;
+  sp->szRxPos = 0;
+  sp->szRxLen = 0;
+  memset(&sp->ovRead, 0, sizeof(sp->ovRead));
+  memset(&sp->ovWrite, 0, sizeof(sp->ovWrite));
+  sp->hAbort = CreateEvent(NULL, FALSE, FALSE, NULL);
+  sp->ovRead.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  sp->ovWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
   // Try to open the serial port
-  sp->hPort = CreateFileA(acPortName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
-  if (sp->hPort == INVALID_HANDLE_VALUE) {
+  sp->hPort = CreateFileA(acPortName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+  if ((sp->hPort == INVALID_HANDLE_VALUE) || (sp->hAbort == NULL) || (sp->ovRead.hEvent == NULL) || (sp->ovWrite.hEvent == NULL)) {
     uart_close(sp);
     return INVALID_SERIAL_PORT;
   }
@@ -87,10 +144,12 @@ uart_open(const char *pcPortName)
     return INVALID_SERIAL_PORT;
   }
 
-  sp->ct.ReadIntervalTimeout = 30;
-  sp->ct.ReadTotalTimeoutMultiplier = 0;
-  sp->ct.ReadTotalTimeoutConstant = 30;
-  sp->ct.WriteTotalTimeoutMultiplier = 30;
+  // Reads return what is there as soon as there is something, timeouts are
+  // those of the waits on the overlapped events
+  sp->ct.ReadIntervalTimeout = MAXDWORD;
+  sp->ct.ReadTotalTimeoutMultiplier = MAXDWORD;
+  sp->ct.ReadTotalTimeoutConstant = MAXDWORD - 1;
+  sp->ct.WriteTotalTimeoutMultiplier = 0;
   sp->ct.WriteTotalTimeoutConstant = 0;
 
   if (!SetCommTimeouts(sp->hPort, &sp->ct)) {
@@ -99,6 +158,10 @@ uart_open(const char *pcPortName)
   }
 
   PurgeComm(sp->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  if (uart_post_read(sp) < 0) {
+    uart_close(sp);
+    return INVALID_SERIAL_PORT;
+  }
 
   return sp;
 }
@@ -106,8 +169,20 @@ uart_open(const char *pcPortName)
 void
 uart_close(const serial_port sp)
 {
-  if (((struct serial_port_windows *) sp)->hPort != INVALID_HANDLE_VALUE) {
-    CloseHandle(((struct serial_port_windows *) sp)->hPort);
+  struct serial_port_windows *spw = UART_DATA(sp);
+
+  if (spw->hPort != INVALID_HANDLE_VALUE) {
+    uart_cancel_read(spw);
+    CloseHandle(spw->hPort);
+  }
+  if (spw->hAbort != NULL) {
+    CloseHandle(spw->hAbort);
+  }
+  if (spw->ovRead.hEvent != NULL) {
+    CloseHandle(spw->ovRead.hEvent);
+  }
+  if (spw->ovWrite.hEvent != NULL) {
+    CloseHandle(spw->ovWrite.hEvent);
   }
   free(sp);
 }
@@ -115,7 +190,15 @@ uart_close(const serial_port sp)
 void
 uart_flush_input(const serial_port sp, bool wait)
 {
-  PurgeComm(((struct serial_port_windows *) sp)->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  struct serial_port_windows *spw = UART_DATA(sp);
+
+  if (wait) {
+    delay_ms(50);
+  }
+  uart_cancel_read(spw);
+  spw->szRxLen = 0;
+  PurgeComm(spw->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  uart_post_read(spw);
 }
 
 void
@@ -133,9 +216,10 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
     case 115200:
     case 230400:
     case 460800:
+    case 921600:
       break;
     default:
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d baud. Speed value must be one of these constants: 9600 (default), 19200, 38400, 57600, 115200, 230400 or 460800.", uiPortSpeed);
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d baud. Speed value must be one of these constants: 9600 (default), 19200, 38400, 57600, 115200, 230400, 460800 or 921600.", uiPortSpeed);
       return;
   };
   spw = (struct serial_port_windows *) sp;
@@ -146,7 +230,80 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to apply new speed settings.");
     return;
   }
+  uart_cancel_read(spw);
+  spw->szRxLen = 0;
   PurgeComm(spw->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  uart_post_read(spw);
+}
+
+// Speeds negotiated with the devices, so they outlive the serial_port handles
+#define UART_REMEMBERED_SPEEDS 8
+static struct {
+  char acPortName[DEVICE_PORT_LENGTH];
+  uint32_t uiPortSpeed;
+} uart_remembered_speeds[UART_REMEMBERED_SPEEDS];
+static size_t uart_remembered_speeds_next = 0;
+static pthread_mutex_t uart_remembered_speeds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Speed last remembered for this port, 0 if none
+ */
+uint32_t
+uart_get_remembered_speed(const char *pcPortName)
+{
+  uint32_t uiPortSpeed = 0;
+  pthread_mutex_lock(&uart_remembered_speeds_lock);
+  for (size_t i = 0; i < UART_REMEMBERED_SPEEDS; i++) {
+    if (strncmp(uart_remembered_speeds[i].acPortName, pcPortName, sizeof(uart_remembered_speeds[i].acPortName)) == 0) {
+      uiPortSpeed = uart_remembered_speeds[i].uiPortSpeed;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&uart_remembered_speeds_lock);
+  return uiPortSpeed;
+}
+
+/**
+ * @brief Remember the speed negotiated on this port, 0 forgets it
+ */
+void
+uart_remember_speed(const char *pcPortName, const uint32_t uiPortSpeed)
+{
+  size_t i;
+  pthread_mutex_lock(&uart_remembered_speeds_lock);
+  for (i = 0; i < UART_REMEMBERED_SPEEDS; i++) {
+    if (strncmp(uart_remembered_speeds[i].acPortName, pcPortName, sizeof(uart_remembered_speeds[i].acPortName)) == 0)
+      break;
+  }
+  if (i == UART_REMEMBERED_SPEEDS) {
+    // Recycle the oldest entry
+    i = uart_remembered_speeds_next;
+    uart_remembered_speeds_next = (uart_remembered_speeds_next + 1) % UART_REMEMBERED_SPEEDS;
+    snprintf(uart_remembered_speeds[i].acPortName, sizeof(uart_remembered_speeds[i].acPortName), "%s", pcPortName);
+  }
+  uart_remembered_speeds[i].uiPortSpeed = uiPortSpeed;
+  pthread_mutex_unlock(&uart_remembered_speeds_lock);
+}
+
+/**
+ * @brief Event handle, as an int, signaled when bytes are received
+ *
+ * Handles fit in 32 bits, even on 64-bit Windows. The event is manual-reset:
+ * it stays signaled until the bytes are read.
+ */
+int
+uart_get_fd(const serial_port sp)
+{
+  return (int)(intptr_t) UART_DATA(sp)->ovRead.hEvent;
+}
+
+/**
+ * @brief Count of bytes received but not read yet by uart_receive()
+ */
+size_t
+uart_pending(const serial_port sp)
+{
+  return UART_DATA(sp)->szRxLen;
 }
 
 uint32_t
@@ -159,83 +316,129 @@ uart_get_speed(const serial_port sp)
   return 0;
 }
 
-int
-uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout)
+/*
+ * Waits until the posted read completes, then makes its bytes pending in
+ * abtRxBuf
+ */
+static int
+uart_fill(struct serial_port_windows *spw, const bool bAbortable, int timeout)
 {
-  DWORD dwBytesToGet = (DWORD)szRx;
-  DWORD dwBytesReceived = 0;
-  DWORD dwTotalBytesReceived = 0;
-  BOOL res;
-
-  // XXX Put this part into uart_win32_timeouts () ?
-  DWORD timeout_ms = timeout;
-  COMMTIMEOUTS timeouts;
-  timeouts.ReadIntervalTimeout = 0;
-  timeouts.ReadTotalTimeoutMultiplier = 0;
-  timeouts.ReadTotalTimeoutConstant = timeout_ms;
-  timeouts.WriteTotalTimeoutMultiplier = 0;
-  timeouts.WriteTotalTimeoutConstant = timeout_ms;
-
-  if (!SetCommTimeouts(((struct serial_port_windows *) sp)->hPort, &timeouts)) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to apply new timeout settings.");
-    return NFC_EIO;
-  }
-  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Timeouts are set to %lu ms", timeout_ms);
-
-  // TODO Enhance the reception method
-  // - According to MSDN, it could be better to implement nfc_abort_command() mecanism using Cancello()
-  volatile bool *abort_flag_p = (volatile bool *)abort_p;
-  do {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "ReadFile");
-    res = ReadFile(((struct serial_port_windows *) sp)->hPort, pbtRx + dwTotalBytesReceived,
-                   dwBytesToGet,
-                   &dwBytesReceived, NULL);
-
-    dwTotalBytesReceived += dwBytesReceived;
-
-    if (!res) {
-      DWORD err = GetLastError();
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "ReadFile error: %lu", err);
-      return NFC_EIO;
-    } else if (dwBytesReceived == 0) {
+  const HANDLE ahEvents[2] = { spw->ovRead.hEvent, spw->hAbort };
+  DWORD dwRead;
+  int res;
+
+  while (true) {
+    if ((res = uart_post_read(spw)) < 0)
+      return res;
+    const DWORD dwWait = WaitForMultipleObjects(bAbortable ? 2 : 1, ahEvents, FALSE, timeout ? (DWORD) timeout : INFINITE);
+    if (dwWait == WAIT_TIMEOUT) {
+      // The read stays posted, nothing received later is lost
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Timeout!");
       return NFC_ETIMEOUT;
     }
-
-    if (((DWORD)szRx) > dwTotalBytesReceived) {
-      dwBytesToGet -= dwBytesReceived;
-    }
-
-    if (abort_flag_p != NULL && (*abort_flag_p) && dwTotalBytesReceived == 0) {
+    if (dwWait == WAIT_OBJECT_0 + 1) {
+      // Waiting for the auto-reset event consumed it
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Abort!");
       return NFC_EOPABORTED;
     }
-  } while (((DWORD)szRx) > dwTotalBytesReceived);
+    if (dwWait != WAIT_OBJECT_0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "WaitForMultipleObjects error: %lu", GetLastError());
+      return NFC_EIO;
+    }
+    spw->bReadPending = false;
+    if (!GetOverlappedResult(spw->hPort, &spw->ovRead, &dwRead, FALSE)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "ReadFile error: %lu", GetLastError());
+      return NFC_EIO;
+    }
+    if (dwRead > 0) {
+      spw->szRxPos = 0;
+      spw->szRxLen = dwRead;
+      return NFC_SUCCESS;
+    }
+  }
+}
+
+// Moves up to szRx pending bytes of the port buffer to pbtRx, posts the next read once it is empty
+static size_t
+uart_take(struct serial_port_windows *spw, uint8_t *pbtRx, const size_t szRx)
+{
+  const size_t n = MIN(spw->szRxLen, szRx);
+  memcpy(pbtRx, spw->abtRxBuf + spw->szRxPos, n);
+  spw->szRxPos += n;
+  spw->szRxLen -= n;
+  if (spw->szRxLen == 0)
+    uart_post_read(spw);
+  return n;
+}
+
+int
+uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, const bool bAbortable, int timeout)
+{
+  struct serial_port_windows *spw = UART_DATA(sp);
+  size_t received_bytes_count = 0;
+  int res;
+
+  while (true) {
+    // Serve what we already have
+    received_bytes_count += uart_take(spw, pbtRx + received_bytes_count, szRx - received_bytes_count);
+    if (received_bytes_count >= szRx)
+      break;
+    if ((res = uart_fill(spw, bAbortable && (received_bytes_count == 0), timeout)) < 0)
+      return res;
+  }
   LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
+  return NFC_SUCCESS;
+}
 
-  return (dwTotalBytesReceived == (DWORD) szRx) ? 0 : NFC_EIO;
+int
+uart_receive_frame(serial_port sp, uint8_t *pbtRx, const size_t szRx, uart_frame_parser parser, void *parser_data,
+                   const bool bAbortable, int timeout)
+{
+  struct serial_port_windows *spw = UART_DATA(sp);
+  size_t szFrame = 0;
+  int missing = parser(parser_data, pbtRx, 0, 0);
+  int res;
+
+  while (missing > 0) {
+    if (szFrame + (size_t) missing > szRx)
+      return NFC_EOVFLOW;
+    if ((spw->szRxLen == 0) && ((res = uart_fill(spw, bAbortable && (szFrame == 0), timeout)) < 0))
+      return res;
+    const size_t n = uart_take(spw, pbtRx + szFrame, (size_t) missing);
+    szFrame += n;
+    missing = parser(parser_data, pbtRx, szFrame, n);
+  }
+  LOG_HEX(LOG_GROUP, "RX", pbtRx, szFrame);
+  return (missing < 0) ? missing : (int) szFrame;
+}
+
+int
+uart_abort(serial_port sp)
+{
+  return SetEvent(UART_DATA(sp)->hAbort) ? NFC_SUCCESS : NFC_ESOFT;
 }
 
 int
 uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout)
 {
+  struct serial_port_windows *spw = UART_DATA(sp);
   DWORD   dwTxLen = 0;
 
-  COMMTIMEOUTS timeouts;
-  timeouts.ReadIntervalTimeout = 0;
-  timeouts.ReadTotalTimeoutMultiplier = 0;
-  timeouts.ReadTotalTimeoutConstant = timeout;
-  timeouts.WriteTotalTimeoutMultiplier = 0;
-  timeouts.WriteTotalTimeoutConstant = timeout;
-
-  if (!SetCommTimeouts(((struct serial_port_windows *) sp)->hPort, &timeouts)) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to apply new timeout settings.");
-    return NFC_EIO;
-  }
-
+  // hAbort is left alone: a pending abort is consumed by the wait it interrupts
   LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
-  if (!WriteFile(((struct serial_port_windows *) sp)->hPort, pbtTx, szTx, &dwTxLen, NULL)) {
-    return NFC_EIO;
+  if (!WriteFile(spw->hPort, pbtTx, szTx, &dwTxLen, &spw->ovWrite)) {
+    if (GetLastError() != ERROR_IO_PENDING)
+      return NFC_EIO;
+    if (WaitForSingleObject(spw->ovWrite.hEvent, timeout ? (DWORD) timeout : INFINITE) != WAIT_OBJECT_0) {
+      CancelIo(spw->hPort);
+      GetOverlappedResult(spw->hPort, &spw->ovWrite, &dwTxLen, TRUE);
+      // CancelIo() also cancelled the posted read
+      uart_cancel_read(spw);
+      uart_post_read(spw);
+      return NFC_ETIMEOUT;
+    }
   }
-  if (!dwTxLen)
+  if (!GetOverlappedResult(spw->hPort, &spw->ovWrite, &dwTxLen, FALSE) || !dwTxLen)
     return NFC_EIO;
   return 0;
 }
@@ -0,0 +1,667 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file usb-winusb.c
+ * @brief libusb 0.1 API subset implemented over WinUSB
+ *
+ * Devices bound to the WinUSB driver (by an INF file or Microsoft OS
+ * descriptors) show up on a single "bus-0" bus, as libusb-win32 does.
+ *
+ * Reads of a bulk IN endpoint are queued: once read, an endpoint keeps
+ * WINUSB_QUEUED_READS transfers posted, so the device answer lands in a
+ * transfer the host controller already knows of and a read that timed out
+ * loses nothing, the transfer stays posted for the next read. These transfers
+ * use RAW_IO, OUT endpoints use SHORT_PACKET_TERMINATE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contrib/windows.h"
+#include <setupapi.h>
+#include <winusb.h>
+
+#include "usbbus.h"
+#include "log.h"
+#define LOG_CATEGORY "libnfc.buses.winusb"
+#define LOG_GROUP    NFC_LOG_GROUP_LIBUSB
+
+// Transfers kept posted on each bulk IN endpoint
+#define WINUSB_QUEUED_READS 2
+// Size of these transfers, a multiple of any bulk max packet size, as RAW_IO wants
+#define WINUSB_READ_LEN 1024
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+// GUID_DEVINTERFACE_USB_DEVICE, registered by the hub driver for every USB device
+static const GUID winusb_guid_usb_device = { 0xA5DCBF10, 0x6530, 0x11D2, { 0x90, 0x1F, 0x00, 0xC0, 0x4F, 0xB9, 0x51, 0xED } };
+
+struct winusb_device {
+  char acPath[LIBUSB_PATH_MAX];
+  // Still in the bus list
+  bool bLinked;
+  bool bSeen;
+  // Open handles, the device is freed once unlinked and closed
+  unsigned int uiRefs;
+};
+
+struct winusb_transfer {
+  OVERLAPPED ov;
+  bool bPosted;
+  uint8_t abtBuf[WINUSB_READ_LEN];
+  // Received bytes not read yet
+  size_t szPos;
+  size_t szLen;
+};
+
+struct winusb_in_pipe {
+  uint8_t btEndPoint;
+  // Transfer the next read gets its bytes from
+  size_t szNext;
+  struct winusb_transfer transfers[WINUSB_QUEUED_READS];
+};
+
+struct usb_dev_handle {
+  struct usb_device *dev;
+  HANDLE hFile;
+  WINUSB_INTERFACE_HANDLE hWinUsb;
+  OVERLAPPED ovWrite;
+  struct winusb_in_pipe *apInPipes[USB_ENDPOINT_ADDRESS_MASK + 1];
+};
+
+static struct usb_bus winusb_bus = { NULL, NULL, "bus-0", NULL, 0 };
+static bool winusb_bus_found = false;
+static unsigned int winusb_next_device_number = 1;
+// Guards the device list against usb_open()/usb_close() from other threads
+static pthread_mutex_t winusb_lock = PTHREAD_MUTEX_INITIALIZER;
+static char winusb_error[128] = "";
+
+static int
+winusb_error_set(const char *pcWhat, const int res)
+{
+  snprintf(winusb_error, sizeof(winusb_error), "%s failed (error %lu)", pcWhat, GetLastError());
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", winusb_error);
+  return res;
+}
+
+void
+usb_init(void)
+{
+}
+
+void
+usb_set_debug(int level)
+{
+  (void) level;
+}
+
+char *
+usb_strerror(void)
+{
+  return winusb_error;
+}
+
+int
+usb_find_busses(void)
+{
+  if (winusb_bus_found)
+    return 0;
+  winusb_bus_found = true;
+  return 1;
+}
+
+struct usb_bus *
+usb_get_busses(void)
+{
+  return winusb_bus_found ? &winusb_bus : NULL;
+}
+
+static bool
+winusb_open_path(const char *pcPath, HANDLE *phFile, WINUSB_INTERFACE_HANDLE *phWinUsb)
+{
+  *phFile = CreateFileA(pcPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+  if (*phFile == INVALID_HANDLE_VALUE)
+    return winusb_error_set("CreateFile", false);
+  if (!WinUsb_Initialize(*phFile, phWinUsb)) {
+    winusb_error_set("WinUsb_Initialize", false);
+    CloseHandle(*phFile);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Only the alternate setting 0 of each interface is kept, as a single
+ * allocation: the configuration, then the interfaces, their descriptors and
+ * all the endpoints.
+ */
+static struct usb_config_descriptor *
+winusb_parse_config(const uint8_t *pbtConfig, const size_t szConfig)
+{
+  size_t szInterfaces = 0;
+  size_t szEndPoints = 0;
+  bool bAlt0 = false;
+
+  if ((szConfig < 9) || (pbtConfig[1] != USB_DT_CONFIG))
+    return NULL;
+  for (size_t szPos = 0; (szPos + 2 <= szConfig) && (pbtConfig[szPos] >= 2) && (szPos + pbtConfig[szPos] <= szConfig); szPos += pbtConfig[szPos]) {
+    if ((pbtConfig[szPos + 1] == USB_DT_INTERFACE) && (pbtConfig[szPos] >= 9)) {
+      if ((bAlt0 = (pbtConfig[szPos + 3] == 0)))
+        szInterfaces++;
+    } else if ((pbtConfig[szPos + 1] == USB_DT_ENDPOINT) && (pbtConfig[szPos] >= 7) && bAlt0) {
+      szEndPoints++;
+    }
+  }
+
+  struct usb_config_descriptor *config = calloc(1, sizeof(struct usb_config_descriptor) +
+                                                szInterfaces * (sizeof(struct usb_interface) + sizeof(struct usb_interface_descriptor)) +
+                                                szEndPoints * sizeof(struct usb_endpoint_descriptor));
+  if (config == NULL)
+    return NULL;
+  struct usb_interface *interfaces = (struct usb_interface *)(config + 1);
+  struct usb_interface_descriptor *altsettings = (struct usb_interface_descriptor *)(interfaces + szInterfaces);
+  struct usb_endpoint_descriptor *endpoints = (struct usb_endpoint_descriptor *)(altsettings + szInterfaces);
+
+  config->bLength = pbtConfig[0];
+  config->bDescriptorType = pbtConfig[1];
+  config->wTotalLength = pbtConfig[2] | (pbtConfig[3] << 8);
+  config->bNumInterfaces = szInterfaces;
+  config->bConfigurationValue = pbtConfig[5];
+  config->iConfiguration = pbtConfig[6];
+  config->bmAttributes = pbtConfig[7];
+  config->MaxPower = pbtConfig[8];
+  config->interface = szInterfaces ? interfaces : NULL;
+
+  struct usb_interface_descriptor *altsetting = NULL;
+  bAlt0 = false;
+  for (size_t szPos = 0; (szPos + 2 <= szConfig) && (pbtConfig[szPos] >= 2) && (szPos + pbtConfig[szPos] <= szConfig); szPos += pbtConfig[szPos]) {
+    const uint8_t *pbt = pbtConfig + szPos;
+    if ((pbt[1] == USB_DT_INTERFACE) && (pbt[0] >= 9)) {
+      if ((bAlt0 = (pbt[3] == 0))) {
+        altsetting = altsettings++;
+        interfaces->altsetting = altsetting;
+        interfaces->num_altsetting = 1;
+        interfaces++;
+        altsetting->bLength = pbt[0];
+        altsetting->bDescriptorType = pbt[1];
+        altsetting->bInterfaceNumber = pbt[2];
+        altsetting->bAlternateSetting = pbt[3];
+        // Counted below, from the endpoints actually there
+        altsetting->bNumEndpoints = 0;
+        altsetting->bInterfaceClass = pbt[5];
+        altsetting->bInterfaceSubClass = pbt[6];
+        altsetting->bInterfaceProtocol = pbt[7];
+        altsetting->iInterface = pbt[8];
+        altsetting->endpoint = endpoints;
+      }
+    } else if ((pbt[1] == USB_DT_ENDPOINT) && (pbt[0] >= 7) && bAlt0) {
+      endpoints->bLength = pbt[0];
+      endpoints->bDescriptorType = pbt[1];
+      endpoints->bEndpointAddress = pbt[2];
+      endpoints->bmAttributes = pbt[3];
+      endpoints->wMaxPacketSize = pbt[4] | (pbt[5] << 8);
+      endpoints->bInterval = pbt[6];
+      endpoints++;
+      altsetting->bNumEndpoints++;
+    }
+  }
+  return config;
+}
+
+// Reads the device and configuration descriptors, fails if the device is in use
+static bool
+winusb_read_descriptors(struct usb_device *dev)
+{
+  const struct winusb_device *wdev = dev->dev;
+  HANDLE hFile;
+  WINUSB_INTERFACE_HANDLE hWinUsb;
+  uint8_t abt[18];
+  ULONG ulLen;
+
+  if (!winusb_open_path(wdev->acPath, &hFile, &hWinUsb))
+    return false;
+  if (WinUsb_GetDescriptor(hWinUsb, USB_DT_DEVICE, 0, 0, abt, sizeof(abt), &ulLen) && (ulLen == sizeof(abt))) {
+    dev->descriptor.bLength = abt[0];
+    dev->descriptor.bDescriptorType = abt[1];
+    dev->descriptor.bcdUSB = abt[2] | (abt[3] << 8);
+    dev->descriptor.bDeviceClass = abt[4];
+    dev->descriptor.bDeviceSubClass = abt[5];
+    dev->descriptor.bDeviceProtocol = abt[6];
+    dev->descriptor.bMaxPacketSize0 = abt[7];
+    dev->descriptor.idVendor = abt[8] | (abt[9] << 8);
+    dev->descriptor.idProduct = abt[10] | (abt[11] << 8);
+    dev->descriptor.bcdDevice = abt[12] | (abt[13] << 8);
+    dev->descriptor.iManufacturer = abt[14];
+    dev->descriptor.iProduct = abt[15];
+    dev->descriptor.iSerialNumber = abt[16];
+    dev->descriptor.bNumConfigurations = abt[17];
+  }
+  // Configuration header first, for its total length
+  if (WinUsb_GetDescriptor(hWinUsb, USB_DT_CONFIG, 0, 0, abt, 9, &ulLen) && (ulLen == 9)) {
+    const size_t szConfig = abt[2] | (abt[3] << 8);
+    uint8_t *pbtConfig = malloc(szConfig);
+    if (pbtConfig && WinUsb_GetDescriptor(hWinUsb, USB_DT_CONFIG, 0, 0, pbtConfig, szConfig, &ulLen))
+      dev->config = winusb_parse_config(pbtConfig, ulLen);
+    free(pbtConfig);
+  }
+  WinUsb_Free(hWinUsb);
+  CloseHandle(hFile);
+  return dev->config != NULL;
+}
+
+// Called with winusb_lock held
+static void
+winusb_device_release(struct usb_device *dev)
+{
+  struct winusb_device *wdev = dev->dev;
+
+  if (wdev->bLinked || wdev->uiRefs)
+    return;
+  free(dev->config);
+  free(wdev);
+  free(dev);
+}
+
+static struct usb_device *
+winusb_device_new(HDEVINFO hInfo, SP_DEVINFO_DATA *pdd, const char *pcPath)
+{
+  struct usb_device *dev = calloc(1, sizeof(struct usb_device));
+  struct winusb_device *wdev = calloc(1, sizeof(struct winusb_device));
+  char acInstanceId[LIBUSB_PATH_MAX];
+  unsigned int uiVendor = 0, uiProduct = 0;
+
+  if ((dev == NULL) || (wdev == NULL)) {
+    free(dev);
+    free(wdev);
+    return NULL;
+  }
+  snprintf(wdev->acPath, sizeof(wdev->acPath), "%s", pcPath);
+  wdev->bLinked = wdev->bSeen = true;
+  dev->dev = wdev;
+  dev->bus = &winusb_bus;
+  // IDs are in the instance ID, "USB\VID_xxxx&PID_xxxx\...", the descriptors may not be readable now
+  if (SetupDiGetDeviceInstanceIdA(hInfo, pdd, acInstanceId, sizeof(acInstanceId), NULL))
+    sscanf(acInstanceId, "USB\\VID_%4x&PID_%4x", &uiVendor, &uiProduct);
+  dev->descriptor.idVendor = uiVendor;
+  dev->descriptor.idProduct = uiProduct;
+  winusb_read_descriptors(dev);
+  snprintf(dev->filename, sizeof(dev->filename), "winusb-%04u--0x%04x-0x%04x", winusb_next_device_number++,
+           dev->descriptor.idVendor, dev->descriptor.idProduct);
+  return dev;
+}
+
+int
+usb_find_devices(void)
+{
+  const HDEVINFO hInfo = SetupDiGetClassDevsA(&winusb_guid_usb_device, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+  SP_DEVICE_INTERFACE_DATA did = { .cbSize = sizeof(SP_DEVICE_INTERFACE_DATA) };
+  int changes = 0;
+
+  if (hInfo == INVALID_HANDLE_VALUE)
+    return winusb_error_set("SetupDiGetClassDevs", -EIO);
+
+  pthread_mutex_lock(&winusb_lock);
+  for (struct usb_device *dev = winusb_bus.devices; dev; dev = dev->next)
+    ((struct winusb_device *) dev->dev)->bSeen = false;
+
+  for (DWORD dwIndex = 0; SetupDiEnumDeviceInterfaces(hInfo, NULL, &winusb_guid_usb_device, dwIndex, &did); dwIndex++) {
+    SP_DEVINFO_DATA dd = { .cbSize = sizeof(SP_DEVINFO_DATA) };
+    SP_DEVICE_INTERFACE_DETAIL_DATA_A *pDetail;
+    DWORD dwSize = 0;
+    char acService[32];
+
+    SetupDiGetDeviceInterfaceDetailA(hInfo, &did, NULL, 0, &dwSize, NULL);
+    if ((dwSize == 0) || ((pDetail = malloc(dwSize)) == NULL))
+      continue;
+    pDetail->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA_A);
+    // Devices bound to another driver are not ours
+    if (!SetupDiGetDeviceInterfaceDetailA(hInfo, &did, pDetail, dwSize, NULL, &dd) ||
+        !SetupDiGetDeviceRegistryPropertyA(hInfo, &dd, SPDRP_SERVICE, NULL, (PBYTE) acService, sizeof(acService), NULL) ||
+        (_stricmp(acService, "WinUSB") != 0)) {
+      free(pDetail);
+      continue;
+    }
+
+    struct usb_device *dev;
+    for (dev = winusb_bus.devices; dev; dev = dev->next) {
+      if (strcmp(((struct winusb_device *) dev->dev)->acPath, pDetail->DevicePath) == 0)
+        break;
+    }
+    if (dev) {
+      ((struct winusb_device *) dev->dev)->bSeen = true;
+      // It was in use at the previous scan
+      if (dev->config == NULL)
+        winusb_read_descriptors(dev);
+    } else if ((dev = winusb_device_new(hInfo, &dd, pDetail->DevicePath))) {
+      dev->next = winusb_bus.devices;
+      if (winusb_bus.devices)
+        winusb_bus.devices->prev = dev;
+      winusb_bus.devices = dev;
+      changes++;
+    }
+    free(pDetail);
+  }
+  SetupDiDestroyDeviceInfoList(hInfo);
+
+  // Unplugged devices go, once closed
+  struct usb_device *next;
+  for (struct usb_device *dev = winusb_bus.devices; dev; dev = next) {
+    struct winusb_device *wdev = dev->dev;
+    next = dev->next;
+    if (wdev->bSeen)
+      continue;
+    if (dev->prev)
+      dev->prev->next = dev->next;
+    else
+      winusb_bus.devices = dev->next;
+    if (dev->next)
+      dev->next->prev = dev->prev;
+    wdev->bLinked = false;
+    winusb_device_release(dev);
+    changes++;
+  }
+  pthread_mutex_unlock(&winusb_lock);
+  return changes;
+}
+
+usb_dev_handle *
+usb_open(struct usb_device *dev)
+{
+  usb_dev_handle *udev = calloc(1, sizeof(usb_dev_handle));
+  struct winusb_device *wdev = dev->dev;
+
+  if (udev == NULL)
+    return NULL;
+  if (!winusb_open_path(wdev->acPath, &udev->hFile, &udev->hWinUsb)) {
+    free(udev);
+    return NULL;
+  }
+  if ((udev->ovWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL) {
+    WinUsb_Free(udev->hWinUsb);
+    CloseHandle(udev->hFile);
+    free(udev);
+    return NULL;
+  }
+  udev->dev = dev;
+  pthread_mutex_lock(&winusb_lock);
+  wdev->uiRefs++;
+  pthread_mutex_unlock(&winusb_lock);
+
+  // Bulk OUT transfers multiple of the max packet size get their zero length packet
+  if (dev->config && dev->config->interface) {
+    const struct usb_interface_descriptor *puid = dev->config->interface->altsetting;
+    UCHAR ucOn = TRUE;
+    for (uint8_t n = 0; n < puid->bNumEndpoints; n++) {
+      if ((puid->endpoint[n].bmAttributes == USB_ENDPOINT_TYPE_BULK) && !(puid->endpoint[n].bEndpointAddress & USB_ENDPOINT_IN))
+        WinUsb_SetPipePolicy(udev->hWinUsb, puid->endpoint[n].bEndpointAddress, SHORT_PACKET_TERMINATE, sizeof(ucOn), &ucOn);
+    }
+  }
+  return udev;
+}
+
+static void
+winusb_in_pipe_free(usb_dev_handle *udev, struct winusb_in_pipe *pipe)
+{
+  ULONG ulLen;
+
+  WinUsb_AbortPipe(udev->hWinUsb, pipe->btEndPoint);
+  for (size_t n = 0; n < WINUSB_QUEUED_READS; n++) {
+    struct winusb_transfer *transfer = &pipe->transfers[n];
+    if (transfer->bPosted)
+      WinUsb_GetOverlappedResult(udev->hWinUsb, &transfer->ov, &ulLen, TRUE);
+    if (transfer->ov.hEvent)
+      CloseHandle(transfer->ov.hEvent);
+  }
+  free(pipe);
+}
+
+int
+usb_close(usb_dev_handle *udev)
+{
+  struct usb_device *dev = udev->dev;
+
+  for (size_t n = 0; n <= USB_ENDPOINT_ADDRESS_MASK; n++) {
+    if (udev->apInPipes[n])
+      winusb_in_pipe_free(udev, udev->apInPipes[n]);
+  }
+  CloseHandle(udev->ovWrite.hEvent);
+  WinUsb_Free(udev->hWinUsb);
+  CloseHandle(udev->hFile);
+  free(udev);
+
+  pthread_mutex_lock(&winusb_lock);
+  ((struct winusb_device *) dev->dev)->uiRefs--;
+  winusb_device_release(dev);
+  pthread_mutex_unlock(&winusb_lock);
+  return 0;
+}
+
+struct usb_device *
+usb_device(usb_dev_handle *udev)
+{
+  return udev->dev;
+}
+
+int
+usb_get_string_simple(usb_dev_handle *udev, int index, char *buf, size_t buflen)
+{
+  uint8_t abt[255];
+  ULONG ulLen;
+
+  if (buflen == 0)
+    return -EINVAL;
+  // String descriptor 0 lists the languages, the first one is used
+  if (!WinUsb_GetDescriptor(udev->hWinUsb, USB_DT_STRING, 0, 0, abt, sizeof(abt), &ulLen) || (ulLen < 4))
+    return winusb_error_set("WinUsb_GetDescriptor", -EIO);
+  const USHORT usLanguage = abt[2] | (abt[3] << 8);
+  if (!WinUsb_GetDescriptor(udev->hWinUsb, USB_DT_STRING, (UCHAR) index, usLanguage, abt, sizeof(abt), &ulLen) ||
+      (ulLen < 2) || (abt[1] != USB_DT_STRING))
+    return winusb_error_set("WinUsb_GetDescriptor", -EIO);
+
+  // UTF-16LE to ASCII, as libusb 0.1 does
+  const size_t szDescriptor = MIN(abt[0], ulLen);
+  size_t szOut = 0;
+  for (size_t szIn = 2; (szIn + 1 < szDescriptor) && (szOut + 1 < buflen); szIn += 2)
+    buf[szOut++] = abt[szIn + 1] ? '?' : (char) abt[szIn];
+  buf[szOut] = '\0';
+  return szOut;
+}
+
+int
+usb_set_configuration(usb_dev_handle *udev, int configuration)
+{
+  // WinUSB always selects the first configuration and cannot change it
+  if (udev->dev->config && (configuration == udev->dev->config->bConfigurationValue))
+    return 0;
+  snprintf(winusb_error, sizeof(winusb_error), "Configuration %d not available with WinUSB", configuration);
+  return -EINVAL;
+}
+
+int
+usb_claim_interface(usb_dev_handle *udev, int interface)
+{
+  (void) udev;
+  // WinUsb_Initialize() has claimed the first interface
+  if (interface == 0)
+    return 0;
+  snprintf(winusb_error, sizeof(winusb_error), "Interface %d not available with WinUSB", interface);
+  return -EINVAL;
+}
+
+int
+usb_release_interface(usb_dev_handle *udev, int interface)
+{
+  (void) udev;
+  (void) interface;
+  return 0;
+}
+
+int
+usb_set_altinterface(usb_dev_handle *udev, int alternate)
+{
+  if (!WinUsb_SetCurrentAlternateSetting(udev->hWinUsb, (UCHAR) alternate))
+    return winusb_error_set("WinUsb_SetCurrentAlternateSetting", -EIO);
+  return 0;
+}
+
+int
+usb_reset(usb_dev_handle *udev)
+{
+  // WinUSB cannot reset the port: the pipes are reset (halts and data toggles)
+  if (udev->dev->config && udev->dev->config->interface) {
+    const struct usb_interface_descriptor *puid = udev->dev->config->interface->altsetting;
+    for (uint8_t n = 0; n < puid->bNumEndpoints; n++)
+      WinUsb_ResetPipe(udev->hWinUsb, puid->endpoint[n].bEndpointAddress);
+  }
+  return 0;
+}
+
+static int
+winusb_transfer_post(usb_dev_handle *udev, struct winusb_in_pipe *pipe, struct winusb_transfer *transfer)
+{
+  ResetEvent(transfer->ov.hEvent);
+  transfer->szPos = transfer->szLen = 0;
+  if (!WinUsb_ReadPipe(udev->hWinUsb, pipe->btEndPoint, transfer->abtBuf, sizeof(transfer->abtBuf), NULL, &transfer->ov) &&
+      (GetLastError() != ERROR_IO_PENDING))
+    return winusb_error_set("WinUsb_ReadPipe", -EIO);
+  transfer->bPosted = true;
+  return 0;
+}
+
+// Sets up the pipe at the first read of an endpoint and queues its transfers
+static struct winusb_in_pipe *
+winusb_in_pipe_get(usb_dev_handle *udev, const uint8_t btEndPoint)
+{
+  struct winusb_in_pipe **ppPipe = &udev->apInPipes[btEndPoint & USB_ENDPOINT_ADDRESS_MASK];
+  struct winusb_in_pipe *pipe;
+  WINUSB_PIPE_INFORMATION wpi;
+  ULONG ulMaxTransfer = 0;
+  ULONG ulLen = sizeof(ulMaxTransfer);
+  UCHAR ucOn = TRUE;
+
+  if (*ppPipe)
+    return *ppPipe;
+  if ((pipe = calloc(1, sizeof(struct winusb_in_pipe))) == NULL)
+    return NULL;
+  pipe->btEndPoint = btEndPoint;
+
+  // RAW_IO hands our transfers to the host controller as they are, they must fit its constraints
+  for (UCHAR n = 0; WinUsb_QueryPipe(udev->hWinUsb, 0, n, &wpi); n++) {
+    if (wpi.PipeId != btEndPoint)
+      continue;
+    if (WinUsb_GetPipePolicy(udev->hWinUsb, btEndPoint, MAXIMUM_TRANSFER_SIZE, &ulLen, &ulMaxTransfer) &&
+        (ulMaxTransfer >= WINUSB_READ_LEN) && wpi.MaximumPacketSize && ((WINUSB_READ_LEN % wpi.MaximumPacketSize) == 0))
+      WinUsb_SetPipePolicy(udev->hWinUsb, btEndPoint, RAW_IO, sizeof(ucOn), &ucOn);
+    break;
+  }
+
+  for (size_t n = 0; n < WINUSB_QUEUED_READS; n++) {
+    struct winusb_transfer *transfer = &pipe->transfers[n];
+    if (((transfer->ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL) || (winusb_transfer_post(udev, pipe, transfer) < 0)) {
+      winusb_in_pipe_free(udev, pipe);
+      return NULL;
+    }
+  }
+  *ppPipe = pipe;
+  return pipe;
+}
+
+int
+usb_bulk_read(usb_dev_handle *udev, int ep, char *bytes, int size, int timeout)
+{
+  struct winusb_in_pipe *pipe = winusb_in_pipe_get(udev, ep);
+  ULONG ulLen;
+
+  if (pipe == NULL)
+    return -EIO;
+  struct winusb_transfer *transfer = &pipe->transfers[pipe->szNext];
+  // Its previous post failed
+  if (!transfer->bPosted && (transfer->szLen == 0) && (winusb_transfer_post(udev, pipe, transfer) < 0))
+    return -EIO;
+  if (transfer->bPosted) {
+    const DWORD dwWait = WaitForSingleObject(transfer->ov.hEvent, timeout ? (DWORD) timeout : INFINITE);
+    if (dwWait == WAIT_TIMEOUT) {
+      // Still posted, what comes later is read next time
+      snprintf(winusb_error, sizeof(winusb_error), "%s", "Timeout");
+      return -USB_TIMEDOUT;
+    }
+    transfer->bPosted = false;
+    if ((dwWait != WAIT_OBJECT_0) || !WinUsb_GetOverlappedResult(udev->hWinUsb, &transfer->ov, &ulLen, FALSE)) {
+      winusb_error_set("WinUsb_ReadPipe", 0);
+      winusb_transfer_post(udev, pipe, transfer);
+      pipe->szNext = (pipe->szNext + 1) % WINUSB_QUEUED_READS;
+      return -EIO;
+    }
+    transfer->szPos = 0;
+    transfer->szLen = ulLen;
+  }
+
+  // Bytes the caller has no room for are kept for the next read
+  const size_t szRead = MIN((size_t) size, transfer->szLen);
+  memcpy(bytes, transfer->abtBuf + transfer->szPos, szRead);
+  transfer->szPos += szRead;
+  transfer->szLen -= szRead;
+  if (transfer->szLen == 0) {
+    winusb_transfer_post(udev, pipe, transfer);
+    pipe->szNext = (pipe->szNext + 1) % WINUSB_QUEUED_READS;
+  }
+  return szRead;
+}
+
+int
+usb_bulk_write(usb_dev_handle *udev, int ep, const char *bytes, int size, int timeout)
+{
+  ULONG ulLen = 0;
+
+  // SHORT_PACKET_TERMINATE already sent the zero length packet drivers send by hand
+  if (size == 0)
+    return 0;
+  ResetEvent(udev->ovWrite.hEvent);
+  if (!WinUsb_WritePipe(udev->hWinUsb, ep, (PUCHAR) bytes, size, NULL, &udev->ovWrite) && (GetLastError() != ERROR_IO_PENDING))
+    return winusb_error_set("WinUsb_WritePipe", -EIO);
+  if (WaitForSingleObject(udev->ovWrite.hEvent, timeout ? (DWORD) timeout : INFINITE) != WAIT_OBJECT_0) {
+    WinUsb_AbortPipe(udev->hWinUsb, ep);
+    WinUsb_GetOverlappedResult(udev->hWinUsb, &udev->ovWrite, &ulLen, TRUE);
+    snprintf(winusb_error, sizeof(winusb_error), "%s", "Timeout");
+    return -USB_TIMEDOUT;
+  }
+  if (!WinUsb_GetOverlappedResult(udev->hWinUsb, &udev->ovWrite, &ulLen, FALSE))
+    return winusb_error_set("WinUsb_WritePipe", -EIO);
+  return ulLen;
+}
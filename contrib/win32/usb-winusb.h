@@ -0,0 +1,170 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file usb-winusb.h
+ * @brief libusb 0.1 API subset implemented over WinUSB
+ *
+ * pn53x_usb and acr122_usb drivers are written against libusb 0.1: this
+ * header, with usb-winusb.c, lets them run on the native WinUSB driver
+ * instead of libusb-win32. Only what these drivers use is provided.
+ */
+
+#ifndef __NFC_USB_WINUSB_H__
+#define __NFC_USB_WINUSB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LIBUSB_PATH_MAX 512
+
+#define USB_DT_DEVICE           0x01
+#define USB_DT_CONFIG           0x02
+#define USB_DT_STRING           0x03
+#define USB_DT_INTERFACE        0x04
+#define USB_DT_ENDPOINT         0x05
+
+#define USB_ENDPOINT_IN         0x80
+#define USB_ENDPOINT_OUT        0x00
+#define USB_ENDPOINT_DIR_MASK   0x80
+#define USB_ENDPOINT_ADDRESS_MASK 0x0f
+
+#define USB_ENDPOINT_TYPE_CONTROL     0
+#define USB_ENDPOINT_TYPE_ISOCHRONOUS 1
+#define USB_ENDPOINT_TYPE_BULK        2
+#define USB_ENDPOINT_TYPE_INTERRUPT   3
+
+#define USB_MAXENDPOINTS  32
+#define USB_MAXINTERFACES 32
+
+struct usb_endpoint_descriptor {
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bEndpointAddress;
+  uint8_t  bmAttributes;
+  uint16_t wMaxPacketSize;
+  uint8_t  bInterval;
+};
+
+struct usb_interface_descriptor {
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bInterfaceNumber;
+  uint8_t  bAlternateSetting;
+  uint8_t  bNumEndpoints;
+  uint8_t  bInterfaceClass;
+  uint8_t  bInterfaceSubClass;
+  uint8_t  bInterfaceProtocol;
+  uint8_t  iInterface;
+
+  struct usb_endpoint_descriptor *endpoint;
+};
+
+struct usb_interface {
+  struct usb_interface_descriptor *altsetting;
+  int num_altsetting;
+};
+
+struct usb_config_descriptor {
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint16_t wTotalLength;
+  uint8_t  bNumInterfaces;
+  uint8_t  bConfigurationValue;
+  uint8_t  iConfiguration;
+  uint8_t  bmAttributes;
+  uint8_t  MaxPower;
+
+  struct usb_interface *interface;
+};
+
+struct usb_device_descriptor {
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint16_t bcdUSB;
+  uint8_t  bDeviceClass;
+  uint8_t  bDeviceSubClass;
+  uint8_t  bDeviceProtocol;
+  uint8_t  bMaxPacketSize0;
+  uint16_t idVendor;
+  uint16_t idProduct;
+  uint16_t bcdDevice;
+  uint8_t  iManufacturer;
+  uint8_t  iProduct;
+  uint8_t  iSerialNumber;
+  uint8_t  bNumConfigurations;
+};
+
+struct usb_bus;
+
+struct usb_device {
+  struct usb_device *next, *prev;
+
+  char filename[LIBUSB_PATH_MAX];
+
+  struct usb_bus *bus;
+
+  struct usb_device_descriptor descriptor;
+  // Only the active configuration, NULL when the device could not be opened to read it
+  struct usb_config_descriptor *config;
+
+  void *dev;
+};
+
+struct usb_bus {
+  struct usb_bus *next, *prev;
+
+  char dirname[LIBUSB_PATH_MAX];
+
+  struct usb_device *devices;
+  uint32_t location;
+};
+
+typedef struct usb_dev_handle usb_dev_handle;
+
+void usb_init(void);
+void usb_set_debug(int level);
+int usb_find_busses(void);
+int usb_find_devices(void);
+struct usb_bus *usb_get_busses(void);
+char *usb_strerror(void);
+
+usb_dev_handle *usb_open(struct usb_device *dev);
+int usb_close(usb_dev_handle *dev);
+struct usb_device *usb_device(usb_dev_handle *dev);
+int usb_get_string_simple(usb_dev_handle *dev, int index, char *buf, size_t buflen);
+
+int usb_set_configuration(usb_dev_handle *dev, int configuration);
+int usb_claim_interface(usb_dev_handle *dev, int interface);
+int usb_release_interface(usb_dev_handle *dev, int interface);
+int usb_set_altinterface(usb_dev_handle *dev, int alternate);
+int usb_reset(usb_dev_handle *dev);
+
+int usb_bulk_write(usb_dev_handle *dev, int ep, const char *bytes, int size, int timeout);
+int usb_bulk_read(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
+
+#endif // __NFC_USB_WINUSB_H__
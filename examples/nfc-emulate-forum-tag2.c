@@ -79,6 +79,7 @@
 #include <nfc/nfc-emulation.h>
 
 #include "utils/nfc-utils.h"
+#include "utils/ndef.h"
 
 static nfc_device *pnd;
 static nfc_context *context;
@@ -95,69 +96,36 @@ stop_emulation(int sig)
   }
 }
 
-static uint8_t __nfcforum_tag2_memory_area[] = {
+#define NFCFORUM_TAG2_DATA_AREA 16
+
+static uint8_t __nfcforum_tag2_memory_area[64] = {
   0x00, 0x00, 0x00, 0x00,  // Block 0
   0x00, 0x00, 0x00, 0x00,
   0x00, 0x00, 0xFF, 0xFF,  // Block 2 (Static lock bytes: CC area and data area are read-only locked)
   0xE1, 0x10, 0x06, 0x0F,  // Block 3 (CC - NFC-Forum Tag Type 2 version 1.0, Data area (from block 4 to the end) is 48 bytes, Read-only mode)
-
-  0x03, 33,   0xd1, 0x02,  // Block 4 (NDEF)
-  0x1c, 0x53, 0x70, 0x91,
-  0x01, 0x09, 0x54, 0x02,
-  0x65, 0x6e, 0x4c, 0x69,
-
-  0x62, 0x6e, 0x66, 0x63,
-  0x51, 0x01, 0x0b, 0x55,
-  0x03, 0x6c, 0x69, 0x62,
-  0x6e, 0x66, 0x63, 0x2e,
-
-  0x6f, 0x72, 0x67, 0x00,
-  0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00,
+  // Block 4 to the end: NDEF message TLV, written by ndef_message_write()
 };
 
-#define READ 		0x30
-#define WRITE 		0xA2
-#define SECTOR_SELECT 	0xC2
-
-#define HALT 		0x50
+// Smart Poster titled "Libnfc" pointing to http://libnfc.org, written in place
 static int
-nfcforum_tag2_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+ndef_message_write(uint8_t *pbtData, const size_t szData)
 {
-  int res = 0;
-
-  uint8_t *nfcforum_tag2_memory_area = (uint8_t *)(emulator->user_data);
-
-  printf("    In: ");
-  print_hex(data_in, data_in_len);
-
-  switch (data_in[0]) {
-    case READ:
-      if (data_out_len >= 16) {
-        memcpy(data_out, nfcforum_tag2_memory_area + (data_in[1] * 4), 16);
-        res = 16;
-      } else {
-        res = -ENOSPC;
-      }
-      break;
-    case HALT:
-      printf("HALT sent\n");
-      res = -ECONNABORTED;
-      break;
-    default:
-      printf("Unknown command: 0x%02x\n", data_in[0]);
-      res = -ENOTSUP;
-  }
-
-  if (res < 0) {
-    ERR("%s (%d)", strerror(-res), -res);
-  } else {
-    printf("    Out: ");
-    print_hex(data_out, res);
-  }
-
-  return res;
+  static const uint8_t abtTitle[] = { 0x02, 'e', 'n', 'L', 'i', 'b', 'n', 'f', 'c' };
+  static const uint8_t abtUri[] = { 0x03, 'l', 'i', 'b', 'n', 'f', 'c', '.', 'o', 'r', 'g' };
+  ndef_writer nw, nwPoster;
+  uint8_t *pbtPoster;
+  size_t szRoom;
+  int res;
+
+  ndef_writer_init(&nw, pbtData, szData, NDEF_FRAMING_TLV);
+  if (!(pbtPoster = ndef_writer_begin_record(&nw, NDEF_TNF_WELL_KNOWN, (const uint8_t *) "Sp", 2, NULL, 0, &szRoom)))
+    return -1;
+  ndef_writer_init(&nwPoster, pbtPoster, szRoom, NDEF_FRAMING_NONE);
+  ndef_writer_add_record(&nwPoster, NDEF_TNF_WELL_KNOWN, (const uint8_t *) "T", 1, abtTitle, sizeof(abtTitle));
+  ndef_writer_add_record(&nwPoster, NDEF_TNF_WELL_KNOWN, (const uint8_t *) "U", 1, abtUri, sizeof(abtUri));
+  if (((res = ndef_writer_finish(&nwPoster)) < 0) || (ndef_writer_end_record(&nw, res) < 0))
+    return -1;
+  return ndef_writer_finish(&nw);
 }
 
 int
@@ -182,14 +150,22 @@ main(int argc, char *argv[])
     }
   };
 
+  // READ answers are computed once, the emulation loop only copies them
+  static struct nfc_emulation_tag2 tag2;
+  if ((ndef_message_write(__nfcforum_tag2_memory_area + NFCFORUM_TAG2_DATA_AREA, sizeof(__nfcforum_tag2_memory_area) - NFCFORUM_TAG2_DATA_AREA) < 0) ||
+      (nfc_emulation_tag2_init(&tag2, __nfcforum_tag2_memory_area, sizeof(__nfcforum_tag2_memory_area), false) < 0)) {
+    ERR("Invalid tag memory");
+    exit(EXIT_FAILURE);
+  }
+
   struct nfc_emulation_state_machine state_machine = {
-    .io = nfcforum_tag2_io
+    .io = nfc_emulation_tag2_io,
+    .data = &tag2,
   };
 
   struct nfc_emulator emulator = {
     .target = &nt,
     .state_machine = &state_machine,
-    .user_data = __nfcforum_tag2_memory_area,
   };
 
   signal(SIGINT, stop_emulation);
@@ -210,7 +186,10 @@ main(int argc, char *argv[])
   printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
   printf("Emulating NDEF tag now, please touch it with a second NFC device\n");
 
-  if (nfc_emulate_target(pnd, &emulator, 0) < 0) {
+  int res;
+  if ((res = nfc_emulate_target(pnd, &emulator, 0)) == NFC_ETGRELEASED) {
+    printf("HALT sent\n");
+  } else if (res < 0) {
     nfc_perror(pnd, argv[0]);
     nfc_close(pnd);
     nfc_exit(context);
@@ -57,6 +57,7 @@
 #include <signal.h>
 
 #include <nfc/nfc.h>
+#include <nfc/nfc-emulation.h>
 
 #include "utils/nfc-utils.h"
 
@@ -67,10 +68,13 @@ static int szRecvBits;
 static nfc_device *pnd;
 static nfc_context *context;
 
-// ISO14443A Anti-Collision response
-uint8_t  abtAtqa[2] = { 0x04, 0x00 };
-uint8_t  abtUidBcc[5] = { 0xDE, 0xAD, 0xBE, 0xEF, 0x22 };
-uint8_t  abtSak[9] = { 0x08, 0xb6, 0xdd };
+// ISO14443A tag answering the anti-collision
+static nfc_iso14443a_info naiEmulated = {
+  .abtAtqa = { 0x00, 0x04 },
+  .btSak = 0x08,
+  .szUidLen = 4,
+  .abtUid = { 0xDE, 0xAD, 0xBE, 0xEF },
+};
 
 static void
 intr_hdlr(int sig)
@@ -91,7 +95,7 @@ print_usage(char *argv[])
   printf("Usage: %s [OPTIONS] [UID]\n", argv[0]);
   printf("Options:\n");
   printf("\t-h\tHelp. Print this message.\n");
-  printf("\t-q\tQuiet mode. Silent output: received and sent frames will not be shown (improves timing).\n");
+  printf("\t-q\tQuiet mode. Silent output: frames outside the anti-collision will not be shown.\n");
   printf("\n");
   printf("\t[UID]\tUID to emulate, specified as 8 HEX digits (default is DEADBEEF).\n");
 }
@@ -99,8 +103,8 @@ print_usage(char *argv[])
 int
 main(int argc, char *argv[])
 {
-  uint8_t *pbtTx = NULL;
-  size_t  szTxBits;
+  struct nfc_emulation_raw_rule rules[NFC_EMULATION_UID_MAX_RULES];
+  int     szRules;
   bool    quiet_output = false;
 
   int     arg,
@@ -117,11 +121,9 @@ main(int argc, char *argv[])
     } else if ((arg == argc - 1) && (strlen(argv[arg]) == 8)) {         // See if UID was specified as HEX string
       uint8_t  abtTmp[3] = { 0x00, 0x00, 0x00 };
       printf("[+] Using UID: %s\n", argv[arg]);
-      abtUidBcc[4] = 0x00;
       for (i = 0; i < 4; ++i) {
         memcpy(abtTmp, argv[arg] + i * 2, 2);
-        abtUidBcc[i] = (uint8_t) strtol((char *) abtTmp, NULL, 16);
-        abtUidBcc[4] ^= abtUidBcc[i];
+        naiEmulated.abtUid[i] = (uint8_t) strtol((char *) abtTmp, NULL, 16);
       }
     } else {
       ERR("%s is not supported option.", argv[arg]);
@@ -182,62 +184,27 @@ main(int argc, char *argv[])
   }
   printf("[+] Received initiator command: ");
   print_hex_bits(abtRecv, (size_t) szRecvBits);
-  printf("[+] Configuring communication\n");
-  if ((nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false) < 0) || (nfc_device_set_property_bool(pnd, NP_HANDLE_PARITY, true) < 0)) {
-    nfc_perror(pnd, "nfc_device_set_property_bool");
+  // Answers are all prepared before the reader starts the anti-collision
+  if ((szRules = nfc_emulation_uid_rules(&naiEmulated, rules)) < 0) {
+    ERR("Could not prepare the anti-collision answers");
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
-  printf("[+] Done, the emulated tag is initialized with UID: %02X%02X%02X%02X\n\n", abtUidBcc[0], abtUidBcc[1],
-         abtUidBcc[2], abtUidBcc[3]);
+  printf("[+] Done, the emulated tag is initialized with UID: %02X%02X%02X%02X\n\n", naiEmulated.abtUid[0], naiEmulated.abtUid[1],
+         naiEmulated.abtUid[2], naiEmulated.abtUid[3]);
 
   while (true) {
-    // Test if we received a frame
-    if ((szRecvBits = nfc_target_receive_bits(pnd, abtRecv, sizeof(abtRecv), 0)) > 0) {
-      // Prepare the command to send back for the anti-collision request
-      switch (szRecvBits) {
-        case 7:                  // Request or Wakeup
-          pbtTx = abtAtqa;
-          szTxBits = 16;
-          // New anti-collsion session started
-          if (!quiet_output)
-            printf("\n");
-          break;
-
-        case 16:                 // Select All
-          pbtTx = abtUidBcc;
-          szTxBits = 40;
-          break;
-
-        case 72:                 // Select Tag
-          pbtTx = abtSak;
-          szTxBits = 24;
-          break;
-
-        default:                 // unknown length?
-          szTxBits = 0;
-          break;
-      }
-
-      if (!quiet_output) {
-        printf("R: ");
-        print_hex_bits(abtRecv, (size_t) szRecvBits);
-      }
-      // Test if we know how to respond
-      if (szTxBits) {
-        // Send and print the command to the screen
-        if (nfc_target_send_bits(pnd, pbtTx, szTxBits, NULL) < 0) {
-          nfc_perror(pnd, "nfc_target_send_bits");
-          nfc_close(pnd);
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-        if (!quiet_output) {
-          printf("T: ");
-          print_hex_bits(pbtTx, szTxBits);
-        }
-      }
+    // The anti-collision is answered within the library, other frames come back here
+    if ((szRecvBits = nfc_emulate_raw(pnd, rules, szRules, abtRecv, sizeof(abtRecv))) < 0) {
+      nfc_perror(pnd, "nfc_emulate_raw");
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    if (!quiet_output) {
+      printf("R: ");
+      print_hex_bits(abtRecv, (size_t) szRecvBits);
     }
   }
 }
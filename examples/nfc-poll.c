@@ -60,10 +60,12 @@
 
 static nfc_device *pnd = NULL;
 static nfc_context *context;
+static volatile sig_atomic_t quitting = 0;
 
 static void stop_polling(int sig)
 {
   (void) sig;
+  quitting = 1;
   if (pnd != NULL)
     nfc_abort_command(pnd);
   else {
@@ -75,14 +77,56 @@ static void stop_polling(int sig)
 static void
 print_usage(const char *progname)
 {
-  printf("usage: %s [-v]\n", progname);
+  printf("usage: %s [-v] [-c] [-t X]\n", progname);
   printf("  -v\t verbose display\n");
+  printf("  -c\t keep polling, reporting targets as they arrive and leave\n");
+  printf("  -t X\t poll only for types according to bitfield X:\n");
+  printf("\t   1: ISO14443A\n");
+  printf("\t   2: Felica (212 kbps)\n");
+  printf("\t   4: Felica (424 kbps)\n");
+  printf("\t   8: ISO14443B\n");
+  printf("\t  16: ISO14443B'\n");
+  printf("\t  32: ISO14443B-2 ST SRx\n");
+  printf("\t  64: ISO14443B-2 ASK CTx\n");
+  printf("\t 128: ISO14443A-3 Jewel\n");
+  printf("\t 256: ISO14443A-2 NFC Barcode\n");
+  printf("\tDefault is ISO14443A, ISO14443B, Felica and Jewel.\n");
+  printf("\tTypes the device cannot auto-poll are probed in turn between the auto-polls.\n");
+}
+
+// Target types, in the order of the -t bitfield
+static const nfc_modulation nmTypes[] = {
+  { .nmt = NMT_ISO14443A, .nbr = NBR_106 },
+  { .nmt = NMT_FELICA, .nbr = NBR_212 },
+  { .nmt = NMT_FELICA, .nbr = NBR_424 },
+  { .nmt = NMT_ISO14443B, .nbr = NBR_106 },
+  { .nmt = NMT_ISO14443BI, .nbr = NBR_106 },
+  { .nmt = NMT_ISO14443B2SR, .nbr = NBR_106 },
+  { .nmt = NMT_ISO14443B2CT, .nbr = NBR_106 },
+  { .nmt = NMT_JEWEL, .nbr = NBR_106 },
+  { .nmt = NMT_BARCODE, .nbr = NBR_106 },
+};
+
+static void
+session_event(nfc_device *dev, const nfc_poll_event npe, const nfc_target *pnt, void *user_data)
+{
+  (void) dev;
+  if (npe == NFC_POLL_ARRIVED) {
+    printf("Target arrived:\n");
+    print_nfc_target(pnt, *(const bool *) user_data);
+  } else {
+    printf("Target left:\n");
+    print_nfc_target(pnt, false);
+  }
+  fflush(stdout);
 }
 
 int
 main(int argc, const char *argv[])
 {
   bool verbose = false;
+  bool continuous = false;
+  int mask = 0;
 
   signal(SIGINT, stop_polling);
 
@@ -90,9 +134,18 @@ main(int argc, const char *argv[])
   const char *acLibnfcVersion = nfc_version();
 
   printf("%s uses libnfc %s\n", argv[0], acLibnfcVersion);
-  if (argc != 1) {
-    if ((argc == 2) && (0 == strcmp("-v", argv[1]))) {
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp("-v", argv[arg])) {
       verbose = true;
+    } else if (0 == strcmp("-c", argv[arg])) {
+      continuous = true;
+    } else if ((0 == strcmp("-t", argv[arg])) && (arg + 1 < argc)) {
+      arg++;
+      mask = atoi(argv[arg]);
+      if ((mask < 1) || (mask > 0x1ff)) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
     } else {
       print_usage(argv[0]);
       exit(EXIT_FAILURE);
@@ -101,14 +154,21 @@ main(int argc, const char *argv[])
 
   const uint8_t uiPollNr = 20;
   const uint8_t uiPeriod = 2;
-  const nfc_modulation nmModulations[5] = {
+  nfc_modulation nmModulations[sizeof(nmTypes) / sizeof(nmTypes[0])] = {
     { .nmt = NMT_ISO14443A, .nbr = NBR_106 },
     { .nmt = NMT_ISO14443B, .nbr = NBR_106 },
     { .nmt = NMT_FELICA, .nbr = NBR_212 },
     { .nmt = NMT_FELICA, .nbr = NBR_424 },
     { .nmt = NMT_JEWEL, .nbr = NBR_106 },
   };
-  const size_t szModulations = 5;
+  size_t szModulations = 5;
+  if (mask) {
+    szModulations = 0;
+    for (size_t t = 0; t < sizeof(nmTypes) / sizeof(nmTypes[0]); t++) {
+      if (mask & (1 << t))
+        nmModulations[szModulations++] = nmTypes[t];
+    }
+  }
 
   nfc_target nt;
   int res = 0;
@@ -135,6 +195,28 @@ main(int argc, const char *argv[])
   }
 
   printf("NFC reader: %s opened\n", nfc_device_get_name(pnd));
+  if (continuous) {
+    // A target has to stay unseen during 500 ms to be reported as gone
+    nfc_poll_session *ps = nfc_poll_session_new(pnd, nmModulations, szModulations, 500, session_event, &verbose);
+    if (ps == NULL) {
+      ERR("Unable to create poll session (malloc)");
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    printf("NFC device polls until interrupted\n");
+    while (!quitting) {
+      if ((res = nfc_poll_session_step(ps)) < 0) {
+        if (!quitting)
+          nfc_perror(pnd, "nfc_poll_session_step");
+        break;
+      }
+    }
+    nfc_poll_session_free(ps);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit((res < 0) && !quitting ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
   printf("NFC device will poll during %ld ms (%u pollings of %lu ms for %" PRIdPTR " modulations)\n", (unsigned long) uiPollNr * szModulations * uiPeriod * 150, uiPollNr, (unsigned long) uiPeriod * 150, szModulations);
   if ((res = nfc_initiator_poll_target(pnd, nmModulations, szModulations, uiPollNr, uiPeriod, &nt))  < 0) {
     nfc_perror(pnd, "nfc_initiator_poll_target");
@@ -58,14 +58,11 @@
 #define MAX_DEVICE_COUNT 2
 
 static uint8_t abtReaderRx[MAX_FRAME_LEN];
-static uint8_t abtReaderRxPar[MAX_FRAME_LEN];
 static int szReaderRxBits;
-static uint8_t abtTagRx[MAX_FRAME_LEN];
-static uint8_t abtTagRxPar[MAX_FRAME_LEN];
-static int szTagRxBits;
 static nfc_device *pndReader;
 static nfc_device *pndTag;
 static bool quitting = false;
+static bool quiet_output = false;
 
 static void
 intr_hdlr(int sig)
@@ -76,6 +73,27 @@ intr_hdlr(int sig)
   return;
 }
 
+static int
+relay_frame(const uint8_t *pbtCommand, const size_t szCommand, const uint8_t *pbtCommandPar,
+            const uint8_t *pbtAnswer, const size_t szAnswer, const uint8_t *pbtAnswerPar, void *user_data)
+{
+  (void) user_data;
+  if (!quiet_output) {
+    // A new session starts with REQA
+    if (szCommand == 7 && pbtCommand[0] == 0x26)
+      printf("\n");
+    // Print the reader frame to the screen
+    printf("R: ");
+    print_hex_par(pbtCommand, szCommand, pbtCommandPar);
+    // Print the tag frame to the screen
+    if (szAnswer) {
+      printf("T: ");
+      print_hex_par(pbtAnswer, szAnswer, pbtAnswerPar);
+    }
+  }
+  return quitting ? -1 : 0;
+}
+
 static void
 print_usage(char *argv[])
 {
@@ -89,7 +107,6 @@ int
 main(int argc, char *argv[])
 {
   int     arg;
-  bool    quiet_output = false;
   const char *acLibnfcVersion = nfc_version();
 
   // Get commandline options
@@ -208,52 +225,19 @@ main(int argc, char *argv[])
   }
   printf("%s", "Done, relaying frames now!");
 
-  while (!quitting) {
-    // Test if we received a frame from the reader
-    if ((szReaderRxBits = nfc_target_receive_bits(pndTag, abtReaderRx, sizeof(abtReaderRx), abtReaderRxPar)) > 0) {
-      // Drop down the field before sending a REQA command and start a new session
-      if (szReaderRxBits == 7 && abtReaderRx[0] == 0x26) {
-        // Drop down field for a very short time (original tag will reboot)
-        if (nfc_device_set_property_bool(pndReader, NP_ACTIVATE_FIELD, false) < 0) {
-          nfc_perror(pndReader, "nfc_device_set_property_bool");
-          nfc_close(pndTag);
-          nfc_close(pndReader);
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-        if (!quiet_output)
-          printf("\n");
-        if (nfc_device_set_property_bool(pndReader, NP_ACTIVATE_FIELD, true) < 0) {
-          nfc_perror(pndReader, "nfc_device_set_property_bool");
-          nfc_close(pndTag);
-          nfc_close(pndReader);
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-      }
-      // Print the reader frame to the screen
-      if (!quiet_output) {
-        printf("R: ");
-        print_hex_par(abtReaderRx, (size_t) szReaderRxBits, abtReaderRxPar);
-      }
-      // Forward the frame to the original tag
-      if ((szTagRxBits = nfc_initiator_transceive_bits
-                         (pndReader, abtReaderRx, (size_t) szReaderRxBits, abtReaderRxPar, abtTagRx, sizeof(abtTagRx), abtTagRxPar)) > 0) {
-        // Redirect the answer back to the reader
-        if (nfc_target_send_bits(pndTag, abtTagRx, szTagRxBits, abtTagRxPar) < 0) {
-          nfc_perror(pndTag, "nfc_target_send_bits");
-          nfc_close(pndTag);
-          nfc_close(pndReader);
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-        // Print the tag frame to the screen
-        if (!quiet_output) {
-          printf("T: ");
-          print_hex_par(abtTagRx, szTagRxBits, abtTagRxPar);
-        }
-      }
-    }
+  // Frames go straight from one device to the other, the callback only prints them
+  const nfc_relay_options nro = {
+    .nrm = NFC_RELAY_FRAMES,
+    .iFdIn = -1,
+    .iFdOut = -1,
+    .callback = relay_frame,
+  };
+  if (nfc_relay_run(pndTag, pndReader, &nro) < 0) {
+    nfc_perror(pndTag, "nfc_relay_run");
+    nfc_close(pndTag);
+    nfc_close(pndReader);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
   }
 
   nfc_close(pndTag);
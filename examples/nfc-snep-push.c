@@ -0,0 +1,186 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-snep-push.c
+ * @brief Pushes an URI to an LLCP peer, e.g. a phone, with SNEP
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include <nfc/nfc.h>
+
+#include "utils/nfc-utils.h"
+#include "utils/llcp.h"
+#include "utils/ndef.h"
+#include "utils/snep.h"
+
+#define DEFAULT_URI "https://github.com/nfc-tools/libnfc"
+#define MAX_NDEF_LEN 1024
+
+static nfc_device *pnd;
+static nfc_context *context;
+static llcp_link ll;
+
+static void stop_snep_push(int sig)
+{
+  (void) sig;
+  if (pnd != NULL) {
+    nfc_abort_command(pnd);
+  } else {
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("Usage: %s [uri]\n", progname);
+  printf("  uri     URI to push, default: %s\n", DEFAULT_URI);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  llcp_connection lc;
+  nfc_target nt;
+  uint8_t  abtPayload[MAX_NDEF_LEN];
+  uint8_t  abtNdef[MAX_NDEF_LEN];
+  int  res;
+
+  if (argc > 2) {
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  const char *pcUri = (argc > 1) ? argv[1] : DEFAULT_URI;
+  const size_t szUri = strlen(pcUri);
+  if (szUri + 1 > sizeof(abtPayload)) {
+    ERR("URI too long");
+    exit(EXIT_FAILURE);
+  }
+
+  // URI record, without abbreviation of the URI
+  ndef_writer nw;
+  abtPayload[0] = 0x00;
+  memcpy(abtPayload + 1, pcUri, szUri);
+  ndef_writer_init(&nw, abtNdef, sizeof(abtNdef), NDEF_FRAMING_NONE);
+  ndef_writer_add_record(&nw, NDEF_TNF_WELL_KNOWN, (const uint8_t *) "U", 1, abtPayload, szUri + 1);
+  const int szNdef = ndef_writer_finish(&nw);
+  if (szNdef < 0) {
+    ERR("URI too long");
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  pnd = nfc_open(context, NULL);
+  if (pnd == NULL) {
+    ERR("Unable to open NFC device.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
+
+  signal(SIGINT, stop_snep_push);
+
+  if (nfc_initiator_init(pnd) < 0) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  // The LLCP parameters go in the general bytes of the ATR_REQ
+  llcp_link_init(&ll, pnd, true, 0, 0);
+  nfc_dep_info ndi = {
+    .abtNFCID3 = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xff, 0x00, 0x00 },
+    .ndm = NDM_PASSIVE,
+  };
+  ndi.szGB = llcp_link_general_bytes(&ll, ndi.abtGB, sizeof(ndi.abtGB));
+
+  printf("Waiting for an LLCP peer...\n");
+  if (nfc_initiator_select_dep_target(pnd, NDM_PASSIVE, NBR_424, &ndi, &nt, 1000) < 0) {
+    nfc_perror(pnd, "nfc_initiator_select_dep_target");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  print_nfc_target(&nt, false);
+
+  if ((res = llcp_link_activate(&ll, nt.nti.ndi.abtGB, nt.nti.ndi.szGB)) < 0) {
+    ERR("Target does not speak LLCP");
+    nfc_initiator_deselect_target(pnd);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if ((res = snep_client_connect(&ll, &lc)) < 0) {
+    ERR("Unable to connect to the SNEP server (%d)", res);
+    nfc_initiator_deselect_target(pnd);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("Pushing: %s\n", pcUri);
+  res = snep_put(&ll, &lc, abtNdef, (size_t) szNdef);
+  if (res < 0) {
+    ERR("Unable to push the NDEF message (%d)", res);
+  } else if (res != SNEP_RES_SUCCESS) {
+    ERR("SNEP server answered 0x%02x", res);
+  } else {
+    printf("Pushed.\n");
+  }
+
+  llcp_disconnect(&ll, &lc);
+  llcp_link_deactivate(&ll);
+  nfc_initiator_deselect_target(pnd);
+  nfc_close(pnd);
+  nfc_exit(context);
+  exit((res == SNEP_RES_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
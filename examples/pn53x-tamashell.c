@@ -49,7 +49,9 @@
 #  include <readline/history.h>
 #endif //HAVE_READLINE
 
+#include <inttypes.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
@@ -67,6 +69,18 @@
 #  define msleep Sleep
 #endif
 
+static double
+now_us(void)
+{
+#ifndef _WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+#else
+  return GetTickCount() * 1e3;
+#endif
+}
+
 
 #include <nfc/nfc.h>
 
@@ -75,6 +89,161 @@
 
 #define MAX_FRAME_LEN 264
 
+/*
+ * Compiled scripts (-n): each line is parsed once into a step, then the steps
+ * are run again and again without printing anything but failures. A command
+ * may be followed by "=" and its expected answer, where ".." matches any byte.
+ */
+struct tama_step {
+  unsigned int uiLine;
+  /** Pause, for "p" lines (no command then) */
+  int iPauseMs;
+  size_t szTx;
+  uint8_t abtTx[MAX_FRAME_LEN];
+  bool bExpected;
+  size_t szExpected;
+  uint8_t abtExpected[MAX_FRAME_LEN];
+  uint8_t abtMask[MAX_FRAME_LEN];
+};
+
+static uint8_t
+hex_nibble(const char c)
+{
+  return isdigit((unsigned char) c) ? (c - '0') : ((tolower((unsigned char) c) - 'a') + 10);
+}
+
+// Reads hex bytes up to the first other character, ".." wildcards too if pbtMask
+static const char *
+parse_hex(const char *pc, uint8_t *pbt, uint8_t *pbtMask, size_t *psz)
+{
+  size_t sz = 0;
+
+  while (sz < MAX_FRAME_LEN) {
+    while (isspace((unsigned char) *pc)) {
+      pc++;
+    }
+    if (pbtMask && (pc[0] == '.') && (pc[1] == '.')) {
+      pbt[sz] = 0x00;
+      pbtMask[sz++] = 0x00;
+      pc += 2;
+      continue;
+    }
+    if (!isxdigit((unsigned char) *pc)) {
+      break;
+    }
+    uint8_t bt = hex_nibble(*pc++);
+    if (isxdigit((unsigned char) *pc)) {
+      bt = (bt << 4) | hex_nibble(*pc++);
+    }
+    pbt[sz] = bt;
+    if (pbtMask) {
+      pbtMask[sz] = 0xff;
+    }
+    sz++;
+  }
+  *psz = sz;
+  return pc;
+}
+
+static struct tama_step *
+script_compile(FILE *input, size_t *pszSteps)
+{
+  char acLine[1024];
+  struct tama_step *steps = NULL;
+  size_t szAlloc = 0;
+  unsigned int uiLine = 0;
+
+  *pszSteps = 0;
+  while (fgets(acLine, sizeof(acLine), input)) {
+    struct tama_step step;
+    const char *pc = acLine;
+
+    uiLine++;
+    while (isspace((unsigned char) *pc)) {
+      pc++;
+    }
+    if (*pc == 'q') {
+      break;
+    }
+    step.uiLine = uiLine;
+    step.iPauseMs = 0;
+    step.szTx = 0;
+    step.bExpected = false;
+    step.szExpected = 0;
+    if (*pc == 'p') {
+      step.iPauseMs = atoi(pc + 1);
+      if (step.iPauseMs <= 0) {
+        continue;
+      }
+    } else {
+      pc = parse_hex(pc, step.abtTx, NULL, &step.szTx);
+      if (step.szTx == 0) {
+        // Blank line or comment
+        continue;
+      }
+      while (isspace((unsigned char) *pc)) {
+        pc++;
+      }
+      if (*pc == '=') {
+        step.bExpected = true;
+        parse_hex(pc + 1, step.abtExpected, step.abtMask, &step.szExpected);
+      }
+    }
+    if (*pszSteps == szAlloc) {
+      szAlloc = szAlloc ? (szAlloc * 2) : 16;
+      struct tama_step *newsteps = realloc(steps, szAlloc * sizeof(*steps));
+      if (!newsteps) {
+        free(steps);
+        return NULL;
+      }
+      steps = newsteps;
+    }
+    steps[(*pszSteps)++] = step;
+  }
+  return steps;
+}
+
+// Runs compiled steps, stops at the first failure which is the only thing printed
+static bool
+script_run(nfc_device *pnd, const struct tama_step *steps, const size_t szSteps)
+{
+  uint8_t abtRx[MAX_FRAME_LEN];
+
+  for (size_t i = 0; i < szSteps; i++) {
+    const struct tama_step *step = &steps[i];
+    if (step->szTx == 0) {
+      int ms = step->iPauseMs;
+      msleep(ms);
+      continue;
+    }
+    int res;
+    if ((res = pn53x_transceive(pnd, step->abtTx, step->szTx, abtRx, sizeof(abtRx), 0)) < 0) {
+      printf("Line %u: %s\n", step->uiLine, nfc_strerror(pnd));
+      return false;
+    }
+    if (!step->bExpected) {
+      continue;
+    }
+    bool bMatch = ((size_t) res == step->szExpected);
+    for (size_t j = 0; bMatch && (j < step->szExpected); j++) {
+      bMatch = ((abtRx[j] & step->abtMask[j]) == step->abtExpected[j]);
+    }
+    if (!bMatch) {
+      printf("Line %u: unexpected Rx: ", step->uiLine);
+      print_hex(abtRx, res);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-n COUNT] [script]\n", progname);
+  printf("  -n COUNT\tcompile the script once and run it COUNT times, only printing failures\n");
+}
+
 int main(int argc, const char *argv[])
 {
   nfc_device *pnd;
@@ -83,18 +252,41 @@ int main(int argc, const char *argv[])
   size_t szRx = sizeof(abtRx);
   size_t szTx;
   FILE *input = NULL;
+  unsigned long ulRuns = 0;
+  struct tama_step *steps = NULL;
+  size_t szSteps = 0;
+  int arg = 1;
 
-  if (argc >= 2) {
-    if ((input = fopen(argv[1], "r")) == NULL) {
+  if ((argc >= 2) && (0 == strcmp(argv[1], "-n"))) {
+    if ((argc < 3) || ((ulRuns = strtoul(argv[2], NULL, 10)) == 0)) {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    arg = 3;
+  }
+  if (argc > arg) {
+    if ((input = fopen(argv[arg], "r")) == NULL) {
       ERR("%s", "Cannot open file.");
       exit(EXIT_FAILURE);
     }
   }
+  if (ulRuns) {
+    steps = script_compile(input ? input : stdin, &szSteps);
+    if (input != NULL) {
+      fclose(input);
+      input = NULL;
+    }
+    if (!steps) {
+      ERR("%s", "Empty script.");
+      exit(EXIT_FAILURE);
+    }
+  }
 
   nfc_context *context;
   nfc_init(&context);
   if (context == NULL) {
     ERR("Unable to init libnfc (malloc)");
+    free(steps);
     exit(EXIT_FAILURE);
   }
 
@@ -106,6 +298,7 @@ int main(int argc, const char *argv[])
     if (input != NULL) {
       fclose(input);
     }
+    free(steps);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
@@ -116,11 +309,27 @@ int main(int argc, const char *argv[])
     if (input != NULL) {
       fclose(input);
     }
+    free(steps);
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
 
+  if (ulRuns) {
+    unsigned long ulFailed = 0;
+    const double dStart = now_us();
+    for (unsigned long ul = 0; ul < ulRuns; ul++) {
+      if (!script_run(pnd, steps, szSteps)) {
+        ulFailed++;
+      }
+    }
+    printf("%lu runs of %" PRIuPTR " steps, %lu failed, %.1f us per run\n", ulRuns, szSteps, ulFailed, (now_us() - dStart) / ulRuns);
+    free(steps);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(ulFailed ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
   const char *prompt = "> ";
   while (1) {
     int offset = 0;
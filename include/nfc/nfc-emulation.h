@@ -61,7 +61,45 @@ struct nfc_emulation_state_machine {
   void *data;
 };
 
+/**
+ * @struct nfc_emulation_tag2
+ * @brief NFC Forum Tag Type 2 emulation with precomputed READ responses
+ *
+ * Set as the state machine \a data, with nfc_emulation_tag2_io() as \a io.
+ */
+#define NFC_EMULATION_TAG2_MAX_BLOCKS 256
+struct nfc_emulation_tag2 {
+  // 4 blocks READ answer for each block address, followed by its CRC_A
+  uint8_t abtRead[NFC_EMULATION_TAG2_MAX_BLOCKS][16 + 2];
+  size_t szBlocks;
+  size_t szReadLen;
+};
+
+/**
+ * @struct nfc_emulation_raw_rule
+ * @brief Answer of a raw emulation to one initiator command
+ *
+ * Frames are given as sent over the air, CRC included, without parity bits
+ * which are left to the device. A rule without answer
+ * (\a answer_bits equal to 0) silently ignores the command.
+ */
+#define NFC_EMULATION_RAW_MAX_LEN 16
+#define NFC_EMULATION_RAW_MAX_RULES 16
+struct nfc_emulation_raw_rule {
+  uint8_t command[NFC_EMULATION_RAW_MAX_LEN];
+  size_t command_bits;
+  uint8_t answer[NFC_EMULATION_RAW_MAX_LEN];
+  size_t answer_bits;
+};
+
+// REQA, WUPA, HLTA and two rules per cascade level of a 10 bytes UID
+#define NFC_EMULATION_UID_MAX_RULES 9
+
 NFC_EXPORT int    nfc_emulate_target(nfc_device *pnd, struct nfc_emulator *emulator, const int timeout);
+NFC_EXPORT int    nfc_emulation_tag2_init(struct nfc_emulation_tag2 *tag2, const uint8_t *memory, const size_t memory_len, const bool append_crc);
+NFC_EXPORT int    nfc_emulation_tag2_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len);
+NFC_EXPORT int    nfc_emulation_uid_rules(const nfc_iso14443a_info *pnai, struct nfc_emulation_raw_rule rules[NFC_EMULATION_UID_MAX_RULES]);
+NFC_EXPORT int    nfc_emulate_raw(nfc_device *pnd, const struct nfc_emulation_raw_rule *rules, const size_t rules_count, uint8_t *rx, const size_t rx_len);
 
 #ifdef __cplusplus
 }
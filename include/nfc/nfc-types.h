@@ -139,8 +139,161 @@ typedef enum {
   NP_FORCE_ISO14443_B,
   /** Force the chip to run at 106 kbps */
   NP_FORCE_SPEED_106,
+  /** In initiator mode, switch ISO14443-4 and D.E.P. targets selected at 106
+   * kbps to the highest bit rate both the chip and the target support
+   * (disabled by default) */
+  NP_AUTO_BITRATE,
+  /** Time the phases of each command, see nfc_device_get_last_timing()
+   * (disabled by default) */
+  NP_COMMAND_TIMING,
 } nfc_property;
 
+/**
+ * @struct nfc_property_setting
+ * @brief One entry of nfc_device_set_properties() list
+ *
+ * \a value is a duration in ms for NP_TIMEOUT_* properties and a boolean
+ * (0 or not) for all others.
+ */
+typedef struct {
+  nfc_property property;
+  int value;
+} nfc_property_setting;
+
+/** Number of buckets of \a nfc_device_stats latency histogram */
+#  define NFC_STATS_LATENCY_BUCKETS 20
+
+/**
+ * @enum nfc_command_phase
+ * @brief Milestones of a command timed with NP_COMMAND_TIMING
+ */
+typedef enum {
+  /** The driver built the frame */
+  NFC_PHASE_BUILD = 0,
+  /** The frame was written to the bus */
+  NFC_PHASE_TX,
+  /** The chip ACKed the frame */
+  NFC_PHASE_ACK,
+  /** The first byte of the answer arrived */
+  NFC_PHASE_FIRST_BYTE,
+  /** The answer frame was parsed */
+  NFC_PHASE_PARSED,
+} nfc_command_phase;
+
+/** Number of \a nfc_command_phase values */
+#  define NFC_COMMAND_PHASES 5
+
+/**
+ * @struct nfc_command_timing
+ * @brief Timing of the last command answered, see nfc_device_get_last_timing()
+ *
+ * phase_us[p] is the time, in microseconds of a monotonic clock, from the
+ * start of the command to phase p. Only the phases whose bit (1 << p) is set
+ * in \a phases were seen: which ones depend on the driver, e.g. USB readers
+ * hand over whole frames so their first byte is also their last. Chained
+ * answers are timed up to their first frame.
+ */
+typedef struct {
+  /** PN53x command code */
+  uint8_t command;
+  /** Phases seen */
+  uint8_t phases;
+  uint32_t phase_us[NFC_COMMAND_PHASES];
+} nfc_command_timing;
+
+/**
+ * @struct nfc_device_stats
+ * @brief NFC device I/O counters
+ *
+ * Counters are updated by the thread that drives the device, without locking.
+ * \a send_time_us covers writing a command to the bus (ACK included), while
+ * \a receive_time_us covers waiting for the chip's answer.
+ * latency_histogram[i] counts commands whose round trip lasted from 2^i to
+ * 2^(i+1) - 1 microseconds, the last bucket also counts all slower commands.
+ */
+typedef struct {
+  /** Commands sent, indexed by PN53x command code */
+  uint32_t commands[256];
+  uint64_t bytes_tx;
+  uint64_t bytes_rx;
+  uint64_t send_time_us;
+  uint64_t receive_time_us;
+  uint32_t timeouts;
+  uint32_t aborts;
+  uint32_t errors;
+  /** Frames the chip did not ACK */
+  uint32_t ack_errors;
+  /** Extra frames exchanged to fetch chained (MI) answers */
+  uint32_t chained_frames;
+  uint32_t latency_histogram[NFC_STATS_LATENCY_BUCKETS];
+  /** Commands timed with NP_COMMAND_TIMING */
+  uint32_t timed_commands;
+  /** Time spent by timed commands reaching each phase from the previous seen one */
+  uint64_t phase_time_us[NFC_COMMAND_PHASES];
+} nfc_device_stats;
+
+/**
+ * @struct nfc_retry_policy
+ * @brief Retries of a nfc_device, see nfc_device_set_retry_policy()
+ *
+ * Chip-level retries are run by the chip itself, within one command. Host-level
+ * retries repeat select, transceive and D.E.P. calls failing with NFC_ERFTRANS,
+ * waiting a jittered backoff in between. They stop once \a budget_ms elapsed
+ * since the first attempt, and each costs one retry credit: credits are earned
+ * back at \a credit_percent per successful call, up to 10, so that a reader in
+ * a retry storm fails fast instead of piling up delays.
+ */
+typedef struct {
+  /** Chip retries of passive activation (InListPassiveTarget), when NP_INFINITE_SELECT is false */
+  uint8_t chip_passive_activation;
+  /** Chip retries of ATR_REQ and PSL_REQ, when NP_INFINITE_SELECT is false */
+  uint8_t chip_atr;
+  uint8_t chip_psl;
+  /** Chip retries of InDataExchange and InCommunicateThru after a timeout */
+  uint8_t chip_com;
+  /** Host retries of a failed call (0: none) */
+  unsigned int host_retries;
+  /** Backoff before the first host retry, doubled at each retry up to backoff_max_ms */
+  unsigned int backoff_ms;
+  unsigned int backoff_max_ms;
+  /** No host retry starts later than this after the first attempt (0: no limit) */
+  unsigned int budget_ms;
+  /** Percent of a retry credit earned per successful call */
+  unsigned int credit_percent;
+} nfc_retry_policy;
+
+/**
+ * @struct nfc_poll_policy
+ * @brief Software polling of a nfc_device, see nfc_device_set_poll_policy()
+ *
+ * Devices which cannot poll by themselves are polled by the library: each
+ * modulation gets a slot of uiPeriod x 150 ms per poll, the field is on during
+ * the first  duty_percent of the slot and off for the rest of it.
+ */
+typedef struct {
+  /** Share of each slot the field is on, in percent (1 to 100) */
+  unsigned int duty_percent;
+  /** Poll in software even when the device could poll by itself */
+  bool software;
+} nfc_poll_policy;
+
+/**
+ * @struct nfc_executor_stats
+ * @brief Counters of one device run by nfc_executor_start()
+ */
+typedef struct {
+  /** Jobs run, failed ones included */
+  uint64_t jobs;
+  /** Jobs which returned an error */
+  uint64_t errors;
+  /** Cards selected */
+  uint64_t targets;
+  /** Time spent running jobs */
+  uint64_t busy_time_us;
+  /** Time since the executor started */
+  uint64_t run_time_us;
+} nfc_executor_stats;
+
 // Compiler directive, set struct alignment to 1 uint8_t for compatibility
 #  pragma pack(1)
 
@@ -341,7 +494,104 @@ typedef struct {
   nfc_modulation nm;
 } nfc_target;
 
+/**
+ * @enum nfc_target_encoding
+ * @brief Encodings of nfc_target_encode()
+ */
+typedef enum {
+  /** Compact binary record, read back by nfc_target_decode() */
+  NTE_TLV,
+  /** One JSON object */
+  NTE_JSON,
+} nfc_target_encoding;
+
+/**
+ * @enum nfc_poll_event
+ * @brief Changes reported by a poll session
+ */
+typedef enum {
+  /** A target entered the field */
+  NFC_POLL_ARRIVED,
+  /** A target was not seen for longer than the session TTL */
+  NFC_POLL_DEPARTED,
+} nfc_poll_event;
+
 // Reset struct alignment to default
 #  pragma pack()
 
+/** Room for every modulation type in a \a nfc_device_capabilities list */
+#  define NFC_MAX_MODULATION_TYPES NMT_DEP
+/** Room for every baud rate in a \a nfc_device_capabilities list */
+#  define NFC_MAX_BAUD_RATES NBR_847
+
+/**
+ * @struct nfc_device_capabilities
+ * @brief What a device is and supports, see nfc_device_get_capabilities()
+ *
+ * Lists are indexed by \a nfc_mode, baud rates also by \a nfc_modulation_type.
+ */
+typedef struct {
+  /** Chip, e.g. "PN532", empty when the driver does not tell */
+  char chip[8];
+  /** Firmware version and revision, 0 when unknown */
+  uint8_t firmware_version;
+  uint8_t firmware_revision;
+  /** Largest data field of a command or answer frame, 0 when unknown */
+  size_t max_frame_size;
+  /** Supported modulation types, ended by 0 */
+  nfc_modulation_type modulations[2][NFC_MAX_MODULATION_TYPES + 1];
+  /** Supported baud rates, ended by NBR_UNDEFINED */
+  nfc_baud_rate baud_rates[2][NFC_MAX_MODULATION_TYPES + 1][NFC_MAX_BAUD_RATES + 1];
+} nfc_device_capabilities;
+
+/**
+ * @struct nfc_io_thread_config
+ * @brief Scheduling of the thread started by nfc_io_thread_start()
+ */
+typedef struct {
+  /** \c SCHED_FIFO priority (1 to 99), 0 keeps the default scheduling */
+  int priority;
+  /** CPU the thread is bound to, -1 for any */
+  int cpu;
+  /** Lock the queues and the thread stack in RAM */
+  bool lock_memory;
+  /** Time the thread, and nfc_io_thread_process(), busy wait before sleeping, in
+   *  microseconds: it spares a wake-up to each side but needs a CPU of its own */
+  unsigned int spin_us;
+} nfc_io_thread_config;
+
+/**
+ * @enum nfc_priority_class
+ * @brief Class of the calls a thread makes to devices, see nfc_thread_set_priority_class()
+ *
+ * When several threads wait for the same device, it goes to the highest class
+ * first, a call in progress being never interrupted.
+ */
+typedef enum {
+  /** Work which can wait: presence monitoring, health probes, power management */
+  NFC_PRIORITY_BACKGROUND = 0,
+  /** Transactions with targets, the default */
+  NFC_PRIORITY_TRANSACTION,
+} nfc_priority_class;
+
+/** Bytes of a UID kept in a \a nfc_target_key */
+#  define NFC_TARGET_KEY_UID_LEN 14
+
+/**
+ * @struct nfc_target_key
+ * @brief Fixed size identity of a target, see nfc_target_get_key()
+ *
+ * Targets with the same modulation type and UID (PUPI, NFCID2, NFCID3...)
+ * have the same key, zero padded, so keys compare with memcmp(). A UID longer
+ * than \a NFC_TARGET_KEY_UID_LEN bytes (barcodes) keeps its first 10 bytes,
+ * followed by a 32 bits hash of the whole UID.
+ */
+typedef struct {
+  /** \a nfc_modulation_type of the target, 0 for no target */
+  uint8_t nmt;
+  /** Length of the whole UID */
+  uint8_t uid_len;
+  uint8_t uid[NFC_TARGET_KEY_UID_LEN];
+} nfc_target_key;
+
 #endif // _LIBNFC_TYPES_H_
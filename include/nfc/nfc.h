@@ -82,22 +82,45 @@ extern  "C" {
 
 /* Library initialization/deinitialization */
 NFC_EXPORT void nfc_init(nfc_context **context) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT void nfc_init_with_config(nfc_context **context, const uint8_t *pbtConfig, const size_t szConfig) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_config_build(uint8_t **ppbtConfig, size_t *pszConfig);
 NFC_EXPORT void nfc_exit(nfc_context *context) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT int nfc_register_driver(const nfc_driver *driver);
+NFC_EXPORT void nfc_set_log_level(const uint32_t log_level);
+NFC_EXPORT uint32_t nfc_get_log_level(void);
 
 /* NFC Device/Hardware manipulation */
 NFC_EXPORT nfc_device *nfc_open(nfc_context *context, const nfc_connstring connstring) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT void nfc_close(nfc_device *pnd);
 NFC_EXPORT int nfc_abort_command(nfc_device *pnd);
 NFC_EXPORT size_t nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], size_t connstrings_len) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT void nfc_list_devices_invalidate(nfc_context *context) ATTRIBUTE_NONNULL(1);
+typedef enum {
+  NFC_HOTPLUG_ARRIVED,
+  NFC_HOTPLUG_LEFT,
+} nfc_hotplug_event;
+typedef void (*nfc_hotplug_callback)(nfc_context *context, nfc_hotplug_event event, const nfc_connstring connstring, void *user_data);
+NFC_EXPORT int nfc_context_add_device(nfc_context *context, const char *name, const char *connstring, const bool optional) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_context_remove_device(nfc_context *context, const char *connstring) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_context_set_hotplug_callback(nfc_context *context, nfc_hotplug_callback callback, void *user_data) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT int nfc_idle(nfc_device *pnd);
+NFC_EXPORT int nfc_device_set_trace(nfc_device *pnd, const char *pcFilename);
+
+/* Simulated devices (sim driver) */
+NFC_EXPORT int nfc_sim_attach_target(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtMemory, const size_t szMemory);
+NFC_EXPORT int nfc_sim_detach_target(nfc_device *pnd);
+NFC_EXPORT int nfc_tcp_serve(nfc_device *pnd, int fd);
+NFC_EXPORT int nfc_daemon_serve(nfc_device *apnd[], const size_t szDevices, int fd);
 
 /* NFC initiator: act as "reader" */
 NFC_EXPORT int nfc_initiator_init(nfc_device *pnd);
 NFC_EXPORT int nfc_initiator_init_secure_element(nfc_device *pnd);
 NFC_EXPORT int nfc_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
 NFC_EXPORT int nfc_initiator_list_passive_targets(nfc_device *pnd, const nfc_modulation nm, nfc_target ant[], const size_t szTargets);
+NFC_EXPORT int nfc_initiator_inventory_iso14443a(nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+NFC_EXPORT int nfc_initiator_reactivate_target(nfc_device *pnd, nfc_target *pnt);
 NFC_EXPORT int nfc_initiator_poll_target(nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_discover_targets(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, nfc_target ant[], const size_t szTargets);
 NFC_EXPORT int nfc_initiator_select_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
 NFC_EXPORT int nfc_initiator_poll_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
 NFC_EXPORT int nfc_initiator_deselect_target(nfc_device *pnd);
@@ -107,18 +130,116 @@ NFC_EXPORT int nfc_initiator_transceive_bytes_timed(nfc_device *pnd, const uint8
 NFC_EXPORT int nfc_initiator_transceive_bits_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar, uint32_t *cycles);
 NFC_EXPORT int nfc_initiator_target_is_present(nfc_device *pnd, const nfc_target *pnt);
 
+/* NFC initiator: batched exchanges */
+NFC_EXPORT int nfc_batch_begin(nfc_device *pnd);
+NFC_EXPORT int nfc_batch_append(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int *pres);
+NFC_EXPORT int nfc_batch_commit(nfc_device *pnd, int timeout);
+
+/* NFC initiator: poll several devices at once */
+typedef int (*nfc_poll_group_callback)(nfc_device *pnd, const nfc_target *pnt, void *user_data);
+NFC_EXPORT int nfc_poll_group(nfc_device *pnds[], const size_t szDevices, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_poll_group_callback callback, void *user_data);
+NFC_EXPORT int nfc_poll_group_slotted(nfc_device *pnds[], const int aiGroups[], const size_t szDevices, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_poll_group_callback callback, void *user_data);
+
+/* NFC initiator: report targets entering and leaving the field */
+typedef struct nfc_poll_session nfc_poll_session;
+typedef void (*nfc_poll_session_callback)(nfc_device *pnd, const nfc_poll_event npe, const nfc_target *pnt, void *user_data);
+NFC_EXPORT nfc_poll_session *nfc_poll_session_new(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const int ttl, nfc_poll_session_callback callback, void *user_data);
+NFC_EXPORT int nfc_poll_session_step(nfc_poll_session *ps);
+NFC_EXPORT void nfc_poll_session_free(nfc_poll_session *ps);
+
+/* NFC initiator: ISO14443-4 block protocol run by the host */
+NFC_EXPORT int nfc_initiator_isodep_activate(nfc_device *pnd, nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_isodep_transceive(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+NFC_EXPORT int nfc_initiator_isodep_deselect(nfc_device *pnd);
+
+/* NFC initiator: precompiled APDU scripts */
+typedef struct nfc_apdu_script nfc_apdu_script;
+NFC_EXPORT nfc_apdu_script *nfc_apdu_script_load(const uint8_t *pbtScript, const size_t szScript);
+NFC_EXPORT void nfc_apdu_script_free(nfc_apdu_script *pas);
+NFC_EXPORT int nfc_apdu_script_run(nfc_device *pnd, nfc_apdu_script *pas, int timeout);
+NFC_EXPORT int nfc_apdu_script_get_sw(const nfc_apdu_script *pas);
+NFC_EXPORT int nfc_apdu_script_get_capture(const nfc_apdu_script *pas, const uint8_t ui8Slot, const uint8_t **ppbtData);
+
+/* NFC initiator: secure element sessions */
+typedef struct nfc_sam_session nfc_sam_session;
+NFC_EXPORT nfc_sam_session *nfc_sam_session_open(nfc_device *pnd);
+NFC_EXPORT int nfc_sam_session_run(nfc_sam_session *pss, nfc_apdu_script *pas, int timeout);
+NFC_EXPORT int nfc_sam_session_select_target(nfc_sam_session *pss, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
+NFC_EXPORT int nfc_sam_session_close(nfc_sam_session *pss);
+
+/* NFC initiator: watch a selected target in the background */
+typedef struct nfc_presence_monitor nfc_presence_monitor;
+typedef void (*nfc_presence_callback)(nfc_device *pnd, const nfc_target *pnt, int res, void *user_data);
+NFC_EXPORT nfc_presence_monitor *nfc_presence_monitor_start(nfc_device *pnd, const nfc_target *pnt, const int min_interval, const int max_interval, nfc_presence_callback callback, void *user_data);
+NFC_EXPORT int nfc_presence_monitor_get_fd(const nfc_presence_monitor *pm);
+NFC_EXPORT int nfc_presence_monitor_stop(nfc_presence_monitor *pm);
+
+/* NFC initiator: spread jobs over a farm of devices */
+typedef struct nfc_executor nfc_executor;
+typedef int (*nfc_executor_job)(nfc_device *pnd, const nfc_target *pnt, void *user_data);
+NFC_EXPORT nfc_executor *nfc_executor_start(nfc_device *pnds[], const size_t szDevices, const nfc_modulation *pnmModulations, const size_t szModulations);
+NFC_EXPORT int nfc_executor_submit(nfc_executor *pe, const nfc_modulation_type nmt, nfc_executor_job job, void *user_data);
+NFC_EXPORT int nfc_executor_get_stats(const nfc_executor *pe, const size_t szDevice, nfc_executor_stats *pstats);
+NFC_EXPORT int nfc_executor_stop(nfc_executor *pe);
+
+/* NFC initiator: asynchronous exchanges */
+typedef void (*nfc_transceive_callback)(nfc_device *pnd, int res, void *user_data);
+NFC_EXPORT int nfc_initiator_transceive_bytes_async(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_transceive_callback callback, void *user_data);
+NFC_EXPORT int nfc_device_get_pollable_fd(nfc_device *pnd);
+NFC_EXPORT int nfc_device_process_events(nfc_device *pnd);
+
+/* NFC initiator: exchanges run by a dedicated thread */
+typedef struct nfc_io_thread nfc_io_thread;
+NFC_EXPORT nfc_io_thread *nfc_io_thread_start(nfc_device *pnd, const nfc_io_thread_config *pconfig);
+NFC_EXPORT int nfc_io_thread_submit(nfc_io_thread *pit, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_transceive_callback callback, void *user_data);
+NFC_EXPORT int nfc_io_thread_process(nfc_io_thread *pit, int timeout);
+NFC_EXPORT int nfc_io_thread_stop(nfc_io_thread *pit);
+
 /* NFC target: act as tag (i.e. MIFARE Classic) or NFC target device. */
 NFC_EXPORT int nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout);
 NFC_EXPORT int nfc_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
 NFC_EXPORT int nfc_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout);
+NFC_EXPORT int nfc_target_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
 NFC_EXPORT int nfc_target_send_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
 NFC_EXPORT int nfc_target_receive_bits(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar);
 
+/* NFC relay: forward frames between an emulated target and a genuine one */
+typedef enum {
+  /** Raw ISO/IEC 14443 type A frames, bit counts and parity included */
+  NFC_RELAY_FRAMES,
+  /** ISO/IEC 14443-4 payloads, the block protocol being run by both chips */
+  NFC_RELAY_APDUS,
+} nfc_relay_mode;
+typedef int (*nfc_relay_callback)(const uint8_t *pbtCommand, const size_t szCommand, const uint8_t *pbtCommandPar,
+                                  const uint8_t *pbtAnswer, const size_t szAnswer, const uint8_t *pbtAnswerPar, void *user_data);
+typedef struct {
+  nfc_relay_mode nrm;
+  /** Transport to the peer process running the missing device, -1 if unused */
+  int iFdIn;
+  int iFdOut;
+  /** Spin on iFdIn rather than blocking in read() */
+  bool bBusyPoll;
+  /** Added before each answer, in milliseconds, to mimic a longer relay */
+  int iDelay;
+  nfc_relay_callback callback;
+  void *user_data;
+} nfc_relay_options;
+NFC_EXPORT int nfc_relay_run(nfc_device *pndTarget, nfc_device *pndInitiator, const nfc_relay_options *pnro);
+NFC_EXPORT int nfc_relay_send_target(const nfc_relay_options *pnro, const nfc_target *pnt);
+NFC_EXPORT int nfc_relay_receive_target(const nfc_relay_options *pnro, nfc_target *pnt);
+
+/* NFC D.E.P.: stream payloads larger than a frame, chained on both sides */
+NFC_EXPORT int nfc_dep_write(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
+NFC_EXPORT int nfc_dep_read(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout);
+
 /* Error reporting */
 NFC_EXPORT const char *nfc_strerror(const nfc_device *pnd);
 NFC_EXPORT int nfc_strerror_r(const nfc_device *pnd, char *buf, size_t buflen);
 NFC_EXPORT void nfc_perror(const nfc_device *pnd, const char *s);
 NFC_EXPORT int nfc_device_get_last_error(const nfc_device *pnd);
+NFC_EXPORT int nfc_device_get_stats(const nfc_device *pnd, nfc_device_stats *pstats);
+NFC_EXPORT void nfc_device_reset_stats(nfc_device *pnd);
+NFC_EXPORT int nfc_device_get_last_timing(const nfc_device *pnd, nfc_command_timing *ptiming);
 
 /* Special data accessors */
 NFC_EXPORT const char *nfc_device_get_name(nfc_device *pnd);
@@ -130,8 +251,18 @@ NFC_EXPORT int nfc_device_get_supported_baud_rate_target_mode(nfc_device *pnd, c
 /* Properties accessors */
 NFC_EXPORT int nfc_device_set_property_int(nfc_device *pnd, const nfc_property property, const int value);
 NFC_EXPORT int nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable);
+NFC_EXPORT int nfc_device_set_properties(nfc_device *pnd, const nfc_property_setting *pSettings, const size_t szSettings);
+NFC_EXPORT int nfc_device_set_retry_policy(nfc_device *pnd, const nfc_retry_policy *pnrp);
+NFC_EXPORT int nfc_device_get_retry_policy(const nfc_device *pnd, nfc_retry_policy *pnrp);
+NFC_EXPORT int nfc_device_set_poll_policy(nfc_device *pnd, const nfc_poll_policy *pnpp);
+NFC_EXPORT int nfc_device_get_poll_policy(const nfc_device *pnd, nfc_poll_policy *pnpp);
+NFC_EXPORT int nfc_device_set_priority_aging(nfc_device *pnd, const unsigned int uiAgingMs);
+NFC_EXPORT nfc_priority_class nfc_thread_set_priority_class(const nfc_priority_class npc);
 
 /* Misc. functions */
+#  define ISO14443A_CRC_INIT 0x6363
+#  define ISO14443B_CRC_INIT 0xFFFF
+NFC_EXPORT uint16_t iso14443a_crc_update(uint16_t wCrc, const uint8_t *pbtData, size_t szLen);
 NFC_EXPORT void iso14443a_crc(uint8_t *pbtData, size_t szLen, uint8_t *pbtCrc);
 NFC_EXPORT void iso14443a_crc_append(uint8_t *pbtData, size_t szLen);
 NFC_EXPORT void iso14443b_crc(uint8_t *pbtData, size_t szLen, uint8_t *pbtCrc);
@@ -141,11 +272,18 @@ NFC_EXPORT uint8_t *iso14443a_locate_historical_bytes(uint8_t *pbtAts, size_t sz
 NFC_EXPORT void nfc_free(void *p);
 NFC_EXPORT const char *nfc_version(void);
 NFC_EXPORT int nfc_device_get_information_about(nfc_device *pnd, char **buf);
+NFC_EXPORT int nfc_device_get_capabilities(nfc_device *pnd, const nfc_device_capabilities **ppcaps);
+NFC_EXPORT int nfc_device_refresh_capabilities(nfc_device *pnd);
 
 /* String converter functions */
 NFC_EXPORT const char *str_nfc_modulation_type(const nfc_modulation_type nmt);
 NFC_EXPORT const char *str_nfc_baud_rate(const nfc_baud_rate nbr);
 NFC_EXPORT int str_nfc_target(char **buf, const nfc_target *pnt, bool verbose);
+NFC_EXPORT int snprint_nfc_target(char *dst, size_t size, const nfc_target *pnt, bool verbose);
+NFC_EXPORT int nfc_target_encode(uint8_t *pbtBuf, const size_t szBuf, const nfc_target *pnt, const nfc_target_encoding nte);
+NFC_EXPORT int nfc_target_decode(nfc_target *pnt, const uint8_t *pbtBuf, const size_t szBuf);
+NFC_EXPORT void nfc_target_get_key(const nfc_target *pnt, nfc_target_key *pntk);
+NFC_EXPORT int nfc_target_decode_key(nfc_target_key *pntk, const uint8_t *pbtBuf, const size_t szBuf);
 
 /* Error codes */
 /** @ingroup error
@@ -0,0 +1,347 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc.hpp
+ * @brief libnfc C++ interface
+ *
+ * Header-only C++17 wrapper of nfc.h: contexts and devices are RAII handles,
+ * frames are passed as spans over the caller's buffers, and modulations are
+ * template parameters checked at build time. Nothing here allocates on the
+ * heap once the device is open, and errors are libnfc's error codes, as in C.
+ *
+ * With C++20 coroutines, nfc::device::transceive_async() can be co_await'ed:
+ * the coroutine is resumed from nfc_device_process_events(), which the
+ * application calls from its event loop as with the C API.
+ */
+
+#ifndef _LIBNFC_HPP_
+#  define _LIBNFC_HPP_
+
+#  if __cplusplus < 201703L
+#    error "nfc.hpp requires C++17 or later"
+#  endif
+
+#  include <cstddef>
+#  include <cstdint>
+#  include <type_traits>
+#  include <utility>
+
+#  if __cplusplus >= 202002L && __has_include(<span>)
+#    include <span>
+#  endif
+#  if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#    include <coroutine>
+#    define LIBNFC_HPP_COROUTINES 1
+#  endif
+
+#  include <nfc/nfc.h>
+
+namespace nfc
+{
+
+#  if defined(__cpp_lib_span)
+using std::span;
+#  else
+/**
+ * @brief Minimal stand-in for C++20 std::span, enough for libnfc calls
+ */
+template <class T>
+class span
+{
+public:
+  constexpr span() noexcept : m_data(nullptr), m_size(0) {}
+  constexpr span(T *data, std::size_t size) noexcept : m_data(data), m_size(size) {}
+  template <std::size_t N>
+  constexpr span(T(&array)[N]) noexcept : m_data(array), m_size(N) {}
+  // Containers such as std::vector, std::array or std::string
+  template < class C, class = std::enable_if_t < std::is_convertible_v < decltype(std::declval<C &>().data()), T * >>>
+  constexpr span(C &container) noexcept : m_data(container.data()), m_size(container.size()) {}
+  template < class U, class = std::enable_if_t < std::is_convertible_v < U(*)[], T(*)[] >>>
+  constexpr span(const span<U> &other) noexcept : m_data(other.data()), m_size(other.size()) {}
+
+  constexpr T *data() const noexcept { return m_data; }
+  constexpr std::size_t size() const noexcept { return m_size; }
+  constexpr bool empty() const noexcept { return m_size == 0; }
+  constexpr T &operator[](std::size_t i) const noexcept { return m_data[i]; }
+  constexpr T *begin() const noexcept { return m_data; }
+  constexpr T *end() const noexcept { return m_data + m_size; }
+  constexpr span first(std::size_t count) const noexcept { return span(m_data, count); }
+
+private:
+  T *m_data;
+  std::size_t m_size;
+};
+#  endif
+
+/**
+ * @brief Whether a modulation may use a baud rate, according to the standards
+ *
+ * This is the build-time check: whether the device supports it is still
+ * checked at run time, against the capabilities cached at nfc_open().
+ */
+constexpr bool
+modulation_is_valid(const nfc_modulation_type nmt, const nfc_baud_rate nbr)
+{
+  switch (nmt) {
+    case NMT_ISO14443A:
+    case NMT_ISO14443B:
+      return (nbr == NBR_106) || (nbr == NBR_212) || (nbr == NBR_424) || (nbr == NBR_847);
+    case NMT_JEWEL:
+    case NMT_BARCODE:
+    case NMT_ISO14443BI:
+    case NMT_ISO14443B2SR:
+    case NMT_ISO14443B2CT:
+      return nbr == NBR_106;
+    case NMT_FELICA:
+      return (nbr == NBR_212) || (nbr == NBR_424);
+    case NMT_DEP:
+      return (nbr == NBR_106) || (nbr == NBR_212) || (nbr == NBR_424);
+  }
+  return false;
+}
+
+/**
+ * @brief A modulation known at build time, e.g. nfc::modulation<NMT_FELICA, NBR_212>
+ */
+template <nfc_modulation_type NMT, nfc_baud_rate NBR>
+struct modulation {
+  static_assert(modulation_is_valid(NMT, NBR), "this modulation does not exist at this baud rate");
+  static constexpr nfc_modulation value = { NMT, NBR };
+};
+
+// Short names for the usual ones
+using iso14443a = modulation<NMT_ISO14443A, NBR_106>;
+using iso14443b = modulation<NMT_ISO14443B, NBR_106>;
+using felica212 = modulation<NMT_FELICA, NBR_212>;
+using felica424 = modulation<NMT_FELICA, NBR_424>;
+using jewel = modulation<NMT_JEWEL, NBR_106>;
+
+/**
+ * @brief Owns a nfc_context, from nfc_init() to nfc_exit()
+ */
+class context
+{
+public:
+  context() noexcept : m_context(nullptr) { nfc_init(&m_context); }
+  ~context() { if (m_context) nfc_exit(m_context); }
+  context(const context &) = delete;
+  context &operator=(const context &) = delete;
+  context(context &&other) noexcept : m_context(std::exchange(other.m_context, nullptr)) {}
+  context &operator=(context &&other) noexcept { std::swap(m_context, other.m_context); return *this; }
+
+  /** False when nfc_init() failed, e.g. for lack of memory */
+  explicit operator bool() const noexcept { return m_context != nullptr; }
+  nfc_context *get() const noexcept { return m_context; }
+
+  /** Fills \a connstrings, returns how many devices were found */
+  std::size_t list_devices(span<nfc_connstring> connstrings) const noexcept
+  {
+    return nfc_list_devices(m_context, connstrings.data(), connstrings.size());
+  }
+
+private:
+  nfc_context *m_context;
+};
+
+#  ifdef LIBNFC_HPP_COROUTINES
+class transceive_awaitable;
+#  endif
+
+/**
+ * @brief Owns a nfc_device, from nfc_open() to nfc_close()
+ *
+ * Methods returning int follow the C function they wrap: a count or 0 on
+ * success, libnfc's error code (negative value) otherwise.
+ */
+class device
+{
+public:
+  device() noexcept : m_device(nullptr) {}
+  /** Opens \a connstring, or the default device if it is nullptr */
+  device(const context &ctx, const char *connstring = nullptr) noexcept : m_device(nfc_open(ctx.get(), connstring)) {}
+  ~device() { if (m_device) nfc_close(m_device); }
+  device(const device &) = delete;
+  device &operator=(const device &) = delete;
+  device(device &&other) noexcept : m_device(std::exchange(other.m_device, nullptr)) {}
+  device &operator=(device &&other) noexcept { std::swap(m_device, other.m_device); return *this; }
+
+  /** False when nfc_open() failed */
+  explicit operator bool() const noexcept { return m_device != nullptr; }
+  nfc_device *get() const noexcept { return m_device; }
+
+  const char *name() const noexcept { return nfc_device_get_name(m_device); }
+  const char *connstring() const noexcept { return nfc_device_get_connstring(m_device); }
+  int last_error() const noexcept { return nfc_device_get_last_error(m_device); }
+  const char *strerror() const noexcept { return nfc_strerror(m_device); }
+  int capabilities(const nfc_device_capabilities *&pcaps) const noexcept { return nfc_device_get_capabilities(m_device, &pcaps); }
+
+  int set_property(const nfc_property property, const bool bEnable) noexcept { return nfc_device_set_property_bool(m_device, property, bEnable); }
+  int set_property(const nfc_property property, const int value) noexcept { return nfc_device_set_property_int(m_device, property, value); }
+  int abort_command() noexcept { return nfc_abort_command(m_device); }
+  int idle() noexcept { return nfc_idle(m_device); }
+
+  // Initiator
+  int initiator_init() noexcept { return nfc_initiator_init(m_device); }
+  int deselect_target() noexcept { return nfc_initiator_deselect_target(m_device); }
+  int target_is_present(const nfc_target &nt) noexcept { return nfc_initiator_target_is_present(m_device, &nt); }
+
+  template <class M>
+  int select_passive_target(nfc_target &nt, span<const uint8_t> init = {}) noexcept
+  {
+    return nfc_initiator_select_passive_target(m_device, M::value, init.data(), init.size(), &nt);
+  }
+
+  template <class M>
+  int list_passive_targets(span<nfc_target> targets) noexcept
+  {
+    return nfc_initiator_list_passive_targets(m_device, M::value, targets.data(), targets.size());
+  }
+
+  /** e.g. poll_target<nfc::iso14443a, nfc::felica212>(20, 2, nt) */
+  template <class... M>
+  int poll_target(const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target &nt) noexcept
+  {
+    static_assert(sizeof...(M) > 0, "poll_target needs at least one modulation");
+    static constexpr nfc_modulation anm[] = { M::value... };
+    return nfc_initiator_poll_target(m_device, anm, sizeof...(M), uiPollNr, uiPeriod, &nt);
+  }
+
+  template <class... M>
+  int discover_targets(span<nfc_target> targets) noexcept
+  {
+    static_assert(sizeof...(M) > 0, "discover_targets needs at least one modulation");
+    static constexpr nfc_modulation anm[] = { M::value... };
+    return nfc_initiator_discover_targets(m_device, anm, sizeof...(M), targets.data(), targets.size());
+  }
+
+  /** The answer is written in \a rx, the received bytes count is returned */
+  int transceive(span<const uint8_t> tx, span<uint8_t> rx, const int timeout = -1) noexcept
+  {
+    return nfc_initiator_transceive_bytes(m_device, tx.data(), tx.size(), rx.data(), rx.size(), timeout);
+  }
+
+  int transceive_bits(span<const uint8_t> tx, const std::size_t szTxBits, span<uint8_t> rx) noexcept
+  {
+    return nfc_initiator_transceive_bits(m_device, tx.data(), szTxBits, nullptr, rx.data(), rx.size(), nullptr);
+  }
+
+#  ifdef LIBNFC_HPP_COROUTINES
+  /**
+   * co_await'able nfc_initiator_transceive_bytes_async(): yields the received
+   * bytes count or libnfc's error code. \a tx and \a rx must outlive the await.
+   */
+  transceive_awaitable transceive_async(span<const uint8_t> tx, span<uint8_t> rx, const int timeout = -1) noexcept;
+  int pollable_fd() noexcept { return nfc_device_get_pollable_fd(m_device); }
+  int process_events() noexcept { return nfc_device_process_events(m_device); }
+#  endif
+
+  // Target
+  int target_init(nfc_target &nt, span<uint8_t> rx, const int timeout = 0) noexcept
+  {
+    return nfc_target_init(m_device, &nt, rx.data(), rx.size(), timeout);
+  }
+  int target_send(span<const uint8_t> tx, const int timeout = -1) noexcept
+  {
+    return nfc_target_send_bytes(m_device, tx.data(), tx.size(), timeout);
+  }
+  int target_receive(span<uint8_t> rx, const int timeout = -1) noexcept
+  {
+    return nfc_target_receive_bytes(m_device, rx.data(), rx.size(), timeout);
+  }
+
+private:
+  nfc_device *m_device;
+};
+
+#  ifdef LIBNFC_HPP_COROUTINES
+/**
+ * @brief Awaiter of device::transceive_async()
+ *
+ * It lives in the coroutine frame while suspended, so the exchange needs no
+ * allocation of its own.
+ */
+class transceive_awaitable
+{
+public:
+  transceive_awaitable(nfc_device *pnd, span<const uint8_t> tx, span<uint8_t> rx, const int timeout) noexcept
+    : m_device(pnd), m_tx(tx), m_rx(rx), m_timeout(timeout), m_result(0), m_state(IDLE) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) noexcept
+  {
+    m_handle = handle;
+    m_state = STARTING;
+    const int res = nfc_initiator_transceive_bytes_async(m_device, m_tx.data(), m_tx.size(), m_rx.data(), m_rx.size(), m_timeout,
+                                                         &transceive_awaitable::completed, this);
+    if (res < 0) {
+      m_result = res;
+      return false;
+    }
+    // The answer may have been there before the call returned
+    if (m_state == DONE)
+      return false;
+    m_state = PENDING;
+    return true;
+  }
+
+  int await_resume() const noexcept { return m_result; }
+
+private:
+  static void completed(nfc_device *, int res, void *user_data)
+  {
+    transceive_awaitable *self = static_cast<transceive_awaitable *>(user_data);
+    self->m_result = res;
+    if (self->m_state == PENDING) {
+      self->m_state = DONE;
+      self->m_handle.resume();
+    } else {
+      self->m_state = DONE;
+    }
+  }
+
+  enum state { IDLE, STARTING, PENDING, DONE };
+
+  nfc_device *m_device;
+  span<const uint8_t> m_tx;
+  span<uint8_t> m_rx;
+  int m_timeout;
+  int m_result;
+  state m_state;
+  std::coroutine_handle<> m_handle;
+};
+
+inline transceive_awaitable
+device::transceive_async(span<const uint8_t> tx, span<uint8_t> rx, const int timeout) noexcept
+{
+  return transceive_awaitable(m_device, tx, rx, timeout);
+}
+#  endif // LIBNFC_HPP_COROUTINES
+
+} // namespace nfc
+
+#endif // _LIBNFC_HPP_
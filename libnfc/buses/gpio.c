@@ -0,0 +1,182 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file gpio.c
+ * @brief GPIO lines, through the Linux gpiochip character device
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "gpio.h"
+
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/gpio.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_COM
+#define LOG_CATEGORY "libnfc.bus.gpio"
+
+// Longest wait between two checks of the abort flag (in ms)
+#define GPIO_ABORT_POLL_INTERVAL 50
+
+struct gpio_line_unix {
+  int fd; // Line event file descriptor
+};
+
+NFC_POOL(gpio_line_unix_pool, struct gpio_line_unix, NFC_POOL_DEVICES);
+
+#define GPIO_DATA( X ) ((struct gpio_line_unix *) X)
+
+/**
+ * @brief Request a GPIO line as an active low interrupt input
+ *
+ * @param pcLineName "<chip>/<offset>", e.g. "gpiochip0/25" or "/dev/gpiochip0/25"
+ */
+gpio_line
+gpio_open_irq(const char *pcLineName)
+{
+  const char *pcOffset = strrchr(pcLineName, '/');
+  char acChip[PATH_MAX];
+  unsigned int uiOffset;
+
+  if ((pcOffset == NULL) || (sscanf(pcOffset + 1, "%u", &uiOffset) != 1)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid GPIO line: %s (expected <chip>/<offset>)", pcLineName);
+    return INVALID_GPIO_LINE;
+  }
+  snprintf(acChip, sizeof(acChip), "%s%.*s", (pcLineName[0] == '/') ? "" : "/dev/", (int)(pcOffset - pcLineName), pcLineName);
+
+  int iChipFd = open(acChip, O_RDONLY);
+  if (iChipFd < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open %s: %s", acChip, strerror(errno));
+    return INVALID_GPIO_LINE;
+  }
+
+  struct gpioevent_request req;
+  memset(&req, 0, sizeof(req));
+  req.lineoffset = uiOffset;
+  req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+  req.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+  snprintf(req.consumer_label, sizeof(req.consumer_label), "%s", "libnfc");
+  int res = ioctl(iChipFd, GPIO_GET_LINEEVENT_IOCTL, &req);
+  close(iChipFd);
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to request line %u of %s: %s", uiOffset, acChip, strerror(errno));
+    return INVALID_GPIO_LINE;
+  }
+  // Queued edges are drained without blocking
+  fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+
+  struct gpio_line_unix *gl = nfc_pool_alloc(&gpio_line_unix_pool);
+  if (gl == NULL) {
+    close(req.fd);
+    return INVALID_GPIO_LINE;
+  }
+  gl->fd = req.fd;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Using line %u of %s as IRQ", uiOffset, acChip);
+  return gl;
+}
+
+void
+gpio_close(const gpio_line gl)
+{
+  close(GPIO_DATA(gl)->fd);
+  nfc_pool_free(gl);
+}
+
+/**
+ * @brief Current level of the line: 0, 1 or libnfc's error code
+ */
+int
+gpio_get_value(const gpio_line gl)
+{
+  struct gpiohandle_data data;
+  if (ioctl(GPIO_DATA(gl)->fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0)
+    return NFC_EIO;
+  return data.values[0] ? 1 : 0;
+}
+
+/**
+ * @brief Block until the line is low
+ * @return NFC_SUCCESS, NFC_ETIMEOUT, NFC_EOPABORTED or NFC_EIO
+ *
+ * @param timeout in milliseconds, 0 waits forever
+ * @param abort_flag checked at least every GPIO_ABORT_POLL_INTERVAL ms, reset when it fired
+ *
+ * The level is checked first so an interrupt raised before the call is not
+ * missed; falling edges only wake us up.
+ */
+int
+gpio_wait_low(const gpio_line gl, int timeout, volatile bool *abort_flag)
+{
+  struct timeval tvStart, tvNow;
+  gettimeofday(&tvStart, NULL);
+
+  for (;;) {
+    struct gpioevent_data event;
+    while (read(GPIO_DATA(gl)->fd, &event, sizeof(event)) == sizeof(event))
+      ;
+
+    int res = gpio_get_value(gl);
+    if (res < 0)
+      return res;
+    if (res == 0)
+      return NFC_SUCCESS;
+
+    int wait = GPIO_ABORT_POLL_INTERVAL;
+    if (timeout > 0) {
+      gettimeofday(&tvNow, NULL);
+      const long elapsed = (tvNow.tv_sec - tvStart.tv_sec) * 1000L + (tvNow.tv_usec - tvStart.tv_usec) / 1000L;
+      if (elapsed >= timeout)
+        return NFC_ETIMEOUT;
+      if (timeout - elapsed < wait)
+        wait = (int)(timeout - elapsed);
+    }
+
+    struct pollfd pfd = { .fd = GPIO_DATA(gl)->fd, .events = POLLIN | POLLPRI, .revents = 0 };
+    if ((poll(&pfd, 1, wait) < 0) && (errno != EINTR))
+      return NFC_EIO;
+    if (abort_flag && *abort_flag) {
+      *abort_flag = false;
+      return NFC_EOPABORTED;
+    }
+  }
+}
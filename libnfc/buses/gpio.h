@@ -0,0 +1,48 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file gpio.h
+ * @brief GPIO lines header, used to wait for the IRQ line of a chip
+ */
+
+#ifndef __NFC_BUS_GPIO_H__
+#  define __NFC_BUS_GPIO_H__
+
+#  include <stdbool.h>
+
+// Define shortcut to types to make code more readable
+typedef void *gpio_line;
+#  define INVALID_GPIO_LINE (void*)(~1)
+
+gpio_line gpio_open_irq(const char *pcLineName);
+void    gpio_close(const gpio_line gl);
+
+int     gpio_get_value(const gpio_line gl);
+int     gpio_wait_low(const gpio_line gl, int timeout, volatile bool *abort_flag);
+
+#endif // __NFC_BUS_GPIO_H__
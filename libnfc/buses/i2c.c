@@ -70,6 +70,8 @@ struct i2c_device_unix {
   int fd;             // I2C device file descriptor
 };
 
+NFC_POOL(i2c_device_unix_pool, struct i2c_device_unix, NFC_POOL_DEVICES);
+
 #define I2C_DATA( X ) ((struct i2c_device_unix *) X)
 
 /**
@@ -82,7 +84,7 @@ struct i2c_device_unix {
 i2c_device
 i2c_open(const char *pcI2C_busName, uint32_t devAddr)
 {
-  struct i2c_device_unix *id = malloc(sizeof(struct i2c_device_unix));
+  struct i2c_device_unix *id = nfc_pool_alloc(&i2c_device_unix_pool);
 
   if (id == 0)
     return INVALID_I2C_BUS ;
@@ -114,7 +116,7 @@ i2c_close(const i2c_device id)
   if (I2C_DATA(id) ->fd >= 0) {
     close(I2C_DATA(id) ->fd);
   }
-  free(id);
+  nfc_pool_free(id);
 }
 
 /**
@@ -71,17 +71,20 @@ const char *spi_ports_device_radix[] = { "spidev", NULL };
 
 struct spi_port_unix {
   int 			fd; 			// Serial port file descriptor
+  uint8_t 		mode; 			// Mode accepted by the controller, see spi_set_mode()
   //~ struct termios 	termios_backup; 	// Terminal info before using the port
   //~ struct termios 	termios_new; 		// Terminal info during the transaction
 };
 
+NFC_POOL(spi_port_unix_pool, struct spi_port_unix, NFC_POOL_DEVICES);
+
 #define SPI_DATA( X ) ((struct spi_port_unix *) X)
 
 
 spi_port
 spi_open(const char *pcPortName)
 {
-  struct spi_port_unix *sp = malloc(sizeof(struct spi_port_unix));
+  struct spi_port_unix *sp = nfc_pool_alloc(&spi_port_unix_pool);
 
   if (sp == 0)
     return INVALID_SPI_PORT;
@@ -91,6 +94,9 @@ spi_open(const char *pcPortName)
     spi_close(sp);
     return INVALID_SPI_PORT;
   }
+  sp->mode = 0;
+  if (ioctl(sp->fd, SPI_IOC_RD_MODE, &sp->mode) == -1)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Error reading SPI mode.");
 
 
   return sp;
@@ -110,15 +116,33 @@ spi_set_speed(spi_port sp, const uint32_t uiPortSpeed)
 
 }
 
+/**
+ * @brief Set SPI mode (SPI_MODE_0...SPI_MODE_3, SPI_LSB_FIRST, ...)
+ *
+ * Many controllers can not shift LSB first: SPI_LSB_FIRST is then dropped and
+ * the transfers asked with \a lsb_first reverse bits in software instead.
+ */
 void
 spi_set_mode(spi_port sp, const uint32_t uiPortMode)
 {
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "SPI port mode requested to be set to %d.", uiPortMode);
+  uint8_t ui8Mode = (uint8_t) uiPortMode;
   int ret;
-  ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &uiPortMode);
-
-  if (ret == -1)  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error setting SPI mode.");
+  ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &ui8Mode);
+  if ((ret == -1) && (ui8Mode & SPI_LSB_FIRST)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "SPI controller can not shift LSB first, bits will be reversed by software.");
+    ui8Mode &= ~SPI_LSB_FIRST;
+    ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &ui8Mode);
+  }
 
+  if (ret == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Error setting SPI mode.");
+    return;
+  }
+  // Some controllers silently ignore the bits they do not support
+  if (ioctl(SPI_DATA(sp)->fd, SPI_IOC_RD_MODE, &ui8Mode) == -1)
+    ui8Mode &= ~SPI_LSB_FIRST;
+  SPI_DATA(sp)->mode = ui8Mode;
 }
 
 uint32_t
@@ -139,29 +163,92 @@ void
 spi_close(const spi_port sp)
 {
   close(SPI_DATA(sp)->fd);
-  free(sp);
+  nfc_pool_free(sp);
 }
 
 
+// Bit reversal of every byte value
+#define R2(n) n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n) R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
+static const uint8_t bit_reversal[256] = { R6(0), R6(2), R6(1), R6(3) };
+#undef R6
+#undef R4
+#undef R2
+
+// Most transfers are PN53x frames, larger ones get a heap buffer for software bit reversal
+#define SPI_TX_SCRATCH_LEN 320
+#define SPI_MAX_SEGMENTS 8
+
 /**
- * @brief Perform bit reversal on one byte \a x
+ * @brief Run all \a segments in a single SPI message, so a single syscall
+ *
+ * CS stays active from the first to the last segment, except after segments
+ * with \a bCsChange set.
  *
- * @return reversed byte
+ * @return 0 on success, otherwise a driver error is returned
  */
-
-static uint8_t
-bit_reversal(const uint8_t x)
+int
+spi_transfer(spi_port sp, const struct spi_segment *segments, const size_t szSegments, bool lsb_first)
 {
-  uint8_t ret = x;
-  ret = (((ret & 0xaa) >> 1) | ((ret & 0x55) << 1));
-  ret = (((ret & 0xcc) >> 2) | ((ret & 0x33) << 2));
-  ret = (((ret & 0xf0) >> 4) | ((ret & 0x0f) << 4));
-  return ret;
-}
-
-
+  struct spi_ioc_transfer tr[SPI_MAX_SEGMENTS];
+  // Reverse bits by software only when the controller does not shift in the wanted order
+  const bool bReverse = (lsb_first != ((SPI_DATA(sp)->mode & SPI_LSB_FIRST) != 0));
+  uint8_t abtScratch[SPI_TX_SCRATCH_LEN];
+  uint8_t *pbtScratch = abtScratch;
+  size_t szTotal = 0;
+  size_t szTotalTx = 0;
+
+  if ((szSegments == 0) || (szSegments > SPI_MAX_SEGMENTS))
+    return NFC_EINVARG;
+
+  for (size_t i = 0; i < szSegments; i++) {
+    if (segments[i].pbtTx)
+      szTotalTx += segments[i].szLen;
+  }
+  if (bReverse && (szTotalTx > sizeof(abtScratch))) {
+    if (!(pbtScratch = malloc(szTotalTx)))
+      return NFC_ESOFT;
+  }
 
+  uint8_t *pbtTxLSB = pbtScratch;
+  memset(tr, 0, sizeof(tr));
+  for (size_t i = 0; i < szSegments; i++) {
+    const uint8_t *pbtTx = segments[i].pbtTx;
+    if (pbtTx && segments[i].szLen) {
+      LOG_HEX(LOG_GROUP, "TX", pbtTx, segments[i].szLen);
+      if (bReverse) {
+        for (size_t j = 0; j < segments[i].szLen; j++)
+          pbtTxLSB[j] = bit_reversal[pbtTx[j]];
+        pbtTx = pbtTxLSB;
+        pbtTxLSB += segments[i].szLen;
+      }
+    }
+    tr[i].tx_buf = (unsigned long) pbtTx;
+    tr[i].rx_buf = (unsigned long) segments[i].pbtRx;
+    tr[i].len = segments[i].szLen;
+    tr[i].cs_change = segments[i].bCsChange;
+    szTotal += segments[i].szLen;
+  }
 
+  int ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_MESSAGE(szSegments), tr);
+  if (pbtScratch != abtScratch)
+    free(pbtScratch);
+  if (ret != (int) szTotal)
+    return NFC_EIO;
+
+  for (size_t i = 0; i < szSegments; i++) {
+    if (segments[i].pbtRx && segments[i].szLen) {
+      // Reverse received bytes if needed
+      if (bReverse) {
+        for (size_t j = 0; j < segments[i].szLen; j++)
+          segments[i].pbtRx[j] = bit_reversal[segments[i].pbtRx[j]];
+      }
+      LOG_HEX(LOG_GROUP, "RX", segments[i].pbtRx, segments[i].szLen);
+    }
+  }
+  return NFC_SUCCESS;
+}
 
 /**
  * @brief Send \a pbtTx content to SPI then receive data from SPI and copy data to \a pbtRx. CS line stays active	 between transfers as well as during transfers.
@@ -171,81 +258,20 @@ bit_reversal(const uint8_t x)
 int
 spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first)
 {
-  size_t transfers = 0;
-  struct spi_ioc_transfer tr[2];
-
-
-  uint8_t *pbtTxLSB = 0;
+  struct spi_segment segments[2];
+  size_t szSegments = 0;
 
   if (szTx) {
-    LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
-    if (lsb_first) {
-      pbtTxLSB = malloc(szTx * sizeof(uint8_t));
-      if (!pbtTxLSB) {
-        return NFC_ESOFT;
-      }
-
-      size_t i;
-      for (i = 0; i < szTx; ++i) {
-        pbtTxLSB[i] = bit_reversal(pbtTx[i]);
-      }
-
-      pbtTx = pbtTxLSB;
-    }
-
-    struct spi_ioc_transfer tr_send = {
-      .tx_buf = (unsigned long) pbtTx,
-      .rx_buf = 0,
-      .len = szTx,
-      .delay_usecs = 0,
-      .speed_hz = 0,
-      .bits_per_word = 0,
-    };
-    tr[transfers] = tr_send;
-
-    ++transfers;
+    const struct spi_segment send = { .pbtTx = pbtTx, .pbtRx = NULL, .szLen = szTx, .bCsChange = false };
+    segments[szSegments++] = send;
   }
-
   if (szRx) {
-    struct spi_ioc_transfer tr_receive = {
-      .tx_buf = 0,
-      .rx_buf = (unsigned long) pbtRx,
-      .len = szRx,
-      .delay_usecs = 0,
-      .speed_hz = 0,
-      .bits_per_word = 0,
-    };
-    tr[transfers] = tr_receive;
-    ++transfers;
-  }
-
-
-
-  if (transfers) {
-    int ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_MESSAGE(transfers), tr);
-    if (szTx && lsb_first) {
-      free(pbtTxLSB);
-    }
-
-    if (ret != (int)(szRx + szTx)) {
-      return NFC_EIO;
-    }
-
-    // Reverse received bytes if needed
-    if (szRx) {
-      if (lsb_first) {
-        size_t i;
-        for (i = 0; i < szRx; ++i) {
-          pbtRx[i] = bit_reversal(pbtRx[i]);
-        }
-      }
-
-      LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
-    }
+    const struct spi_segment receive = { .pbtTx = NULL, .pbtRx = pbtRx, .szLen = szRx, .bCsChange = false };
+    segments[szSegments++] = receive;
   }
-
-
-  return NFC_SUCCESS;
+  if (!szSegments)
+    return NFC_SUCCESS;
+  return spi_transfer(sp, segments, szSegments, lsb_first);
 }
 
 
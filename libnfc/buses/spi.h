@@ -49,6 +49,15 @@ typedef void *spi_port;
 #  define INVALID_SPI_PORT (void*)(~1)
 #  define CLAIMED_SPI_PORT (void*)(~2)
 
+// One part of a SPI message, either pointer may be NULL for half-duplex parts
+struct spi_segment {
+  const uint8_t *pbtTx;
+  uint8_t *pbtRx;
+  size_t szLen;
+  // Release CS after this part
+  bool bCsChange;
+};
+
 spi_port spi_open(const char *pcPortName);
 void    spi_close(const spi_port sp);
 
@@ -59,6 +68,7 @@ uint32_t spi_get_speed(const spi_port sp);
 int     spi_receive(spi_port sp, uint8_t *pbtRx, const size_t szRx, bool lsb_first);
 int     spi_send(spi_port sp, const uint8_t *pbtTx, const size_t szTx, bool lsb_first);
 int     spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first);
+int     spi_transfer(spi_port sp, const struct spi_segment *segments, const size_t szSegments, bool lsb_first);
 
 char  **spi_list_ports(void);
 
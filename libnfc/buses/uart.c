@@ -46,10 +46,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <termios.h>
 #include <unistd.h>
 #include <stdlib.h>
+#ifdef __linux__
+#  include <sys/eventfd.h>
+#endif
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
@@ -95,26 +99,76 @@ const char *serial_ports_device_radix[] = { "ttyUSB", "ttyS", "ttyACM", "ttyAMA"
 // Work-around to claim uart interface using the c_iflag (software input processing) from the termios struct
 #  define CCLAIMED 0x80000000
 
+// Enough to hold the longest PN53x extended frame
+#  define UART_RX_BUFFER_SIZE 512
+
 struct serial_port_unix {
   int 			fd; 			// Serial port file descriptor
   struct termios 	termios_backup; 	// Terminal info before using the port
   struct termios 	termios_new; 		// Terminal info during the transaction
+  uint8_t 		abtRxBuf[UART_RX_BUFFER_SIZE];	// Bytes received but not yet requested
+  size_t 		szRxPos; 		// Position of the first pending byte in abtRxBuf
+  size_t 		szRxLen; 		// Count of pending bytes in abtRxBuf
+  int 			iAbortFd; 		// Readable once uart_abort() is called
+  int 			iAbortWakeFd; 		// Written by uart_abort(), same as iAbortFd for an eventfd
 };
 
+NFC_POOL(serial_port_unix_pool, struct serial_port_unix, NFC_POOL_DEVICES);
+
 #define UART_DATA( X ) ((struct serial_port_unix *) X)
 
 void uart_close_ext(const serial_port sp, const bool restore_termios);
 
+/*
+ * The abort channel lives as long as the port: an eventfd on Linux, a pipe
+ * elsewhere, both non-blocking.
+ */
+static int
+uart_abort_channel_open(struct serial_port_unix *sp)
+{
+#ifdef __linux__
+  sp->iAbortFd = sp->iAbortWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return sp->iAbortFd;
+#else
+  int fds[2];
+  if (pipe(fds) < 0)
+    return -1;
+  for (int i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  sp->iAbortFd = fds[0];
+  sp->iAbortWakeFd = fds[1];
+  return 0;
+#endif
+}
+
+// Consumes pending aborts
+static void
+uart_abort_channel_reset(struct serial_port_unix *sp)
+{
+  uint8_t abtDrain[8];
+  while (read(sp->iAbortFd, abtDrain, sizeof(abtDrain)) > 0) {
+#ifdef __linux__
+    // An eventfd read clears the counter at once
+    break;
+#endif
+  }
+}
+
 serial_port
 uart_open(const char *pcPortName)
 {
-  struct serial_port_unix *sp = malloc(sizeof(struct serial_port_unix));
+  struct serial_port_unix *sp = nfc_pool_alloc(&serial_port_unix_pool);
 
   if (sp == 0)
     return INVALID_SERIAL_PORT;
 
+  sp->szRxPos = 0;
+  sp->szRxLen = 0;
+  sp->iAbortFd = sp->iAbortWakeFd = -1;
   sp->fd = open(pcPortName, O_RDWR | O_NOCTTY | O_NONBLOCK);
-  if (sp->fd == -1) {
+  if ((sp->fd == -1) || (uart_abort_channel_open(sp) < 0)) {
     uart_close_ext(sp, false);
     return INVALID_SERIAL_PORT;
   }
@@ -157,6 +211,10 @@ uart_flush_input(serial_port sp, bool wait)
     msleep(50); // 50 ms
   }
 
+  // Drop bytes already buffered by uart_receive()
+  UART_DATA(sp)->szRxPos = 0;
+  UART_DATA(sp)->szRxLen = 0;
+
   // This line seems to produce absolutely no effect on my system (GNU/Linux 2.6.35)
   tcflush(UART_DATA(sp)->fd, TCIFLUSH);
   // So, I wrote this byte-eater
@@ -222,6 +280,11 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
     case 460800:
       stPortSpeed = B460800;
       break;
+#  endif
+#  ifdef B921600
+    case 921600:
+      stPortSpeed = B921600;
+      break;
 #  endif
     default:
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d baud. Speed value must be one of those defined in termios(3).",
@@ -237,6 +300,75 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
   }
 }
 
+// Speeds negotiated with the devices, so they outlive the serial_port handles
+#define UART_REMEMBERED_SPEEDS 8
+static struct {
+  char acPortName[DEVICE_PORT_LENGTH];
+  uint32_t uiPortSpeed;
+} uart_remembered_speeds[UART_REMEMBERED_SPEEDS];
+static size_t uart_remembered_speeds_next = 0;
+static pthread_mutex_t uart_remembered_speeds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Speed last remembered for this port, 0 if none
+ */
+uint32_t
+uart_get_remembered_speed(const char *pcPortName)
+{
+  uint32_t uiPortSpeed = 0;
+  pthread_mutex_lock(&uart_remembered_speeds_lock);
+  for (size_t i = 0; i < UART_REMEMBERED_SPEEDS; i++) {
+    if (strncmp(uart_remembered_speeds[i].acPortName, pcPortName, sizeof(uart_remembered_speeds[i].acPortName)) == 0) {
+      uiPortSpeed = uart_remembered_speeds[i].uiPortSpeed;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&uart_remembered_speeds_lock);
+  return uiPortSpeed;
+}
+
+/**
+ * @brief Remember the speed negotiated on this port, 0 forgets it
+ */
+void
+uart_remember_speed(const char *pcPortName, const uint32_t uiPortSpeed)
+{
+  size_t i;
+  pthread_mutex_lock(&uart_remembered_speeds_lock);
+  for (i = 0; i < UART_REMEMBERED_SPEEDS; i++) {
+    if (strncmp(uart_remembered_speeds[i].acPortName, pcPortName, sizeof(uart_remembered_speeds[i].acPortName)) == 0)
+      break;
+  }
+  if (i == UART_REMEMBERED_SPEEDS) {
+    // Recycle the oldest entry
+    i = uart_remembered_speeds_next;
+    uart_remembered_speeds_next = (uart_remembered_speeds_next + 1) % UART_REMEMBERED_SPEEDS;
+    snprintf(uart_remembered_speeds[i].acPortName, sizeof(uart_remembered_speeds[i].acPortName), "%s", pcPortName);
+  }
+  uart_remembered_speeds[i].uiPortSpeed = uiPortSpeed;
+  pthread_mutex_unlock(&uart_remembered_speeds_lock);
+}
+
+/**
+ * @brief File descriptor which becomes readable when data is received
+ *
+ * Bytes may already be waiting in our buffer, see uart_pending().
+ */
+int
+uart_get_fd(const serial_port sp)
+{
+  return UART_DATA(sp)->fd;
+}
+
+/**
+ * @brief Count of bytes received but not read yet by uart_receive()
+ */
+size_t
+uart_pending(const serial_port sp)
+{
+  return UART_DATA(sp)->szRxLen;
+}
+
 uint32_t
 uart_get_speed(serial_port sp)
 {
@@ -270,6 +402,11 @@ uart_get_speed(serial_port sp)
     case B460800:
       uiPortSpeed = 460800;
       break;
+#  endif
+#  ifdef B921600
+    case B921600:
+      uiPortSpeed = 921600;
+      break;
 #  endif
   }
 
@@ -284,7 +421,11 @@ uart_close_ext(const serial_port sp, const bool restore_termios)
       tcsetattr(UART_DATA(sp)->fd, TCSANOW, &UART_DATA(sp)->termios_backup);
     close(UART_DATA(sp)->fd);
   }
-  free(sp);
+  if (UART_DATA(sp)->iAbortWakeFd != UART_DATA(sp)->iAbortFd)
+    close(UART_DATA(sp)->iAbortWakeFd);
+  if (UART_DATA(sp)->iAbortFd >= 0)
+    close(UART_DATA(sp)->iAbortFd);
+  nfc_pool_free(sp);
 }
 
 void
@@ -293,42 +434,55 @@ uart_close(const serial_port sp)
   uart_close_ext(sp, true);
 }
 
-/**
- * @brief Receive data from UART and copy data to \a pbtRx
- *
- * @return 0 on success, otherwise driver error code
+// n_tty honours VMIN in poll() when VTIME is 0, up to 255 bytes
+#define UART_MAX_VMIN 255
+
+/*
+ * The port is non-blocking, so VMIN only changes when poll() wakes up: it is
+ * left as is between the waits of an exchange and only set when a wait needs
+ * another value.
  */
-int
-uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout)
+static void
+uart_set_vmin(struct serial_port_unix *port, const cc_t vmin)
 {
-  int iAbortFd = abort_p ? *((int *)abort_p) : 0;
-  int received_bytes_count = 0;
-  int available_bytes_count = 0;
-  const int expected_bytes_count = (int)szRx;
+  const cc_t previous = port->termios_new.c_cc[VMIN];
+  if (previous == vmin)
+    return;
+  port->termios_new.c_cc[VMIN] = vmin;
+  // Not fatal: poll() then just wakes up more often
+  if (tcsetattr(port->fd, TCSANOW, &port->termios_new) == -1) {
+    port->termios_new.c_cc[VMIN] = previous;
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to set VMIN");
+  }
+}
+
+/*
+ * Waits until bytes are available, at least szWanted ones if they come in
+ * time, and reads as many as the port buffer can hold.
+ */
+static int
+uart_fill(struct serial_port_unix *port, const size_t szWanted, const bool bAbortable, int timeout)
+{
+  struct pollfd pfds[2];
+  const nfds_t nfds = bAbortable ? 2 : 1;
   int res;
-  fd_set rfds;
-  do {
-select:
-    // Reset file descriptor
-    FD_ZERO(&rfds);
-    FD_SET(UART_DATA(sp)->fd, &rfds);
-
-    if (iAbortFd) {
-      FD_SET(iAbortFd, &rfds);
-    }
 
-    struct timeval timeout_tv;
-    if (timeout > 0) {
-      timeout_tv.tv_sec = (timeout / 1000);
-      timeout_tv.tv_usec = ((timeout % 1000) * 1000);
-    }
+  pfds[0].fd = port->fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = port->iAbortFd;
+  pfds[1].events = POLLIN;
 
-    res = select(MAX(UART_DATA(sp)->fd, iAbortFd) + 1, &rfds, NULL, NULL, timeout ? &timeout_tv : NULL);
+  while (true) {
+    pfds[0].revents = 0;
+    pfds[1].revents = 0;
+    // Let poll() wake up once all missing bytes are there rather than on the first one
+    uart_set_vmin(port, (szWanted > 1) ? (cc_t) MIN(szWanted, UART_MAX_VMIN) : 0);
+    res = poll(pfds, nfds, timeout ? timeout : -1);
 
     if ((res < 0) && (EINTR == errno)) {
       // The system call was interupted by a signal and a signal handler was
       // run.  Restart the interupted system call.
-      goto select;
+      continue;
     }
 
     // Read error
@@ -342,40 +496,145 @@ select:
       return NFC_ETIMEOUT;
     }
 
-    if (FD_ISSET(iAbortFd, &rfds)) {
+    if ((nfds > 1) && (pfds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
       // Abort requested
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Abort!");
-      close(iAbortFd);
+      uart_abort_channel_reset(port);
       return NFC_EOPABORTED;
     }
 
-    // Retrieve the count of the incoming bytes
-    res = ioctl(UART_DATA(sp)->fd, FIONREAD, &available_bytes_count);
-    if (res != 0) {
-      return NFC_EIO;
-    }
-    // There is something available, read the data
-    res = read(UART_DATA(sp)->fd, pbtRx + received_bytes_count, MIN(available_bytes_count, (expected_bytes_count - received_bytes_count)));
+    // There is something available, read as much as we can hold
+    port->szRxPos = 0;
+    res = read(port->fd, port->abtRxBuf, sizeof(port->abtRxBuf));
+    if ((res < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+      continue;
     // Stop if the OS has some troubles reading the data
     if (res <= 0) {
       return NFC_EIO;
     }
-    received_bytes_count += res;
+    port->szRxLen = (size_t)res;
+    return NFC_SUCCESS;
+  }
+}
+
+// Moves up to szRx pending bytes of the port buffer to pbtRx
+static size_t
+uart_take(struct serial_port_unix *port, uint8_t *pbtRx, const size_t szRx)
+{
+  const size_t n = MIN(port->szRxLen, szRx);
+  memcpy(pbtRx, port->abtRxBuf + port->szRxPos, n);
+  port->szRxPos += n;
+  port->szRxLen -= n;
+  return n;
+}
+
+/**
+ * @brief Receive data from UART and copy data to \a pbtRx
+ *
+ * Each read() grabs all the bytes available on the port: bytes received beyond
+ * \a szRx are kept in the port buffer and served by the next calls without
+ * waiting again for the port. When \a bAbortable is set, uart_abort() makes
+ * a pending or the next wait return NFC_EOPABORTED.
+ *
+ * @return 0 on success, otherwise driver error code
+ */
+int
+uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, const bool bAbortable, int timeout)
+{
+  struct serial_port_unix *port = UART_DATA(sp);
+  size_t received_bytes_count = 0;
+  int res;
 
-  } while (expected_bytes_count > received_bytes_count);
+  while (true) {
+    // Serve what we already have
+    received_bytes_count += uart_take(port, pbtRx + received_bytes_count, szRx - received_bytes_count);
+    if (received_bytes_count >= szRx)
+      break;
+    if ((res = uart_fill(port, szRx - received_bytes_count, bAbortable, timeout)) < 0) {
+      NFC_PROBE3(uart__receive, szRx, timeout, res);
+      return res;
+    }
+  }
   LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
+  NFC_PROBE3(uart__receive, szRx, timeout, NFC_SUCCESS);
   return NFC_SUCCESS;
 }
 
+/**
+ * @brief Receive a whole frame from UART to \a pbtRx
+ *
+ * \a parser is told about bytes as soon as they are appended to the frame
+ * and says how many are still missing, so that a frame is usually read with
+ * a single wakeup and checked on the fly. Bytes following the frame stay in
+ * the port buffer. With \a bAbortable, uart_abort() is only taken into
+ * account until the first byte of the frame is received.
+ *
+ * @return the frame length on success, otherwise driver error code
+ */
+int
+uart_receive_frame(serial_port sp, uint8_t *pbtRx, const size_t szRx, uart_frame_parser parser, void *parser_data,
+                   const bool bAbortable, int timeout)
+{
+  struct serial_port_unix *port = UART_DATA(sp);
+  size_t szFrame = 0;
+  int missing = parser(parser_data, pbtRx, 0, 0);
+  int res;
+
+  while (missing > 0) {
+    if (szFrame + (size_t) missing > szRx) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Frame larger than receive buffer");
+      return NFC_EOVFLOW;
+    }
+    if ((port->szRxLen == 0) && ((res = uart_fill(port, (size_t) missing, bAbortable && (szFrame == 0), timeout)) < 0)) {
+      NFC_PROBE3(uart__receive, szFrame, timeout, res);
+      return res;
+    }
+    const size_t n = uart_take(port, pbtRx + szFrame, (size_t) missing);
+    szFrame += n;
+    missing = parser(parser_data, pbtRx, szFrame, n);
+  }
+  LOG_HEX(LOG_GROUP, "RX", pbtRx, szFrame);
+  res = (missing < 0) ? missing : (int) szFrame;
+  NFC_PROBE3(uart__receive, szFrame, timeout, res);
+  return res;
+}
+
+/**
+ * @brief Abort the abortable receive in progress on \a sp, or the next one
+ *
+ * Cheap and safe to call from any thread: it only signals the abort channel
+ * the port holds for its whole life, the receive consumes the signal.
+ *
+ * @return 0 on success, otherwise driver error code
+ */
+int
+uart_abort(serial_port sp)
+{
+#ifdef __linux__
+  // Adds to the eventfd counter
+  const uint64_t ui64Abort = 1;
+  const ssize_t res = write(UART_DATA(sp)->iAbortWakeFd, &ui64Abort, sizeof(ui64Abort));
+#else
+  const uint8_t btAbort = 1;
+  const ssize_t res = write(UART_DATA(sp)->iAbortWakeFd, &btAbort, sizeof(btAbort));
+#endif
+  // EAGAIN: enough aborts are pending already
+  return ((res > 0) || (EAGAIN == errno)) ? NFC_SUCCESS : NFC_ESOFT;
+}
+
 /**
  * @brief Send \a pbtTx content to UART
  *
+ * A pending abort is kept: it is consumed by the receive it interrupts.
+ *
  * @return 0 on success, otherwise a driver error is returned
  */
 int
 uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout)
 {
   (void) timeout;
+  // Whoever polls uart_get_fd() for the answer expects to wake up on its first byte
+  uart_set_vmin(UART_DATA(sp), 0);
   LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
   if ((int) szTx == write(UART_DATA(sp)->fd, pbtTx, szTx))
     return NFC_SUCCESS;
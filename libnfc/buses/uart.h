@@ -53,10 +53,23 @@ void    uart_flush_input(const serial_port sp, bool wait);
 
 void    uart_set_speed(serial_port sp, const uint32_t uiPortSpeed);
 uint32_t uart_get_speed(const serial_port sp);
+int     uart_get_fd(const serial_port sp);
+size_t  uart_pending(const serial_port sp);
+uint32_t uart_get_remembered_speed(const char *pcPortName);
+void    uart_remember_speed(const char *pcPortName, const uint32_t uiPortSpeed);
 
-int     uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout);
+int     uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, const bool bAbortable, int timeout);
 int     uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout);
 
+/*
+ * Told by uart_receive_frame() that szNew bytes were appended to the szFrame
+ * bytes long pbtFrame (none at first call), returns the count of bytes still
+ * missing, 0 once the frame is complete, or a libnfc error code.
+ */
+typedef int (*uart_frame_parser)(void *parser_data, const uint8_t *pbtFrame, const size_t szFrame, const size_t szNew);
+int     uart_receive_frame(serial_port sp, uint8_t *pbtRx, const size_t szRx, uart_frame_parser parser, void *parser_data, const bool bAbortable, int timeout);
+int     uart_abort(serial_port sp);
+
 char  **uart_list_ports(void);
 
 #endif // __NFC_BUS_UART_H__
@@ -34,6 +34,9 @@
 #  include "config.h"
 #endif // HAVE_CONFIG_H
 
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "usbbus.h"
@@ -41,21 +44,21 @@
 #define LOG_CATEGORY "libnfc.buses.usbbus"
 #define LOG_GROUP    NFC_LOG_GROUP_DRIVER
 
+// libusb-0.1 keeps the bus list in globals
+static pthread_mutex_t usb_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int usb_prepare(void)
 {
   static bool usb_initialized = false;
-  if (!usb_initialized) {
 
-#ifdef ENVVARS
-    char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
+  pthread_mutex_lock(&usb_lock);
+  if (!usb_initialized) {
+    usb_init();
     // Set libusb debug only if asked explicitely:
     // LIBUSB_LOG_LEVEL=12288 (= NFC_LOG_PRIORITY_DEBUG * 2 ^ NFC_LOG_GROUP_LIBUSB)
-    if (env_log_level && (((atoi(env_log_level) >> (NFC_LOG_GROUP_LIBUSB * 2)) & 0x00000003) >= NFC_LOG_PRIORITY_DEBUG)) {
-      setenv("USB_DEBUG", "255", 1);
+    if (((log_get_level() >> (NFC_LOG_GROUP_LIBUSB * 2)) & 0x00000003) >= NFC_LOG_PRIORITY_DEBUG) {
+      usb_set_debug(255);
     }
-#endif
-
-    usb_init();
     usb_initialized = true;
   }
 
@@ -64,6 +67,7 @@ int usb_prepare(void)
   // number of changes since previous call to this function (total of new
   // busses and busses removed).
   if ((res = usb_find_busses()) < 0) {
+    pthread_mutex_unlock(&usb_lock);
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB busses (%s)", _usb_strerror(res));
     return -1;
   }
@@ -71,9 +75,97 @@ int usb_prepare(void)
   // called after usb_find_busses. Returns the number of changes since the
   // previous call to this function (total of new device and devices removed).
   if ((res = usb_find_devices()) < 0) {
+    pthread_mutex_unlock(&usb_lock);
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB devices (%s)", _usb_strerror(res));
     return -1;
   }
+  pthread_mutex_unlock(&usb_lock);
   return 0;
 }
 
+
+/*
+ * Devices a previous scan managed to open, keyed by driver and bus/device
+ * number (and IDs, as device numbers are reused after unplugging), along
+ * with their name once read: neither later scans nor nfc_device_get_name()
+ * have to talk to the device again.
+ */
+#define USB_SCAN_CACHE_LEN 32
+
+struct usb_scan_cache_entry {
+  const char *driver;
+  char acBus[64];
+  char acDevice[64];
+  uint16_t ui16Vendor;
+  uint16_t ui16Product;
+  bool bNamed;
+  char acName[256];
+};
+
+static struct usb_scan_cache_entry usb_scan_cache[USB_SCAN_CACHE_LEN];
+static size_t usb_scan_cache_next = 0;
+
+// Called with usb_lock held
+static struct usb_scan_cache_entry *
+usb_scan_cache_get(const char *driver, const struct usb_device *dev)
+{
+  for (size_t n = 0; n < USB_SCAN_CACHE_LEN; n++) {
+    struct usb_scan_cache_entry *entry = &usb_scan_cache[n];
+    if (entry->driver && (strcmp(entry->driver, driver) == 0) &&
+        (strcmp(entry->acBus, dev->bus->dirname) == 0) && (strcmp(entry->acDevice, dev->filename) == 0) &&
+        (entry->ui16Vendor == dev->descriptor.idVendor) && (entry->ui16Product == dev->descriptor.idProduct))
+      return entry;
+  }
+  return NULL;
+}
+
+bool
+usb_scan_cache_find(const char *driver, const struct usb_device *dev)
+{
+  pthread_mutex_lock(&usb_lock);
+  const bool bFound = (usb_scan_cache_get(driver, dev) != NULL);
+  pthread_mutex_unlock(&usb_lock);
+  return bFound;
+}
+
+void
+usb_scan_cache_add(const char *driver, const struct usb_device *dev)
+{
+  pthread_mutex_lock(&usb_lock);
+  if (usb_scan_cache_get(driver, dev) == NULL) {
+    // Oldest entry goes
+    struct usb_scan_cache_entry *entry = &usb_scan_cache[usb_scan_cache_next];
+    usb_scan_cache_next = (usb_scan_cache_next + 1) % USB_SCAN_CACHE_LEN;
+    entry->driver = driver;
+    snprintf(entry->acBus, sizeof(entry->acBus), "%s", dev->bus->dirname);
+    snprintf(entry->acDevice, sizeof(entry->acDevice), "%s", dev->filename);
+    entry->ui16Vendor = dev->descriptor.idVendor;
+    entry->ui16Product = dev->descriptor.idProduct;
+    entry->bNamed = false;
+  }
+  pthread_mutex_unlock(&usb_lock);
+}
+
+bool
+usb_scan_cache_get_name(const char *driver, const struct usb_device *dev, char *buffer, size_t len)
+{
+  pthread_mutex_lock(&usb_lock);
+  const struct usb_scan_cache_entry *entry = usb_scan_cache_get(driver, dev);
+  const bool bNamed = entry && entry->bNamed;
+  if (bNamed)
+    snprintf(buffer, len, "%s", entry->acName);
+  pthread_mutex_unlock(&usb_lock);
+  return bNamed;
+}
+
+void
+usb_scan_cache_set_name(const char *driver, const struct usb_device *dev, const char *name)
+{
+  pthread_mutex_lock(&usb_lock);
+  struct usb_scan_cache_entry *entry = usb_scan_cache_get(driver, dev);
+  if (entry) {
+    snprintf(entry->acName, sizeof(entry->acName), "%s", name);
+    entry->bNamed = true;
+  }
+  pthread_mutex_unlock(&usb_lock);
+}
@@ -38,6 +38,11 @@
 #include <usb.h>
 #define USB_TIMEDOUT ETIMEDOUT
 #define _usb_strerror( X ) strerror(-X)
+#elif defined(LIBNFC_WINUSB)
+// Under Windows with the native WinUSB driver, see contrib/win32/usb-winusb.h
+#include "usb-winusb.h"
+#define USB_TIMEDOUT 116
+#define _usb_strerror( X ) usb_strerror()
 #else
 // Under Windows we use libusb-win32 (>= 1.2.5)
 #include <lusb0_usb.h>
@@ -50,4 +55,13 @@
 
 int usb_prepare(void);
 
+/*
+ * Scans only open devices they did not see yet, and device names (string
+ * descriptors, several control transfers) are read once per bus/device.
+ */
+bool usb_scan_cache_find(const char *driver, const struct usb_device *dev);
+void usb_scan_cache_add(const char *driver, const struct usb_device *dev);
+bool usb_scan_cache_get_name(const char *driver, const struct usb_device *dev, char *buffer, size_t len);
+void usb_scan_cache_set_name(const char *driver, const struct usb_device *dev, const char *name);
+
 #endif // __NFC_BUS_USB_H__
@@ -33,18 +33,20 @@
 #  include "config.h"
 #endif // HAVE_CONFIG_H
 
+#include <errno.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include "nfc/nfc.h"
+#include "nfc/nfc-emulation.h"
 #include "nfc-internal.h"
 #include "pn53x.h"
 #include "pn53x-internal.h"
 
-#include "mirror-subr.h"
 
 #define LOG_CATEGORY "libnfc.chip.pn53x"
 #define LOG_GROUP NFC_LOG_GROUP_CHIP
@@ -62,6 +64,11 @@ const nfc_baud_rate pn532_iso14443b_supported_baud_rates[] = { NBR_106, 0 };
 const nfc_baud_rate pn533_iso14443b_supported_baud_rates[] = { NBR_847, NBR_424, NBR_212, NBR_106, 0 };
 const nfc_modulation_type pn53x_supported_modulation_as_target[] = {NMT_ISO14443A, NMT_FELICA, NMT_DEP, 0};
 
+typedef nfc_modulation_type pn53x_modulations[NMT_DEP + 1];
+NFC_POOL(pn53x_data_pool, struct pn53x_data, NFC_POOL_DEVICES);
+NFC_POOL(pn53x_modulations_pool, pn53x_modulations, NFC_POOL_DEVICES);
+NFC_POOL(pn53x_target_pool, nfc_target, NFC_POOL_TARGETS);
+
 /* prototypes */
 int pn53x_reset_settings(struct nfc_device *pnd);
 int pn53x_writeback_register(struct nfc_device *pnd);
@@ -74,18 +81,25 @@ void *pn53x_current_target_new(const struct nfc_device *pnd, const nfc_target *p
 void pn53x_current_target_free(const struct nfc_device *pnd);
 bool pn53x_current_target_is(const struct nfc_device *pnd, const nfc_target *pnt);
 
+static int pn53x_warm_refresh(struct nfc_device *pnd);
+static void pn53x_warm_store(struct nfc_device *pnd);
+
 /* implementations */
 int
 pn53x_init(struct nfc_device *pnd)
 {
   int res = 0;
+  if (CHIP_DATA(pnd)->iWarm < 0)
+    pn53x_warm_lookup(pnd, pnd->connstring);
+  const bool bWarm = CHIP_DATA(pnd)->bWarm;
+
   // GetFirmwareVersion command is used to set PN53x chips type (PN531, PN532 or PN533)
-  if ((res = pn53x_decode_firmware_version(pnd)) < 0) {
+  if (!bWarm && ((res = pn53x_decode_firmware_version(pnd)) < 0)) {
     return res;
   }
 
   if (!CHIP_DATA(pnd)->supported_modulation_as_initiator) {
-    CHIP_DATA(pnd)->supported_modulation_as_initiator = malloc(sizeof(nfc_modulation_type) * (NMT_DEP + 1));
+    CHIP_DATA(pnd)->supported_modulation_as_initiator = nfc_pool_alloc(&pn53x_modulations_pool);
     if (! CHIP_DATA(pnd)->supported_modulation_as_initiator)
       return NFC_ESOFT;
     int nbSupportedModulation = 0;
@@ -128,12 +142,23 @@ pn53x_init(struct nfc_device *pnd)
   // We can't read these parameters, so we set a default config by using the SetParameters wrapper
   // Note: pn53x_SetParameters() will save the sent value in pnd->ui8Parameters cache
   if ((res = pn53x_SetParameters(pnd, PARAM_AUTO_ATR_RES | PARAM_AUTO_RATS)) < 0) {
+    pn53x_warm_forget(pnd);
+    return res;
+  }
+
+  // Once the snapshot is refreshed, settings already in place on the chip are not written again
+  if (bWarm && ((res = pn53x_warm_refresh(pnd)) < 0)) {
+    pn53x_warm_forget(pnd);
     return res;
   }
 
   if ((res = pn53x_reset_settings(pnd)) < 0) {
+    pn53x_warm_forget(pnd);
     return res;
   }
+
+  if (!bWarm)
+    pn53x_warm_store(pnd);
   return NFC_SUCCESS;
 }
 
@@ -161,54 +186,549 @@ pn53x_reset_settings(struct nfc_device *pnd)
   return NFC_SUCCESS;
 }
 
-int
-pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+static int pn53x_transceive_frame(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, const bool bDataOnly, int timeout);
+
+static uint64_t
+pn53x_stats_elapsed_us(const struct timeval *start, const struct timeval *stop)
+{
+  int64_t us = ((int64_t)(stop->tv_sec - start->tv_sec) * 1000000) + (stop->tv_usec - start->tv_usec);
+  return (us > 0) ? (uint64_t) us : 0;
+}
+
+// Moving average, a quarter weight for the new sample
+static uint32_t
+pn53x_power_average(const uint32_t uiAverage, const uint64_t ui64Sample)
+{
+  const uint32_t uiSample = (ui64Sample > UINT32_MAX) ? UINT32_MAX : (uint32_t) ui64Sample;
+  return uiAverage ? (uint32_t)(((uint64_t) uiAverage * 3 + uiSample) / 4) : uiSample;
+}
+
+static void
+pn53x_stats_error(struct nfc_device *pnd, const int res)
+{
+  switch (res) {
+    case NFC_ETIMEOUT:
+      pnd->stats.timeouts++;
+      break;
+    case NFC_EOPABORTED:
+      pnd->stats.aborts++;
+      break;
+    default:
+      pnd->stats.errors++;
+  }
+}
+
+static void
+pn53x_stats_latency(struct nfc_device *pnd, uint64_t us)
+{
+  size_t bucket = 0;
+  while ((us >>= 1) && (bucket < NFC_STATS_LATENCY_BUCKETS - 1))
+    bucket++;
+  pnd->stats.latency_histogram[bucket]++;
+}
+
+/*
+ * Adaptive timeouts: response times of InDataExchange and InCommunicateThru are
+ * kept per (modulation, command) in half-octave histograms. Once enough are
+ * known, the chip timer and the default host timeout of these commands are set
+ * adaptive_timeout_margin percent above the observed p99, never above what
+ * NP_TIMEOUT_COM and NP_TIMEOUT_COMMAND allow. An exchange timed out by the
+ * chip is counted too, at the time it was given up: otherwise a too short
+ * estimate would only ever lose the slow answers and never grow back. The host
+ * timeout is never shortened below PN53X_ADAPTIVE_HOST_TIMEOUT_MIN, and when
+ * the host still gives up first the estimate of the command is dropped, as
+ * its give-up time says nothing of the target.
+ */
+static bool
+pn53x_adaptive_command(const uint8_t btCmd)
+{
+  return (btCmd == InDataExchange) || (btCmd == InCommunicateThru);
+}
+
+static struct pn53x_adaptive_timing *
+pn53x_adaptive_lookup(struct nfc_device *pnd, const uint8_t btCmd, const bool bCreate)
+{
+  // Commands sent without a selected target are kept apart, with modulation 0
+  const nfc_modulation_type nmt = CHIP_DATA(pnd)->current_target ? CHIP_DATA(pnd)->current_target->nm.nmt : 0;
+  struct pn53x_adaptive_timing *pat = CHIP_DATA(pnd)->adaptive.timings;
+  size_t n;
+  for (n = 0; n < CHIP_DATA(pnd)->adaptive.szTimings; n++) {
+    if ((pat[n].nmt == nmt) && (pat[n].btCmd == btCmd))
+      return &pat[n];
+  }
+  if (!bCreate || (n == PN53X_ADAPTIVE_KEYS))
+    return NULL;
+  memset(&pat[n], 0, sizeof(pat[n]));
+  pat[n].nmt = nmt;
+  pat[n].btCmd = btCmd;
+  CHIP_DATA(pnd)->adaptive.szTimings++;
+  return &pat[n];
+}
+
+static size_t
+pn53x_adaptive_bucket(const uint64_t us)
+{
+  if (us < 2)
+    return 0;
+  size_t k = 0;
+  while (us >> (k + 1))
+    k++;
+  // [2^k, 1.5 * 2^k) and [1.5 * 2^k, 2^(k+1))
+  const size_t bucket = 2 * k - 1 + ((us >> (k - 1)) & 1);
+  return MIN(bucket, PN53X_ADAPTIVE_BUCKETS - 1);
+}
+
+static uint64_t
+pn53x_adaptive_bucket_limit(const size_t bucket)
+{
+  const size_t k = (bucket + 1) / 2;
+  return (bucket & 1) ? ((uint64_t) 3 << k) / 2 : (uint64_t) 2 << k;
+}
+
+static void
+pn53x_adaptive_record(struct nfc_device *pnd, const uint8_t btCmd, const uint64_t us)
+{
+  struct pn53x_adaptive_timing *pat;
+  if (!CHIP_DATA(pnd)->adaptive.iMargin || !pn53x_adaptive_command(btCmd) ||
+      !(pat = pn53x_adaptive_lookup(pnd, btCmd, true)))
+    return;
+
+  pat->aui16Histogram[pn53x_adaptive_bucket(us)]++;
+  // Old samples fade out, so that the estimate follows the cards in use
+  if (++pat->uiSamples == PN53X_ADAPTIVE_WINDOW) {
+    pat->uiSamples = 0;
+    for (size_t b = 0; b < PN53X_ADAPTIVE_BUCKETS; b++) {
+      pat->aui16Histogram[b] /= 2;
+      pat->uiSamples += pat->aui16Histogram[b];
+    }
+  }
+  if (pat->uiSamples < PN53X_ADAPTIVE_MIN_SAMPLES)
+    return;
+
+  // Upper limit of the bucket holding the 99th percentile
+  uint32_t uiAbove = 0;
+  size_t b = PN53X_ADAPTIVE_BUCKETS - 1;
+  while ((b > 0) && ((uiAbove += pat->aui16Histogram[b]) <= pat->uiSamples / 100))
+    b--;
+  const uint64_t ui64Us = pn53x_adaptive_bucket_limit(b) * (100 + CHIP_DATA(pnd)->adaptive.iMargin) / 100;
+  pat->iTimeout = (int)((ui64Us + 999) / 1000);
+}
+
+// Learns the response times of a command again, with the configured timeouts meanwhile
+static void
+pn53x_adaptive_forget(struct nfc_device *pnd, const uint8_t btCmd)
+{
+  struct pn53x_adaptive_timing *pat = pn53x_adaptive_lookup(pnd, btCmd, false);
+  if (!pat)
+    return;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Host timeout of command 0x%02x too short, learning it again", btCmd);
+  memset(pat->aui16Histogram, 0, sizeof(pat->aui16Histogram));
+  pat->uiSamples = 0;
+  pat->iTimeout = 0;
+}
+
+static uint8_t pn53x_int_to_timeout(const int ms);
+
+// Shortest RFConfiguration timeout code, 100 us << (code - 1), lasting at least ms
+static uint8_t
+pn53x_adaptive_timeout_code(const int ms)
+{
+  uint8_t code = 1;
+  while ((code < 0x10) && (((uint32_t) 100 << (code - 1)) < (uint32_t) ms * 1000))
+    code++;
+  return code;
+}
+
+static int
+pn53x_adaptive_prepare(struct nfc_device *pnd, const uint8_t btCmd, int *timeout)
+{
+  CHIP_DATA(pnd)->adaptive.bHostShortened = false;
+  if (!CHIP_DATA(pnd)->adaptive.iMargin || !pn53x_adaptive_command(btCmd))
+    return NFC_SUCCESS;
+
+  const struct pn53x_adaptive_timing *pat = pn53x_adaptive_lookup(pnd, btCmd, false);
+  uint8_t btRetryTimeout = pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication);
+  if (pat && pat->iTimeout) {
+    const uint8_t btAdaptive = pn53x_adaptive_timeout_code(pat->iTimeout);
+    if ((btRetryTimeout == 0) || (btAdaptive < btRetryTimeout))
+      btRetryTimeout = btAdaptive;
+  }
+
+  int res;
+  if ((btRetryTimeout != CHIP_DATA(pnd)->adaptive.btRetryTimeout) &&
+      ((res = pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), btRetryTimeout)) < 0))
+    return res;
+
+  // The chip gives up first, the host waits the chip timer plus the exchange time
+  if (pat && pat->iTimeout && (*timeout == -1) && btRetryTimeout) {
+    const int iHostTimeout = MAX((int)(((uint32_t) 100 << (btRetryTimeout - 1)) / 1000) + 1 + pat->iTimeout,
+                                 PN53X_ADAPTIVE_HOST_TIMEOUT_MIN);
+    if ((CHIP_DATA(pnd)->timeout_command == 0) || (iHostTimeout < CHIP_DATA(pnd)->timeout_command)) {
+      *timeout = iHostTimeout;
+      CHIP_DATA(pnd)->adaptive.bHostShortened = true;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+// Sends chip-level retries of the device retry policy when it changed, before a command they apply to
+static int
+pn53x_retry_policy_prepare(struct nfc_device *pnd, const uint8_t btCmd)
+{
+  switch (btCmd) {
+    case InListPassiveTarget:
+    case InJumpForDEP:
+    case InJumpForPSL:
+    case InATR:
+    case InPSL:
+    case InDataExchange:
+    case InCommunicateThru:
+      break;
+    default:
+      return NFC_SUCCESS;
+  }
+  if (CHIP_DATA(pnd)->uiRetryGeneration == pnd->uiRetryGeneration)
+    return NFC_SUCCESS;
+
+  int res;
+  CHIP_DATA(pnd)->uiRetryGeneration = pnd->uiRetryGeneration;
+  CHIP_DATA(pnd)->bMaxRetriesKnown = false;
+  if (((res = pn53x_RFConfiguration__MaxRtyCOM(pnd, pnd->retry_policy.chip_com)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, pnd->bInfiniteSelect)) < 0)) {
+    // Sent again next time
+    CHIP_DATA(pnd)->uiRetryGeneration--;
+    return res;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_transceive_prepare(struct nfc_device *pnd, const uint8_t *pbtTx, int *timeout)
 {
-  bool mi = false;
   int res = 0;
   if (CHIP_DATA(pnd)->wb_trigged) {
     if ((res = pn53x_writeback_register(pnd)) < 0) {
       return res;
     }
   }
+  if ((res = pn53x_retry_policy_prepare(pnd, pbtTx[0])) < 0) {
+    return res;
+  }
+  if ((res = pn53x_adaptive_prepare(pnd, pbtTx[0], timeout)) < 0) {
+    return res;
+  }
 
   PNCMD_TRACE(pbtTx[0]);
-  if (timeout > 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Timeout value: %d", timeout);
-  } else if (timeout == 0) {
+  if (*timeout > 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Timeout value: %d", *timeout);
+  } else if (*timeout == 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "No timeout");
-  } else if (timeout == -1) {
-    timeout = CHIP_DATA(pnd)->timeout_command;
+  } else if (*timeout == -1) {
+    *timeout = CHIP_DATA(pnd)->timeout_command;
   } else {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid timeout value: %d", timeout);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid timeout value: %d", *timeout);
+  }
+  return NFC_SUCCESS;
+}
+
+/*
+ * Scratch arena: frame buffers are borrowed in LIFO order. A function keeps
+ * the value of pn53x_scratch_mark() and gives back everything it (and the
+ * functions it called) borrowed with pn53x_scratch_release(). Commands are
+ * serialized per device, so the arena needs no locking. Each buffer has
+ * PN53X_TX_HEADROOM bytes in front of it, for pn53x_frame_tx().
+ */
+size_t
+pn53x_scratch_mark(struct nfc_device *pnd)
+{
+  return CHIP_DATA(pnd)->szScratchUsed;
+}
+
+uint8_t *
+pn53x_scratch_get(struct nfc_device *pnd)
+{
+  if (CHIP_DATA(pnd)->szScratchUsed >= PN53X_SCRATCH_FRAMES) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Scratch arena exhausted, PN53X_SCRATCH_FRAMES is too low");
+    return NULL;
+  }
+  return CHIP_DATA(pnd)->abtScratch[CHIP_DATA(pnd)->szScratchUsed++] + PN53X_TX_HEADROOM;
+}
+
+void
+pn53x_scratch_release(struct nfc_device *pnd, const size_t szMark)
+{
+  CHIP_DATA(pnd)->szScratchUsed = szMark;
+}
+
+// Whether pbt is a buffer returned by pn53x_scratch_get(), headroom included
+bool
+pn53x_scratch_has_headroom(const struct nfc_device *pnd, const uint8_t *pbt)
+{
+  const uintptr_t uiBase = (uintptr_t) CHIP_DATA(pnd)->abtScratch;
+  const uintptr_t uiPos = (uintptr_t) pbt;
+  if ((uiPos < uiBase) || (uiPos >= uiBase + sizeof(CHIP_DATA(pnd)->abtScratch)))
+    return false;
+  return ((uiPos - uiBase) % sizeof(CHIP_DATA(pnd)->abtScratch[0])) == PN53X_TX_HEADROOM;
+}
+
+// Copies szData bytes and returns the DCS of TFI 0xD4 followed by them
+static uint8_t
+pn53x_copy_and_sum(uint8_t *pbtDst, const uint8_t *pbtSrc, const size_t szData)
+{
+  uint8_t btDCS = (256 - 0xD4);
+  for (size_t szPos = 0; szPos < szData; szPos++) {
+    pbtDst[szPos] = pbtSrc[szPos];
+    btDCS -= pbtSrc[szPos];
   }
+  return btDCS;
+}
 
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+/*
+ * Frames a command for the bus, szPrefix bytes being left in front of the
+ * preamble for the bus to fill. Commands built in a scratch buffer are framed
+ * where they lie, headers going into its headroom; other ones are copied
+ * into a new scratch buffer, which the caller's pn53x_scratch_release() gives
+ * back. Returns the start of the prefix, *pszFrame counting it.
+ */
+uint8_t *
+pn53x_frame_tx(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const size_t szPrefix, size_t *pszFrame)
+{
+  const bool bExtended = szData > PN53x_NORMAL_FRAME__DATA_MAX_LEN;
+  const size_t szHeader = bExtended ? 9 : 6;
+  uint8_t *pbtCmd;
+  uint8_t btDCS;
 
-  // Check if receiving buffers are available, if not, replace them
-  if (szRxLen == 0 || !pbtRx) {
-    pbtRx = abtRx;
+  if (szData > PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "We can't send more than %d bytes in a raw (requested: %" PRIdPTR ")", PN53x_EXTENDED_FRAME__DATA_MAX_LEN, szData);
+    pnd->last_error = NFC_ECHIP;
+    return NULL;
+  }
+  if (pn53x_scratch_has_headroom(pnd, pbtData)) {
+    // Our own buffer: writing around the command leaves it untouched
+    pbtCmd = (uint8_t *) pbtData;
+    btDCS = (256 - 0xD4);
+    for (size_t szPos = 0; szPos < szData; szPos++)
+      btDCS -= pbtCmd[szPos];
+  } else {
+    if (!(pbtCmd = pn53x_scratch_get(pnd))) {
+      pnd->last_error = NFC_ESOFT;
+      return NULL;
+    }
+    btDCS = pn53x_copy_and_sum(pbtCmd, pbtData, szData);
+  }
+
+  uint8_t *pbtHeader = pbtCmd - szHeader;
+  pbtHeader[0] = 0x00;
+  pbtHeader[1] = 0x00;
+  pbtHeader[2] = 0xff;
+  if (bExtended) {
+    pbtHeader[3] = 0xff;
+    pbtHeader[4] = 0xff;
+    pbtHeader[5] = (szData + 1) >> 8;
+    pbtHeader[6] = (szData + 1) & 0xff;
+    pbtHeader[7] = 256 - ((pbtHeader[5] + pbtHeader[6]) & 0xff);
   } else {
-    szRx = szRxLen;
+    pbtHeader[3] = szData + 1;
+    pbtHeader[4] = 256 - (szData + 1);
+  }
+  pbtHeader[szHeader - 1] = 0xD4;
+  pbtCmd[szData] = btDCS;
+  pbtCmd[szData + 1] = 0x00;
+
+  *pszFrame = szPrefix + szHeader + szData + 2;
+  return pbtHeader - szPrefix;
+}
+
+static int
+pn53x_transceive_ex(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, const bool bDataOnly, int timeout)
+{
+  int res = 0;
+  // The chip can only handle one command at a time
+  if (CHIP_DATA(pnd)->async.bPending) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "An asynchronous exchange is still pending");
+    return pnd->last_error = NFC_EINVARG;
+  }
+  NFC_PROBE3(transceive__start, pbtTx[0], szTx, timeout);
+  if ((res = pn53x_transceive_prepare(pnd, pbtTx, &timeout)) >= 0)
+    res = pn53x_transceive_frame(pnd, pbtTx, szTx, pbtRx, szRxLen, bDataOnly, timeout);
+  NFC_PROBE2(transceive__done, pbtTx[0], res);
+  return res;
+}
+
+int
+pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+{
+  return pn53x_transceive_ex(pnd, pbtTx, szTx, pbtRx, szRxLen, false, timeout);
+}
+
+// Like pn53x_transceive() but pbtRx only gets the data following the status byte
+static int
+pn53x_transceive_data(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+{
+  return pn53x_transceive_ex(pnd, pbtTx, szTx, pbtRx, szRxLen, true, timeout);
+}
+
+static int
+pn53x_transceive_send(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout, struct timeval *tvStart, struct timeval *tvSent)
+{
+  int res = 0;
+
+  gettimeofday(tvStart, NULL);
+  if (pnd->bTiming)
+    nfc_timing_start(pnd, pbtTx[0]);
+  pnd->stats.commands[pbtTx[0]]++;
+
+  CHIP_DATA(pnd)->power.ulCommands++;
+  if (CHIP_DATA(pnd)->power.bIdle) {
+    CHIP_DATA(pnd)->power.bIdle = false;
+    CHIP_DATA(pnd)->power.uiGapUs = pn53x_power_average(CHIP_DATA(pnd)->power.uiGapUs, pn53x_stats_elapsed_us(&CHIP_DATA(pnd)->power.tvIdle, tvStart));
   }
+  // The driver wakes the chip up first, TgInitAsTarget ones are woken up by an initiator
+  CHIP_DATA(pnd)->power.bWaking = (CHIP_DATA(pnd)->power_mode != NORMAL) && (pbtTx[0] != TgInitAsTarget);
 
-  // Call the send/receice callback functions of the current driver
-  if ((res = CHIP_DATA(pnd)->io->send(pnd, pbtTx, szTx, timeout)) < 0) {
+  // Call the send callback function of the current driver
+  res = PN53X_IO(pnd)->send(pnd, pbtTx, szTx, timeout);
+  NFC_PROBE4(io__send, pbtTx[0], szTx, timeout, res);
+  if (res < 0) {
+    pn53x_stats_error(pnd, res);
     return res;
   }
+  gettimeofday(tvSent, NULL);
+  pnd->stats.send_time_us += pn53x_stats_elapsed_us(tvStart, tvSent);
+  pnd->stats.bytes_tx += szTx;
+  NFC_TRACE_FRAME(pnd, true, pbtTx, szTx);
 
   // Command is sent, we store the command
   CHIP_DATA(pnd)->last_command = pbtTx[0];
 
+  // Any other command may change what pn53x_target_init() set up
+  switch (pbtTx[0]) {
+    case TgInitAsTarget:
+    case TgGetData:
+    case TgSetData:
+    case TgSetMetaData:
+    case TgGetInitiatorCommand:
+    case TgResponseToInitiator:
+    case TgGetTargetStatus:
+      break;
+    default:
+      CHIP_DATA(pnd)->szTargetArm = 0;
+  }
+
+  switch (pbtTx[0]) {
+    case InDataExchange:
+    case InCommunicateThru:
+      // Firmware reloads its own timer settings for these commands
+      // E.g. on SCL3711 timer settings are reset by 0x42 InCommunicateThru command to:
+      //  631a=82 631b=a5 631c=02 631d=00
+      for (uint16_t ui16Reg = PN53X_REG_CIU_TMode; ui16Reg <= PN53X_REG_CIU_TReloadVal_lo; ui16Reg++) {
+        CHIP_DATA(pnd)->wb_known[ui16Reg - PN53X_CACHE_REGISTER_MIN_ADDRESS] = false;
+      }
+      break;
+    case ReadRegister:
+    case WriteRegister:
+    case GetFirmwareVersion:
+    case GetGeneralStatus:
+      break;
+    default:
+      // Other commands may let the firmware reconfigure the CIU, forget what we know about registers
+      pn53x_cache_invalidate(pnd);
+  }
+
   // Handle power mode for PN532
   if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) {  // PN532 automatically goes into PowerDown mode when TgInitAsTarget command will be sent
     CHIP_DATA(pnd)->power_mode = POWERDOWN;
   }
+  return NFC_SUCCESS;
+}
+
+/*
+ * Gets the next answer frame, from the driver buffer when the driver can hand
+ * it out in place, otherwise read into pbtBuf (or the device buffer if NULL).
+ */
+static int
+pn53x_receive_frame(struct nfc_device *pnd, uint8_t *pbtBuf, size_t szBuf, const uint8_t **ppbtFrame, int timeout)
+{
+  int res;
+
+  if (PN53X_IO(pnd)->receive_view) {
+    res = PN53X_IO(pnd)->receive_view(pnd, ppbtFrame, timeout);
+    NFC_PROBE3(io__receive, 0, timeout, res);
+    return res;
+  }
+
+  if (!pbtBuf) {
+    pbtBuf = CHIP_DATA(pnd)->abtRxFrame;
+    szBuf = sizeof(CHIP_DATA(pnd)->abtRxFrame);
+  }
+  *ppbtFrame = pbtBuf;
+  res = PN53X_IO(pnd)->receive(pnd, pbtBuf, szBuf, timeout);
+  NFC_PROBE3(io__receive, szBuf, timeout, res);
+  return res;
+}
 
-  if ((res = CHIP_DATA(pnd)->io->receive(pnd, pbtRx, szRx, timeout)) < 0) {
+/*
+ * Receives the answer to a command sent by pn53x_transceive_send().
+ * pbtTx only needs to hold the command code and its first parameter: they
+ * are all that is needed to decode the status byte and to fetch the next
+ * frames of a chained (MI) answer.
+ * With bDataOnly, the status byte is left out of pbtRx, a too short pbtRx
+ * fails with NFC_EOVFLOW and the data length is returned. Either way each
+ * frame is copied once, straight into pbtRx.
+ */
+static int
+pn53x_transceive_receive(struct nfc_device *pnd, const uint8_t *pbtTx, uint8_t *pbtRx, const size_t szRxLen, const bool bDataOnly, int timeout, const struct timeval *tvStart, const struct timeval *tvSent)
+{
+  bool mi = false;
+  bool bOverflow = false;
+  int res = 0;
+  const uint8_t *pbtFrame = NULL;
+  const size_t szSkip = bDataOnly ? 1 : 0;
+  // Without receiving buffer, the answer is only decoded
+  if (!bDataOnly && (szRxLen == 0)) {
+    pbtRx = NULL;
+  }
+  const size_t szRx = pbtRx ? szRxLen : 0;
+
+  struct timeval tvReceived;
+  res = pn53x_receive_frame(pnd, bDataOnly ? NULL : pbtRx, szRx, &pbtFrame, timeout);
+  gettimeofday(&tvReceived, NULL);
+  pnd->stats.receive_time_us += pn53x_stats_elapsed_us(tvSent, &tvReceived);
+  if (CHIP_DATA(pnd)->power.bWaking) {
+    CHIP_DATA(pnd)->power.bWaking = false;
+    if (res >= 0)
+      CHIP_DATA(pnd)->power.uiWakeUs = pn53x_power_average(CHIP_DATA(pnd)->power.uiWakeUs, pn53x_stats_elapsed_us(tvStart, &tvReceived));
+  }
+  const bool bHostShortened = CHIP_DATA(pnd)->adaptive.bHostShortened;
+  CHIP_DATA(pnd)->adaptive.bHostShortened = false;
+  if (res < 0) {
+    if ((res == NFC_ETIMEOUT) && bHostShortened)
+      pn53x_adaptive_forget(pnd, pbtTx[0]);
+    else if (res == NFC_ETIMEOUT)
+      pn53x_adaptive_record(pnd, pbtTx[0], pn53x_stats_elapsed_us(tvStart, &tvReceived));
+    pn53x_stats_error(pnd, res);
     return res;
   }
+  if (pnd->bTimingActive) {
+    nfc_timing_mark(pnd, NFC_PHASE_PARSED);
+    nfc_timing_done(pnd);
+  }
+  pnd->stats.bytes_rx += res;
+  NFC_TRACE_FRAME(pnd, false, pbtFrame, res);
+  pn53x_stats_latency(pnd, pn53x_stats_elapsed_us(tvStart, &tvReceived));
+  if ((size_t) res < szSkip) {
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+
+  size_t szOut = (size_t) res - szSkip;
+  if (pbtRx) {
+    if (szOut > szRx) {
+      bOverflow = true;
+    } else if (pbtFrame + szSkip != pbtRx) {
+      memcpy(pbtRx, pbtFrame + szSkip, szOut);
+    }
+  }
 
   if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) { // PN532 automatically wakeup on external RF field
     CHIP_DATA(pnd)->power_mode = NORMAL; // When TgInitAsTarget reply that means an external RF have waken up the chip
@@ -229,14 +749,14 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     case TgResponseToInitiator:
     case TgSetGeneralBytes:
     case TgSetMetaData:
-      if (pbtRx[0] & 0x80) { abort(); } // NAD detected
-//      if (pbtRx[0] & 0x40) { abort(); } // MI detected
-      mi = pbtRx[0] & 0x40;
-      CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+      if (pbtFrame[0] & 0x80) { abort(); } // NAD detected
+//      if (pbtFrame[0] & 0x40) { abort(); } // MI detected
+      mi = pbtFrame[0] & 0x40;
+      CHIP_DATA(pnd)->last_status_byte = pbtFrame[0] & 0x3f;
       break;
     case Diagnose:
       if (pbtTx[1] == 0x06) { // Diagnose: Card presence detection
-        CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+        CHIP_DATA(pnd)->last_status_byte = pbtFrame[0] & 0x3f;
       } else {
         CHIP_DATA(pnd)->last_status_byte = 0;
       };
@@ -249,13 +769,13 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
         CHIP_DATA(pnd)->last_status_byte = 0;
         break;
       }
-      CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+      CHIP_DATA(pnd)->last_status_byte = pbtFrame[0] & 0x3f;
       break;
     case ReadRegister:
     case WriteRegister:
       if (CHIP_DATA(pnd)->type == PN533) {
         // PN533 prepends its answer by the status byte
-        CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+        CHIP_DATA(pnd)->last_status_byte = pbtFrame[0] & 0x3f;
       } else {
         CHIP_DATA(pnd)->last_status_byte = 0;
       }
@@ -264,32 +784,52 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
       CHIP_DATA(pnd)->last_status_byte = 0;
   }
 
+  if ((CHIP_DATA(pnd)->last_status_byte == 0) || (CHIP_DATA(pnd)->last_status_byte == ETIMEOUT))
+    pn53x_adaptive_record(pnd, pbtTx[0], pn53x_stats_elapsed_us(tvStart, &tvReceived));
+
+  // InDataExchange needs its target number, TgGetData comes alone
+  const size_t szNextTx = (pbtTx[0] == InDataExchange) ? 2 : 1;
   while (mi) {
     int res2;
-    uint8_t  abtRx2[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+    pnd->stats.chained_frames++;
     // Send empty command to card
-    if ((res2 = CHIP_DATA(pnd)->io->send(pnd, pbtTx, 2, timeout)) < 0) {
+    res2 = PN53X_IO(pnd)->send(pnd, pbtTx, szNextTx, timeout);
+    NFC_PROBE4(io__send, pbtTx[0], szNextTx, timeout, res2);
+    if (res2 < 0) {
+      pn53x_stats_error(pnd, res2);
       return res2;
     }
-    if ((res2 = CHIP_DATA(pnd)->io->receive(pnd, abtRx2, sizeof(abtRx2), timeout)) < 0) {
+    pnd->stats.bytes_tx += szNextTx;
+    NFC_TRACE_FRAME(pnd, true, pbtTx, szNextTx);
+    if ((res2 = pn53x_receive_frame(pnd, NULL, 0, &pbtFrame, timeout)) < 1) {
+      res2 = (res2 < 0) ? res2 : NFC_EIO;
+      pn53x_stats_error(pnd, res2);
       return res2;
     }
-    mi = abtRx2[0] & 0x40;
-    if ((size_t)(res + res2 - 1) > szRx) {
-      CHIP_DATA(pnd)->last_status_byte = ESMALLBUF;
-      break;
+    pnd->stats.bytes_rx += res2;
+    NFC_TRACE_FRAME(pnd, false, pbtFrame, res2);
+    mi = pbtFrame[0] & 0x40;
+    // Keep reading the whole chain even when it does not fit
+    if (pbtRx && !bOverflow) {
+      if (szOut + res2 - 1 > szRx) {
+        bOverflow = true;
+      } else {
+        memcpy(pbtRx + szOut, pbtFrame + 1, res2 - 1);
+        // Copy last status byte
+        if (!bDataOnly)
+          pbtRx[0] = pbtFrame[0];
+      }
     }
-    memcpy(pbtRx + res, abtRx2 + 1, res2 - 1);
-    // Copy last status byte
-    pbtRx[0] = abtRx2[0];
-    res += res2 - 1;
+    szOut += res2 - 1;
   }
 
-  szRx = (size_t) res;
+  if (bOverflow && !bDataOnly) {
+    CHIP_DATA(pnd)->last_status_byte = ESMALLBUF;
+  }
 
   switch (CHIP_DATA(pnd)->last_status_byte) {
     case 0:
-      res = (int)szRx;
+      res = (int)szOut;
       break;
     case ETIMEOUT:
     case ECRC:
@@ -335,6 +875,11 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
       break;
   };
 
+  if ((res >= 0) && bOverflow) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szOut);
+    res = NFC_EOVFLOW;
+  }
+
   if (res < 0) {
     pnd->last_error = res;
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Chip error: \"%s\" (%02x), returned error: \"%s\" (%d))", pn53x_strerror(pnd), CHIP_DATA(pnd)->last_status_byte, nfc_strerror(pnd), res);
@@ -344,6 +889,18 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
   return res;
 }
 
+static int
+pn53x_transceive_frame(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, const bool bDataOnly, int timeout)
+{
+  int res = 0;
+  struct timeval tvStart, tvSent;
+
+  if ((res = pn53x_transceive_send(pnd, pbtTx, szTx, timeout, &tvStart, &tvSent)) < 0) {
+    return res;
+  }
+  return pn53x_transceive_receive(pnd, pbtTx, pbtRx, szRxLen, bDataOnly, timeout, &tvStart, &tvSent);
+}
+
 int
 pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Parameter, const bool bEnable)
 {
@@ -374,18 +931,16 @@ int
 pn53x_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar,
                  uint8_t *pbtFrame)
 {
-  uint8_t  btData;
-  uint32_t uiBitPos;
-  uint32_t uiDataPos = 0;
-  size_t  szBitsLeft = szTxBits;
+  uint32_t u32Bits = 0;
+  uint8_t uiBits = 0;
   size_t szFrameBits = 0;
 
   // Make sure we should frame at least something
-  if (szBitsLeft == 0)
+  if (szTxBits == 0)
     return NFC_ECHIP;
 
   // Handle a short response (1byte) as a special case
-  if (szBitsLeft < 9) {
+  if (szTxBits < 9) {
     *pbtFrame = *pbtTx;
     szFrameBits = szTxBits;
     return szFrameBits;
@@ -393,56 +948,40 @@ pn53x_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbt
   // We start by calculating the frame length in bits
   szFrameBits = szTxBits + (szTxBits / 8);
 
-  // Parse the data bytes and add the parity bits
-  // This is really a sensitive process, mirror the frame bytes and append parity bits
-  // buffer = mirror(frame-byte) + parity + mirror(frame-byte) + parity + ...
-  // split "buffer" up in segments of 8 bits again and mirror them
-  // air-bytes = mirror(buffer-byte) + mirror(buffer-byte) + mirror(buffer-byte) + ..
-  while (true) {
-    // Reset the temporary frame byte;
-    uint8_t  btFrame = 0;
-
-    for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
-      // Copy as much data that fits in the frame byte
-      btData = mirror(pbtTx[uiDataPos]);
-      btFrame |= (btData >> uiBitPos);
-      // Save this frame byte
-      *pbtFrame = mirror(btFrame);
-      // Set the remaining bits of the date in the new frame byte and append the parity bit
-      btFrame = (btData << (8 - uiBitPos));
-      btFrame |= ((pbtTxPar[uiDataPos] & 0x01) << (7 - uiBitPos));
-      // Backup the frame bits we have so far
-      pbtFrame++;
-      *pbtFrame = mirror(btFrame);
-      // Increase the data (without parity bit) position
-      uiDataPos++;
-      // Test if we are done
-      if (szBitsLeft < 9)
-        return szFrameBits;
-      szBitsLeft -= 8;
-    }
-    // Every 8 data bytes we lose one frame byte to the parities
-    pbtFrame++;
+  // The frame is a bit stream sent LSB first where every data byte is followed
+  // by its parity bit: feed 9 bits at a time and flush completed frame bytes,
+  // so 8 data bytes with their parities makes exactly 9 frame bytes
+  const size_t szTx = (szTxBits + 7) / 8;
+  for (size_t szPos = 0; szPos < szTx; szPos++) {
+    u32Bits |= (uint32_t)(pbtTx[szPos] | ((pbtTxPar[szPos] & 0x01) << 8)) << uiBits;
+    uiBits += 9;
+    *pbtFrame++ = (uint8_t) u32Bits;
+    u32Bits >>= 8;
+    uiBits -= 8;
+    if (uiBits == 8) {
+      *pbtFrame++ = (uint8_t) u32Bits;
+      u32Bits = 0;
+      uiBits = 0;
+    }
   }
+  if (uiBits)
+    *pbtFrame = (uint8_t) u32Bits;
+  return szFrameBits;
 }
 
 int
 pn53x_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar)
 {
-  uint8_t  btFrame;
-  uint8_t  btData;
-  uint8_t uiBitPos;
-  uint32_t uiDataPos = 0;
-  uint8_t *pbtFramePos = (uint8_t *) pbtFrame;
-  size_t  szBitsLeft = szFrameBits;
+  uint32_t u32Bits = 0;
+  uint8_t uiBits = 0;
   size_t szRxBits = 0;
 
   // Make sure we should frame at least something
-  if (szBitsLeft == 0)
+  if (szFrameBits == 0)
     return NFC_ECHIP;
 
   // Handle a short response (1byte) as a special case
-  if (szBitsLeft < 9) {
+  if (szFrameBits < 9) {
     *pbtRx = *pbtFrame;
     szRxBits = szFrameBits;
     return szRxBits;
@@ -450,178 +989,222 @@ pn53x_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *p
   // Calculate the data length in bits
   szRxBits = szFrameBits - (szFrameBits / 9);
 
-  // Parse the frame bytes, remove the parity bits and store them in the parity array
-  // This process is the reverse of WrapFrame(), look there for more info
-  while (true) {
-    for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
-      btFrame = mirror(pbtFramePos[uiDataPos]);
-      btData = (btFrame << uiBitPos);
-      btFrame = mirror(pbtFramePos[uiDataPos + 1]);
-      btData |= (btFrame >> (8 - uiBitPos));
-      pbtRx[uiDataPos] = mirror(btData);
-      if (pbtRxPar != NULL)
-        pbtRxPar[uiDataPos] = ((btFrame >> (7 - uiBitPos)) & 0x01);
-      // Increase the data (without parity bit) position
-      uiDataPos++;
-      // Test if we are done
-      if (szBitsLeft < 9)
-        return szRxBits;
-      szBitsLeft -= 9;
+  // Parse the frame bit stream 9 bits at a time: 8 data bits then the parity bit
+  // This process is the reverse of pn53x_wrap_frame(), look there for more info
+  const size_t szRx = (szRxBits + 7) / 8;
+  for (size_t szPos = 0; szPos < szRx; szPos++) {
+    u32Bits |= (uint32_t)(*pbtFrame++) << uiBits;
+    uiBits += 8;
+    if (uiBits < 9) {
+      u32Bits |= (uint32_t)(*pbtFrame++) << uiBits;
+      uiBits += 8;
     }
-    // Every 8 data bytes we lose one frame byte to the parities
-    pbtFramePos++;
+    pbtRx[szPos] = (uint8_t) u32Bits;
+    if (pbtRxPar != NULL)
+      pbtRxPar[szPos] = (u32Bits >> 8) & 0x01;
+    u32Bits >>= 9;
+    uiBits -= 9;
   }
+  return szRxBits;
 }
 
-int
-pn53x_decode_target_data(const uint8_t *pbtRawData, size_t szRawData, pn53x_type type, nfc_modulation_type nmt,
-                         nfc_target_info *pnti)
-{
-  uint8_t szAttribRes;
-  const uint8_t *pbtUid;
+/*
+ * TargetData layout of each modulation, as found in InListPassiveTarget and
+ * InAutoPoll answers. Fixed fields are copied as they are, what depends on
+ * the data itself is left to the tail decoder.
+ */
+#define PN53X_TARGET_FIELDS_MAX 4
 
-  switch (nmt) {
-    case NMT_ISO14443A:
-      // We skip the first byte: its the target number (Tg)
-      pbtRawData++;
+struct pn53x_target_field {
+  uint8_t ui8Offset;
+  uint8_t ui8Len;
+  uint16_t ui16Member;
+};
 
-      // Somehow they switched the lower and upper ATQA bytes around for the PN531 chipset
-      if (type == PN531) {
-        pnti->nai.abtAtqa[1] = *(pbtRawData++);
-        pnti->nai.abtAtqa[0] = *(pbtRawData++);
-      } else {
-        pnti->nai.abtAtqa[0] = *(pbtRawData++);
-        pnti->nai.abtAtqa[1] = *(pbtRawData++);
-      }
-      pnti->nai.btSak = *(pbtRawData++);
-      // Copy the NFCID1
-      pnti->nai.szUidLen = *(pbtRawData++);
-      pbtUid = pbtRawData;
-      pbtRawData += pnti->nai.szUidLen;
-
-      // Did we received an optional ATS (Smardcard ATR)
-      if (szRawData > (pnti->nai.szUidLen + 5)) {
-        pnti->nai.szAtsLen = ((*(pbtRawData++)) - 1);     // In pbtRawData, ATS Length byte is counted in ATS Frame.
-        memcpy(pnti->nai.abtAts, pbtRawData, pnti->nai.szAtsLen);
-      } else {
-        pnti->nai.szAtsLen = 0;
-      }
-
-      // For PN531, strip CT (Cascade Tag) to retrieve and store the _real_ UID
-      // (e.g. 0x8801020304050607 is in fact 0x01020304050607)
-      if ((pnti->nai.szUidLen == 8) && (pbtUid[0] == 0x88)) {
-        pnti->nai.szUidLen = 7;
-        memcpy(pnti->nai.abtUid, pbtUid + 1, 7);
-//      } else if ((pnti->nai.szUidLen == 12) && (pbtUid[0] == 0x88) && (pbtUid[4] == 0x88)) {
-      } else if (pnti->nai.szUidLen > 10) {
-        pnti->nai.szUidLen = 10;
-        memcpy(pnti->nai.abtUid, pbtUid + 1, 3);
-        memcpy(pnti->nai.abtUid + 3, pbtUid + 5, 3);
-        memcpy(pnti->nai.abtUid + 6, pbtUid + 8, 4);
-      } else {
-        // For PN532, PN533
-        memcpy(pnti->nai.abtUid, pbtUid, pnti->nai.szUidLen);
-      }
-      break;
+struct pn53x_target_layout {
+  // Shorter TargetData are rejected before anything is written
+  uint8_t szMin;
+  // Size of a target amongst several: szBase + pbtData[iLenByte] (iLenByte < 0: fixed), 0 when it takes what is left
+  uint8_t szBase;
+  int8_t iLenByte;
+  uint8_t szFields;
+  struct pn53x_target_field afFields[PN53X_TARGET_FIELDS_MAX];
+  int (*decode_tail)(const uint8_t *pbtRawData, const size_t szRawData, const pn53x_type type, nfc_target_info *pnti);
+};
 
-    case NMT_ISO14443B:
-      // We skip the first byte: its the target number (Tg)
-      pbtRawData++;
+#define PN53X_TARGET_FIELD(offset, len, member) { offset, len, offsetof(nfc_target_info, member) }
 
-      // Now we are in ATQB, we skip the first ATQB byte always equal to 0x50
-      pbtRawData++;
+static int
+pn53x_decode_iso14443a_tail(const uint8_t *pbtRawData, const size_t szRawData, const pn53x_type type, nfc_target_info *pnti)
+{
+  const size_t szUidLen = pbtRawData[4];
+  const uint8_t *pbtUid = pbtRawData + 5;
 
-      // Store the PUPI (Pseudo-Unique PICC Identifier)
-      memcpy(pnti->nbi.abtPupi, pbtRawData, 4);
-      pbtRawData += 4;
+  if (5 + szUidLen > szRawData)
+    return NFC_ECHIP;
+  // Somehow they switched the lower and upper ATQA bytes around for the PN531 chipset
+  if (type == PN531) {
+    pnti->nai.abtAtqa[0] = pbtRawData[2];
+    pnti->nai.abtAtqa[1] = pbtRawData[1];
+  }
+
+  // Did we received an optional ATS (Smardcard ATR)
+  pnti->nai.szAtsLen = 0;
+  if (szRawData > 5 + szUidLen) {
+    // In pbtRawData, ATS Length byte is counted in ATS Frame
+    size_t szAtsLen = pbtRawData[5 + szUidLen];
+    szAtsLen = MIN(szAtsLen ? szAtsLen - 1 : 0, szRawData - 6 - szUidLen);
+    pnti->nai.szAtsLen = MIN(szAtsLen, sizeof(pnti->nai.abtAts));
+    memcpy(pnti->nai.abtAts, pbtUid + szUidLen + 1, pnti->nai.szAtsLen);
+  }
+
+  // For PN531, strip CT (Cascade Tag) to retrieve and store the _real_ UID
+  // (e.g. 0x8801020304050607 is in fact 0x01020304050607)
+  if ((szUidLen == 8) && (pbtUid[0] == 0x88)) {
+    pnti->nai.szUidLen = 7;
+    memcpy(pnti->nai.abtUid, pbtUid + 1, 7);
+  } else if (szUidLen > 10) {
+    if (szUidLen < 12)
+      return NFC_ECHIP;
+    pnti->nai.szUidLen = 10;
+    memcpy(pnti->nai.abtUid, pbtUid + 1, 3);
+    memcpy(pnti->nai.abtUid + 3, pbtUid + 5, 3);
+    memcpy(pnti->nai.abtUid + 6, pbtUid + 8, 4);
+  } else {
+    // For PN532, PN533
+    pnti->nai.szUidLen = szUidLen;
+    memcpy(pnti->nai.abtUid, pbtUid, szUidLen);
+  }
+  return NFC_SUCCESS;
+}
 
-      // Store the Application Data
-      memcpy(pnti->nbi.abtApplicationData, pbtRawData, 4);
-      pbtRawData += 4;
+static int
+pn53x_decode_iso14443b_tail(const uint8_t *pbtRawData, const size_t szRawData, const pn53x_type type, nfc_target_info *pnti)
+{
+  (void) type;
+  // ATTRIB_RES, which starts with the Card IDentifier
+  pnti->nbi.ui8CardIdentifier = (pbtRawData[13] && (szRawData > 14)) ? pbtRawData[14] : 0;
+  return NFC_SUCCESS;
+}
 
-      // Store the Protocol Info
-      memcpy(pnti->nbi.abtProtocolInfo, pbtRawData, 3);
-      pbtRawData += 3;
+static int
+pn53x_decode_iso14443bi_tail(const uint8_t *pbtRawData, const size_t szRawData, const pn53x_type type, nfc_target_info *pnti)
+{
+  (void) type;
+  // After V & T addresses: 0x07 = REPGEN
+  if (pbtRawData[1] != 0x07)
+    return NFC_ECHIP;
+  pnti->nii.btConfig = 0;
+  pnti->nii.szAtrLen = 0;
+  // Type = long?
+  if ((pnti->nii.btVerLog & 0x80) && (szRawData > 7)) {
+    pnti->nii.btConfig = pbtRawData[7];
+    if (pnti->nii.btConfig & 0x40) {
+      pnti->nii.szAtrLen = MIN(szRawData - 8, sizeof(pnti->nii.abtAtr));
+      memcpy(pnti->nii.abtAtr, pbtRawData + 8, pnti->nii.szAtrLen);
+    }
+  }
+  return NFC_SUCCESS;
+}
 
-      // We leave the ATQB field, we now enter in Card IDentifier
-      szAttribRes = *(pbtRawData++);
-      if (szAttribRes) {
-        pnti->nbi.ui8CardIdentifier = *(pbtRawData++);
-      }
-      break;
-
-    case NMT_ISO14443BI:
-      // Skip V & T Addresses
-      pbtRawData++;
-      if (*pbtRawData != 0x07) { // 0x07 = REPGEN
-        return NFC_ECHIP;
-      }
-      pbtRawData++;
-      // Store the UID
-      memcpy(pnti->nii.abtDIV, pbtRawData, 4);
-      pbtRawData += 4;
-      pnti->nii.btVerLog = *(pbtRawData++);
-      if (pnti->nii.btVerLog & 0x80) { // Type = long?
-        pnti->nii.btConfig = *(pbtRawData++);
-        if (pnti->nii.btConfig & 0x40) {
-          memcpy(pnti->nii.abtAtr, pbtRawData, szRawData - 8);
-          pnti->nii.szAtrLen = szRawData - 8;
-        }
-      }
-      break;
+static int
+pn53x_decode_felica_tail(const uint8_t *pbtRawData, const size_t szRawData, const pn53x_type type, nfc_target_info *pnti)
+{
+  (void) type;
+  pnti->nfi.szLen = pbtRawData[1];
+  // Test if the System code (SYST_CODE) is available
+  if ((pnti->nfi.szLen > 18) && (szRawData >= 21))
+    memcpy(pnti->nfi.abtSysCode, pbtRawData + 19, 2);
+  else
+    memset(pnti->nfi.abtSysCode, 0x00, 2);
+  return NFC_SUCCESS;
+}
 
-    case NMT_ISO14443B2SR:
-      // Store the UID
-      memcpy(pnti->nsi.abtUID, pbtRawData, 8);
-      break;
+static int
+pn53x_decode_barcode_tail(const uint8_t *pbtRawData, const size_t szRawData, const pn53x_type type, nfc_target_info *pnti)
+{
+  (void) type;
+  if (szRawData > sizeof(pnti->nti.abtData))
+    return NFC_ECHIP;
+  pnti->nti.szDataLen = szRawData;
+  memcpy(pnti->nti.abtData, pbtRawData, szRawData);
+  return NFC_SUCCESS;
+}
 
-    case NMT_ISO14443B2CT:
-      // Store UID LSB
-      memcpy(pnti->nci.abtUID, pbtRawData, 2);
-      pbtRawData += 2;
-      // Store Prod Code & Fab Code
-      pnti->nci.btProdCode = *(pbtRawData++);
-      pnti->nci.btFabCode = *(pbtRawData++);
-      // Store UID MSB
-      memcpy(pnti->nci.abtUID + 2, pbtRawData, 2);
-      break;
+// Tg comes first where it is sent, DEP targets are not decoded from TargetData
+static const struct pn53x_target_layout pn53x_target_layouts[NMT_DEP + 1] = {
+  [NMT_ISO14443A] = {
+    5, 5, 4, 2, {
+      PN53X_TARGET_FIELD(1, 2, nai.abtAtqa),
+      PN53X_TARGET_FIELD(3, 1, nai.btSak),
+    }, pn53x_decode_iso14443a_tail
+  },
+  [NMT_JEWEL] = {
+    7, 7, -1, 2, {
+      PN53X_TARGET_FIELD(1, 2, nji.btSensRes),
+      PN53X_TARGET_FIELD(3, 4, nji.btId),
+    }, NULL
+  },
+  [NMT_BARCODE] = {
+    0, 0, -1, 0, { { 0, 0, 0 } }, pn53x_decode_barcode_tail
+  },
+  // ATQB starts with 0x50, then ATTRIB_RES length
+  [NMT_ISO14443B] = {
+    14, 14, 13, 3, {
+      PN53X_TARGET_FIELD(2, 4, nbi.abtPupi),
+      PN53X_TARGET_FIELD(6, 4, nbi.abtApplicationData),
+      PN53X_TARGET_FIELD(10, 3, nbi.abtProtocolInfo),
+    }, pn53x_decode_iso14443b_tail
+  },
+  [NMT_ISO14443BI] = {
+    7, 0, -1, 2, {
+      PN53X_TARGET_FIELD(2, 4, nii.abtDIV),
+      PN53X_TARGET_FIELD(6, 1, nii.btVerLog),
+    }, pn53x_decode_iso14443bi_tail
+  },
+  [NMT_ISO14443B2SR] = {
+    8, 0, -1, 1, {
+      PN53X_TARGET_FIELD(0, 8, nsi.abtUID),
+    }, NULL
+  },
+  // UID LSB, product code, fab code, UID MSB
+  [NMT_ISO14443B2CT] = {
+    6, 0, -1, 4, {
+      PN53X_TARGET_FIELD(0, 2, nci.abtUID),
+      PN53X_TARGET_FIELD(2, 1, nci.btProdCode),
+      PN53X_TARGET_FIELD(3, 1, nci.btFabCode),
+      PN53X_TARGET_FIELD(4, 2, nci.abtUID[2]),
+    }, NULL
+  },
+  [NMT_FELICA] = {
+    19, 1, 1, 3, {
+      PN53X_TARGET_FIELD(2, 1, nfi.btResCode),
+      PN53X_TARGET_FIELD(3, 8, nfi.abtId),
+      PN53X_TARGET_FIELD(11, 8, nfi.abtPad),
+    }, pn53x_decode_felica_tail
+  },
+};
 
-    case NMT_FELICA:
-      // We skip the first byte: its the target number (Tg)
-      pbtRawData++;
-
-      // Store the mandatory info
-      pnti->nfi.szLen = *(pbtRawData++);
-      pnti->nfi.btResCode = *(pbtRawData++);
-      // Copy the NFCID2t
-      memcpy(pnti->nfi.abtId, pbtRawData, 8);
-      pbtRawData += 8;
-      // Copy the felica padding
-      memcpy(pnti->nfi.abtPad, pbtRawData, 8);
-      pbtRawData += 8;
-      // Test if the System code (SYST_CODE) is available
-      if (pnti->nfi.szLen > 18) {
-        memcpy(pnti->nfi.abtSysCode, pbtRawData, 2);
-      }
-      break;
-    case NMT_JEWEL:
-      // We skip the first byte: its the target number (Tg)
-      pbtRawData++;
+/*
+ * Decodes one TargetData into pnti. The layout is checked against szRawData
+ * before anything is written. Like the fields, lengths and optional scalars
+ * are always set, but array bytes past those lengths are left untouched.
+ */
+int
+pn53x_decode_target_data(const uint8_t *pbtRawData, size_t szRawData, pn53x_type type, nfc_modulation_type nmt,
+                         nfc_target_info *pnti)
+{
+  if ((nmt < NMT_ISO14443A) || (nmt > NMT_DEP))
+    return NFC_ECHIP;
+  const struct pn53x_target_layout *pl = &pn53x_target_layouts[nmt];
+  if (((pl->szFields == 0) && (pl->decode_tail == NULL)) || (szRawData < pl->szMin))
+    return NFC_ECHIP;
 
-      // Store the mandatory info
-      memcpy(pnti->nji.btSensRes, pbtRawData, 2);
-      pbtRawData += 2;
-      memcpy(pnti->nji.btId, pbtRawData, 4);
-      break;
-    case NMT_BARCODE:
-      pnti->nti.szDataLen = szRawData;
-      memcpy(pnti->nti.abtData, pbtRawData, szRawData);
-      break;
-    // Should not happend...
-    case NMT_DEP:
-      return NFC_ECHIP;
+  for (size_t i = 0; i < pl->szFields; i++) {
+    const struct pn53x_target_field *pf = &pl->afFields[i];
+    memcpy((uint8_t *) pnti + pf->ui16Member, pbtRawData + pf->ui8Offset, pf->ui8Len);
   }
-  return NFC_SUCCESS;
+  return pl->decode_tail ? pl->decode_tail(pbtRawData, szRawData, type, pnti) : NFC_SUCCESS;
 }
 
 static int
@@ -645,9 +1228,81 @@ pn53x_ReadRegister(struct nfc_device *pnd, uint16_t ui16RegisterAddress, uint8_t
   return NFC_SUCCESS;
 }
 
+static bool
+pn53x_register_is_cacheable(const uint16_t ui16RegisterAddress)
+{
+  if ((ui16RegisterAddress < PN53X_CACHE_REGISTER_MIN_ADDRESS) || (ui16RegisterAddress > PN53X_CACHE_REGISTER_MAX_ADDRESS))
+    return false;
+  switch (ui16RegisterAddress) {
+    // Unused addresses
+    case 0x630F:
+    case 0x6310:
+    case 0x6320:
+    case 0x632C:
+    case 0x632D:
+    case 0x632E:
+    // Registers updated by the CIU itself
+    case PN53X_REG_CIU_CRCResultMSB:
+    case PN53X_REG_CIU_CRCResultLSB:
+    case PN53X_REG_CIU_TCounterVal_hi:
+    case PN53X_REG_CIU_TCounterVal_lo:
+    case PN53X_REG_CIU_TestPinValue:
+    case PN53X_REG_CIU_TestBus:
+    case PN53X_REG_CIU_AutoTest:
+    case PN53X_REG_CIU_TestADC:
+    case PN53X_REG_CIU_RFlevelDet:
+    case PN53X_REG_CIU_Command:
+    case PN53X_REG_CIU_CommIrq:
+    case PN53X_REG_CIU_DivIrq:
+    case PN53X_REG_CIU_Error:
+    case PN53X_REG_CIU_Status1:
+    case PN53X_REG_CIU_Status2:
+    case PN53X_REG_CIU_FIFOData:
+    case PN53X_REG_CIU_FIFOLevel:
+    case PN53X_REG_CIU_Control:
+    case PN53X_REG_CIU_BitFraming:
+    case PN53X_REG_CIU_Coll:
+      return false;
+    default:
+      return true;
+  }
+}
+
+static void
+pn53x_cache_store(struct nfc_device *pnd, const uint16_t ui16RegisterAddress, const uint8_t ui8Value)
+{
+  if (pn53x_register_is_cacheable(ui16RegisterAddress)) {
+    const int internal_address = ui16RegisterAddress - PN53X_CACHE_REGISTER_MIN_ADDRESS;
+    CHIP_DATA(pnd)->wb_shadow[internal_address] = ui8Value;
+    CHIP_DATA(pnd)->wb_known[internal_address] = true;
+  }
+}
+
+void
+pn53x_cache_invalidate(struct nfc_device *pnd)
+{
+  memset(CHIP_DATA(pnd)->wb_known, false, sizeof(CHIP_DATA(pnd)->wb_known));
+}
+
 int pn53x_read_register(struct nfc_device *pnd, uint16_t ui16RegisterAddress, uint8_t *ui8Value)
 {
-  return pn53x_ReadRegister(pnd, ui16RegisterAddress, ui8Value);
+  int res = 0;
+  if (pn53x_register_is_cacheable(ui16RegisterAddress)) {
+    const int internal_address = ui16RegisterAddress - PN53X_CACHE_REGISTER_MIN_ADDRESS;
+    if (CHIP_DATA(pnd)->wb_mask[internal_address] == 0xff) {
+      // Pending write covers the whole register
+      *ui8Value = CHIP_DATA(pnd)->wb_data[internal_address];
+      return NFC_SUCCESS;
+    }
+    if ((CHIP_DATA(pnd)->wb_mask[internal_address] == 0x00) && CHIP_DATA(pnd)->wb_known[internal_address]) {
+      *ui8Value = CHIP_DATA(pnd)->wb_shadow[internal_address];
+      return NFC_SUCCESS;
+    }
+  }
+  if ((res = pn53x_ReadRegister(pnd, ui16RegisterAddress, ui8Value)) < 0)
+    return res;
+  pn53x_cache_store(pnd, ui16RegisterAddress, *ui8Value);
+  return NFC_SUCCESS;
 }
 
 static int
@@ -689,27 +1344,41 @@ int
 pn53x_writeback_register(struct nfc_device *pnd)
 {
   int res = 0;
-  // TODO Check at each step (ReadRegister, WriteRegister) if we didn't exceed max supported frame length
-  BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  // ReadRegister then WriteRegister commands, built one after the other
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  uint8_t *abtRes = pn53x_scratch_get(pnd);
+  size_t szCmd = 0;
+
+  if (!abtCmd || !abtRes) {
+    pn53x_scratch_release(pnd, szScratch);
+    return NFC_ESOFT;
+  }
+  // Both commands fit: a ReadRegister needs 2 bytes and a WriteRegister 3 per register
+  abtCmd[szCmd++] = ReadRegister;
 
   // First step, it looks for registers to be read before applying the requested mask
   CHIP_DATA(pnd)->wb_trigged = false;
   for (size_t n = 0; n < PN53X_CACHE_REGISTER_SIZE; n++) {
     if ((CHIP_DATA(pnd)->wb_mask[n]) && (CHIP_DATA(pnd)->wb_mask[n] != 0xff)) {
+      if (CHIP_DATA(pnd)->wb_known[n]) {
+        // Current value is known, we can merge the requested bits right now
+        CHIP_DATA(pnd)->wb_data[n] = ((CHIP_DATA(pnd)->wb_data[n] & CHIP_DATA(pnd)->wb_mask[n]) | (CHIP_DATA(pnd)->wb_shadow[n] & (~CHIP_DATA(pnd)->wb_mask[n])));
+        CHIP_DATA(pnd)->wb_mask[n] = 0xff;
+        continue;
+      }
       // This register needs to be read: mask is present but does not cover full data width (ie. mask != 0xff)
       const uint16_t pn53x_register_address = PN53X_CACHE_REGISTER_MIN_ADDRESS + n;
-      BUFFER_APPEND(abtReadRegisterCmd, pn53x_register_address  >> 8);
-      BUFFER_APPEND(abtReadRegisterCmd, pn53x_register_address & 0xff);
+      abtCmd[szCmd++] = pn53x_register_address  >> 8;
+      abtCmd[szCmd++] = pn53x_register_address & 0xff;
     }
   }
 
-  if (BUFFER_SIZE(abtReadRegisterCmd) > 1) {
+  if (szCmd > 1) {
     // It needs to read some registers
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
     // It transceives the previously constructed ReadRegister command
-    if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
+    if ((res = pn53x_transceive(pnd, abtCmd, szCmd, abtRes, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, -1)) < 0) {
+      pn53x_scratch_release(pnd, szScratch);
       return res;
     }
     size_t i = 0;
@@ -719,6 +1388,7 @@ pn53x_writeback_register(struct nfc_device *pnd)
     }
     for (size_t n = 0; n < PN53X_CACHE_REGISTER_SIZE; n++) {
       if ((CHIP_DATA(pnd)->wb_mask[n]) && (CHIP_DATA(pnd)->wb_mask[n] != 0xff)) {
+        pn53x_cache_store(pnd, PN53X_CACHE_REGISTER_MIN_ADDRESS + n, abtRes[i]);
         CHIP_DATA(pnd)->wb_data[n] = ((CHIP_DATA(pnd)->wb_data[n] & CHIP_DATA(pnd)->wb_mask[n]) | (abtRes[i] & (~CHIP_DATA(pnd)->wb_mask[n])));
         if (CHIP_DATA(pnd)->wb_data[n] != abtRes[i]) {
           // Requested value is different from read one
@@ -731,25 +1401,124 @@ pn53x_writeback_register(struct nfc_device *pnd)
     }
   }
   // Now, the writeback-cache only has masks with 0xff, we can start to WriteRegister
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
+  szCmd = 0;
+  abtCmd[szCmd++] = WriteRegister;
   for (size_t n = 0; n < PN53X_CACHE_REGISTER_SIZE; n++) {
     if (CHIP_DATA(pnd)->wb_mask[n] == 0xff) {
-      const uint16_t pn53x_register_address = PN53X_CACHE_REGISTER_MIN_ADDRESS + n;
-      PNREG_TRACE(pn53x_register_address);
-      BUFFER_APPEND(abtWriteRegisterCmd, pn53x_register_address  >> 8);
-      BUFFER_APPEND(abtWriteRegisterCmd, pn53x_register_address & 0xff);
-      BUFFER_APPEND(abtWriteRegisterCmd, CHIP_DATA(pnd)->wb_data[n]);
       // This register is handled, we reset the mask to prevent
       CHIP_DATA(pnd)->wb_mask[n] = 0x00;
+      if (CHIP_DATA(pnd)->wb_known[n] && (CHIP_DATA(pnd)->wb_shadow[n] == CHIP_DATA(pnd)->wb_data[n])) {
+        // Register already holds the requested value
+        continue;
+      }
+      const uint16_t pn53x_register_address = PN53X_CACHE_REGISTER_MIN_ADDRESS + n;
+      PNREG_TRACE(pn53x_register_address);
+      abtCmd[szCmd++] = pn53x_register_address  >> 8;
+      abtCmd[szCmd++] = pn53x_register_address & 0xff;
+      abtCmd[szCmd++] = CHIP_DATA(pnd)->wb_data[n];
     }
   }
 
-  if (BUFFER_SIZE(abtWriteRegisterCmd) > 1) {
+  if (szCmd > 1) {
     // We need to write some registers
-    if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
+    res = pn53x_transceive(pnd, abtCmd, szCmd, NULL, 0, -1);
+    NFC_PROBE2(writeback, (szCmd - 1) / 3, res);
+    if (res < 0) {
+      pn53x_cache_invalidate(pnd);
+      pn53x_scratch_release(pnd, szScratch);
       return res;
     }
+    // Keep track of the values we just wrote
+    for (size_t i = 1; i < szCmd; i += 3) {
+      const uint16_t pn53x_register_address = (abtCmd[i] << 8) | abtCmd[i + 1];
+      pn53x_cache_store(pnd, pn53x_register_address, abtCmd[i + 2]);
+    }
+  }
+  pn53x_scratch_release(pnd, szScratch);
+  return NFC_SUCCESS;
+}
+
+struct pn53x_register_setting {
+  uint16_t ui16Register;
+  uint8_t ui8SymbolMask;
+  uint8_t ui8Value;
+};
+
+#define PN53X_PROFILE_MAX_SETTINGS 3
+
+/*
+ * Framing and speed of the CIU for modulations the host drives by itself,
+ * CRC and parity handling are left to their own properties.
+ */
+static const struct {
+  nfc_modulation nm;
+  size_t szSettings;
+  struct pn53x_register_setting settings[PN53X_PROFILE_MAX_SETTINGS];
+} pn53x_register_profiles[] = {
+  {
+    { NMT_ISO14443A, NBR_106 }, 3, {
+      { PN53X_REG_CIU_TxMode, SYMBOL_TX_FRAMING | SYMBOL_TX_SPEED, 0x00 },
+      { PN53X_REG_CIU_RxMode, SYMBOL_RX_FRAMING | SYMBOL_RX_SPEED, 0x00 },
+      { PN53X_REG_CIU_TxAuto, SYMBOL_FORCE_100_ASK, 0x40 },
+    }
+  },
+  {
+    { NMT_ISO14443B, NBR_106 }, 2, {
+      { PN53X_REG_CIU_TxMode, SYMBOL_TX_FRAMING | SYMBOL_TX_SPEED, 0x03 },
+      { PN53X_REG_CIU_RxMode, SYMBOL_RX_FRAMING | SYMBOL_RX_SPEED, 0x03 },
+    }
+  },
+  {
+    { NMT_FELICA, NBR_212 }, 3, {
+      { PN53X_REG_CIU_TxMode, SYMBOL_TX_FRAMING | SYMBOL_TX_SPEED, 0x12 },
+      { PN53X_REG_CIU_RxMode, SYMBOL_RX_FRAMING | SYMBOL_RX_SPEED, 0x12 },
+      { PN53X_REG_CIU_TxAuto, SYMBOL_FORCE_100_ASK, 0x00 },
+    }
+  },
+  {
+    { NMT_FELICA, NBR_424 }, 3, {
+      { PN53X_REG_CIU_TxMode, SYMBOL_TX_FRAMING | SYMBOL_TX_SPEED, 0x22 },
+      { PN53X_REG_CIU_RxMode, SYMBOL_RX_FRAMING | SYMBOL_RX_SPEED, 0x22 },
+      { PN53X_REG_CIU_TxAuto, SYMBOL_FORCE_100_ASK, 0x00 },
+    }
+  },
+};
+
+int
+pn53x_set_register_profile(struct nfc_device *pnd, const nfc_modulation nm)
+{
+  nfc_modulation_type nmt = nm.nmt;
+  nfc_baud_rate nbr = nm.nbr;
+  int res = 0;
+  size_t n;
+
+  switch (nmt) {
+    case NMT_ISO14443BI:
+    case NMT_ISO14443B2SR:
+    case NMT_ISO14443B2CT:
+      // Same physical layer at 106 kbps, only the commands differ
+      nmt = NMT_ISO14443B;
+      nbr = NBR_106;
+      break;
+    default:
+      break;
+  }
+  for (n = 0; n < sizeof(pn53x_register_profiles) / sizeof(pn53x_register_profiles[0]); n++) {
+    if ((pn53x_register_profiles[n].nm.nmt == nmt) && (pn53x_register_profiles[n].nm.nbr == nbr))
+      break;
+  }
+  if (n == sizeof(pn53x_register_profiles) / sizeof(pn53x_register_profiles[0]))
+    return pnd->last_error = NFC_EINVARG;
+
+  for (size_t i = 0; i < pn53x_register_profiles[n].szSettings; i++) {
+    const struct pn53x_register_setting *prs = &pn53x_register_profiles[n].settings[i];
+    const int internal_address = prs->ui16Register - PN53X_CACHE_REGISTER_MIN_ADDRESS;
+    // Only queue what differs from the chip: once flushed, the whole profile costs one WriteRegister
+    if (CHIP_DATA(pnd)->wb_known[internal_address] && !(CHIP_DATA(pnd)->wb_mask[internal_address] & prs->ui8SymbolMask) &&
+        ((CHIP_DATA(pnd)->wb_shadow[internal_address] & prs->ui8SymbolMask) == prs->ui8Value))
+      continue;
+    if ((res = pn53x_write_register(pnd, prs->ui16Register, prs->ui8SymbolMask, prs->ui8Value)) < 0)
+      return res;
   }
   return NFC_SUCCESS;
 }
@@ -848,6 +1617,8 @@ pn53x_set_property_int(struct nfc_device *pnd, const nfc_property property, cons
     case NP_FORCE_ISO14443_A:
     case NP_FORCE_ISO14443_B:
     case NP_FORCE_SPEED_106:
+    case NP_AUTO_BITRATE:
+    case NP_COMMAND_TIMING:
       return NFC_EINVARG;
   }
   return NFC_SUCCESS;
@@ -900,12 +1671,20 @@ pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, con
       // TODO Made some research around this point:
       // timings could be tweak better than this, and maybe we can tweak timings
       // to "gain" a sort-of hardware polling (ie. like PN532 does)
+      if ((bEnable == pnd->bInfiniteSelect) && CHIP_DATA(pnd)->bMaxRetriesKnown)
+        // Nothing to do
+        return NFC_SUCCESS;
       pnd->bInfiniteSelect = bEnable;
-      return pn53x_RFConfiguration__MaxRetries(pnd,
-                                               (bEnable) ? 0xff : 0x00,        // MxRtyATR, default: active = 0xff, passive = 0x02
-                                               (bEnable) ? 0xff : 0x01,        // MxRtyPSL, default: 0x01
-                                               (bEnable) ? 0xff : 0x02         // MxRtyPassiveActivation, default: 0xff (0x00 leads to problems with PN531)
-                                              );
+      CHIP_DATA(pnd)->bMaxRetriesKnown = false;
+      // Finite retries come from the device retry policy, see nfc_device_set_retry_policy()
+      if ((res = pn53x_RFConfiguration__MaxRetries(pnd,
+                                                   (bEnable) ? 0xff : pnd->retry_policy.chip_atr,                 // MxRtyATR, default: active = 0xff, passive = 0x02
+                                                   (bEnable) ? 0xff : pnd->retry_policy.chip_psl,                 // MxRtyPSL, default: 0x01
+                                                   (bEnable) ? 0xff : pnd->retry_policy.chip_passive_activation   // MxRtyPassiveActivation, default: 0xff (0x00 leads to problems with PN531)
+                                                  )) < 0)
+        return res;
+      CHIP_DATA(pnd)->bMaxRetriesKnown = true;
+      return NFC_SUCCESS;
 
     case NP_ACCEPT_INVALID_FRAMES:
       btValue = (bEnable) ? SYMBOL_RX_NO_ERROR : 0x00;
@@ -958,6 +1737,16 @@ pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, con
         return res;
       }
       return pn53x_write_register(pnd, PN53X_REG_CIU_RxMode, SYMBOL_RX_SPEED, 0x00);
+
+    case NP_AUTO_BITRATE:
+      // Only used by next selects
+      pnd->bAutoBitrate = bEnable;
+      return NFC_SUCCESS;
+
+    case NP_COMMAND_TIMING:
+      pnd->bTiming = bEnable;
+      pnd->bTimingActive = false;
+      return NFC_SUCCESS;
     // Following properties are invalid (not boolean)
     case NP_TIMEOUT_COMMAND:
     case NP_TIMEOUT_ATR:
@@ -968,6 +1757,187 @@ pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, con
   return NFC_EINVARG;
 }
 
+/*
+ * Register properties only land in the write-back cache, which already drops
+ * writes the chip holds; the others are reduced to their final value so that
+ * each remaining command (SetParameters, RFConfiguration) is sent at most once.
+ * As with single setters, registers are flushed by the next command. The field is therefore switched once, to the last value
+ * of the list: use separate calls to cycle it.
+ */
+int
+pn53x_set_properties(struct nfc_device *pnd, const nfc_property_setting *pSettings, const size_t szSettings)
+{
+  int res = 0;
+  int iField = -1;
+  int iInfiniteSelect = -1;
+  int timeout_atr = CHIP_DATA(pnd)->timeout_atr;
+  int timeout_communication = CHIP_DATA(pnd)->timeout_communication;
+  uint8_t ui8Parameters = CHIP_DATA(pnd)->ui8Parameters;
+  size_t i;
+
+  for (i = 0; i < szSettings; i++) {
+    const bool bEnable = (pSettings[i].value != 0);
+    switch (pSettings[i].property) {
+      case NP_TIMEOUT_COMMAND:
+        CHIP_DATA(pnd)->timeout_command = pSettings[i].value;
+        break;
+      case NP_TIMEOUT_ATR:
+        timeout_atr = pSettings[i].value;
+        break;
+      case NP_TIMEOUT_COM:
+        timeout_communication = pSettings[i].value;
+        break;
+      case NP_ACTIVATE_FIELD:
+        iField = bEnable;
+        break;
+      case NP_INFINITE_SELECT:
+        iInfiniteSelect = bEnable;
+        break;
+      case NP_AUTO_ISO14443_4:
+        pnd->bAutoIso14443_4 = bEnable;
+        ui8Parameters = (bEnable) ? (ui8Parameters | PARAM_AUTO_RATS) : (ui8Parameters & ~PARAM_AUTO_RATS);
+        break;
+      default:
+        if ((res = pn53x_set_property_bool(pnd, pSettings[i].property, bEnable)) < 0)
+          return res;
+        break;
+    }
+  }
+
+  if (ui8Parameters != CHIP_DATA(pnd)->ui8Parameters) {
+    if ((res = pn53x_SetParameters(pnd, ui8Parameters)) < 0)
+      return res;
+  }
+  if ((timeout_atr != CHIP_DATA(pnd)->timeout_atr) || (timeout_communication != CHIP_DATA(pnd)->timeout_communication)) {
+    CHIP_DATA(pnd)->timeout_atr = timeout_atr;
+    CHIP_DATA(pnd)->timeout_communication = timeout_communication;
+    if ((res = pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(timeout_atr), pn53x_int_to_timeout(timeout_communication))) < 0)
+      return res;
+  }
+  if (iInfiniteSelect >= 0) {
+    if ((res = pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, iInfiniteSelect)) < 0)
+      return res;
+  }
+  if (iField >= 0) {
+    if ((res = pn53x_RFConfiguration__RF_field(pnd, iField)) < 0)
+      return res;
+  }
+  return NFC_SUCCESS;
+}
+
+/*
+ * PN532 power policy
+ *
+ * Waking a PN532 up costs a long preamble, and a SAMConfiguration command
+ * after LowVBat: while commands come in quick succession, nfc_idle() leaves
+ * the chip awake (and the RF field on) and a timer powers it down once it
+ * kept idle. The policy tunes itself from what it measures:
+ * - the chip is powered down at once when the usual delay between nfc_idle()
+ *   and the next command exceeds power_idle_timeout (traffic is sparse), or
+ *   when wakeups are cheap on this link;
+ * - otherwise it stays warm PN53X_POWER_HOLD_GAPS usual delays, at most
+ *   power_idle_timeout, so that it sleeps soon after a busy period ends.
+ */
+#define PN53X_POWER_HOLD_GAPS 4
+#define PN53X_POWER_CHEAP_WAKEUP_US 2000
+
+static void *
+pn53x_power_run(void *arg)
+{
+  struct nfc_device *pnd = arg;
+  struct pn53x_power_policy *pp = &CHIP_DATA(pnd)->power;
+
+  nfc_thread_set_priority_class(NFC_PRIORITY_BACKGROUND);
+  pthread_mutex_lock(&pp->lock);
+  while (!pp->bStop) {
+    if (!pp->bArmed) {
+      pthread_cond_wait(&pp->cond, &pp->lock);
+      continue;
+    }
+    // Woken up early when re-armed or stopped
+    if (pthread_cond_timedwait(&pp->cond, &pp->lock, &pp->tsDeadline) != ETIMEDOUT)
+      continue;
+    pp->bArmed = false;
+    const unsigned long ulArmedCommands = pp->ulArmedCommands;
+    const bool bFieldOn = pp->bFieldOn;
+    pthread_mutex_unlock(&pp->lock);
+
+    // The device lock first, as pn53x_power_keep_warm() runs with it held
+    nfc_device_lock(pnd);
+    pthread_mutex_lock(&pp->lock);
+    const bool bPowerDown = !pp->bStop && !pp->bArmed && (pp->ulCommands == ulArmedCommands);
+    pthread_mutex_unlock(&pp->lock);
+    if (bPowerDown) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Idle for long enough, powering down");
+      if (bFieldOn)
+        nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false);
+      NFC_DRIVER(pnd)->powerdown(pnd);
+    }
+    nfc_device_unlock(pnd);
+    pthread_mutex_lock(&pp->lock);
+  }
+  pthread_mutex_unlock(&pp->lock);
+  return NULL;
+}
+
+/*
+ * Called by pn53x_idle() instead of powering the chip down: returns true
+ * when the chip stays warm, the timer powering it down later.
+ */
+static bool
+pn53x_power_keep_warm(struct nfc_device *pnd, const bool bFieldOn)
+{
+  struct pn53x_power_policy *pp = &CHIP_DATA(pnd)->power;
+  const uint32_t uiTimeoutUs = (uint32_t) pp->iIdleTimeout * 1000;
+
+  if ((pp->iIdleTimeout <= 0) || pp->bStop)
+    return false;
+  if ((pp->uiWakeUs && (pp->uiWakeUs < PN53X_POWER_CHEAP_WAKEUP_US)) || (pp->uiGapUs > uiTimeoutUs))
+    return false;
+  const uint32_t uiHoldUs = pp->uiGapUs ? MIN(uiTimeoutUs, PN53X_POWER_HOLD_GAPS * pp->uiGapUs) : uiTimeoutUs;
+
+  pthread_mutex_lock(&pp->lock);
+  if (!pp->bThread) {
+    if (pthread_create(&pp->thread, NULL, pn53x_power_run, pnd) != 0) {
+      pthread_mutex_unlock(&pp->lock);
+      return false;
+    }
+    pp->bThread = true;
+  }
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  const uint64_t ui64DeadlineUs = (uint64_t) tv.tv_usec + uiHoldUs;
+  pp->tsDeadline.tv_sec = tv.tv_sec + (time_t)(ui64DeadlineUs / 1000000);
+  pp->tsDeadline.tv_nsec = (long)(ui64DeadlineUs % 1000000) * 1000;
+  pp->bArmed = true;
+  pp->bFieldOn = bFieldOn;
+  pp->ulArmedCommands = pp->ulCommands;
+  pthread_cond_signal(&pp->cond);
+  pthread_mutex_unlock(&pp->lock);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Staying warm for %" PRIu32 " ms (wakeup: %" PRIu32 " us, idle: %" PRIu32 " us)",
+          uiHoldUs / 1000, pp->uiWakeUs, pp->uiGapUs);
+  return true;
+}
+
+/*
+ * Stops the power policy timer, drivers call it on close before
+ * pn53x_idle(), which then powers the chip down at once.
+ */
+void
+pn53x_power_stop(struct nfc_device *pnd)
+{
+  struct pn53x_power_policy *pp = &CHIP_DATA(pnd)->power;
+
+  pthread_mutex_lock(&pp->lock);
+  pp->bStop = true;
+  pthread_cond_signal(&pp->cond);
+  pthread_mutex_unlock(&pp->lock);
+  if (pp->bThread) {
+    pthread_join(pp->thread, NULL);
+    pp->bThread = false;
+  }
+}
+
 int
 pn53x_idle(struct nfc_device *pnd)
 {
@@ -979,9 +1949,9 @@ pn53x_idle(struct nfc_device *pnd)
       if ((res = pn53x_InRelease(pnd, 0)) < 0) {
         return res;
       }
-      if ((CHIP_DATA(pnd)->type == PN532) && (pnd->driver->powerdown)) {
+      if ((CHIP_DATA(pnd)->type == PN532) && (NFC_DRIVER(pnd)->powerdown) && !pn53x_power_keep_warm(pnd, false)) {
         // Use PowerDown to go in "Low VBat" power mode
-        if ((res = pnd->driver->powerdown(pnd)) < 0) {
+        if ((res = NFC_DRIVER(pnd)->powerdown(pnd)) < 0) {
           return res;
         }
       }
@@ -991,13 +1961,17 @@ pn53x_idle(struct nfc_device *pnd)
       if ((res = pn53x_InRelease(pnd, 0)) < 0) {
         return res;
       }
+      // Field and chip stay up for the next command, the timer powers them down
+      if ((CHIP_DATA(pnd)->type == PN532) && (NFC_DRIVER(pnd)->powerdown) && pn53x_power_keep_warm(pnd, true)) {
+        break;
+      }
       // Disable RF field to avoid heating
       if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0) {
         return res;
       }
-      if ((CHIP_DATA(pnd)->type == PN532) && (pnd->driver->powerdown)) {
+      if ((CHIP_DATA(pnd)->type == PN532) && (NFC_DRIVER(pnd)->powerdown)) {
         // Use PowerDown to go in "Low VBat" power mode
-        if ((res = pnd->driver->powerdown(pnd)) < 0) {
+        if ((res = NFC_DRIVER(pnd)->powerdown(pnd)) < 0) {
           return res;
         }
       }
@@ -1008,6 +1982,8 @@ pn53x_idle(struct nfc_device *pnd)
   // Clear the current nfc_target
   pn53x_current_target_free(pnd);
   CHIP_DATA(pnd)->operating_mode = IDLE;
+  CHIP_DATA(pnd)->power.bIdle = true;
+  gettimeofday(&CHIP_DATA(pnd)->power.tvIdle, NULL);
   return NFC_SUCCESS;
 }
 
@@ -1054,15 +2030,72 @@ pn532_initiator_init_secure_element(struct nfc_device *pnd)
   return pn532_SAMConfiguration(pnd, PSM_WIRED_CARD, -1);
 }
 
+/*
+ * Sends PPS (through InPSL) to a ISO14443-4 target just selected at 106 kbps,
+ * or PSL_REQ to a D.E.P. target, trying the highest bit rates first. TA(1) of
+ * ATS and the bit rate byte of ATQB share the same layout: bits 7-5 for target
+ * to initiator and bits 3-1 for initiator to target, at 847, 424 and 212 kbps.
+ * Only rates available in both directions are used. A failed attempt leaves
+ * the target at its current rate, so the next lower one is tried.
+ */
 static int
-pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
-                                          const nfc_modulation nm,
-                                          const uint8_t *pbtInitData, const size_t szInitData,
-                                          nfc_target *pnt,
-                                          int timeout)
+pn53x_initiator_raise_bit_rate(struct nfc_device *pnd, nfc_target *pnt)
 {
-  uint8_t  abtTargetsData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szTargetsData = sizeof(abtTargetsData);
+  const nfc_baud_rate *supported_br;
+  uint8_t btBitRates = 0;
+  int res = 0;
+
+  if ((CHIP_DATA(pnd)->type != PN532) && (CHIP_DATA(pnd)->type != PN533))
+    return NFC_SUCCESS;
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      // TA(1) comes first after T0, when present
+      if ((pnt->nti.nai.szAtsLen >= 2) && (pnt->nti.nai.abtAts[0] & 0x10))
+        btBitRates = pnt->nti.nai.abtAts[1];
+      break;
+    case NMT_ISO14443B:
+      btBitRates = pnt->nti.nbi.abtProtocolInfo[0];
+      break;
+    case NMT_DEP:
+      // BSt and BRt of ATR_RES, from bit 0 at 212 kbps
+      btBitRates = pnt->nti.ndi.btBS & pnt->nti.ndi.btBR & 0x07;
+      btBitRates |= btBitRates << 4;
+      break;
+    default:
+      break;
+  }
+  btBitRates = (btBitRates >> 4) & btBitRates & 0x07;
+  if ((btBitRates == 0) || (pn53x_get_supported_baud_rate(pnd, N_INITIATOR, pnt->nm.nmt, &supported_br) < 0))
+    return NFC_SUCCESS;
+
+  // Supported bit rates are listed from the highest
+  for (size_t i = 0; supported_br[i] > NBR_106; i++) {
+    const nfc_baud_rate nbr = supported_br[i];
+    if (!(btBitRates & (1 << (nbr - NBR_212))))
+      continue;
+    const uint8_t abtCmd[] = { InPSL, 0x01, nbr - 1, nbr - 1 };
+    if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, 0)) >= 0) {
+      pnt->nm.nbr = nbr;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Bit rate raised to %s", str_nfc_baud_rate(nbr));
+      return NFC_SUCCESS;
+    }
+    if (res == NFC_EOPABORTED)
+      return res;
+  }
+  // Keep on at 106 kbps
+  pnd->last_error = 0;
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_initiator_select_passive_target_scratch(struct nfc_device *pnd,
+                                              const nfc_modulation nm,
+                                              const uint8_t *pbtInitData, const size_t szInitData,
+                                              nfc_target *pnt,
+                                              int timeout,
+                                              uint8_t *abtTargetsData, uint8_t *abtRx, uint8_t *abtRxPar)
+{
+  size_t  szTargetsData = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
   int res = 0;
   nfc_target nttmp;
   memset(&nttmp, 0x00, sizeof(nfc_target));
@@ -1074,10 +2107,7 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
       return pnd->last_error;
     }
     // No native support in InListPassiveTarget so we do discovery by hand
-    if ((res = nfc_device_set_property_bool(pnd, NP_FORCE_ISO14443_B, true)) < 0) {
-      return res;
-    }
-    if ((res = nfc_device_set_property_bool(pnd, NP_FORCE_SPEED_106, true)) < 0) {
+    if ((res = pn53x_set_register_profile(pnd, nm)) < 0) {
       return res;
     }
     if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0) {
@@ -1110,7 +2140,7 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
         // Some work to do before getting the UID...
         const uint8_t abtReqt[] = { 0x10 };
         // Getting product code / fab code & store it in output buffer after the serial nr we'll obtain later
-        if ((res = pn53x_initiator_transceive_bytes(pnd, abtReqt, sizeof(abtReqt), abtTargetsData + 2, sizeof(abtTargetsData) - 2, timeout)) < 0) {
+        if ((res = pn53x_initiator_transceive_bytes(pnd, abtReqt, sizeof(abtReqt), abtTargetsData + 2, PN53x_EXTENDED_FRAME__DATA_MAX_LEN - 2, timeout)) < 0) {
           if ((res == NFC_ERFTRANS) && (CHIP_DATA(pnd)->last_status_byte == 0x01)) { // Chip timeout
             continue;
           } else
@@ -1119,7 +2149,7 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
         szTargetsData = (size_t)res;
       }
 
-      if ((res = pn53x_initiator_transceive_bytes(pnd, pbtInitData, szInitData, abtTargetsData, sizeof(abtTargetsData), timeout)) < 0) {
+      if ((res = pn53x_initiator_transceive_bytes(pnd, pbtInitData, szInitData, abtTargetsData, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, timeout)) < 0) {
         if ((res == NFC_ERFTRANS) && (CHIP_DATA(pnd)->last_status_byte == 0x01)) { // Chip timeout
           continue;
         } else
@@ -1130,7 +2160,7 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
         if (szTargetsData != 2)
           return 0; // Target is not ISO14443B2CT
         uint8_t abtRead[] = { 0xC4 }; // Reading UID_MSB (Read address 4)
-        if ((res = pn53x_initiator_transceive_bytes(pnd, abtRead, sizeof(abtRead), abtTargetsData + 4, sizeof(abtTargetsData) - 4, timeout)) < 0) {
+        if ((res = pn53x_initiator_transceive_bytes(pnd, abtRead, sizeof(abtRead), abtTargetsData + 4, PN53x_EXTENDED_FRAME__DATA_MAX_LEN - 4, timeout)) < 0) {
           return res;
         }
         szTargetsData = 6; // u16 UID_LSB, u8 prod code, u8 fab code, u16 UID_MSB
@@ -1175,9 +2205,7 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
 
     bool found = false;
     do {
-      uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-      uint8_t abtRxPar[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-      if ((res = nfc_initiator_transceive_bits(pnd, NULL, 0, NULL, abtRx, sizeof(abtRx), abtRxPar)) < 0) {
+      if ((res = nfc_initiator_transceive_bits(pnd, NULL, 0, NULL, abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, abtRxPar)) < 0) {
         if ((res == NFC_ERFTRANS) || (res == NFC_ECHIP)) { // Broken reception
           continue;
         } else {
@@ -1193,7 +2221,7 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
       size_t  szBytes = res / 8;
       size_t  off = 0;
       uint8_t i;
-      memset(abtTargetsData, 0x00, sizeof(abtTargetsData));
+      memset(abtTargetsData, 0x00, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
       // Reinject S bit
       abtTargetsData[off / 8] |= 1 << (7 - (off % 8));
       off++;
@@ -1259,6 +2287,9 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
       if ((res = pn53x_transceive(pnd, pncmd_inpsl, sizeof(pncmd_inpsl), NULL, 0, 0)) < 0) {
         return res;
       }
+    } else if (pnd->bAutoBitrate && (nm.nbr == NBR_106)) {
+      if ((res = pn53x_initiator_raise_bit_rate(pnd, &nttmp)) < 0)
+        return res;
     }
   }
   if (pn53x_current_target_new(pnd, &nttmp) == NULL) {
@@ -1272,6 +2303,26 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
   return abtTargetsData[0];
 }
 
+static int
+pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
+                                          const nfc_modulation nm,
+                                          const uint8_t *pbtInitData, const size_t szInitData,
+                                          nfc_target *pnt,
+                                          int timeout)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtTargetsData = pn53x_scratch_get(pnd);
+  // Only used to discover NFC Barcodes
+  uint8_t *abtRx = pn53x_scratch_get(pnd);
+  uint8_t *abtRxPar = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtTargetsData && abtRx && abtRxPar)
+    res = pn53x_initiator_select_passive_target_scratch(pnd, nm, pbtInitData, szInitData, pnt, timeout, abtTargetsData, abtRx, abtRxPar);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
 int
 pn53x_initiator_select_passive_target(struct nfc_device *pnd,
                                       const nfc_modulation nm,
@@ -1281,91 +2332,913 @@ pn53x_initiator_select_passive_target(struct nfc_device *pnd,
   return pn53x_initiator_select_passive_target_ext(pnd, nm, pbtInitData, szInitData, pnt, 300);
 }
 
+/*
+ * Length of one target of an InListPassiveTarget answer (Tg included), 0 when
+ * it does not fit. The last target takes what is left, which covers optional
+ * fields; others have to be followed by the next target number.
+ */
+static size_t
+pn53x_target_data_len(struct nfc_device *pnd, const nfc_modulation_type nmt, const uint8_t *pbtData, const size_t szData, const bool bLast)
+{
+  const struct pn53x_target_layout *pl = &pn53x_target_layouts[nmt];
+  size_t szLen = pl->szBase;
+
+  if (szLen == 0) {
+    szLen = szData;
+  } else if (pl->iLenByte >= 0) {
+    if (szData <= (size_t) pl->iLenByte)
+      return 0;
+    szLen += pbtData[pl->iLenByte];
+  }
+  if ((nmt == NMT_ISO14443A) && (szLen < szData) && ((pbtData[3] & 0x20) && (CHIP_DATA(pnd)->ui8Parameters & PARAM_AUTO_RATS))) {
+    // ATS is there if the chip sent RATS itself
+    const size_t szAts = pbtData[szLen];
+    if (bLast || ((szLen + szAts < szData) && (pbtData[szLen + szAts] == pbtData[0] + 1)))
+      szLen += szAts;
+  }
+  if (szLen > szData)
+    return 0;
+  if (bLast)
+    return szData;
+  if ((szLen == szData) || (pbtData[szLen] != pbtData[0] + 1))
+    return 0;
+  return szLen;
+}
+
+/*
+ * Decodes every target of an InListPassiveTarget answer (NbTg first) straight
+ * into ant[], returns how many were decoded or libnfc's error code. As with
+ * InAutoPoll, slots are not cleared first: array bytes past the decoded
+ * lengths keep their former content.
+ */
 int
-pn53x_initiator_poll_target(struct nfc_device *pnd,
-                            const nfc_modulation *pnmModulations, const size_t szModulations,
-                            const uint8_t uiPollNr, const uint8_t uiPeriod,
-                            nfc_target *pnt)
+pn53x_decode_targets(struct nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtRawData, const size_t szRawData,
+                     nfc_target ant[], const size_t szTargets)
+{
+  size_t szOffset = 1;
+  int res;
+
+  if (szRawData < 1)
+    return NFC_ECHIP;
+  const size_t szDecoded = MIN(pbtRawData[0], szTargets);
+  for (size_t t = 0; t < szDecoded; t++) {
+    const size_t szLen = pn53x_target_data_len(pnd, nm.nmt, pbtRawData + szOffset, szRawData - szOffset, t == (size_t) pbtRawData[0] - 1);
+    if (szLen == 0)
+      return NFC_ECHIP;
+    ant[t].nm = nm;
+    if ((res = pn53x_decode_target_data(pbtRawData + szOffset, szLen, CHIP_DATA(pnd)->type, nm.nmt, &(ant[t].nti))) < 0)
+      return res;
+    szOffset += szLen;
+  }
+  return (int) szDecoded;
+}
+
+/*
+ * Inventories end after this many rounds even if cards keep colliding, or
+ * keep answering with new identifiers.
+ */
+#ifndef PN53X_INVENTORY_MAX_ROUNDS
+#  define PN53X_INVENTORY_MAX_ROUNDS 8
+#endif
+
+// FeliCa POLLING timeslots minus one, ISO14443B REQB slots as N code (4 slots)
+#define PN53X_INVENTORY_FELICA_TSN 0x07
+#define PN53X_INVENTORY_REQB_N     0x02
+
+struct pn53x_inventory {
+  const nfc_modulation nm;
+  nfc_target *ant;
+  const size_t szTargets;
+  size_t szFound;
+  struct nfc_target_set ts;
+};
+
+// Keeps pnt if it is new, tells whether the inventory can go on
+static bool
+pn53x_inventory_add(struct pn53x_inventory *pinv, const nfc_target *pnt, bool *pbNew)
 {
+  if (!nfc_target_set_contains(&pinv->ts, pnt)) {
+    memcpy(&(pinv->ant[pinv->szFound]), pnt, sizeof(nfc_target));
+    nfc_target_set_add(&pinv->ts);
+    pinv->szFound++;
+    *pbNew = true;
+  }
+  return pinv->szFound < pinv->szTargets;
+}
+
+/*
+ * One InListPassiveTarget for up to two targets, the new ones are kept and
+ * stay selected. Returns the number of targets the chip answered with.
+ */
+static int
+pn53x_inventory_list_round(struct nfc_device *pnd, struct pn53x_inventory *pinv,
+                           const uint8_t *pbtInitData, const size_t szInitData,
+                           uint8_t *abtTargetsData, bool *pbNew)
+{
+  const uint8_t szRequested = (uint8_t) MIN(2, pinv->szTargets - pinv->szFound);
+  size_t szTargetsData = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
+  nfc_target *pntDecoded = pinv->ant + pinv->szFound;
+  int iTargets;
   int res = 0;
 
-  if (CHIP_DATA(pnd)->type == PN532) {
-    size_t szTargetTypes = 0;
-    pn53x_target_type apttTargetTypes[32];
-    memset(apttTargetTypes, PTT_UNDEFINED, 32 * sizeof(pn53x_target_type));
-    for (size_t n = 0; n < szModulations; n++) {
-      const pn53x_target_type ptt = pn53x_nm_to_ptt(pnmModulations[n]);
-      if (PTT_UNDEFINED == ptt) {
-        pnd->last_error = NFC_EINVARG;
-        return pnd->last_error;
+  *pbNew = false;
+  if ((iTargets = pn53x_InListPassiveTarget(pnd, pn53x_nm_to_pm(pinv->nm), szRequested, pbtInitData, szInitData, abtTargetsData, &szTargetsData, 300)) <= 0)
+    return iTargets;
+  // Decoded in the free slots of the caller's array, already seen ones are then dropped
+  if ((res = pn53x_decode_targets(pnd, pinv->nm, abtTargetsData, szTargetsData, pntDecoded, szRequested)) < 0)
+    return pnd->last_error = res;
+  for (int t = 0; t < res; t++) {
+    if (nfc_target_set_contains(&pinv->ts, &pntDecoded[t]))
+      continue;
+    nfc_target *pnt = pinv->ant + pinv->szFound;
+    if (pnt != &pntDecoded[t])
+      memcpy(pnt, &pntDecoded[t], sizeof(nfc_target));
+    nfc_target_set_add(&pinv->ts);
+    pinv->szFound++;
+    *pbNew = true;
+    if (pn53x_current_target_new(pnd, pnt) == NULL)
+      return pnd->last_error = NFC_ESOFT;
+  }
+  return (iTargets < szRequested) ? 0 : iTargets;
+}
+
+// Raw ISO14443B frames, CRC by the chip
+static int
+pn53x_inventory_raw_begin(struct nfc_device *pnd, const nfc_modulation nm)
+{
+  int res = 0;
+  if (CHIP_DATA(pnd)->type == RCS360) {
+    // It refuses to send raw frames without a first select
+    return NFC_ENOTIMPL;
+  }
+  if ((res = pn53x_set_register_profile(pnd, nm)) < 0)
+    return res;
+  if ((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0)
+    return res;
+  return pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false);
+}
+
+/*
+ * Sends a raw frame that any number of cards may answer: returns the answer
+ * length, 0 if nobody answered and NFC_ERFTRANS if answers collided.
+ */
+static int
+pn53x_inventory_raw_exchange(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  int res = pn53x_initiator_transceive_bytes(pnd, pbtTx, szTx, pbtRx, szRx, 300);
+  if ((res == NFC_ERFTRANS) && (CHIP_DATA(pnd)->last_status_byte == 0x01)) // Chip timeout
+    return 0;
+  return res;
+}
+
+/*
+ * REQB then Slot-MARKERs: every card answers in one of the slots, we halt
+ * (HLTB) each one identified. Another round is only needed after a collision.
+ */
+static int
+pn53x_inventory_iso14443b(struct nfc_device *pnd, struct pn53x_inventory *pinv, uint8_t *abtRx)
+{
+  const uint8_t abtReqb[] = { 0x05, 0x00, PN53X_INVENTORY_REQB_N }; // AFI 0x00: all PICCs
+  const size_t szSlots = 1 << PN53X_INVENTORY_REQB_N;
+  uint8_t abtTargetData[14];
+  nfc_target nt;
+  int res = 0;
+
+  if ((res = pn53x_inventory_raw_begin(pnd, pinv->nm)) < 0)
+    return res;
+  for (size_t szRound = 0; szRound < PN53X_INVENTORY_MAX_ROUNDS; szRound++) {
+    bool bCollision = false;
+    for (size_t szSlot = 0; szSlot < szSlots; szSlot++) {
+      const uint8_t abtSlotMarker[] = { (uint8_t)((szSlot << 4) | 0x05) };
+      if (szSlot == 0)
+        res = pn53x_inventory_raw_exchange(pnd, abtReqb, sizeof(abtReqb), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+      else
+        res = pn53x_inventory_raw_exchange(pnd, abtSlotMarker, sizeof(abtSlotMarker), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+      if (res == NFC_ERFTRANS) {
+        bCollision = true;
+        continue;
       }
-      apttTargetTypes[szTargetTypes] = ptt;
-      if ((pnd->bAutoIso14443_4) && (ptt == PTT_MIFARE)) { // Hack to have ATS
-        apttTargetTypes[szTargetTypes] = PTT_ISO14443_4A_106;
-        szTargetTypes++;
-        apttTargetTypes[szTargetTypes] = PTT_MIFARE;
+      if (res < 0)
+        return res;
+      if ((res < 12) || (abtRx[0] != 0x50)) {
+        bCollision = bCollision || (res > 0);
+        continue;
       }
-      szTargetTypes++;
+      // Decode it as an InListPassiveTarget answer without ATTRIB_RES
+      abtTargetData[0] = 1;
+      memcpy(abtTargetData + 1, abtRx, 12);
+      abtTargetData[13] = 0;
+      memset(&nt, 0x00, sizeof(nfc_target));
+      nt.nm = pinv->nm;
+      if ((res = pn53x_decode_target_data(abtTargetData, sizeof(abtTargetData), CHIP_DATA(pnd)->type, NMT_ISO14443B, &(nt.nti))) < 0)
+        return res;
+      // HLTB, so that it keeps quiet until the next WUPB
+      uint8_t abtHltb[5] = { 0x50 };
+      memcpy(abtHltb + 1, nt.nti.nbi.abtPupi, 4);
+      if ((res = pn53x_inventory_raw_exchange(pnd, abtHltb, sizeof(abtHltb), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN)) < 0)
+        return res;
+      bool bNew = false;
+      if (!pn53x_inventory_add(pinv, &nt, &bNew))
+        return NFC_SUCCESS;
     }
-    nfc_target ntTargets[2];
-    memset(ntTargets, 0x00, sizeof(nfc_target) * 2);
+    if (!bCollision)
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+/*
+ * ST SRx anticollision: INITIATE, PCALL16 and Slot-MARKERs collect Chip_IDs,
+ * each one is then selected, read and deactivated (COMPLETION) so that next
+ * rounds only see the chips whose Chip_ID collided.
+ */
+static int
+pn53x_inventory_iso14443b2sr(struct nfc_device *pnd, struct pn53x_inventory *pinv, uint8_t *abtRx)
+{
+  const uint8_t abtInitiate[] = { 0x06, 0x00 };
+  const uint8_t abtPcall16[] = { 0x06, 0x04 };
+  const uint8_t abtGetUid[] = { 0x0b };
+  const uint8_t abtCompletion[] = { 0x0f };
+  uint8_t abtChipIds[16];
+  nfc_target nt;
+  int res = 0;
 
-    if ((res = pn53x_InAutoPoll(pnd, apttTargetTypes, szTargetTypes, uiPollNr, uiPeriod, ntTargets, 0)) < 0)
+  if ((res = pn53x_inventory_raw_begin(pnd, pinv->nm)) < 0)
+    return res;
+  for (size_t szRound = 0; szRound < PN53X_INVENTORY_MAX_ROUNDS; szRound++) {
+    size_t szChipIds = 0;
+    bool bCollision = false;
+
+    // Chips enter inventory state, a lone one answers right away
+    if ((res = pn53x_inventory_raw_exchange(pnd, abtInitiate, sizeof(abtInitiate), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN)) == 0)
+      break;
+    if ((res < 0) && (res != NFC_ERFTRANS))
       return res;
-    switch (res) {
-      case 0:
-        return pnd->last_error = NFC_SUCCESS;
-        break;
-      case 1:
-        *pnt = ntTargets[0];
-        if (pn53x_current_target_new(pnd, pnt) == NULL) {
-          return pnd->last_error = NFC_ESOFT;
-        }
+    for (uint8_t ui8Slot = 0; ui8Slot < 16; ui8Slot++) {
+      const uint8_t abtSlotMarker[] = { (uint8_t)((ui8Slot << 4) | 0x06) };
+      if (ui8Slot == 0)
+        res = pn53x_inventory_raw_exchange(pnd, abtPcall16, sizeof(abtPcall16), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+      else
+        res = pn53x_inventory_raw_exchange(pnd, abtSlotMarker, sizeof(abtSlotMarker), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+      if ((res == NFC_ERFTRANS) || (res > 1)) {
+        bCollision = true;
+        continue;
+      }
+      if (res < 0)
         return res;
-      case 2:
-        *pnt = ntTargets[1]; // We keep the selected one
-        if (pn53x_current_target_new(pnd, pnt) == NULL) {
-          return pnd->last_error = NFC_ESOFT;
-        }
+      if (res == 1)
+        abtChipIds[szChipIds++] = abtRx[0];
+    }
+    for (size_t i = 0; i < szChipIds; i++) {
+      const uint8_t abtSelect[] = { 0x0e, abtChipIds[i] };
+      if ((res = pn53x_inventory_raw_exchange(pnd, abtSelect, sizeof(abtSelect), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN)) < 0)
         return res;
-      default:
-        return NFC_ECHIP;
+      if ((res != 1) || (abtRx[0] != abtChipIds[i]))
+        continue;
+      if ((res = pn53x_inventory_raw_exchange(pnd, abtGetUid, sizeof(abtGetUid), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN)) < 0)
+        return res;
+      if (res != 8)
+        continue;
+      memset(&nt, 0x00, sizeof(nfc_target));
+      nt.nm = pinv->nm;
+      if ((res = pn53x_decode_target_data(abtRx, 8, CHIP_DATA(pnd)->type, NMT_ISO14443B2SR, &(nt.nti))) < 0)
+        return res;
+      // Deactivated until the field goes off, no answer expected
+      if ((res = pn53x_inventory_raw_exchange(pnd, abtCompletion, sizeof(abtCompletion), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN)) < 0)
+        return res;
+      bool bNew = false;
+      if (!pn53x_inventory_add(pinv, &nt, &bNew))
+        return NFC_SUCCESS;
     }
-  } else {
-    bool bInfiniteSelect = pnd->bInfiniteSelect;
-    int result = 0;
-    if ((res = pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, true)) < 0)
+    if (!bCollision)
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_initiator_list_passive_targets_scratch(struct nfc_device *pnd, const nfc_modulation nm,
+                                             nfc_target ant[], const size_t szTargets,
+                                             uint8_t *abtTargetsData)
+{
+  struct pn53x_inventory inv = { nm, ant, szTargets, 0, { NULL, 0, 0, { { 0 } } } };
+  const bool bEasyFraming = pnd->bEasyFraming;
+  uint8_t *pbtInitData = NULL;
+  size_t szInitData = 0;
+  bool bNew = false;
+  int res = 0;
+
+  if ((nm.nbr != NBR_106) && (nm.nmt != NMT_FELICA)) {
+    // ISO14443A needs a PSL once selected, the chip lists only one ISO14443B target at higher speeds
+    return NFC_ENOTIMPL;
+  }
+  nfc_target_set_init(&inv.ts, ant);
+  if (szTargets == 0)
+    return 0;
+
+  switch (nm.nmt) {
+    case NMT_ISO14443A:
+      prepare_initiator_data(nm, &pbtInitData, &szInitData);
+      while ((res = pn53x_inventory_list_round(pnd, &inv, pbtInitData, szInitData, abtTargetsData, &bNew)) > 0) {
+        if (!bNew || (inv.szFound == szTargets))
+          break;
+        // Halt them all so that next round only sees the other ones
+        pn53x_current_target_free(pnd);
+        if ((res = pn53x_InDeselect(pnd, 0)) < 0)
+          break;
+      }
+      break;
+
+    case NMT_FELICA: {
+      // Cards answer in a random timeslot of the POLLING and ignore deselection:
+      // poll again until rounds stop bringing new cards
+      uint8_t abtPolling[5];
+      size_t szIdleRounds = 0;
+      prepare_initiator_data(nm, &pbtInitData, &szInitData);
+      memcpy(abtPolling, pbtInitData, sizeof(abtPolling));
+      abtPolling[4] = PN53X_INVENTORY_FELICA_TSN;
+      for (size_t szRound = 0; (szRound < PN53X_INVENTORY_MAX_ROUNDS) && (inv.szFound < szTargets) && (szIdleRounds < 2); szRound++) {
+        res = pn53x_inventory_list_round(pnd, &inv, abtPolling, sizeof(abtPolling), abtTargetsData, &bNew);
+        if (res < 0)
+          break;
+        // Less answers than asked for and nothing new: no card is left over
+        if ((res == 0) && !bNew)
+          break;
+        szIdleRounds = bNew ? 0 : szIdleRounds + 1;
+      }
+    }
+    break;
+
+    case NMT_ISO14443B:
+      res = pn53x_inventory_iso14443b(pnd, &inv, abtTargetsData);
+      pn53x_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming);
+      break;
+
+    case NMT_ISO14443B2SR:
+      res = pn53x_inventory_iso14443b2sr(pnd, &inv, abtTargetsData);
+      pn53x_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming);
+      break;
+
+    case NMT_ISO14443BI:
+    case NMT_ISO14443B2CT:
+    case NMT_JEWEL:
+    case NMT_BARCODE:
+    case NMT_DEP:
+      // No anticollision, one card at a time
+      return NFC_ENOTIMPL;
+  }
+  // Like one by one selection, a failure only ends the inventory
+  if ((res == NFC_ENOTIMPL) && (inv.szFound == 0))
+    return res;
+  return (int) inv.szFound;
+}
+
+int
+pn53x_initiator_list_passive_targets(struct nfc_device *pnd, const nfc_modulation nm,
+                                     nfc_target ant[], const size_t szTargets)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtTargetsData = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtTargetsData)
+    res = pn53x_initiator_list_passive_targets_scratch(pnd, nm, ant, szTargets, abtTargetsData);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+/*
+ * Host side ISO14443A anticollision. The CIU keeps handling parity, which is
+ * what lets it send and receive frames split in the middle of a byte
+ * (TxLastBits and RxAlign); CRC is computed here.
+ */
+#ifndef PN53X_ANTICOL_MAX_EXCHANGES
+#  define PN53X_ANTICOL_MAX_EXCHANGES 1024
+#endif
+#define PN53X_ANTICOL_STACK 48
+#define SAK_ISO14443_4_COMPLIANT 0x20
+
+struct pn53x_anticol {
+  // Settings to restore
+  bool bCrc;
+  bool bPar;
+  bool bEasyFraming;
+  bool bStarted;
+  size_t szScratch;
+  uint8_t *abtCmd;
+  uint8_t *abtRx;
+  // Last BitFraming value written, 0xff when unknown
+  uint8_t ui8BitFraming;
+  size_t szExchanges;
+  // CL1 prefixes known to lead to cards, according to collisions
+  struct {
+    uint8_t abtUid[4];
+    uint8_t ui8Bits;
+  } aPending[PN53X_ANTICOL_STACK];
+  size_t szPending;
+};
+
+/*
+ * Sends szTxBits bits and stores the answer from bit ui8RxAlign of pbtRx[0]
+ * on. Returns the number of bytes touched in pbtRx, 0 if nobody answered.
+ */
+static int
+pn53x_anticol_exchange(struct nfc_device *pnd, struct pn53x_anticol *pac, const uint8_t *pbtTx, const size_t szTxBits,
+                       const uint8_t ui8RxAlign, uint8_t *pbtRx, const size_t szRx)
+{
+  const size_t szTx = (szTxBits + 7) / 8;
+  const uint8_t ui8BitFraming = (ui8RxAlign << 4) | (szTxBits % 8);
+  int res = 0;
+
+  if (pac->szExchanges++ >= PN53X_ANTICOL_MAX_EXCHANGES)
+    return NFC_ETIMEOUT;
+  if (ui8BitFraming != pac->ui8BitFraming) {
+    if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, 0xff, ui8BitFraming)) < 0)
       return res;
-    // FIXME It does not support DEP targets
-    do {
-      for (size_t p = 0; p < uiPollNr; p++) {
-        for (size_t n = 0; n < szModulations; n++) {
-          uint8_t *pbtInitiatorData;
-          size_t szInitiatorData;
-          prepare_initiator_data(pnmModulations[n], &pbtInitiatorData, &szInitiatorData);
-          const int timeout_ms = uiPeriod * 150;
-
-          if ((res = pn53x_initiator_select_passive_target_ext(pnd, pnmModulations[n], pbtInitiatorData, szInitiatorData, pnt, timeout_ms)) < 0) {
-            if (pnd->last_error != NFC_ETIMEOUT) {
-              result = pnd->last_error;
-              goto end;
-            }
-          } else {
-            result = res;
+    pac->ui8BitFraming = ui8BitFraming;
+    CHIP_DATA(pnd)->ui8TxBits = szTxBits % 8;
+  }
+  pac->abtCmd[0] = InCommunicateThru;
+  memcpy(pac->abtCmd + 1, pbtTx, szTx);
+  if ((res = pn53x_transceive(pnd, pac->abtCmd, szTx + 1, pac->abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, -1)) < 0) {
+    if ((res == NFC_ERFTRANS) && (CHIP_DATA(pnd)->last_status_byte == 0x01)) // Chip timeout
+      return 0;
+    return res;
+  }
+  // Skip the status byte
+  res = MIN((size_t) res - 1, szRx);
+  if (res > 0) {
+    const uint8_t ui8Kept = (1 << ui8RxAlign) - 1;
+    pbtRx[0] = (pbtRx[0] & ui8Kept) | (pac->abtRx[1] & ~ui8Kept);
+    memcpy(pbtRx + 1, pac->abtRx + 2, res - 1);
+  }
+  return res;
+}
+
+static void
+pn53x_anticol_push(struct pn53x_anticol *pac, const uint8_t *pbtUid, const uint8_t ui8Bits)
+{
+  if (pac->szPending == PN53X_ANTICOL_STACK) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Too many collisions, some cards may be missed");
+    return;
+  }
+  memcpy(pac->aPending[pac->szPending].abtUid, pbtUid, 4);
+  pac->aPending[pac->szPending].ui8Bits = ui8Bits;
+  pac->szPending++;
+}
+
+/*
+ * Walks down the tree from the ui8Bits known bits of abtUidCL (UID CLn and
+ * BCC) until a single card answers. On each collision, the next bit is taken
+ * as 0 and the branch where it is 1 is either pushed (CL1) or reported in
+ * *pbLeftover. Returns 1 with abtUidCL complete, 0 if the branch is empty.
+ */
+static int
+pn53x_anticol_walk(struct nfc_device *pnd, struct pn53x_anticol *pac, const uint8_t btSel,
+                   uint8_t abtUidCL[5], uint8_t ui8Bits, bool *pbLeftover)
+{
+  uint8_t abtTx[7];
+  int res = 0;
+
+  while (ui8Bits < 32) {
+    abtTx[0] = btSel;
+    abtTx[1] = (uint8_t)(((2 + ui8Bits / 8) << 4) | (ui8Bits % 8)); // NVB
+    memcpy(abtTx + 2, abtUidCL, (ui8Bits + 7) / 8);
+    res = pn53x_anticol_exchange(pnd, pac, abtTx, 16 + ui8Bits, ui8Bits % 8, abtUidCL + ui8Bits / 8, 5 - ui8Bits / 8);
+    if (res == 0)
+      return 0;
+    if ((res > 0) && ((size_t) res == (size_t)(5 - ui8Bits / 8)) &&
+        ((abtUidCL[0] ^ abtUidCL[1] ^ abtUidCL[2] ^ abtUidCL[3]) == abtUidCL[4]))
+      return 1;
+    if ((res < 0) && (res != NFC_ERFTRANS))
+      return res;
+    // Collision: follow 0, remember 1
+    const uint8_t ui8Mask = 1 << (ui8Bits % 8);
+    abtUidCL[ui8Bits / 8] |= ui8Mask;
+    if (btSel == 0x93)
+      pn53x_anticol_push(pac, abtUidCL, ui8Bits + 1);
+    else
+      *pbLeftover = true;
+    abtUidCL[ui8Bits / 8] &= ~ui8Mask;
+    ui8Bits++;
+  }
+  // All bits are known, only BCC is missing
+  abtUidCL[4] = abtUidCL[0] ^ abtUidCL[1] ^ abtUidCL[2] ^ abtUidCL[3];
+  return 1;
+}
+
+static int
+pn53x_initiator_inventory_iso14443a_scratch(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets,
+                                            struct pn53x_anticol *pac)
+{
+  const uint8_t abtReqa[] = { 0x26 };
+  uint8_t abtHlta[4] = { 0x50, 0x00 };
+  const nfc_modulation nm = { NMT_ISO14443A, NBR_106 };
+  struct nfc_target_set ts;
+  size_t szFound = 0;
+  bool bReady = false;
+  int res = 0;
+
+  iso14443a_crc_append(abtHlta, 2);
+  nfc_target_set_init(&ts, ant);
+  pn53x_anticol_push(pac, (const uint8_t *) "\x00\x00\x00\x00", 0);
+
+  while ((pac->szPending > 0) && (szFound < szTargets)) {
+    uint8_t abtAtqa[2] = { 0x00, 0x00 };
+    uint8_t abtUidCL[5];
+    uint8_t abtRawUid[12];
+    uint8_t abtSelect[9];
+    uint8_t btSak = 0;
+    size_t szRawUid = 0;
+    bool bLeftover = false;
+    bool bComplete = false;
+
+    pac->szPending--;
+    memcpy(abtUidCL, pac->aPending[pac->szPending].abtUid, 4);
+    const uint8_t ui8Bits = pac->aPending[pac->szPending].ui8Bits;
+
+    // Cards only stay READY while they get anticollision frames
+    if (!bReady) {
+      if ((res = pn53x_anticol_exchange(pnd, pac, abtReqa, 7, 0, abtAtqa, sizeof(abtAtqa))) == 0)
+        break; // Every card is halted
+      if ((res < 0) && (res != NFC_ERFTRANS))
+        goto error;
+      // ATQA of different cards do collide, we keep it only when it was clean
+      if (res != 2)
+        memset(abtAtqa, 0x00, sizeof(abtAtqa));
+      bReady = true;
+    }
+
+    for (uint8_t btSel = 0x93; btSel <= 0x97; btSel += 2) {
+      if ((res = pn53x_anticol_walk(pnd, pac, btSel, abtUidCL, (btSel == 0x93) ? ui8Bits : 0, &bLeftover)) <= 0)
+        break;
+      abtSelect[0] = btSel;
+      abtSelect[1] = 0x70;
+      memcpy(abtSelect + 2, abtUidCL, 5);
+      iso14443a_crc_append(abtSelect, 7);
+      bReady = false;
+      uint8_t abtSak[3];
+      res = pn53x_anticol_exchange(pnd, pac, abtSelect, 8 * sizeof(abtSelect), 0, abtSak, sizeof(abtSak));
+      if ((res == 0) || (res == NFC_ERFTRANS)) {
+        // Card went away, or several cards share this CL1 and disagree on SAK
+        szRawUid = 0;
+        res = 0;
+        break;
+      }
+      if (res < 0)
+        goto error;
+      btSak = abtSak[0];
+      memcpy(abtRawUid + szRawUid, abtUidCL, 4);
+      szRawUid += 4;
+      if (!(btSak & 0x04)) {
+        bComplete = true;
+        break;
+      }
+      memset(abtUidCL, 0x00, sizeof(abtUidCL));
+    }
+    if (res < 0)
+      goto error;
+    // Other cards sharing the CL1 of this one are found by selecting it again
+    if (bLeftover && (szRawUid > 0))
+      pn53x_anticol_push(pac, abtRawUid, 32);
+    if (!bComplete)
+      continue;
+
+    nfc_target nt;
+    memset(&nt, 0x00, sizeof(nfc_target));
+    nt.nm = nm;
+    nt.nti.nai.abtAtqa[0] = abtAtqa[1];
+    nt.nti.nai.abtAtqa[1] = abtAtqa[0];
+    nt.nti.nai.btSak = btSak;
+    // Strip the cascade tags
+    for (size_t i = 0; i < szRawUid; i += 4) {
+      const bool bCascaded = (i + 4 < szRawUid);
+      memcpy(nt.nti.nai.abtUid + nt.nti.nai.szUidLen, abtRawUid + i + (bCascaded ? 1 : 0), bCascaded ? 3 : 4);
+      nt.nti.nai.szUidLen += bCascaded ? 3 : 4;
+    }
+    // HLTA, the card does not answer
+    if ((res = pn53x_anticol_exchange(pnd, pac, abtHlta, 8 * sizeof(abtHlta), 0, pac->abtRx, 0)) < 0)
+      goto error;
+    if (!nfc_target_set_contains(&ts, &nt)) {
+      memcpy(&(ant[szFound]), &nt, sizeof(nfc_target));
+      nfc_target_set_add(&ts);
+      szFound++;
+    }
+  }
+  return (int) szFound;
+
+error:
+  // Out of exchanges: the targets found so far are still worth reporting
+  if ((res == NFC_ETIMEOUT) && (pac->szExchanges > PN53X_ANTICOL_MAX_EXCHANGES) && (szFound > 0))
+    return (int) szFound;
+  return res;
+}
+
+/*
+ * Switches to raw ISO14443A frames for pn53x_anticol_exchange(). Whatever
+ * it returns, pn53x_anticol_end() has to be called.
+ */
+static int
+pn53x_anticol_begin(struct nfc_device *pnd, struct pn53x_anticol *pac)
+{
+  int res = 0;
+
+  memset(pac, 0x00, sizeof(struct pn53x_anticol));
+  pac->bCrc = pnd->bCrc;
+  pac->bPar = pnd->bPar;
+  pac->bEasyFraming = pnd->bEasyFraming;
+  pac->szScratch = pn53x_scratch_mark(pnd);
+  pac->ui8BitFraming = 0xff;
+  if (CHIP_DATA(pnd)->type == RCS360) {
+    // It refuses to send raw frames without a first select
+    return NFC_ENOTIMPL;
+  }
+  pac->abtCmd = pn53x_scratch_get(pnd);
+  pac->abtRx = pn53x_scratch_get(pnd);
+  if (!pac->abtCmd || !pac->abtRx)
+    return NFC_ESOFT;
+  pac->bStarted = true;
+  if (((res = pn53x_set_register_profile(pnd, (nfc_modulation) { NMT_ISO14443A, NBR_106 })) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, false)) < 0))
+    return res;
+  return pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false);
+}
+
+static int
+pn53x_anticol_end(struct nfc_device *pnd, struct pn53x_anticol *pac, const int res)
+{
+  pn53x_scratch_release(pnd, pac->szScratch);
+  if (pac->bStarted) {
+    // Back to whole bytes frames and to the previous settings, even on error
+    if (pac->ui8BitFraming != 0xff) {
+      pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_RX_ALIGN | SYMBOL_TX_LAST_BITS, 0x00);
+      CHIP_DATA(pnd)->ui8TxBits = 0;
+    }
+    pn53x_set_property_bool(pnd, NP_HANDLE_CRC, pac->bCrc);
+    pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, pac->bPar);
+    pn53x_set_property_bool(pnd, NP_EASY_FRAMING, pac->bEasyFraming);
+  }
+  if (res < 0)
+    pnd->last_error = res;
+  return res;
+}
+
+int
+pn53x_initiator_inventory_iso14443a(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets)
+{
+  struct pn53x_anticol ac;
+  int res = 0;
+
+  if ((res = pn53x_anticol_begin(pnd, &ac)) >= 0)
+    res = pn53x_initiator_inventory_iso14443a_scratch(pnd, ant, szTargets, &ac);
+  return pn53x_anticol_end(pnd, &ac, res);
+}
+
+/*
+ * WUPA then SELECT of each cascade level of a known UID. ISO14443-4 targets
+ * would need RATS too, those are left to a full select.
+ */
+static int
+pn53x_initiator_reactivate_target_scratch(struct nfc_device *pnd, const nfc_target *pnt, struct pn53x_anticol *pac)
+{
+  const uint8_t abtWupa[] = { 0x52 };
+  uint8_t abtCascadedUid[12];
+  size_t szCascadedUid = 0;
+  uint8_t abtAtqa[2];
+  uint8_t abtSak[3];
+  int res = 0;
+
+  // The cipher, if any, belongs to the previous session
+  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_Status2, SYMBOL_MF_CRYPTO1_ON, 0x00)) < 0)
+    return res;
+  // Any answer, clean or not, means a card woke up
+  if ((res = pn53x_anticol_exchange(pnd, pac, abtWupa, 7, 0, abtAtqa, sizeof(abtAtqa))) == 0)
+    return 0;
+  if ((res < 0) && (res != NFC_ERFTRANS))
+    return res;
+
+  iso14443_cascade_uid(pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen, abtCascadedUid, &szCascadedUid);
+  for (size_t i = 0; i < szCascadedUid; i += 4) {
+    uint8_t abtSelect[9];
+    const bool bLast = (i + 4 >= szCascadedUid);
+
+    abtSelect[0] = (uint8_t)(0x93 + (i / 2));
+    abtSelect[1] = 0x70;
+    memcpy(abtSelect + 2, abtCascadedUid + i, 4);
+    abtSelect[6] = abtSelect[2] ^ abtSelect[3] ^ abtSelect[4] ^ abtSelect[5];
+    iso14443a_crc_append(abtSelect, 7);
+    res = pn53x_anticol_exchange(pnd, pac, abtSelect, 8 * sizeof(abtSelect), 0, abtSak, sizeof(abtSak));
+    if ((res == 0) || (res == NFC_ERFTRANS))
+      return 0;
+    if (res < 0)
+      return res;
+    // Another card with the same UID prefix would not give the expected SAK
+    if (bLast ? (abtSak[0] != pnt->nti.nai.btSak) : !(abtSak[0] & 0x04))
+      return 0;
+  }
+  return 1;
+}
+
+int
+pn53x_initiator_reactivate_target(struct nfc_device *pnd, const nfc_target *pnt)
+{
+  struct pn53x_anticol ac;
+  int res = 0;
+
+  if ((pnt->nm.nmt != NMT_ISO14443A) || (pnt->nti.nai.szUidLen == 0) ||
+      (pnd->bAutoIso14443_4 && (pnt->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT))) {
+    pnd->last_error = NFC_ENOTIMPL;
+    return pnd->last_error;
+  }
+  if ((res = pn53x_anticol_begin(pnd, &ac)) >= 0)
+    res = pn53x_initiator_reactivate_target_scratch(pnd, pnt, &ac);
+  return pn53x_anticol_end(pnd, &ac, res);
+}
+
+// InAutoPoll takes at most 15 target types
+#define PN53X_AUTOPOLL_MAX_TYPES 15
+
+// InAutoPoll (PN532 only) knows neither ISO14443B', SRx, CTx nor Barcode
+static bool
+pn53x_autopoll_handles(const struct nfc_device *pnd, const nfc_modulation nm)
+{
+  return (CHIP_DATA(pnd)->type == PN532) && (pn53x_nm_to_ptt(nm) != PTT_UNDEFINED);
+}
+
+static void
+pn53x_autopoll_add_type(pn53x_target_type *apttTargetTypes, size_t *pszTargetTypes, const pn53x_target_type ptt)
+{
+  for (size_t n = 0; n < *pszTargetTypes; n++) {
+    if (apttTargetTypes[n] == ptt)
+      return;
+  }
+  apttTargetTypes[(*pszTargetTypes)++] = ptt;
+}
+
+// Target types of a single InAutoPoll covering every modulation it handles
+static size_t
+pn53x_autopoll_types(const struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations,
+                     pn53x_target_type apttTargetTypes[PN53X_AUTOPOLL_MAX_TYPES])
+{
+  size_t szTargetTypes = 0;
+
+  for (size_t n = 0; n < szModulations; n++) {
+    if (!pn53x_autopoll_handles(pnd, pnmModulations[n]))
+      continue;
+    const pn53x_target_type ptt = pn53x_nm_to_ptt(pnmModulations[n]);
+    if ((pnd->bAutoIso14443_4) && (ptt == PTT_MIFARE)) // Hack to have ATS
+      pn53x_autopoll_add_type(apttTargetTypes, &szTargetTypes, PTT_ISO14443_4A_106);
+    pn53x_autopoll_add_type(apttTargetTypes, &szTargetTypes, ptt);
+  }
+  return szTargetTypes;
+}
+
+static int
+pn53x_autopoll_target(struct nfc_device *pnd, const pn53x_target_type *apttTargetTypes, const size_t szTargetTypes,
+                      const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt)
+{
+  nfc_target ntTargets[2];
+  int res;
+
+  memset(ntTargets, 0x00, sizeof(nfc_target) * 2);
+  if ((res = pn53x_InAutoPoll(pnd, apttTargetTypes, szTargetTypes, uiPollNr, uiPeriod, ntTargets, 0)) < 0)
+    return res;
+  switch (res) {
+    case 0:
+      return pnd->last_error = NFC_SUCCESS;
+    case 1:
+    case 2:
+      *pnt = ntTargets[res - 1]; // We keep the selected one
+      if (pn53x_current_target_new(pnd, pnt) == NULL) {
+        return pnd->last_error = NFC_ESOFT;
+      }
+      return res;
+    default:
+      return NFC_ECHIP;
+  }
+}
+
+/*
+ * On PN532 the modulations InAutoPoll handles are polled by a single command,
+ * the other ones and those of other chips by a select each, every round.
+ */
+int
+pn53x_initiator_poll_target(struct nfc_device *pnd,
+                            const nfc_modulation *pnmModulations, const size_t szModulations,
+                            const uint8_t uiPollNr, const uint8_t uiPeriod,
+                            nfc_target *pnt)
+{
+  pn53x_target_type apttTargetTypes[PN53X_AUTOPOLL_MAX_TYPES];
+  const size_t szTargetTypes = pn53x_autopoll_types(pnd, pnmModulations, szModulations, apttTargetTypes);
+  size_t szSelects = 0;
+  int res = 0;
+
+  for (size_t n = 0; n < szModulations; n++) {
+    if (!pn53x_autopoll_handles(pnd, pnmModulations[n]))
+      szSelects++;
+  }
+  if (szSelects == 0)
+    return pn53x_autopoll_target(pnd, apttTargetTypes, szTargetTypes, uiPollNr, uiPeriod, pnt);
+  // Nothing for InAutoPoll (e.g. not a PN532): nfc_initiator_poll_target() polls in software
+  if (szTargetTypes == 0)
+    return NFC_ENOTIMPL;
+
+  bool bInfiniteSelect = pnd->bInfiniteSelect;
+  int result = 0;
+  if ((res = pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, true)) < 0)
+    return res;
+  // FIXME It does not support DEP targets
+  do {
+    for (size_t p = 0; p < uiPollNr; p++) {
+      if (szTargetTypes > 0) {
+        if ((res = pn53x_autopoll_target(pnd, apttTargetTypes, szTargetTypes, 1, uiPeriod, pnt)) != 0) {
+          result = res;
+          goto end;
+        }
+      }
+      for (size_t n = 0; n < szModulations; n++) {
+        uint8_t *pbtInitiatorData;
+        size_t szInitiatorData;
+        if (pn53x_autopoll_handles(pnd, pnmModulations[n]))
+          continue;
+        prepare_initiator_data(pnmModulations[n], &pbtInitiatorData, &szInitiatorData);
+        const int timeout_ms = uiPeriod * 150;
+
+        if ((res = pn53x_initiator_select_passive_target_ext(pnd, pnmModulations[n], pbtInitiatorData, szInitiatorData, pnt, timeout_ms)) < 0) {
+          if (pnd->last_error != NFC_ETIMEOUT) {
+            result = pnd->last_error;
             goto end;
           }
+        } else {
+          result = res;
+          goto end;
         }
       }
-    } while (uiPollNr == 0xff); // uiPollNr==0xff means infinite polling
-    // We reach this point when each listing give no result, we simply have to return 0
+    }
+  } while (uiPollNr == 0xff); // uiPollNr==0xff means infinite polling
+  // We reach this point when each listing give no result, we simply have to return 0
 end:
-    if (! bInfiniteSelect) {
-      if ((res = pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, false)) < 0)
-        return res;
+  if (! bInfiniteSelect) {
+    if ((res = pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, false)) < 0)
+      return res;
+  }
+  return result;
+}
+
+/*
+ * InAutoPoll stops at the first target type which answers, so it is sent again
+ * for the types after that one: an empty field costs a single command. The
+ * modulations it does not handle are listed one by one.
+ */
+int
+pn53x_initiator_discover_targets(struct nfc_device *pnd,
+                                 const nfc_modulation *pnmModulations, const size_t szModulations,
+                                 nfc_target ant[], const size_t szTargets)
+{
+  pn53x_target_type apttTargetTypes[PN53X_AUTOPOLL_MAX_TYPES];
+  size_t szTargetTypes = pn53x_autopoll_types(pnd, pnmModulations, szModulations, apttTargetTypes);
+  size_t szFound = 0;
+  int res;
+
+  if (CHIP_DATA(pnd)->type != PN532)
+    return NFC_ENOTIMPL;
+
+  while ((szTargetTypes > 0) && (szFound < szTargets)) {
+    nfc_target ntTargets[2];
+    size_t szPolled = 0;
+
+    memset(ntTargets, 0x00, sizeof(nfc_target) * 2);
+    if ((res = pn53x_InAutoPoll(pnd, apttTargetTypes, szTargetTypes, 1, 1, ntTargets, 0)) < 0)
+      return res;
+    if (res == 0)
+      break;
+    for (int t = 0; (t < res) && (szFound < szTargets); t++)
+      ant[szFound++] = ntTargets[t];
+    // Types up to the one which answered found nothing else
+    for (size_t n = 0; n < szTargetTypes; n++) {
+      const nfc_modulation nm = pn53x_ptt_to_nm(apttTargetTypes[n]);
+      if ((nm.nmt == ntTargets[0].nm.nmt) && (nm.nbr == ntTargets[0].nm.nbr))
+        szPolled = n + 1;
     }
-    return result;
+    if (szPolled == 0)
+      return pnd->last_error = NFC_ECHIP;
+    memmove(apttTargetTypes, apttTargetTypes + szPolled, (szTargetTypes - szPolled) * sizeof(pn53x_target_type));
+    szTargetTypes -= szPolled;
   }
-  return NFC_ECHIP;
+  // Targets found by previous InAutoPoll are released by the next one
+  pn53x_current_target_free(pnd);
+
+  for (size_t n = 0; (n < szModulations) && (szFound < szTargets); n++) {
+    if (pn53x_autopoll_handles(pnd, pnmModulations[n]))
+      continue;
+    if ((res = nfc_initiator_list_passive_targets(pnd, pnmModulations[n], ant + szFound, szTargets - szFound)) > 0)
+      szFound += res;
+    else if ((res == NFC_EIO) || (res == NFC_ENOTSUCHDEV))
+      return res;
+  }
+  pnd->last_error = 0;
+  return szFound;
 }
 
 int
@@ -1400,6 +3273,12 @@ pn53x_initiator_select_dep_target(struct nfc_device *pnd,
   } else {
     res = pn53x_InJumpForDEP(pnd, ndm, nbr, pbtPassiveInitiatorData, NULL, NULL, 0, pnt, timeout);
   }
+  CHIP_DATA(pnd)->szDepPending = 0;
+  if ((res > 0) && pnt && pnd->bAutoBitrate && (nbr == NBR_106)) {
+    int res2;
+    if ((res2 = pn53x_initiator_raise_bit_rate(pnd, pnt)) < 0)
+      return res2;
+  }
   if (res > 0) {
     if (pn53x_current_target_new(pnd, pnt) == NULL) {
       return NFC_ESOFT;
@@ -1408,9 +3287,10 @@ pn53x_initiator_select_dep_target(struct nfc_device *pnd,
   return res;
 }
 
-int
-pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
-                                const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar)
+static int
+pn53x_initiator_transceive_bits_scratch(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
+                                        const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar,
+                                        uint8_t *abtCmd, uint8_t *abtRx)
 {
   int res = 0;
   size_t  szFrameBits = 0;
@@ -1418,7 +3298,8 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
   size_t szRxBits = 0;
   uint8_t ui8rcc;
   uint8_t ui8Bits = 0;
-  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN] = { InCommunicateThru };
+
+  abtCmd[0] = InCommunicateThru;
 
   // Check if we should prepare the parity bits ourself
   if ((!pnd->bPar) && (szTxBits > 0)) {
@@ -1446,8 +3327,7 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
 
   // Send the frame to the PN53X chip and get the answer
   // We have to give the amount of bytes + (the command byte 0x42)
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+  size_t  szRx = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
   if ((res = pn53x_transceive(pnd, abtCmd, szFrameBytes + 1, abtRx, szRx, -1)) < 0)
     return res;
   szRx = (size_t) res;
@@ -1478,12 +3358,26 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
   return szRxBits;
 }
 
+int
+pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
+                                const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  uint8_t *abtRx = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtCmd && abtRx)
+    res = pn53x_initiator_transceive_bits_scratch(pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, pbtRxPar, abtCmd, abtRx);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
 int
 pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
                                  const size_t szRx, int timeout)
 {
   size_t  szExtraTxLen;
-  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
   int res = 0;
 
   // We can not just send bytes without parity if while the PN53X expects we handled them
@@ -1492,6 +3386,13 @@ pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, c
     return pnd->last_error;
   }
 
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  if (!abtCmd) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+
   // Copy the data into the command frame
   if (pnd->bEasyFraming) {
     abtCmd[0] = InDataExchange;
@@ -1506,31 +3407,223 @@ pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, c
 
   // To transfer command frames bytes we can not have any leading bits, reset this to zero
   if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
+    pn53x_scratch_release(pnd, szScratch);
     pnd->last_error = res;
     return pnd->last_error;
   }
 
   // Send the frame to the PN53X chip and get the answer
   // We have to give the amount of bytes + (the two command bytes 0xD4, 0x42)
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  if ((res = pn53x_transceive(pnd, abtCmd, szTx + szExtraTxLen, abtRx, sizeof(abtRx), timeout)) < 0) {
+  res = pn53x_transceive_data(pnd, abtCmd, szTx + szExtraTxLen, pbtRx, szRx, timeout);
+  pn53x_scratch_release(pnd, szScratch);
+  if (res < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
-  const size_t szRxLen = (size_t)res - 1;
-  if (pbtRx != NULL) {
-    if (szRxLen >  szRx) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen);
-      return NFC_EOVFLOW;
+  // Everything went successful, we return received bytes count
+  return res;
+}
+
+int
+pn53x_initiator_transceive_bytes_batch(struct nfc_device *pnd, const struct nfc_batch_frame *frames, const size_t szFrames, int timeout)
+{
+  size_t  szExtraTxLen;
+  int res = 0;
+
+  // We can not just send bytes without parity if while the PN53X expects we handled them
+  // nor interleave the batch with a pending asynchronous exchange
+  if (!pnd->bPar || CHIP_DATA(pnd)->async.bPending) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+
+  // To transfer command frames bytes we can not have any leading bits, reset this to zero
+  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+
+  // Flush pending register writes and resolve the timeout once for the whole batch
+  if (CHIP_DATA(pnd)->wb_trigged) {
+    if ((res = pn53x_writeback_register(pnd)) < 0) {
+      pnd->last_error = res;
+      return pnd->last_error;
     }
-    // Copy the received bytes
-    memcpy(pbtRx, abtRx + 1, szRxLen);
   }
-  // Everything went successful, we return received bytes count
-  return szRxLen;
+  if (timeout == -1) {
+    timeout = CHIP_DATA(pnd)->timeout_command;
+  } else if (timeout < -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid timeout value: %d", timeout);
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Batch of %" PRIuPTR " frame(s), timeout value: %d", szFrames, timeout);
+
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  if (!abtCmd) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+
+  if (pnd->bEasyFraming) {
+    abtCmd[0] = InDataExchange;
+    abtCmd[1] = 1;              /* target number */
+    szExtraTxLen = 2;
+  } else {
+    abtCmd[0] = InCommunicateThru;
+    szExtraTxLen = 1;
+  }
+
+  for (size_t i = 0; i < szFrames; i++) {
+    const struct nfc_batch_frame *frame = &(frames[i]);
+    if (frame->szTx > PN53x_EXTENDED_FRAME__DATA_MAX_LEN - szExtraTxLen) {
+      res = NFC_EINVARG;
+    } else {
+      memcpy(abtCmd + szExtraTxLen, frame->pbtTx, frame->szTx);
+      res = pn53x_transceive_frame(pnd, abtCmd, frame->szTx + szExtraTxLen, frame->pbtRx, frame->szRx, true, timeout);
+    }
+    if (frame->pres)
+      *(frame->pres) = res;
+    if (res < 0) {
+      pn53x_scratch_release(pnd, szScratch);
+      pnd->last_error = res;
+      return pnd->last_error;
+    }
+    if (nfc_batch_frame_sw_mismatch(frame, res))
+      break;
+  }
+  pn53x_scratch_release(pnd, szScratch);
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_initiator_transceive_bytes_async_scratch(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx,
+                                               int timeout, nfc_transceive_callback callback, void *user_data, uint8_t *abtCmd)
+{
+  size_t  szExtraTxLen;
+  int res = 0;
+
+  // We can not just send bytes without parity if while the PN53X expects we handled them,
+  // and the chip only handles one command at a time
+  if (!pnd->bPar || !callback || CHIP_DATA(pnd)->async.bPending) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+
+  // Copy the data into the command frame
+  if (pnd->bEasyFraming) {
+    abtCmd[0] = InDataExchange;
+    abtCmd[1] = 1;              /* target number */
+    szExtraTxLen = 2;
+  } else {
+    abtCmd[0] = InCommunicateThru;
+    abtCmd[1] = 0;
+    szExtraTxLen = 1;
+  }
+  if (szTx > PN53x_EXTENDED_FRAME__DATA_MAX_LEN - szExtraTxLen) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  memcpy(abtCmd + szExtraTxLen, pbtTx, szTx);
+
+  // To transfer command frames bytes we can not have any leading bits, reset this to zero
+  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+
+  if ((res = pn53x_transceive_prepare(pnd, abtCmd, &timeout)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+  // Set before sending, so that the driver does not defer reading the ACK frame
+  CHIP_DATA(pnd)->async.bPending = true;
+  if ((res = pn53x_transceive_send(pnd, abtCmd, szTx + szExtraTxLen, timeout, &(CHIP_DATA(pnd)->async.tvStart), &(CHIP_DATA(pnd)->async.tvSent))) < 0) {
+    CHIP_DATA(pnd)->async.bPending = false;
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+
+  memcpy(CHIP_DATA(pnd)->async.abtCmd, abtCmd, sizeof(CHIP_DATA(pnd)->async.abtCmd));
+  CHIP_DATA(pnd)->async.timeout = timeout;
+  CHIP_DATA(pnd)->async.pbtRx = pbtRx;
+  CHIP_DATA(pnd)->async.szRx = szRx;
+  CHIP_DATA(pnd)->async.callback = callback;
+  CHIP_DATA(pnd)->async.user_data = user_data;
+
+  // The bus layer may already hold the answer (e.g. read together with the ACK frame),
+  // in which case the descriptor would never become readable: complete right now.
+  if (PN53X_IO(pnd)->pending && PN53X_IO(pnd)->pending(pnd)) {
+    pn53x_process_events(pnd);
+  }
+  return NFC_SUCCESS;
+}
+
+int
+pn53x_initiator_transceive_bytes_async(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx,
+                                       int timeout, nfc_transceive_callback callback, void *user_data)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  int res;
+
+  if (!abtCmd) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  res = pn53x_initiator_transceive_bytes_async_scratch(pnd, pbtTx, szTx, pbtRx, szRx, timeout, callback, user_data, abtCmd);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+int
+pn53x_get_pollable_fd(struct nfc_device *pnd)
+{
+  if (!PN53X_IO(pnd)->get_fd)
+    return NFC_EDEVNOTSUPP;
+  return PN53X_IO(pnd)->get_fd(pnd);
+}
+
+int
+pn53x_process_events(struct nfc_device *pnd)
+{
+  if (!CHIP_DATA(pnd)->async.bPending)
+    return 0;
+
+  int timeout = CHIP_DATA(pnd)->async.timeout;
+  if (timeout > 0) {
+    // Only wait for what is left of the exchange timeout
+    struct timeval tvNow;
+    gettimeofday(&tvNow, NULL);
+    const uint64_t elapsed_ms = pn53x_stats_elapsed_us(&(CHIP_DATA(pnd)->async.tvSent), &tvNow) / 1000;
+    timeout = (elapsed_ms < (uint64_t) timeout) ? timeout - (int) elapsed_ms : 1;
+  }
+
+  int res = pn53x_transceive_receive(pnd, CHIP_DATA(pnd)->async.abtCmd, CHIP_DATA(pnd)->async.pbtRx, CHIP_DATA(pnd)->async.szRx, true, timeout,
+                                     &(CHIP_DATA(pnd)->async.tvStart), &(CHIP_DATA(pnd)->async.tvSent));
+  pnd->last_error = (res < 0) ? res : 0;
+
+  // Release the chip before the callback so it can submit the next exchange
+  nfc_transceive_callback callback = CHIP_DATA(pnd)->async.callback;
+  void *user_data = CHIP_DATA(pnd)->async.user_data;
+  CHIP_DATA(pnd)->async.bPending = false;
+  callback(pnd, res, user_data);
+  return 1;
+}
+
+static void __pn53x_timer_register_append(struct nfc_device *pnd, uint8_t *pbtCmd, size_t *pszCmd, const uint16_t ui16RegisterAddress, const uint8_t ui8Value)
+{
+  const int internal_address = ui16RegisterAddress - PN53X_CACHE_REGISTER_MIN_ADDRESS;
+  if (CHIP_DATA(pnd)->wb_known[internal_address] && (CHIP_DATA(pnd)->wb_shadow[internal_address] == ui8Value)) {
+    // Timer register is already programmed with this value
+    return;
+  }
+  PNREG_TRACE(ui16RegisterAddress);
+  pbtCmd[(*pszCmd)++] = ui16RegisterAddress >> 8;
+  pbtCmd[(*pszCmd)++] = ui16RegisterAddress & 0xff;
+  pbtCmd[(*pszCmd)++] = ui8Value;
 }
 
-static void __pn53x_init_timer(struct nfc_device *pnd, const uint32_t max_cycles)
+static void __pn53x_init_timer(struct nfc_device *pnd, const uint32_t max_cycles, uint8_t *pbtCmd, size_t *pszCmd)
 {
 // The prescaler will dictate what will be the precision and
 // the largest delay to measure before saturation. Some examples:
@@ -1544,40 +3637,28 @@ static void __pn53x_init_timer(struct nfc_device *pnd, const uint32_t max_cycles
     CHIP_DATA(pnd)->timer_prescaler = 0;
   }
   uint16_t reloadval = 0xFFFF;
-  // Initialize timer
-  pn53x_write_register(pnd, PN53X_REG_CIU_TMode, 0xFF, SYMBOL_TAUTO | ((CHIP_DATA(pnd)->timer_prescaler >> 8) & SYMBOL_TPRESCALERHI));
-  pn53x_write_register(pnd, PN53X_REG_CIU_TPrescaler, 0xFF, (CHIP_DATA(pnd)->timer_prescaler & SYMBOL_TPRESCALERLO));
-  pn53x_write_register(pnd, PN53X_REG_CIU_TReloadVal_hi, 0xFF, (reloadval >> 8) & 0xFF);
-  pn53x_write_register(pnd, PN53X_REG_CIU_TReloadVal_lo, 0xFF, reloadval & 0xFF);
+  // Initialize timer: registers are appended to the WriteRegister command which
+  // will fill the FIFO, and only when they differ from the values already programmed
+  __pn53x_timer_register_append(pnd, pbtCmd, pszCmd, PN53X_REG_CIU_TMode, SYMBOL_TAUTO | ((CHIP_DATA(pnd)->timer_prescaler >> 8) & SYMBOL_TPRESCALERHI));
+  __pn53x_timer_register_append(pnd, pbtCmd, pszCmd, PN53X_REG_CIU_TPrescaler, (CHIP_DATA(pnd)->timer_prescaler & SYMBOL_TPRESCALERLO));
+  __pn53x_timer_register_append(pnd, pbtCmd, pszCmd, PN53X_REG_CIU_TReloadVal_hi, (reloadval >> 8) & 0xFF);
+  __pn53x_timer_register_append(pnd, pbtCmd, pszCmd, PN53X_REG_CIU_TReloadVal_lo, reloadval & 0xFF);
 }
 
-static uint32_t __pn53x_get_timer(struct nfc_device *pnd, const uint8_t last_cmd_byte)
+static void __pn53x_timer_registers_written(struct nfc_device *pnd, const uint8_t *pbtCmd, const size_t szCmd)
 {
-  uint8_t counter_hi, counter_lo;
-  uint16_t counter;
-  uint32_t u32cycles;
-  size_t off = 0;
-  if (CHIP_DATA(pnd)->type == PN533) {
-    // PN533 prepends its answer by a status byte
-    off = 1;
-  }
-  // Read timer
-  BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi  >> 8);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi & 0xff);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo  >> 8);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo & 0xff);
-  uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t szRes = sizeof(abtRes);
-  // Let's send the previously constructed ReadRegister command
-  if (pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1) < 0) {
-    return false;
+  // Keep track of the timer settings sent in this WriteRegister command
+  for (size_t i = 1; i + 2 < szCmd; i += 3) {
+    const uint16_t ui16RegisterAddress = (pbtCmd[i] << 8) | pbtCmd[i + 1];
+    if ((ui16RegisterAddress >= PN53X_REG_CIU_TMode) && (ui16RegisterAddress <= PN53X_REG_CIU_TReloadVal_lo)) {
+      pn53x_cache_store(pnd, ui16RegisterAddress, pbtCmd[i + 2]);
+    }
   }
-  counter_hi = abtRes[off];
-  counter_lo = abtRes[off + 1];
-  counter = counter_hi;
-  counter = (counter << 8) + counter_lo;
+}
+
+static uint32_t __pn53x_get_timer(struct nfc_device *pnd, const uint16_t counter, const uint8_t last_cmd_byte)
+{
+  uint32_t u32cycles;
   if (counter == 0) {
     // counter saturated
     u32cycles = 0xFFFFFFFF;
@@ -1612,9 +3693,10 @@ static uint32_t __pn53x_get_timer(struct nfc_device *pnd, const uint8_t last_cmd
   return u32cycles;
 }
 
-int
-pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
-                                      const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles)
+static int
+pn53x_initiator_transceive_bits_timed_scratch(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
+                                              const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles,
+                                              uint8_t *abtCmd, uint8_t *abtRes)
 {
   // TODO Do something with these bytes...
   (void) pbtTxPar;
@@ -1640,14 +3722,13 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
     return pnd->last_error;
   }
 
-  __pn53x_init_timer(pnd, *cycles);
-
   // Once timer is started, we cannot use Tama commands anymore.
   // E.g. on SCL3711 timer settings are reset by 0x42 InCommunicateThru command to:
   //  631a=82 631b=a5 631c=02 631d=00
-  // Prepare FIFO
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  // Setup timer and prepare FIFO in the same WriteRegister command
+  BUFFER_INIT_AT(abtWriteRegisterCmd, abtCmd);
   BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
+  __pn53x_init_timer(pnd, *cycles, abtWriteRegisterCmd, &BUFFER_SIZE(abtWriteRegisterCmd));
 
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command  >> 8);
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command & 0xff);
@@ -1668,6 +3749,7 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
   if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
     return res;
   }
+  __pn53x_timer_registers_written(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd));
 
   // Recv data
   // we've to watch for coming data until we decide to timeout.
@@ -1684,8 +3766,9 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
     // PN533 prepends its answer by a status byte
     off = 1;
   }
+  uint16_t counter = 0;
   while (1) {
-    BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+    BUFFER_INIT_AT(abtReadRegisterCmd, abtCmd);
     BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
     for (i = 0; i < sz; i++) {
       BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
@@ -1693,8 +3776,12 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
     }
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
+    // Timer is already stopped once data is received, read it along with FIFO
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi & 0xff);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo & 0xff);
+    size_t szRes = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
     // Let's send the previously constructed ReadRegister command
     if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
       return res;
@@ -1703,6 +3790,7 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
       pbtRx[i + szRxBits] = abtRes[i + off];
     }
     szRxBits += (size_t)(sz & SYMBOL_FIFO_LEVEL);
+    counter = (abtRes[sz + off + 1] << 8) | abtRes[sz + off + 2];
     sz = abtRes[sz + off];
     if (sz == 0)
       break;
@@ -1710,13 +3798,30 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
   szRxBits *= 8; // in bits, not bytes
 
   // Recv corrected timer value
-  *cycles = __pn53x_get_timer(pnd, pbtTx[szTxBits / 8]);
+  *cycles = __pn53x_get_timer(pnd, counter, pbtTx[szTxBits / 8]);
 
   return szRxBits;
 }
 
 int
-pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles)
+pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
+                                      const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  // WriteRegister then ReadRegister commands, built one after the other
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  uint8_t *abtRes = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtCmd && abtRes)
+    res = pn53x_initiator_transceive_bits_timed_scratch(pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, pbtRxPar, cycles, abtCmd, abtRes);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+static int
+pn53x_initiator_transceive_bytes_timed_scratch(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles,
+                                               uint8_t *abtCmd, uint8_t *abtRes)
 {
   uint16_t i;
   uint8_t sz = 0;
@@ -1741,14 +3846,13 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
     }
   }
 
-  __pn53x_init_timer(pnd, *cycles);
-
   // Once timer is started, we cannot use Tama commands anymore.
   // E.g. on SCL3711 timer settings are reset by 0x42 InCommunicateThru command to:
   //  631a=82 631b=a5 631c=02 631d=00
-  // Prepare FIFO
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  // Setup timer and prepare FIFO in the same WriteRegister command
+  BUFFER_INIT_AT(abtWriteRegisterCmd, abtCmd);
   BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
+  __pn53x_init_timer(pnd, *cycles, abtWriteRegisterCmd, &BUFFER_SIZE(abtWriteRegisterCmd));
 
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command  >> 8);
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command & 0xff);
@@ -1769,6 +3873,7 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
   if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
     return res;
   }
+  __pn53x_timer_registers_written(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd));
 
   // Recv data
   size_t szRxLen = 0;
@@ -1786,8 +3891,9 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
     // PN533 prepends its answer by a status byte
     off = 1;
   }
+  uint16_t counter = 0;
   while (1) {
-    BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+    BUFFER_INIT_AT(abtReadRegisterCmd, abtCmd);
     BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
     for (i = 0; i < sz; i++) {
       BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
@@ -1795,8 +3901,12 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
     }
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
+    // Timer is already stopped once data is received, read it along with FIFO
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi & 0xff);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo & 0xff);
+    size_t szRes = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
     // Let's send the previously constructed ReadRegister command
     if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
       return res;
@@ -1812,6 +3922,7 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
       }
     }
     szRxLen += (size_t)(sz & SYMBOL_FIFO_LEVEL);
+    counter = (abtRes[sz + off + 1] << 8) | abtRes[sz + off + 2];
     sz = abtRes[sz + off];
     if (sz == 0)
       break;
@@ -1831,14 +3942,29 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
       iso14443b_crc_append(pbtTxRaw, szTx);
     else
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unsupported framing type %02X, cannot adjust CRC cycles", txmode & SYMBOL_TX_FRAMING);
-    *cycles = __pn53x_get_timer(pnd, pbtTxRaw[szTx + 1]);
+    *cycles = __pn53x_get_timer(pnd, counter, pbtTxRaw[szTx + 1]);
     free(pbtTxRaw);
   } else {
-    *cycles = __pn53x_get_timer(pnd, pbtTx[szTx - 1]);
+    *cycles = __pn53x_get_timer(pnd, counter, pbtTx[szTx - 1]);
   }
   return szRxLen;
 }
 
+int
+pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  // WriteRegister then ReadRegister commands, built one after the other
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  uint8_t *abtRes = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtCmd && abtRes)
+    res = pn53x_initiator_transceive_bytes_timed_scratch(pnd, pbtTx, szTx, pbtRx, szRx, cycles, abtCmd, abtRes);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
 int
 pn53x_initiator_deselect_target(struct nfc_device *pnd)
 {
@@ -1953,9 +4079,12 @@ static int pn53x_ISO14443A_Barcode_is_present(struct nfc_device *pnd)
     if ((! CHIP_DATA(pnd)->progressive_field) && (ret = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0) {
       return ret;
     }
-    uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    uint8_t abtRxPar[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    if ((ret = nfc_initiator_transceive_bits(pnd, NULL, 0, NULL, abtRx, sizeof(abtRx), abtRxPar)) < 1) {
+    const size_t szScratch = pn53x_scratch_mark(pnd);
+    uint8_t *abtRx = pn53x_scratch_get(pnd);
+    uint8_t *abtRxPar = pn53x_scratch_get(pnd);
+    ret = (abtRx && abtRxPar) ? nfc_initiator_transceive_bits(pnd, NULL, 0, NULL, abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, abtRxPar) : NFC_ESOFT;
+    pn53x_scratch_release(pnd, szScratch);
+    if (ret < 1) {
       failures++;
     } else {
       nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true);
@@ -2000,6 +4129,22 @@ static int pn53x_ISO14443A_MFC_is_present(struct nfc_device *pnd)
   if ((CHIP_DATA(pnd)->type == PN533) && (CHIP_DATA(pnd)->current_target->nti.nai.btSak != 0x09)) {
     // MFC Mini (atqa0004/sak09) fails on PN533, so we exclude it
     ret = pn53x_Diagnose06(pnd);
+  } else if (CHIP_DATA(pnd)->type != RCS360) {
+    // Limitation: halting will lose authentication of already authenticated sector
+    // HLTA, then WUPA and SELECT from the known UID: much lighter than a full select
+    uint8_t abtHlta[4] = { 0x50, 0x00 };
+    struct pn53x_anticol ac;
+    iso14443a_crc_append(abtHlta, 2);
+    if ((ret = pn53x_anticol_begin(pnd, &ac)) >= 0) {
+      if ((ret = pn53x_anticol_exchange(pnd, &ac, abtHlta, 8 * sizeof(abtHlta), 0, ac.abtRx, 0)) >= 0)
+        ret = pn53x_initiator_reactivate_target_scratch(pnd, CHIP_DATA(pnd)->current_target, &ac);
+    }
+    ret = pn53x_anticol_end(pnd, &ac, ret);
+    if (ret == 1) {
+      ret = NFC_SUCCESS;
+    } else if (ret == 0) {
+      ret = NFC_ETGRELEASED;
+    }
   } else {
     // Limitation: re-select will lose authentication of already authenticated sector
     bool bInfiniteSelect = pnd->bInfiniteSelect;
@@ -2224,14 +4369,21 @@ pn53x_initiator_target_is_present(struct nfc_device *pnd, const nfc_target *pnt)
   return pnd->last_error = ret;
 }
 
-#define SAK_ISO14443_4_COMPLIANT 0x20
 #define SAK_ISO18092_COMPLIANT   0x40
+static size_t pn53x_TgInitAsTarget_frame(struct nfc_device *pnd, pn53x_target_mode ptm,
+                                         const uint8_t *pbtMifareParams,
+                                         const uint8_t *pbtTkt, size_t szTkt,
+                                         const uint8_t *pbtFeliCaParams,
+                                         const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt,
+                                         uint8_t *abtCmd);
+static int pn53x_TgInitAsTarget_send(struct nfc_device *pnd, const uint8_t *abtCmd, const size_t szCmd,
+                                     uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout);
+
 int
 pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRxLen, int timeout)
 {
-  pn53x_reset_settings(pnd);
-
   CHIP_DATA(pnd)->operating_mode = TARGET;
+  CHIP_DATA(pnd)->szDepPending = 0;
 
   pn53x_target_mode ptm = PTM_NORMAL;
   int res = 0;
@@ -2274,10 +4426,6 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
       return pnd->last_error;
   }
 
-  // Let the PN53X be activated by the RF level detector from power down mode
-  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_TxAuto, SYMBOL_INITIAL_RF_ON, 0x04)) < 0)
-    return res;
-
   uint8_t abtMifareParams[6];
   uint8_t *pbtMifareParams = NULL;
   uint8_t *pbtTkt = NULL;
@@ -2376,17 +4524,31 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
       return pnd->last_error;
   }
 
+  uint8_t abtCmd[PN53X_TGINITASTARGET_MAX_LEN];
+  const size_t szCmd = pn53x_TgInitAsTarget_frame(pnd, ptm, pbtMifareParams, pbtTkt, szTkt, pbtFeliCaParams, pbtNFCID3t, pbtGBt, szGBt, abtCmd);
+
+  // Re-arming the same target right after a session: only target commands ran since the chip was set up, it still is
+  if ((CHIP_DATA(pnd)->szTargetArm != szCmd) || (memcmp(CHIP_DATA(pnd)->abtTargetArm, abtCmd, szCmd) != 0) ||
+      !pnd->bCrc || !pnd->bPar || !pnd->bEasyFraming || (CHIP_DATA(pnd)->ui8TxBits != 0)) {
+    pn53x_reset_settings(pnd);
+    // Let the PN53X be activated by the RF level detector from power down mode
+    if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_TxAuto, SYMBOL_INITIAL_RF_ON, 0x04)) < 0)
+      return res;
+  }
+
   bool targetActivated = false;
   size_t szRx;
   while (!targetActivated) {
     uint8_t btActivatedMode;
 
-    if ((res = pn53x_TgInitAsTarget(pnd, ptm, pbtMifareParams, pbtTkt, szTkt, pbtFeliCaParams, pbtNFCID3t, pbtGBt, szGBt, pbtRx, szRxLen, &btActivatedMode, timeout)) < 0) {
+    if ((res = pn53x_TgInitAsTarget_send(pnd, abtCmd, szCmd, pbtRx, szRxLen, &btActivatedMode, timeout)) < 0) {
       if (res == NFC_ETIMEOUT) {
         pn53x_idle(pnd);
       }
       return res;
     }
+    memcpy(CHIP_DATA(pnd)->abtTargetArm, abtCmd, szCmd);
+    CHIP_DATA(pnd)->szTargetArm = szCmd;
     szRx = (size_t) res;
     nfc_modulation nm = {
       .nmt = NMT_DEP, // Silent compilation warnings
@@ -2450,14 +4612,14 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
   return szRx;
 }
 
-int
-pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtRxPar)
+static int
+pn53x_target_receive_bits_scratch(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtRxPar,
+                                  uint8_t *abtRx)
 {
   size_t szRxBits = 0;
   uint8_t  abtCmd[] = { TgGetInitiatorCommand };
 
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+  size_t  szRx = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
   int res = 0;
 
   // Try to gather a received frame from the reader
@@ -2493,6 +4655,19 @@ pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t s
   return szRxBits;
 }
 
+int
+pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtRxPar)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtRx = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtRx)
+    res = pn53x_target_receive_bits_scratch(pnd, pbtRx, szRxLen, pbtRxPar, abtRx);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
 int
 pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout)
 {
@@ -2534,34 +4709,25 @@ pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t
   }
 
   // Try to gather a received frame from the reader
-  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t szRx = sizeof(abtRx);
   int res = 0;
-  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, szRx, timeout)) < 0)
+  if ((res = pn53x_transceive_data(pnd, abtCmd, sizeof(abtCmd), pbtRx, szRxLen, timeout)) < 0)
     return pnd->last_error;
-  szRx = (size_t) res;
-  // Save the received bytes count
-  szRx -= 1;
-
-  if (szRx > szRxLen)
-    return NFC_EOVFLOW;
-
-  // Copy the received bytes
-  memcpy(pbtRx, abtRx + 1, szRx);
 
   // Everyting seems ok, return received bytes count
-  return szRx;
+  return res;
 }
 
-int
-pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar)
+static int
+pn53x_target_send_bits_scratch(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar,
+                               uint8_t *abtCmd)
 {
   size_t  szFrameBits = 0;
   size_t  szFrameBytes = 0;
   uint8_t ui8Bits = 0;
-  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN] = { TgResponseToInitiator };
   int res = 0;
 
+  abtCmd[0] = TgResponseToInitiator;
+
   // Check if we should prepare the parity bits ourself
   if (!pnd->bPar) {
     // Convert data with parity to a frame
@@ -2594,10 +4760,113 @@ pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_
   return szTxBits;
 }
 
-int
-pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+int
+pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtCmd)
+    res = pn53x_target_send_bits_scratch(pnd, pbtTx, szTxBits, pbtTxPar, abtCmd);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+// A raw emulation rule as exchanged with the chip
+struct pn53x_raw_rule {
+  const uint8_t *pbtCommand;
+  size_t szCommand;
+  uint8_t ui8CommandMask;
+  // TgResponseToInitiator command, ready to be sent
+  uint8_t abtAnswer[1 + NFC_EMULATION_RAW_MAX_LEN];
+  size_t szAnswer;
+  uint8_t ui8AnswerLastBits;
+};
+
+static bool
+pn53x_raw_rule_matches(const struct pn53x_raw_rule *prule, const uint8_t *pbtFrame, const size_t szFrame)
+{
+  return (szFrame == prule->szCommand) && !memcmp(pbtFrame, prule->pbtCommand, szFrame - 1) &&
+         !((pbtFrame[szFrame - 1] ^ prule->pbtCommand[szFrame - 1]) & prule->ui8CommandMask);
+}
+
+/*
+ * The answers are prepared once here, then each frame is matched and answered
+ * as it is. The chip keeps handling the parity: host made parity bits would
+ * leave answers with a trailing partial byte, each costing a BitFraming
+ * register update. Frame lengths are compared in bytes, which spares reading
+ * the last bits count from the chip but for the frame handed back.
+ */
+int
+pn53x_target_emulate_raw(struct nfc_device *pnd, const struct nfc_emulation_raw_rule *rules, const size_t szRules,
+                         uint8_t *pbtRx, const size_t szRxLen)
+{
+  struct pn53x_raw_rule arules[NFC_EMULATION_RAW_MAX_RULES];
+  const uint8_t abtCmd[] = { TgGetInitiatorCommand };
+  int res;
+
+  if (!pnd->bPar || pnd->bCrc || (szRules > NFC_EMULATION_RAW_MAX_RULES)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  for (size_t n = 0; n < szRules; n++) {
+    if ((rules[n].command_bits == 0) || (rules[n].command_bits > NFC_EMULATION_RAW_MAX_LEN * 8) ||
+        (rules[n].answer_bits > NFC_EMULATION_RAW_MAX_LEN * 8)) {
+      pnd->last_error = NFC_EINVARG;
+      return pnd->last_error;
+    }
+    arules[n].pbtCommand = rules[n].command;
+    arules[n].szCommand = (rules[n].command_bits + 7) / 8;
+    arules[n].ui8CommandMask = (rules[n].command_bits % 8) ? (1 << (rules[n].command_bits % 8)) - 1 : 0xff;
+    arules[n].abtAnswer[0] = TgResponseToInitiator;
+    memcpy(arules[n].abtAnswer + 1, rules[n].answer, (rules[n].answer_bits + 7) / 8);
+    arules[n].szAnswer = rules[n].answer_bits ? 1 + (rules[n].answer_bits + 7) / 8 : 0;
+    arules[n].ui8AnswerLastBits = rules[n].answer_bits % 8;
+  }
+
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtRx = pn53x_scratch_get(pnd);
+  res = NFC_ESOFT;
+  while (abtRx) {
+    if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, -1)) < 0)
+      break;
+    const size_t szFrame = (size_t) res - 1;
+    const struct pn53x_raw_rule *prule = NULL;
+    for (size_t n = 0; (n < szRules) && szFrame; n++) {
+      if (pn53x_raw_rule_matches(&arules[n], abtRx + 1, szFrame)) {
+        prule = &arules[n];
+        break;
+      }
+    }
+    if (!prule) {
+      // Not ours: hand the frame back as nfc_target_receive_bits() would
+      uint8_t ui8rcc;
+      if ((res = pn53x_read_register(pnd, PN53X_REG_CIU_Control, &ui8rcc)) < 0)
+        break;
+      const uint8_t ui8Bits = ui8rcc & SYMBOL_RX_LAST_BITS;
+      if (szFrame > szRxLen) {
+        res = NFC_EOVFLOW;
+        break;
+      }
+      memcpy(pbtRx, abtRx + 1, szFrame);
+      res = (int)(((szFrame - ((ui8Bits == 0) ? 0 : 1)) * 8) + ui8Bits);
+      break;
+    }
+    if (prule->szAnswer) {
+      if (((res = pn53x_set_tx_bits(pnd, prule->ui8AnswerLastBits)) < 0) ||
+          ((res = pn53x_transceive(pnd, prule->abtAnswer, prule->szAnswer, NULL, 0, -1)) < 0))
+        break;
+    }
+  }
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+static int
+pn53x_target_send_bytes_scratch(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout,
+                                uint8_t *abtCmd)
 {
-  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
   int res = 0;
 
   // We can not just send bytes without parity if while the PN53X expects we handled them
@@ -2639,17 +4908,156 @@ pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size
     abtCmd[0] = TgResponseToInitiator;
   }
 
+  // Longer answers (e.g. extended length R-APDUs) are chained: TgSetMetaData sets MI, TgSetData ends
+  size_t szDone = 0;
+  if (abtCmd[0] == TgSetData) {
+    while (szTx - szDone > PN53X_DEP_CHUNK_LEN) {
+      abtCmd[0] = TgSetMetaData;
+      memcpy(abtCmd + 1, pbtTx + szDone, PN53X_DEP_CHUNK_LEN);
+      if ((res = pn53x_transceive(pnd, abtCmd, 1 + PN53X_DEP_CHUNK_LEN, NULL, 0, timeout)) < 0)
+        return res;
+      szDone += PN53X_DEP_CHUNK_LEN;
+    }
+    abtCmd[0] = TgSetData;
+  } else if (szTx >= PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+
   // Copy the data into the command frame
-  memcpy(abtCmd + 1, pbtTx, szTx);
+  memcpy(abtCmd + 1, pbtTx + szDone, szTx - szDone);
 
   // Try to send the bits to the reader
-  if ((res = pn53x_transceive(pnd, abtCmd, szTx + 1, NULL, 0, timeout)) < 0)
+  if ((res = pn53x_transceive(pnd, abtCmd, szTx - szDone + 1, NULL, 0, timeout)) < 0)
     return res;
 
   // Everyting seems ok, return sent byte count
   return szTx;
 }
 
+int
+pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtCmd)
+    res = pn53x_target_send_bytes_scratch(pnd, pbtTx, szTx, timeout, abtCmd);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+int
+pn53x_target_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  // The next command is asked for as soon as the answer is out, the initiator is not kept waiting for the host
+  if (abtCmd && ((res = pn53x_target_send_bytes_scratch(pnd, pbtTx, szTx, timeout, abtCmd)) >= 0))
+    res = pn53x_target_receive_bytes(pnd, pbtRx, szRx, timeout);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+static int
+pn53x_dep_write_scratch(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout, uint8_t *abtCmd)
+{
+  struct pn53x_data *data = CHIP_DATA(pnd);
+  size_t szDone = 0;
+  int res = 0;
+
+  if (data->operating_mode == INITIATOR) {
+    // Full chunks go with MI set, the tail waits for pn53x_dep_read()
+    abtCmd[0] = InDataExchange;
+    abtCmd[1] = 0x41;
+    while (data->szDepPending + (szTx - szDone) > PN53X_DEP_CHUNK_LEN) {
+      const size_t szTaken = PN53X_DEP_CHUNK_LEN - data->szDepPending;
+      memcpy(abtCmd + 2, data->abtDepPending, data->szDepPending);
+      memcpy(abtCmd + 2 + data->szDepPending, pbtTx + szDone, szTaken);
+      data->szDepPending = 0;
+      szDone += szTaken;
+      if ((res = pn53x_transceive(pnd, abtCmd, 2 + PN53X_DEP_CHUNK_LEN, NULL, 0, timeout)) < 0)
+        return res;
+    }
+    memcpy(data->abtDepPending + data->szDepPending, pbtTx + szDone, szTx - szDone);
+    data->szDepPending += szTx - szDone;
+    return (int) szTx;
+  }
+
+  // As target, the whole answer goes now: TgSetMetaData sets MI, TgSetData ends
+  do {
+    const size_t szChunk = MIN(szTx - szDone, PN53X_DEP_CHUNK_LEN);
+    abtCmd[0] = (szDone + szChunk < szTx) ? TgSetMetaData : TgSetData;
+    memcpy(abtCmd + 1, pbtTx + szDone, szChunk);
+    if ((res = pn53x_transceive(pnd, abtCmd, 1 + szChunk, NULL, 0, timeout)) < 0)
+      return res;
+    szDone += szChunk;
+  } while (szDone < szTx);
+  return (int) szTx;
+}
+
+int
+pn53x_dep_write(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+{
+  int res = 0;
+
+  if (!CHIP_DATA(pnd)->current_target || (CHIP_DATA(pnd)->current_target->nm.nmt != NMT_DEP)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  if (!abtCmd) {
+    res = NFC_ESOFT;
+  } else if ((res = pn53x_set_tx_bits(pnd, 0)) >= 0) {
+    res = pn53x_dep_write_scratch(pnd, pbtTx, szTx, timeout, abtCmd);
+  }
+  pn53x_scratch_release(pnd, szScratch);
+  if (res < 0)
+    pnd->last_error = res;
+  return res;
+}
+
+int
+pn53x_dep_read(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  struct pn53x_data *data = CHIP_DATA(pnd);
+  size_t szCmd = 0;
+  int res = 0;
+
+  if (!data->current_target || (data->current_target->nm.nmt != NMT_DEP)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  if (!abtCmd) {
+    pn53x_scratch_release(pnd, szScratch);
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  if (data->operating_mode == INITIATOR) {
+    // The tail of the message, the answer comes back chained as needed
+    abtCmd[0] = InDataExchange;
+    abtCmd[1] = 0x01;
+    memcpy(abtCmd + 2, data->abtDepPending, data->szDepPending);
+    szCmd = 2 + data->szDepPending;
+    data->szDepPending = 0;
+  } else {
+    abtCmd[0] = TgGetData;
+    szCmd = 1;
+  }
+  if ((res = pn53x_set_tx_bits(pnd, 0)) >= 0)
+    res = pn53x_transceive_data(pnd, abtCmd, szCmd, pbtRx, szRx, timeout);
+  pn53x_scratch_release(pnd, szScratch);
+  if (res < 0)
+    pnd->last_error = res;
+  return res;
+}
+
 static struct sErrorMessage {
   int     iErrorCode;
   const char *pcErrorMsg;
@@ -2721,7 +5129,11 @@ pn53x_RFConfiguration__Various_timings(struct nfc_device *pnd, const uint8_t fAT
     fATR_RES_Timeout,	 // ATR_RES timeout (default: 0x0B 102.4 ms)
     fRetryTimeout	 // TimeOut during non-DEP communications (default: 0x0A 51.2 ms)
   };
-  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1);
+  int res;
+  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1)) < 0)
+    return res;
+  CHIP_DATA(pnd)->adaptive.btRetryTimeout = fRetryTimeout;
+  return res;
 }
 
 int
@@ -2763,6 +5175,49 @@ pn53x_SetParameters(struct nfc_device *pnd, const uint8_t ui8Value)
   return NFC_SUCCESS;
 }
 
+/*
+ * Only the command itself: the PN532 switches once the host acknowledged the
+ * answer, so the driver has to send an ACK frame then change its own speed.
+ */
+int
+pn532_SetSerialBaudRate(struct nfc_device *pnd, const uint32_t uiBaudRate)
+{
+  uint8_t  abtCmd[] = { SetSerialBaudRate, 0x00 };
+
+  switch (uiBaudRate) {
+    case 9600:
+      abtCmd[1] = 0x00;
+      break;
+    case 19200:
+      abtCmd[1] = 0x01;
+      break;
+    case 38400:
+      abtCmd[1] = 0x02;
+      break;
+    case 57600:
+      abtCmd[1] = 0x03;
+      break;
+    case 115200:
+      abtCmd[1] = 0x04;
+      break;
+    case 230400:
+      abtCmd[1] = 0x05;
+      break;
+    case 460800:
+      abtCmd[1] = 0x06;
+      break;
+    case 921600:
+      abtCmd[1] = 0x07;
+      break;
+    case 1288000:
+      abtCmd[1] = 0x08;
+      break;
+    default:
+      return NFC_EINVARG;
+  }
+  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1);
+}
+
 int
 pn532_SAMConfiguration(struct nfc_device *pnd, const pn532_sam_mode sam_mode, int timeout)
 {
@@ -2881,15 +5336,18 @@ pn53x_InDeselect(struct nfc_device *pnd, const uint8_t ui8Target)
 {
   if (CHIP_DATA(pnd)->type == RCS360) {
     // We should do act here *only* if a target was previously selected
-    uint8_t  abtStatus[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t  szStatus = sizeof(abtStatus);
+    const size_t szScratch = pn53x_scratch_mark(pnd);
+    uint8_t *abtStatus = pn53x_scratch_get(pnd);
     uint8_t  abtCmdGetStatus[] = { GetGeneralStatus };
-    int res = 0;
-    if ((res = pn53x_transceive(pnd, abtCmdGetStatus, sizeof(abtCmdGetStatus), abtStatus, szStatus, -1)) < 0) {
+    int res = NFC_ESOFT;
+    if (abtStatus)
+      res = pn53x_transceive(pnd, abtCmdGetStatus, sizeof(abtCmdGetStatus), abtStatus, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, -1);
+    const bool bSelected = (res >= 3) && (abtStatus[2] != 0);
+    pn53x_scratch_release(pnd, szScratch);
+    if (res < 0) {
       return res;
     }
-    szStatus = (size_t) res;
-    if ((szStatus < 3) || (abtStatus[2] == 0)) {
+    if (!bSelected) {
       return NFC_SUCCESS;
     }
     // No much choice what to deselect actually...
@@ -2906,14 +5364,18 @@ pn53x_InRelease(struct nfc_device *pnd, const uint8_t ui8Target)
   int res = 0;
   if (CHIP_DATA(pnd)->type == RCS360) {
     // We should do act here *only* if a target was previously selected
-    uint8_t  abtStatus[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t  szStatus = sizeof(abtStatus);
+    const size_t szScratch = pn53x_scratch_mark(pnd);
+    uint8_t *abtStatus = pn53x_scratch_get(pnd);
     uint8_t  abtCmdGetStatus[] = { GetGeneralStatus };
-    if ((res = pn53x_transceive(pnd, abtCmdGetStatus, sizeof(abtCmdGetStatus), abtStatus, szStatus, -1)) < 0) {
+    res = NFC_ESOFT;
+    if (abtStatus)
+      res = pn53x_transceive(pnd, abtCmdGetStatus, sizeof(abtCmdGetStatus), abtStatus, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, -1);
+    const bool bSelected = (res >= 3) && (abtStatus[2] != 0);
+    pn53x_scratch_release(pnd, szScratch);
+    if (res < 0) {
       return res;
     }
-    szStatus = (size_t) res;
-    if ((szStatus < 3) || (abtStatus[2] == 0)) {
+    if (!bSelected) {
       return NFC_SUCCESS;
     }
     // No much choice what to release actually...
@@ -2926,10 +5388,11 @@ pn53x_InRelease(struct nfc_device *pnd, const uint8_t ui8Target)
   return (res >= 0) ? NFC_SUCCESS : res;
 }
 
-int
-pn53x_InAutoPoll(struct nfc_device *pnd,
-                 const pn53x_target_type *ppttTargetTypes, const size_t szTargetTypes,
-                 const uint8_t btPollNr, const uint8_t btPeriod, nfc_target *pntTargets, const int timeout)
+static int
+pn53x_InAutoPoll_scratch(struct nfc_device *pnd,
+                         const pn53x_target_type *ppttTargetTypes, const size_t szTargetTypes,
+                         const uint8_t btPollNr, const uint8_t btPeriod, nfc_target *pntTargets, const int timeout,
+                         uint8_t *abtRx)
 {
   size_t szTargetFound = 0;
   if (CHIP_DATA(pnd)->type != PN532) {
@@ -2945,42 +5408,49 @@ pn53x_InAutoPoll(struct nfc_device *pnd,
     abtCmd[3 + n] = ppttTargetTypes[n];
   }
 
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+  size_t szRx = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
   int res = pn53x_transceive(pnd, abtCmd, szTxInAutoPoll, abtRx, szRx, timeout);
   szRx = (size_t) res;
   if (res < 0) {
     return res;
   } else if (szRx > 0) {
-    szTargetFound = abtRx[0];
-    if (szTargetFound > 0) {
-      uint8_t ln;
-      uint8_t *pbt = abtRx + 1;
-      /* 1st target */
-      // Target type
-      pn53x_target_type ptt = *(pbt++);
-      pntTargets[0].nm = pn53x_ptt_to_nm(ptt);
-      // AutoPollTargetData length
-      ln = *(pbt++);
-      if ((res = pn53x_decode_target_data(pbt, ln, CHIP_DATA(pnd)->type, pntTargets[0].nm.nmt, &(pntTargets[0].nti))) < 0) {
-        return res;
+    // Each target comes as type, AutoPollTargetData length and AutoPollTargetData
+    size_t szOffset = 1;
+    szTargetFound = MIN(abtRx[0], 2);
+    for (size_t t = 0; t < szTargetFound; t++) {
+      res = NFC_ECHIP;
+      if ((szOffset + 2 <= szRx) && (szOffset + 2 + abtRx[szOffset + 1] <= szRx)) {
+        pntTargets[t].nm = pn53x_ptt_to_nm(abtRx[szOffset]);
+        res = pn53x_decode_target_data(abtRx + szOffset + 2, abtRx[szOffset + 1], CHIP_DATA(pnd)->type, pntTargets[t].nm.nmt, &(pntTargets[t].nti));
       }
-      pbt += ln;
-
-      if (abtRx[0] > 1) {
-        /* 2nd target */
-        // Target type
-        ptt = *(pbt++);
-        pntTargets[1].nm = pn53x_ptt_to_nm(ptt);
-        // AutoPollTargetData length
-        ln = *(pbt++);
-        pn53x_decode_target_data(pbt, ln, CHIP_DATA(pnd)->type, pntTargets[1].nm.nmt, &(pntTargets[1].nti));
+      if (res < 0) {
+        // Only the first target is mandatory
+        if (t == 0)
+          return pnd->last_error = res;
+        szTargetFound = t;
+        break;
       }
+      szOffset += 2 + abtRx[szOffset + 1];
     }
   }
   return szTargetFound;
 }
 
+int
+pn53x_InAutoPoll(struct nfc_device *pnd,
+                 const pn53x_target_type *ppttTargetTypes, const size_t szTargetTypes,
+                 const uint8_t btPollNr, const uint8_t btPeriod, nfc_target *pntTargets, const int timeout)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtRx = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtRx)
+    res = pn53x_InAutoPoll_scratch(pnd, ppttTargetTypes, szTargetTypes, btPollNr, btPeriod, pntTargets, timeout, abtRx);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
 /**
  * @brief Wrapper for InJumpForDEP command
  * @param pmInitModulation desired initial modulation
@@ -2991,15 +5461,16 @@ pn53x_InAutoPoll(struct nfc_device *pnd,
  * @param szGBi count of General Bytes
  * @param[out] pnt \a nfc_target which will be filled by this function
  */
-int
-pn53x_InJumpForDEP(struct nfc_device *pnd,
-                   const nfc_dep_mode ndm,
-                   const nfc_baud_rate nbr,
-                   const uint8_t *pbtPassiveInitiatorData,
-                   const uint8_t *pbtNFCID3i,
-                   const uint8_t *pbtGBi, const size_t szGBi,
-                   nfc_target *pnt,
-                   const int timeout)
+static int
+pn53x_InJumpForDEP_scratch(struct nfc_device *pnd,
+                           const nfc_dep_mode ndm,
+                           const nfc_baud_rate nbr,
+                           const uint8_t *pbtPassiveInitiatorData,
+                           const uint8_t *pbtNFCID3i,
+                           const uint8_t *pbtGBi, const size_t szGBi,
+                           nfc_target *pnt,
+                           const int timeout,
+                           uint8_t *abtRx)
 {
   // Max frame size = 1 (Command) + 1 (ActPass) + 1 (Baud rate) + 1 (Next) + 5 (PassiveInitiatorData) + 10 (NFCID3) + 48 (General bytes) = 67 bytes
   uint8_t  abtCmd[67] = { InJumpForDEP, (ndm == NDM_ACTIVE) ? 0x01 : 0x00 };
@@ -3049,8 +5520,7 @@ pn53x_InJumpForDEP(struct nfc_device *pnd,
     offset += szGBi;
   }
 
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+  size_t szRx = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
   int res = 0;
   // Try to find a target, call the transceive callback function of the current device
   if ((res = pn53x_transceive(pnd, abtCmd, offset, abtRx, szRx, timeout)) < 0)
@@ -3081,19 +5551,39 @@ pn53x_InJumpForDEP(struct nfc_device *pnd,
 }
 
 int
-pn53x_TgInitAsTarget(struct nfc_device *pnd, pn53x_target_mode ptm,
-                     const uint8_t *pbtMifareParams,
-                     const uint8_t *pbtTkt, size_t szTkt,
-                     const uint8_t *pbtFeliCaParams,
-                     const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt,
-                     uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout)
+pn53x_InJumpForDEP(struct nfc_device *pnd,
+                   const nfc_dep_mode ndm,
+                   const nfc_baud_rate nbr,
+                   const uint8_t *pbtPassiveInitiatorData,
+                   const uint8_t *pbtNFCID3i,
+                   const uint8_t *pbtGBi, const size_t szGBi,
+                   nfc_target *pnt,
+                   const int timeout)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtRx = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtRx)
+    res = pn53x_InJumpForDEP_scratch(pnd, ndm, nbr, pbtPassiveInitiatorData, pbtNFCID3i, pbtGBi, szGBi, pnt, timeout, abtRx);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+// Encodes the TgInitAsTarget command into abtCmd (PN53X_TGINITASTARGET_MAX_LEN bytes), returns its length
+static size_t
+pn53x_TgInitAsTarget_frame(struct nfc_device *pnd, pn53x_target_mode ptm,
+                           const uint8_t *pbtMifareParams,
+                           const uint8_t *pbtTkt, size_t szTkt,
+                           const uint8_t *pbtFeliCaParams,
+                           const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt,
+                           uint8_t *abtCmd)
 {
-  uint8_t  abtCmd[39 + 47 + 48] = { TgInitAsTarget }; // Worst case: 39-byte base, 47 bytes max. for General Bytes, 48 bytes max. for Historical Bytes
   size_t  szOptionalBytes = 0;
-  int res = 0;
 
   // Clear the target init struct, reset to all zeros
-  memset(abtCmd + 1, 0x00, sizeof(abtCmd) - 1);
+  abtCmd[0] = TgInitAsTarget;
+  memset(abtCmd + 1, 0x00, PN53X_TGINITASTARGET_MAX_LEN - 1);
 
   // Store the target mode in the initialization params
   abtCmd[1] = ptm;
@@ -3131,11 +5621,19 @@ pn53x_TgInitAsTarget(struct nfc_device *pnd, pn53x_target_mode ptm,
     }
     szOptionalBytes += szTkt + 1;
   }
+  return 36 + szOptionalBytes;
+}
+
+static int
+pn53x_TgInitAsTarget_send_scratch(struct nfc_device *pnd, const uint8_t *abtCmd, const size_t szCmd,
+                                  uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout,
+                                  uint8_t *abtRx)
+{
+  int res = 0;
 
   // Request the initialization as a target
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t szRx = sizeof(abtRx);
-  if ((res = pn53x_transceive(pnd, abtCmd, 36 + szOptionalBytes, abtRx, szRx, timeout)) < 0)
+  size_t szRx = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
+  if ((res = pn53x_transceive(pnd, abtCmd, szCmd, abtRx, szRx, timeout)) < 0)
     return res;
   szRx = (size_t) res;
 
@@ -3156,20 +5654,145 @@ pn53x_TgInitAsTarget(struct nfc_device *pnd, pn53x_target_mode ptm,
   return szRx;
 }
 
+static int
+pn53x_TgInitAsTarget_send(struct nfc_device *pnd, const uint8_t *abtCmd, const size_t szCmd,
+                          uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout)
+{
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtRx = pn53x_scratch_get(pnd);
+  int res = NFC_ESOFT;
+
+  if (abtRx)
+    res = pn53x_TgInitAsTarget_send_scratch(pnd, abtCmd, szCmd, pbtRx, szRxLen, pbtModeByte, timeout, abtRx);
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
+int
+pn53x_TgInitAsTarget(struct nfc_device *pnd, pn53x_target_mode ptm,
+                     const uint8_t *pbtMifareParams,
+                     const uint8_t *pbtTkt, size_t szTkt,
+                     const uint8_t *pbtFeliCaParams,
+                     const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt,
+                     uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout)
+{
+  uint8_t  abtCmd[PN53X_TGINITASTARGET_MAX_LEN];
+  const size_t szCmd = pn53x_TgInitAsTarget_frame(pnd, ptm, pbtMifareParams, pbtTkt, szTkt, pbtFeliCaParams, pbtNFCID3t, pbtGBt, szGBt, abtCmd);
+
+  return pn53x_TgInitAsTarget_send(pnd, abtCmd, szCmd, pbtRx, szRxLen, pbtModeByte, timeout);
+}
+
 int
 pn53x_check_ack_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen)
 {
   if (szRxFrameLen >= sizeof(pn53x_ack_frame)) {
     if (0 == memcmp(pbtRxFrame, pn53x_ack_frame, sizeof(pn53x_ack_frame))) {
+      NFC_TIMING_MARK(pnd, NFC_PHASE_ACK);
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PN53x ACKed");
       return NFC_SUCCESS;
     }
   }
+  pnd->stats.ack_errors++;
   pnd->last_error = NFC_EIO;
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unexpected PN53x reply!");
   return pnd->last_error;
 }
 
+void
+pn53x_frame_parser_init(struct pn53x_frame_parser *pfp, struct nfc_device *pnd, const bool bAckPending)
+{
+  pfp->pnd = pnd;
+  pfp->szAck = bAckPending ? PN53x_ACK_FRAME__LEN : 0;
+  pfp->szDataPos = 0;
+  pfp->szDataLen = 0;
+  pfp->szFrame = 0;
+  pfp->szSummed = 0;
+  pfp->btDCS = 0;
+}
+
+static int
+pn53x_frame_parse_error(struct pn53x_frame_parser *pfp, const char *pcError)
+{
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", pcError);
+  pfp->pnd->last_error = NFC_EIO;
+  return pfp->pnd->last_error;
+}
+
+/*
+ * Frames are, after the ACK frame if any: 00 00 FF LEN LCS TFI CC+1 ... DCS 00
+ * for normal ones, 00 00 FF FF FF LENM LENL LCS TFI CC+1 ... DCS 00 for
+ * extended ones, and 00 00 FF 01 FF 7F 81 00 for the error frame. The data
+ * checksum is computed as bytes come in.
+ */
+int
+pn53x_frame_parse(void *parser_data, const uint8_t *pbtFrame, const size_t szFrame, const size_t szNew)
+{
+  struct pn53x_frame_parser *pfp = parser_data;
+  const uint8_t *pbtHeader = pbtFrame + pfp->szAck;
+  const size_t szPrevious = szFrame - szNew;
+
+  if ((szPrevious < pfp->szAck) && (szFrame >= pfp->szAck) && (pfp->szAck > 0)) {
+    if (pn53x_check_ack_frame(pfp->pnd, pbtFrame, pfp->szAck) < 0)
+      return pfp->pnd->last_error;
+  }
+  if (szFrame > pfp->szAck)
+    NFC_TIMING_MARK(pfp->pnd, NFC_PHASE_FIRST_BYTE);
+  if (szFrame < pfp->szAck + 5)
+    return (int)(pfp->szAck + 5 - szFrame);
+
+  if (pfp->szFrame == 0) {
+    const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
+    if (0 != (memcmp(pbtHeader, pn53x_preamble, 3)))
+      return pn53x_frame_parse_error(pfp, "Frame preamble+start code mismatch");
+    if ((0x01 == pbtHeader[3]) && (0xff == pbtHeader[4])) {
+      // Error frame, left when complete
+      if (szFrame < pfp->szAck + sizeof(pn53x_error_frame))
+        return (int)(pfp->szAck + sizeof(pn53x_error_frame) - szFrame);
+      return pn53x_frame_parse_error(pfp, "Application level error detected");
+    }
+    size_t szLen;
+    if ((0xff == pbtHeader[3]) && (0xff == pbtHeader[4])) {
+      // Extended frame
+      if (szFrame < pfp->szAck + 8)
+        return (int)(pfp->szAck + 8 - szFrame);
+      if (((pbtHeader[5] + pbtHeader[6] + pbtHeader[7]) % 256) != 0)
+        return pn53x_frame_parse_error(pfp, "Length checksum mismatch");
+      szLen = (pbtHeader[5] << 8) + pbtHeader[6];
+      pfp->szSummed = pfp->szAck + 8;
+    } else {
+      // Normal frame
+      if (256 != (pbtHeader[3] + pbtHeader[4]))
+        return pn53x_frame_parse_error(pfp, "Length checksum mismatch");
+      szLen = pbtHeader[3];
+      pfp->szSummed = pfp->szAck + 5;
+    }
+    // LEN includes TFI + (CC+1)
+    if (szLen < 2)
+      return pn53x_frame_parse_error(pfp, "Frame too short");
+    pfp->szDataPos = pfp->szSummed + 2;
+    pfp->szDataLen = szLen - 2;
+    // Followed by DCS and postamble
+    pfp->szFrame = pfp->szSummed + szLen + 2;
+  }
+
+  // TFI, data and DCS sum up to 0
+  const size_t szSumEnd = MIN(szFrame, pfp->szFrame - 1);
+  for (; pfp->szSummed < szSumEnd; pfp->szSummed++)
+    pfp->btDCS += pbtFrame[pfp->szSummed];
+  if (szFrame < pfp->szFrame)
+    return (int)(pfp->szFrame - szFrame);
+
+  if (pbtFrame[pfp->szDataPos - 2] != 0xD5)
+    return pn53x_frame_parse_error(pfp, "TFI Mismatch");
+  if (pbtFrame[pfp->szDataPos - 1] != CHIP_DATA(pfp->pnd)->last_command + 1)
+    return pn53x_frame_parse_error(pfp, "Command Code verification failed");
+  if (pfp->btDCS != 0)
+    return pn53x_frame_parse_error(pfp, "Data checksum mismatch");
+  if (0x00 != pbtFrame[pfp->szFrame - 1])
+    return pn53x_frame_parse_error(pfp, "Frame postamble mismatch");
+  return 0;
+}
+
 int
 pn53x_check_error_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen)
 {
@@ -3199,15 +5822,8 @@ pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, c
     pbtFrame[4] = 256 - (szData + 1);
     // TFI
     pbtFrame[5] = 0xD4;
-    // DATA - Copy the PN53X command into the packet buffer
-    memcpy(pbtFrame + 6, pbtData, szData);
-
-    // DCS - Calculate data payload checksum
-    uint8_t btDCS = (256 - 0xD4);
-    for (size_t szPos = 0; szPos < szData; szPos++) {
-      btDCS -= pbtData[szPos];
-    }
-    pbtFrame[6 + szData] = btDCS;
+    // DATA and DCS - Copy the PN53X command into the packet buffer, summing it on the way
+    pbtFrame[6 + szData] = pn53x_copy_and_sum(pbtFrame + 6, pbtData, szData);
 
     // 0x00 - End of stream marker
     pbtFrame[szData + 7] = 0x00;
@@ -3225,15 +5841,8 @@ pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, c
     pbtFrame[7] = 256 - ((pbtFrame[5] + pbtFrame[6]) & 0xff);
     // TFI
     pbtFrame[8] = 0xD4;
-    // DATA - Copy the PN53X command into the packet buffer
-    memcpy(pbtFrame + 9, pbtData, szData);
-
-    // DCS - Calculate data payload checksum
-    uint8_t btDCS = (256 - 0xD4);
-    for (size_t szPos = 0; szPos < szData; szPos++) {
-      btDCS -= pbtData[szPos];
-    }
-    pbtFrame[9 + szData] = btDCS;
+    // DATA and DCS - Copy the PN53X command into the packet buffer, summing it on the way
+    pbtFrame[9 + szData] = pn53x_copy_and_sum(pbtFrame + 9, pbtData, szData);
 
     // 0x00 - End of stream marker
     pbtFrame[szData + 10] = 0x00;
@@ -3611,6 +6220,21 @@ pn53x_get_information_about(nfc_device *pnd, char **pbuf)
   return NFC_SUCCESS;
 }
 
+int
+pn53x_get_capabilities(nfc_device *pnd, nfc_device_capabilities *pcaps)
+{
+  unsigned int uiVersion = 0, uiRevision = 0;
+
+  // As written by pn53x_decode_firmware_version(), e.g. "PN532 v1.6"
+  if (sscanf(CHIP_DATA(pnd)->firmware_text, "%7s v%u.%u", pcaps->chip, &uiVersion, &uiRevision) < 1)
+    pcaps->chip[0] = '\0';
+  pcaps->firmware_version = uiVersion;
+  pcaps->firmware_revision = uiRevision;
+  // PN531 has no extended frames
+  pcaps->max_frame_size = (CHIP_DATA(pnd)->type == PN531) ? PN53x_NORMAL_FRAME__DATA_MAX_LEN : PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
+  return NFC_SUCCESS;
+}
+
 void *
 pn53x_current_target_new(const struct nfc_device *pnd, const nfc_target *pnt)
 {
@@ -3618,12 +6242,11 @@ pn53x_current_target_new(const struct nfc_device *pnd, const nfc_target *pnt)
     return NULL;
   }
   // Keep the current nfc_target for further commands
-  if (CHIP_DATA(pnd)->current_target) {
-    free(CHIP_DATA(pnd)->current_target);
-  }
-  CHIP_DATA(pnd)->current_target = malloc(sizeof(nfc_target));
   if (!CHIP_DATA(pnd)->current_target) {
-    return NULL;
+    CHIP_DATA(pnd)->current_target = nfc_pool_alloc(&pn53x_target_pool);
+    if (!CHIP_DATA(pnd)->current_target) {
+      return NULL;
+    }
   }
   memcpy(CHIP_DATA(pnd)->current_target, pnt, sizeof(nfc_target));
   return CHIP_DATA(pnd)->current_target;
@@ -3633,7 +6256,7 @@ void
 pn53x_current_target_free(const struct nfc_device *pnd)
 {
   if (CHIP_DATA(pnd)->current_target) {
-    free(CHIP_DATA(pnd)->current_target);
+    nfc_pool_free(CHIP_DATA(pnd)->current_target);
     CHIP_DATA(pnd)->current_target = NULL;
   }
 }
@@ -3651,10 +6274,176 @@ pn53x_current_target_is(const struct nfc_device *pnd, const nfc_target *pnt)
   return true;
 }
 
+#ifndef PN53X_WARM_ENTRIES
+#  define PN53X_WARM_ENTRIES 8
+#endif
+
+/**
+ * @internal
+ * @struct pn53x_warm_entry
+ * @brief What a cold pn53x_init() learnt about a chip, to open it again faster
+ */
+struct pn53x_warm_entry {
+  nfc_connstring key;
+  /** Bumped each time the entry is claimed for another key */
+  unsigned int uiGeneration;
+  /** Identity and settings below are filled */
+  bool bValid;
+  uint64_t ui64LastUsed;
+  pn53x_type type;
+  char firmware_text[22];
+  uint8_t btSupportByte;
+  char name[DEVICE_NAME_LENGTH];
+  /** Offsets of the registers set up by pn53x_init(), read back on warm open */
+  uint8_t abtRegisters[PN53X_CACHE_REGISTER_SIZE];
+  size_t szRegisters;
+};
+
+static pthread_mutex_t pn53x_warm_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pn53x_warm_entry pn53x_warm_entries[PN53X_WARM_ENTRIES];
+static uint64_t pn53x_warm_clock = 0;
+
+/**
+ * @brief Look for what a previous open of the chip at \a key learnt
+ * @return true if chip type, firmware and device name have been restored
+ *
+ * Drivers call it before their own identification steps to skip them on a hit,
+ * otherwise pn53x_init() uses the connstring as key. On a miss the least recently
+ * used entry is claimed, and filled once pn53x_init() succeeds.
+ */
+bool
+pn53x_warm_lookup(struct nfc_device *pnd, const char *key)
+{
+  size_t n, szOldest = 0;
+  bool bHit = false;
+
+  pthread_mutex_lock(&pn53x_warm_lock);
+  for (n = 0; n < PN53X_WARM_ENTRIES; n++) {
+    if (strcmp(pn53x_warm_entries[n].key, key) == 0)
+      break;
+    if (pn53x_warm_entries[n].ui64LastUsed < pn53x_warm_entries[szOldest].ui64LastUsed)
+      szOldest = n;
+  }
+  if (n == PN53X_WARM_ENTRIES) {
+    n = szOldest;
+    snprintf(pn53x_warm_entries[n].key, sizeof(pn53x_warm_entries[n].key), "%s", key);
+    pn53x_warm_entries[n].uiGeneration++;
+    pn53x_warm_entries[n].bValid = false;
+  }
+  struct pn53x_warm_entry *entry = &pn53x_warm_entries[n];
+  entry->ui64LastUsed = ++pn53x_warm_clock;
+  if (entry->bValid) {
+    CHIP_DATA(pnd)->type = entry->type;
+    memcpy(CHIP_DATA(pnd)->firmware_text, entry->firmware_text, sizeof(CHIP_DATA(pnd)->firmware_text));
+    pnd->btSupportByte = entry->btSupportByte;
+    memcpy(pnd->name, entry->name, sizeof(pnd->name));
+    bHit = true;
+  }
+  CHIP_DATA(pnd)->uiWarmGeneration = entry->uiGeneration;
+  pthread_mutex_unlock(&pn53x_warm_lock);
+
+  CHIP_DATA(pnd)->iWarm = (int) n;
+  CHIP_DATA(pnd)->bWarm = bHit;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Warm open cache %s for \"%s\"", bHit ? "hit" : "miss", key);
+  return bHit;
+}
+
+/**
+ * @brief Forget the warm open cache entry of the device, next open will be a cold one
+ */
+void
+pn53x_warm_forget(struct nfc_device *pnd)
+{
+  if (CHIP_DATA(pnd)->iWarm < 0)
+    return;
+  pthread_mutex_lock(&pn53x_warm_lock);
+  struct pn53x_warm_entry *entry = &pn53x_warm_entries[CHIP_DATA(pnd)->iWarm];
+  if (entry->uiGeneration == CHIP_DATA(pnd)->uiWarmGeneration)
+    entry->bValid = false;
+  pthread_mutex_unlock(&pn53x_warm_lock);
+  CHIP_DATA(pnd)->bWarm = false;
+}
+
+static void
+pn53x_warm_store(struct nfc_device *pnd)
+{
+  if (CHIP_DATA(pnd)->iWarm < 0)
+    return;
+  pthread_mutex_lock(&pn53x_warm_lock);
+  struct pn53x_warm_entry *entry = &pn53x_warm_entries[CHIP_DATA(pnd)->iWarm];
+  if (entry->uiGeneration != CHIP_DATA(pnd)->uiWarmGeneration) {
+    // Claimed for another chip in the meantime
+    pthread_mutex_unlock(&pn53x_warm_lock);
+    return;
+  }
+  entry->type = CHIP_DATA(pnd)->type;
+  memcpy(entry->firmware_text, CHIP_DATA(pnd)->firmware_text, sizeof(entry->firmware_text));
+  entry->btSupportByte = pnd->btSupportByte;
+  memcpy(entry->name, pnd->name, sizeof(entry->name));
+  // Registers read or written (maybe still pending in the writeback cache) by the initialization
+  entry->szRegisters = 0;
+  for (size_t n = 0; n < PN53X_CACHE_REGISTER_SIZE; n++) {
+    if (CHIP_DATA(pnd)->wb_known[n] || CHIP_DATA(pnd)->wb_mask[n])
+      entry->abtRegisters[entry->szRegisters++] = n;
+  }
+  entry->bValid = true;
+  pthread_mutex_unlock(&pn53x_warm_lock);
+}
+
+/*
+ * Reads back the registers of the snapshot in a single ReadRegister command, so
+ * that the following settings only write what actually differs on the chip.
+ */
+static int
+pn53x_warm_refresh(struct nfc_device *pnd)
+{
+  uint8_t abtRegisters[PN53X_CACHE_REGISTER_SIZE];
+  size_t szRegisters;
+
+  pthread_mutex_lock(&pn53x_warm_lock);
+  const struct pn53x_warm_entry *entry = &pn53x_warm_entries[CHIP_DATA(pnd)->iWarm];
+  szRegisters = (entry->uiGeneration == CHIP_DATA(pnd)->uiWarmGeneration) ? entry->szRegisters : 0;
+  memcpy(abtRegisters, entry->abtRegisters, szRegisters);
+  pthread_mutex_unlock(&pn53x_warm_lock);
+
+  if (szRegisters == 0)
+    return NFC_SUCCESS;
+
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtCmd = pn53x_scratch_get(pnd);
+  uint8_t *abtRes = pn53x_scratch_get(pnd);
+  size_t szCmd = 0;
+  int res;
+
+  if (!abtCmd || !abtRes) {
+    pn53x_scratch_release(pnd, szScratch);
+    return NFC_ESOFT;
+  }
+  abtCmd[szCmd++] = ReadRegister;
+  for (size_t n = 0; n < szRegisters; n++) {
+    const uint16_t ui16RegisterAddress = PN53X_CACHE_REGISTER_MIN_ADDRESS + abtRegisters[n];
+    abtCmd[szCmd++] = ui16RegisterAddress >> 8;
+    abtCmd[szCmd++] = ui16RegisterAddress & 0xff;
+  }
+  if ((res = pn53x_transceive(pnd, abtCmd, szCmd, abtRes, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, -1)) >= 0) {
+    // PN533 prepends its answer by a status byte
+    const size_t i = (CHIP_DATA(pnd)->type == PN533) ? 1 : 0;
+    if ((size_t) res < i + szRegisters) {
+      res = NFC_EIO;
+    } else {
+      for (size_t n = 0; n < szRegisters; n++)
+        pn53x_cache_store(pnd, PN53X_CACHE_REGISTER_MIN_ADDRESS + abtRegisters[n], abtRes[i + n]);
+      res = NFC_SUCCESS;
+    }
+  }
+  pn53x_scratch_release(pnd, szScratch);
+  return res;
+}
+
 void *
 pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
 {
-  pnd->chip_data = malloc(sizeof(struct pn53x_data));
+  pnd->chip_data = nfc_pool_alloc(&pn53x_data_pool);
   if (!pnd->chip_data) {
     return NULL;
   }
@@ -3680,9 +6469,20 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
   // Set current sam_mode to normal mode
   CHIP_DATA(pnd)->sam_mode = PSM_NORMAL;
 
+  // Nothing borrowed from the scratch arena yet
+  CHIP_DATA(pnd)->szScratchUsed = 0;
+
+  // Never armed as target
+  CHIP_DATA(pnd)->szTargetArm = 0;
+
+  // Not looked up in the warm open cache yet
+  CHIP_DATA(pnd)->iWarm = -1;
+  CHIP_DATA(pnd)->bWarm = false;
+
   // WriteBack cache is clean
   CHIP_DATA(pnd)->wb_trigged = false;
   memset(CHIP_DATA(pnd)->wb_mask, 0x00, PN53X_CACHE_REGISTER_SIZE);
+  pn53x_cache_invalidate(pnd);
 
   // Set default command timeout (350 ms)
   CHIP_DATA(pnd)->timeout_command = 350;
@@ -3693,6 +6493,10 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
   // Set default communication timeout (52 ms)
   CHIP_DATA(pnd)->timeout_communication = 52;
 
+  // MaxRetries have not been sent yet, MaxRtyCOM is left to its default until the retry policy changes
+  CHIP_DATA(pnd)->bMaxRetriesKnown = false;
+  CHIP_DATA(pnd)->uiRetryGeneration = pnd->uiRetryGeneration;
+
   CHIP_DATA(pnd)->supported_modulation_as_initiator = NULL;
 
   CHIP_DATA(pnd)->supported_modulation_as_target = NULL;
@@ -3700,18 +6504,33 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
   // Set default progressive field flag
   CHIP_DATA(pnd)->progressive_field = false;
 
+  // Nothing measured yet for adaptive timeouts, and the chip timer is unknown
+  memset(&CHIP_DATA(pnd)->adaptive, 0, sizeof(CHIP_DATA(pnd)->adaptive));
+  CHIP_DATA(pnd)->adaptive.iMargin = pnd->context ? (int) pnd->context->adaptive_timeout_margin : 0;
+  CHIP_DATA(pnd)->adaptive.btRetryTimeout = 0xff;
+
+  // Nothing measured yet for the power policy
+  memset(&CHIP_DATA(pnd)->power, 0, sizeof(CHIP_DATA(pnd)->power));
+  CHIP_DATA(pnd)->power.iIdleTimeout = pnd->context ? (int) pnd->context->power_idle_timeout : 0;
+  pthread_mutex_init(&CHIP_DATA(pnd)->power.lock, NULL);
+  pthread_cond_init(&CHIP_DATA(pnd)->power.cond, NULL);
+
   return pnd->chip_data;
 }
 
 void
 pn53x_data_free(struct nfc_device *pnd)
 {
+  pn53x_power_stop(pnd);
+  pthread_mutex_destroy(&CHIP_DATA(pnd)->power.lock);
+  pthread_cond_destroy(&CHIP_DATA(pnd)->power.cond);
+
   // Free current target
   pn53x_current_target_free(pnd);
 
   // Free supported modulation(s)
   if (CHIP_DATA(pnd)->supported_modulation_as_initiator) {
-    free(CHIP_DATA(pnd)->supported_modulation_as_initiator);
+    nfc_pool_free(CHIP_DATA(pnd)->supported_modulation_as_initiator);
   }
-  free(pnd->chip_data);
+  nfc_pool_free(pnd->chip_data);
 }
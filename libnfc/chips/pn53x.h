@@ -158,6 +158,13 @@ typedef enum {
 struct pn53x_io {
   int (*send)(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout);
   int (*receive)(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout);
+  /** Optional: file descriptor which becomes readable when an answer arrives */
+  int (*get_fd)(struct nfc_device *pnd);
+  /** Optional: count of answer bytes already received but not read yet by receive() */
+  size_t (*pending)(struct nfc_device *pnd);
+  /** Optional: like receive() but parses the frame in place, *ppbtData then points
+   *  into a driver buffer which stays valid until the next call to the driver */
+  int (*receive_view)(struct nfc_device *pnd, const uint8_t **ppbtData, int timeout);
 };
 
 /* defines */
@@ -165,6 +172,76 @@ struct pn53x_io {
 #define PN53X_CACHE_REGISTER_MAX_ADDRESS 	PN53X_REG_CIU_Coll
 #define PN53X_CACHE_REGISTER_SIZE 		((PN53X_CACHE_REGISTER_MAX_ADDRESS - PN53X_CACHE_REGISTER_MIN_ADDRESS) + 1)
 
+// A scratch buffer holds a whole frame plus a bus prefix byte (e.g. SPI DATAWRITE)
+#define PN53X_SCRATCH_LEN 			(PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD + 1)
+// Room kept in front of each scratch buffer for the headers wrapping a command on its way
+// to the bus, see pn53x_frame_tx(): the largest is ACR122 USB (CCID 10 + APDU 5 + TFI 1)
+#define PN53X_TX_HEADROOM 			16
+// Deepest nesting is a barcode selection: 3 in the selection, 2 in transceive_bits(),
+// 2 in the register writeback and 1 for the driver. Lower values fail with NFC_ESOFT.
+#ifndef PN53X_SCRATCH_FRAMES
+#  define PN53X_SCRATCH_FRAMES 		8
+#endif
+
+// D.E.P. payload sent per command, fitting normal frames of every driver
+#define PN53X_DEP_CHUNK_LEN 			(PN53x_NORMAL_FRAME__DATA_MAX_LEN - 2)
+
+// Worst case: 39-byte base, 47 bytes max. for General Bytes, 48 bytes max. for Historical Bytes
+#define PN53X_TGINITASTARGET_MAX_LEN 		(39 + 47 + 48)
+
+/**
+ * @internal
+ * @struct pn53x_power_policy
+ * @brief Keeps a PN532 awake between busy commands, see pn53x_power_keep_warm()
+ */
+struct pn53x_power_policy {
+  /** Longest time nfc_idle() leaves the chip warm, in ms (0: powers down at once) */
+  int iIdleTimeout;
+  /** Averages of the delay from nfc_idle() to the next command and of exchanges waking the chip up, in us (0: unknown) */
+  uint32_t uiGapUs;
+  uint32_t uiWakeUs;
+  /** Idle since tvIdle */
+  bool bIdle;
+  struct timeval tvIdle;
+  /** Exchange in progress wakes the chip up */
+  bool bWaking;
+  /** Commands sent, tells the timer whether the chip was used meanwhile */
+  unsigned long ulCommands;
+  /** Timer thread powering the chip down, lock protects what follows */
+  pthread_t thread;
+  bool bThread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool bStop;
+  bool bArmed;
+  bool bFieldOn;
+  struct timespec tsDeadline;
+  unsigned long ulArmedCommands;
+};
+
+#define PN53X_ADAPTIVE_KEYS 		16
+// Half-octave buckets of response times, in us, the last one from 1.5 s on
+#define PN53X_ADAPTIVE_BUCKETS 		41
+#define PN53X_ADAPTIVE_MIN_SAMPLES 	32
+#define PN53X_ADAPTIVE_WINDOW 		1024
+// Shortest host timeout set by adaptive timeouts, in ms: drivers polling the bus
+// in slices, or scheduled by the USB host, do not honour shorter waits reliably
+#define PN53X_ADAPTIVE_HOST_TIMEOUT_MIN 	50
+
+/**
+ * @internal
+ * @struct pn53x_adaptive_timing
+ * @brief Response times of one command to targets of one modulation
+ */
+struct pn53x_adaptive_timing {
+  nfc_modulation_type nmt;
+  uint8_t btCmd;
+  uint16_t aui16Histogram[PN53X_ADAPTIVE_BUCKETS];
+  uint32_t uiSamples;
+  /** Observed p99 plus the margin, in ms (0: not enough samples yet) */
+  int iTimeout;
+};
+
 /**
  * @internal
  * @struct pn53x_data
@@ -201,20 +278,77 @@ struct pn53x_data {
   uint8_t wb_data[PN53X_CACHE_REGISTER_SIZE];
   uint8_t wb_mask[PN53X_CACHE_REGISTER_SIZE];
   bool wb_trigged;
+  /** Shadow copy of cacheable registers, only valid where wb_known is set */
+  uint8_t wb_shadow[PN53X_CACHE_REGISTER_SIZE];
+  bool wb_known[PN53X_CACHE_REGISTER_SIZE];
   /** Command timeout */
   int timeout_command;
   /** ATR timeout */
   int timeout_atr;
   /** Communication timeout */
   int timeout_communication;
+  /** RFConfiguration retries already match pnd->bInfiniteSelect */
+  bool bMaxRetriesKnown;
+  /** pnd->uiRetryGeneration of the chip retries last sent */
+  unsigned int uiRetryGeneration;
   /** Supported modulation type */
   nfc_modulation_type *supported_modulation_as_initiator;
   nfc_modulation_type *supported_modulation_as_target;
   bool progressive_field;
+  /** Asynchronous exchange in flight, see pn53x_initiator_transceive_bytes_async() */
+  struct {
+    bool bPending;
+    /** Command code and target number, needed to decode the answer */
+    uint8_t abtCmd[2];
+    int timeout;
+    struct timeval tvStart;
+    struct timeval tvSent;
+    uint8_t *pbtRx;
+    size_t szRx;
+    nfc_transceive_callback callback;
+    void *user_data;
+  } async;
+  /** Answer frames land here when neither the caller nor the driver provide a buffer */
+  uint8_t abtRxFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  /** Frame buffers borrowed by nested commands instead of the stack, see pn53x_scratch_get() */
+  uint8_t abtScratch[PN53X_SCRATCH_FRAMES][PN53X_TX_HEADROOM + PN53X_SCRATCH_LEN];
+  size_t szScratchUsed;
+  /** Warm open cache entry of this device (-1 if none), see pn53x_warm_lookup() */
+  int iWarm;
+  unsigned int uiWarmGeneration;
+  /** Chip identity was restored from the warm open cache */
+  bool bWarm;
+  /** TgInitAsTarget command of the last pn53x_target_init(), kept while only target commands follow (0 if none) */
+  uint8_t abtTargetArm[PN53X_TGINITASTARGET_MAX_LEN];
+  size_t szTargetArm;
+  /** Tail of the message queued by pn53x_dep_write(), sent by pn53x_dep_read() */
+  uint8_t abtDepPending[PN53X_DEP_CHUNK_LEN];
+  size_t szDepPending;
+  /** PN532 power policy */
+  struct pn53x_power_policy power;
+  /** Adaptive timeouts, see pn53x_adaptive_prepare() */
+  struct {
+    /** Percent above the observed p99 (0: disabled) */
+    int iMargin;
+    struct pn53x_adaptive_timing timings[PN53X_ADAPTIVE_KEYS];
+    size_t szTimings;
+    /** fRetryTimeout last sent by pn53x_RFConfiguration__Various_timings() (0xff: unknown) */
+    uint8_t btRetryTimeout;
+    /** The host timeout of the exchange in progress was shortened */
+    bool bHostShortened;
+  } adaptive;
 };
 
 #define CHIP_DATA(pnd) ((struct pn53x_data*)(pnd->chip_data))
 
+// I/O functions of the driver, bound at compile time for a single driver build
+#if defined (NFC_SINGLE_PN53X_IO)
+extern const struct pn53x_io NFC_SINGLE_PN53X_IO;
+#  define PN53X_IO(pnd) (&NFC_SINGLE_PN53X_IO)
+#else
+#  define PN53X_IO(pnd) (CHIP_DATA(pnd)->io)
+#endif /* NFC_SINGLE_PN53X_IO */
+
 /**
  * @enum pn53x_modulation
  * @brief NFC modulation enumeration
@@ -304,6 +438,12 @@ extern const uint8_t pn53x_nack_frame[PN53x_ACK_FRAME__LEN];
 int    pn53x_init(struct nfc_device *pnd);
 int    pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout);
 
+size_t pn53x_scratch_mark(struct nfc_device *pnd);
+uint8_t *pn53x_scratch_get(struct nfc_device *pnd);
+void   pn53x_scratch_release(struct nfc_device *pnd, const size_t szMark);
+bool   pn53x_scratch_has_headroom(const struct nfc_device *pnd, const uint8_t *pbt);
+uint8_t *pn53x_frame_tx(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const size_t szPrefix, size_t *pszFrame);
+
 int    pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Value, const bool bEnable);
 int    pn53x_set_tx_bits(struct nfc_device *pnd, const uint8_t ui8Bits);
 int    pn53x_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame);
@@ -311,11 +451,16 @@ int    pn53x_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uin
 int    pn53x_decode_target_data(const uint8_t *pbtRawData, size_t szRawData,
                                 pn53x_type chip_type, nfc_modulation_type nmt,
                                 nfc_target_info *pnti);
+int    pn53x_decode_targets(struct nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtRawData, const size_t szRawData,
+                            nfc_target ant[], const size_t szTargets);
 int    pn53x_read_register(struct nfc_device *pnd, uint16_t ui16Reg, uint8_t *ui8Value);
 int    pn53x_write_register(struct nfc_device *pnd, uint16_t ui16Reg, uint8_t ui8SymbolMask, uint8_t ui8Value);
+void   pn53x_cache_invalidate(struct nfc_device *pnd);
+int    pn53x_set_register_profile(struct nfc_device *pnd, const nfc_modulation nm);
 int    pn53x_decode_firmware_version(struct nfc_device *pnd);
 int    pn53x_set_property_int(struct nfc_device *pnd, const nfc_property property, const int value);
 int    pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, const bool bEnable);
+int    pn53x_set_properties(struct nfc_device *pnd, const nfc_property_setting *pSettings, const size_t szSettings);
 
 int    pn53x_check_communication(struct nfc_device *pnd);
 int    pn53x_idle(struct nfc_device *pnd);
@@ -327,10 +472,17 @@ int    pn53x_initiator_select_passive_target(struct nfc_device *pnd,
                                              const nfc_modulation nm,
                                              const uint8_t *pbtInitData, const size_t szInitData,
                                              nfc_target *pnt);
+int    pn53x_initiator_list_passive_targets(struct nfc_device *pnd, const nfc_modulation nm,
+                                            nfc_target ant[], const size_t szTargets);
+int    pn53x_initiator_inventory_iso14443a(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+int    pn53x_initiator_reactivate_target(struct nfc_device *pnd, const nfc_target *pnt);
 int    pn53x_initiator_poll_target(struct nfc_device *pnd,
                                    const nfc_modulation *pnmModulations, const size_t szModulations,
                                    const uint8_t uiPollNr, const uint8_t uiPeriod,
                                    nfc_target *pnt);
+int    pn53x_initiator_discover_targets(struct nfc_device *pnd,
+                                        const nfc_modulation *pnmModulations, const size_t szModulations,
+                                        nfc_target ant[], const size_t szTargets);
 int    pn53x_initiator_select_dep_target(struct nfc_device *pnd,
                                          const nfc_dep_mode ndm, const nfc_baud_rate nbr,
                                          const nfc_dep_info *pndiInitiator,
@@ -346,13 +498,25 @@ int    pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint
                                               uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
 int    pn53x_initiator_deselect_target(struct nfc_device *pnd);
 int    pn53x_initiator_target_is_present(struct nfc_device *pnd, const nfc_target *pnt);
+int    pn53x_initiator_transceive_bytes_batch(struct nfc_device *pnd, const struct nfc_batch_frame *frames, const size_t szFrames, int timeout);
+int    pn53x_initiator_transceive_bytes_async(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx,
+                                              int timeout, nfc_transceive_callback callback, void *user_data);
+int    pn53x_get_pollable_fd(struct nfc_device *pnd);
+int    pn53x_process_events(struct nfc_device *pnd);
 
 // NFC device as Target functions
 int    pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRxLen, int timeout);
 int    pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtRxPar);
 int    pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout);
 int    pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
+int    pn53x_target_emulate_raw(struct nfc_device *pnd, const struct nfc_emulation_raw_rule *rules, const size_t szRules,
+                                uint8_t *pbtRx, const size_t szRxLen);
 int    pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
+int    pn53x_target_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+
+// D.E.P. streaming functions
+int    pn53x_dep_write(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
+int    pn53x_dep_read(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout);
 
 // Error handling functions
 const char *pn53x_strerror(const struct nfc_device *pnd);
@@ -360,7 +524,9 @@ const char *pn53x_strerror(const struct nfc_device *pnd);
 // C wrappers for PN53x commands
 int    pn53x_SetParameters(struct nfc_device *pnd, const uint8_t ui8Value);
 int    pn532_SAMConfiguration(struct nfc_device *pnd, const pn532_sam_mode mode, int timeout);
+int    pn532_SetSerialBaudRate(struct nfc_device *pnd, const uint32_t uiBaudRate);
 int    pn53x_PowerDown(struct nfc_device *pnd);
+void   pn53x_power_stop(struct nfc_device *pnd);
 int    pn53x_InListPassiveTarget(struct nfc_device *pnd, const pn53x_modulation pmInitModulation,
                                  const uint8_t szMaxTargets, const uint8_t *pbtInitiatorData,
                                  const size_t szInitiatorDataLen, uint8_t *pbtTargetsData, size_t *pszTargetsData,
@@ -394,9 +560,33 @@ int    pn53x_RFConfiguration__MaxRetries(struct nfc_device *pnd, const uint8_t M
 int    pn53x_check_ack_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen);
 int    pn53x_check_error_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen);
 int    pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, const size_t szData);
+
+/*
+ * Incremental check of a PN53x answer frame, for uart_receive_frame(): once
+ * complete, the answer (TFI and command code excluded) is szDataLen bytes
+ * long at offset szDataPos of the frame.
+ */
+struct pn53x_frame_parser {
+  struct nfc_device *pnd;
+  // Length of an ACK frame expected before the answer, 0 if none
+  size_t szAck;
+  size_t szDataPos;
+  size_t szDataLen;
+  // Private, from here
+  size_t szFrame;
+  size_t szSummed;
+  uint8_t btDCS;
+};
+void   pn53x_frame_parser_init(struct pn53x_frame_parser *pfp, struct nfc_device *pnd, const bool bAckPending);
+int    pn53x_frame_parse(void *parser_data, const uint8_t *pbtFrame, const size_t szFrame, const size_t szNew);
 int    pn53x_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt);
 int    pn53x_get_supported_baud_rate(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
 int    pn53x_get_information_about(nfc_device *pnd, char **pbuf);
+int    pn53x_get_capabilities(nfc_device *pnd, nfc_device_capabilities *pcaps);
+
+// Warm open cache
+bool    pn53x_warm_lookup(struct nfc_device *pnd, const char *key);
+void    pn53x_warm_forget(struct nfc_device *pnd);
 
 void   *pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io);
 void    pn53x_data_free(struct nfc_device *pnd);
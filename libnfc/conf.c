@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -204,6 +205,30 @@ conf_parse_file(const char *filename,
   return;
 }
 
+enum conf_device_field {
+  CONF_DEVICE_NAME,
+  CONF_DEVICE_CONNSTRING,
+  CONF_DEVICE_OPTIONAL,
+};
+
+// Device a field applies to: the last one, or a new one if it already has that field set
+static int
+conf_device_index(nfc_context *context, const enum conf_device_field field)
+{
+  const size_t szDevices = context->registry.szDevices;
+  if (szDevices) {
+    const struct nfc_user_defined_device *pudd = &context->registry.devices[szDevices - 1];
+    if (((field == CONF_DEVICE_NAME) && !pudd->name) ||
+        ((field == CONF_DEVICE_CONNSTRING) && !pudd->connstring) ||
+        ((field == CONF_DEVICE_OPTIONAL) && !pudd->optional))
+      return (int)(szDevices - 1);
+  }
+  const int res = nfc_registry_append(&context->registry);
+  if (res < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to add a user-defined device.");
+  return res;
+}
+
 static void
 conf_keyvalue_context(void *data, const char *key, const char *value)
 {
@@ -215,51 +240,156 @@ conf_keyvalue_context(void *data, const char *key, const char *value)
     string_as_boolean(value, &(context->allow_intrusive_scan));
   } else if (strcmp(key, "log_level") == 0) {
     context->log_level = atoi(value);
+  } else if (strcmp(key, "discovery_cache_ttl") == 0) {
+    context->discovery_cache_ttl = atoi(value);
+  } else if (strcmp(key, "pcsc_handle_ttl") == 0) {
+    context->pcsc_handle_ttl = atoi(value);
+  } else if (strcmp(key, "scan_concurrency") == 0) {
+    context->scan_concurrency = atoi(value);
+  } else if (strcmp(key, "power_idle_timeout") == 0) {
+    context->power_idle_timeout = atoi(value);
+  } else if (strcmp(key, "adaptive_timeout_margin") == 0) {
+    context->adaptive_timeout_margin = atoi(value);
   } else if (strcmp(key, "device.name") == 0) {
-    if ((context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].name, "") != 0) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    strncpy(context->user_defined_devices[context->user_defined_device_count - 1].name, value, DEVICE_NAME_LENGTH - 1);
-    context->user_defined_devices[context->user_defined_device_count - 1].name[DEVICE_NAME_LENGTH - 1] = '\0';
+    const int i = conf_device_index(context, CONF_DEVICE_NAME);
+    if (i >= 0)
+      nfc_registry_set(&context->registry, i, value, NULL, -1);
   } else if (strcmp(key, "device.connstring") == 0) {
-    if ((context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].connstring, "") != 0) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    strncpy(context->user_defined_devices[context->user_defined_device_count - 1].connstring, value, NFC_BUFSIZE_CONNSTRING - 1);
-    context->user_defined_devices[context->user_defined_device_count - 1].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
+    const int i = conf_device_index(context, CONF_DEVICE_CONNSTRING);
+    if (i >= 0)
+      nfc_registry_set(&context->registry, i, NULL, value, -1);
   } else if (strcmp(key, "device.optional") == 0) {
-    if ((context->user_defined_device_count == 0) || context->user_defined_devices[context->user_defined_device_count - 1].optional) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    if ((strcmp(value, "true") == 0) || (strcmp(value, "True") == 0) || (strcmp(value, "1") == 0)) //optional
-      context->user_defined_devices[context->user_defined_device_count - 1].optional = true;
+    const int i = conf_device_index(context, CONF_DEVICE_OPTIONAL);
+    if ((i >= 0) && ((strcmp(value, "true") == 0) || (strcmp(value, "True") == 0) || (strcmp(value, "1") == 0))) //optional
+      nfc_registry_set(&context->registry, i, NULL, NULL, true);
   } else {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unknown key in config line: %s = %s", key, value);
   }
 }
 
+/*
+ * Compiled configuration: what the files say, as "key\0value\0" pairs behind
+ * a header. Keys of devices.d files are stored with their "device." prefix.
+ */
+#define CONF_BLOB_MAGIC "nfcconf1"
+
+struct conf_blob {
+  uint8_t *pbt;
+  size_t sz;
+  size_t szAlloc;
+  bool bFailed;
+};
+
+static void
+conf_blob_put(struct conf_blob *pcb, const char *s)
+{
+  const size_t szLen = strlen(s) + 1;
+  if (pcb->bFailed)
+    return;
+  if (pcb->sz + szLen > pcb->szAlloc) {
+    const size_t szAlloc = MAX(pcb->szAlloc * 2, pcb->sz + szLen + 256);
+    uint8_t *pbt = realloc(pcb->pbt, szAlloc);
+    if (!pbt) {
+      pcb->bFailed = true;
+      return;
+    }
+    pcb->pbt = pbt;
+    pcb->szAlloc = szAlloc;
+  }
+  memcpy(pcb->pbt + pcb->sz, s, szLen);
+  pcb->sz += szLen;
+}
+
+static void
+conf_keyvalue_blob(void *data, const char *key, const char *value)
+{
+  conf_blob_put(data, key);
+  conf_blob_put(data, value);
+}
+
 static void
 conf_keyvalue_device(void *data, const char *key, const char *value)
 {
   char newkey[BUFSIZ];
-  sprintf(newkey, "device.%s", key);
-  conf_keyvalue_context(data, newkey, value);
+  snprintf(newkey, sizeof(newkey), "device.%s", key);
+  conf_keyvalue_blob(data, newkey, value);
 }
 
+/*
+ * Files the compiled configuration was read from, it is compiled again once
+ * any of them changed, showed up or went away.
+ */
+struct conf_stamp {
+  char *path;
+  bool bPresent;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  time_t ctime;
+};
+
+struct conf_stamps {
+  struct conf_stamp *pcs;
+  size_t szStamps;
+  size_t szAlloc;
+};
+
 static void
-conf_devices_load(const char *dirname, nfc_context *context)
+conf_stamp_take(struct conf_stamp *pcs)
+{
+  struct stat s;
+  pcs->bPresent = (stat(pcs->path, &s) == 0);
+  if (pcs->bPresent) {
+    pcs->dev = s.st_dev;
+    pcs->ino = s.st_ino;
+    pcs->size = s.st_size;
+    pcs->mtime = s.st_mtime;
+    pcs->ctime = s.st_ctime;
+  }
+}
+
+static bool
+conf_stamp_changed(const struct conf_stamp *pcs)
+{
+  struct conf_stamp now = { pcs->path, false, 0, 0, 0, 0, 0 };
+  conf_stamp_take(&now);
+  if (now.bPresent != pcs->bPresent)
+    return true;
+  return now.bPresent && ((now.dev != pcs->dev) || (now.ino != pcs->ino) || (now.size != pcs->size) ||
+                          (now.mtime != pcs->mtime) || (now.ctime != pcs->ctime));
+}
+
+static bool
+conf_stamps_add(struct conf_stamps *pcss, const char *path)
+{
+  if (pcss->szStamps == pcss->szAlloc) {
+    const size_t szAlloc = pcss->szAlloc ? pcss->szAlloc * 2 : 8;
+    struct conf_stamp *pcs = realloc(pcss->pcs, szAlloc * sizeof(*pcs));
+    if (!pcs)
+      return false;
+    pcss->pcs = pcs;
+    pcss->szAlloc = szAlloc;
+  }
+  struct conf_stamp *pcs = &pcss->pcs[pcss->szStamps];
+  if (!(pcs->path = strdup(path)))
+    return false;
+  conf_stamp_take(pcs);
+  pcss->szStamps++;
+  return true;
+}
+
+static void
+conf_stamps_clear(struct conf_stamps *pcss)
+{
+  for (size_t n = 0; n < pcss->szStamps; n++)
+    free(pcss->pcs[n].path);
+  free(pcss->pcs);
+  memset(pcss, 0, sizeof(*pcss));
+}
+
+static void
+conf_devices_load(const char *dirname, struct conf_blob *pcb, struct conf_stamps *pcss)
 {
   DIR *d = opendir(dirname);
   if (!d) {
@@ -281,7 +411,8 @@ conf_devices_load(const char *dirname, nfc_context *context)
             continue;
           }
           if (S_ISREG(s.st_mode)) {
-            conf_parse_file(filename, conf_keyvalue_device, context);
+            conf_stamps_add(pcss, filename);
+            conf_parse_file(filename, conf_keyvalue_device, pcb);
           }
         }
       }
@@ -290,11 +421,104 @@ conf_devices_load(const char *dirname, nfc_context *context)
   }
 }
 
+// Stamps are taken before reading, so that a file changed meanwhile is read again next time
+static int
+conf_compile(struct conf_blob *pcb, struct conf_stamps *pcss)
+{
+  memset(pcb, 0, sizeof(*pcb));
+  memset(pcss, 0, sizeof(*pcss));
+  conf_blob_put(pcb, CONF_BLOB_MAGIC);
+  conf_stamps_add(pcss, LIBNFC_CONFFILE);
+  conf_stamps_add(pcss, LIBNFC_DEVICECONFDIR);
+  conf_parse_file(LIBNFC_CONFFILE, conf_keyvalue_blob, pcb);
+  conf_devices_load(LIBNFC_DEVICECONFDIR, pcb, pcss);
+  if (pcb->bFailed || (pcss->szStamps < 2)) {
+    free(pcb->pbt);
+    conf_stamps_clear(pcss);
+    return NFC_ESOFT;
+  }
+  return NFC_SUCCESS;
+}
+
+// Last compiled configuration, kept for the whole process
+static pthread_mutex_t conf_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct conf_blob conf_cache;
+static struct conf_stamps conf_cache_stamps;
+
+/*
+ * Gets a copy of the compiled configuration files, only compiled again when
+ * they changed since the last call: then a few stat() are all it costs.
+ */
+int
+conf_build(uint8_t **ppbtConfig, size_t *pszConfig)
+{
+  int res = NFC_SUCCESS;
+  pthread_mutex_lock(&conf_cache_lock);
+  bool bFresh = conf_cache.pbt != NULL;
+  for (size_t n = 0; bFresh && (n < conf_cache_stamps.szStamps); n++)
+    bFresh = !conf_stamp_changed(&conf_cache_stamps.pcs[n]);
+  if (!bFresh) {
+    struct conf_blob cb;
+    struct conf_stamps css;
+    if ((res = conf_compile(&cb, &css)) == NFC_SUCCESS) {
+      free(conf_cache.pbt);
+      conf_stamps_clear(&conf_cache_stamps);
+      conf_cache = cb;
+      conf_cache_stamps = css;
+    } else if (!conf_cache.pbt) {
+      pthread_mutex_unlock(&conf_cache_lock);
+      return res;
+    }
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Configuration files unchanged, using compiled configuration");
+  }
+  if ((*ppbtConfig = malloc(conf_cache.sz))) {
+    memcpy(*ppbtConfig, conf_cache.pbt, conf_cache.sz);
+    *pszConfig = conf_cache.sz;
+    res = NFC_SUCCESS;
+  } else {
+    res = NFC_ESOFT;
+  }
+  pthread_mutex_unlock(&conf_cache_lock);
+  return res;
+}
+
+// Applies a configuration compiled by conf_build(), without any file system access
+int
+conf_apply(nfc_context *context, const uint8_t *pbtConfig, const size_t szConfig)
+{
+  const size_t szMagic = sizeof(CONF_BLOB_MAGIC);
+  if ((szConfig < szMagic) || memcmp(pbtConfig, CONF_BLOB_MAGIC, szMagic) || pbtConfig[szConfig - 1]) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid compiled configuration");
+    return NFC_EINVARG;
+  }
+  const char *key = NULL;
+  for (size_t n = szMagic; n < szConfig; n += strlen((const char *) pbtConfig + n) + 1) {
+    if (!key) {
+      key = (const char *) pbtConfig + n;
+    } else {
+      conf_keyvalue_context(context, key, (const char *) pbtConfig + n);
+      key = NULL;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
 void
 conf_load(nfc_context *context)
 {
-  conf_parse_file(LIBNFC_CONFFILE, conf_keyvalue_context, context);
-  conf_devices_load(LIBNFC_DEVICECONFDIR, context);
+  uint8_t *pbtConfig;
+  size_t szConfig;
+  if (conf_build(&pbtConfig, &szConfig) == NFC_SUCCESS) {
+    conf_apply(context, pbtConfig, szConfig);
+    free(pbtConfig);
+  }
+}
+
+void
+conf_load_file(nfc_context *context, const char *filename)
+{
+  conf_parse_file(filename, conf_keyvalue_context, context);
 }
 
 #endif // CONFFILES
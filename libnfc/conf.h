@@ -29,6 +29,9 @@
 #include <nfc/nfc-types.h>
 
 void conf_load(nfc_context *context);
+int conf_build(uint8_t **ppbtConfig, size_t *pszConfig);
+int conf_apply(nfc_context *context, const uint8_t *pbtConfig, const size_t szConfig);
+void conf_load_file(nfc_context *context, const char *filename);
 
 #endif // __NFC_CONF_H__
 
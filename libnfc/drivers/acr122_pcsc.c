@@ -105,39 +105,160 @@ const char *supported_devices[] = {
 struct acr122_pcsc_data {
   SCARDHANDLE hCard;
   SCARD_IO_REQUEST ioCard;
+  // Escape commands work on the T=0 card handle: answers come in one exchange, no GET RESPONSE
+  bool bEscape;
   uint8_t  abtRx[ACR122_PCSC_RESPONSE_LEN];
   size_t  szRx;
 };
 
+NFC_POOL(acr122_pcsc_data_pool, struct acr122_pcsc_data, NFC_POOL_DEVICES);
+
 #define DRIVER_DATA(pnd) ((struct acr122_pcsc_data*)(pnd->driver_data))
 
-static SCARDCONTEXT _SCardContext;
-static int _iSCardContextRefCount = 0;
+#define PCSC_MAX_DEVICES 16
+#define PCSC_READER_NAMES_LEN (256 + 64 * PCSC_MAX_DEVICES)
+
+// Card handle kept by nfc_close() for the next nfc_open() of the same reader
+struct acr122_pcsc_parked_handle {
+  char acReaderName[NFC_BUFSIZE_CONNSTRING];
+  SCARDHANDLE hCard;
+  SCARD_IO_REQUEST ioCard;
+  bool bEscape;
+  time_t expires_at;
+  bool bUsed;
+};
+
+/*
+ * The PC/SC context is established once and kept for the process lifetime,
+ * with the reader list and the parked handles. Refreshing the list only
+ * when the PnP pseudo-reader reports a change keeps scan and open from
+ * costing one pcscd round trip per reader on the host.
+ */
+static struct {
+  pthread_mutex_t lock;
+  SCARDCONTEXT context;
+  bool bContext;
+  char acReaderNames[PCSC_READER_NAMES_LEN];
+  DWORD dwReaderCount;
+  bool bReaderNamesValid;
+  // Cleared when SCardGetStatusChange() does not know the PnP pseudo-reader
+  bool bPnP;
+  struct acr122_pcsc_parked_handle parked[PCSC_MAX_DEVICES];
+} acr122_pcsc_cache = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .bPnP = true,
+};
 
+// Must be called with acr122_pcsc_cache.lock held
 static SCARDCONTEXT *
 acr122_pcsc_get_scardcontext(void)
 {
-  if (_iSCardContextRefCount == 0) {
-    if (SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &_SCardContext) != SCARD_S_SUCCESS)
+  if (!acr122_pcsc_cache.bContext) {
+    if (SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &acr122_pcsc_cache.context) != SCARD_S_SUCCESS)
       return NULL;
+    acr122_pcsc_cache.bContext = true;
+    acr122_pcsc_cache.bReaderNamesValid = false;
   }
-  _iSCardContextRefCount++;
+  return &acr122_pcsc_cache.context;
+}
 
-  return &_SCardContext;
+// Must be called with acr122_pcsc_cache.lock held, e.g. after pcscd restarted
+static void
+acr122_pcsc_drop_scardcontext(void)
+{
+  if (acr122_pcsc_cache.bContext) {
+    SCardReleaseContext(acr122_pcsc_cache.context);
+    acr122_pcsc_cache.bContext = false;
+  }
+  acr122_pcsc_cache.bReaderNamesValid = false;
+  for (size_t i = 0; i < PCSC_MAX_DEVICES; i++)
+    acr122_pcsc_cache.parked[i].bUsed = false;
 }
 
+// Must be called with acr122_pcsc_cache.lock held
 static void
-acr122_pcsc_free_scardcontext(void)
+acr122_pcsc_expire_handles(const time_t now)
 {
-  if (_iSCardContextRefCount) {
-    _iSCardContextRefCount--;
-    if (!_iSCardContextRefCount) {
-      SCardReleaseContext(_SCardContext);
+  for (size_t i = 0; i < PCSC_MAX_DEVICES; i++) {
+    struct acr122_pcsc_parked_handle *pph = &acr122_pcsc_cache.parked[i];
+    if (pph->bUsed && (now >= pph->expires_at)) {
+      SCardDisconnect(pph->hCard, SCARD_LEAVE_CARD);
+      pph->bUsed = false;
     }
   }
 }
 
-#define PCSC_MAX_DEVICES 16
+// Must be called with acr122_pcsc_cache.lock held, returns the multi-string list of reader names
+static const char *
+acr122_pcsc_list_readers(SCARDCONTEXT *pscc)
+{
+  if (acr122_pcsc_cache.bReaderNamesValid) {
+    SCARD_READERSTATE rs;
+    memset(&rs, 0, sizeof(rs));
+    rs.szReader = "\\\\?PnP?\\Notification";
+    rs.dwCurrentState = acr122_pcsc_cache.dwReaderCount << 16;
+    const LONG res = SCardGetStatusChange(*pscc, 0, &rs, 1);
+    if ((res == SCARD_S_SUCCESS) && (rs.dwEventState & SCARD_STATE_UNKNOWN))
+      acr122_pcsc_cache.bPnP = false;
+    if (res == SCARD_E_TIMEOUT)
+      return acr122_pcsc_cache.acReaderNames;
+    if ((res != SCARD_S_SUCCESS) && (res != SCARD_E_UNKNOWN_READER)) {
+      // Stale context: pcscd went away, try again with a new one
+      acr122_pcsc_drop_scardcontext();
+      if ((pscc = acr122_pcsc_get_scardcontext()) == NULL)
+        return NULL;
+    }
+    acr122_pcsc_cache.bReaderNamesValid = false;
+  }
+
+  memset(acr122_pcsc_cache.acReaderNames, '\0', sizeof(acr122_pcsc_cache.acReaderNames));
+  DWORD dwReaderNamesLen = sizeof(acr122_pcsc_cache.acReaderNames);
+  if (SCardListReaders(*pscc, NULL, acr122_pcsc_cache.acReaderNames, &dwReaderNamesLen) != SCARD_S_SUCCESS)
+    return NULL;
+  acr122_pcsc_cache.dwReaderCount = 0;
+  for (size_t szPos = 0; acr122_pcsc_cache.acReaderNames[szPos] != '\0'; szPos += strlen(acr122_pcsc_cache.acReaderNames + szPos) + 1)
+    acr122_pcsc_cache.dwReaderCount++;
+  acr122_pcsc_cache.bReaderNamesValid = acr122_pcsc_cache.bPnP;
+  return acr122_pcsc_cache.acReaderNames;
+}
+
+// Escape commands when there is no card handle to transmit to, or when they were found to work at open
+static bool
+acr122_pcsc_use_escape(const nfc_device *pnd)
+{
+  return (DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_UNDEFINED) || DRIVER_DATA(pnd)->bEscape;
+}
+
+static LONG
+acr122_pcsc_exchange(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, DWORD *pdwRxLen)
+{
+  if (acr122_pcsc_use_escape(pnd))
+    return SCardControl(DRIVER_DATA(pnd)->hCard, IOCTL_CCID_ESCAPE_SCARD_CTL_CODE, pbtTx, szTx, pbtRx, *pdwRxLen, pdwRxLen);
+  return SCardTransmit(DRIVER_DATA(pnd)->hCard, &(DRIVER_DATA(pnd)->ioCard), pbtTx, szTx, NULL, pbtRx, pdwRxLen);
+}
+
+/*
+ * In T=0 mode, each command costs a second SCardTransmit() to GET RESPONSE.
+ * Readers whose CCID driver allows escape commands answer them directly on
+ * the same handle: check once with the firmware version command.
+ */
+static void
+acr122_pcsc_probe_escape(nfc_device *pnd)
+{
+  const uint8_t abtGetFw[5] = { 0xFF, 0x00, 0x48, 0x00, 0x00 };
+  uint8_t abtFw[11];
+  DWORD dwFwLen = sizeof(abtFw) - 1;
+
+  DRIVER_DATA(pnd)->bEscape = false;
+  if (DRIVER_DATA(pnd)->ioCard.dwProtocol != SCARD_PROTOCOL_T0)
+    return;
+  if (SCardControl(DRIVER_DATA(pnd)->hCard, IOCTL_CCID_ESCAPE_SCARD_CTL_CODE, abtGetFw, sizeof(abtGetFw), abtFw, dwFwLen, &dwFwLen) != SCARD_S_SUCCESS)
+    return;
+  abtFw[dwFwLen] = '\0';
+  DRIVER_DATA(pnd)->bEscape = (strstr((char *) abtFw, FIRMWARE_TEXT) != NULL);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Escape commands %s on T=0 handle", DRIVER_DATA(pnd)->bEscape ? "supported" : "not supported");
+}
+
 /**
  * @brief List opened devices
  *
@@ -152,23 +273,23 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
 {
   (void) context;
   size_t  szPos = 0;
-  char    acDeviceNames[256 + 64 * PCSC_MAX_DEVICES];
-  size_t  szDeviceNamesLen = sizeof(acDeviceNames);
+  const char *acDeviceNames;
   SCARDCONTEXT *pscc;
   int     i;
 
-  // Clear the reader list
-  memset(acDeviceNames, '\0', szDeviceNamesLen);
-
+  pthread_mutex_lock(&acr122_pcsc_cache.lock);
+  acr122_pcsc_expire_handles(time(NULL));
   // Test if context succeeded
   if (!(pscc = acr122_pcsc_get_scardcontext())) {
+    pthread_mutex_unlock(&acr122_pcsc_cache.lock);
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: %s", "PCSC context not found (make sure PCSC daemon is running).");
     return 0;
   }
   // Retrieve the string array of all available pcsc readers
-  DWORD dwDeviceNamesLen = szDeviceNamesLen;
-  if (SCardListReaders(*pscc, NULL, acDeviceNames, &dwDeviceNamesLen) != SCARD_S_SUCCESS)
+  if ((acDeviceNames = acr122_pcsc_list_readers(pscc)) == NULL) {
+    pthread_mutex_unlock(&acr122_pcsc_cache.lock);
     return 0;
+  }
 
   size_t device_found = 0;
   while ((acDeviceNames[szPos] != '\0') && (device_found < connstrings_len)) {
@@ -189,11 +310,97 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
     // Find next device name position
     while (acDeviceNames[szPos++] != '\0');
   }
-  acr122_pcsc_free_scardcontext();
+  pthread_mutex_unlock(&acr122_pcsc_cache.lock);
 
   return device_found;
 }
 
+static int
+acr122_pcsc_connect(nfc_device *pnd, const char *pcReaderName)
+{
+  SCARDCONTEXT *pscc;
+  int res = NFC_SUCCESS;
+
+  pthread_mutex_lock(&acr122_pcsc_cache.lock);
+  // Test if context succeeded
+  if (!(pscc = acr122_pcsc_get_scardcontext())) {
+    pthread_mutex_unlock(&acr122_pcsc_cache.lock);
+    return NFC_EIO;
+  }
+  // Test if we were able to connect to the "emulator" card
+  if (SCardConnect(*pscc, pcReaderName, SCARD_SHARE_EXCLUSIVE, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
+    // Connect to ACR122 firmware version >2.0
+    if (SCardConnect(*pscc, pcReaderName, SCARD_SHARE_DIRECT, 0, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
+      // We can not connect to this device.
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PCSC connect failed");
+      res = NFC_EIO;
+    }
+  }
+  pthread_mutex_unlock(&acr122_pcsc_cache.lock);
+  if (res < 0)
+    return res;
+  // Configure I/O settings for card communication
+  DRIVER_DATA(pnd)->ioCard.cbPciLength = sizeof(SCARD_IO_REQUEST);
+  acr122_pcsc_probe_escape(pnd);
+  return NFC_SUCCESS;
+}
+
+// Takes back the handle kept by nfc_close() for this reader, if any
+static bool
+acr122_pcsc_unpark(const char *pcReaderName, struct acr122_pcsc_data *data)
+{
+  bool bFound = false;
+
+  pthread_mutex_lock(&acr122_pcsc_cache.lock);
+  acr122_pcsc_expire_handles(time(NULL));
+  for (size_t i = 0; (i < PCSC_MAX_DEVICES) && !bFound; i++) {
+    struct acr122_pcsc_parked_handle *pph = &acr122_pcsc_cache.parked[i];
+    if (pph->bUsed && (strcmp(pph->acReaderName, pcReaderName) == 0)) {
+      data->hCard = pph->hCard;
+      data->ioCard = pph->ioCard;
+      data->bEscape = pph->bEscape;
+      pph->bUsed = false;
+      bFound = true;
+    }
+  }
+  pthread_mutex_unlock(&acr122_pcsc_cache.lock);
+  return bFound;
+}
+
+// Keeps the handle for pcsc_handle_ttl seconds, returns false if it must be disconnected
+static bool
+acr122_pcsc_park(nfc_device *pnd)
+{
+  const unsigned int ttl = pnd->context->pcsc_handle_ttl;
+  char *pcReaderName;
+  bool bParked = false;
+
+  if (ttl == 0)
+    return false;
+  if (connstring_decode(pnd->connstring, ACR122_PCSC_DRIVER_NAME, "pcsc", &pcReaderName, NULL) < 2) {
+    nfc_pool_free(pcReaderName);
+    return false;
+  }
+  pthread_mutex_lock(&acr122_pcsc_cache.lock);
+  const time_t now = time(NULL);
+  acr122_pcsc_expire_handles(now);
+  for (size_t i = 0; (i < PCSC_MAX_DEVICES) && !bParked; i++) {
+    struct acr122_pcsc_parked_handle *pph = &acr122_pcsc_cache.parked[i];
+    if (pph->bUsed || !acr122_pcsc_cache.bContext)
+      continue;
+    snprintf(pph->acReaderName, sizeof(pph->acReaderName), "%s", pcReaderName);
+    pph->hCard = DRIVER_DATA(pnd)->hCard;
+    pph->ioCard = DRIVER_DATA(pnd)->ioCard;
+    pph->bEscape = DRIVER_DATA(pnd)->bEscape;
+    pph->expires_at = now + ttl;
+    pph->bUsed = true;
+    bParked = true;
+  }
+  pthread_mutex_unlock(&acr122_pcsc_cache.lock);
+  nfc_pool_free(pcReaderName);
+  return bParked;
+}
+
 struct acr122_pcsc_descriptor {
   char *pcsc_device_name;
 };
@@ -225,28 +432,29 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     // Device was not specified, only ID, retrieve it
     size_t index;
     if (sscanf(ndd.pcsc_device_name, "%4" SCNuPTR, &index) != 1) {
-      free(ndd.pcsc_device_name);
+      nfc_pool_free(ndd.pcsc_device_name);
       return NULL;
     }
     nfc_connstring *ncs = malloc(sizeof(nfc_connstring) * (index + 1));
     if (!ncs) {
       perror("malloc");
-      free(ndd.pcsc_device_name);
+      nfc_pool_free(ndd.pcsc_device_name);
       return NULL;
     }
     size_t szDeviceFound = acr122_pcsc_scan(context, ncs, index + 1);
     if (szDeviceFound < index + 1) {
       free(ncs);
-      free(ndd.pcsc_device_name);
+      nfc_pool_free(ndd.pcsc_device_name);
       return NULL;
     }
     strncpy(fullconnstring, ncs[index], sizeof(nfc_connstring));
     fullconnstring[sizeof(nfc_connstring) - 1] = '\0';
     free(ncs);
+    nfc_pool_free(ndd.pcsc_device_name);
     connstring_decode_level = connstring_decode(fullconnstring, ACR122_PCSC_DRIVER_NAME, "pcsc", &ndd.pcsc_device_name, NULL);
 
     if (connstring_decode_level < 2) {
-      free(ndd.pcsc_device_name);
+      nfc_pool_free(ndd.pcsc_device_name);
       return NULL;
     }
   }
@@ -257,7 +465,7 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     perror("malloc");
     goto error;
   }
-  pnd->driver_data = malloc(sizeof(struct acr122_pcsc_data));
+  pnd->driver_data = nfc_pool_alloc(&acr122_pcsc_data_pool);
   if (!pnd->driver_data) {
     perror("malloc");
     goto error;
@@ -269,26 +477,20 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     goto error;
   }
 
-  SCARDCONTEXT *pscc;
-
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Attempt to open %s", ndd.pcsc_device_name);
-  // Test if context succeeded
-  if (!(pscc = acr122_pcsc_get_scardcontext()))
+  const bool bParked = acr122_pcsc_unpark(ndd.pcsc_device_name, DRIVER_DATA(pnd));
+  if (!bParked && (acr122_pcsc_connect(pnd, ndd.pcsc_device_name) < 0))
     goto error;
-  // Test if we were able to connect to the "emulator" card
-  if (SCardConnect(*pscc, ndd.pcsc_device_name, SCARD_SHARE_EXCLUSIVE, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
-    // Connect to ACR122 firmware version >2.0
-    if (SCardConnect(*pscc, ndd.pcsc_device_name, SCARD_SHARE_DIRECT, 0, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
-      // We can not connect to this device.
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PCSC connect failed");
-      goto error;
-    }
-  }
-  // Configure I/O settings for card communication
-  DRIVER_DATA(pnd)->ioCard.cbPciLength = sizeof(SCARD_IO_REQUEST);
 
   // Retrieve the current firmware version
   pcFirmware = acr122_pcsc_firmware(pnd);
+  if (bParked && (strstr(pcFirmware, FIRMWARE_TEXT) == NULL)) {
+    // Reader reset or replugged since it was closed
+    SCardDisconnect(DRIVER_DATA(pnd)->hCard, SCARD_LEAVE_CARD);
+    if (acr122_pcsc_connect(pnd, ndd.pcsc_device_name) < 0)
+      goto error;
+    pcFirmware = acr122_pcsc_firmware(pnd);
+  }
   if (strstr(pcFirmware, FIRMWARE_TEXT) != NULL) {
 
     // Done, we found the reader we are looking for
@@ -302,12 +504,12 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
 
     pn53x_init(pnd);
 
-    free(ndd.pcsc_device_name);
+    nfc_pool_free(ndd.pcsc_device_name);
     return pnd;
   }
 
 error:
-  free(ndd.pcsc_device_name);
+  nfc_pool_free(ndd.pcsc_device_name);
   nfc_device_free(pnd);
   return NULL;
 }
@@ -317,8 +519,8 @@ acr122_pcsc_close(nfc_device *pnd)
 {
   pn53x_idle(pnd);
 
-  SCardDisconnect(DRIVER_DATA(pnd)->hCard, SCARD_LEAVE_CARD);
-  acr122_pcsc_free_scardcontext();
+  if (!acr122_pcsc_park(pnd))
+    SCardDisconnect(DRIVER_DATA(pnd)->hCard, SCARD_LEAVE_CARD);
 
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
@@ -346,34 +548,23 @@ acr122_pcsc_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, i
 
   DWORD dwRxLen = sizeof(DRIVER_DATA(pnd)->abtRx);
 
-  if (DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_UNDEFINED) {
-    /*
-     * In this communication mode, we directly have the response from the
-     * PN532.  Save it in the driver data structure so that it can be retrieved
-     * in ac122_receive().
-     *
-     * Some devices will never enter this state (e.g. Touchatag) but are still
-     * supported through SCardTransmit calls (see bellow).
-     *
-     * This state is generaly reached when the ACR122 has no target in it's
-     * field.
-     */
-    if (SCardControl(DRIVER_DATA(pnd)->hCard, IOCTL_CCID_ESCAPE_SCARD_CTL_CODE, abtTxBuf, szTxBuf, DRIVER_DATA(pnd)->abtRx, ACR122_PCSC_RESPONSE_LEN, &dwRxLen) != SCARD_S_SUCCESS) {
-      pnd->last_error = NFC_EIO;
-      return pnd->last_error;
-    }
-  } else {
-    /*
-     * In T=0 mode, we receive an acknoledge from the MCU, in T=1 mode, we
-     * receive the response from the PN532.
-     */
-    if (SCardTransmit(DRIVER_DATA(pnd)->hCard, &(DRIVER_DATA(pnd)->ioCard), abtTxBuf, szTxBuf, NULL, DRIVER_DATA(pnd)->abtRx, &dwRxLen) != SCARD_S_SUCCESS) {
-      pnd->last_error = NFC_EIO;
-      return pnd->last_error;
-    }
+  /*
+   * Through escape commands, we directly have the response from the PN532.
+   * Save it in the driver data structure so that it can be retrieved in
+   * ac122_receive().
+   *
+   * Escape commands are always used when there is no card handle, generaly
+   * when the ACR122 has no target in it's field. Some devices will never
+   * enter this state (e.g. Touchatag) but are still supported through
+   * SCardTransmit calls: in T=0 mode, we receive an acknoledge from the MCU,
+   * in T=1 mode, we receive the response from the PN532.
+   */
+  if (acr122_pcsc_exchange(pnd, abtTxBuf, szTxBuf, DRIVER_DATA(pnd)->abtRx, &dwRxLen) != SCARD_S_SUCCESS) {
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
   }
 
-  if (DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_T0) {
+  if ((DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_T0) && !DRIVER_DATA(pnd)->bEscape) {
     /*
      * Check the MCU response
      */
@@ -402,7 +593,7 @@ acr122_pcsc_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szData, int
   (void) timeout;
   int len;
 
-  if (DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_T0) {
+  if ((DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_T0) && !DRIVER_DATA(pnd)->bEscape) {
     /*
      * Retrieve the PN532 response.
      */
@@ -442,11 +633,8 @@ acr122_pcsc_firmware(nfc_device *pnd)
   static char abtFw[11];
   DWORD dwFwLen = sizeof(abtFw);
   memset(abtFw, 0x00, sizeof(abtFw));
-  if (DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_UNDEFINED) {
-    uiResult = SCardControl(DRIVER_DATA(pnd)->hCard, IOCTL_CCID_ESCAPE_SCARD_CTL_CODE, abtGetFw, sizeof(abtGetFw), (uint8_t *) abtFw, dwFwLen - 1, &dwFwLen);
-  } else {
-    uiResult = SCardTransmit(DRIVER_DATA(pnd)->hCard, &(DRIVER_DATA(pnd)->ioCard), abtGetFw, sizeof(abtGetFw), NULL, (uint8_t *) abtFw, &dwFwLen);
-  }
+  dwFwLen--;
+  uiResult = acr122_pcsc_exchange(pnd, abtGetFw, sizeof(abtGetFw), (uint8_t *) abtFw, &dwFwLen);
 
   if (uiResult != SCARD_S_SUCCESS) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "No ACR122 firmware received, Error: %08x", uiResult);
@@ -487,6 +675,10 @@ const struct nfc_driver acr122_pcsc_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -494,22 +686,33 @@ const struct nfc_driver acr122_pcsc_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
 
   .abort_command  = NULL,  // Abort is not supported in this driver
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
 
@@ -182,6 +182,8 @@ struct acr122_usb_data {
   struct acr122_usb_apdu_frame apdu_frame;
 };
 
+NFC_POOL(acr122_usb_data_pool, struct acr122_usb_data, NFC_POOL_DEVICES);
+
 // CCID Bulk-Out messages type
 #define PC_to_RDR_IccPowerOn	0x62
 #define PC_to_RDR_XfrBlock	0x6f
@@ -323,14 +325,16 @@ acr122_usb_scan(const nfc_context *context, nfc_connstring connstrings[], const
             continue;
           }
 
-          usb_dev_handle *udev = usb_open(dev);
-          if (udev == NULL)
-            continue;
+          // Devices a previous scan could use are not opened again, names are read by nfc_device_get_name()
+          if (!usb_scan_cache_find(ACR122_USB_DRIVER_NAME, dev)) {
+            usb_dev_handle *udev = usb_open(dev);
+            if (udev == NULL)
+              continue;
+            usb_close(udev);
+            usb_scan_cache_add(ACR122_USB_DRIVER_NAME, dev);
+          }
 
-          // Set configuration
-          // acr122_usb_get_usb_device_name (dev, udev, pnddDevices[device_found].acDevice, sizeof (pnddDevices[device_found].acDevice));
           log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s Name %s", bus->dirname, dev->filename, acr122_usb_supported_devices[n].name);
-          usb_close(udev);
           snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", ACR122_USB_DRIVER_NAME, bus->dirname, dev->filename);
           device_found++;
           // Test if we reach the maximum "wanted" devices
@@ -378,6 +382,18 @@ acr122_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, cha
   return false;
 }
 
+static void
+acr122_usb_get_name(nfc_device *pnd)
+{
+  struct usb_device *dev = usb_device(DRIVER_DATA(pnd)->pudh);
+
+  if (usb_scan_cache_get_name(ACR122_USB_DRIVER_NAME, dev, pnd->name, sizeof(pnd->name)))
+    return;
+  acr122_usb_get_usb_device_name(dev, DRIVER_DATA(pnd)->pudh, pnd->name, sizeof(pnd->name));
+  usb_scan_cache_add(ACR122_USB_DRIVER_NAME, dev);
+  usb_scan_cache_set_name(ACR122_USB_DRIVER_NAME, dev, pnd->name);
+}
+
 static nfc_device *
 acr122_usb_open(const nfc_context *context, const nfc_connstring connstring)
 {
@@ -441,9 +457,9 @@ acr122_usb_open(const nfc_context *context, const nfc_connstring connstring)
         perror("malloc");
         goto error;
       }
-      acr122_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
+      // String descriptors are read by nfc_device_get_name(), when needed
 
-      pnd->driver_data = malloc(sizeof(struct acr122_usb_data));
+      pnd->driver_data = nfc_pool_alloc(&acr122_usb_data_pool);
       if (!pnd->driver_data) {
         perror("malloc");
         goto error;
@@ -477,8 +493,8 @@ error:
   nfc_device_free(pnd);
   pnd = NULL;
 free_mem:
-  free(desc.dirname);
-  free(desc.filename);
+  nfc_pool_free(desc.dirname);
+  nfc_pool_free(desc.filename);
   return pnd;
 }
 
@@ -551,23 +567,36 @@ acr122_build_frame_from_tama(nfc_device *pnd, const uint8_t *tama, const size_t
 
   DRIVER_DATA(pnd)->tama_frame.ccid_header.dwLength = htole32(tama_len + sizeof(struct apdu_header) + 1);
   DRIVER_DATA(pnd)->tama_frame.apdu_header.bLen = tama_len + 1;
-  memcpy(DRIVER_DATA(pnd)->tama_frame.tama_payload, tama, tama_len);
+  // The payload is left to the caller when tama is NULL, see acr122_usb_send()
+  if (tama)
+    memcpy(DRIVER_DATA(pnd)->tama_frame.tama_payload, tama, tama_len);
   return (sizeof(struct ccid_header) + sizeof(struct apdu_header) + 1 + tama_len);
 }
 
 static int
 acr122_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
 {
+  const size_t szHeader = sizeof(struct ccid_header) + sizeof(struct apdu_header) + 1;
+  unsigned char *pbtFrame = (unsigned char *) & (DRIVER_DATA(pnd)->tama_frame);
   int res;
-  if ((res = acr122_build_frame_from_tama(pnd, pbtData, szData)) < 0) {
+  if ((res = acr122_build_frame_from_tama(pnd, NULL, szData)) < 0) {
     pnd->last_error = NFC_EINVARG;
     return pnd->last_error;
   }
+  if (pn53x_scratch_has_headroom(pnd, pbtData)) {
+    // Only the headers move, in front of the command where it was built
+    pbtFrame = (uint8_t *) pbtData - szHeader;
+    memcpy(pbtFrame, &(DRIVER_DATA(pnd)->tama_frame), szHeader);
+  } else {
+    memcpy(DRIVER_DATA(pnd)->tama_frame.tama_payload, pbtData, szData);
+  }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_BUILD);
 
-  if ((res = acr122_usb_bulk_write(DRIVER_DATA(pnd), (unsigned char *) & (DRIVER_DATA(pnd)->tama_frame), res, timeout)) < 0) {
+  if ((res = acr122_usb_bulk_write(DRIVER_DATA(pnd), pbtFrame, res, timeout)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
   return NFC_SUCCESS;
 }
 
@@ -591,13 +620,14 @@ read:
     usb_timeout = USB_TIMEOUT_PER_PASS;
   } else {
     // A user-provided timeout is set, we have to cut it in multiple chunk to be able to keep an nfc_abort_command() mecanism
-    remaining_time -= USB_TIMEOUT_PER_PASS;
     if (remaining_time <= 0) {
+      // Cancel the command, so that its late answer is not read by the next one
+      acr122_usb_ack(pnd);
       pnd->last_error = NFC_ETIMEOUT;
       return pnd->last_error;
-    } else {
-      usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
     }
+    usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
+    remaining_time -= usb_timeout;
   }
 
   res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), usb_timeout);
@@ -622,6 +652,7 @@ read:
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_FIRST_BYTE);
   if (abtRxBuf[offset] != attempted_response) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame header mismatch");
     pnd->last_error = NFC_EIO;
@@ -834,6 +865,10 @@ const struct nfc_driver acr122_usb_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -841,21 +876,33 @@ const struct nfc_driver acr122_usb_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
+  .device_get_name = acr122_usb_get_name,
 
   .abort_command  = acr122_usb_abort_command,
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
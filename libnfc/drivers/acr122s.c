@@ -60,13 +60,10 @@
 struct acr122s_data {
   serial_port port;
   uint8_t seq;
-#ifndef WIN32
-  int abort_fds[2];
-#else
-  volatile bool abort_flag;
-#endif
 };
 
+NFC_POOL(acr122s_data_pool, struct acr122s_data, NFC_POOL_DEVICES);
+
 const struct pn53x_io acr122s_io;
 
 #define STX 2
@@ -199,18 +196,11 @@ acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
   uint8_t positive_ack[4] = { STX, 0, 0, ETX };
   serial_port port = DRIVER_DATA(pnd)->port;
   int ret;
-  void *abort_p;
-
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->abort_fds[1]);
-#else
-  abort_p = &(DRIVER_DATA(pnd)->abort_flag);
-#endif
 
   if ((ret = uart_send(port, frame, frame_size, timeout)) < 0)
     return ret;
 
-  if ((ret = uart_receive(port, ack, 4, abort_p, timeout)) < 0)
+  if ((ret = uart_receive(port, ack, 4, true, timeout)) < 0)
     return ret;
 
   if (memcmp(ack, positive_ack, 4) != 0) {
@@ -224,20 +214,65 @@ acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
   return 0;
 }
 
+struct acr122s_frame_parser {
+  size_t szFrame;
+  size_t szSummed;
+  uint8_t btChecksum;
+};
+
+/*
+ * Frames are STX, a 10 bytes header giving the payload length, the payload,
+ * the XOR of all bytes since STX, and ETX. The checksum is computed as bytes
+ * come in, see uart_receive_frame().
+ */
+static int
+acr122s_frame_parse(void *parser_data, const uint8_t *frame, const size_t received, const size_t added)
+{
+  struct acr122s_frame_parser *parser = parser_data;
+
+  (void) added;
+  if (received < 11)
+    return (int)(11 - received);
+  if (parser->szFrame == 0) {
+    if (frame[0] != STX) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid frame start.");
+      return NFC_EIO;
+    }
+    if (APDU_SIZE(frame) > MAX_FRAME_SIZE - FRAME_OVERHEAD) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame too long.");
+      return NFC_EIO;
+    }
+    parser->szFrame = FRAME_SIZE(frame);
+    parser->szSummed = 1;
+  }
+
+  const size_t sum_end = MIN(received, parser->szFrame - 2);
+  for (; parser->szSummed < sum_end; parser->szSummed++)
+    parser->btChecksum ^= frame[parser->szSummed];
+  if (received < parser->szFrame)
+    return (int)(parser->szFrame - received);
+
+  if ((frame[parser->szFrame - 2] != parser->btChecksum) || (frame[parser->szFrame - 1] != ETX)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid frame checksum.");
+    return NFC_EIO;
+  }
+  return 0;
+}
+
 /**
  * Receive response frame after a successfull acr122s_send_command().
  *
  * @param: pnd is target nfc device
  * @param: frame is buffer where received response frame will be stored
  * @param: frame_size is frame size
- * @param: abort_p
+ * @param: bAbortable
  * @param: timeout
  * @note returned frame size can be fetched using FRAME_SIZE macro
  *
  * @return 0 if success
  */
 static int
-acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abort_p, int timeout)
+acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, const bool bAbortable, int timeout)
 {
   if (frame_size < 13) {
     pnd->last_error = NFC_EINVARG;
@@ -245,20 +280,14 @@ acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abo
   }
   int ret;
   serial_port port = DRIVER_DATA(pnd)->port;
+  struct acr122s_frame_parser parser = { 0, 0, 0 };
 
-  if ((ret = uart_receive(port, frame, 11, abort_p, timeout)) != 0)
-    return ret;
-
-  // Is buffer sufficient to store response?
-  if (frame_size < FRAME_SIZE(frame)) {
-    pnd->last_error = NFC_EIO;
+  if ((ret = uart_receive_frame(port, frame, frame_size, acr122s_frame_parse, &parser, bAbortable, timeout)) < 0) {
+    // NFC_EOVFLOW: buffer too small to store the response
+    pnd->last_error = (ret == NFC_EOVFLOW) ? NFC_EIO : ret;
     return pnd->last_error;
   }
 
-  size_t remaining = FRAME_SIZE(frame) - 11;
-  if ((ret = uart_receive(port, frame + 11, remaining, abort_p, timeout)) != 0)
-    return ret;
-
   struct xfr_block_res *res = (struct xfr_block_res *) &frame[1];
   if ((uint8_t)(res->seq + 1) != DRIVER_DATA(pnd)->seq) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid response sequence number.");
@@ -351,7 +380,7 @@ acr122s_activate_sam(nfc_device *pnd)
   if ((ret = acr122s_send_frame(pnd, cmd, 0)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, false, 0)) != 0)
     return ret;
 
   CHIP_DATA(pnd)->power_mode = NORMAL;
@@ -373,7 +402,7 @@ acr122s_deactivate_sam(nfc_device *pnd)
   if ((ret = acr122s_send_frame(pnd, cmd, 0)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, false, 0)) != 0)
     return ret;
 
   CHIP_DATA(pnd)->power_mode = LOWVBAT;
@@ -394,7 +423,7 @@ acr122s_get_firmware_version(nfc_device *pnd, char *version, size_t length)
   if ((ret = acr122s_send_frame(pnd, cmd, 1000)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, cmd, sizeof(cmd), 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, cmd, sizeof(cmd), false, 0)) != 0)
     return ret;
 
   size_t len = APDU_SIZE(cmd);
@@ -411,111 +440,63 @@ struct acr122s_descriptor {
   uint32_t speed;
 };
 
-static size_t
-acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static bool
+acr122s_scan_port(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
-
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ACR122S device on serial port: %s at %d baud.", acPort, ACR122S_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp, true);
-      uart_set_speed(sp, ACR122S_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ACR122S_DRIVER_NAME, acPort, ACR122S_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-
-      pnd->driver = &acr122s_driver;
-      pnd->driver_data = malloc(sizeof(struct acr122s_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-      DRIVER_DATA(pnd)->seq = 0;
-
-#ifndef WIN32
-      if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-#else
-      DRIVER_DATA(pnd)->abort_flag = false;
-#endif
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ACR122S device on serial port: %s at %d baud.", acPort, ACR122S_DEFAULT_SPEED);
 
-      if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      CHIP_DATA(pnd)->type = PN532;
-      CHIP_DATA(pnd)->power_mode = NORMAL;
-
-      char version[32];
-      int ret = acr122s_get_firmware_version(pnd, version, sizeof(version));
-      if (ret == 0 && strncmp("ACR122S", version, 7) != 0) {
-        ret = -1;
-      }
-
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-
-      if (ret != 0)
-        continue;
-
-      // ACR122S reader is found
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return false;
+
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp, true);
+  uart_set_speed(sp, ACR122S_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ACR122S_DRIVER_NAME, acPort, ACR122S_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return false;
   }
-  iDevice = 0;
-  while ((acPort = acPorts[iDevice++])) {
-    free((void *)acPort);
+
+  pnd->driver = &acr122s_driver;
+  pnd->driver_data = nfc_pool_alloc(&acr122s_data_pool);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return false;
   }
-  free(acPorts);
-  return device_found;
+  DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->seq = 0;
+
+  int ret = -1;
+  if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
+    perror("malloc");
+  } else {
+    CHIP_DATA(pnd)->type = PN532;
+    CHIP_DATA(pnd)->power_mode = NORMAL;
+
+    char version[32];
+    ret = acr122s_get_firmware_version(pnd, version, sizeof(version));
+    if (ret == 0 && strncmp("ACR122S", version, 7) != 0) {
+      ret = -1;
+    }
+    pn53x_data_free(pnd);
+  }
+
+  uart_close(DRIVER_DATA(pnd)->port);
+  nfc_device_free(pnd);
+  // ACR122S reader is found if it told its firmware version
+  return ret == 0;
+}
+
+static size_t
+acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  return nfc_probe_ports(context, uart_list_ports(), acr122s_scan_port, connstrings, connstrings_len);
 }
 
 static void
@@ -526,12 +507,6 @@ acr122s_close(nfc_device *pnd)
 
   uart_close(DRIVER_DATA(pnd)->port);
 
-#ifndef WIN32
-  // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->abort_fds[0]);
-  close(DRIVER_DATA(pnd)->abort_fds[1]);
-#endif
-
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -548,11 +523,11 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
     ndd.speed = 0;
     if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
+      nfc_pool_free(ndd.port);
+      nfc_pool_free(speed_s);
       return NULL;
     }
-    free(speed_s);
+    nfc_pool_free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -568,13 +543,13 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == INVALID_SERIAL_PORT) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR,
             "Invalid serial port: %s", ndd.port);
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     return NULL;
   }
   if (sp == CLAIMED_SERIAL_PORT) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR,
             "Serial port already claimed: %s", ndd.port);
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     return NULL;
   }
 
@@ -584,15 +559,15 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
   pnd = nfc_device_new(context, connstring);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     uart_close(sp);
     return NULL;
   }
   pnd->driver = &acr122s_driver;
   strcpy(pnd->name, ACR122S_DRIVER_NAME);
-  free(ndd.port);
+  nfc_pool_free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct acr122s_data));
+  pnd->driver_data = nfc_pool_alloc(&acr122s_data_pool);
   if (!pnd->driver_data) {
     perror("malloc");
     uart_close(sp);
@@ -603,16 +578,6 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
   DRIVER_DATA(pnd)->port = sp;
   DRIVER_DATA(pnd)->seq = 0;
 
-#ifndef WIN32
-  if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-    uart_close(DRIVER_DATA(pnd)->port);
-    nfc_device_free(pnd);
-    return NULL;
-  }
-#else
-  DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
   if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
     perror("malloc");
     uart_close(DRIVER_DATA(pnd)->port);
@@ -665,6 +630,7 @@ acr122s_send(nfc_device *pnd, const uint8_t *buf, const size_t buf_len, int time
   if (! acr122s_build_frame(pnd, cmd, sizeof(cmd), 0, 0, buf, buf_len, 1)) {
     return NFC_EINVARG;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_BUILD);
 
   int ret;
   if ((ret = acr122s_send_frame(pnd, cmd, timeout)) != 0) {
@@ -672,6 +638,7 @@ acr122s_send(nfc_device *pnd, const uint8_t *buf, const size_t buf_len, int time
     pnd->last_error = ret;
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
 
   return NFC_SUCCESS;
 }
@@ -679,18 +646,10 @@ acr122s_send(nfc_device *pnd, const uint8_t *buf, const size_t buf_len, int time
 static int
 acr122s_receive(nfc_device *pnd, uint8_t *buf, size_t buf_len, int timeout)
 {
-  void *abort_p;
-
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->abort_fds[1]);
-#else
-  abort_p = &(DRIVER_DATA(pnd)->abort_flag);
-#endif
-
   uint8_t tmp[MAX_FRAME_SIZE];
-  pnd->last_error = acr122s_recv_frame(pnd, tmp, sizeof(tmp), abort_p, timeout);
+  pnd->last_error = acr122s_recv_frame(pnd, tmp, sizeof(tmp), true, timeout);
 
-  if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
+  if (NFC_EOPABORTED == pnd->last_error) {
     pnd->last_error = NFC_EOPABORTED;
     return pnd->last_error;
   }
@@ -714,23 +673,27 @@ acr122s_receive(nfc_device *pnd, uint8_t *buf, size_t buf_len, int timeout)
 static int
 acr122s_abort_command(nfc_device *pnd)
 {
-  if (pnd) {
-#ifndef WIN32
-    close(DRIVER_DATA(pnd)->abort_fds[0]);
-    close(DRIVER_DATA(pnd)->abort_fds[1]);
-    if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-      return NFC_ESOFT;
-    }
-#else
-    DRIVER_DATA(pnd)->abort_flag = true;
-#endif
-  }
-  return NFC_SUCCESS;
+  // Wakes up the receive in progress, if any, see uart_abort()
+  return uart_abort(DRIVER_DATA(pnd)->port);
+}
+
+static int
+acr122s_get_fd(struct nfc_device *pnd)
+{
+  return uart_get_fd(DRIVER_DATA(pnd)->port);
+}
+
+static size_t
+acr122s_pending(struct nfc_device *pnd)
+{
+  return uart_pending(DRIVER_DATA(pnd)->port);
 }
 
 const struct pn53x_io acr122s_io = {
   .send    = acr122s_send,
   .receive = acr122s_receive,
+  .get_fd  = acr122s_get_fd,
+  .pending = acr122s_pending,
 };
 
 const struct nfc_driver acr122s_driver = {
@@ -745,6 +708,10 @@ const struct nfc_driver acr122s_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -752,21 +719,32 @@ const struct nfc_driver acr122s_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
 
   .abort_command  = acr122s_abort_command,
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
@@ -82,13 +82,11 @@ const struct pn53x_io arygon_tama_io;
 
 struct arygon_data {
   serial_port port;
-#ifndef WIN32
-  int     iAbortFds[2];
-#else
-  volatile bool abort_flag;
-#endif
+  char    port_name[DEVICE_PORT_LENGTH];
 };
 
+NFC_POOL(arygon_data_pool, struct arygon_data, NFC_POOL_DEVICES);
+
 // ARYGON frames
 static const uint8_t arygon_error_none[] = "FF000000\x0d\x0a";
 static const uint8_t arygon_error_unknown_mode[] = "FF060000\x0d\x0a";
@@ -97,125 +95,101 @@ static const uint8_t arygon_error_unknown_mode[] = "FF060000\x0d\x0a";
 int     arygon_reset_tama(nfc_device *pnd);
 void    arygon_firmware(nfc_device *pnd, char *str);
 
-static size_t
-arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static bool
+arygon_scan_port(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
-
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ARYGON device on serial port: %s at %d baud.", acPort, ARYGON_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp, true);
-      uart_set_speed(sp, ARYGON_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ARYGON_DRIVER_NAME, acPort, ARYGON_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-
-      pnd->driver = &arygon_driver;
-      pnd->driver_data = malloc(sizeof(struct arygon_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-
-#ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        pn53x_data_free(pnd);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-#else
-      DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
-      int res = arygon_reset_tama(pnd);
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
-
-      // ARYGON reader is found
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ARYGON device on serial port: %s at %d baud.", acPort, ARYGON_DEFAULT_SPEED);
+
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return false;
+
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp, true);
+  uart_set_speed(sp, ARYGON_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ARYGON_DRIVER_NAME, acPort, ARYGON_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return false;
   }
-  iDevice = 0;
-  while ((acPort = acPorts[iDevice++])) {
-    free((void *)acPort);
+
+  pnd->driver = &arygon_driver;
+  pnd->driver_data = nfc_pool_alloc(&arygon_data_pool);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return false;
+  }
+  DRIVER_DATA(pnd)->port = sp;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
   }
-  free(acPorts);
-  return device_found;
+
+  int res = arygon_reset_tama(pnd);
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  // ARYGON reader is found if TAMA answered
+  return res >= 0;
+}
+
+static size_t
+arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  return nfc_probe_ports(context, uart_list_ports(), arygon_scan_port, connstrings, connstrings_len);
 }
 
 struct arygon_descriptor {
   char *port;
   uint32_t speed;
+  bool auto_speed;
 };
 
+/*
+ * The host link ends at the ARYGON MCU, not at the PN53x HSU, so there is
+ * nothing to negotiate: "auto" looks for the speed the MCU is configured at.
+ */
+static const uint32_t arygon_auto_speeds[] = { 115200, 57600, 38400, 19200, 9600 };
+
+static int
+arygon_probe(nfc_device *pnd)
+{
+  serial_port sp = DRIVER_DATA(pnd)->port;
+  const uint32_t uiRemembered = uart_get_remembered_speed(DRIVER_DATA(pnd)->port_name);
+  int res = NFC_EIO;
+
+  for (size_t i = 0; i <= sizeof(arygon_auto_speeds) / sizeof(arygon_auto_speeds[0]); i++) {
+    const uint32_t uiSpeed = (i == 0) ? uiRemembered : arygon_auto_speeds[i - 1];
+    if ((uiSpeed == 0) || ((i > 0) && (uiSpeed == uiRemembered)))
+      continue;
+    uart_set_speed(sp, uiSpeed);
+    if (uart_get_speed(sp) != uiSpeed)
+      continue;
+    uart_flush_input(sp, true);
+    if ((res = arygon_reset_tama(pnd)) == 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "ARYGON MCU found at %" PRIu32 " baud.", uiSpeed);
+      uart_remember_speed(DRIVER_DATA(pnd)->port_name, uiSpeed);
+      return NFC_SUCCESS;
+    }
+  }
+  return res;
+}
+
 static void
 arygon_close_step2(nfc_device *pnd)
 {
   // Release UART port
   uart_close(DRIVER_DATA(pnd)->port);
 
-#ifndef WIN32
-  // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->iAbortFds[0]);
-  close(DRIVER_DATA(pnd)->iAbortFds[1]);
-#endif
-
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -233,15 +207,19 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   struct arygon_descriptor ndd;
   char *speed_s;
   int connstring_decode_level = connstring_decode(connstring, ARYGON_DRIVER_NAME, NULL, &ndd.port, &speed_s);
+  ndd.auto_speed = false;
   if (connstring_decode_level == 3) {
     ndd.speed = 0;
-    if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
+    if (strcmp(speed_s, "auto") == 0) {
+      ndd.auto_speed = true;
+      ndd.speed = ARYGON_DEFAULT_SPEED;
+    } else if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
+      nfc_pool_free(ndd.port);
+      nfc_pool_free(speed_s);
       return NULL;
     }
-    free(speed_s);
+    nfc_pool_free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -260,7 +238,7 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == CLAIMED_SERIAL_PORT)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Serial port already claimed: %s", ndd.port);
   if ((sp == CLAIMED_SERIAL_PORT) || (sp == INVALID_SERIAL_PORT)) {
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     return NULL;
   }
 
@@ -272,21 +250,23 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   pnd = nfc_device_new(context, connstring);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     uart_close(sp);
     return NULL;
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", ARYGON_DRIVER_NAME, ndd.port);
-  free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct arygon_data));
+  pnd->driver_data = nfc_pool_alloc(&arygon_data_pool);
   if (!pnd->driver_data) {
     perror("malloc");
+    nfc_pool_free(ndd.port);
     uart_close(sp);
     nfc_device_free(pnd);
     return NULL;
   }
   DRIVER_DATA(pnd)->port = sp;
+  snprintf(DRIVER_DATA(pnd)->port_name, sizeof(DRIVER_DATA(pnd)->port_name), "%s", ndd.port);
+  nfc_pool_free(ndd.port);
 
   // Alloc and init chip's data
   if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
@@ -303,20 +283,8 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   CHIP_DATA(pnd)->timer_correction = 46;
   pnd->driver = &arygon_driver;
 
-#ifndef WIN32
-  // pipe-based abort mecanism
-  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-    uart_close(DRIVER_DATA(pnd)->port);
-    pn53x_data_free(pnd);
-    nfc_device_free(pnd);
-    return NULL;
-  }
-#else
-  DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
   // Check communication using "Reset TAMA" command
-  if (arygon_reset_tama(pnd) < 0) {
+  if ((ndd.auto_speed ? arygon_probe(pnd) : arygon_reset_tama(pnd)) < 0) {
     arygon_close_step2(pnd);
     return NULL;
   }
@@ -341,8 +309,6 @@ arygon_tama_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, i
   // Before sending anything, we need to discard from any junk bytes
   uart_flush_input(DRIVER_DATA(pnd)->port, false);
 
-  uint8_t abtFrame[ARYGON_TX_BUFFER_LEN] = { DEV_ARYGON_PROTOCOL_TAMA, 0x00, 0x00, 0xff };     // Every packet must start with "0x32 0x00 0x00 0xff"
-
   size_t szFrame = 0;
   if (szData > PN53x_NORMAL_FRAME__DATA_MAX_LEN) {
     // ARYGON Reader with PN532 equipped does not support extended frame (bug in ARYGON firmware?)
@@ -351,19 +317,27 @@ arygon_tama_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, i
     return pnd->last_error;
   }
 
-  if ((res = pn53x_build_frame(abtFrame + 1, &szFrame, pbtData, szData)) < 0) {
-    pnd->last_error = res;
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *abtFrame = pn53x_frame_tx(pnd, pbtData, szData, 1, &szFrame);
+  if (!abtFrame) {
+    pn53x_scratch_release(pnd, szScratch);
     return pnd->last_error;
   }
+  // Every packet must start with "0x32 0x00 0x00 0xff"
+  abtFrame[0] = DEV_ARYGON_PROTOCOL_TAMA;
+  NFC_TIMING_MARK(pnd, NFC_PHASE_BUILD);
 
-  if ((res = uart_send(DRIVER_DATA(pnd)->port, abtFrame, szFrame + 1, timeout)) != 0) {
+  res = uart_send(DRIVER_DATA(pnd)->port, abtFrame, szFrame, timeout);
+  pn53x_scratch_release(pnd, szScratch);
+  if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to transmit data. (TX)");
     pnd->last_error = res;
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
 
   uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
-  if ((res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), 0, timeout)) != 0) {
+  if ((res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), false, timeout)) != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to read ACK");
     pnd->last_error = res;
     return pnd->last_error;
@@ -375,7 +349,7 @@ arygon_tama_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, i
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Bad frame format.");
     // We have already read 6 bytes and arygon_error_unknown_mode is 10 bytes long
     // so we have to read 4 remaining bytes to be synchronized at the next receiving pass.
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 4, 0, timeout);
+    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 4, false, timeout);
     return pnd->last_error;
   } else {
     return pnd->last_error;
@@ -398,19 +372,13 @@ arygon_abort(nfc_device *pnd)
 static int
 arygon_tama_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  uint8_t  abtRxBuf[5];
-  size_t len;
-  void *abort_p = NULL;
-
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[1]);
-#else
-  abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
-#endif
+  uint8_t  abtRxBuf[PN53x_EXTENDED_FRAME__OVERHEAD + PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  struct pn53x_frame_parser parser;
 
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, timeout);
+  pn53x_frame_parser_init(&parser, pnd, false);
+  const int res = uart_receive_frame(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), pn53x_frame_parse, &parser, true, timeout);
 
-  if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
+  if (NFC_EOPABORTED == res) {
     arygon_abort(pnd);
 
     /* last_error got reset by arygon_abort() */
@@ -418,99 +386,21 @@ arygon_tama_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, i
     return pnd->last_error;
   }
 
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    return pnd->last_error;
-  }
-
-  const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
-  if (0 != (memcmp(abtRxBuf, pn53x_preamble, 3))) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame preamble+start code mismatch");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  if ((0x01 == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
-    // Error frame
-    uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  } else if ((0xff == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
-    // Extended frame
-    // ARYGON devices does not support extended frame sending
-    abort();
-  } else {
-    // Normal frame
-    if (256 != (abtRxBuf[3] + abtRxBuf[4])) {
-      // TODO: Retry
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
-      pnd->last_error = NFC_EIO;
-      return pnd->last_error;
-    }
-
-    // abtRxBuf[3] (LEN) include TFI + (CC+1)
-    len = abtRxBuf[3] - 2;
-  }
-
-  if (len > szDataLen) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  // TFI + PD0 (CC+1)
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    return pnd->last_error;
-  }
-
-  if (abtRxBuf[0] != 0xD5) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  if (abtRxBuf[1] != CHIP_DATA(pnd)->last_command + 1) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  if (len) {
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, pbtData, len, 0, timeout);
-    if (pnd->last_error != 0) {
+  if (res < 0) {
+    if (res != NFC_EIO)
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      return pnd->last_error;
-    }
-  }
-
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    return pnd->last_error;
-  }
-
-  uint8_t btDCS = (256 - 0xD5);
-  btDCS -= CHIP_DATA(pnd)->last_command + 1;
-  for (size_t szPos = 0; szPos < len; szPos++) {
-    btDCS -= pbtData[szPos];
-  }
-
-  if (btDCS != abtRxBuf[0]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
-    pnd->last_error = NFC_EIO;
+    pnd->last_error = (res == NFC_EOVFLOW) ? NFC_EIO : res;
     return pnd->last_error;
   }
 
-  if (0x00 != abtRxBuf[1]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
+  if (parser.szDataLen > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, parser.szDataLen);
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
   }
+  memcpy(pbtData, abtRxBuf + parser.szDataPos, parser.szDataLen);
   // The PN53x command is done and we successfully received the reply
-  return len;
+  return parser.szDataLen;
 }
 
 void
@@ -526,7 +416,7 @@ arygon_firmware(nfc_device *pnd, char *str)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to send ARYGON firmware command.");
     return;
   }
-  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, 0, 0);
+  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, false, 0);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to retrieve ARYGON firmware version.");
     return;
@@ -555,7 +445,7 @@ arygon_reset_tama(nfc_device *pnd)
 
   // Two reply are possible from ARYGON device: arygon_error_none (ie. in case the byte is well-sent)
   // or arygon_error_unknown_mode (ie. in case of the first byte was bad-transmitted)
-  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, 0, 1000);
+  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, false, 1000);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "No reply to 'reset TAMA' command.");
     pnd->last_error = res;
@@ -573,23 +463,28 @@ arygon_reset_tama(nfc_device *pnd)
 static int
 arygon_abort_command(nfc_device *pnd)
 {
-  if (pnd) {
-#ifndef WIN32
-    close(DRIVER_DATA(pnd)->iAbortFds[0]);
-    if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-      return NFC_ESOFT;
-    }
-#else
-    DRIVER_DATA(pnd)->abort_flag = true;
-#endif
-  }
-  return NFC_SUCCESS;
+  // Wakes up the receive in progress, if any, see uart_abort()
+  return uart_abort(DRIVER_DATA(pnd)->port);
 }
 
 
+static int
+arygon_tama_get_fd(struct nfc_device *pnd)
+{
+  return uart_get_fd(DRIVER_DATA(pnd)->port);
+}
+
+static size_t
+arygon_tama_pending(struct nfc_device *pnd)
+{
+  return uart_pending(DRIVER_DATA(pnd)->port);
+}
+
 const struct pn53x_io arygon_tama_io = {
   .send       = arygon_tama_send,
   .receive    = arygon_tama_receive,
+  .get_fd     = arygon_tama_get_fd,
+  .pending    = arygon_tama_pending,
 };
 
 const struct nfc_driver arygon_driver = {
@@ -604,6 +499,10 @@ const struct nfc_driver arygon_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -611,22 +510,33 @@ const struct nfc_driver arygon_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
 
   .abort_command  = arygon_abort_command,
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
 
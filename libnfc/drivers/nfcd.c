@@ -0,0 +1,481 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfcd.c
+ * @brief Driver for devices shared by nfc-daemon between processes
+ *
+ * A client connects to the daemon UNIX socket and asks for a device. The
+ * daemon answers with a shared memory segment holding two single producer,
+ * single consumer byte rings (requests and answers), over which the tcp
+ * driver protocol runs. The socket stays open: it only carries wake-ups, one
+ * byte written when the peer went to sleep on an empty ring, and tells the
+ * daemon when the client is gone.
+ *
+ * Connstring: nfcd:index (index of the device in the daemon list)
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "nfcd.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "tcp.h"
+
+#define NFCD_DRIVER_NAME "nfcd"
+// Socket of a daemon run by root, in a directory only root can write to
+#define NFCD_DEFAULT_SOCKET "/run/libnfc/nfcd.sock"
+// Socket of a daemon run by a user, in $XDG_RUNTIME_DIR (private to the user)
+#define NFCD_USER_SOCKET "libnfc-nfcd.sock"
+
+#define NFCD_SHM_MAGIC 0x6e666364
+// Must be a power of two, and hold at least a request of the tcp protocol
+#define NFCD_RING_LEN (1 << 18)
+// Polls of an empty ring before going to sleep
+#define NFCD_SPIN_COUNT 20000
+
+#define NFCD_CMD_LIST 'L'
+#define NFCD_CMD_OPEN 'O'
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif
+
+#define LOG_CATEGORY "libnfc.driver.nfcd"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+struct nfcd_ring {
+  // Written by the producer only
+  uint32_t ui32Head;
+  uint8_t abtPad1[60];
+  // Written by the consumer only, but for ui32Waiting
+  uint32_t ui32Tail;
+  uint32_t ui32Waiting;
+  uint8_t abtPad2[56];
+  uint8_t abtData[NFCD_RING_LEN];
+};
+
+struct nfcd_shm {
+  uint32_t ui32Magic;
+  uint8_t abtPad[60];
+  struct nfcd_ring requests;
+  struct nfcd_ring answers;
+};
+
+struct nfcd_link {
+  struct nfcd_shm *pshm;
+  struct nfcd_ring *prx;
+  struct nfcd_ring *ptx;
+};
+
+#define LINK_DATA(link) ((struct nfcd_link *)((link)->data))
+
+// Waits for data in an empty ring, spinning first then sleeping on the socket
+static int
+nfcd_ring_wait(struct tcp_link *link, struct nfcd_ring *pr, const uint32_t ui32Tail)
+{
+  uint8_t abtWakeUps[64];
+
+  for (int i = 0; i < NFCD_SPIN_COUNT; i++) {
+    if (__atomic_load_n(&pr->ui32Head, __ATOMIC_ACQUIRE) != ui32Tail)
+      return NFC_SUCCESS;
+  }
+  __atomic_store_n(&pr->ui32Waiting, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pr->ui32Head, __ATOMIC_SEQ_CST) != ui32Tail) {
+    __atomic_store_n(&pr->ui32Waiting, 0, __ATOMIC_SEQ_CST);
+    return NFC_SUCCESS;
+  }
+  // Wake-ups may pile up, read them all
+  for (;;) {
+    const ssize_t res = read(link->fd, abtWakeUps, sizeof(abtWakeUps));
+    if (res > 0)
+      return NFC_SUCCESS;
+    if (res == 0)
+      return NFC_ETGRELEASED;
+    if (errno != EINTR)
+      return NFC_EIO;
+  }
+}
+
+static int
+nfcd_ring_read(struct tcp_link *link, uint8_t *pbtData, const size_t szData)
+{
+  struct nfcd_ring *pr = LINK_DATA(link)->prx;
+  size_t szDone = 0;
+  int res;
+
+  while (szDone < szData) {
+    const uint32_t ui32Tail = pr->ui32Tail;
+    const uint32_t ui32Used = __atomic_load_n(&pr->ui32Head, __ATOMIC_ACQUIRE) - ui32Tail;
+    if (ui32Used == 0) {
+      if ((res = nfcd_ring_wait(link, pr, ui32Tail)) < 0)
+        return res;
+      continue;
+    }
+    const size_t szOffset = ui32Tail & (NFCD_RING_LEN - 1);
+    const size_t szChunk = MIN(MIN(ui32Used, szData - szDone), NFCD_RING_LEN - szOffset);
+    memcpy(pbtData + szDone, pr->abtData + szOffset, szChunk);
+    __atomic_store_n(&pr->ui32Tail, ui32Tail + szChunk, __ATOMIC_RELEASE);
+    szDone += szChunk;
+  }
+  return NFC_SUCCESS;
+}
+
+// Has the peer closed the socket?
+static bool
+nfcd_peer_gone(struct tcp_link *link)
+{
+  uint8_t abt;
+  return recv(link->fd, &abt, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+static int
+nfcd_ring_write(struct tcp_link *link, const uint8_t *pbtData, const size_t szData)
+{
+  struct nfcd_ring *pr = LINK_DATA(link)->ptx;
+  size_t szDone = 0;
+
+  while (szDone < szData) {
+    const uint32_t ui32Head = pr->ui32Head;
+    const uint32_t ui32Free = NFCD_RING_LEN - (ui32Head - __atomic_load_n(&pr->ui32Tail, __ATOMIC_ACQUIRE));
+    if (ui32Free == 0) {
+      // Full rings are rare: the consumer is not woken up for room
+      if (nfcd_peer_gone(link))
+        return NFC_EIO;
+      sched_yield();
+      continue;
+    }
+    const size_t szOffset = ui32Head & (NFCD_RING_LEN - 1);
+    const size_t szChunk = MIN(MIN(ui32Free, szData - szDone), NFCD_RING_LEN - szOffset);
+    memcpy(pr->abtData + szOffset, pbtData + szDone, szChunk);
+    __atomic_store_n(&pr->ui32Head, ui32Head + szChunk, __ATOMIC_SEQ_CST);
+    szDone += szChunk;
+  }
+  if (__atomic_exchange_n(&pr->ui32Waiting, 0, __ATOMIC_SEQ_CST)) {
+    const uint8_t abtWakeUp[1] = { 0 };
+    if (send(link->fd, abtWakeUp, sizeof(abtWakeUp), MSG_NOSIGNAL) < 0)
+      return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+}
+
+static void
+nfcd_ring_arm(struct tcp_link *link)
+{
+  struct nfcd_ring *pr = LINK_DATA(link)->prx;
+
+  // Asks the daemon for a wake-up byte, which makes the socket readable
+  __atomic_store_n(&pr->ui32Waiting, 1, __ATOMIC_SEQ_CST);
+}
+
+static void
+nfcd_ring_close(struct tcp_link *link)
+{
+  munmap(LINK_DATA(link)->pshm, sizeof(struct nfcd_shm));
+  free(link->data);
+  close(link->fd);
+}
+
+static int
+nfcd_ring_link(struct tcp_link *link, const int fd, struct nfcd_shm *pshm, const bool bDaemon)
+{
+  struct nfcd_link *pnl;
+
+  if ((pnl = malloc(sizeof(struct nfcd_link))) == NULL)
+    return NFC_ESOFT;
+  pnl->pshm = pshm;
+  pnl->prx = bDaemon ? &(pshm->requests) : &(pshm->answers);
+  pnl->ptx = bDaemon ? &(pshm->answers) : &(pshm->requests);
+  memset(link, 0, sizeof(struct tcp_link));
+  link->read = nfcd_ring_read;
+  link->write = nfcd_ring_write;
+  link->arm = nfcd_ring_arm;
+  link->close = nfcd_ring_close;
+  link->fd = fd;
+  link->data = pnl;
+  return NFC_SUCCESS;
+}
+
+static int
+nfcd_connect_path(const char *pcPath)
+{
+  struct sockaddr_un sa;
+  int fd;
+
+  if (strlen(pcPath) >= sizeof(sa.sun_path))
+    return -1;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, pcPath);
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+  if (connect(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * Connects to LIBNFC_NFCD_SOCKET when set, otherwise to the system daemon,
+ * then to the daemon of the user. Only paths that other users can not create
+ * are tried: devices and their traffic go through whoever listens there.
+ */
+static int
+nfcd_connect(void)
+{
+  int fd;
+
+#ifdef ENVVARS
+  const char *pcPath = getenv("LIBNFC_NFCD_SOCKET");
+  if (pcPath && *pcPath)
+    return nfcd_connect_path(pcPath);
+#endif // ENVVARS
+  if ((fd = nfcd_connect_path(NFCD_DEFAULT_SOCKET)) >= 0)
+    return fd;
+#ifdef ENVVARS
+  const char *pcRuntimeDir = getenv("XDG_RUNTIME_DIR");
+  char acPath[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+  if (pcRuntimeDir && (*pcRuntimeDir == '/') &&
+      (snprintf(acPath, sizeof(acPath), "%s/%s", pcRuntimeDir, NFCD_USER_SOCKET) < (int) sizeof(acPath)))
+    return nfcd_connect_path(acPath);
+#endif // ENVVARS
+  return -1;
+}
+
+static int
+nfcd_read_byte(const int fd)
+{
+  uint8_t bt;
+  ssize_t res;
+
+  while (((res = read(fd, &bt, 1)) < 0) && (errno == EINTR));
+  return (res == 1) ? bt : -1;
+}
+
+static int
+nfcd_write(const int fd, const uint8_t *pbtData, const size_t szData)
+{
+  return (send(fd, pbtData, szData, MSG_NOSIGNAL) == (ssize_t) szData) ? NFC_SUCCESS : NFC_EIO;
+}
+
+size_t
+nfcd_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  const uint8_t abtCmd[1] = { NFCD_CMD_LIST };
+  size_t szDevices = 0;
+  int fd;
+
+  (void) context;
+  // No daemon running, no device
+  if ((fd = nfcd_connect()) < 0)
+    return 0;
+  if (nfcd_write(fd, abtCmd, sizeof(abtCmd)) == NFC_SUCCESS) {
+    const int iCount = nfcd_read_byte(fd);
+    for (int i = 0; (i < iCount) && (szDevices < connstrings_len); i++)
+      snprintf(connstrings[szDevices++], sizeof(nfc_connstring), "%s:%d", NFCD_DRIVER_NAME, i);
+  }
+  close(fd);
+  return szDevices;
+}
+
+// Gets the shared memory segment file descriptor sent by the daemon
+static int
+nfcd_receive_fd(const int fd, int *pfdShm)
+{
+  uint8_t btStatus;
+  struct iovec iov = { &btStatus, 1 };
+  union {
+    struct cmsghdr cm;
+    char acControl[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg;
+  struct cmsghdr *pcm;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.acControl;
+  msg.msg_controllen = sizeof(control.acControl);
+  if (recvmsg(fd, &msg, 0) != 1)
+    return NFC_EIO;
+  if (btStatus != 0)
+    return -(int) btStatus;
+  pcm = CMSG_FIRSTHDR(&msg);
+  if (!pcm || (pcm->cmsg_level != SOL_SOCKET) || (pcm->cmsg_type != SCM_RIGHTS))
+    return NFC_EIO;
+  memcpy(pfdShm, CMSG_DATA(pcm), sizeof(int));
+  return NFC_SUCCESS;
+}
+
+static int
+nfcd_send_fd(const int fd, const int fdShm)
+{
+  uint8_t btStatus = 0;
+  struct iovec iov = { &btStatus, 1 };
+  union {
+    struct cmsghdr cm;
+    char acControl[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg;
+  struct cmsghdr *pcm;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.acControl;
+  msg.msg_controllen = sizeof(control.acControl);
+  pcm = CMSG_FIRSTHDR(&msg);
+  pcm->cmsg_level = SOL_SOCKET;
+  pcm->cmsg_type = SCM_RIGHTS;
+  pcm->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(pcm), &fdShm, sizeof(int));
+  return (sendmsg(fd, &msg, MSG_NOSIGNAL) == 1) ? NFC_SUCCESS : NFC_EIO;
+}
+
+nfc_device *
+nfcd_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  char *pcIndex = NULL;
+  struct tcp_link link;
+  struct nfcd_shm *pshm;
+  int fd, fdShm = -1;
+  int iIndex = 0;
+  int res;
+
+  res = connstring_decode(connstring, NFCD_DRIVER_NAME, NULL, &pcIndex, NULL);
+  if (res >= 2)
+    iIndex = atoi(pcIndex);
+  nfc_pool_free(pcIndex);
+  if ((res < 1) || (iIndex < 0) || (iIndex > 0xff))
+    return NULL;
+
+  if ((fd = nfcd_connect()) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to connect to the daemon");
+    return NULL;
+  }
+  const uint8_t abtCmd[2] = { NFCD_CMD_OPEN, iIndex };
+  if (((res = nfcd_write(fd, abtCmd, sizeof(abtCmd))) < 0) ||
+      ((res = nfcd_receive_fd(fd, &fdShm)) < 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to get device %d (%d)", iIndex, res);
+    close(fd);
+    return NULL;
+  }
+  pshm = mmap(NULL, sizeof(struct nfcd_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fdShm, 0);
+  close(fdShm);
+  if (pshm == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  if ((pshm->ui32Magic != NFCD_SHM_MAGIC) || (nfcd_ring_link(&link, fd, pshm, false) < 0)) {
+    munmap(pshm, sizeof(struct nfcd_shm));
+    close(fd);
+    return NULL;
+  }
+  return tcp_open_link(context, connstring, &nfcd_driver, &link);
+}
+
+// Backs the rings with an unlinked file, in memory if possible
+static int
+nfcd_shm_create(void)
+{
+  const char *apcTemplates[] = { "/dev/shm/libnfc-nfcd-XXXXXX", "/tmp/libnfc-nfcd-XXXXXX" };
+
+  for (size_t i = 0; i < sizeof(apcTemplates) / sizeof(apcTemplates[0]); i++) {
+    char acPath[32];
+    snprintf(acPath, sizeof(acPath), "%s", apcTemplates[i]);
+    const int fd = mkstemp(acPath);
+    if (fd < 0)
+      continue;
+    unlink(acPath);
+    if (ftruncate(fd, sizeof(struct nfcd_shm)) == 0)
+      return fd;
+    close(fd);
+  }
+  return -1;
+}
+
+int
+nfcd_serve(nfc_device *apnd[], const size_t szDevices, int fd)
+{
+  struct tcp_link link;
+  struct nfcd_shm *pshm;
+  int res;
+
+  const int iCmd = nfcd_read_byte(fd);
+  if (iCmd == NFCD_CMD_LIST) {
+    const uint8_t abtCount[1] = { MIN(szDevices, 0xff) };
+    return nfcd_write(fd, abtCount, sizeof(abtCount));
+  }
+  if (iCmd != NFCD_CMD_OPEN)
+    return NFC_EIO;
+  const int iIndex = nfcd_read_byte(fd);
+  if ((iIndex < 0) || ((size_t) iIndex >= szDevices)) {
+    const uint8_t abtStatus[1] = { -NFC_ENOTSUCHDEV };
+    nfcd_write(fd, abtStatus, sizeof(abtStatus));
+    return NFC_ENOTSUCHDEV;
+  }
+
+  const int fdShm = nfcd_shm_create();
+  if (fdShm < 0)
+    return NFC_ESOFT;
+  pshm = mmap(NULL, sizeof(struct nfcd_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fdShm, 0);
+  if (pshm == MAP_FAILED) {
+    close(fdShm);
+    return NFC_ESOFT;
+  }
+  // The file is zeroed, so are the rings
+  pshm->ui32Magic = NFCD_SHM_MAGIC;
+  res = nfcd_send_fd(fd, fdShm);
+  close(fdShm);
+  if ((res < 0) || ((res = nfcd_ring_link(&link, fd, pshm, true)) < 0)) {
+    munmap(pshm, sizeof(struct nfcd_shm));
+    return res;
+  }
+  res = tcp_serve_link(apnd[iIndex], &link, true);
+  // The caller keeps its socket
+  munmap(pshm, sizeof(struct nfcd_shm));
+  free(link.data);
+  return res;
+}
@@ -0,0 +1,43 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfcd.h
+ * @brief Driver for devices shared by nfc-daemon between processes
+ */
+
+#ifndef __NFC_DRIVER_NFCD_H__
+#define __NFC_DRIVER_NFCD_H__
+
+#include <nfc/nfc-types.h>
+
+extern const struct nfc_driver nfcd_driver;
+
+size_t nfcd_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len);
+nfc_device *nfcd_open(const nfc_context *context, const nfc_connstring connstring);
+int nfcd_serve(nfc_device *apnd[], const size_t szDevices, int fd);
+
+#endif // ! __NFC_DRIVER_NFCD_H__
@@ -50,6 +50,7 @@
 #include "chips/pn53x.h"
 #include "chips/pn53x-internal.h"
 #include "buses/i2c.h"
+#include "buses/gpio.h"
 
 #define PN532_I2C_DRIVER_NAME "pn532_i2c"
 
@@ -71,9 +72,15 @@ const struct pn53x_io pn532_i2c_io;
 
 struct pn532_i2c_data {
   i2c_device dev;
+  // Optional IRQ line, see pn532_i2c_wait_rdyframe()
+  gpio_line irq;
+  // End of the last transaction, see PN532_BUS_FREE_TIME
+  struct timespec transaction_stop;
   volatile bool abort_flag;
 };
 
+NFC_POOL(pn532_i2c_data_pool, struct pn532_i2c_data, NFC_POOL_DEVICES);
+
 /* preamble and start bytes, see pn532-internal.h for details */
 const uint8_t pn53x_preamble_and_start[] = { 0x00, 0x00, 0xff };
 #define PN53X_PREAMBLE_AND_START_LEN	(sizeof(pn53x_preamble_and_start) / sizeof(pn53x_preamble_and_start[0]))
@@ -105,33 +112,50 @@ static size_t pn532_i2c_scan(const nfc_context *context, nfc_connstring connstri
  * table 320. I2C timing specification, page 211, rev. 3.2 - 2007-12-07.
  */
 #define PN532_BUS_FREE_TIME 5
-static struct timespec __transaction_stop;
+
+/*
+ * Status polling interval bounds (in us) when no IRQ line is wired, on top
+ * of the bus free time.
+ */
+#define PN532_I2C_POLL_MIN_INTERVAL 250
+#define PN532_I2C_POLL_MAX_INTERVAL 10000
+
+/**
+ * @brief Sleep for what is left of the bus free time since the last transaction
+ *
+ * @param pnd pointer on the NFC device.
+ */
+static void pn532_i2c_wait_bus_free(nfc_device *pnd)
+{
+  struct timespec transaction_start;
+
+  clock_gettime(CLOCK_MONOTONIC, &transaction_start);
+  const long long elapsed = (transaction_start.tv_sec - DRIVER_DATA(pnd)->transaction_stop.tv_sec) * 1000000000LL
+                            + (transaction_start.tv_nsec - DRIVER_DATA(pnd)->transaction_stop.tv_nsec);
+  const long long remaining = (PN532_BUS_FREE_TIME * 1000 * 1000) - elapsed;
+  if (remaining > 0) {
+    const struct timespec bus_free_time = { 0, (long) remaining };
+    nanosleep(&bus_free_time, NULL);
+  }
+}
 
 /**
  * @brief Wrapper around i2c_read to ensure proper timing by respecting the
  * 	  minimal free bus time between a STOP condition and a START condition.
  *
- * @note This is not thread safe, but since libnfc is single threaded
- * 	 this should be okay.
- *
- * @param id I2C device
+ * @param pnd pointer on the NFC device.
  * @param buf pointer on buffer used to store data
  * @param len length of the buffer
  * @return length (in bytes) of read data, or driver error code (negative value)
  */
-static ssize_t pn532_i2c_read(const i2c_device id,
+static ssize_t pn532_i2c_read(nfc_device *pnd,
                               uint8_t *buf, const size_t len)
 {
-  struct timespec transaction_start, bus_free_time = { 0, 0 };
   ssize_t ret;
 
-  clock_gettime(CLOCK_MONOTONIC, &transaction_start);
-  bus_free_time.tv_nsec = (PN532_BUS_FREE_TIME * 1000 * 1000) -
-                          (transaction_start.tv_nsec - __transaction_stop.tv_nsec);
-  nanosleep(&bus_free_time, NULL);
-
-  ret = i2c_read(id, buf, len);
-  clock_gettime(CLOCK_MONOTONIC, &__transaction_stop);
+  pn532_i2c_wait_bus_free(pnd);
+  ret = i2c_read(DRIVER_DATA(pnd)->dev, buf, len);
+  clock_gettime(CLOCK_MONOTONIC, &(DRIVER_DATA(pnd)->transaction_stop));
   return ret;
 }
 
@@ -139,30 +163,77 @@ static ssize_t pn532_i2c_read(const i2c_device id,
  * @brief Wrapper around i2c_write to ensure proper timing by respecting the
  * 	  minimal free bus time between a STOP condition and a START condition.
  *
- * @note This is not thread safe, but since libnfc is single threaded
- * 	 this should be okay.
- *
- * @param id I2C device
+ * @param pnd pointer on the NFC device.
  * @param buf pointer on buffer containing data
  * @param len length of the buffer
  * @return NFC_SUCCESS on success, otherwise driver error code
  */
-static ssize_t pn532_i2c_write(const i2c_device id,
+static ssize_t pn532_i2c_write(nfc_device *pnd,
                                const uint8_t *buf, const size_t len)
 {
-  struct timespec transaction_start, bus_free_time = { 0, 0 };
   ssize_t ret;
 
-  clock_gettime(CLOCK_MONOTONIC, &transaction_start);
-  bus_free_time.tv_nsec = (PN532_BUS_FREE_TIME * 1000 * 1000) -
-                          (transaction_start.tv_nsec - __transaction_stop.tv_nsec);
-  nanosleep(&bus_free_time, NULL);
-
-  ret = i2c_write(id, buf, len);
-  clock_gettime(CLOCK_MONOTONIC, &__transaction_stop);
+  pn532_i2c_wait_bus_free(pnd);
+  ret = i2c_write(DRIVER_DATA(pnd)->dev, buf, len);
+  clock_gettime(CLOCK_MONOTONIC, &(DRIVER_DATA(pnd)->transaction_stop));
   return ret;
 }
 
+/**
+ * @brief Look for a PN532 device on an I2C bus.
+ */
+static bool
+pn532_i2c_scan_port(const nfc_context *context, const char *i2cPort, nfc_connstring connstring)
+{
+  i2c_device id = i2c_open(i2cPort, PN532_I2C_ADDR);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on I2C bus %s.", i2cPort);
+
+  if ((id == INVALID_I2C_ADDRESS) || (id == INVALID_I2C_BUS))
+    return false;
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s", PN532_I2C_DRIVER_NAME, i2cPort);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    i2c_close(id);
+    return false;
+  }
+  pnd->driver = &pn532_i2c_driver;
+  pnd->driver_data = nfc_pool_alloc(&pn532_i2c_data_pool);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    i2c_close(id);
+    nfc_device_free(pnd);
+    return false;
+  }
+  DRIVER_DATA(pnd)->dev = id;
+  DRIVER_DATA(pnd)->irq = INVALID_GPIO_LINE;
+  DRIVER_DATA(pnd)->transaction_stop.tv_sec = 0;
+  DRIVER_DATA(pnd)->transaction_stop.tv_nsec = 0;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn532_i2c_io) == NULL) {
+    perror("malloc");
+    i2c_close(DRIVER_DATA(pnd)->dev);
+    nfc_device_free(pnd);
+    return false;
+  }
+
+  // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
+  CHIP_DATA(pnd)->type = PN532;
+  // This device starts in LowVBat power mode
+  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+
+  DRIVER_DATA(pnd)->abort_flag = false;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  int res = pn53x_check_communication(pnd);
+  i2c_close(DRIVER_DATA(pnd)->dev);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return res >= 0;
+}
+
 /**
  * @brief Scan all available I2C buses to find PN532 devices.
  *
@@ -175,88 +246,7 @@ static ssize_t pn532_i2c_write(const i2c_device id,
 static size_t
 pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
 {
-  size_t device_found = 0;
-  i2c_device id;
-  char **i2cPorts = i2c_list_ports();
-  const char *i2cPort;
-  int iDevice = 0;
-
-  while ((i2cPort = i2cPorts[iDevice++])) {
-    id = i2c_open(i2cPort, PN532_I2C_ADDR);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on I2C bus %s.", i2cPort);
-
-    if ((id != INVALID_I2C_ADDRESS) && (id != INVALID_I2C_BUS)) {
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s", PN532_I2C_DRIVER_NAME, i2cPort);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        i2c_close(id);
-        iDevice = 0;
-        while ((i2cPort = i2cPorts[iDevice++])) {
-          free((void *)i2cPort);
-        }
-        free(i2cPorts);
-        return 0;
-      }
-      pnd->driver = &pn532_i2c_driver;
-      pnd->driver_data = malloc(sizeof(struct pn532_i2c_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        i2c_close(id);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((i2cPort = i2cPorts[iDevice++])) {
-          free((void *)i2cPort);
-        }
-        free(i2cPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->dev = id;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn532_i2c_io) == NULL) {
-        perror("malloc");
-        i2c_close(DRIVER_DATA(pnd)->dev);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((i2cPort = i2cPorts[iDevice++])) {
-          free((void *)i2cPort);
-        }
-        free(i2cPorts);
-        return 0;
-      }
-
-      // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
-      CHIP_DATA(pnd)->type = PN532;
-      // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
-
-      DRIVER_DATA(pnd)->abort_flag = false;
-
-      // Check communication using "Diagnose" command, with "Communication test" (0x00)
-      int res = pn53x_check_communication(pnd);
-      i2c_close(DRIVER_DATA(pnd)->dev);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
-
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
-  }
-  iDevice = 0;
-  while ((i2cPort = i2cPorts[iDevice++])) {
-    free((void *)i2cPort);
-  }
-  free(i2cPorts);
-  return device_found;
+  return nfc_probe_ports(context, i2c_list_ports(), pn532_i2c_scan_port, connstrings, connstrings_len);
 }
 
 /**
@@ -267,8 +257,11 @@ pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const s
 static void
 pn532_i2c_close(nfc_device *pnd)
 {
+  pn53x_power_stop(pnd);
   pn53x_idle(pnd);
   i2c_close(DRIVER_DATA(pnd)->dev);
+  if (DRIVER_DATA(pnd)->irq != INVALID_GPIO_LINE)
+    gpio_close(DRIVER_DATA(pnd)->irq);
 
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
@@ -302,18 +295,21 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
   i2c_dev = i2c_open(i2c_devname, PN532_I2C_ADDR);
 
   if (i2c_dev == INVALID_I2C_BUS || i2c_dev == INVALID_I2C_ADDRESS) {
+    nfc_pool_free(i2c_devname);
     return NULL;
   }
 
   pnd = nfc_device_new(context, connstring);
   if (!pnd) {
     perror("malloc");
+    nfc_pool_free(i2c_devname);
     i2c_close(i2c_dev);
     return NULL;
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", PN532_I2C_DRIVER_NAME, i2c_devname);
+  nfc_pool_free(i2c_devname);
 
-  pnd->driver_data = malloc(sizeof(struct pn532_i2c_data));
+  pnd->driver_data = nfc_pool_alloc(&pn532_i2c_data_pool);
   if (!pnd->driver_data) {
     perror("malloc");
     i2c_close(i2c_dev);
@@ -321,6 +317,9 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
   DRIVER_DATA(pnd)->dev = i2c_dev;
+  DRIVER_DATA(pnd)->irq = INVALID_GPIO_LINE;
+  DRIVER_DATA(pnd)->transaction_stop.tv_sec = 0;
+  DRIVER_DATA(pnd)->transaction_stop.tv_nsec = 0;
 
   // Alloc and init chip's data
   if (pn53x_data_new(pnd, &pn532_i2c_io) == NULL) {
@@ -330,6 +329,19 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
 
+  // The PN532 pulls its IRQ line low when an answer is ready, e.g. "irq=gpiochip0/4"
+  char *irq_s = connstring_get_option(connstring, "irq");
+  if (irq_s) {
+    DRIVER_DATA(pnd)->irq = gpio_open_irq(irq_s);
+    nfc_pool_free(irq_s);
+    if (DRIVER_DATA(pnd)->irq == INVALID_GPIO_LINE) {
+      i2c_close(i2c_dev);
+      pn53x_data_free(pnd);
+      nfc_device_free(pnd);
+      return NULL;
+    }
+  }
+
   // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
   CHIP_DATA(pnd)->type = PN532;
   // This device starts in LowVBat mode
@@ -402,28 +414,31 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
       break;
   };
 
-  uint8_t abtFrame[PN532_BUFFER_LEN];
+  const size_t szScratch = pn53x_scratch_mark(pnd);
   size_t szFrame = 0;
+  uint8_t *abtFrame = pn53x_frame_tx(pnd, pbtData, szData, 0, &szFrame);
 
-  memcpy(abtFrame, pn53x_preamble_and_start, PN53X_PREAMBLE_AND_START_LEN);	// Every packet must start with the preamble and start bytes.
-  if ((res = pn53x_build_frame(abtFrame, &szFrame, pbtData, szData)) < 0) {
-    pnd->last_error = res;
+  if (!abtFrame) {
+    pn53x_scratch_release(pnd, szScratch);
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_BUILD);
 
   for (retries = PN532_SEND_RETRIES; retries > 0; retries--) {
-    res = pn532_i2c_write(DRIVER_DATA(pnd)->dev, abtFrame, szFrame);
+    res = pn532_i2c_write(pnd, abtFrame, szFrame);
     if (res >= 0)
       break;
 
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Failed to transmit data. Retries left: %d.", retries - 1);
   }
+  pn53x_scratch_release(pnd, szScratch);
 
   if (res < 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to transmit data. (TX)");
     pnd->last_error = res;
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
 
   uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
 
@@ -459,23 +474,61 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
 static int
 pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  bool done = false;
   int res;
 
   struct timeval start_tv, cur_tv;
-  long long duration;
+  long long duration = 0;
+  unsigned int poll_interval = PN532_I2C_POLL_MIN_INTERVAL;
 
   // Actual I2C response frame includes an additional status byte,
   // so we use a temporary buffer to read the I2C frame
   uint8_t i2cRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + 1];
 
-  if (timeout > 0) {
-    // If a timeout is specified, get current timestamp
-    gettimeofday(&start_tv, NULL);
-  }
+  gettimeofday(&start_tv, NULL);
 
-  do {
-    int recCount = pn532_i2c_read(DRIVER_DATA(pnd)->dev, i2cRx, szDataLen + 1);
+  for (;;) {
+    bool ready = false;
+
+    if (DRIVER_DATA(pnd)->irq != INVALID_GPIO_LINE) {
+      // Sleep until the PN532 pulls IRQ low, the frame status byte below only confirms it
+      res = gpio_wait_low(DRIVER_DATA(pnd)->irq, (timeout > 0) ? (int)(timeout - duration / 1000) : 0, &(DRIVER_DATA(pnd)->abort_flag));
+      if (res == NFC_EOPABORTED) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
+                "Wait for a READY frame has been aborted.");
+        return res;
+      }
+      if (res < 0) {
+        return res;
+      }
+      ready = true;
+    } else {
+      // Poll the status byte alone, reading a whole frame each time would hog the bus.
+      // Frames as short as an ACK are polled whole: once ready, no second read is needed.
+      const size_t szPoll = (szDataLen <= PN53x_ACK_FRAME__LEN) ? szDataLen + 1 : 1;
+      const int recCount = pn532_i2c_read(pnd, i2cRx, szPoll);
+      if (recCount <= 0) {
+        return NFC_EIO;
+      }
+      ready = i2cRx[0] & 1;
+      if (ready && (szPoll > 1)) {
+        res = recCount - 1;
+        memcpy(pbtData, &(i2cRx[1]), MIN(res, (int)szDataLen));
+        return res;
+      }
+    }
+
+    if (ready) {
+      // Every read starts with the status byte, even right after it was polled
+      int recCount = pn532_i2c_read(pnd, i2cRx, szDataLen + 1);
+      if (recCount <= 0) {
+        return NFC_EIO;
+      }
+      if (i2cRx[0] & 1) {
+        res = recCount - 1;
+        memcpy(pbtData, &(i2cRx[1]), MIN(res, (int)szDataLen));
+        return res;
+      }
+    }
 
     if (DRIVER_DATA(pnd)->abort_flag) {
       // Reset abort flag
@@ -486,39 +539,21 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
       return NFC_EOPABORTED;
     }
 
-    if (recCount <= 0) {
-      done = true;
-      res = NFC_EIO;
-    } else {
-      const uint8_t rdy = i2cRx[0];
-      if (rdy & 1) {
-        int copyLength;
-
-        done = true;
-        res = recCount - 1;
-        copyLength = MIN(res, (int)szDataLen);
-        memcpy(pbtData, &(i2cRx[1]), copyLength);
-      } else {
-        /* Not ready yet. Check for elapsed timeout. */
-
-        if (timeout > 0) {
-          gettimeofday(&cur_tv, NULL);
-          duration = (cur_tv.tv_sec - start_tv.tv_sec) * 1000000L
-                     + (cur_tv.tv_usec - start_tv.tv_usec);
-
-          if (duration / 1000 > timeout) {
-            res = NFC_ETIMEOUT;
-            done = true;
-
-            log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
-                    "timeout reached with no READY frame.");
-          }
-        }
-      }
+    /* Not ready yet. Check for elapsed timeout. */
+    gettimeofday(&cur_tv, NULL);
+    duration = (cur_tv.tv_sec - start_tv.tv_sec) * 1000000L
+               + (cur_tv.tv_usec - start_tv.tv_usec);
+    if ((timeout > 0) && (duration / 1000 > timeout)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
+              "timeout reached with no READY frame.");
+      return NFC_ETIMEOUT;
     }
-  } while (!done);
 
-  return res;
+    // Quick answers are caught early, long waits (e.g. target mode) back off
+    const struct timespec poll_time = { 0, poll_interval * 1000L };
+    nanosleep(&poll_time, NULL);
+    poll_interval = MIN(poll_interval * 2, PN532_I2C_POLL_MAX_INTERVAL);
+  }
 }
 
 /**
@@ -534,20 +569,29 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
 static int
 pn532_i2c_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  uint8_t frameBuf[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  const size_t szScratch = pn53x_scratch_mark(pnd);
+  uint8_t *frameBuf = pn53x_scratch_get(pnd);
   int frameLength;
   int TFI_idx;
   size_t len;
 
-  frameLength = pn532_i2c_wait_rdyframe(pnd, frameBuf, sizeof(frameBuf), timeout);
+  if (!frameBuf) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+
+  frameLength = pn532_i2c_wait_rdyframe(pnd, frameBuf, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, timeout);
 
   if (NFC_EOPABORTED == pnd->last_error) {
+    pn53x_scratch_release(pnd, szScratch);
     return pn532_i2c_ack(pnd);
   }
 
   if (frameLength < 0) {
     goto error;
   }
+  // The whole frame is read at once
+  NFC_TIMING_MARK(pnd, NFC_PHASE_FIRST_BYTE);
 
   if (0 != (memcmp(frameBuf, pn53x_preamble_and_start, PN53X_PREAMBLE_AND_START_LEN))) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame preamble+start code mismatch");
@@ -626,10 +670,12 @@ pn532_i2c_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
   }
 
   memcpy(pbtData, &frameBuf[TFI_idx + 2], len - 2);
+  pn53x_scratch_release(pnd, szScratch);
 
   /* The PN53x command is done and we successfully received the reply */
   return len - 2;
 error:
+  pn53x_scratch_release(pnd, szScratch);
   return pnd->last_error;
 }
 
@@ -642,7 +688,7 @@ error:
 int
 pn532_i2c_ack(nfc_device *pnd)
 {
-  return pn532_i2c_write(DRIVER_DATA(pnd)->dev, pn53x_ack_frame, sizeof(pn53x_ack_frame));
+  return pn532_i2c_write(pnd, pn53x_ack_frame, sizeof(pn53x_ack_frame));
 }
 
 /**
@@ -677,6 +723,10 @@ const struct nfc_driver pn532_i2c_driver = {
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -684,21 +734,32 @@ const struct nfc_driver pn532_i2c_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
 
   .abort_command  = pn532_i2c_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
 
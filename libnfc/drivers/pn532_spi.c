@@ -46,6 +46,7 @@
 #include "chips/pn53x.h"
 #include "chips/pn53x-internal.h"
 #include "spi.h"
+#include "gpio.h"
 
 #define PN532_SPI_DEFAULT_SPEED 1000000 // 1 MHz
 #define PN532_SPI_DRIVER_NAME "pn532_spi"
@@ -74,9 +75,13 @@
 const struct pn53x_io pn532_spi_io;
 struct pn532_spi_data {
   spi_port port;
+  // Optional IRQ line, see pn532_spi_wait_for_data()
+  gpio_line irq;
   volatile bool abort_flag;
 };
 
+NFC_POOL(pn532_spi_data_pool, struct pn532_spi_data, NFC_POOL_DEVICES);
+
 static const uint8_t pn532_spi_cmd_dataread = 0x03;
 static const uint8_t pn532_spi_cmd_datawrite = 0x01;
 
@@ -87,94 +92,63 @@ int     pn532_spi_wakeup(nfc_device *pnd);
 
 #define DRIVER_DATA(pnd) ((struct pn532_spi_data*)(pnd->driver_data))
 
-static size_t
-pn532_spi_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static bool
+pn532_spi_scan_port(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  spi_port sp;
-  char **acPorts = spi_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
-
-  while ((acPort = acPorts[iDevice++])) {
-    sp = spi_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on SPI port: %s at %d Hz.", acPort, PN532_SPI_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SPI_PORT) && (sp != CLAIMED_SPI_PORT)) {
-      // Serial port claimed but we need to check if a PN532_SPI is opened.
-      spi_set_speed(sp, PN532_SPI_DEFAULT_SPEED);
-      spi_set_mode(sp, PN532_SPI_MODE);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_SPI_DRIVER_NAME, acPort, PN532_SPI_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        spi_close(sp);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      pnd->driver = &pn532_spi_driver;
-      pnd->driver_data = malloc(sizeof(struct pn532_spi_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        spi_close(sp);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn532_spi_io) == NULL) {
-        perror("malloc");
-        spi_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
-      CHIP_DATA(pnd)->type = PN532;
-      // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
+  spi_port sp = spi_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on SPI port: %s at %d Hz.", acPort, PN532_SPI_DEFAULT_SPEED);
 
-      DRIVER_DATA(pnd)->abort_flag = false;
-
-      // Check communication using "Diagnose" command, with "Communication test" (0x00)
-      int res = pn53x_check_communication(pnd);
-      spi_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
+  if ((sp == INVALID_SPI_PORT) || (sp == CLAIMED_SPI_PORT))
+    return false;
 
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
+  // Serial port claimed but we need to check if a PN532_SPI is opened.
+  spi_set_speed(sp, PN532_SPI_DEFAULT_SPEED);
+  spi_set_mode(sp, PN532_SPI_MODE | SPI_LSB_FIRST);
 
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_SPI_DRIVER_NAME, acPort, PN532_SPI_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    spi_close(sp);
+    return false;
   }
-  iDevice = 0;
-  while ((acPort = acPorts[iDevice++])) {
-    free((void *)acPort);
+  pnd->driver = &pn532_spi_driver;
+  pnd->driver_data = nfc_pool_alloc(&pn532_spi_data_pool);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    spi_close(sp);
+    nfc_device_free(pnd);
+    return false;
   }
-  free(acPorts);
-  return device_found;
+  DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->irq = INVALID_GPIO_LINE;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn532_spi_io) == NULL) {
+    perror("malloc");
+    spi_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
+  }
+  // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
+  CHIP_DATA(pnd)->type = PN532;
+  // This device starts in LowVBat power mode
+  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+
+  DRIVER_DATA(pnd)->abort_flag = false;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  int res = pn53x_check_communication(pnd);
+  spi_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return res >= 0;
+}
+
+static size_t
+pn532_spi_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  return nfc_probe_ports(context, spi_list_ports(), pn532_spi_scan_port, connstrings, connstrings_len);
 }
 
 struct pn532_spi_descriptor {
@@ -185,10 +159,13 @@ struct pn532_spi_descriptor {
 static void
 pn532_spi_close(nfc_device *pnd)
 {
+  pn53x_power_stop(pnd);
   pn53x_idle(pnd);
 
   // Release SPI port
   spi_close(DRIVER_DATA(pnd)->port);
+  if (DRIVER_DATA(pnd)->irq != INVALID_GPIO_LINE)
+    gpio_close(DRIVER_DATA(pnd)->irq);
 
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
@@ -204,11 +181,11 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
     ndd.speed = 0;
     if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
+      nfc_pool_free(ndd.port);
+      nfc_pool_free(speed_s);
       return NULL;
     }
-    free(speed_s);
+    nfc_pool_free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -227,24 +204,24 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == CLAIMED_SPI_PORT)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "SPI port already claimed: %s", ndd.port);
   if ((sp == CLAIMED_SPI_PORT) || (sp == INVALID_SPI_PORT)) {
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     return NULL;
   }
   spi_set_speed(sp, ndd.speed);
-  spi_set_mode(sp, PN532_SPI_MODE);
+  spi_set_mode(sp, PN532_SPI_MODE | SPI_LSB_FIRST);
 
   // We have a connection
   pnd = nfc_device_new(context, connstring);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     spi_close(sp);
     return NULL;
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", PN532_SPI_DRIVER_NAME, ndd.port);
-  free(ndd.port);
+  nfc_pool_free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct pn532_spi_data));
+  pnd->driver_data = nfc_pool_alloc(&pn532_spi_data_pool);
   if (!pnd->driver_data) {
     perror("malloc");
     spi_close(sp);
@@ -252,6 +229,7 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
   DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->irq = INVALID_GPIO_LINE;
 
   // Alloc and init chip's data
   if (pn53x_data_new(pnd, &pn532_spi_io) == NULL) {
@@ -260,6 +238,19 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
     nfc_device_free(pnd);
     return NULL;
   }
+
+  // The PN532 pulls its IRQ line low when an answer is ready, e.g. "irq=gpiochip0/25"
+  char *irq_s = connstring_get_option(connstring, "irq");
+  if (irq_s) {
+    DRIVER_DATA(pnd)->irq = gpio_open_irq(irq_s);
+    nfc_pool_free(irq_s);
+    if (DRIVER_DATA(pnd)->irq == INVALID_GPIO_LINE) {
+      spi_close(DRIVER_DATA(pnd)->port);
+      pn53x_data_free(pnd);
+      nfc_device_free(pnd);
+      return NULL;
+    }
+  }
   // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
   CHIP_DATA(pnd)->type = PN532;
   // This device starts in LowVBat mode
@@ -282,11 +273,11 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
   return pnd;
 }
 
+static const uint8_t pn532_spi_statread_cmd = 0x02;
+
 static int
 pn532_spi_read_spi_status(nfc_device *pnd)
 {
-  static const uint8_t pn532_spi_statread_cmd = 0x02;
-
   uint8_t spi_status = 0;
   int res = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_statread_cmd, 1, &spi_status, 1, true);
 
@@ -299,6 +290,27 @@ pn532_spi_read_spi_status(nfc_device *pnd)
   return spi_status;
 }
 
+// Read SPI status then, in the same SPI message, the first szRx bytes of the frame: they are only meaningful when the status is ready
+static int
+pn532_spi_read_spi_status_and_data(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx)
+{
+  uint8_t spi_status = 0;
+  const struct spi_segment segments[] = {
+    { .pbtTx = &pn532_spi_statread_cmd, .pbtRx = NULL, .szLen = 1, .bCsChange = false },
+    { .pbtTx = NULL, .pbtRx = &spi_status, .szLen = 1, .bCsChange = true },
+    { .pbtTx = &pn532_spi_cmd_dataread, .pbtRx = NULL, .szLen = 1, .bCsChange = false },
+    { .pbtTx = NULL, .pbtRx = pbtRx, .szLen = szRx, .bCsChange = false },
+  };
+  int res = spi_transfer(DRIVER_DATA(pnd)->port, segments, sizeof(segments) / sizeof(segments[0]), true);
+
+  if (res != NFC_SUCCESS) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to read SPI status");
+    return res;
+  }
+
+  return spi_status;
+}
+
 int
 pn532_spi_wakeup(nfc_device *pnd)
 {
@@ -339,17 +351,40 @@ pn532_spi_wakeup(nfc_device *pnd)
 #define PN532_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
 
 
+// Status polling interval bounds (in us) when no IRQ line is wired
+#define PN532_SPI_POLL_MIN_INTERVAL 250
+#define PN532_SPI_POLL_MAX_INTERVAL 10000
+
+/*
+ * Wait for the PN532 to be ready then read the first szRx bytes of its answer into pbtRx.
+ * With an IRQ line the chip is very likely ready once IRQ is low, so status and data are
+ * read in one SPI message and the data dropped if the status disagrees. Without it, most
+ * polls find the chip busy so data is only read once the status says ready.
+ */
 static int
-pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
+pn532_spi_wait_for_data(nfc_device *pnd, int timeout, uint8_t *pbtRx, const size_t szRx)
 {
   static const uint8_t pn532_spi_ready = 0x01;
-  static const int pn532_spi_poll_interval = 10; //ms
-
 
-  int timer = 0;
+  unsigned int uiPollInterval = PN532_SPI_POLL_MIN_INTERVAL;
+  struct timeval tvStart, tvNow;
+  long elapsed = 0;
+  gettimeofday(&tvStart, NULL);
 
   int ret;
-  while ((ret = pn532_spi_read_spi_status(pnd)) != pn532_spi_ready) {
+  for (;;) {
+    if (DRIVER_DATA(pnd)->irq != INVALID_GPIO_LINE) {
+      // Sleep until the PN532 pulls IRQ low, the status read below only confirms it
+      ret = gpio_wait_low(DRIVER_DATA(pnd)->irq, (timeout > 0) ? (int)(timeout - elapsed) : 0, &(DRIVER_DATA(pnd)->abort_flag));
+      if (ret < 0) {
+        return ret;
+      }
+      if ((ret = pn532_spi_read_spi_status_and_data(pnd, pbtRx, szRx)) == pn532_spi_ready) {
+        return NFC_SUCCESS;
+      }
+    } else if ((ret = pn532_spi_read_spi_status(pnd)) == pn532_spi_ready) {
+      return spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, pbtRx, szRx, true);
+    }
     if (ret < 0) {
       return ret;
     }
@@ -359,17 +394,19 @@ pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
       return NFC_EOPABORTED;
     }
 
-    if (timeout > 0) {
-      timer += pn532_spi_poll_interval;
-      if (timer > timeout) {
-        return NFC_ETIMEOUT;
-      }
+    gettimeofday(&tvNow, NULL);
+    elapsed = (tvNow.tv_sec - tvStart.tv_sec) * 1000L + (tvNow.tv_usec - tvStart.tv_usec) / 1000L;
+    if ((timeout > 0) && (elapsed >= timeout)) {
+      return NFC_ETIMEOUT;
+    }
 
-      msleep(pn532_spi_poll_interval);
+    // Quick answers are caught early, long waits (e.g. target mode) do not hog the bus
+    const struct timespec tsPollInterval = { 0, uiPollInterval * 1000L };
+    nanosleep(&tsPollInterval, NULL);
+    if (uiPollInterval < PN532_SPI_POLL_MAX_INTERVAL) {
+      uiPollInterval = MIN(uiPollInterval * 2, PN532_SPI_POLL_MAX_INTERVAL);
     }
   }
-
-  return NFC_SUCCESS;
 }
 
 
@@ -405,15 +442,15 @@ pn532_spi_receive_next_chunk(nfc_device *pnd, uint8_t *pbtData, const size_t szD
   //  The response frame is 0x00 0xff 0x02 0xfe 0xd5 0x15 0x16 0x00
 
 
-  int res = spi_receive(DRIVER_DATA(pnd)->port, pbtData, 1, true);
-
-  if (res != NFC_SUCCESS) {
-    return res;
-  }
-
-  res = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, pbtData + 1, szDataLen - 1, true);
+  // Both reads of a chunk go in a single SPI message, CS toggling in between
+  const struct spi_segment segments[] = {
+    { .pbtTx = NULL, .pbtRx = pbtData, .szLen = 1, .bCsChange = true },
+    { .pbtTx = &pn532_spi_cmd_dataread, .pbtRx = NULL, .szLen = 1, .bCsChange = false },
+    { .pbtTx = NULL, .pbtRx = pbtData + 1, .szLen = szDataLen - 1, .bCsChange = false },
+  };
+  const size_t szSegments = (szDataLen > 1) ? 3 : 2;
 
-  return res;
+  return spi_transfer(DRIVER_DATA(pnd)->port, segments, szSegments, true);
 }
 
 static int
@@ -422,7 +459,7 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
   uint8_t  abtRxBuf[5];
   size_t len;
 
-  pnd->last_error = pn532_spi_wait_for_data(pnd, timeout);
+  pnd->last_error = pn532_spi_wait_for_data(pnd, timeout, abtRxBuf, 4);
 
   if (NFC_EOPABORTED == pnd->last_error) {
     return pn532_spi_ack(pnd);
@@ -432,12 +469,7 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to wait for SPI data. (RX)");
     goto error;
   }
-
-  pnd->last_error = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, abtRxBuf, 4, true);
-
-  if (pnd->last_error < 0) {
-    goto error;
-  }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_FIRST_BYTE);
 
   const uint8_t pn53x_long_preamble[3] = { 0x00, 0x00, 0xff };
   if (0 == (memcmp(abtRxBuf, pn53x_long_preamble, 3))) {
@@ -593,35 +625,31 @@ pn532_spi_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
       break;
   };
 
-  uint8_t  abtFrame[PN532_BUFFER_LEN + 1] = { pn532_spi_cmd_datawrite, 0x00, 0x00, 0xff };       // SPI data transfer starts with DATAWRITE (0x01) byte,  Every packet must start with "00 00 ff"
+  const size_t szScratch = pn53x_scratch_mark(pnd);
   size_t szFrame = 0;
+  uint8_t *abtFrame = pn53x_frame_tx(pnd, pbtData, szData, 1, &szFrame);
 
-  if ((res = pn53x_build_frame(abtFrame + 1, &szFrame, pbtData, szData)) < 0) {
-    pnd->last_error = res;
+  if (!abtFrame) {
+    pn53x_scratch_release(pnd, szScratch);
     return pnd->last_error;
   }
+  // SPI data transfer starts with DATAWRITE (0x01) byte
+  abtFrame[0] = pn532_spi_cmd_datawrite;
+  NFC_TIMING_MARK(pnd, NFC_PHASE_BUILD);
 
   res = spi_send(DRIVER_DATA(pnd)->port, abtFrame, szFrame, true);
+  pn53x_scratch_release(pnd, szScratch);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to transmit data. (TX)");
     pnd->last_error = res;
     return pnd->last_error;
   }
-
-  res = pn532_spi_wait_for_data(pnd, timeout);
-  if (res != NFC_SUCCESS) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to wait for SPI data. (RX)");
-    pnd->last_error = res;
-    return pnd->last_error;
-  }
-
-
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
 
   uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
-  res = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, abtRxBuf, sizeof(abtRxBuf), true);
-
-  if (res != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to read ACK");
+  res = pn532_spi_wait_for_data(pnd, timeout, abtRxBuf, sizeof(abtRxBuf));
+  if (res != NFC_SUCCESS) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to read ACK");
     pnd->last_error = res;
     return pnd->last_error;
   }
@@ -676,6 +704,10 @@ const struct nfc_driver pn532_spi_driver = {
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -683,21 +715,32 @@ const struct nfc_driver pn532_spi_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
 
   .abort_command  = pn532_spi_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
 
@@ -58,144 +58,192 @@
 const struct pn53x_io pn532_uart_io;
 struct pn532_uart_data {
   serial_port port;
-#ifndef WIN32
-  int     iAbortFds[2];
-#else
-  volatile bool abort_flag;
-#endif
+  char    port_name[DEVICE_PORT_LENGTH];
+  // ACK of the last sent frame not read yet, see pn532_uart_send()
+  bool    bAckPending;
+  // Nothing left on the line since the last answer was parsed, see pn532_uart_send()
+  bool    bInSync;
 };
 
+NFC_POOL(pn532_uart_data_pool, struct pn532_uart_data, NFC_POOL_DEVICES);
+
 // Prototypes
 int     pn532_uart_ack(nfc_device *pnd);
 int     pn532_uart_wakeup(nfc_device *pnd);
 
 #define DRIVER_DATA(pnd) ((struct pn532_uart_data*)(pnd->driver_data))
 
-static size_t
-pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static bool
+pn532_uart_scan_port(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
-
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on serial port: %s at %d baud.", acPort, PN532_UART_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp, true);
-      // Serial port claimed but we need to check if a PN532_UART is opened.
-      uart_set_speed(sp, PN532_UART_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_UART_DRIVER_NAME, acPort, PN532_UART_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      pnd->driver = &pn532_uart_driver;
-      pnd->driver_data = malloc(sizeof(struct pn532_uart_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn532_uart_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
-      CHIP_DATA(pnd)->type = PN532;
-      // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
-
-#ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        pn53x_data_free(pnd);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-#else
-      DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
-      // Check communication using "Diagnose" command, with "Communication test" (0x00)
-      int res = pn53x_check_communication(pnd);
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on serial port: %s at %d baud.", acPort, PN532_UART_DEFAULT_SPEED);
 
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return false;
 
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp, true);
+  // Serial port claimed but we need to check if a PN532_UART is opened.
+  uart_set_speed(sp, PN532_UART_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_UART_DRIVER_NAME, acPort, PN532_UART_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return false;
   }
-  iDevice = 0;
-  while ((acPort = acPorts[iDevice++])) {
-    free((void *)acPort);
+  pnd->driver = &pn532_uart_driver;
+  pnd->driver_data = nfc_pool_alloc(&pn532_uart_data_pool);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return false;
   }
-  free(acPorts);
-  return device_found;
+  DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->bAckPending = false;
+  DRIVER_DATA(pnd)->bInSync = false;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn532_uart_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
+  }
+  // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
+  CHIP_DATA(pnd)->type = PN532;
+  // This device starts in LowVBat power mode
+  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  int res = pn53x_check_communication(pnd);
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return res >= 0;
+}
+
+static size_t
+pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  return nfc_probe_ports(context, uart_list_ports(), pn532_uart_scan_port, connstrings, connstrings_len);
 }
 
 struct pn532_uart_descriptor {
   char *port;
   uint32_t speed;
+  bool auto_speed;
 };
 
+// Best first, tried by "auto" when nothing was negotiated on the port yet
+static const uint32_t pn532_uart_auto_speeds[] = { 921600, 460800, 230400 };
+
+static int
+pn532_uart_set_baud_rate(nfc_device *pnd, const uint32_t uiSpeed)
+{
+  serial_port sp = DRIVER_DATA(pnd)->port;
+  const uint32_t uiCurrentSpeed = uart_get_speed(sp);
+  int res = 0;
+
+  if (uiSpeed == uiCurrentSpeed)
+    return NFC_SUCCESS;
+
+  // Do not ask the PN532 for a speed the host can not follow
+  uart_set_speed(sp, uiSpeed);
+  const bool bSupported = (uart_get_speed(sp) == uiSpeed);
+  uart_set_speed(sp, uiCurrentSpeed);
+  if (!bSupported)
+    return NFC_EDEVNOTSUPP;
+
+  if ((res = pn532_SetSerialBaudRate(pnd, uiSpeed)) < 0)
+    return res;
+  // The PN532 switches once it gets our ACK, the port drains it before switching too
+  if ((res = pn532_uart_ack(pnd)) < 0)
+    return res;
+  uart_set_speed(sp, uiSpeed);
+  uart_flush_input(sp, true);
+
+  if (pn53x_check_communication(pnd) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Link does not hold %" PRIu32 " baud, falling back to %" PRIu32 " baud.", uiSpeed, uiCurrentSpeed);
+    uart_set_speed(sp, uiCurrentSpeed);
+    uart_flush_input(sp, true);
+    if ((res = pn53x_check_communication(pnd)) < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "PN532 lost while changing serial speed");
+      return res;
+    }
+    return NFC_EDEVNOTSUPP;
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Serial link switched to %" PRIu32 " baud.", uiSpeed);
+  return NFC_SUCCESS;
+}
+
+/*
+ * The PN532 always boots at the default speed but keeps a negotiated one until
+ * it is reset, so also look for it where a previous session may have left it.
+ */
+static int
+pn532_uart_probe(nfc_device *pnd, const uint32_t uiRequestedSpeed)
+{
+  serial_port sp = DRIVER_DATA(pnd)->port;
+  const uint32_t auiSpeeds[] = { PN532_UART_DEFAULT_SPEED, uart_get_remembered_speed(DRIVER_DATA(pnd)->port_name), uiRequestedSpeed };
+  int res = NFC_EIO;
+
+  for (size_t i = 0; i < sizeof(auiSpeeds) / sizeof(auiSpeeds[0]); i++) {
+    if ((auiSpeeds[i] == 0) || ((i > 0) && (auiSpeeds[i] == PN532_UART_DEFAULT_SPEED)) || ((i > 1) && (auiSpeeds[i] == auiSpeeds[1])))
+      continue;
+    uart_set_speed(sp, auiSpeeds[i]);
+    if (uart_get_speed(sp) != auiSpeeds[i])
+      continue;
+    uart_flush_input(sp, true);
+    // Wake the chip up again in case the previous attempt was not understood
+    CHIP_DATA(pnd)->power_mode = LOWVBAT;
+    // Check communication using "Diagnose" command, with "Communication test" (0x00)
+    if ((res = pn53x_check_communication(pnd)) == 0)
+      return NFC_SUCCESS;
+  }
+  return res;
+}
+
+// Only fails when the PN532 does not answer anymore, not when it stays at its current speed
+static int
+pn532_uart_negotiate(nfc_device *pnd, const struct pn532_uart_descriptor *pndd)
+{
+  const uint32_t uiRemembered = uart_get_remembered_speed(DRIVER_DATA(pnd)->port_name);
+  int res = 0;
+
+  if (!pndd->auto_speed) {
+    if ((res = pn532_uart_set_baud_rate(pnd, pndd->speed)) == NFC_EDEVNOTSUPP) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to switch to %" PRIu32 " baud, staying at %" PRIu32 " baud.", pndd->speed, uart_get_speed(DRIVER_DATA(pnd)->port));
+      return NFC_SUCCESS;
+    }
+    return res;
+  }
+  if ((uiRemembered != 0) && ((res = pn532_uart_set_baud_rate(pnd, uiRemembered)) != NFC_EDEVNOTSUPP))
+    return res;
+  for (size_t i = 0; i < sizeof(pn532_uart_auto_speeds) / sizeof(pn532_uart_auto_speeds[0]); i++) {
+    if ((res = pn532_uart_set_baud_rate(pnd, pn532_uart_auto_speeds[i])) != NFC_EDEVNOTSUPP)
+      return res;
+  }
+  return NFC_SUCCESS;
+}
+
 static void
 pn532_uart_close(nfc_device *pnd)
 {
+  pn53x_power_stop(pnd);
+
+  // Hand the PN532 back at the speed everyone expects, the negotiated one stays remembered
+  if (uart_get_speed(DRIVER_DATA(pnd)->port) != PN532_UART_DEFAULT_SPEED)
+    pn532_uart_set_baud_rate(pnd, PN532_UART_DEFAULT_SPEED);
+
   pn53x_idle(pnd);
 
   // Release UART port
   uart_close(DRIVER_DATA(pnd)->port);
 
-#ifndef WIN32
-  // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->iAbortFds[0]);
-  close(DRIVER_DATA(pnd)->iAbortFds[1]);
-#endif
-
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -206,15 +254,20 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   struct pn532_uart_descriptor ndd;
   char *speed_s;
   int connstring_decode_level = connstring_decode(connstring, PN532_UART_DRIVER_NAME, NULL, &ndd.port, &speed_s);
+  ndd.auto_speed = false;
   if (connstring_decode_level == 3) {
     ndd.speed = 0;
-    if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
+    if (strcmp(speed_s, "auto") == 0) {
+      // Negotiate the fastest speed both ends can hold
+      ndd.auto_speed = true;
+      ndd.speed = PN532_UART_DEFAULT_SPEED;
+    } else if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
+      nfc_pool_free(ndd.port);
+      nfc_pool_free(speed_s);
       return NULL;
     }
-    free(speed_s);
+    nfc_pool_free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -225,7 +278,7 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   serial_port sp;
   nfc_device *pnd = NULL;
 
-  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Attempt to open: %s at %d baud.", ndd.port, ndd.speed);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Attempt to open: %s at %s%d baud.", ndd.port, ndd.auto_speed ? "up to " : "", ndd.auto_speed ? (int) pn532_uart_auto_speeds[0] : (int) ndd.speed);
   sp = uart_open(ndd.port);
 
   if (sp == INVALID_SERIAL_PORT)
@@ -233,32 +286,38 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == CLAIMED_SERIAL_PORT)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Serial port already claimed: %s", ndd.port);
   if ((sp == CLAIMED_SERIAL_PORT) || (sp == INVALID_SERIAL_PORT)) {
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     return NULL;
   }
   // We need to flush input to be sure first reply does not comes from older byte transceive
   uart_flush_input(sp, true);
-  uart_set_speed(sp, ndd.speed);
+  // The PN532 starts at its default speed, the requested one is negotiated later
+  uart_set_speed(sp, PN532_UART_DEFAULT_SPEED);
 
   // We have a connection
   pnd = nfc_device_new(context, connstring);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
+    nfc_pool_free(ndd.port);
     uart_close(sp);
     return NULL;
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", PN532_UART_DRIVER_NAME, ndd.port);
-  free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct pn532_uart_data));
+  pnd->driver_data = nfc_pool_alloc(&pn532_uart_data_pool);
   if (!pnd->driver_data) {
     perror("malloc");
+    nfc_pool_free(ndd.port);
     uart_close(sp);
     nfc_device_free(pnd);
     return NULL;
   }
   DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->bAckPending = false;
+  DRIVER_DATA(pnd)->bInSync = false;
+  snprintf(DRIVER_DATA(pnd)->port_name, sizeof(DRIVER_DATA(pnd)->port_name), "%s", ndd.port);
+  nfc_pool_free(ndd.port);
+  ndd.port = NULL;
 
   // Alloc and init chip's data
   if (pn53x_data_new(pnd, &pn532_uart_io) == NULL) {
@@ -276,24 +335,22 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   CHIP_DATA(pnd)->timer_correction = 48;
   pnd->driver = &pn532_uart_driver;
 
-#ifndef WIN32
-  // pipe-based abort mecanism
-  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-    uart_close(DRIVER_DATA(pnd)->port);
-    pn53x_data_free(pnd);
-    nfc_device_free(pnd);
+  if (pn532_uart_probe(pnd, ndd.speed) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "pn53x_check_communication error");
+    // Nobody to restore the speed of
+    uart_set_speed(DRIVER_DATA(pnd)->port, PN532_UART_DEFAULT_SPEED);
+    pn532_uart_close(pnd);
     return NULL;
   }
-#else
-  DRIVER_DATA(pnd)->abort_flag = false;
-#endif
 
-  // Check communication using "Diagnose" command, with "Communication test" (0x00)
-  if (pn53x_check_communication(pnd) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "pn53x_check_communication error");
+  if ((ndd.auto_speed || (ndd.speed != uart_get_speed(DRIVER_DATA(pnd)->port))) && (pn532_uart_negotiate(pnd, &ndd) < 0)) {
+    uart_remember_speed(DRIVER_DATA(pnd)->port_name, 0);
+    uart_set_speed(DRIVER_DATA(pnd)->port, PN532_UART_DEFAULT_SPEED);
     pn532_uart_close(pnd);
     return NULL;
   }
+  const uint32_t uiSpeed = uart_get_speed(DRIVER_DATA(pnd)->port);
+  uart_remember_speed(DRIVER_DATA(pnd)->port_name, (uiSpeed != PN532_UART_DEFAULT_SPEED) ? uiSpeed : 0);
 
   pn53x_init(pnd);
   return pnd;
@@ -314,8 +371,12 @@ static int
 pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
 {
   int res = 0;
-  // Before sending anything, we need to discard from any junk bytes
-  uart_flush_input(DRIVER_DATA(pnd)->port, false);
+  // Junk bytes are only expected after an error, a timeout or an abort: once the last
+  // answer was parsed to its end, the line is known to be empty and needs no flush
+  if (!DRIVER_DATA(pnd)->bInSync)
+    uart_flush_input(DRIVER_DATA(pnd)->port, false);
+  DRIVER_DATA(pnd)->bInSync = false;
+  DRIVER_DATA(pnd)->bAckPending = false;
 
   switch (CHIP_DATA(pnd)->power_mode) {
     case LOWVBAT: {
@@ -340,23 +401,35 @@ pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, in
       break;
   };
 
-  uint8_t  abtFrame[PN532_BUFFER_LEN] = { 0x00, 0x00, 0xff };       // Every packet must start with "00 00 ff"
+  const size_t szScratch = pn53x_scratch_mark(pnd);
   size_t szFrame = 0;
+  uint8_t *abtFrame = pn53x_frame_tx(pnd, pbtData, szData, 0, &szFrame);
 
-  if ((res = pn53x_build_frame(abtFrame, &szFrame, pbtData, szData)) < 0) {
-    pnd->last_error = res;
+  if (!abtFrame) {
+    pn53x_scratch_release(pnd, szScratch);
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_BUILD);
 
   res = uart_send(DRIVER_DATA(pnd)->port, abtFrame, szFrame, timeout);
+  pn53x_scratch_release(pnd, szScratch);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to transmit data. (TX)");
     pnd->last_error = res;
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
+
+  // Optimistic mode: the ACK is read by pn532_uart_receive() together with the answer
+  // header, in one wakeup. Not for asynchronous exchanges, where receiving must not wait
+  // for the answer once the port gets readable.
+  if (!CHIP_DATA(pnd)->async.bPending) {
+    DRIVER_DATA(pnd)->bAckPending = true;
+    return NFC_SUCCESS;
+  }
 
   uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
-  res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), 0, timeout);
+  res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), false, timeout);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to read ACK");
     pnd->last_error = res;
@@ -374,125 +447,36 @@ pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, in
 static int
 pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  uint8_t  abtRxBuf[5];
-  size_t len;
-  void *abort_p = NULL;
+  uint8_t  abtRxBuf[PN53x_ACK_FRAME__LEN + PN53x_EXTENDED_FRAME__OVERHEAD + PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  struct pn53x_frame_parser parser;
 
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[1]);
-#else
-  abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
-#endif
+  // The ACK frame, when still expected, is checked along with the answer
+  pn53x_frame_parser_init(&parser, pnd, DRIVER_DATA(pnd)->bAckPending);
+  DRIVER_DATA(pnd)->bAckPending = false;
+  const int res = uart_receive_frame(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), pn53x_frame_parse, &parser, true, timeout);
 
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, timeout);
-
-  if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
+  if (NFC_EOPABORTED == res) {
     pn532_uart_ack(pnd);
     return NFC_EOPABORTED;
   }
 
-  if (pnd->last_error < 0) {
-    goto error;
-  }
-
-  const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
-  if (0 != (memcmp(abtRxBuf, pn53x_preamble, 3))) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame preamble+start code mismatch");
-    pnd->last_error = NFC_EIO;
-    goto error;
-  }
-
-  if ((0x01 == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
-    // Error frame
-    uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
-    pnd->last_error = NFC_EIO;
-    goto error;
-  } else if ((0xff == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
-    // Extended frame
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      goto error;
-    }
-    // (abtRxBuf[0] << 8) + abtRxBuf[1] (LEN) include TFI + (CC+1)
-    len = (abtRxBuf[0] << 8) + abtRxBuf[1] - 2;
-    if (((abtRxBuf[0] + abtRxBuf[1] + abtRxBuf[2]) % 256) != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
-      pnd->last_error = NFC_EIO;
-      goto error;
-    }
-  } else {
-    // Normal frame
-    if (256 != (abtRxBuf[3] + abtRxBuf[4])) {
-      // TODO: Retry
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
-      pnd->last_error = NFC_EIO;
-      goto error;
-    }
-
-    // abtRxBuf[3] (LEN) include TFI + (CC+1)
-    len = abtRxBuf[3] - 2;
-  }
-
-  if (len > szDataLen) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
-    pnd->last_error = NFC_EIO;
-    goto error;
-  }
-
-  // TFI + PD0 (CC+1)
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    goto error;
-  }
-
-  if (abtRxBuf[0] != 0xD5) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
-    pnd->last_error = NFC_EIO;
-    goto error;
-  }
-
-  if (abtRxBuf[1] != CHIP_DATA(pnd)->last_command + 1) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
-    pnd->last_error = NFC_EIO;
-    goto error;
-  }
-
-  if (len) {
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, pbtData, len, 0, timeout);
-    if (pnd->last_error != 0) {
+  if (res < 0) {
+    if (res != NFC_EIO)
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      goto error;
-    }
-  }
-
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
+    pnd->last_error = (res == NFC_EOVFLOW) ? NFC_EIO : res;
     goto error;
   }
 
-  uint8_t btDCS = (256 - 0xD5);
-  btDCS -= CHIP_DATA(pnd)->last_command + 1;
-  for (size_t szPos = 0; szPos < len; szPos++) {
-    btDCS -= pbtData[szPos];
-  }
-
-  if (btDCS != abtRxBuf[0]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
-    pnd->last_error = NFC_EIO;
-    goto error;
-  }
-
-  if (0x00 != abtRxBuf[1]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
+  if (parser.szDataLen > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, parser.szDataLen);
     pnd->last_error = NFC_EIO;
     goto error;
   }
+  memcpy(pbtData, abtRxBuf + parser.szDataPos, parser.szDataLen);
+  // Bytes read past the answer would belong to no command
+  DRIVER_DATA(pnd)->bInSync = (uart_pending(DRIVER_DATA(pnd)->port) == 0);
   // The PN53x command is done and we successfully received the reply
-  return len;
+  return parser.szDataLen;
 error:
   uart_flush_input(DRIVER_DATA(pnd)->port, true);
   return pnd->last_error;
@@ -513,22 +497,27 @@ pn532_uart_ack(nfc_device *pnd)
 static int
 pn532_uart_abort_command(nfc_device *pnd)
 {
-  if (pnd) {
-#ifndef WIN32
-    close(DRIVER_DATA(pnd)->iAbortFds[0]);
-    if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-      return NFC_ESOFT;
-    }
-#else
-    DRIVER_DATA(pnd)->abort_flag = true;
-#endif
-  }
-  return NFC_SUCCESS;
+  // Wakes up the receive in progress, if any, see uart_abort()
+  return uart_abort(DRIVER_DATA(pnd)->port);
+}
+
+static int
+pn532_uart_get_fd(struct nfc_device *pnd)
+{
+  return uart_get_fd(DRIVER_DATA(pnd)->port);
+}
+
+static size_t
+pn532_uart_pending(struct nfc_device *pnd)
+{
+  return uart_pending(DRIVER_DATA(pnd)->port);
 }
 
 const struct pn53x_io pn532_uart_io = {
   .send       = pn532_uart_send,
   .receive    = pn532_uart_receive,
+  .get_fd     = pn532_uart_get_fd,
+  .pending    = pn532_uart_pending,
 };
 
 const struct nfc_driver pn532_uart_driver = {
@@ -543,6 +532,10 @@ const struct nfc_driver pn532_uart_driver = {
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -550,21 +543,32 @@ const struct nfc_driver pn532_uart_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
 
   .abort_command  = pn532_uart_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
 
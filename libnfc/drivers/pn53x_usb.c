@@ -73,6 +73,8 @@ typedef enum {
   SONY_RCS360
 } pn53x_usb_model;
 
+#define PN53X_USB_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
+
 // Internal data struct
 struct pn53x_usb_data {
   usb_dev_handle *pudh;
@@ -82,8 +84,12 @@ struct pn53x_usb_data {
   uint32_t uiMaxPacketSize;
   volatile bool abort_flag;
   bool possibly_corrupted_usbdesc;
+  // Last answer frame, parsed in place by pn53x_usb_receive_view()
+  uint8_t abtRxBuf[PN53X_USB_BUFFER_LEN];
 };
 
+NFC_POOL(pn53x_usb_data_pool, struct pn53x_usb_data, NFC_POOL_DEVICES);
+
 // Internal io struct
 const struct pn53x_io pn53x_usb_io;
 
@@ -95,6 +101,7 @@ static int
 pn53x_usb_bulk_read(struct pn53x_usb_data *data, uint8_t abtRx[], const size_t szRx, const int timeout)
 {
   int res = usb_bulk_read(data->pudh, data->uiEndPointIn, (char *) abtRx, szRx, timeout);
+  NFC_PROBE3(usb__bulk_read, szRx, timeout, res);
   if (res > 0) {
     LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, res);
   } else if (res < 0) {
@@ -109,6 +116,7 @@ pn53x_usb_bulk_write(struct pn53x_usb_data *data, uint8_t abtTx[], const size_t
 {
   LOG_HEX(NFC_LOG_GROUP_COM, "TX", abtTx, szTx);
   int res = usb_bulk_write(data->pudh, data->uiEndPointOut, (char *) abtTx, szTx, timeout);
+  NFC_PROBE3(usb__bulk_write, szTx, timeout, res);
   if (res > 0) {
     // HACK This little hack is a well know problem of USB, see http://www.libusb.org/ticket/6 for more details
     if ((res % data->uiMaxPacketSize) == 0) {
@@ -321,22 +329,25 @@ pn53x_usb_scan(const nfc_context *context, nfc_connstring connstrings[], const s
             }
           }
 
-          usb_dev_handle *udev = usb_open(dev);
-          if (udev == NULL)
-            continue;
+          // Devices a previous scan could use are not opened again, names are read by nfc_device_get_name()
+          if (!usb_scan_cache_find(PN53X_USB_DRIVER_NAME, dev)) {
+            usb_dev_handle *udev = usb_open(dev);
+            if (udev == NULL)
+              continue;
 
-          // Set configuration
-          int res = usb_set_configuration(udev, 1);
-          if (res < 0) {
-            log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", _usb_strerror(res));
+            // Set configuration
+            int res = usb_set_configuration(udev, 1);
+            if (res < 0) {
+              log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", _usb_strerror(res));
+              usb_close(udev);
+              // we failed to use the device
+              continue;
+            }
             usb_close(udev);
-            // we failed to use the device
-            continue;
+            usb_scan_cache_add(PN53X_USB_DRIVER_NAME, dev);
           }
 
-          // pn53x_usb_get_usb_device_name (dev, udev, pnddDevices[device_found].acDevice, sizeof (pnddDevices[device_found].acDevice));
           log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s", bus->dirname, dev->filename);
-          usb_close(udev);
           snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", PN53X_USB_DRIVER_NAME, bus->dirname, dev->filename);
           device_found++;
           // Test if we reach the maximum "wanted" devices
@@ -384,6 +395,18 @@ pn53x_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, char
   return false;
 }
 
+static void
+pn53x_usb_get_name(nfc_device *pnd)
+{
+  struct usb_device *dev = usb_device(DRIVER_DATA(pnd)->pudh);
+
+  if (usb_scan_cache_get_name(PN53X_USB_DRIVER_NAME, dev, pnd->name, sizeof(pnd->name)))
+    return;
+  pn53x_usb_get_usb_device_name(dev, DRIVER_DATA(pnd)->pudh, pnd->name, sizeof(pnd->name));
+  usb_scan_cache_add(PN53X_USB_DRIVER_NAME, dev);
+  usb_scan_cache_set_name(PN53X_USB_DRIVER_NAME, dev, pnd->name);
+}
+
 static nfc_device *
 pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
 {
@@ -457,9 +480,7 @@ pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
         perror("malloc");
         goto error;
       }
-      pn53x_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
-
-      pnd->driver_data = malloc(sizeof(struct pn53x_usb_data));
+      pnd->driver_data = nfc_pool_alloc(&pn53x_usb_data_pool);
       if (!pnd->driver_data) {
         perror("malloc");
         goto error;
@@ -472,6 +493,13 @@ pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
         goto error;
       }
 
+      // Reading the string descriptors takes several control transfers: the name
+      // comes from the last open or is left to nfc_device_get_name()
+      nfc_connstring acWarmKey;
+      snprintf(acWarmKey, sizeof(acWarmKey), "%s:%s:%s:%04x:%04x", PN53X_USB_DRIVER_NAME, bus->dirname, dev->filename,
+               dev->descriptor.idVendor, dev->descriptor.idProduct);
+      pn53x_warm_lookup(pnd, acWarmKey);
+
       switch (DRIVER_DATA(pnd)->model) {
         // empirical tuning
         case ASK_LOGO:
@@ -514,17 +542,20 @@ pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
 
 error:
   // Free allocated structure on error.
+  if (pnd && pnd->chip_data)
+    pn53x_data_free(pnd);
   nfc_device_free(pnd);
   pnd = NULL;
 free_mem:
-  free(desc.dirname);
-  free(desc.filename);
+  nfc_pool_free(desc.dirname);
+  nfc_pool_free(desc.filename);
   return pnd;
 }
 
 static void
 pn53x_usb_close(nfc_device *pnd)
 {
+  pn53x_power_stop(pnd);
   pn53x_usb_ack(pnd);
 
   if (DRIVER_DATA(pnd)->model == ASK_LOGO) {
@@ -550,28 +581,32 @@ pn53x_usb_close(nfc_device *pnd)
   nfc_device_free(pnd);
 }
 
-#define PN53X_USB_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
 
 static int
 pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
 {
-  uint8_t  abtFrame[PN53X_USB_BUFFER_LEN] = { 0x00, 0x00, 0xff };  // Every packet must start with "00 00 ff"
+  const size_t szScratch = pn53x_scratch_mark(pnd);
   size_t szFrame = 0;
   int res = 0;
 
-  if ((res = pn53x_build_frame(abtFrame, &szFrame, pbtData, szData)) < 0) {
-    pnd->last_error = res;
+  uint8_t *abtFrame = pn53x_frame_tx(pnd, pbtData, szData, 0, &szFrame);
+  if (!abtFrame) {
+    pn53x_scratch_release(pnd, szScratch);
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_BUILD);
 
   DRIVER_DATA(pnd)->possibly_corrupted_usbdesc |= szData > 17;
-  if ((res = pn53x_usb_bulk_write(DRIVER_DATA(pnd), abtFrame, szFrame, timeout)) < 0) {
+  res = pn53x_usb_bulk_write(DRIVER_DATA(pnd), abtFrame, szFrame, timeout);
+  pn53x_scratch_release(pnd, szScratch);
+  if (res < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
 
-  uint8_t abtRxBuf[PN53X_USB_BUFFER_LEN];
-  if ((res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), timeout)) < 0) {
+  uint8_t *abtRxBuf = DRIVER_DATA(pnd)->abtRxBuf;
+  if ((res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, PN53X_USB_BUFFER_LEN, timeout)) < 0) {
     // try to interrupt current device state
     pn53x_usb_ack(pnd);
     pnd->last_error = res;
@@ -600,12 +635,12 @@ pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, con
 
 #define USB_TIMEOUT_PER_PASS 200
 static int
-pn53x_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+pn53x_usb_receive_view(nfc_device *pnd, const uint8_t **ppbtData, const int timeout)
 {
   size_t len;
   off_t offset = 0;
 
-  uint8_t  abtRxBuf[PN53X_USB_BUFFER_LEN];
+  uint8_t *abtRxBuf = DRIVER_DATA(pnd)->abtRxBuf;
   int res;
 
   /*
@@ -619,16 +654,17 @@ read:
     usb_timeout = USB_TIMEOUT_PER_PASS;
   } else {
     // A user-provided timeout is set, we have to cut it in multiple chunk to be able to keep an nfc_abort_command() mecanism
-    remaining_time -= USB_TIMEOUT_PER_PASS;
     if (remaining_time <= 0) {
+      // Cancel the command, so that its late answer is not read by the next one
+      pn53x_usb_ack(pnd);
       pnd->last_error = NFC_ETIMEOUT;
       return pnd->last_error;
-    } else {
-      usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
     }
+    usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
+    remaining_time -= usb_timeout;
   }
 
-  res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), usb_timeout);
+  res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, PN53X_USB_BUFFER_LEN, usb_timeout);
 
   if (res == -USB_TIMEDOUT) {
     if (DRIVER_DATA(pnd)->abort_flag) {
@@ -647,6 +683,8 @@ read:
     pnd->last_error = res;
     return pnd->last_error;
   }
+  // The whole frame comes in one transfer
+  NFC_TIMING_MARK(pnd, NFC_PHASE_FIRST_BYTE);
 
   const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
   if (0 != (memcmp(abtRxBuf, pn53x_preamble, 3))) {
@@ -688,12 +726,6 @@ read:
     offset += 2;
   }
 
-  if (len > szDataLen) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
   // TFI + PD0 (CC+1)
   if (abtRxBuf[offset] != 0xD5) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
@@ -709,7 +741,7 @@ read:
   }
   offset += 1;
 
-  memcpy(pbtData, abtRxBuf + offset, len);
+  const uint8_t *pbtData = abtRxBuf + offset;
   offset += len;
 
   uint8_t btDCS = (256 - 0xD5);
@@ -733,9 +765,28 @@ read:
   // The PN53x command is done and we successfully received the reply
   pnd->last_error = 0;
   DRIVER_DATA(pnd)->possibly_corrupted_usbdesc |= len > 16;
+  *ppbtData = pbtData;
   return len;
 }
 
+static int
+pn53x_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+{
+  const uint8_t *pbtFrame;
+  int res;
+
+  if ((res = pn53x_usb_receive_view(pnd, &pbtFrame, timeout)) < 0)
+    return res;
+
+  if ((size_t) res > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %d)", szDataLen, res);
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, pbtFrame, res);
+  return res;
+}
+
 int
 pn53x_usb_ack(nfc_device *pnd)
 {
@@ -803,34 +854,21 @@ pn53x_usb_init(nfc_device *pnd)
 }
 
 static int
-pn53x_usb_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable)
+pn53x_usb_set_field_leds(nfc_device *pnd, const bool bEnable)
 {
   int res = 0;
-  if ((res = pn53x_set_property_bool(pnd, property, bEnable)) < 0)
-    return res;
-
   switch (DRIVER_DATA(pnd)->model) {
     case ASK_LOGO:
-      if (NP_ACTIVATE_FIELD == property) {
-        /* Switch on/off LED2 and Progressive Field GPIO according to ACTIVATE_FIELD option */
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Switch progressive field %s", bEnable ? "On" : "Off");
-        if ((res = pn53x_write_register(pnd, PN53X_SFR_P3, _BV(P31) | _BV(P34), bEnable ? _BV(P34) : _BV(P31))) < 0)
-          return NFC_ECHIP;
-      }
+      /* Switch on/off LED2 and Progressive Field GPIO according to ACTIVATE_FIELD option */
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Switch progressive field %s", bEnable ? "On" : "Off");
+      if ((res = pn53x_write_register(pnd, PN53X_SFR_P3, _BV(P31) | _BV(P34), bEnable ? _BV(P34) : _BV(P31))) < 0)
+        return NFC_ECHIP;
       break;
     case SCM_SCL3711:
-      if (NP_ACTIVATE_FIELD == property) {
-        // Switch on/off LED according to ACTIVATE_FIELD option
-        if ((res = pn53x_write_register(pnd, PN53X_SFR_P3, _BV(P32), bEnable ? 0 : _BV(P32))) < 0)
-          return res;
-      }
-      break;
     case SCM_SCL3712:
-      if (NP_ACTIVATE_FIELD == property) {
-        // Switch on/off LED according to ACTIVATE_FIELD option
-        if ((res = pn53x_write_register(pnd, PN53X_SFR_P3, _BV(P32), bEnable ? 0 : _BV(P32))) < 0)
-          return res;
-      }
+      // Switch on/off LED according to ACTIVATE_FIELD option
+      if ((res = pn53x_write_register(pnd, PN53X_SFR_P3, _BV(P32), bEnable ? 0 : _BV(P32))) < 0)
+        return res;
       break;
     case NXP_PN531:
     case NXP_PN533:
@@ -843,6 +881,34 @@ pn53x_usb_set_property_bool(nfc_device *pnd, const nfc_property property, const
   return NFC_SUCCESS;
 }
 
+static int
+pn53x_usb_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable)
+{
+  int res = 0;
+  if ((res = pn53x_set_property_bool(pnd, property, bEnable)) < 0)
+    return res;
+
+  if (NP_ACTIVATE_FIELD == property)
+    return pn53x_usb_set_field_leds(pnd, bEnable);
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_usb_set_properties(nfc_device *pnd, const nfc_property_setting *pSettings, const size_t szSettings)
+{
+  int res = 0;
+  size_t i = szSettings;
+  if ((res = pn53x_set_properties(pnd, pSettings, szSettings)) < 0)
+    return res;
+
+  // LEDs follow the last field setting of the list
+  while (i--) {
+    if (NP_ACTIVATE_FIELD == pSettings[i].property)
+      return pn53x_usb_set_field_leds(pnd, pSettings[i].value != 0);
+  }
+  return NFC_SUCCESS;
+}
+
 static int
 pn53x_usb_abort_command(nfc_device *pnd)
 {
@@ -863,6 +929,7 @@ pn53x_usb_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const n
 const struct pn53x_io pn53x_usb_io = {
   .send       = pn53x_usb_send,
   .receive    = pn53x_usb_receive,
+  .receive_view = pn53x_usb_receive_view,
 };
 
 const struct nfc_driver pn53x_usb_driver = {
@@ -877,6 +944,10 @@ const struct nfc_driver pn53x_usb_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -884,20 +955,32 @@ const struct nfc_driver pn53x_usb_driver = {
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
 
   .device_set_property_bool     = pn53x_usb_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_usb_set_properties,
   .get_supported_modulation     = pn53x_usb_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
+  .device_get_name = pn53x_usb_get_name,
 
   .abort_command  = pn53x_usb_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
 };
@@ -0,0 +1,387 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file replay.c
+ * @brief Virtual driver replaying a pcapng capture
+ *
+ * Serves the PN53x answers recorded by nfc_device_set_trace() (or the
+ * LIBNFC_TRACE_FILE environment variable) so that the whole pn53x stack runs
+ * without any hardware, at memory speed.
+ *
+ * Connstring: replay:/path/to/capture.pcapng
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define REPLAY_DRIVER_NAME "replay"
+
+#define LOG_CATEGORY "libnfc.driver.replay"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+// pcapng blocks and options, see nfc-trace.c
+#define PCAPNG_SHB             0x0A0D0D0A
+#define PCAPNG_EPB             0x00000006
+#define PCAPNG_BYTE_ORDER      0x1A2B3C4D
+#define PCAPNG_OPT_EPB_FLAGS   2
+#define PCAPNG_EPB_OUTBOUND    0x2
+
+struct replay_frame {
+  bool bOutbound;
+  size_t szData;
+  uint8_t *pbtData;
+};
+
+// Internal data structs
+const struct pn53x_io replay_io;
+struct replay_data {
+  struct replay_frame *frames;
+  size_t szFrames;
+  size_t szCursor;
+  volatile bool abort_flag;
+};
+
+NFC_POOL(replay_data_pool, struct replay_data, NFC_POOL_DEVICES);
+
+#define DRIVER_DATA(pnd) ((struct replay_data*)(pnd->driver_data))
+
+static uint32_t
+replay_get_u32(const uint8_t *pbt)
+{
+  uint32_t u32;
+  memcpy(&u32, pbt, sizeof(u32));
+  return u32;
+}
+
+static uint16_t
+replay_get_u16(const uint8_t *pbt)
+{
+  uint16_t u16;
+  memcpy(&u16, pbt, sizeof(u16));
+  return u16;
+}
+
+static void
+replay_frames_free(struct replay_data *data)
+{
+  for (size_t i = 0; i < data->szFrames; i++)
+    free(data->frames[i].pbtData);
+  free(data->frames);
+  data->frames = NULL;
+  data->szFrames = 0;
+}
+
+// Direction is taken from the epb_flags option, frames without it are dropped
+static int
+replay_parse_epb(struct replay_data *data, const uint8_t *pbtBlock, const size_t szBlock)
+{
+  if (szBlock < 32)
+    return NFC_EIO;
+  const size_t szCaptured = replay_get_u32(pbtBlock + 20);
+  const size_t szPadded = (szCaptured + 3) & ~((size_t) 3);
+  if (28 + szPadded + 4 > szBlock)
+    return NFC_EIO;
+
+  bool bDirection = false;
+  bool bOutbound = false;
+  size_t szOffset = 28 + szPadded;
+  while (szOffset + 4 <= szBlock - 4) {
+    const uint16_t code = replay_get_u16(pbtBlock + szOffset);
+    const uint16_t len = replay_get_u16(pbtBlock + szOffset + 2);
+    if (code == 0)
+      break;
+    if ((code == PCAPNG_OPT_EPB_FLAGS) && (len == 4) && (szOffset + 8 <= szBlock - 4)) {
+      bDirection = true;
+      bOutbound = (replay_get_u32(pbtBlock + szOffset + 4) & 0x3) == PCAPNG_EPB_OUTBOUND;
+    }
+    szOffset += 4 + ((len + 3) & ~3);
+  }
+  if (!bDirection)
+    return NFC_SUCCESS;
+
+  if ((data->szFrames % 64) == 0) {
+    struct replay_frame *frames = realloc(data->frames, (data->szFrames + 64) * sizeof(struct replay_frame));
+    if (frames == NULL)
+      return NFC_ESOFT;
+    data->frames = frames;
+  }
+  struct replay_frame *frame = &data->frames[data->szFrames];
+  frame->bOutbound = bOutbound;
+  frame->szData = szCaptured;
+  frame->pbtData = malloc(szCaptured ? szCaptured : 1);
+  if (frame->pbtData == NULL)
+    return NFC_ESOFT;
+  memcpy(frame->pbtData, pbtBlock + 28, szCaptured);
+  data->szFrames++;
+  return NFC_SUCCESS;
+}
+
+static int
+replay_load(struct replay_data *data, const char *pcFilename)
+{
+  FILE *f = fopen(pcFilename, "rb");
+  if (f == NULL) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open capture file: %s", pcFilename);
+    return NFC_ESOFT;
+  }
+
+  int res = NFC_SUCCESS;
+  uint8_t abtHeader[8];
+  while (fread(abtHeader, sizeof(abtHeader), 1, f) == 1) {
+    const uint32_t ui32Type = replay_get_u32(abtHeader);
+    const uint32_t ui32Len = replay_get_u32(abtHeader + 4);
+    if ((ui32Len < 12) || (ui32Len % 4)) {
+      res = NFC_EIO;
+      break;
+    }
+    uint8_t *pbtBlock = malloc(ui32Len);
+    if (pbtBlock == NULL) {
+      res = NFC_ESOFT;
+      break;
+    }
+    memcpy(pbtBlock, abtHeader, sizeof(abtHeader));
+    if (fread(pbtBlock + sizeof(abtHeader), ui32Len - sizeof(abtHeader), 1, f) != 1) {
+      free(pbtBlock);
+      res = NFC_EIO;
+      break;
+    }
+    if (ui32Type == PCAPNG_SHB) {
+      // Captures are written in host byte order, that is all we can replay
+      if (replay_get_u32(pbtBlock + 8) != PCAPNG_BYTE_ORDER)
+        res = NFC_EIO;
+    } else if (ui32Type == PCAPNG_EPB) {
+      res = replay_parse_epb(data, pbtBlock, ui32Len);
+    }
+    free(pbtBlock);
+    if (res < 0)
+      break;
+  }
+  fclose(f);
+
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid capture file: %s", pcFilename);
+    replay_frames_free(data);
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%ld frame(s) loaded from %s", (unsigned long) data->szFrames, pcFilename);
+  }
+  return res;
+}
+
+static size_t
+replay_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  // A capture file can't be discovered, it has to be given by connstring
+  return 0;
+}
+
+static void
+replay_close(nfc_device *pnd)
+{
+  pn53x_power_stop(pnd);
+  replay_frames_free(DRIVER_DATA(pnd));
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+replay_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  char *pcFilename;
+  if (connstring_decode(connstring, REPLAY_DRIVER_NAME, NULL, &pcFilename, NULL) < 2) {
+    return NULL;
+  }
+
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    nfc_pool_free(pcFilename);
+    return NULL;
+  }
+  snprintf(pnd->name, sizeof(pnd->name), "%s:%s", REPLAY_DRIVER_NAME, pcFilename);
+
+  pnd->driver_data = nfc_pool_zalloc(&replay_data_pool);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    nfc_pool_free(pcFilename);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  if (replay_load(DRIVER_DATA(pnd), pcFilename) < 0) {
+    nfc_pool_free(pcFilename);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  nfc_pool_free(pcFilename);
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &replay_io) == NULL) {
+    perror("malloc");
+    replay_frames_free(DRIVER_DATA(pnd));
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  // Real chip type will be set by the GetFirmwareVersion recorded in pn53x_init()
+  CHIP_DATA(pnd)->type = PN532;
+  pnd->driver = &replay_driver;
+  DRIVER_DATA(pnd)->abort_flag = false;
+
+  // Frames sent by the recording driver before pn53x_init() are skipped by replay_send()
+  if (pn53x_init(pnd) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Capture does not start with device initialization");
+    replay_close(pnd);
+    return NULL;
+  }
+  return pnd;
+}
+
+static int
+replay_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  struct replay_data *data = DRIVER_DATA(pnd);
+  (void) timeout;
+
+  // Go to the next recording of this very frame, skipping what the recording
+  // driver did on its own (e.g. driver-specific setup)
+  for (size_t i = data->szCursor; i < data->szFrames; i++) {
+    const struct replay_frame *frame = &data->frames[i];
+    if (frame->bOutbound && (frame->szData == szData) && (0 == memcmp(frame->pbtData, pbtData, szData))) {
+      data->szCursor = i + 1;
+      return NFC_SUCCESS;
+    }
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Frame not found in capture (command 0x%02x)", pbtData[0]);
+  data->szCursor = data->szFrames;
+  pnd->last_error = NFC_EIO;
+  return pnd->last_error;
+}
+
+static int
+replay_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  struct replay_data *data = DRIVER_DATA(pnd);
+  (void) timeout;
+
+  if (data->abort_flag) {
+    data->abort_flag = false;
+    pnd->last_error = NFC_EOPABORTED;
+    return pnd->last_error;
+  }
+  if ((data->szCursor >= data->szFrames) || data->frames[data->szCursor].bOutbound) {
+    // No answer was recorded
+    pnd->last_error = NFC_ETIMEOUT;
+    return pnd->last_error;
+  }
+  const struct replay_frame *frame = &data->frames[data->szCursor++];
+  if (frame->szData > szDataLen) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, frame->pbtData, frame->szData);
+  return (int) frame->szData;
+}
+
+static int
+replay_abort_command(nfc_device *pnd)
+{
+  if (pnd) {
+    DRIVER_DATA(pnd)->abort_flag = true;
+  }
+  return NFC_SUCCESS;
+}
+
+const struct pn53x_io replay_io = {
+  .send       = replay_send,
+  .receive    = replay_receive,
+};
+
+const struct nfc_driver replay_driver = {
+  .name                             = REPLAY_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = replay_scan,
+  .open                             = replay_open,
+  .close                            = replay_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = NULL, // No secure-element support
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_reactivate_target      = pn53x_initiator_reactivate_target,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .dep_write             = pn53x_dep_write,
+  .dep_read              = pn53x_dep_read,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
+
+  .abort_command  = replay_abort_command,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
+};
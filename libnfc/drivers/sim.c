@@ -0,0 +1,620 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file sim.c
+ * @brief Virtual driver simulating a PN532 chip
+ *
+ * The chip model answers the PN53x commands used by libnfc, with a register
+ * file for ReadRegister/WriteRegister, and at most one simulated card attached
+ * with nfc_sim_attach_target(): MIFARE Classic (READ, WRITE, value blocks,
+ * authentication always granted), MIFARE Ultralight (READ, WRITE) or FeliCa
+ * (polling only).
+ *
+ * Connstring: sim[:name[:latency]], latency being the simulated round-trip
+ * bus time in microseconds (default: 0).
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "sim.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#ifndef _WIN32
+#  include <time.h>
+#  define usleep_sim(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = (x) / 1000000; \
+    xsleep.tv_nsec = ((x) % 1000000) * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <winbase.h>
+#  define usleep_sim(x) Sleep((x) / 1000)
+#endif
+
+#define SIM_DRIVER_NAME "sim"
+// Step used to wait for a card or an abort in blocking commands
+#define SIM_WAIT_STEP_US 10000
+
+#define LOG_CATEGORY "libnfc.driver.sim"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+// Internal data structs
+const struct pn53x_io sim_io;
+struct sim_data {
+  uint32_t latency_us;
+  // CIU (0x63xx) and SFR (0xFFxx) registers, other addresses read as 0
+  uint8_t abtCiu[256];
+  uint8_t abtSfr[256];
+  // Attached card
+  volatile bool bCardPresent;
+  bool bCardSelected;
+  nfc_target ntCard;
+  uint8_t *pbtMemory;
+  size_t szMemory;
+  // MIFARE Classic transfer buffer, filled by DECREMENT/INCREMENT/RESTORE
+  bool bTransfer;
+  uint8_t abtTransfer[4];
+  uint8_t btTransferAddr;
+  // Answer to the last command, handed back by sim_receive()
+  int iRxRes;
+  size_t szRx;
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  volatile bool abort_flag;
+};
+
+NFC_POOL(sim_data_pool, struct sim_data, NFC_POOL_DEVICES);
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+
+static uint8_t *
+sim_register(struct sim_data *data, const uint16_t ui16Reg)
+{
+  switch (ui16Reg >> 8) {
+    case 0x63:
+      return &data->abtCiu[ui16Reg & 0xff];
+    case 0xff:
+      return &data->abtSfr[ui16Reg & 0xff];
+    default:
+      return NULL;
+  }
+}
+
+static bool
+sim_card_is_mifare_classic(const struct sim_data *data)
+{
+  return (data->ntCard.nm.nmt == NMT_ISO14443A) && (data->ntCard.nti.nai.btSak & 0x08);
+}
+
+// A MIFARE Classic value block holds value, ~value, value, then addr, ~addr, addr, ~addr
+static bool
+sim_is_value_block(const uint8_t *pbtBlock)
+{
+  for (size_t i = 0; i < 4; i++) {
+    if ((pbtBlock[i] != pbtBlock[8 + i]) || (pbtBlock[i] != (uint8_t) ~pbtBlock[4 + i]))
+      return false;
+  }
+  return (pbtBlock[12] == pbtBlock[14]) && (pbtBlock[13] == pbtBlock[15]) && (pbtBlock[12] == (uint8_t) ~pbtBlock[13]);
+}
+
+// Append target data as returned by InListPassiveTarget/InAutoPoll (Tg included)
+static size_t
+sim_target_data(const struct sim_data *data, uint8_t *pbt)
+{
+  size_t sz = 0;
+  pbt[sz++] = 1; // Tg
+  if (data->ntCard.nm.nmt == NMT_ISO14443A) {
+    const nfc_iso14443a_info *pnai = &data->ntCard.nti.nai;
+    pbt[sz++] = pnai->abtAtqa[0];
+    pbt[sz++] = pnai->abtAtqa[1];
+    pbt[sz++] = pnai->btSak;
+    pbt[sz++] = (uint8_t) pnai->szUidLen;
+    memcpy(pbt + sz, pnai->abtUid, pnai->szUidLen);
+    sz += pnai->szUidLen;
+    if (pnai->szAtsLen) {
+      pbt[sz++] = (uint8_t)(pnai->szAtsLen + 1);
+      memcpy(pbt + sz, pnai->abtAts, pnai->szAtsLen);
+      sz += pnai->szAtsLen;
+    }
+  } else {
+    const nfc_felica_info *pnfi = &data->ntCard.nti.nfi;
+    const uint8_t szLen = (pnfi->szLen > 18) ? 20 : 18;
+    pbt[sz++] = szLen;
+    pbt[sz++] = 0x01; // Response code
+    memcpy(pbt + sz, pnfi->abtId, 8);
+    sz += 8;
+    memcpy(pbt + sz, pnfi->abtPad, 8);
+    sz += 8;
+    if (szLen > 18) {
+      memcpy(pbt + sz, pnfi->abtSysCode, 2);
+      sz += 2;
+    }
+  }
+  return sz;
+}
+
+static bool
+sim_card_matches_modulation(const struct sim_data *data, const uint8_t btBrTy)
+{
+  const nfc_modulation *pnm = &data->ntCard.nm;
+  switch (btBrTy) {
+    case PM_ISO14443A_106:
+      return pnm->nmt == NMT_ISO14443A;
+    case PM_FELICA_212:
+      return (pnm->nmt == NMT_FELICA) && (pnm->nbr != NBR_424);
+    case PM_FELICA_424:
+      return (pnm->nmt == NMT_FELICA) && (pnm->nbr != NBR_212);
+    default:
+      return false;
+  }
+}
+
+static bool
+sim_card_matches_target_type(const struct sim_data *data, const uint8_t btType)
+{
+  switch (btType) {
+    case PTT_GENERIC_PASSIVE_106:
+    case PTT_MIFARE:
+      return sim_card_matches_modulation(data, PM_ISO14443A_106);
+    case PTT_ISO14443_4A_106:
+      return sim_card_matches_modulation(data, PM_ISO14443A_106) && (data->ntCard.nti.nai.btSak & 0x20);
+    case PTT_GENERIC_PASSIVE_212:
+    case PTT_FELICA_212:
+      return sim_card_matches_modulation(data, PM_FELICA_212);
+    case PTT_GENERIC_PASSIVE_424:
+    case PTT_FELICA_424:
+      return sim_card_matches_modulation(data, PM_FELICA_424);
+    default:
+      return false;
+  }
+}
+
+// Process a frame sent to the selected card, fills the status byte and the card answer
+static void
+sim_card_exchange(struct sim_data *data, const uint8_t *pbtTx, const size_t szTx)
+{
+  uint8_t *pbtRx = data->abtRx;
+  data->szRx = 1;
+
+  if (!data->bCardPresent || !data->bCardSelected) {
+    pbtRx[0] = ETGREL;
+    return;
+  }
+  pbtRx[0] = ETIMEOUT; // Card stays mute unless it understands the frame
+  if ((data->ntCard.nm.nmt != NMT_ISO14443A) || (szTx < 2))
+    return;
+
+  const bool bClassic = sim_card_is_mifare_classic(data);
+  const size_t szBlock = bClassic ? 16 : 4;
+  const size_t szOffset = pbtTx[1] * szBlock;
+  if (szOffset >= data->szMemory)
+    return;
+
+  switch (pbtTx[0]) {
+    case 0x30: // READ: 16 bytes, Ultralight wraps around its memory
+      for (size_t i = 0; i < 16; i++)
+        pbtRx[1 + i] = data->pbtMemory[(szOffset + i) % data->szMemory];
+      data->szRx += 16;
+      pbtRx[0] = 0;
+      break;
+    case 0xA0: // WRITE (or Ultralight COMPATIBILITY WRITE)
+      if ((szTx == 18) && (szOffset + szBlock <= data->szMemory)) {
+        memcpy(data->pbtMemory + szOffset, pbtTx + 2, szBlock);
+        pbtRx[0] = 0;
+      }
+      break;
+    case 0xA2: // Ultralight WRITE
+      if (!bClassic && (szTx == 6) && (szOffset + 4 <= data->szMemory)) {
+        memcpy(data->pbtMemory + szOffset, pbtTx + 2, 4);
+        pbtRx[0] = 0;
+      }
+      break;
+    case 0x60: // AUTH A
+    case 0x61: // AUTH B
+      pbtRx[0] = bClassic ? 0 : EMFAUTH;
+      break;
+    case 0xC0: // DECREMENT
+    case 0xC1: // INCREMENT
+    case 0xC2: { // RESTORE
+      // The card NAKs the command on a block which is not a value block
+      if (!bClassic || (szTx != 6) || (szOffset + 16 > data->szMemory) || !sim_is_value_block(data->pbtMemory + szOffset))
+        break;
+      const uint8_t *pbtValue = data->pbtMemory + szOffset;
+      uint32_t uiValue = pbtValue[0] | (pbtValue[1] << 8) | (pbtValue[2] << 16) | ((uint32_t) pbtValue[3] << 24);
+      const uint32_t uiOperand = pbtTx[2] | (pbtTx[3] << 8) | (pbtTx[4] << 16) | ((uint32_t) pbtTx[5] << 24);
+      if (pbtTx[0] == 0xC0)
+        uiValue -= uiOperand;
+      else if (pbtTx[0] == 0xC1)
+        uiValue += uiOperand;
+      for (size_t i = 0; i < 4; i++)
+        data->abtTransfer[i] = uiValue >> (8 * i);
+      data->btTransferAddr = pbtValue[12];
+      data->bTransfer = true;
+      pbtRx[0] = 0;
+      break;
+    }
+    case 0xB0: // TRANSFER: writes the transfer buffer, address byte included
+      if (bClassic && data->bTransfer && (szOffset + 16 <= data->szMemory)) {
+        uint8_t *pbtBlock = data->pbtMemory + szOffset;
+        for (size_t i = 0; i < 4; i++) {
+          pbtBlock[i] = pbtBlock[8 + i] = data->abtTransfer[i];
+          pbtBlock[4 + i] = ~data->abtTransfer[i];
+        }
+        pbtBlock[12] = pbtBlock[14] = data->btTransferAddr;
+        pbtBlock[13] = pbtBlock[15] = ~data->btTransferAddr;
+        data->bTransfer = false;
+        pbtRx[0] = 0;
+      }
+      break;
+  }
+}
+
+// Wait for a card or an abort, returns false when aborted
+static bool
+sim_wait_card(struct sim_data *data)
+{
+  while (!data->bCardPresent) {
+    if (data->abort_flag)
+      return false;
+    usleep_sim(SIM_WAIT_STEP_US);
+  }
+  return true;
+}
+
+static int
+sim_process(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const int timeout)
+{
+  struct sim_data *data = DRIVER_DATA(pnd);
+  uint8_t *pbtRx = data->abtRx;
+  data->szRx = 0;
+
+  switch (pbtTx[0]) {
+    case Diagnose:
+      if ((szTx >= 2) && (pbtTx[1] == 0x00)) { // Communication line test: echo
+        memcpy(pbtRx, pbtTx + 1, szTx - 1);
+        data->szRx = szTx - 1;
+      } else if ((szTx >= 2) && (pbtTx[1] == 0x06)) { // Card presence detection
+        pbtRx[0] = (data->bCardPresent && data->bCardSelected) ? 0 : ETIMEOUT;
+        data->szRx = 1;
+      } else {
+        pbtRx[0] = 0;
+        data->szRx = 1;
+      }
+      break;
+    case GetFirmwareVersion:
+      pbtRx[0] = 0x32; // PN532
+      pbtRx[1] = 0x01;
+      pbtRx[2] = 0x06;
+      pbtRx[3] = SUPPORT_ISO14443A | SUPPORT_ISO18092;
+      data->szRx = 4;
+      break;
+    case GetGeneralStatus:
+      memset(pbtRx, 0, 4); // No error, field off, no target, SAM status
+      data->szRx = 4;
+      break;
+    case ReadRegister:
+      for (size_t i = 1; i + 1 < szTx; i += 2) {
+        const uint8_t *pbtReg = sim_register(data, (pbtTx[i] << 8) | pbtTx[i + 1]);
+        pbtRx[data->szRx++] = pbtReg ? *pbtReg : 0x00;
+      }
+      break;
+    case WriteRegister:
+      for (size_t i = 1; i + 2 < szTx; i += 3) {
+        uint8_t *pbtReg = sim_register(data, (pbtTx[i] << 8) | pbtTx[i + 1]);
+        if (pbtReg)
+          *pbtReg = pbtTx[i + 2];
+      }
+      break;
+    case SetParameters:
+    case SAMConfiguration:
+    case RFConfiguration:
+      break;
+    case PowerDown:
+      pbtRx[0] = 0;
+      data->szRx = 1;
+      break;
+    case InListPassiveTarget:
+      pbtRx[0] = 0;
+      data->szRx = 1;
+      if (data->bCardPresent && (szTx >= 3) && sim_card_matches_modulation(data, pbtTx[2])) {
+        // ISO14443A initiator data selects a given UID
+        if ((pbtTx[2] == PM_ISO14443A_106) && (szTx > 3) &&
+            (((szTx - 3) != data->ntCard.nti.nai.szUidLen) || memcmp(pbtTx + 3, data->ntCard.nti.nai.abtUid, szTx - 3)))
+          break;
+        pbtRx[0] = 1;
+        data->szRx += sim_target_data(data, pbtRx + 1);
+        data->bCardSelected = true;
+      }
+      break;
+    case InAutoPoll: {
+      pbtRx[0] = 0;
+      data->szRx = 1;
+      if (szTx < 3)
+        break;
+      // Endless polling blocks until a card shows up
+      if ((pbtTx[1] == 0xff) && !sim_wait_card(data))
+        return NFC_EOPABORTED;
+      for (size_t i = 3; data->bCardPresent && (i < szTx); i++) {
+        if (sim_card_matches_target_type(data, pbtTx[i])) {
+          pbtRx[0] = 1;
+          pbtRx[1] = pbtTx[i];
+          pbtRx[2] = (uint8_t) sim_target_data(data, pbtRx + 3);
+          data->szRx = 3 + pbtRx[2];
+          data->bCardSelected = true;
+          break;
+        }
+      }
+    }
+    break;
+    case InDataExchange:
+      if (szTx < 2)
+        return NFC_EIO;
+      sim_card_exchange(data, pbtTx + 2, szTx - 2);
+      break;
+    case InCommunicateThru:
+      sim_card_exchange(data, pbtTx + 1, szTx - 1);
+      break;
+    case InSelect:
+      pbtRx[0] = data->bCardPresent ? 0 : ETGREL;
+      data->bCardSelected = data->bCardPresent;
+      data->szRx = 1;
+      break;
+    case InDeselect:
+    case InRelease:
+      data->bCardSelected = false;
+      pbtRx[0] = 0;
+      data->szRx = 1;
+      break;
+    case TgInitAsTarget:
+      // There is no simulated initiator, wait for the timeout or an abort
+      for (int elapsed = 0; (timeout <= 0) || (elapsed < timeout * 1000); elapsed += SIM_WAIT_STEP_US) {
+        if (data->abort_flag)
+          return NFC_EOPABORTED;
+        usleep_sim(SIM_WAIT_STEP_US);
+      }
+      return NFC_ETIMEOUT;
+    default:
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Command 0x%02x is not simulated", pbtTx[0]);
+      // The chip would send an error frame
+      return NFC_EIO;
+  }
+  return (int) data->szRx;
+}
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  // Simulated devices have to be requested by connstring
+  return 0;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  char *pcName = NULL;
+  char *pcLatency = NULL;
+  uint32_t latency_us = 0;
+  int connstring_decode_level = connstring_decode(connstring, SIM_DRIVER_NAME, NULL, &pcName, &pcLatency);
+  if (connstring_decode_level < 1) {
+    return NULL;
+  }
+  if (connstring_decode_level == 3) {
+    if (sscanf(pcLatency, "%10"PRIu32, &latency_us) != 1) {
+      // latency is not a number
+      nfc_pool_free(pcName);
+      nfc_pool_free(pcLatency);
+      return NULL;
+    }
+  }
+  nfc_pool_free(pcLatency);
+
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    nfc_pool_free(pcName);
+    return NULL;
+  }
+  snprintf(pnd->name, sizeof(pnd->name), "%s:%s", SIM_DRIVER_NAME, pcName ? pcName : "");
+  nfc_pool_free(pcName);
+
+  pnd->driver_data = nfc_pool_zalloc(&sim_data_pool);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  DRIVER_DATA(pnd)->latency_us = latency_us;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &sim_io) == NULL) {
+    perror("malloc");
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  // No SAMConfiguration needed to wake the simulated chip up
+  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pnd->driver = &sim_driver;
+  DRIVER_DATA(pnd)->abort_flag = false;
+
+  if (pn53x_init(pnd) < 0) {
+    sim_close(pnd);
+    return NULL;
+  }
+  return pnd;
+}
+
+static int
+sim_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  NFC_TIMING_MARK(pnd, NFC_PHASE_TX);
+  DRIVER_DATA(pnd)->iRxRes = sim_process(pnd, pbtData, szData, timeout);
+  return NFC_SUCCESS;
+}
+
+static int
+sim_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  struct sim_data *data = DRIVER_DATA(pnd);
+  (void) timeout;
+
+  if (data->latency_us)
+    usleep_sim(data->latency_us);
+  NFC_TIMING_MARK(pnd, NFC_PHASE_FIRST_BYTE);
+
+  if (data->abort_flag) {
+    data->abort_flag = false;
+    pnd->last_error = NFC_EOPABORTED;
+    return pnd->last_error;
+  }
+  if (data->iRxRes < 0) {
+    pnd->last_error = data->iRxRes;
+    return pnd->last_error;
+  }
+  if (data->szRx > szDataLen) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, data->abtRx, data->szRx);
+  return (int) data->szRx;
+}
+
+static int
+sim_abort_command(nfc_device *pnd)
+{
+  if (pnd) {
+    DRIVER_DATA(pnd)->abort_flag = true;
+  }
+  return NFC_SUCCESS;
+}
+
+int
+sim_attach_target(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtMemory, const size_t szMemory)
+{
+  if (pnd->driver != &sim_driver)
+    return NFC_EDEVNOTSUPP;
+  if ((pnt->nm.nmt != NMT_ISO14443A) && (pnt->nm.nmt != NMT_FELICA))
+    return NFC_EINVARG;
+
+  struct sim_data *data = DRIVER_DATA(pnd);
+  data->bCardPresent = false;
+  data->ntCard = *pnt;
+  data->pbtMemory = pbtMemory;
+  data->szMemory = pbtMemory ? szMemory : 0;
+  data->bCardSelected = false;
+  data->bCardPresent = true;
+  return NFC_SUCCESS;
+}
+
+int
+sim_detach_target(nfc_device *pnd)
+{
+  if (pnd->driver != &sim_driver)
+    return NFC_EDEVNOTSUPP;
+
+  struct sim_data *data = DRIVER_DATA(pnd);
+  data->bCardPresent = false;
+  data->bCardSelected = false;
+  data->pbtMemory = NULL;
+  data->szMemory = 0;
+  return NFC_SUCCESS;
+}
+
+const struct pn53x_io sim_io = {
+  .send       = sim_send,
+  .receive    = sim_receive,
+};
+
+const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = NULL, // No secure-element support
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_discover_targets       = pn53x_initiator_discover_targets,
+  .initiator_list_passive_targets   = pn53x_initiator_list_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .initiator_transceive_bytes_async = pn53x_initiator_transceive_bytes_async,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_transceive_bytes = pn53x_target_transceive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+  .target_emulate_raw    = pn53x_target_emulate_raw,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_property_int      = pn53x_set_property_int,
+  .device_set_properties        = pn53x_set_properties,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+  .device_get_capabilities      = pn53x_get_capabilities,
+
+  .abort_command  = sim_abort_command,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+  .get_pollable_fd = pn53x_get_pollable_fd,
+  .process_events = pn53x_process_events,
+};
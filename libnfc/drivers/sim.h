@@ -0,0 +1,42 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file sim.h
+ * @brief Virtual driver simulating a PN532 chip
+ */
+
+#ifndef __NFC_DRIVER_SIM_H__
+#define __NFC_DRIVER_SIM_H__
+
+#include <nfc/nfc-types.h>
+
+extern const struct nfc_driver sim_driver;
+
+int sim_attach_target(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtMemory, const size_t szMemory);
+int sim_detach_target(nfc_device *pnd);
+
+#endif // ! __NFC_DRIVER_SIM_H__
@@ -0,0 +1,1836 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file tcp.c
+ * @brief Driver for devices exported over the network by nfc_tcp_serve()
+ *
+ * Each driver operation is sent as a request made of an operation code, a
+ * request id (two bytes), the payload length (two bytes) and the payload. The
+ * server answers in order with the request id, the value returned by the
+ * remote driver (four bytes, signed), the payload length and the payload.
+ * Integers are big endian and targets are encoded field by field, so both
+ * ends do not need to share the same ABI.
+ *
+ * The server reads requests ahead while the previous one is being run: an
+ * abort request is honoured right away, and nfc_initiator_transceive_bytes_async()
+ * leaves the connection free for the application to prepare the next one.
+ * Batches (see nfc_batch_commit()) cross the network as a single request.
+ *
+ * Connstring: tcp:host:port
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "tcp.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#if defined (DRIVER_NFCD_ENABLED)
+#  include "nfcd.h"
+#endif /* DRIVER_NFCD_ENABLED */
+
+#define TCP_DRIVER_NAME "tcp"
+#define TCP_PROTOCOL_VERSION 1
+
+#define TCP_REQUEST_HEADER_LEN 5
+#define TCP_RESPONSE_HEADER_LEN 8
+#define TCP_PAYLOAD_MAX_LEN 0xFFFF
+// Targets listed at once by a single request
+#define TCP_MAX_TARGETS 32
+// Answer size of each batched frame
+#define TCP_BATCH_RX_MAX_LEN 1024
+// Requests read ahead by the server
+#define TCP_SERVE_QUEUE_LEN 4
+
+#define LOG_CATEGORY "libnfc.driver.tcp"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+enum tcp_op {
+  TCP_OP_HELLO = 1,
+  TCP_OP_ABORT,
+  TCP_OP_INITIATOR_INIT,
+  TCP_OP_INITIATOR_INIT_SECURE_ELEMENT,
+  TCP_OP_INITIATOR_SELECT_PASSIVE_TARGET,
+  TCP_OP_INITIATOR_POLL_TARGET,
+  TCP_OP_INITIATOR_LIST_PASSIVE_TARGETS,
+  TCP_OP_INITIATOR_INVENTORY_ISO14443A,
+  TCP_OP_INITIATOR_REACTIVATE_TARGET,
+  TCP_OP_INITIATOR_SELECT_DEP_TARGET,
+  TCP_OP_INITIATOR_DESELECT_TARGET,
+  TCP_OP_INITIATOR_TRANSCEIVE_BYTES,
+  TCP_OP_INITIATOR_TRANSCEIVE_BITS,
+  TCP_OP_INITIATOR_TRANSCEIVE_BYTES_TIMED,
+  TCP_OP_INITIATOR_TRANSCEIVE_BITS_TIMED,
+  TCP_OP_INITIATOR_TARGET_IS_PRESENT,
+  TCP_OP_INITIATOR_TRANSCEIVE_BYTES_BATCH,
+  TCP_OP_TARGET_INIT,
+  TCP_OP_TARGET_SEND_BYTES,
+  TCP_OP_TARGET_RECEIVE_BYTES,
+  TCP_OP_TARGET_TRANSCEIVE_BYTES,
+  TCP_OP_TARGET_SEND_BITS,
+  TCP_OP_TARGET_RECEIVE_BITS,
+  TCP_OP_DEP_WRITE,
+  TCP_OP_DEP_READ,
+  TCP_OP_SET_PROPERTY_BOOL,
+  TCP_OP_SET_PROPERTY_INT,
+  TCP_OP_SET_PROPERTIES,
+  TCP_OP_GET_SUPPORTED_MODULATION,
+  TCP_OP_GET_SUPPORTED_BAUD_RATE,
+  TCP_OP_GET_INFORMATION_ABOUT,
+  TCP_OP_IDLE,
+  TCP_OP_POWERDOWN,
+};
+
+// Flags of bit frames requests
+#define TCP_BITS_TX_PARITY 0x01
+#define TCP_BITS_RX_PARITY 0x02
+
+// Device flags, sent along with each property change
+#define TCP_FLAG_CRC              0x01
+#define TCP_FLAG_PARITY           0x02
+#define TCP_FLAG_EASY_FRAMING     0x04
+#define TCP_FLAG_INFINITE_SELECT  0x08
+#define TCP_FLAG_AUTO_ISO14443_4  0x10
+#define TCP_FLAG_AUTO_BITRATE     0x20
+
+/*
+ * Encoding
+ */
+
+struct tcp_buffer {
+  uint8_t *pbtData;
+  // Capacity when writing, length when reading
+  size_t szData;
+  size_t szPos;
+  bool bError;
+};
+
+static void
+tcp_put_bytes(struct tcp_buffer *pb, const uint8_t *pbtData, const size_t szData)
+{
+  if (pb->bError || (szData > pb->szData - pb->szPos)) {
+    pb->bError = true;
+    return;
+  }
+  if (szData)
+    memcpy(pb->pbtData + pb->szPos, pbtData, szData);
+  pb->szPos += szData;
+}
+
+static void
+tcp_put_u8(struct tcp_buffer *pb, const uint8_t ui8)
+{
+  tcp_put_bytes(pb, &ui8, 1);
+}
+
+static void
+tcp_put_u16(struct tcp_buffer *pb, const uint16_t ui16)
+{
+  const uint8_t abt[2] = { ui16 >> 8, ui16 & 0xff };
+  tcp_put_bytes(pb, abt, sizeof(abt));
+}
+
+static void
+tcp_put_u32(struct tcp_buffer *pb, const uint32_t ui32)
+{
+  const uint8_t abt[4] = { ui32 >> 24, (ui32 >> 16) & 0xff, (ui32 >> 8) & 0xff, ui32 & 0xff };
+  tcp_put_bytes(pb, abt, sizeof(abt));
+}
+
+// Length on one byte then data
+static void
+tcp_put_data8(struct tcp_buffer *pb, const uint8_t *pbtData, const size_t szData)
+{
+  if (szData > 0xff) {
+    pb->bError = true;
+    return;
+  }
+  tcp_put_u8(pb, szData);
+  tcp_put_bytes(pb, pbtData, szData);
+}
+
+static const uint8_t *
+tcp_get_bytes(struct tcp_buffer *pb, const size_t szData)
+{
+  if (pb->bError || (szData > pb->szData - pb->szPos)) {
+    pb->bError = true;
+    return NULL;
+  }
+  const uint8_t *pbtData = pb->pbtData + pb->szPos;
+  pb->szPos += szData;
+  return pbtData;
+}
+
+static void
+tcp_get_copy(struct tcp_buffer *pb, uint8_t *pbtData, const size_t szData)
+{
+  const uint8_t *pbtSrc = tcp_get_bytes(pb, szData);
+  if (pbtSrc && szData)
+    memcpy(pbtData, pbtSrc, szData);
+}
+
+static uint8_t
+tcp_get_u8(struct tcp_buffer *pb)
+{
+  const uint8_t *pbt = tcp_get_bytes(pb, 1);
+  return pbt ? pbt[0] : 0;
+}
+
+static uint16_t
+tcp_get_u16(struct tcp_buffer *pb)
+{
+  const uint8_t *pbt = tcp_get_bytes(pb, 2);
+  return pbt ? (pbt[0] << 8) | pbt[1] : 0;
+}
+
+static uint32_t
+tcp_get_u32(struct tcp_buffer *pb)
+{
+  const uint8_t *pbt = tcp_get_bytes(pb, 4);
+  return pbt ? ((uint32_t) pbt[0] << 24) | (pbt[1] << 16) | (pbt[2] << 8) | pbt[3] : 0;
+}
+
+static size_t
+tcp_get_data8(struct tcp_buffer *pb, uint8_t *pbtData, const size_t szMax)
+{
+  const size_t szData = tcp_get_u8(pb);
+  if (szData > szMax) {
+    pb->bError = true;
+    return 0;
+  }
+  tcp_get_copy(pb, pbtData, szData);
+  return szData;
+}
+
+static size_t
+tcp_get_remaining(const struct tcp_buffer *pb)
+{
+  return pb->bError ? 0 : pb->szData - pb->szPos;
+}
+
+static void
+tcp_put_dep_info(struct tcp_buffer *pb, const nfc_dep_info *pndi)
+{
+  tcp_put_bytes(pb, pndi->abtNFCID3, sizeof(pndi->abtNFCID3));
+  tcp_put_u8(pb, pndi->btDID);
+  tcp_put_u8(pb, pndi->btBS);
+  tcp_put_u8(pb, pndi->btBR);
+  tcp_put_u8(pb, pndi->btTO);
+  tcp_put_u8(pb, pndi->btPP);
+  tcp_put_data8(pb, pndi->abtGB, MIN(pndi->szGB, sizeof(pndi->abtGB)));
+  tcp_put_u8(pb, pndi->ndm);
+}
+
+static void
+tcp_get_dep_info(struct tcp_buffer *pb, nfc_dep_info *pndi)
+{
+  tcp_get_copy(pb, pndi->abtNFCID3, sizeof(pndi->abtNFCID3));
+  pndi->btDID = tcp_get_u8(pb);
+  pndi->btBS = tcp_get_u8(pb);
+  pndi->btBR = tcp_get_u8(pb);
+  pndi->btTO = tcp_get_u8(pb);
+  pndi->btPP = tcp_get_u8(pb);
+  pndi->szGB = tcp_get_data8(pb, pndi->abtGB, sizeof(pndi->abtGB));
+  pndi->ndm = tcp_get_u8(pb);
+}
+
+static void
+tcp_put_target(struct tcp_buffer *pb, const nfc_target *pnt)
+{
+  const nfc_target_info *pnti = &(pnt->nti);
+
+  tcp_put_u8(pb, pnt->nm.nmt);
+  tcp_put_u8(pb, pnt->nm.nbr);
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      tcp_put_bytes(pb, pnti->nai.abtAtqa, sizeof(pnti->nai.abtAtqa));
+      tcp_put_u8(pb, pnti->nai.btSak);
+      tcp_put_data8(pb, pnti->nai.abtUid, MIN(pnti->nai.szUidLen, sizeof(pnti->nai.abtUid)));
+      tcp_put_data8(pb, pnti->nai.abtAts, MIN(pnti->nai.szAtsLen, sizeof(pnti->nai.abtAts)));
+      break;
+    case NMT_FELICA:
+      tcp_put_u8(pb, pnti->nfi.szLen);
+      tcp_put_u8(pb, pnti->nfi.btResCode);
+      tcp_put_bytes(pb, pnti->nfi.abtId, sizeof(pnti->nfi.abtId));
+      tcp_put_bytes(pb, pnti->nfi.abtPad, sizeof(pnti->nfi.abtPad));
+      tcp_put_bytes(pb, pnti->nfi.abtSysCode, sizeof(pnti->nfi.abtSysCode));
+      break;
+    case NMT_ISO14443B:
+      tcp_put_bytes(pb, pnti->nbi.abtPupi, sizeof(pnti->nbi.abtPupi));
+      tcp_put_bytes(pb, pnti->nbi.abtApplicationData, sizeof(pnti->nbi.abtApplicationData));
+      tcp_put_bytes(pb, pnti->nbi.abtProtocolInfo, sizeof(pnti->nbi.abtProtocolInfo));
+      tcp_put_u8(pb, pnti->nbi.ui8CardIdentifier);
+      break;
+    case NMT_ISO14443BI:
+      tcp_put_bytes(pb, pnti->nii.abtDIV, sizeof(pnti->nii.abtDIV));
+      tcp_put_u8(pb, pnti->nii.btVerLog);
+      tcp_put_u8(pb, pnti->nii.btConfig);
+      tcp_put_data8(pb, pnti->nii.abtAtr, MIN(pnti->nii.szAtrLen, sizeof(pnti->nii.abtAtr)));
+      break;
+    case NMT_ISO14443B2SR:
+      tcp_put_bytes(pb, pnti->nsi.abtUID, sizeof(pnti->nsi.abtUID));
+      break;
+    case NMT_ISO14443B2CT:
+      tcp_put_bytes(pb, pnti->nci.abtUID, sizeof(pnti->nci.abtUID));
+      tcp_put_u8(pb, pnti->nci.btProdCode);
+      tcp_put_u8(pb, pnti->nci.btFabCode);
+      break;
+    case NMT_JEWEL:
+      tcp_put_bytes(pb, pnti->nji.btSensRes, sizeof(pnti->nji.btSensRes));
+      tcp_put_bytes(pb, pnti->nji.btId, sizeof(pnti->nji.btId));
+      break;
+    case NMT_BARCODE:
+      tcp_put_data8(pb, pnti->nti.abtData, MIN(pnti->nti.szDataLen, sizeof(pnti->nti.abtData)));
+      break;
+    case NMT_DEP:
+      tcp_put_dep_info(pb, &(pnti->ndi));
+      break;
+  }
+}
+
+static void
+tcp_get_target(struct tcp_buffer *pb, nfc_target *pnt)
+{
+  nfc_target_info *pnti = &(pnt->nti);
+
+  memset(pnt, 0, sizeof(nfc_target));
+  pnt->nm.nmt = tcp_get_u8(pb);
+  pnt->nm.nbr = tcp_get_u8(pb);
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      tcp_get_copy(pb, pnti->nai.abtAtqa, sizeof(pnti->nai.abtAtqa));
+      pnti->nai.btSak = tcp_get_u8(pb);
+      pnti->nai.szUidLen = tcp_get_data8(pb, pnti->nai.abtUid, sizeof(pnti->nai.abtUid));
+      pnti->nai.szAtsLen = tcp_get_data8(pb, pnti->nai.abtAts, sizeof(pnti->nai.abtAts));
+      break;
+    case NMT_FELICA:
+      pnti->nfi.szLen = tcp_get_u8(pb);
+      pnti->nfi.btResCode = tcp_get_u8(pb);
+      tcp_get_copy(pb, pnti->nfi.abtId, sizeof(pnti->nfi.abtId));
+      tcp_get_copy(pb, pnti->nfi.abtPad, sizeof(pnti->nfi.abtPad));
+      tcp_get_copy(pb, pnti->nfi.abtSysCode, sizeof(pnti->nfi.abtSysCode));
+      break;
+    case NMT_ISO14443B:
+      tcp_get_copy(pb, pnti->nbi.abtPupi, sizeof(pnti->nbi.abtPupi));
+      tcp_get_copy(pb, pnti->nbi.abtApplicationData, sizeof(pnti->nbi.abtApplicationData));
+      tcp_get_copy(pb, pnti->nbi.abtProtocolInfo, sizeof(pnti->nbi.abtProtocolInfo));
+      pnti->nbi.ui8CardIdentifier = tcp_get_u8(pb);
+      break;
+    case NMT_ISO14443BI:
+      tcp_get_copy(pb, pnti->nii.abtDIV, sizeof(pnti->nii.abtDIV));
+      pnti->nii.btVerLog = tcp_get_u8(pb);
+      pnti->nii.btConfig = tcp_get_u8(pb);
+      pnti->nii.szAtrLen = tcp_get_data8(pb, pnti->nii.abtAtr, sizeof(pnti->nii.abtAtr));
+      break;
+    case NMT_ISO14443B2SR:
+      tcp_get_copy(pb, pnti->nsi.abtUID, sizeof(pnti->nsi.abtUID));
+      break;
+    case NMT_ISO14443B2CT:
+      tcp_get_copy(pb, pnti->nci.abtUID, sizeof(pnti->nci.abtUID));
+      pnti->nci.btProdCode = tcp_get_u8(pb);
+      pnti->nci.btFabCode = tcp_get_u8(pb);
+      break;
+    case NMT_JEWEL:
+      tcp_get_copy(pb, pnti->nji.btSensRes, sizeof(pnti->nji.btSensRes));
+      tcp_get_copy(pb, pnti->nji.btId, sizeof(pnti->nji.btId));
+      break;
+    case NMT_BARCODE:
+      pnti->nti.szDataLen = tcp_get_data8(pb, pnti->nti.abtData, sizeof(pnti->nti.abtData));
+      break;
+    case NMT_DEP:
+      tcp_get_dep_info(pb, &(pnti->ndi));
+      break;
+    default:
+      pb->bError = true;
+      break;
+  }
+}
+
+static int
+tcp_socket_read(struct tcp_link *link, uint8_t *pbtData, const size_t szData)
+{
+  size_t szDone = 0;
+
+  while (szDone < szData) {
+    const ssize_t res = read(link->fd, pbtData + szDone, szData - szDone);
+    if (res > 0)
+      szDone += res;
+    else if (res == 0)
+      return NFC_ETGRELEASED;
+    else if (errno != EINTR)
+      return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+tcp_socket_write(struct tcp_link *link, const uint8_t *pbtData, const size_t szData)
+{
+  size_t szDone = 0;
+
+  while (szDone < szData) {
+    const ssize_t res = write(link->fd, pbtData + szDone, szData - szDone);
+    if (res > 0)
+      szDone += res;
+    else if ((res < 0) && (errno != EINTR))
+      return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+}
+
+static void
+tcp_socket_close(struct tcp_link *link)
+{
+  close(link->fd);
+}
+
+static void
+tcp_socket_link(struct tcp_link *link, const int fd)
+{
+  memset(link, 0, sizeof(struct tcp_link));
+  link->read = tcp_socket_read;
+  link->write = tcp_socket_write;
+  link->close = tcp_socket_close;
+  link->fd = fd;
+}
+
+static uint8_t
+tcp_device_flags(const nfc_device *pnd)
+{
+  return (pnd->bCrc ? TCP_FLAG_CRC : 0) |
+         (pnd->bPar ? TCP_FLAG_PARITY : 0) |
+         (pnd->bEasyFraming ? TCP_FLAG_EASY_FRAMING : 0) |
+         (pnd->bInfiniteSelect ? TCP_FLAG_INFINITE_SELECT : 0) |
+         (pnd->bAutoIso14443_4 ? TCP_FLAG_AUTO_ISO14443_4 : 0) |
+         (pnd->bAutoBitrate ? TCP_FLAG_AUTO_BITRATE : 0);
+}
+
+static void
+tcp_set_device_flags(nfc_device *pnd, const uint8_t btFlags)
+{
+  pnd->bCrc = btFlags & TCP_FLAG_CRC;
+  pnd->bPar = btFlags & TCP_FLAG_PARITY;
+  pnd->bEasyFraming = btFlags & TCP_FLAG_EASY_FRAMING;
+  pnd->bInfiniteSelect = btFlags & TCP_FLAG_INFINITE_SELECT;
+  pnd->bAutoIso14443_4 = btFlags & TCP_FLAG_AUTO_ISO14443_4;
+  pnd->bAutoBitrate = btFlags & TCP_FLAG_AUTO_BITRATE;
+}
+
+/*
+ * Client
+ */
+
+struct tcp_data {
+  struct tcp_link link;
+  // Held while writing a request, abort requests come from other threads
+  pthread_mutex_t write_lock;
+  uint16_t ui16NextId;
+  // Request being built, headroom for its header included
+  uint8_t *pbtTx;
+  // Payload of the last response
+  uint8_t *pbtRx;
+  struct tcp_buffer rx;
+  // Exchange started by nfc_initiator_transceive_bytes_async()
+  bool bAsyncPending;
+  uint16_t ui16AsyncId;
+  uint8_t *pbtAsyncRx;
+  size_t szAsyncRx;
+  nfc_transceive_callback async_callback;
+  void *async_user_data;
+  // Storage for the lists returned by get_supported_*()
+  nfc_modulation_type anmtModulations[2][NMT_DEP + 2];
+  nfc_baud_rate anbrBaudRates[2][NMT_DEP + 1][NBR_847 + 2];
+};
+
+#define DRIVER_DATA(pnd) ((struct tcp_data*)(pnd->driver_data))
+
+NFC_POOL(tcp_data_pool, struct tcp_data, NFC_POOL_DEVICES);
+
+static struct tcp_buffer
+tcp_request_init(nfc_device *pnd)
+{
+  struct tcp_buffer b = { DRIVER_DATA(pnd)->pbtTx + TCP_REQUEST_HEADER_LEN, TCP_PAYLOAD_MAX_LEN, 0, false };
+  return b;
+}
+
+static int
+tcp_send_request(nfc_device *pnd, const uint8_t btOp, const struct tcp_buffer *preq, uint16_t *pui16Id)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  uint8_t *pbtHeader = preq->pbtData - TCP_REQUEST_HEADER_LEN;
+  int res;
+
+  if (preq->bError)
+    return NFC_EOVFLOW;
+  pthread_mutex_lock(&data->write_lock);
+  *pui16Id = data->ui16NextId++;
+  pbtHeader[0] = btOp;
+  pbtHeader[1] = *pui16Id >> 8;
+  pbtHeader[2] = *pui16Id & 0xff;
+  pbtHeader[3] = preq->szPos >> 8;
+  pbtHeader[4] = preq->szPos & 0xff;
+  res = data->link.write(&data->link, pbtHeader, TCP_REQUEST_HEADER_LEN + preq->szPos);
+  pthread_mutex_unlock(&data->write_lock);
+  return res;
+}
+
+// Returns the remote driver result, the payload being left in DRIVER_DATA(pnd)->rx
+static int
+tcp_receive_response(nfc_device *pnd, const uint16_t ui16Id)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  uint8_t abtHeader[TCP_RESPONSE_HEADER_LEN];
+  int res;
+
+  if ((res = data->link.read(&data->link, abtHeader, sizeof(abtHeader))) < 0)
+    return NFC_EIO;
+  const uint16_t ui16RxId = (abtHeader[0] << 8) | abtHeader[1];
+  const int32_t i32Res = (int32_t)(((uint32_t) abtHeader[2] << 24) | (abtHeader[3] << 16) | (abtHeader[4] << 8) | abtHeader[5]);
+  const size_t szPayload = (abtHeader[6] << 8) | abtHeader[7];
+  if ((res = data->link.read(&data->link, data->pbtRx, szPayload)) < 0)
+    return NFC_EIO;
+  if (ui16RxId != ui16Id) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unexpected answer %04x to request %04x", ui16RxId, ui16Id);
+    return NFC_EIO;
+  }
+  data->rx.pbtData = data->pbtRx;
+  data->rx.szData = szPayload;
+  data->rx.szPos = 0;
+  data->rx.bError = false;
+  return i32Res;
+}
+
+static int
+tcp_call(nfc_device *pnd, const uint8_t btOp, const struct tcp_buffer *preq)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  uint16_t ui16Id;
+  int res;
+
+  // Only one exchange at a time, see nfc_initiator_transceive_bytes_async()
+  if (data->bAsyncPending) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  // Left empty unless an answer comes
+  data->rx.szData = 0;
+  data->rx.szPos = 0;
+  if (((res = tcp_send_request(pnd, btOp, preq, &ui16Id)) < 0) ||
+      ((res = tcp_receive_response(pnd, ui16Id)) < 0)) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+  return res;
+}
+
+// Checks the whole response payload was decoded
+static int
+tcp_call_done(nfc_device *pnd, const int res)
+{
+  if (DRIVER_DATA(pnd)->rx.bError) {
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  return res;
+}
+
+static int
+tcp_call_simple(nfc_device *pnd, const uint8_t btOp)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  return tcp_call(pnd, btOp, &req);
+}
+
+// Copies a received frame to the application buffer
+static int
+tcp_get_rx(nfc_device *pnd, const int res, uint8_t *pbtRx, const size_t szRx)
+{
+  struct tcp_buffer *prx = &(DRIVER_DATA(pnd)->rx);
+
+  if (res <= 0)
+    return res;
+  if ((size_t) res > szRx) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  tcp_get_copy(prx, pbtRx, res);
+  return tcp_call_done(pnd, res);
+}
+
+// Copies a received bit frame and its parity bits, res being the bits count
+static int
+tcp_get_rx_bits(nfc_device *pnd, const int res, uint8_t *pbtRx, uint8_t *pbtRxPar)
+{
+  struct tcp_buffer *prx = &(DRIVER_DATA(pnd)->rx);
+
+  if (res <= 0)
+    return res;
+  const size_t szBytes = (res + 7) / 8;
+  tcp_get_copy(prx, pbtRx, szBytes);
+  if (pbtRxPar)
+    tcp_get_copy(prx, pbtRxPar, szBytes);
+  return tcp_call_done(pnd, res);
+}
+
+static void
+tcp_put_tx_bits(struct tcp_buffer *preq, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, const uint8_t *pbtRxPar)
+{
+  const size_t szBytes = (szTxBits + 7) / 8;
+
+  tcp_put_u16(preq, szTxBits);
+  tcp_put_u8(preq, (pbtTxPar ? TCP_BITS_TX_PARITY : 0) | (pbtRxPar ? TCP_BITS_RX_PARITY : 0));
+  tcp_put_bytes(preq, pbtTx, szBytes);
+  if (pbtTxPar)
+    tcp_put_bytes(preq, pbtTxPar, szBytes);
+}
+
+static size_t
+tcp_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  // Remote devices have to be requested by connstring
+  return 0;
+}
+
+static void
+tcp_close(nfc_device *pnd)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+
+  if (data) {
+    if (data->link.close)
+      data->link.close(&data->link);
+    pthread_mutex_destroy(&data->write_lock);
+    free(data->pbtTx);
+    free(data->pbtRx);
+  }
+  nfc_device_free(pnd);
+}
+
+static int
+tcp_connect(const char *pcHost, const char *pcPort)
+{
+  struct addrinfo hints, *pai, *p;
+  int fd = -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(pcHost, pcPort, &hints, &pai) != 0)
+    return -1;
+  for (p = pai; p; p = p->ai_next) {
+    if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+      continue;
+    if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(pai);
+  if (fd >= 0) {
+    const int one = 1;
+    // Requests are small and latency bound, and the connection lasts as long as the device is opened
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+  }
+  return fd;
+}
+
+nfc_device *
+tcp_open_link(const nfc_context *context, const nfc_connstring connstring, const struct nfc_driver *driver, const struct tcp_link *link)
+{
+  struct tcp_data *data;
+  int res;
+
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    link->close((struct tcp_link *) link);
+    return NULL;
+  }
+  pnd->driver_data = data = nfc_pool_zalloc(&tcp_data_pool);
+  if (!data) {
+    perror("malloc");
+    link->close((struct tcp_link *) link);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  pthread_mutex_init(&data->write_lock, NULL);
+  pnd->driver = driver;
+  data->link = *link;
+  data->pbtTx = malloc(TCP_REQUEST_HEADER_LEN + TCP_PAYLOAD_MAX_LEN);
+  data->pbtRx = malloc(TCP_PAYLOAD_MAX_LEN);
+  if (!data->pbtTx || !data->pbtRx) {
+    tcp_close(pnd);
+    return NULL;
+  }
+
+  struct tcp_buffer req = tcp_request_init(pnd);
+  tcp_put_u8(&req, TCP_PROTOCOL_VERSION);
+  if ((res = tcp_call(pnd, TCP_OP_HELLO, &req)) != TCP_PROTOCOL_VERSION) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Server does not speak protocol version %d (%d)", TCP_PROTOCOL_VERSION, res);
+    tcp_close(pnd);
+    return NULL;
+  }
+  tcp_set_device_flags(pnd, tcp_get_u8(&data->rx));
+  pnd->btSupportByte = tcp_get_u8(&data->rx);
+  const size_t szName = MIN(tcp_get_remaining(&data->rx), sizeof(pnd->name) - 1);
+  tcp_get_copy(&data->rx, (uint8_t *) pnd->name, szName);
+  pnd->name[szName] = '\0';
+  return pnd;
+}
+
+static nfc_device *
+tcp_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  char *pcHost = NULL;
+  char *pcPort = NULL;
+  struct tcp_link link;
+  int fd = -1;
+
+  if (connstring_decode(connstring, TCP_DRIVER_NAME, NULL, &pcHost, &pcPort) >= 3) {
+    if ((fd = tcp_connect(pcHost, pcPort)) < 0)
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to connect to %s:%s", pcHost, pcPort);
+  }
+  nfc_pool_free(pcHost);
+  nfc_pool_free(pcPort);
+  if (fd < 0)
+    return NULL;
+  tcp_socket_link(&link, fd);
+  return tcp_open_link(context, connstring, &tcp_driver, &link);
+}
+
+static int
+tcp_initiator_init(nfc_device *pnd)
+{
+  return tcp_call_simple(pnd, TCP_OP_INITIATOR_INIT);
+}
+
+static int
+tcp_initiator_init_secure_element(nfc_device *pnd)
+{
+  return tcp_call_simple(pnd, TCP_OP_INITIATOR_INIT_SECURE_ELEMENT);
+}
+
+static int
+tcp_get_target_answer(nfc_device *pnd, const int res, nfc_target *pnt)
+{
+  if ((res > 0) && pnt) {
+    tcp_get_target(&(DRIVER_DATA(pnd)->rx), pnt);
+    return tcp_call_done(pnd, res);
+  }
+  return res;
+}
+
+static int
+tcp_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u8(&req, nm.nmt);
+  tcp_put_u8(&req, nm.nbr);
+  tcp_put_data8(&req, pbtInitData, szInitData);
+  return tcp_get_target_answer(pnd, tcp_call(pnd, TCP_OP_INITIATOR_SELECT_PASSIVE_TARGET, &req), pnt);
+}
+
+static int
+tcp_initiator_poll_target(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t btPeriod, nfc_target *pnt)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u8(&req, szModulations);
+  for (size_t i = 0; i < szModulations; i++) {
+    tcp_put_u8(&req, pnmModulations[i].nmt);
+    tcp_put_u8(&req, pnmModulations[i].nbr);
+  }
+  tcp_put_u8(&req, uiPollNr);
+  tcp_put_u8(&req, btPeriod);
+  return tcp_get_target_answer(pnd, tcp_call(pnd, TCP_OP_INITIATOR_POLL_TARGET, &req), pnt);
+}
+
+static int
+tcp_get_targets_answer(nfc_device *pnd, const int res, nfc_target ant[], const size_t szTargets)
+{
+  if (res <= 0)
+    return res;
+  if ((size_t) res > szTargets) {
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  for (int i = 0; i < res; i++)
+    tcp_get_target(&(DRIVER_DATA(pnd)->rx), &(ant[i]));
+  return tcp_call_done(pnd, res);
+}
+
+static int
+tcp_initiator_list_passive_targets(nfc_device *pnd, const nfc_modulation nm, nfc_target ant[], const size_t szTargets)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  const size_t szMax = MIN(szTargets, TCP_MAX_TARGETS);
+
+  tcp_put_u8(&req, nm.nmt);
+  tcp_put_u8(&req, nm.nbr);
+  tcp_put_u8(&req, szMax);
+  return tcp_get_targets_answer(pnd, tcp_call(pnd, TCP_OP_INITIATOR_LIST_PASSIVE_TARGETS, &req), ant, szMax);
+}
+
+static int
+tcp_initiator_inventory_iso14443a(nfc_device *pnd, nfc_target ant[], const size_t szTargets)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  const size_t szMax = MIN(szTargets, TCP_MAX_TARGETS);
+
+  tcp_put_u8(&req, szMax);
+  return tcp_get_targets_answer(pnd, tcp_call(pnd, TCP_OP_INITIATOR_INVENTORY_ISO14443A, &req), ant, szMax);
+}
+
+static int
+tcp_initiator_reactivate_target(nfc_device *pnd, const nfc_target *pnt)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_target(&req, pnt);
+  return tcp_call(pnd, TCP_OP_INITIATOR_REACTIVATE_TARGET, &req);
+}
+
+static int
+tcp_initiator_select_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u8(&req, ndm);
+  tcp_put_u8(&req, nbr);
+  tcp_put_u8(&req, pndiInitiator ? 1 : 0);
+  if (pndiInitiator)
+    tcp_put_dep_info(&req, pndiInitiator);
+  tcp_put_u32(&req, timeout);
+  return tcp_get_target_answer(pnd, tcp_call(pnd, TCP_OP_INITIATOR_SELECT_DEP_TARGET, &req), pnt);
+}
+
+static int
+tcp_initiator_deselect_target(nfc_device *pnd)
+{
+  return tcp_call_simple(pnd, TCP_OP_INITIATOR_DESELECT_TARGET);
+}
+
+static int
+tcp_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u32(&req, timeout);
+  tcp_put_bytes(&req, pbtTx, szTx);
+  return tcp_get_rx(pnd, tcp_call(pnd, TCP_OP_INITIATOR_TRANSCEIVE_BYTES, &req), pbtRx, szRx);
+}
+
+static int
+tcp_initiator_transceive_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_tx_bits(&req, pbtTx, szTxBits, pbtTxPar, pbtRxPar);
+  return tcp_get_rx_bits(pnd, tcp_call(pnd, TCP_OP_INITIATOR_TRANSCEIVE_BITS, &req), pbtRx, pbtRxPar);
+}
+
+static int
+tcp_initiator_transceive_bytes_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  int res;
+
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u32(&req, cycles ? *cycles : 0);
+  tcp_put_bytes(&req, pbtTx, szTx);
+  if ((res = tcp_call(pnd, TCP_OP_INITIATOR_TRANSCEIVE_BYTES_TIMED, &req)) < 0)
+    return res;
+  const uint32_t ui32Cycles = tcp_get_u32(&(DRIVER_DATA(pnd)->rx));
+  if (cycles)
+    *cycles = ui32Cycles;
+  return tcp_get_rx(pnd, res, pbtRx, szRx);
+}
+
+static int
+tcp_initiator_transceive_bits_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  int res;
+
+  tcp_put_u32(&req, cycles ? *cycles : 0);
+  tcp_put_tx_bits(&req, pbtTx, szTxBits, pbtTxPar, pbtRxPar);
+  if ((res = tcp_call(pnd, TCP_OP_INITIATOR_TRANSCEIVE_BITS_TIMED, &req)) < 0)
+    return res;
+  const uint32_t ui32Cycles = tcp_get_u32(&(DRIVER_DATA(pnd)->rx));
+  if (cycles)
+    *cycles = ui32Cycles;
+  return tcp_get_rx_bits(pnd, res, pbtRx, pbtRxPar);
+}
+
+static int
+tcp_initiator_target_is_present(nfc_device *pnd, const nfc_target *pnt)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u8(&req, pnt ? 1 : 0);
+  if (pnt)
+    tcp_put_target(&req, pnt);
+  return tcp_call(pnd, TCP_OP_INITIATOR_TARGET_IS_PRESENT, &req);
+}
+
+static int
+tcp_initiator_transceive_bytes_batch(nfc_device *pnd, const struct nfc_batch_frame *frames, const size_t szFrames, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  int res;
+
+  tcp_put_u32(&req, timeout);
+  tcp_put_u8(&req, szFrames);
+  for (size_t i = 0; i < szFrames; i++) {
+    tcp_put_u16(&req, MIN(frames[i].szRx, TCP_BATCH_RX_MAX_LEN));
+    tcp_put_u16(&req, frames[i].ui16Sw);
+    tcp_put_u16(&req, frames[i].ui16SwMask);
+    tcp_put_u16(&req, frames[i].szTx);
+    tcp_put_bytes(&req, frames[i].pbtTx, frames[i].szTx);
+  }
+  res = tcp_call(pnd, TCP_OP_INITIATOR_TRANSCEIVE_BYTES_BATCH, &req);
+  if ((res < 0) && DRIVER_DATA(pnd)->rx.szData == 0)
+    return res;
+
+  // Each frame result, followed by its answer
+  struct tcp_buffer *prx = &(DRIVER_DATA(pnd)->rx);
+  for (size_t i = 0; i < szFrames; i++) {
+    const int iRes = (int32_t) tcp_get_u32(prx);
+    if ((iRes > 0) && ((size_t) iRes > frames[i].szRx)) {
+      pnd->last_error = NFC_EIO;
+      return pnd->last_error;
+    }
+    if (iRes > 0)
+      tcp_get_copy(prx, frames[i].pbtRx, iRes);
+    if (frames[i].pres)
+      *(frames[i].pres) = iRes;
+  }
+  return tcp_call_done(pnd, res);
+}
+
+static int
+tcp_initiator_transceive_bytes_async(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout,
+                                     nfc_transceive_callback callback, void *user_data)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  struct tcp_buffer req = tcp_request_init(pnd);
+  int res;
+
+  if (data->bAsyncPending) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  // Sent as a regular exchange, its answer is only read by tcp_process_events()
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u32(&req, timeout);
+  tcp_put_bytes(&req, pbtTx, szTx);
+  if ((res = tcp_send_request(pnd, TCP_OP_INITIATOR_TRANSCEIVE_BYTES, &req, &data->ui16AsyncId)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+  if (data->link.arm)
+    data->link.arm(&data->link);
+  data->pbtAsyncRx = pbtRx;
+  data->szAsyncRx = szRx;
+  data->async_callback = callback;
+  data->async_user_data = user_data;
+  data->bAsyncPending = true;
+  return NFC_SUCCESS;
+}
+
+static int
+tcp_get_pollable_fd(nfc_device *pnd)
+{
+  return DRIVER_DATA(pnd)->link.fd;
+}
+
+static int
+tcp_process_events(nfc_device *pnd)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  int res;
+
+  if (!data->bAsyncPending)
+    return 0;
+  data->bAsyncPending = false;
+  if ((res = tcp_receive_response(pnd, data->ui16AsyncId)) < 0)
+    pnd->last_error = res;
+  else
+    res = tcp_get_rx(pnd, res, data->pbtAsyncRx, data->szAsyncRx);
+  if (data->async_callback)
+    data->async_callback(pnd, res, data->async_user_data);
+  return 1;
+}
+
+static int
+tcp_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  int res;
+
+  tcp_put_target(&req, pnt);
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u32(&req, timeout);
+  if ((res = tcp_call(pnd, TCP_OP_TARGET_INIT, &req)) < 0)
+    return res;
+  // The chip completes the emulated target (e.g. NFCID3)
+  tcp_get_target(&(DRIVER_DATA(pnd)->rx), pnt);
+  if (res == 0)
+    return tcp_call_done(pnd, res);
+  return tcp_get_rx(pnd, res, pbtRx, szRx);
+}
+
+static int
+tcp_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u32(&req, timeout);
+  tcp_put_bytes(&req, pbtTx, szTx);
+  return tcp_call(pnd, TCP_OP_TARGET_SEND_BYTES, &req);
+}
+
+static int
+tcp_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u32(&req, timeout);
+  return tcp_get_rx(pnd, tcp_call(pnd, TCP_OP_TARGET_RECEIVE_BYTES, &req), pbtRx, szRx);
+}
+
+static int
+tcp_target_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u32(&req, timeout);
+  tcp_put_bytes(&req, pbtTx, szTx);
+  return tcp_get_rx(pnd, tcp_call(pnd, TCP_OP_TARGET_TRANSCEIVE_BYTES, &req), pbtRx, szRx);
+}
+
+static int
+tcp_target_send_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_tx_bits(&req, pbtTx, szTxBits, pbtTxPar, NULL);
+  return tcp_call(pnd, TCP_OP_TARGET_SEND_BITS, &req);
+}
+
+static int
+tcp_target_receive_bits(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+  int res;
+
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u8(&req, pbtRxPar ? TCP_BITS_RX_PARITY : 0);
+  if (((res = tcp_call(pnd, TCP_OP_TARGET_RECEIVE_BITS, &req)) > 0) && ((size_t)(res + 7) / 8 > szRx)) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  return tcp_get_rx_bits(pnd, res, pbtRx, pbtRxPar);
+}
+
+static int
+tcp_dep_write(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u32(&req, timeout);
+  tcp_put_bytes(&req, pbtTx, szTx);
+  return tcp_call(pnd, TCP_OP_DEP_WRITE, &req);
+}
+
+static int
+tcp_dep_read(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u16(&req, MIN(szRx, TCP_PAYLOAD_MAX_LEN));
+  tcp_put_u32(&req, timeout);
+  return tcp_get_rx(pnd, tcp_call(pnd, TCP_OP_DEP_READ, &req), pbtRx, szRx);
+}
+
+// Property changes answer with the device flags, as updated by the remote driver
+static int
+tcp_get_flags_answer(nfc_device *pnd, const int res)
+{
+  struct tcp_buffer *prx = &(DRIVER_DATA(pnd)->rx);
+
+  if (tcp_get_remaining(prx))
+    tcp_set_device_flags(pnd, tcp_get_u8(prx));
+  return res;
+}
+
+static int
+tcp_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u8(&req, property);
+  tcp_put_u8(&req, bEnable ? 1 : 0);
+  return tcp_get_flags_answer(pnd, tcp_call(pnd, TCP_OP_SET_PROPERTY_BOOL, &req));
+}
+
+static int
+tcp_set_property_int(nfc_device *pnd, const nfc_property property, const int value)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u8(&req, property);
+  tcp_put_u32(&req, value);
+  return tcp_get_flags_answer(pnd, tcp_call(pnd, TCP_OP_SET_PROPERTY_INT, &req));
+}
+
+static int
+tcp_set_properties(nfc_device *pnd, const nfc_property_setting *pSettings, const size_t szSettings)
+{
+  struct tcp_buffer req = tcp_request_init(pnd);
+
+  tcp_put_u8(&req, szSettings);
+  for (size_t i = 0; i < szSettings; i++) {
+    tcp_put_u8(&req, pSettings[i].property);
+    tcp_put_u32(&req, pSettings[i].value);
+  }
+  return tcp_get_flags_answer(pnd, tcp_call(pnd, TCP_OP_SET_PROPERTIES, &req));
+}
+
+static int
+tcp_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  struct tcp_buffer req = tcp_request_init(pnd);
+  nfc_modulation_type *pnmt = data->anmtModulations[mode == N_INITIATOR];
+  int res;
+
+  tcp_put_u8(&req, mode);
+  if ((res = tcp_call(pnd, TCP_OP_GET_SUPPORTED_MODULATION, &req)) < 0)
+    return res;
+  size_t i;
+  for (i = 0; (i < NMT_DEP + 1) && tcp_get_remaining(&data->rx); i++)
+    pnmt[i] = tcp_get_u8(&data->rx);
+  pnmt[i] = 0;
+  *supported_mt = pnmt;
+  return res;
+}
+
+static int
+tcp_get_supported_baud_rate(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  struct tcp_buffer req = tcp_request_init(pnd);
+  int res;
+
+  if ((nmt < NMT_ISO14443A) || (nmt > NMT_DEP)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  nfc_baud_rate *pnbr = data->anbrBaudRates[mode == N_INITIATOR][nmt];
+  tcp_put_u8(&req, mode);
+  tcp_put_u8(&req, nmt);
+  if ((res = tcp_call(pnd, TCP_OP_GET_SUPPORTED_BAUD_RATE, &req)) < 0)
+    return res;
+  size_t i;
+  for (i = 0; (i < NBR_847 + 1) && tcp_get_remaining(&data->rx); i++)
+    pnbr[i] = tcp_get_u8(&data->rx);
+  pnbr[i] = NBR_UNDEFINED;
+  *supported_br = pnbr;
+  return res;
+}
+
+static int
+tcp_get_information_about(nfc_device *pnd, char **pbuf)
+{
+  struct tcp_data *data = DRIVER_DATA(pnd);
+  int res;
+
+  if ((res = tcp_call_simple(pnd, TCP_OP_GET_INFORMATION_ABOUT)) < 0)
+    return res;
+  const size_t szInfo = tcp_get_remaining(&data->rx);
+  if ((*pbuf = malloc(szInfo + 1)) == NULL) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  tcp_get_copy(&data->rx, (uint8_t *) * pbuf, szInfo);
+  (*pbuf)[szInfo] = '\0';
+  return res;
+}
+
+static int
+tcp_abort_command(nfc_device *pnd)
+{
+  struct tcp_data *data;
+  uint8_t abtRequest[TCP_REQUEST_HEADER_LEN] = { TCP_OP_ABORT, 0, 0, 0, 0 };
+  int res;
+
+  if (!pnd)
+    return NFC_SUCCESS;
+  data = DRIVER_DATA(pnd);
+  // No answer: the command being aborted will answer instead
+  pthread_mutex_lock(&data->write_lock);
+  res = data->link.write(&data->link, abtRequest, sizeof(abtRequest));
+  pthread_mutex_unlock(&data->write_lock);
+  return res;
+}
+
+static int
+tcp_idle(nfc_device *pnd)
+{
+  return tcp_call_simple(pnd, TCP_OP_IDLE);
+}
+
+static int
+tcp_powerdown(nfc_device *pnd)
+{
+  return tcp_call_simple(pnd, TCP_OP_POWERDOWN);
+}
+
+// Shared by the drivers speaking this protocol
+#define TCP_DRIVER_HOOKS \
+  .initiator_init                   = tcp_initiator_init, \
+  .initiator_init_secure_element    = tcp_initiator_init_secure_element, \
+  .initiator_select_passive_target  = tcp_initiator_select_passive_target, \
+  .initiator_poll_target            = tcp_initiator_poll_target, \
+  .initiator_list_passive_targets   = tcp_initiator_list_passive_targets, \
+  .initiator_inventory_iso14443a    = tcp_initiator_inventory_iso14443a, \
+  .initiator_reactivate_target      = tcp_initiator_reactivate_target, \
+  .initiator_select_dep_target      = tcp_initiator_select_dep_target, \
+  .initiator_deselect_target        = tcp_initiator_deselect_target, \
+  .initiator_transceive_bytes       = tcp_initiator_transceive_bytes, \
+  .initiator_transceive_bits        = tcp_initiator_transceive_bits, \
+  .initiator_transceive_bytes_timed = tcp_initiator_transceive_bytes_timed, \
+  .initiator_transceive_bits_timed  = tcp_initiator_transceive_bits_timed, \
+  .initiator_target_is_present      = tcp_initiator_target_is_present, \
+  .initiator_transceive_bytes_batch = tcp_initiator_transceive_bytes_batch, \
+  .initiator_transceive_bytes_async = tcp_initiator_transceive_bytes_async, \
+  \
+  .target_init           = tcp_target_init, \
+  .target_send_bytes     = tcp_target_send_bytes, \
+  .target_receive_bytes  = tcp_target_receive_bytes, \
+  .target_transceive_bytes = tcp_target_transceive_bytes, \
+  .target_send_bits      = tcp_target_send_bits, \
+  .target_receive_bits   = tcp_target_receive_bits, \
+  \
+  .dep_write = tcp_dep_write, \
+  .dep_read  = tcp_dep_read, \
+  \
+  .device_set_property_bool     = tcp_set_property_bool, \
+  .device_set_property_int      = tcp_set_property_int, \
+  .device_set_properties        = tcp_set_properties, \
+  .get_supported_modulation     = tcp_get_supported_modulation, \
+  .get_supported_baud_rate      = tcp_get_supported_baud_rate, \
+  .device_get_information_about = tcp_get_information_about, \
+  \
+  .abort_command  = tcp_abort_command, \
+  .idle           = tcp_idle, \
+  .powerdown      = tcp_powerdown, \
+  .get_pollable_fd = tcp_get_pollable_fd, \
+  .process_events = tcp_process_events
+
+const struct nfc_driver tcp_driver = {
+  .name                             = TCP_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = tcp_scan,
+  .open                             = tcp_open,
+  .close                            = tcp_close,
+  .strerror                         = NULL,
+  TCP_DRIVER_HOOKS
+};
+
+#if defined (DRIVER_NFCD_ENABLED)
+// Same protocol, over shared memory rings, see nfcd.c
+const struct nfc_driver nfcd_driver = {
+  .name                             = "nfcd",
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = nfcd_scan,
+  .open                             = nfcd_open,
+  .close                            = tcp_close,
+  .strerror                         = NULL,
+  TCP_DRIVER_HOOKS
+};
+#endif /* DRIVER_NFCD_ENABLED */
+
+/*
+ * Server
+ */
+
+struct tcp_serve_request {
+  uint8_t btOp;
+  uint16_t ui16Id;
+  size_t szPayload;
+  uint8_t abtPayload[TCP_PAYLOAD_MAX_LEN];
+};
+
+struct tcp_server {
+  nfc_device *pnd;
+  struct tcp_link link;
+  // Other connections use the device too
+  bool bShared;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  // Requests read ahead, run in order by tcp_serve_run()
+  struct tcp_serve_request aRequests[TCP_SERVE_QUEUE_LEN];
+  size_t szHead;
+  size_t szCount;
+  bool bClosed;
+  // A request of this connection is being run
+  bool bRunning;
+  int res;
+  uint8_t abtResponse[TCP_RESPONSE_HEADER_LEN + TCP_PAYLOAD_MAX_LEN];
+  uint8_t abtScratch[TCP_PAYLOAD_MAX_LEN];
+};
+
+// Calls the driver of the exported device, like HAL() does for the application
+#define SERVE_HAL(FUNCTION, ...) \
+  (pnd->driver->FUNCTION ? pnd->driver->FUNCTION(__VA_ARGS__) : NFC_EDEVNOTSUPP)
+
+static int
+tcp_serve_batch(nfc_device *pnd, struct tcp_server *ps, struct tcp_buffer *preq, struct tcp_buffer *presp)
+{
+  struct nfc_batch_frame frames[NFC_BATCH_MAX_FRAMES];
+  int aiRes[NFC_BATCH_MAX_FRAMES];
+  int res = NFC_SUCCESS;
+
+  const int timeout = (int32_t) tcp_get_u32(preq);
+  const size_t szFrames = tcp_get_u8(preq);
+  if (szFrames > NFC_BATCH_MAX_FRAMES)
+    return NFC_EINVARG;
+  for (size_t i = 0; i < szFrames; i++) {
+    const size_t szRx = tcp_get_u16(preq);
+    frames[i].szRx = MIN(szRx, TCP_BATCH_RX_MAX_LEN);
+    frames[i].ui16Sw = tcp_get_u16(preq);
+    frames[i].ui16SwMask = tcp_get_u16(preq);
+    frames[i].szTx = tcp_get_u16(preq);
+    frames[i].pbtTx = tcp_get_bytes(preq, frames[i].szTx);
+    frames[i].pbtRx = ps->abtScratch + i * TCP_BATCH_RX_MAX_LEN;
+    frames[i].pres = &(aiRes[i]);
+    aiRes[i] = NFC_EOPABORTED;
+  }
+  if (preq->bError)
+    return NFC_EINVARG;
+
+  if (pnd->driver->initiator_transceive_bytes_batch) {
+    res = pnd->driver->initiator_transceive_bytes_batch(pnd, frames, szFrames, timeout);
+  } else {
+    // Same fallback as nfc_batch_commit()
+    for (size_t i = 0; i < szFrames; i++) {
+      aiRes[i] = SERVE_HAL(initiator_transceive_bytes, pnd, frames[i].pbtTx, frames[i].szTx, frames[i].pbtRx, frames[i].szRx, timeout);
+      if (aiRes[i] < 0) {
+        res = aiRes[i];
+        break;
+      }
+      if (nfc_batch_frame_sw_mismatch(&(frames[i]), aiRes[i]))
+        break;
+    }
+  }
+  for (size_t i = 0; i < szFrames; i++) {
+    tcp_put_u32(presp, aiRes[i]);
+    if (aiRes[i] > 0)
+      tcp_put_bytes(presp, frames[i].pbtRx, aiRes[i]);
+  }
+  return res;
+}
+
+static int
+tcp_serve_bits(struct tcp_server *ps, struct tcp_buffer *presp, const int res, const bool bRxPar)
+{
+  // Answer bytes are already in place, parity bits follow them
+  if (res > 0) {
+    const size_t szBytes = (res + 7) / 8;
+    presp->szPos += szBytes;
+    if (bRxPar)
+      tcp_put_bytes(presp, ps->abtScratch, szBytes);
+  }
+  return res;
+}
+
+// Runs a request against the exported device, the answer payload being written to presp
+static int
+tcp_serve_dispatch(struct tcp_server *ps, struct tcp_serve_request *pr, struct tcp_buffer *presp)
+{
+  nfc_device *pnd = ps->pnd;
+  struct tcp_buffer req = { pr->abtPayload, pr->szPayload, 0, false };
+  nfc_target nt;
+  nfc_target ant[TCP_MAX_TARGETS];
+  nfc_modulation nm;
+  uint8_t *pbtRx = presp->pbtData;
+  int res = NFC_EINVARG;
+
+  switch (pr->btOp) {
+    case TCP_OP_HELLO:
+      if (tcp_get_u8(&req) != TCP_PROTOCOL_VERSION)
+        return NFC_EDEVNOTSUPP;
+      tcp_put_u8(presp, tcp_device_flags(pnd));
+      tcp_put_u8(presp, pnd->btSupportByte);
+      nfc_device_resolve_name(pnd);
+      tcp_put_bytes(presp, (const uint8_t *) pnd->name, strlen(pnd->name));
+      return TCP_PROTOCOL_VERSION;
+    case TCP_OP_INITIATOR_INIT:
+      return SERVE_HAL(initiator_init, pnd);
+    case TCP_OP_INITIATOR_INIT_SECURE_ELEMENT:
+      return SERVE_HAL(initiator_init_secure_element, pnd);
+    case TCP_OP_INITIATOR_SELECT_PASSIVE_TARGET: {
+      uint8_t abtInit[0xff];
+      nm.nmt = tcp_get_u8(&req);
+      nm.nbr = tcp_get_u8(&req);
+      const size_t szInit = tcp_get_data8(&req, abtInit, sizeof(abtInit));
+      if (req.bError)
+        break;
+      if ((res = SERVE_HAL(initiator_select_passive_target, pnd, nm, szInit ? abtInit : NULL, szInit, &nt)) > 0)
+        tcp_put_target(presp, &nt);
+      break;
+    }
+    case TCP_OP_INITIATOR_POLL_TARGET: {
+      nfc_modulation anm[NMT_DEP * 4];
+      const size_t szModulations = tcp_get_u8(&req);
+      if (szModulations > sizeof(anm) / sizeof(anm[0]))
+        break;
+      for (size_t i = 0; i < szModulations; i++) {
+        anm[i].nmt = tcp_get_u8(&req);
+        anm[i].nbr = tcp_get_u8(&req);
+      }
+      const uint8_t uiPollNr = tcp_get_u8(&req);
+      const uint8_t btPeriod = tcp_get_u8(&req);
+      if (req.bError)
+        break;
+      if ((res = SERVE_HAL(initiator_poll_target, pnd, anm, szModulations, uiPollNr, btPeriod, &nt)) > 0)
+        tcp_put_target(presp, &nt);
+      break;
+    }
+    case TCP_OP_INITIATOR_LIST_PASSIVE_TARGETS:
+    case TCP_OP_INITIATOR_INVENTORY_ISO14443A: {
+      if (pr->btOp == TCP_OP_INITIATOR_LIST_PASSIVE_TARGETS) {
+        nm.nmt = tcp_get_u8(&req);
+        nm.nbr = tcp_get_u8(&req);
+      }
+      const size_t szRequested = tcp_get_u8(&req);
+      const size_t szTargets = MIN(szRequested, TCP_MAX_TARGETS);
+      if (req.bError)
+        break;
+      if (pr->btOp == TCP_OP_INITIATOR_LIST_PASSIVE_TARGETS)
+        res = SERVE_HAL(initiator_list_passive_targets, pnd, nm, ant, szTargets);
+      else
+        res = SERVE_HAL(initiator_inventory_iso14443a, pnd, ant, szTargets);
+      for (int i = 0; i < res; i++)
+        tcp_put_target(presp, &(ant[i]));
+      break;
+    }
+    case TCP_OP_INITIATOR_REACTIVATE_TARGET:
+      tcp_get_target(&req, &nt);
+      if (!req.bError)
+        res = SERVE_HAL(initiator_reactivate_target, pnd, &nt);
+      break;
+    case TCP_OP_INITIATOR_SELECT_DEP_TARGET: {
+      nfc_dep_info ndi;
+      const nfc_dep_mode ndm = tcp_get_u8(&req);
+      const nfc_baud_rate nbr = tcp_get_u8(&req);
+      const bool bInfo = tcp_get_u8(&req);
+      if (bInfo)
+        tcp_get_dep_info(&req, &ndi);
+      const int timeout = (int32_t) tcp_get_u32(&req);
+      if (req.bError)
+        break;
+      if ((res = SERVE_HAL(initiator_select_dep_target, pnd, ndm, nbr, bInfo ? &ndi : NULL, &nt, timeout)) > 0)
+        tcp_put_target(presp, &nt);
+      break;
+    }
+    case TCP_OP_INITIATOR_DESELECT_TARGET:
+      return SERVE_HAL(initiator_deselect_target, pnd);
+    case TCP_OP_INITIATOR_TRANSCEIVE_BYTES:
+    case TCP_OP_TARGET_TRANSCEIVE_BYTES: {
+      const size_t szRx = tcp_get_u16(&req);
+      const int timeout = (int32_t) tcp_get_u32(&req);
+      const size_t szTx = tcp_get_remaining(&req);
+      const uint8_t *pbtTx = tcp_get_bytes(&req, szTx);
+      if (req.bError)
+        break;
+      if (pr->btOp == TCP_OP_INITIATOR_TRANSCEIVE_BYTES)
+        res = SERVE_HAL(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+      else
+        res = SERVE_HAL(target_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+      if (res > 0)
+        presp->szPos = res;
+      break;
+    }
+    case TCP_OP_INITIATOR_TRANSCEIVE_BITS:
+    case TCP_OP_INITIATOR_TRANSCEIVE_BITS_TIMED: {
+      uint32_t cycles = 0;
+      if (pr->btOp == TCP_OP_INITIATOR_TRANSCEIVE_BITS_TIMED)
+        cycles = tcp_get_u32(&req);
+      const size_t szTxBits = tcp_get_u16(&req);
+      const uint8_t btFlags = tcp_get_u8(&req);
+      const uint8_t *pbtTx = tcp_get_bytes(&req, (szTxBits + 7) / 8);
+      const uint8_t *pbtTxPar = (btFlags & TCP_BITS_TX_PARITY) ? tcp_get_bytes(&req, (szTxBits + 7) / 8) : NULL;
+      uint8_t *pbtRxPar = (btFlags & TCP_BITS_RX_PARITY) ? ps->abtScratch : NULL;
+      if (req.bError)
+        break;
+      if (pr->btOp == TCP_OP_INITIATOR_TRANSCEIVE_BITS_TIMED) {
+        // Cycles come first, the answer follows
+        res = SERVE_HAL(initiator_transceive_bits_timed, pnd, pbtTx, szTxBits, pbtTxPar, pbtRx + 4, pbtRxPar, &cycles);
+        tcp_put_u32(presp, cycles);
+      } else {
+        res = SERVE_HAL(initiator_transceive_bits, pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, pbtRxPar);
+      }
+      tcp_serve_bits(ps, presp, res, pbtRxPar != NULL);
+      break;
+    }
+    case TCP_OP_INITIATOR_TRANSCEIVE_BYTES_TIMED: {
+      const size_t szRequested = tcp_get_u16(&req);
+      const size_t szRx = MIN(szRequested, TCP_PAYLOAD_MAX_LEN - 4);
+      uint32_t cycles = tcp_get_u32(&req);
+      const size_t szTx = tcp_get_remaining(&req);
+      const uint8_t *pbtTx = tcp_get_bytes(&req, szTx);
+      if (req.bError)
+        break;
+      res = SERVE_HAL(initiator_transceive_bytes_timed, pnd, pbtTx, szTx, pbtRx + 4, szRx, &cycles);
+      tcp_put_u32(presp, cycles);
+      if (res > 0)
+        presp->szPos += res;
+      break;
+    }
+    case TCP_OP_INITIATOR_TARGET_IS_PRESENT:
+      if (tcp_get_u8(&req))
+        tcp_get_target(&req, &nt);
+      if (!req.bError)
+        res = SERVE_HAL(initiator_target_is_present, pnd, pr->abtPayload[0] ? &nt : NULL);
+      break;
+    case TCP_OP_INITIATOR_TRANSCEIVE_BYTES_BATCH:
+      return tcp_serve_batch(pnd, ps, &req, presp);
+    case TCP_OP_TARGET_INIT: {
+      tcp_get_target(&req, &nt);
+      const size_t szRx = tcp_get_u16(&req);
+      const int timeout = (int32_t) tcp_get_u32(&req);
+      if (req.bError)
+        break;
+      if ((res = SERVE_HAL(target_init, pnd, &nt, ps->abtScratch, szRx, timeout)) >= 0) {
+        tcp_put_target(presp, &nt);
+        tcp_put_bytes(presp, ps->abtScratch, res);
+      }
+      break;
+    }
+    case TCP_OP_TARGET_SEND_BYTES:
+    case TCP_OP_DEP_WRITE: {
+      const int timeout = (int32_t) tcp_get_u32(&req);
+      const size_t szTx = tcp_get_remaining(&req);
+      const uint8_t *pbtTx = tcp_get_bytes(&req, szTx);
+      if (req.bError)
+        break;
+      if (pr->btOp == TCP_OP_TARGET_SEND_BYTES)
+        res = SERVE_HAL(target_send_bytes, pnd, pbtTx, szTx, timeout);
+      else
+        res = SERVE_HAL(dep_write, pnd, pbtTx, szTx, timeout);
+      break;
+    }
+    case TCP_OP_TARGET_RECEIVE_BYTES:
+    case TCP_OP_DEP_READ: {
+      const size_t szRx = tcp_get_u16(&req);
+      const int timeout = (int32_t) tcp_get_u32(&req);
+      if (req.bError)
+        break;
+      if (pr->btOp == TCP_OP_TARGET_RECEIVE_BYTES)
+        res = SERVE_HAL(target_receive_bytes, pnd, pbtRx, szRx, timeout);
+      else
+        res = SERVE_HAL(dep_read, pnd, pbtRx, szRx, timeout);
+      if (res > 0)
+        presp->szPos = res;
+      break;
+    }
+    case TCP_OP_TARGET_SEND_BITS: {
+      const size_t szTxBits = tcp_get_u16(&req);
+      const uint8_t btFlags = tcp_get_u8(&req);
+      const uint8_t *pbtTx = tcp_get_bytes(&req, (szTxBits + 7) / 8);
+      const uint8_t *pbtTxPar = (btFlags & TCP_BITS_TX_PARITY) ? tcp_get_bytes(&req, (szTxBits + 7) / 8) : NULL;
+      if (!req.bError)
+        res = SERVE_HAL(target_send_bits, pnd, pbtTx, szTxBits, pbtTxPar);
+      break;
+    }
+    case TCP_OP_TARGET_RECEIVE_BITS: {
+      // Answer and parity bits must fit the response together
+      const size_t szRequested = tcp_get_u16(&req);
+      const size_t szRx = MIN(szRequested, TCP_PAYLOAD_MAX_LEN / 2);
+      const bool bRxPar = tcp_get_u8(&req) & TCP_BITS_RX_PARITY;
+      if (req.bError)
+        break;
+      res = SERVE_HAL(target_receive_bits, pnd, pbtRx, szRx, bRxPar ? ps->abtScratch : NULL);
+      tcp_serve_bits(ps, presp, res, bRxPar);
+      break;
+    }
+    case TCP_OP_SET_PROPERTY_BOOL: {
+      const nfc_property property = tcp_get_u8(&req);
+      const bool bEnable = tcp_get_u8(&req);
+      if (req.bError)
+        break;
+      res = SERVE_HAL(device_set_property_bool, pnd, property, bEnable);
+      tcp_put_u8(presp, tcp_device_flags(pnd));
+      break;
+    }
+    case TCP_OP_SET_PROPERTY_INT: {
+      const nfc_property property = tcp_get_u8(&req);
+      const int value = (int32_t) tcp_get_u32(&req);
+      if (req.bError)
+        break;
+      res = SERVE_HAL(device_set_property_int, pnd, property, value);
+      tcp_put_u8(presp, tcp_device_flags(pnd));
+      break;
+    }
+    case TCP_OP_SET_PROPERTIES: {
+      nfc_property_setting aSettings[0xff];
+      const size_t szSettings = tcp_get_u8(&req);
+      for (size_t i = 0; i < szSettings; i++) {
+        aSettings[i].property = tcp_get_u8(&req);
+        aSettings[i].value = (int32_t) tcp_get_u32(&req);
+      }
+      if (req.bError)
+        break;
+      // Same fallback as for a local device, the lock being recursive
+      res = nfc_device_set_properties(pnd, aSettings, szSettings);
+      tcp_put_u8(presp, tcp_device_flags(pnd));
+      break;
+    }
+    case TCP_OP_GET_SUPPORTED_MODULATION: {
+      const nfc_modulation_type *pnmt = NULL;
+      const nfc_mode mode = tcp_get_u8(&req);
+      if (req.bError)
+        break;
+      if (((res = SERVE_HAL(get_supported_modulation, pnd, mode, &pnmt)) >= 0) && pnmt) {
+        for (size_t i = 0; pnmt[i]; i++)
+          tcp_put_u8(presp, pnmt[i]);
+      }
+      break;
+    }
+    case TCP_OP_GET_SUPPORTED_BAUD_RATE: {
+      const nfc_baud_rate *pnbr = NULL;
+      const nfc_mode mode = tcp_get_u8(&req);
+      const nfc_modulation_type nmt = tcp_get_u8(&req);
+      if (req.bError)
+        break;
+      if (((res = SERVE_HAL(get_supported_baud_rate, pnd, mode, nmt, &pnbr)) >= 0) && pnbr) {
+        for (size_t i = 0; pnbr[i]; i++)
+          tcp_put_u8(presp, pnbr[i]);
+      }
+      break;
+    }
+    case TCP_OP_GET_INFORMATION_ABOUT: {
+      char *pcInfo = NULL;
+      if (((res = SERVE_HAL(device_get_information_about, pnd, &pcInfo)) >= 0) && pcInfo)
+        tcp_put_bytes(presp, (const uint8_t *) pcInfo, MIN(strlen(pcInfo), TCP_PAYLOAD_MAX_LEN));
+      free(pcInfo);
+      break;
+    }
+    case TCP_OP_IDLE:
+      return SERVE_HAL(idle, pnd);
+    case TCP_OP_POWERDOWN:
+      return SERVE_HAL(powerdown, pnd);
+    default:
+      return NFC_EDEVNOTSUPP;
+  }
+  return res;
+}
+
+static void *
+tcp_serve_run(void *arg)
+{
+  struct tcp_server *ps = arg;
+  nfc_device *pnd = ps->pnd;
+
+  for (;;) {
+    pthread_mutex_lock(&ps->lock);
+    while (!ps->szCount && !ps->bClosed)
+      pthread_cond_wait(&ps->cond, &ps->lock);
+    if (ps->bClosed) {
+      pthread_mutex_unlock(&ps->lock);
+      break;
+    }
+    struct tcp_serve_request *pr = &(ps->aRequests[ps->szHead]);
+    pthread_mutex_unlock(&ps->lock);
+
+    struct tcp_buffer resp = { ps->abtResponse + TCP_RESPONSE_HEADER_LEN, TCP_PAYLOAD_MAX_LEN, 0, false };
+    // Connections sharing the device are served in turn
+    nfc_device_turn_take(pnd);
+    nfc_device_lock(pnd);
+    pthread_mutex_lock(&ps->lock);
+    ps->bRunning = true;
+    pthread_mutex_unlock(&ps->lock);
+    pnd->last_error = 0;
+    const int32_t res = tcp_serve_dispatch(ps, pr, &resp);
+    pthread_mutex_lock(&ps->lock);
+    ps->bRunning = false;
+    pthread_mutex_unlock(&ps->lock);
+    nfc_device_unlock(pnd);
+    nfc_device_turn_release(pnd);
+    if (resp.bError)
+      resp.szPos = 0;
+
+    uint8_t *pbtHeader = ps->abtResponse;
+    pbtHeader[0] = pr->ui16Id >> 8;
+    pbtHeader[1] = pr->ui16Id & 0xff;
+    pbtHeader[2] = (uint32_t) res >> 24;
+    pbtHeader[3] = ((uint32_t) res >> 16) & 0xff;
+    pbtHeader[4] = ((uint32_t) res >> 8) & 0xff;
+    pbtHeader[5] = (uint32_t) res & 0xff;
+    pbtHeader[6] = resp.szPos >> 8;
+    pbtHeader[7] = resp.szPos & 0xff;
+    const int iWrite = ps->link.write(&ps->link, ps->abtResponse, TCP_RESPONSE_HEADER_LEN + resp.szPos);
+
+    pthread_mutex_lock(&ps->lock);
+    ps->szHead = (ps->szHead + 1) % TCP_SERVE_QUEUE_LEN;
+    ps->szCount--;
+    if (iWrite < 0) {
+      ps->res = iWrite;
+      ps->bClosed = true;
+    }
+    pthread_cond_broadcast(&ps->cond);
+    pthread_mutex_unlock(&ps->lock);
+  }
+  return NULL;
+}
+
+// Aborts the request of this connection, if one is being run
+static void
+tcp_serve_abort(struct tcp_server *ps)
+{
+  pthread_mutex_lock(&ps->lock);
+  if (ps->bRunning || !ps->bShared)
+    nfc_abort_command(ps->pnd);
+  pthread_mutex_unlock(&ps->lock);
+}
+
+int
+tcp_serve_link(nfc_device *pnd, const struct tcp_link *link, const bool bShared)
+{
+  struct tcp_server *ps;
+  pthread_t thread;
+  uint8_t abtHeader[TCP_REQUEST_HEADER_LEN];
+  int res;
+
+  if ((ps = malloc(sizeof(struct tcp_server))) == NULL)
+    return NFC_ESOFT;
+  ps->pnd = pnd;
+  ps->link = *link;
+  ps->bShared = bShared;
+  ps->szHead = 0;
+  ps->szCount = 0;
+  ps->bClosed = false;
+  ps->bRunning = false;
+  ps->res = NFC_SUCCESS;
+  pthread_mutex_init(&ps->lock, NULL);
+  pthread_cond_init(&ps->cond, NULL);
+  if (pthread_create(&thread, NULL, tcp_serve_run, ps) != 0) {
+    pthread_cond_destroy(&ps->cond);
+    pthread_mutex_destroy(&ps->lock);
+    free(ps);
+    return NFC_ESOFT;
+  }
+
+  // Read requests ahead, while the previous ones are being run
+  for (;;) {
+    if ((res = ps->link.read(&ps->link, abtHeader, sizeof(abtHeader))) < 0)
+      break;
+    const size_t szPayload = (abtHeader[3] << 8) | abtHeader[4];
+    if (abtHeader[0] == TCP_OP_ABORT) {
+      // Must not wait for the command to abort
+      tcp_serve_abort(ps);
+      if (szPayload && ((res = ps->link.read(&ps->link, ps->abtScratch, szPayload)) < 0))
+        break;
+      continue;
+    }
+
+    pthread_mutex_lock(&ps->lock);
+    while ((ps->szCount == TCP_SERVE_QUEUE_LEN) && !ps->bClosed)
+      pthread_cond_wait(&ps->cond, &ps->lock);
+    const bool bClosed = ps->bClosed;
+    struct tcp_serve_request *pr = &(ps->aRequests[(ps->szHead + ps->szCount) % TCP_SERVE_QUEUE_LEN]);
+    pthread_mutex_unlock(&ps->lock);
+    if (bClosed)
+      break;
+
+    pr->btOp = abtHeader[0];
+    pr->ui16Id = (abtHeader[1] << 8) | abtHeader[2];
+    pr->szPayload = szPayload;
+    if ((res = ps->link.read(&ps->link, pr->abtPayload, szPayload)) < 0)
+      break;
+    pthread_mutex_lock(&ps->lock);
+    ps->szCount++;
+    pthread_cond_broadcast(&ps->cond);
+    pthread_mutex_unlock(&ps->lock);
+  }
+
+  // Client gone: unblock the command being run, if any
+  pthread_mutex_lock(&ps->lock);
+  ps->bClosed = true;
+  pthread_cond_broadcast(&ps->cond);
+  pthread_mutex_unlock(&ps->lock);
+  tcp_serve_abort(ps);
+  pthread_join(thread, NULL);
+  // Leave the device idle, unless other clients use it
+  if (!bShared)
+    nfc_idle(pnd);
+
+  if (res == NFC_ETGRELEASED)
+    res = ps->res;
+  pthread_cond_destroy(&ps->cond);
+  pthread_mutex_destroy(&ps->lock);
+  free(ps);
+  return res;
+}
+
+int
+tcp_serve(nfc_device *pnd, int fd)
+{
+  struct tcp_link link;
+
+  tcp_socket_link(&link, fd);
+  // The caller keeps its socket
+  link.close = NULL;
+  return tcp_serve_link(pnd, &link, false);
+}
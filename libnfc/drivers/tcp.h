@@ -0,0 +1,60 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file tcp.h
+ * @brief Driver for devices exported over the network by nfc_tcp_serve()
+ */
+
+#ifndef __NFC_DRIVER_TCP_H__
+#define __NFC_DRIVER_TCP_H__
+
+#include <nfc/nfc-types.h>
+
+/**
+ * @struct tcp_link
+ * @brief Byte stream the protocol runs over
+ *
+ * \a read and \a write transfer the whole buffer or fail. \a fd is the
+ * pollable file descriptor of the client side.
+ */
+struct tcp_link {
+  int (*read)(struct tcp_link *link, uint8_t *pbtData, const size_t szData);
+  int (*write)(struct tcp_link *link, const uint8_t *pbtData, const size_t szData);
+  /** Makes \a fd readable once an answer is available, if needed */
+  void (*arm)(struct tcp_link *link);
+  void (*close)(struct tcp_link *link);
+  int fd;
+  void *data;
+};
+
+extern const struct nfc_driver tcp_driver;
+
+nfc_device *tcp_open_link(const nfc_context *context, const nfc_connstring connstring, const struct nfc_driver *driver, const struct tcp_link *link);
+int tcp_serve_link(nfc_device *pnd, const struct tcp_link *link, const bool bShared);
+int tcp_serve(nfc_device *pnd, int fd);
+
+#endif // ! __NFC_DRIVER_TCP_H__
@@ -40,4 +40,8 @@
 #define ISO7816_SHORT_C_APDU_MAX_LEN (ISO7816_C_APDU_COMMAND_HEADER_LEN + ISO7816_SHORT_APDU_MAX_DATA_LEN + ISO7816_SHORT_C_APDU_MAX_OVERHEAD)
 #define ISO7816_SHORT_R_APDU_MAX_LEN (ISO7816_SHORT_APDU_MAX_DATA_LEN + ISO7816_SHORT_R_APDU_RESPONSE_TRAILER_LEN)
 
+// Extended length: Lc on 3 bytes then Le on 2 bytes, up to 65535 bytes sent and 65536 expected
+#define ISO7816_EXTENDED_C_APDU_MAX_LEN (ISO7816_C_APDU_COMMAND_HEADER_LEN + 3 + 65535 + 2)
+#define ISO7816_EXTENDED_R_APDU_MAX_LEN (65536 + ISO7816_SHORT_R_APDU_RESPONSE_TRAILER_LEN)
+
 #endif /* !__LIBNFC_ISO7816_H__ */
@@ -54,16 +54,25 @@ log_priority_to_str(const int priority)
 
 #include "log-internal.h"
 
+// Process-wide, read by any thread logging through any context
+static uint32_t log_current_level =
+#ifdef DEBUG
+  3;
+#else
+  1;
+#endif
+
+// Set by log_set_level(), the configuration of later contexts then leaves the level alone
+static bool log_level_pinned = false;
+
+// Set while probing optional devices, which must not be reported
+static __thread bool log_thread_muted = false;
+
 void
 log_init(const nfc_context *context)
 {
-#ifdef ENVVARS
-  char str[32];
-  sprintf(str, "%"PRIu32, context->log_level);
-  setenv("LIBNFC_LOG_LEVEL", str, 1);
-#else
-  (void)context;
-#endif
+  if (!__atomic_load_n(&log_level_pinned, __ATOMIC_RELAXED))
+    __atomic_store_n(&log_current_level, context->log_level, __ATOMIC_RELAXED);
 }
 
 void
@@ -72,36 +81,45 @@ log_exit(void)
 }
 
 void
-log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+log_set_level(const uint32_t log_level)
 {
-  char *env_log_level = NULL;
-#ifdef ENVVARS
-  env_log_level = getenv("LIBNFC_LOG_LEVEL");
-#endif
-  uint32_t log_level;
-  if (NULL == env_log_level) {
-    // LIBNFC_LOG_LEVEL is not set
-#ifdef DEBUG
-    log_level = 3;
-#else
-    log_level = 1;
-#endif
-  } else {
-    log_level = atoi(env_log_level);
-  }
+  __atomic_store_n(&log_level_pinned, true, __ATOMIC_RELAXED);
+  __atomic_store_n(&log_current_level, log_level, __ATOMIC_RELAXED);
+}
+
+uint32_t
+log_get_level(void)
+{
+  return __atomic_load_n(&log_current_level, __ATOMIC_RELAXED);
+}
 
+void
+log_mute_thread(const bool bMuted)
+{
+  log_thread_muted = bMuted;
+}
+
+bool
+log_enabled_at_runtime(const uint8_t group, const uint8_t priority)
+{
+  const uint32_t log_level = __atomic_load_n(&log_current_level, __ATOMIC_RELAXED);
   //  printf("log_level = %"PRIu32" group = %"PRIu8" priority = %"PRIu8"\n", log_level, group, priority);
-  if (log_level) { // If log is not disabled by log_level=none
-    if (((log_level & 0x00000003) >= priority) ||   // Global log level
-        (((log_level >> (group * 2)) & 0x00000003) >= priority)) { // Group log level
-
-      va_list va;
-      va_start(va, format);
-      log_put_internal("%s\t%s\t", log_priority_to_str(priority), category);
-      log_vput_internal(format, va);
-      log_put_internal("\n");
-      va_end(va);
-    }
+  if (!log_level || log_thread_muted) // If log is disabled by log_level=none
+    return false;
+  return (((log_level & 0x00000003) >= priority) ||   // Global log level
+          (((log_level >> (group * 2)) & 0x00000003) >= priority)); // Group log level
+}
+
+void
+log_put_message(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+{
+  if (log_enabled_at_runtime(group, priority)) {
+    va_list va;
+    va_start(va, format);
+    log_put_internal("%s\t%s\t", log_priority_to_str(priority), category);
+    log_vput_internal(format, va);
+    log_put_internal("\n");
+    va_end(va);
   }
 }
 
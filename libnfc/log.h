@@ -58,6 +58,40 @@
        LIBNFC_LOG_LEVEL=3585  // 1+512+3072
 */
 
+/*
+  Build-time ceilings, one per group: messages above them are compiled out,
+  arguments included, whatever the runtime log level. They default to DEBUG
+  and are set with e.g. -DLIBNFC_LOG_MAX_COM=INFO (CMake) or
+  --with-log-max="COM=INFO" (configure), which define LOG_MAX_COM.
+*/
+#ifndef LOG_MAX_GENERAL
+#  define LOG_MAX_GENERAL NFC_LOG_PRIORITY_DEBUG
+#endif
+#ifndef LOG_MAX_CONFIG
+#  define LOG_MAX_CONFIG  NFC_LOG_PRIORITY_DEBUG
+#endif
+#ifndef LOG_MAX_CHIP
+#  define LOG_MAX_CHIP    NFC_LOG_PRIORITY_DEBUG
+#endif
+#ifndef LOG_MAX_DRIVER
+#  define LOG_MAX_DRIVER  NFC_LOG_PRIORITY_DEBUG
+#endif
+#ifndef LOG_MAX_COM
+#  define LOG_MAX_COM     NFC_LOG_PRIORITY_DEBUG
+#endif
+#ifndef LOG_MAX_LIBUSB
+#  define LOG_MAX_LIBUSB  NFC_LOG_PRIORITY_DEBUG
+#endif
+
+// Constant when group and priority are, so that the compiler drops dead call sites
+#define log_compiled(group, priority) ((priority) <= \
+  ((group) == NFC_LOG_GROUP_GENERAL ? LOG_MAX_GENERAL : \
+   (group) == NFC_LOG_GROUP_CONFIG ? LOG_MAX_CONFIG : \
+   (group) == NFC_LOG_GROUP_CHIP ? LOG_MAX_CHIP : \
+   (group) == NFC_LOG_GROUP_DRIVER ? LOG_MAX_DRIVER : \
+   (group) == NFC_LOG_GROUP_COM ? LOG_MAX_COM : \
+   (group) == NFC_LOG_GROUP_LIBUSB ? LOG_MAX_LIBUSB : NFC_LOG_PRIORITY_DEBUG))
+
 //int log_priority_to_int(const char* priority);
 const char *log_priority_to_str(const int priority);
 
@@ -73,15 +107,28 @@ const char *log_priority_to_str(const int priority);
 
 void log_init(const nfc_context *context);
 void log_exit(void);
-void log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+void log_set_level(const uint32_t log_level);
+uint32_t log_get_level(void);
+void log_mute_thread(const bool bMuted);
+bool log_enabled_at_runtime(const uint8_t group, const uint8_t priority);
+void log_put_message(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
 #  if __has_attribute_format
 __attribute__((format(printf, 4, 5)))
 #  endif
 ;
+#  define log_enabled(group, priority) (log_compiled(group, priority) && log_enabled_at_runtime(group, priority))
+#  define log_put(group, category, priority, ...) do { \
+    if (log_compiled(group, priority)) \
+      log_put_message(group, category, priority, __VA_ARGS__); \
+  } while (0)
 #else
 // No logging
 #define log_init(nfc_context) ((void) 0)
 #define log_exit() ((void) 0)
+#define log_set_level(log_level) ((void) (log_level))
+#define log_get_level() ((uint32_t) 0)
+#define log_mute_thread(bMuted) ((void) (bMuted))
+#define log_enabled(group, priority) (false)
 #define log_put(group, category, priority, format, ...) do {} while (0)
 
 #endif // LOG
@@ -96,12 +143,18 @@ __attribute__((format(printf, 4, 5)))
     size_t	 __szPos; \
     char	 __acBuf[1024]; \
     size_t	 __szBuf = 0; \
+    if (!log_compiled(group, NFC_LOG_PRIORITY_DEBUG)) { \
+      break; \
+    } \
     if ((int)szBytes < 0) { \
       fprintf (stderr, "%s:%d: Attempt to print %d bytes!\n", __FILE__, __LINE__, (int)szBytes); \
       log_put (group, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s:%d: Attempt to print %d bytes!\n", __FILE__, __LINE__, (int)szBytes); \
       abort(); \
       break; \
     } \
+    if (!log_enabled(group, NFC_LOG_PRIORITY_DEBUG)) { \
+      break; \
+    } \
     snprintf (__acBuf + __szBuf, sizeof(__acBuf) - __szBuf, "%s: ", pcTag); \
     __szBuf += strlen (pcTag) + 2; \
     for (__szPos=0; (__szPos < (size_t)(szBytes)) && (__szBuf < sizeof(__acBuf)); __szPos++) { \
@@ -0,0 +1,269 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-apdu-script.c
+ * @brief Run a precompiled sequence of APDUs against the selected target
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "iso7816.h"
+
+#define APDU_STEP_CHECK_SW 0x01
+#define APDU_STEP_CAPTURE  0x02
+
+struct apdu_step {
+  const uint8_t *pbtCApdu;
+  size_t szCApdu;
+  uint16_t ui16Sw;
+  uint16_t ui16SwMask;
+  // Index in aCaptures, -1 to receive in abtRApdu
+  int iSlot;
+};
+
+struct apdu_capture {
+  uint8_t abtData[ISO7816_SHORT_R_APDU_MAX_LEN];
+  int iLen;
+};
+
+struct nfc_apdu_script {
+  uint8_t *pbtScript;
+  struct apdu_step *aSteps;
+  size_t szSteps;
+  struct apdu_capture *aCaptures;
+  size_t szCaptures;
+  // Answers of the steps without capture slot, one per batch frame
+  uint8_t abtRApdu[NFC_BATCH_MAX_FRAMES][ISO7816_SHORT_R_APDU_MAX_LEN];
+  int aiRes[NFC_BATCH_MAX_FRAMES];
+  int iLastSw;
+};
+
+// Walks the script, filling steps when given, returns the steps count or -1 if malformed
+static int
+apdu_script_parse(const uint8_t *pbtScript, const size_t szScript, struct apdu_step *aSteps, size_t *pszCaptures)
+{
+  size_t szOffset = 0;
+  int iSteps = 0;
+
+  *pszCaptures = 0;
+  while (szOffset < szScript) {
+    if (szScript - szOffset < 3)
+      return -1;
+    const uint8_t btFlags = pbtScript[szOffset];
+    const size_t szCApdu = (pbtScript[szOffset + 1] << 8) | pbtScript[szOffset + 2];
+    const size_t szStep = 3 + szCApdu + ((btFlags & APDU_STEP_CHECK_SW) ? 4 : 0) + ((btFlags & APDU_STEP_CAPTURE) ? 1 : 0);
+    if ((btFlags & ~(APDU_STEP_CHECK_SW | APDU_STEP_CAPTURE)) ||
+        (szCApdu < ISO7816_C_APDU_COMMAND_HEADER_LEN) || (szCApdu > ISO7816_SHORT_C_APDU_MAX_LEN) ||
+        (szScript - szOffset < szStep))
+      return -1;
+
+    const uint8_t *pbtNext = pbtScript + szOffset + 3 + szCApdu;
+    uint16_t ui16Sw = 0, ui16SwMask = 0;
+    int iSlot = -1;
+    if (btFlags & APDU_STEP_CHECK_SW) {
+      ui16Sw = (pbtNext[0] << 8) | pbtNext[1];
+      ui16SwMask = (pbtNext[2] << 8) | pbtNext[3];
+      pbtNext += 4;
+    }
+    if (btFlags & APDU_STEP_CAPTURE) {
+      iSlot = pbtNext[0];
+      if ((size_t) iSlot + 1 > *pszCaptures)
+        *pszCaptures = iSlot + 1;
+    }
+    if (aSteps) {
+      aSteps[iSteps].pbtCApdu = pbtScript + szOffset + 3;
+      aSteps[iSteps].szCApdu = szCApdu;
+      aSteps[iSteps].ui16Sw = ui16Sw;
+      aSteps[iSteps].ui16SwMask = ui16SwMask;
+      aSteps[iSteps].iSlot = iSlot;
+    }
+    szOffset += szStep;
+    iSteps++;
+  }
+  return iSteps;
+}
+
+/** @ingroup initiator
+ * @brief Load a binary APDU script
+ * @return Returns the script to give to nfc_apdu_script_run(), or \e NULL if it is malformed or on error
+ *
+ * @param pbtScript script bytes, copied
+ * @param szScript size of the script
+ *
+ * The script is a sequence of steps, each made of:
+ * - a flags byte: 0x01 when an expected status word follows the C-APDU, 0x02
+ *   when a capture slot follows;
+ * - the C-APDU length, on two bytes big endian, then the C-APDU itself (a
+ *   short APDU, header included);
+ * - if flagged, the expected SW1 SW2 then the mask SW1 SW2 telling which bits
+ *   are compared (i.e. 90 00 ff ff for success only, 61 00 ff 00 for any 61xx);
+ * - if flagged, the capture slot number (0 to 255) keeping the R-APDU.
+ *
+ * The script is checked once here so that nfc_apdu_script_run() only has to
+ * exchange the APDUs.
+ */
+nfc_apdu_script *
+nfc_apdu_script_load(const uint8_t *pbtScript, const size_t szScript)
+{
+  nfc_apdu_script *pas;
+  size_t szCaptures;
+  int iSteps;
+
+  if ((pbtScript == NULL) || ((iSteps = apdu_script_parse(pbtScript, szScript, NULL, &szCaptures)) < 0))
+    return NULL;
+  if ((pas = calloc(1, sizeof(nfc_apdu_script))) == NULL)
+    return NULL;
+  pas->pbtScript = malloc(szScript ? szScript : 1);
+  pas->aSteps = malloc(iSteps ? iSteps * sizeof(struct apdu_step) : 1);
+  pas->aCaptures = calloc(szCaptures ? szCaptures : 1, sizeof(struct apdu_capture));
+  if (!pas->pbtScript || !pas->aSteps || !pas->aCaptures) {
+    nfc_apdu_script_free(pas);
+    return NULL;
+  }
+  memcpy(pas->pbtScript, pbtScript, szScript);
+  pas->szSteps = apdu_script_parse(pas->pbtScript, szScript, pas->aSteps, &szCaptures);
+  pas->szCaptures = szCaptures;
+  for (size_t i = 0; i < szCaptures; i++)
+    pas->aCaptures[i].iLen = NFC_EOPABORTED;
+  pas->iLastSw = -1;
+  return pas;
+}
+
+/** @ingroup initiator
+ * @brief Free a script loaded by nfc_apdu_script_load()
+ *
+ * @param pas script, can be \e NULL
+ */
+void
+nfc_apdu_script_free(nfc_apdu_script *pas)
+{
+  if (pas == NULL)
+    return;
+  free(pas->pbtScript);
+  free(pas->aSteps);
+  free(pas->aCaptures);
+  free(pas);
+}
+
+/** @ingroup initiator
+ * @brief Run a script against the selected target
+ * @return Returns the number of steps whose status word matched (the whole script if equal to the steps count), otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pas script loaded by nfc_apdu_script_load()
+ * @param timeout in milliseconds, applied to each APDU
+ *
+ * APDUs are exchanged like with nfc_initiator_transceive_bytes(), so the
+ * target must be selected with easy framing (or activated by the application).
+ * They are sent as batches (see nfc_batch_commit()): the chip is set up once
+ * per batch and answers are received straight into the capture slots.
+ *
+ * The script stops at the first APDU whose answer does not match its expected
+ * status word, see nfc_apdu_script_get_sw(). Capture slots of steps which did
+ * not run report \c NFC_EOPABORTED.
+ */
+int
+nfc_apdu_script_run(nfc_device *pnd, nfc_apdu_script *pas, int timeout)
+{
+  size_t szDone = 0;
+  int res;
+
+  if (pas == NULL) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  for (size_t i = 0; i < pas->szCaptures; i++)
+    pas->aCaptures[i].iLen = NFC_EOPABORTED;
+  pas->iLastSw = -1;
+
+  while (szDone < pas->szSteps) {
+    const size_t szBatch = MIN(pas->szSteps - szDone, NFC_BATCH_MAX_FRAMES);
+    nfc_batch_begin(pnd);
+    for (size_t i = 0; i < szBatch; i++) {
+      const struct apdu_step *step = &(pas->aSteps[szDone + i]);
+      uint8_t *pbtRx = (step->iSlot < 0) ? pas->abtRApdu[i] : pas->aCaptures[step->iSlot].abtData;
+      if ((res = nfc_batch_append(pnd, step->pbtCApdu, step->szCApdu, pbtRx, ISO7816_SHORT_R_APDU_MAX_LEN, &(pas->aiRes[i]))) < 0)
+        return res;
+      pnd->batch_frames[i].ui16Sw = step->ui16Sw;
+      pnd->batch_frames[i].ui16SwMask = step->ui16SwMask;
+    }
+    res = nfc_batch_commit(pnd, timeout);
+
+    for (size_t i = 0; i < szBatch; i++) {
+      const struct apdu_step *step = &(pas->aSteps[szDone]);
+      const uint8_t *pbtRx = (step->iSlot < 0) ? pas->abtRApdu[i] : pas->aCaptures[step->iSlot].abtData;
+      const int iRes = pas->aiRes[i];
+      if (iRes < 0)
+        return (res < 0) ? res : iRes;
+      if (step->iSlot >= 0)
+        pas->aCaptures[step->iSlot].iLen = iRes;
+      pas->iLastSw = (iRes >= 2) ? ((pbtRx[iRes - 2] << 8) | pbtRx[iRes - 1]) : -1;
+      if (step->ui16SwMask && ((pas->iLastSw < 0) || ((pas->iLastSw ^ step->ui16Sw) & step->ui16SwMask)))
+        return (int) szDone;
+      szDone++;
+    }
+  }
+  return (int) szDone;
+}
+
+/** @ingroup initiator
+ * @brief Get the status word which ended the last R-APDU received by nfc_apdu_script_run()
+ * @return Returns SW1 SW2 as a 16 bits value, or -1 if no answer carried a status word
+ *
+ * @param pas script loaded by nfc_apdu_script_load()
+ */
+int
+nfc_apdu_script_get_sw(const nfc_apdu_script *pas)
+{
+  return pas ? pas->iLastSw : -1;
+}
+
+/** @ingroup initiator
+ * @brief Get the R-APDU kept in a capture slot during nfc_apdu_script_run()
+ * @return Returns the R-APDU length (status word included), otherwise returns libnfc's error code
+ *
+ * @param pas script loaded by nfc_apdu_script_load()
+ * @param ui8Slot capture slot number
+ * @param[out] ppbtData will point to the R-APDU, valid until the script is run again or freed
+ */
+int
+nfc_apdu_script_get_capture(const nfc_apdu_script *pas, const uint8_t ui8Slot, const uint8_t **ppbtData)
+{
+  if ((pas == NULL) || (ui8Slot >= pas->szCaptures))
+    return NFC_EINVARG;
+  if (ppbtData)
+    *ppbtData = pas->aCaptures[ui8Slot].abtData;
+  return pas->aCaptures[ui8Slot].iLen;
+}
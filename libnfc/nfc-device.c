@@ -29,19 +29,26 @@
  * @brief Provide internal function to manipulate nfc_device type
  */
 
-#include <stdlib.h>
-#include <string.h>
-
 #ifdef HAVE_CONFIG_H
 #  include "config.h"
 #endif // HAVE_CONFIG_H
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
 #include "nfc-internal.h"
 
+NFC_POOL(nfc_device_pool, nfc_device, NFC_POOL_DEVICES);
+
+// Set by nfc_thread_set_priority_class()
+static __thread nfc_priority_class nfc_thread_class = NFC_PRIORITY_TRANSACTION;
+
 nfc_device *
 nfc_device_new(const nfc_context *context, const nfc_connstring connstring)
 {
-  nfc_device *res = malloc(sizeof(*res));
+  nfc_device *res = nfc_pool_alloc(&nfc_device_pool);
 
   if (!res) {
     return NULL;
@@ -59,11 +66,59 @@ nfc_device_new(const nfc_context *context, const nfc_connstring connstring)
   res->bEasyFraming    = false;
   res->bInfiniteSelect = false;
   res->bAutoIso14443_4 = false;
+  res->bAutoBitrate    = false;
   res->last_error  = 0;
+  res->szBatchFrames = 0;
+  res->bBatch = false;
+  res->isodep.bActive = false;
+  // Chip retries as set up by NP_INFINITE_SELECT so far, no host retry
+  res->retry_policy.chip_passive_activation = 0x02;
+  res->retry_policy.chip_atr = 0x00;
+  res->retry_policy.chip_psl = 0x01;
+  res->retry_policy.chip_com = 0x00;
+  res->retry_policy.host_retries = 0;
+  res->retry_policy.backoff_ms = 10;
+  res->retry_policy.backoff_max_ms = 200;
+  res->retry_policy.budget_ms = 500;
+  res->retry_policy.credit_percent = 10;
+  res->uiRetryGeneration = 0;
+  res->uiRetryCredit = NFC_RETRY_CREDIT_MAX;
+  res->ui32RetrySeed = (uint32_t)(uintptr_t) res | 1;
+  res->bCaps = false;
+  res->pcInformation = NULL;
+  // Field always on, as when the chip polls by itself
+  res->poll_policy.duty_percent = 100;
+  res->poll_policy.software = false;
+  res->bPollAbort = false;
+  memset(&res->stats, 0, sizeof(res->stats));
+  res->bTiming = false;
+  res->bTimingActive = false;
+  memset(&res->last_timing, 0, sizeof(res->last_timing));
+  res->trace = NULL;
+  res->bTraceOwned = false;
+  res->bTraceStarted = false;
+  res->uiTraceInterface = 0;
   memcpy(res->connstring, connstring, sizeof(res->connstring));
+  res->driver = NULL;
   res->driver_data = NULL;
   res->chip_data   = NULL;
 
+  pthread_mutex_init(&res->lock, NULL);
+  pthread_cond_init(&res->lock_cond, NULL);
+  res->uiLockDepth = 0;
+  res->uiLockGeneration = 0;
+  memset(res->auiLockWaiting, 0, sizeof(res->auiLockWaiting));
+  res->uiAgingMs = NFC_PRIORITY_AGING_MS;
+  pthread_mutex_init(&res->turn_lock, NULL);
+  pthread_cond_init(&res->turn_cond, NULL);
+  res->uiTurnNext = 0;
+  res->uiTurnServing = 0;
+
+  // Capture from the very first frame, see nfc_device_set_trace()
+  if (context && context->trace) {
+    res->trace = context->trace;
+  }
+
   return res;
 }
 
@@ -71,7 +126,260 @@ void
 nfc_device_free(nfc_device *dev)
 {
   if (dev) {
-    free(dev->driver_data);
-    free(dev);
+    nfc_trace_close(dev);
+    free(dev->pcInformation);
+    pthread_cond_destroy(&dev->lock_cond);
+    pthread_mutex_destroy(&dev->lock);
+    pthread_cond_destroy(&dev->turn_cond);
+    pthread_mutex_destroy(&dev->turn_lock);
+    nfc_pool_free(dev->driver_data);
+    nfc_pool_free(dev);
+  }
+}
+
+/**
+ * @brief Fill the capability cache of \a dev from its driver
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * Modulation and baud rate lists do not change once a device is open: having
+ * them at hand spares a driver call, possibly a network round trip, to each
+ * nfc_device_get_supported_modulation() and to the modulation check of each
+ * select. The information report is dropped, to be built again on request.
+ * Called at open and by nfc_device_refresh_capabilities(), with the lock held.
+ */
+int
+nfc_device_load_capabilities(nfc_device *dev)
+{
+  const struct nfc_driver *ndr = dev->driver;
+  nfc_device_capabilities *pcaps = &dev->caps;
+  const nfc_mode anm[] = { N_TARGET, N_INITIATOR };
+  int res;
+
+  __atomic_store_n(&dev->bCaps, false, __ATOMIC_RELEASE);
+  free(dev->pcInformation);
+  dev->pcInformation = NULL;
+  if (!ndr->get_supported_modulation || !ndr->get_supported_baud_rate)
+    return NFC_EDEVNOTSUPP;
+  memset(pcaps, 0, sizeof(*pcaps));
+  for (size_t m = 0; m < sizeof(anm) / sizeof(anm[0]); m++) {
+    const nfc_modulation_type *nmt;
+    size_t szTypes = 0;
+
+    if ((res = ndr->get_supported_modulation(dev, anm[m], &nmt)) < 0)
+      return res;
+    for (size_t i = 0; nmt[i] && (szTypes < NFC_MAX_MODULATION_TYPES); i++) {
+      const nfc_baud_rate *nbr;
+
+      if ((nmt[i] < NMT_ISO14443A) || (nmt[i] > NMT_DEP))
+        continue;
+      if ((res = ndr->get_supported_baud_rate(dev, anm[m], nmt[i], &nbr)) < 0)
+        return res;
+      pcaps->modulations[anm[m]][szTypes++] = nmt[i];
+      for (size_t j = 0; nbr[j] && (j < NFC_MAX_BAUD_RATES); j++)
+        pcaps->baud_rates[anm[m]][nmt[i]][j] = nbr[j];
+    }
+  }
+  if (ndr->device_get_capabilities && ((res = ndr->device_get_capabilities(dev, pcaps)) < 0))
+    return res;
+  __atomic_store_n(&dev->bCaps, true, __ATOMIC_RELEASE);
+  return NFC_SUCCESS;
+}
+
+// Is a thread of a class above uiClass waiting for dev
+static bool
+nfc_device_lock_outranked(const nfc_device *dev, const unsigned int uiClass)
+{
+  for (unsigned int c = uiClass + 1; c <= NFC_PRIORITY_AGED; c++) {
+    if (dev->auiLockWaiting[c])
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Take the device for the calling thread
+ *
+ * Recursive, as some public functions are built on top of others. Waiting
+ * threads get the device, when it is released, in the order of their
+ * classes (see nfc_thread_set_priority_class()), so that a thread calling
+ * the device in a loop lets a thread of a higher class in between two calls.
+ * A thread waiting longer than the aging time of the device goes ahead of
+ * all classes, which bounds the wait of background threads.
+ */
+void
+nfc_device_lock(nfc_device *dev)
+{
+  const pthread_t self = pthread_self();
+  unsigned int uiClass = nfc_thread_class;
+
+  pthread_mutex_lock(&dev->lock);
+  if (dev->uiLockDepth && pthread_equal(dev->tLockOwner, self)) {
+    dev->uiLockDepth++;
+    pthread_mutex_unlock(&dev->lock);
+    return;
+  }
+  if (dev->uiLockDepth || nfc_device_lock_outranked(dev, uiClass)) {
+    struct timespec tsAged = { 0, 0 };
+    bool bAged = (dev->uiAgingMs == 0);
+    if (!bAged) {
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      const uint64_t ui64Us = (uint64_t) tv.tv_usec + (uint64_t) dev->uiAgingMs * 1000;
+      tsAged.tv_sec = tv.tv_sec + (time_t)(ui64Us / 1000000);
+      tsAged.tv_nsec = (long)(ui64Us % 1000000) * 1000;
+    }
+    dev->auiLockWaiting[uiClass]++;
+    while (dev->uiLockDepth || nfc_device_lock_outranked(dev, uiClass)) {
+      if (bAged) {
+        pthread_cond_wait(&dev->lock_cond, &dev->lock);
+      } else if (pthread_cond_timedwait(&dev->lock_cond, &dev->lock, &tsAged) == ETIMEDOUT) {
+        dev->auiLockWaiting[uiClass]--;
+        uiClass = NFC_PRIORITY_AGED;
+        dev->auiLockWaiting[uiClass]++;
+        bAged = true;
+      }
+    }
+    dev->auiLockWaiting[uiClass]--;
+  }
+  dev->tLockOwner = self;
+  dev->uiLockDepth = 1;
+  dev->uiLockGeneration++;
+  pthread_mutex_unlock(&dev->lock);
+}
+
+void
+nfc_device_unlock(nfc_device *dev)
+{
+  pthread_mutex_lock(&dev->lock);
+  if (--dev->uiLockDepth == 0)
+    pthread_cond_broadcast(&dev->lock_cond);
+  pthread_mutex_unlock(&dev->lock);
+}
+
+/** @ingroup properties
+ * @brief Set the class of the calls the calling thread makes to devices
+ * @return Returns the previous class of the thread
+ * @param npc class of the next calls, \a NFC_PRIORITY_TRANSACTION by default
+ *
+ * A device waited for by several threads goes to the highest class first:
+ * threads monitoring targets or probing devices in the background should set
+ * \a NFC_PRIORITY_BACKGROUND, so that they do not delay transactions by more
+ * than the call they are making. nfc_presence_monitor_start() threads do it.
+ */
+nfc_priority_class
+nfc_thread_set_priority_class(const nfc_priority_class npc)
+{
+  const nfc_priority_class res = nfc_thread_class;
+  nfc_thread_class = (npc > NFC_PRIORITY_TRANSACTION) ? NFC_PRIORITY_TRANSACTION : npc;
+  return res;
+}
+
+/** @ingroup properties
+ * @brief Set how long a thread waits for a device before going ahead of all classes
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param uiAgingMs aging time in milliseconds, 0 to never promote a thread
+ *
+ * Bounds the wait of background threads on a device kept busy by
+ * transactions, 200 ms by default.
+ */
+int
+nfc_device_set_priority_aging(nfc_device *pnd, const unsigned int uiAgingMs)
+{
+  pthread_mutex_lock(&pnd->lock);
+  pnd->uiAgingMs = uiAgingMs;
+  pthread_mutex_unlock(&pnd->lock);
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Wait for the turn of the calling thread to use the device
+ *
+ * Turns are given in the order they were asked for, so that threads serving
+ * several clients of the same device (see tcp_serve_link()) are served
+ * fairly, which \a lock alone does not guarantee.
+ */
+void
+nfc_device_turn_take(nfc_device *dev)
+{
+  pthread_mutex_lock(&dev->turn_lock);
+  const unsigned int uiTurn = dev->uiTurnNext++;
+  while (dev->uiTurnServing != uiTurn)
+    pthread_cond_wait(&dev->turn_cond, &dev->turn_lock);
+  pthread_mutex_unlock(&dev->turn_lock);
+}
+
+void
+nfc_device_turn_release(nfc_device *dev)
+{
+  pthread_mutex_lock(&dev->turn_lock);
+  dev->uiTurnServing++;
+  pthread_cond_broadcast(&dev->turn_cond);
+  pthread_mutex_unlock(&dev->turn_lock);
+}
+
+/**
+ * @brief Have the driver fill the device name if it left it empty at open
+ *
+ * Serialized on its own lock rather than \a lock, as callbacks run with the
+ * latter held may ask for the name.
+ */
+void
+nfc_device_resolve_name(nfc_device *dev)
+{
+  static pthread_mutex_t name_lock = PTHREAD_MUTEX_INITIALIZER;
+
+  if (!NFC_DRIVER(dev)->device_get_name)
+    return;
+  pthread_mutex_lock(&name_lock);
+  if (!*dev->name)
+    NFC_DRIVER(dev)->device_get_name(dev);
+  pthread_mutex_unlock(&name_lock);
+}
+
+/*
+ * Command timing, enabled by NP_COMMAND_TIMING: the chip layer starts timing
+ * when it sends a command and ends it once the answer is parsed, drivers mark
+ * the phases in between they can see. Only the first time a phase is reached
+ * counts, so that chained frames and retried reads do not move it.
+ */
+void
+nfc_timing_start(nfc_device *pnd, const uint8_t btCommand)
+{
+  clock_gettime(CLOCK_MONOTONIC, &pnd->tsTimingStart);
+  pnd->timing.command = btCommand;
+  pnd->timing.phases = 0;
+  pnd->bTimingActive = true;
+}
+
+void
+nfc_timing_mark(nfc_device *pnd, const nfc_command_phase phase)
+{
+  if (pnd->timing.phases & (1 << phase))
+    return;
+
+  struct timespec tsNow;
+  clock_gettime(CLOCK_MONOTONIC, &tsNow);
+  const int64_t us = ((int64_t)(tsNow.tv_sec - pnd->tsTimingStart.tv_sec) * 1000000) + (tsNow.tv_nsec - pnd->tsTimingStart.tv_nsec) / 1000;
+  pnd->timing.phase_us[phase] = (us > 0) ? (uint32_t) MIN(us, UINT32_MAX) : 0;
+  pnd->timing.phases |= 1 << phase;
+}
+
+void
+nfc_timing_done(nfc_device *pnd)
+{
+  uint32_t uiPrevious = 0;
+
+  pnd->bTimingActive = false;
+  pnd->last_timing = pnd->timing;
+  pnd->stats.timed_commands++;
+  for (int i = 0; i < NFC_COMMAND_PHASES; i++) {
+    if (!(pnd->timing.phases & (1 << i)))
+      continue;
+    // Drivers may see phases out of order, e.g. an ACK read along with the answer
+    if (pnd->timing.phase_us[i] > uiPrevious) {
+      pnd->stats.phase_time_us[i] += pnd->timing.phase_us[i] - uiPrevious;
+      uiPrevious = pnd->timing.phase_us[i];
+    }
   }
 }
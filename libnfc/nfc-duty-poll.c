@@ -0,0 +1,205 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file nfc-duty-poll.c
+ * @brief Duty-cycled polling for devices which cannot poll by themselves
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <time.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+#define LOG_CATEGORY "libnfc.general"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+// Unit of uiPeriod, as for InAutoPoll
+#define POLL_PERIOD_UNIT_MS 150
+// The field-off part of a slot is slept in slices, so that an abort cuts it short
+#define POLL_SLEEP_SLICE_MS 10
+// Selects answered faster than this (e.g. by a simulated chip) are paced, to bound host CPU
+#define POLL_SELECT_MIN_MS 5
+
+static int64_t
+nfc_poll_now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+nfc_poll_sleep_until(nfc_device *pnd, const int64_t until)
+{
+  int64_t now;
+  while (!pnd->bPollAbort && ((now = nfc_poll_now_ms()) < until)) {
+    const int64_t ms = MIN(until - now, POLL_SLEEP_SLICE_MS);
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = (long) ms * 1000000;
+    nanosleep(&ts, NULL);
+  }
+}
+
+/*
+ * Polls with nfc_initiator_select_passive_target(), modulation after
+ * modulation, each in a slot of uiPeriod x 150 ms: single-shot selects are
+ * sent during the first duty_percent of the slot, then the field is switched
+ * off until the slot ends. The time spent in selects counts in the slot, so a
+ * poll lasts the same on every reader. Called with the device lock held.
+ */
+int
+nfc_poll_software(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations,
+                  const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt)
+{
+  const int64_t iSlotMs = (int64_t) uiPeriod * POLL_PERIOD_UNIT_MS;
+  const int64_t iListenMs = MAX(iSlotMs * pnd->poll_policy.duty_percent / 100, 1);
+  const bool bInfiniteSelect = pnd->bInfiniteSelect;
+  bool bFieldOff = false;
+  int result = 0;
+  int res;
+
+  if ((szModulations == 0) || (uiPollNr == 0) || (uiPeriod == 0) || (uiPeriod > 0x0f)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  // Modulations the device lacks are left out, as InAutoPoll would do
+  size_t aszPolled[szModulations];
+  size_t szPolled = 0;
+  for (size_t n = 0; n < szModulations; n++) {
+    if (nfc_device_validate_modulation(pnd, N_INITIATOR, &pnmModulations[n]) == NFC_SUCCESS)
+      aszPolled[szPolled++] = n;
+  }
+  if (szPolled == 0) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+
+  pnd->bPollAbort = false;
+  // Each select gives up quickly, the slot sets how long we keep on trying
+  if ((res = nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, false)) < 0)
+    return res;
+
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Software polling: %d ms slots, field on for %d ms",
+          (int) iSlotMs, (int) iListenMs);
+  do {
+    for (size_t p = 0; p < uiPollNr; p++) {
+      for (size_t m = 0; m < szPolled; m++) {
+        const nfc_modulation nm = pnmModulations[aszPolled[m]];
+        const int64_t iSlotStart = nfc_poll_now_ms();
+
+        if (bFieldOff) {
+          if ((result = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true)) < 0)
+            goto end;
+          bFieldOff = false;
+        }
+        do {
+          const int64_t iSelectStart = nfc_poll_now_ms();
+          if ((res = nfc_initiator_select_passive_target(pnd, nm, NULL, 0, pnt)) > 0) {
+            result = res;
+            goto end;
+          }
+          // Noise and collisions are no reason to stop polling
+          if ((res < 0) && (res != NFC_ERFTRANS) && (res != NFC_ETIMEOUT)) {
+            result = res;
+            goto end;
+          }
+          nfc_poll_sleep_until(pnd, MIN(iSelectStart + POLL_SELECT_MIN_MS, iSlotStart + iListenMs));
+        } while (!pnd->bPollAbort && (nfc_poll_now_ms() - iSlotStart < iListenMs));
+
+        if (iListenMs < iSlotMs) {
+          if ((result = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0)
+            goto end;
+          bFieldOff = true;
+          nfc_poll_sleep_until(pnd, iSlotStart + iSlotMs);
+        }
+        // Drivers able to abort fail the next select by themselves
+        if (pnd->bPollAbort && !NFC_DRIVER(pnd)->abort_command) {
+          pnd->last_error = NFC_EOPABORTED;
+          result = pnd->last_error;
+          goto end;
+        }
+      }
+    }
+  } while (uiPollNr == 0xff); // uiPollNr==0xff means infinite polling
+  result = 0;
+end:
+  // Leave the device as we found it
+  if (bFieldOff)
+    nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true);
+  if (bInfiniteSelect) {
+    if ((res = nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, true)) < 0)
+      return res;
+  }
+  if (result >= 0)
+    pnd->last_error = 0;
+  return result;
+}
+
+/** @ingroup properties
+ * @brief Set how a device is polled when it cannot poll by itself
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnpp \a nfc_poll_policy struct pointer holding the new policy
+ *
+ * Applies to nfc_initiator_poll_target() on devices without hardware polling
+ * (e.g. PN531, PN533 or ACR122 readers), for modulations the device cannot
+ * poll by itself, or on any device once \a software is set.
+ * A lower \a duty_percent saves power and RF exposure at the price of targets
+ * entering the field being found later.
+ */
+int
+nfc_device_set_poll_policy(nfc_device *pnd, const nfc_poll_policy *pnpp)
+{
+  if ((pnpp->duty_percent < 1) || (pnpp->duty_percent > 100)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  nfc_device_lock(pnd);
+  pnd->poll_policy = *pnpp;
+  nfc_device_unlock(pnd);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup properties
+ * @brief Get the poll policy of a device
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pnpp \a nfc_poll_policy struct pointer where the policy will be copied
+ */
+int
+nfc_device_get_poll_policy(const nfc_device *pnd, nfc_poll_policy *pnpp)
+{
+  *pnpp = pnd->poll_policy;
+  return NFC_SUCCESS;
+}
@@ -29,11 +29,46 @@
  * @brief Provide a small API to ease emulation in libnfc
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
 #include <nfc/nfc.h>
 #include <nfc/nfc-emulation.h>
 
+#include "nfc-internal.h"
 #include "iso7816.h"
 
+static int
+nfc_emulate_target_loop(nfc_device *pnd, struct nfc_emulator *emulator, uint8_t *abtRx, uint8_t *abtTx, const int timeout)
+{
+  int res;
+  if ((res = nfc_target_init(pnd, emulator->target, abtRx, ISO7816_EXTENDED_C_APDU_MAX_LEN, timeout)) < 0) {
+    return res;
+  }
+
+  size_t szRx = res;
+  int io_res = res;
+  while (io_res >= 0) {
+    io_res = emulator->state_machine->io(emulator, abtRx, szRx, abtTx, ISO7816_EXTENDED_R_APDU_MAX_LEN);
+    if (io_res > 0) {
+      res = nfc_target_transceive_bytes(pnd, abtTx, io_res, abtRx, ISO7816_EXTENDED_C_APDU_MAX_LEN, timeout);
+    } else if (io_res == 0) {
+      res = nfc_target_receive_bytes(pnd, abtRx, ISO7816_EXTENDED_C_APDU_MAX_LEN, timeout);
+    } else {
+      break;
+    }
+    if (res < 0) {
+      return res;
+    }
+    szRx = res;
+  }
+  return io_res;
+}
+
 /** @ingroup emulation
  * @brief Emulate a target
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
@@ -41,36 +76,173 @@
  * @param pnd \a nfc_device struct pointer that represents currently used device
  * @param emulator \nfc_emulator struct point that handles input/output functions
  *
+ * The \a io function works in place: \a data_in is the frame as received and
+ * \a data_out is written as it will be sent, both sized for extended length
+ * APDUs. Each answer goes out with nfc_target_transceive_bytes(), which gets
+ * the next frame in the same call.
+ *
  * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
  * If timeout equals to -1, the default timeout will be used
  */
 int
 nfc_emulate_target(nfc_device *pnd, struct nfc_emulator *emulator, const int timeout)
 {
-  uint8_t abtRx[ISO7816_SHORT_R_APDU_MAX_LEN];
-  uint8_t abtTx[ISO7816_SHORT_C_APDU_MAX_LEN];
+  // Allocated once, the exchange loop itself does not allocate
+  uint8_t *abtRx = malloc(ISO7816_EXTENDED_C_APDU_MAX_LEN);
+  uint8_t *abtTx = malloc(ISO7816_EXTENDED_R_APDU_MAX_LEN);
 
   int res;
-  if ((res = nfc_target_init(pnd, emulator->target, abtRx, sizeof(abtRx), timeout)) < 0) {
-    return res;
+  if (!abtRx || !abtTx) {
+    res = NFC_ESOFT;
+  } else {
+    res = nfc_emulate_target_loop(pnd, emulator, abtRx, abtTx, timeout);
   }
+  free(abtRx);
+  free(abtTx);
+  return res;
+}
 
-  size_t szRx = res;
-  int io_res = res;
-  while (io_res >= 0) {
-    io_res = emulator->state_machine->io(emulator, abtRx, szRx, abtTx, sizeof(abtTx));
-    if (io_res > 0) {
-      if ((res = nfc_target_send_bytes(pnd, abtTx, io_res, timeout)) < 0) {
-        return res;
-      }
-    }
-    if (io_res >= 0) {
-      if ((res = nfc_target_receive_bytes(pnd, abtRx, sizeof(abtRx), timeout)) < 0) {
-        return res;
-      }
-      szRx = res;
-    }
+/** @ingroup emulation
+ * @brief Precompute the answers of an emulated NFC Forum Tag Type 2
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param tag2 \a nfc_emulation_tag2 struct pointer to fill
+ * @param memory tag memory, 4 bytes per block
+ * @param memory_len memory size, a multiple of 4, up to NFC_EMULATION_TAG2_MAX_BLOCKS blocks
+ * @param append_crc true when the device does not handle the CRC (\a NP_HANDLE_CRC disabled)
+ *
+ * The READ answer of every block address is built once here, rolling over to
+ * block 0 like a real tag, so that nfc_emulation_tag2_io() only copies it:
+ * the emulation loop does not compute, print nor allocate anything, which
+ * keeps the answer within the frame waiting time of strict readers. The
+ * memory is read-only, it has to be initialized again to change it.
+ */
+int
+nfc_emulation_tag2_init(struct nfc_emulation_tag2 *tag2, const uint8_t *memory, const size_t memory_len, const bool append_crc)
+{
+  if ((memory_len == 0) || (memory_len % 4) || (memory_len / 4 > NFC_EMULATION_TAG2_MAX_BLOCKS))
+    return NFC_EINVARG;
+
+  tag2->szBlocks = memory_len / 4;
+  tag2->szReadLen = append_crc ? 16 + 2 : 16;
+  for (size_t block = 0; block < tag2->szBlocks; block++) {
+    for (size_t n = 0; n < 4; n++)
+      memcpy(tag2->abtRead[block] + (n * 4), memory + (((block + n) % tag2->szBlocks) * 4), 4);
+    iso14443a_crc_append(tag2->abtRead[block], 16);
   }
-  return io_res;
+  return NFC_SUCCESS;
 }
 
+#define TAG2_READ 0x30
+#define TAG2_HALT 0x50
+
+/** @ingroup emulation
+ * @brief State machine \a io of an NFC Forum Tag Type 2 prepared by nfc_emulation_tag2_init()
+ * @return Returns the answer length, 0 to stay silent, otherwise returns libnfc's error code (negative value) ending the emulation.
+ *
+ * READ of a valid block address is answered; other commands, including WRITE,
+ * get no answer, like a NAK the reader times out on. HALT ends the emulation
+ * with \c NFC_ETGRELEASED.
+ */
+int
+nfc_emulation_tag2_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  const struct nfc_emulation_tag2 *tag2 = emulator->state_machine->data;
+
+  if ((data_in_len >= 2) && (data_in[0] == TAG2_READ) && (data_in[1] < tag2->szBlocks)) {
+    if (data_out_len < tag2->szReadLen)
+      return NFC_EOVFLOW;
+    memcpy(data_out, tag2->abtRead[data_in[1]], tag2->szReadLen);
+    return tag2->szReadLen;
+  }
+  if ((data_in_len >= 1) && (data_in[0] == TAG2_HALT))
+    return NFC_ETGRELEASED;
+  return 0;
+}
+
+static void
+nfc_emulation_raw_rule_set(struct nfc_emulation_raw_rule *rule, const uint8_t *command, const size_t command_bits,
+                           const uint8_t *answer, const size_t answer_bits)
+{
+  memcpy(rule->command, command, (command_bits + 7) / 8);
+  rule->command_bits = command_bits;
+  if (answer_bits)
+    memcpy(rule->answer, answer, (answer_bits + 7) / 8);
+  rule->answer_bits = answer_bits;
+}
+
+/** @ingroup emulation
+ * @brief Build the raw emulation rules answering the ISO/IEC 14443-3 anti-collision of a tag
+ * @return Returns the number of rules written, otherwise returns libnfc's error code (negative value).
+ *
+ * @param pnai ATQA, SAK and UID (4, 7 or 10 bytes) of the tag
+ * @param rules receives the rules, to be given to nfc_emulate_raw()
+ *
+ * REQA and WUPA get the ATQA, then each cascade level gets its UID part and
+ * BCC on ANTICOLLISION, and its SAK on SELECT, the last one being \a btSak.
+ * HLTA is ignored. Bit oriented anti-collision frames, only sent by readers
+ * when two tags answer, are not in the rules.
+ */
+int
+nfc_emulation_uid_rules(const nfc_iso14443a_info *pnai, struct nfc_emulation_raw_rule rules[NFC_EMULATION_UID_MAX_RULES])
+{
+  const uint8_t abtReqa[] = { 0x26 };
+  const uint8_t abtWupa[] = { 0x52 };
+  uint8_t abtHlta[4] = { 0x50, 0x00 };
+  // ATQA goes LSB first over the air
+  const uint8_t abtAtqa[2] = { pnai->abtAtqa[1], pnai->abtAtqa[0] };
+  uint8_t abtCascadedUid[12];
+  size_t szCascadedUid;
+  size_t n = 0;
+
+  if ((pnai->szUidLen != 4) && (pnai->szUidLen != 7) && (pnai->szUidLen != 10))
+    return NFC_EINVARG;
+  iso14443_cascade_uid(pnai->abtUid, pnai->szUidLen, abtCascadedUid, &szCascadedUid);
+
+  nfc_emulation_raw_rule_set(&rules[n++], abtReqa, 7, abtAtqa, 16);
+  nfc_emulation_raw_rule_set(&rules[n++], abtWupa, 7, abtAtqa, 16);
+  for (size_t level = 0; level < szCascadedUid / 4; level++) {
+    const bool bLast = (level + 1 == szCascadedUid / 4);
+    uint8_t abtAnticol[2] = { 0x93 + 2 * level, 0x20 };
+    uint8_t abtSelect[9] = { 0x93 + 2 * level, 0x70 };
+    uint8_t abtSak[3] = { bLast ? pnai->btSak : 0x04 };
+
+    memcpy(abtSelect + 2, abtCascadedUid + level * 4, 4);
+    abtSelect[6] = abtSelect[2] ^ abtSelect[3] ^ abtSelect[4] ^ abtSelect[5];
+    iso14443a_crc_append(abtSelect, 7);
+    iso14443a_crc_append(abtSak, 1);
+    nfc_emulation_raw_rule_set(&rules[n++], abtAnticol, 16, abtSelect + 2, 40);
+    nfc_emulation_raw_rule_set(&rules[n++], abtSelect, 72, abtSak, 24);
+  }
+  iso14443a_crc_append(abtHlta, 2);
+  nfc_emulation_raw_rule_set(&rules[n++], abtHlta, 32, NULL, 0);
+  return n;
+}
+
+/** @ingroup emulation
+ * @brief Answer the initiator from a table of raw frames
+ * @return Returns the received bits count of the first frame which is not in the table, otherwise returns libnfc's error code (negative value).
+ *
+ * @param pnd \a nfc_device struct pointer that represents currently used device, once nfc_target_init() returned
+ * @param rules table of commands and their answers, e.g. from nfc_emulation_uid_rules()
+ * @param rules_count number of rules, up to NFC_EMULATION_RAW_MAX_RULES
+ * @param[out] rx receives the frame which is not in the table
+ * @param rx_len size of \a rx
+ *
+ * The CRC is no longer handled by the device (\a NP_HANDLE_CRC disabled), the
+ * parity is (\a NP_HANDLE_PARITY enabled). The answers are prepared when the
+ * emulation starts, so that the exchange loop runs in the driver without
+ * computing, printing nor allocating anything, keeping the answers within the
+ * tight timings of anti-collision. The emulation can be stopped with
+ * nfc_abort_command().
+ */
+int
+nfc_emulate_raw(nfc_device *pnd, const struct nfc_emulation_raw_rule *rules, const size_t rules_count, uint8_t *rx, const size_t rx_len)
+{
+  int res;
+
+  if (((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0))
+    return res;
+  HAL(target_emulate_raw, pnd, rules, rules_count, rx, rx_len);
+}
@@ -0,0 +1,509 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-executor.c
+ * @brief Spread jobs over a farm of NFC devices
+ *
+ * Each device has a worker thread which polls for a card, then runs queued
+ * jobs on it. Jobs wait in lock-free queues, one per modulation type plus one
+ * for jobs accepting any card, shared by all the workers: a job is bound to a
+ * device only when a worker with a suitable card takes it, so work never
+ * waits behind a busy device while another one is idle.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+// Jobs per queue, must be a power of two
+#define EXECUTOR_QUEUE_SIZE 256
+// One queue per modulation type, queue 0 takes jobs accepting any card
+#define EXECUTOR_QUEUES (NMT_DEP + 1)
+// Pause between polls finding nothing, in ms
+#define EXECUTOR_HUNT_INTERVAL 100
+// Presence checks of a card waiting for jobs, in ms
+#define EXECUTOR_PRESENCE_MIN_INTERVAL 50
+#define EXECUTOR_PRESENCE_MAX_INTERVAL 400
+
+struct executor_cell {
+  size_t seq;
+  nfc_executor_job job;
+  void *user_data;
+};
+
+// Bounded MPMC queue: a cell is free for the producer at position p when its
+// sequence equals p, and holds a job for the consumer when it equals p + 1.
+struct executor_queue {
+  size_t enqueue_pos;
+  uint8_t pad0[64 - sizeof(size_t)];
+  size_t dequeue_pos;
+  uint8_t pad1[64 - sizeof(size_t)];
+  struct executor_cell cells[EXECUTOR_QUEUE_SIZE];
+};
+
+struct executor_worker {
+  nfc_executor *pe;
+  nfc_device *pnd;
+  pthread_t thread;
+  bool started;
+  // Written by nfc_executor_submit() and nfc_executor_stop() to wake the worker
+  int fds[2];
+  // 1 while the worker waits on fds[0] with a card, cleared by whoever wakes it
+  int sleeping;
+  // Modulation type of the card held, 0 when none
+  int nmt;
+  bool polling;
+  nfc_target nt;
+  // Last card released by a job, ignored until it leaves the field
+  nfc_target ntRetired;
+  bool bRetired;
+  // Counters, only written by the worker
+  uint64_t jobs;
+  uint64_t errors;
+  uint64_t targets;
+  uint64_t busy_time_us;
+};
+
+struct nfc_executor {
+  const nfc_modulation *pnmModulations;
+  size_t szModulations;
+  struct executor_queue queues[EXECUTOR_QUEUES];
+  struct executor_worker *workers;
+  size_t szWorkers;
+  struct timeval tvStart;
+  // Serializes stop against workers entering nfc_initiator_poll_target()
+  pthread_mutex_t lock;
+  int stop;
+};
+
+static uint64_t
+executor_elapsed_us(const struct timeval *ptvStart)
+{
+  struct timeval tvNow;
+  gettimeofday(&tvNow, NULL);
+  return (uint64_t)(tvNow.tv_sec - ptvStart->tv_sec) * 1000000 + (uint64_t)(tvNow.tv_usec - ptvStart->tv_usec);
+}
+
+static void
+executor_queue_init(struct executor_queue *q)
+{
+  for (size_t i = 0; i < EXECUTOR_QUEUE_SIZE; i++)
+    q->cells[i].seq = i;
+  q->enqueue_pos = 0;
+  q->dequeue_pos = 0;
+}
+
+static bool
+executor_queue_push(struct executor_queue *q, nfc_executor_job job, void *user_data)
+{
+  struct executor_cell *cell;
+  size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+
+  for (;;) {
+    cell = &q->cells[pos & (EXECUTOR_QUEUE_SIZE - 1)];
+    const size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos) {
+      if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (seq < pos) {
+      return false; // Full
+    } else {
+      pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+  cell->job = job;
+  cell->user_data = user_data;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool
+executor_queue_pop(struct executor_queue *q, nfc_executor_job *pjob, void **puser_data)
+{
+  struct executor_cell *cell;
+  size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+
+  for (;;) {
+    cell = &q->cells[pos & (EXECUTOR_QUEUE_SIZE - 1)];
+    const size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos + 1) {
+      if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (seq < pos + 1) {
+      return false; // Empty
+    } else {
+      pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    }
+  }
+  *pjob = cell->job;
+  *puser_data = cell->user_data;
+  __atomic_store_n(&cell->seq, pos + EXECUTOR_QUEUE_SIZE, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Jobs for this very modulation come first, then the ones accepting any card
+static bool
+executor_take_job(nfc_executor *pe, const int nmt, nfc_executor_job *pjob, void **puser_data)
+{
+  return executor_queue_pop(&pe->queues[nmt], pjob, puser_data) ||
+         executor_queue_pop(&pe->queues[0], pjob, puser_data);
+}
+
+static bool
+executor_has_job(nfc_executor *pe, const int nmt)
+{
+  return (__atomic_load_n(&pe->queues[nmt].enqueue_pos, __ATOMIC_SEQ_CST) != __atomic_load_n(&pe->queues[nmt].dequeue_pos, __ATOMIC_SEQ_CST)) ||
+         (__atomic_load_n(&pe->queues[0].enqueue_pos, __ATOMIC_SEQ_CST) != __atomic_load_n(&pe->queues[0].dequeue_pos, __ATOMIC_SEQ_CST));
+}
+
+static void
+executor_wake(struct executor_worker *worker)
+{
+  const uint8_t btWake = 1;
+  if (write(worker->fds[1], &btWake, 1) < 0) {
+    // Pipe already full of wake-ups
+  }
+}
+
+static void
+executor_drain(struct executor_worker *worker)
+{
+  uint8_t abtBuf[16];
+  while (read(worker->fds[0], abtBuf, sizeof(abtBuf)) > 0) {
+  }
+}
+
+static bool
+executor_stopped(nfc_executor *pe)
+{
+  return __atomic_load_n(&pe->stop, __ATOMIC_ACQUIRE) != 0;
+}
+
+// Waits for ms milliseconds at most (-1: forever) on the wake pipe and fd, if any
+static int
+executor_wait(struct executor_worker *worker, const int fd, const int ms)
+{
+  struct pollfd pfds[2] = {
+    { worker->fds[0], POLLIN, 0 },
+    { fd, POLLIN, 0 },
+  };
+  const int res = poll(pfds, (fd < 0) ? 1 : 2, ms);
+  if ((res > 0) && (pfds[0].revents & POLLIN))
+    executor_drain(worker);
+  return res;
+}
+
+static void
+executor_release_target(struct executor_worker *worker, const bool bRetire)
+{
+  __atomic_store_n(&worker->nmt, 0, __ATOMIC_SEQ_CST);
+  if (bRetire) {
+    nfc_initiator_deselect_target(worker->pnd);
+    memcpy(&worker->ntRetired, &worker->nt, sizeof(nfc_target));
+    worker->bRetired = true;
+  }
+}
+
+// Polls once for a card, returns true when one is held
+static bool
+executor_hunt(struct executor_worker *worker)
+{
+  nfc_executor *pe = worker->pe;
+  int res;
+
+  pthread_mutex_lock(&pe->lock);
+  worker->polling = !executor_stopped(pe);
+  pthread_mutex_unlock(&pe->lock);
+  if (!worker->polling)
+    return false;
+  memset(&worker->nt, 0, sizeof(nfc_target));
+  res = nfc_initiator_poll_target(worker->pnd, pe->pnmModulations, pe->szModulations, 1, 1, &worker->nt);
+  pthread_mutex_lock(&pe->lock);
+  worker->polling = false;
+  pthread_mutex_unlock(&pe->lock);
+
+  if (res <= 0) {
+    // The retired card, if any, left the field
+    worker->bRetired = false;
+    return false;
+  }
+  if (worker->bRetired &&
+      (worker->nt.nm.nmt == worker->ntRetired.nm.nmt) &&
+      (memcmp(&worker->nt.nti, &worker->ntRetired.nti, sizeof(nfc_target_info)) == 0)) {
+    nfc_initiator_deselect_target(worker->pnd);
+    return false;
+  }
+  worker->bRetired = false;
+  __atomic_add_fetch(&worker->targets, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&worker->nmt, worker->nt.nm.nmt, __ATOMIC_SEQ_CST);
+  return true;
+}
+
+// Sleeps until a job is submitted or the card is removed, returns false in the latter case
+static bool
+executor_idle(struct executor_worker *worker)
+{
+  nfc_executor *pe = worker->pe;
+  nfc_presence_monitor *pm;
+  bool bPresent = true;
+  int expected = 1;
+
+  if ((pm = nfc_presence_monitor_start(worker->pnd, &worker->nt, EXECUTOR_PRESENCE_MIN_INTERVAL,
+                                       EXECUTOR_PRESENCE_MAX_INTERVAL, NULL, NULL)) == NULL) {
+    executor_wait(worker, -1, EXECUTOR_HUNT_INTERVAL);
+    return true;
+  }
+  // Pairs with nfc_executor_submit() pushing then looking for a sleeper
+  __atomic_store_n(&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+  if (!executor_has_job(pe, worker->nmt) && !executor_stopped(pe)) {
+    struct pollfd pfd = { nfc_presence_monitor_get_fd(pm), POLLIN, 0 };
+    executor_wait(worker, pfd.fd, -1);
+    bPresent = (poll(&pfd, 1, 0) == 0);
+  }
+  __atomic_compare_exchange_n(&worker->sleeping, &expected, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  if ((nfc_presence_monitor_stop(pm) != NFC_SUCCESS) || !bPresent) {
+    executor_release_target(worker, false);
+    return false;
+  }
+  return true;
+}
+
+static void *
+executor_worker_run(void *arg)
+{
+  struct executor_worker *worker = arg;
+  nfc_executor *pe = worker->pe;
+  nfc_executor_job job;
+  void *user_data;
+
+  while (!executor_stopped(pe)) {
+    if (worker->nmt == 0) {
+      if (!executor_hunt(worker) && !executor_stopped(pe))
+        executor_wait(worker, -1, EXECUTOR_HUNT_INTERVAL);
+      continue;
+    }
+    if (!executor_take_job(pe, worker->nmt, &job, &user_data)) {
+      executor_idle(worker);
+      continue;
+    }
+    struct timeval tvStart;
+    gettimeofday(&tvStart, NULL);
+    const int res = job(worker->pnd, &worker->nt, user_data);
+    __atomic_add_fetch(&worker->busy_time_us, executor_elapsed_us(&tvStart), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&worker->jobs, 1, __ATOMIC_RELAXED);
+    if (res < 0) {
+      // The card may be gone or confused, select it again
+      __atomic_add_fetch(&worker->errors, 1, __ATOMIC_RELAXED);
+      executor_release_target(worker, false);
+    } else if (res > 0) {
+      executor_release_target(worker, true);
+    }
+  }
+  return NULL;
+}
+
+/** @ingroup initiator
+ * @brief Start running jobs on a farm of NFC devices
+ * @return Returns an executor to give to nfc_executor_submit(), or \e NULL on error
+ *
+ * @param pnds array of \a nfc_device struct pointers, each already opened and initialized as initiator
+ * @param szDevices number of devices in \a pnds
+ * @param pnmModulations modulations polled for cards, kept by reference until nfc_executor_stop()
+ * @param szModulations size of \a pnmModulations
+ *
+ * Each device gets a worker thread that polls for a card, then runs the jobs
+ * submitted with nfc_executor_submit() on it, one at a time. While no job is
+ * queued, a presence monitor watches the card so that a removed card is
+ * noticed and another one looked for.
+ *
+ * @note Devices must not be used by another thread until nfc_executor_stop().
+ */
+nfc_executor *
+nfc_executor_start(nfc_device *pnds[], const size_t szDevices,
+                   const nfc_modulation *pnmModulations, const size_t szModulations)
+{
+  nfc_executor *pe;
+
+  if ((pnds == NULL) || (szDevices == 0) || (pnmModulations == NULL) || (szModulations == 0))
+    return NULL;
+  if ((pe = malloc(sizeof(nfc_executor))) == NULL)
+    return NULL;
+  if ((pe->workers = calloc(szDevices, sizeof(struct executor_worker))) == NULL) {
+    free(pe);
+    return NULL;
+  }
+  pe->pnmModulations = pnmModulations;
+  pe->szModulations = szModulations;
+  for (size_t i = 0; i < EXECUTOR_QUEUES; i++)
+    executor_queue_init(&pe->queues[i]);
+  pe->szWorkers = szDevices;
+  pe->stop = 0;
+  pthread_mutex_init(&pe->lock, NULL);
+  gettimeofday(&pe->tvStart, NULL);
+
+  for (size_t i = 0; i < szDevices; i++) {
+    struct executor_worker *worker = &pe->workers[i];
+    worker->pe = pe;
+    worker->pnd = pnds[i];
+    if (pipe(worker->fds) < 0) {
+      worker->fds[0] = worker->fds[1] = -1;
+      continue;
+    }
+    fcntl(worker->fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(worker->fds[1], F_SETFL, O_NONBLOCK);
+    worker->started = (pthread_create(&worker->thread, NULL, executor_worker_run, worker) == 0);
+  }
+  for (size_t i = 0; i < szDevices; i++) {
+    if (pe->workers[i].started)
+      return pe;
+  }
+  nfc_executor_stop(pe);
+  return NULL;
+}
+
+/** @ingroup initiator
+ * @brief Queue a job for the first device holding a suitable card
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pe executor returned by nfc_executor_start()
+ * @param nmt modulation type of the cards the job can run on, 0 for any
+ * @param job function run by a worker with its device and the selected card
+ * @param user_data opaque pointer handed to \a job
+ *
+ * \a job returns 0 to keep the card for the next jobs, a positive value when
+ * done with it: that card is not taken again until it left the field. A
+ * negative value counts as an error and the card is selected again. A failed
+ * job is not run again, it is up to \a job to submit itself anew.
+ *
+ * Safe to call from any thread, \a job included. Returns NFC_EOVFLOW when
+ * too many jobs of this kind are waiting.
+ */
+int
+nfc_executor_submit(nfc_executor *pe, const nfc_modulation_type nmt, nfc_executor_job job, void *user_data)
+{
+  if ((pe == NULL) || (job == NULL) || ((int)nmt < 0) || ((int)nmt >= EXECUTOR_QUEUES))
+    return NFC_EINVARG;
+  if (executor_stopped(pe))
+    return NFC_EOPABORTED;
+  if (!executor_queue_push(&pe->queues[nmt], job, user_data))
+    return NFC_EOVFLOW;
+
+  // Busy workers take the job when done, only a sleeping one needs a nudge
+  for (size_t i = 0; i < pe->szWorkers; i++) {
+    struct executor_worker *worker = &pe->workers[i];
+    const int held = __atomic_load_n(&worker->nmt, __ATOMIC_SEQ_CST);
+    int expected = 1;
+    if ((held == 0) || ((nmt != 0) && (held != (int)nmt)))
+      continue;
+    if (__atomic_compare_exchange_n(&worker->sleeping, &expected, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      executor_wake(worker);
+      break;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Get the counters of one device of the farm
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pe executor returned by nfc_executor_start()
+ * @param szDevice index of the device in the array given to nfc_executor_start()
+ * @param[out] pstats counters of this device
+ *
+ * The device utilization is \a busy_time_us / \a run_time_us.
+ */
+int
+nfc_executor_get_stats(const nfc_executor *pe, const size_t szDevice, nfc_executor_stats *pstats)
+{
+  if ((pe == NULL) || (szDevice >= pe->szWorkers) || (pstats == NULL))
+    return NFC_EINVARG;
+  const struct executor_worker *worker = &pe->workers[szDevice];
+  pstats->jobs = __atomic_load_n(&worker->jobs, __ATOMIC_RELAXED);
+  pstats->errors = __atomic_load_n(&worker->errors, __ATOMIC_RELAXED);
+  pstats->targets = __atomic_load_n(&worker->targets, __ATOMIC_RELAXED);
+  pstats->busy_time_us = __atomic_load_n(&worker->busy_time_us, __ATOMIC_RELAXED);
+  pstats->run_time_us = executor_elapsed_us(&pe->tvStart);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Stop the workers and free the executor
+ * @return Returns the number of queued jobs that were never run, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pe executor returned by nfc_executor_start()
+ *
+ * Jobs being run are waited for, polls in progress are aborted. Must not be
+ * called from a job.
+ */
+int
+nfc_executor_stop(nfc_executor *pe)
+{
+  nfc_executor_job job;
+  void *user_data;
+  int dropped = 0;
+
+  if (pe == NULL)
+    return NFC_EINVARG;
+  pthread_mutex_lock(&pe->lock);
+  __atomic_store_n(&pe->stop, 1, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < pe->szWorkers; i++) {
+    if (pe->workers[i].polling)
+      nfc_abort_command(pe->workers[i].pnd);
+  }
+  pthread_mutex_unlock(&pe->lock);
+
+  for (size_t i = 0; i < pe->szWorkers; i++) {
+    struct executor_worker *worker = &pe->workers[i];
+    if (worker->started) {
+      executor_wake(worker);
+      pthread_join(worker->thread, NULL);
+    }
+    if (worker->fds[0] >= 0) {
+      close(worker->fds[0]);
+      close(worker->fds[1]);
+    }
+  }
+  for (size_t i = 0; i < EXECUTOR_QUEUES; i++) {
+    while (executor_queue_pop(&pe->queues[i], &job, &user_data))
+      dropped++;
+  }
+  pthread_mutex_destroy(&pe->lock);
+  free(pe->workers);
+  free(pe);
+  return dropped;
+}
@@ -0,0 +1,289 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-hotplug.c
+ * @brief Report devices plugged and unplugged
+ *
+ * Kernel uevents for the buses libnfc drivers sit on (USB, TTY, spidev and
+ * i2c-dev) trigger a scan, whose result is compared with the previous one:
+ * nothing is scanned while nothing is plugged nor unplugged.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "log.h"
+
+#define LOG_CATEGORY "libnfc.general"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+// Events come in bursts (USB device, then interface, then tty...): scan once it is over
+#define HOTPLUG_SETTLE_DELAY 500
+
+struct nfc_hotplug {
+  nfc_context *context;
+  nfc_hotplug_callback callback;
+  void *user_data;
+  pthread_t thread;
+  int fd;
+  // Written by nfc_hotplug_stop()
+  int fds[2];
+  nfc_connstring connstrings[MAX_CACHED_DEVICES];
+  size_t szDevices;
+};
+
+static const char *hotplug_subsystems[] = { "usb", "tty", "spidev", "i2c-dev", NULL };
+
+/*
+ * Returns 1 for an "add" event of a watched subsystem, -1 for a "remove"
+ * one, 0 otherwise. A uevent is "ACTION@DEVPATH" followed by KEY=VALUE
+ * strings, all NUL-terminated.
+ */
+static int
+hotplug_parse_uevent(const char *pcEvent, const size_t szEvent)
+{
+  int action = 0;
+  bool bWatched = false;
+
+  for (size_t szPos = 0; szPos < szEvent; szPos += strlen(pcEvent + szPos) + 1) {
+    const char *pcField = pcEvent + szPos;
+    if (strncmp(pcField, "ACTION=", 7) == 0) {
+      if (strcmp(pcField + 7, "add") == 0)
+        action = 1;
+      else if (strcmp(pcField + 7, "remove") == 0)
+        action = -1;
+    } else if (strncmp(pcField, "SUBSYSTEM=", 10) == 0) {
+      for (size_t i = 0; hotplug_subsystems[i]; i++)
+        bWatched |= (strcmp(pcField + 10, hotplug_subsystems[i]) == 0);
+    }
+  }
+  return bWatched ? action : 0;
+}
+
+/*
+ * Serial, SPI and I2C ports opened by a process are skipped by scans: while
+ * the port node exists, such a device is not gone.
+ */
+static bool
+hotplug_port_exists(const nfc_connstring connstring)
+{
+  const char *pcPath = strstr(connstring, ":/dev/");
+  char acPath[NFC_BUFSIZE_CONNSTRING];
+
+  if (pcPath == NULL)
+    return false;
+  snprintf(acPath, sizeof(acPath), "%s", pcPath + 1);
+  char *pcEnd = strchr(acPath, ':');
+  if (pcEnd)
+    *pcEnd = '\0';
+  return access(acPath, F_OK) == 0;
+}
+
+static bool
+hotplug_find(nfc_connstring connstrings[], const size_t szDevices, const nfc_connstring connstring)
+{
+  for (size_t i = 0; i < szDevices; i++) {
+    if (strcmp(connstrings[i], connstring) == 0)
+      return true;
+  }
+  return false;
+}
+
+static void
+hotplug_rescan(struct nfc_hotplug *ph, const bool bRemoved)
+{
+  nfc_connstring connstrings[MAX_CACHED_DEVICES];
+
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Scanning for plugged or unplugged devices");
+  nfc_list_devices_invalidate(ph->context);
+  size_t szDevices = nfc_list_devices(ph->context, connstrings, MAX_CACHED_DEVICES);
+
+  for (size_t i = 0; i < ph->szDevices; i++) {
+    if (hotplug_find(connstrings, szDevices, ph->connstrings[i]))
+      continue;
+    if (!bRemoved || hotplug_port_exists(ph->connstrings[i])) {
+      // Still there, only busy
+      if (szDevices < MAX_CACHED_DEVICES)
+        memcpy(connstrings[szDevices++], ph->connstrings[i], sizeof(nfc_connstring));
+      continue;
+    }
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Device unplugged: %s", ph->connstrings[i]);
+    ph->callback(ph->context, NFC_HOTPLUG_LEFT, ph->connstrings[i], ph->user_data);
+  }
+  for (size_t i = 0; i < szDevices; i++) {
+    if (hotplug_find(ph->connstrings, ph->szDevices, connstrings[i]))
+      continue;
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Device plugged: %s", connstrings[i]);
+    ph->callback(ph->context, NFC_HOTPLUG_ARRIVED, connstrings[i], ph->user_data);
+  }
+  memcpy(ph->connstrings, connstrings, szDevices * sizeof(nfc_connstring));
+  ph->szDevices = szDevices;
+}
+
+static void *
+hotplug_run(void *arg)
+{
+  struct nfc_hotplug *ph = arg;
+  struct pollfd pfds[2] = {
+    { ph->fd, POLLIN, 0 },
+    { ph->fds[0], POLLIN, 0 },
+  };
+  char acEvent[8192];
+  bool bPending = false;
+  bool bRemoved = false;
+
+  // Devices already there are reported first
+  hotplug_rescan(ph, false);
+  for (;;) {
+    pfds[0].revents = pfds[1].revents = 0;
+    const int res = poll(pfds, 2, bPending ? HOTPLUG_SETTLE_DELAY : -1);
+    if ((res < 0) || (pfds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+      break;
+    if (res == 0) {
+      hotplug_rescan(ph, bRemoved);
+      bPending = bRemoved = false;
+      continue;
+    }
+    const ssize_t szEvent = recv(ph->fd, acEvent, sizeof(acEvent) - 1, 0);
+    if (szEvent <= 0)
+      continue;
+    acEvent[szEvent] = '\0';
+    const int action = hotplug_parse_uevent(acEvent, (size_t) szEvent);
+    if (action != 0) {
+      bPending = true;
+      bRemoved |= (action < 0);
+    }
+  }
+  return NULL;
+}
+
+void
+nfc_hotplug_stop(nfc_context *context)
+{
+  struct nfc_hotplug *ph = context->hotplug;
+  const uint8_t btStop = 1;
+
+  if (ph == NULL)
+    return;
+  context->hotplug = NULL;
+  if (write(ph->fds[1], &btStop, 1) != 1)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to stop hotplug thread");
+  pthread_join(ph->thread, NULL);
+  close(ph->fds[0]);
+  close(ph->fds[1]);
+  close(ph->fd);
+  free(ph);
+}
+
+/** @ingroup dev
+ * @brief Get notified when devices are plugged or unplugged
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param context The context to operate on.
+ * @param callback function called for each device plugged or unplugged, \e NULL to stop
+ * @param user_data opaque pointer handed back to \a callback
+ *
+ * \a callback is called from a libnfc thread, first for the devices already
+ * there, then whenever the kernel reports a USB, serial, SPI or I2C device
+ * coming or going, with the connstrings nfc_list_devices() gains or loses.
+ * A device in use, as a serial port opened by another process, is not
+ * reported unplugged while its port is still there.
+ *
+ * Only available on Linux (kernel uevents), NFC_EDEVNOTSUPP is returned
+ * elsewhere. nfc_exit() stops notifications. Must not be called from
+ * \a callback.
+ */
+int
+nfc_context_set_hotplug_callback(nfc_context *context, nfc_hotplug_callback callback, void *user_data)
+{
+  struct nfc_hotplug *ph;
+  struct sockaddr_nl snl;
+
+  nfc_hotplug_stop(context);
+  if (callback == NULL)
+    return NFC_SUCCESS;
+
+  if ((ph = malloc(sizeof(struct nfc_hotplug))) == NULL)
+    return NFC_ESOFT;
+  ph->context = context;
+  ph->callback = callback;
+  ph->user_data = user_data;
+  ph->szDevices = 0;
+  if ((ph->fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT)) < 0) {
+    free(ph);
+    return NFC_EDEVNOTSUPP;
+  }
+  memset(&snl, 0, sizeof(snl));
+  snl.nl_family = AF_NETLINK;
+  // Kernel events multicast group
+  snl.nl_groups = 1;
+  if ((bind(ph->fd, (struct sockaddr *) &snl, sizeof(snl)) < 0) || (pipe(ph->fds) < 0)) {
+    close(ph->fd);
+    free(ph);
+    return NFC_EDEVNOTSUPP;
+  }
+  if (pthread_create(&ph->thread, NULL, hotplug_run, ph) != 0) {
+    close(ph->fds[0]);
+    close(ph->fds[1]);
+    close(ph->fd);
+    free(ph);
+    return NFC_ESOFT;
+  }
+  context->hotplug = ph;
+  return NFC_SUCCESS;
+}
+
+#else // __linux__
+
+void
+nfc_hotplug_stop(nfc_context *context)
+{
+  (void) context;
+}
+
+int
+nfc_context_set_hotplug_callback(nfc_context *context, nfc_hotplug_callback callback, void *user_data)
+{
+  (void) context;
+  (void) user_data;
+  return (callback == NULL) ? NFC_SUCCESS : NFC_EDEVNOTSUPP;
+}
+
+#endif // __linux__
@@ -40,6 +40,7 @@
 #include "conf.h"
 #endif
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
@@ -69,8 +70,12 @@ string_as_boolean(const char *s, bool *value)
   }
 }
 
+/*
+ * Creates a context set up from the configuration files, or from pbtConfig when
+ * not NULL, see nfc_init_with_config()
+ */
 nfc_context *
-nfc_context_new(void)
+nfc_context_new(const uint8_t *pbtConfig, const size_t szConfig)
 {
   nfc_context *res = malloc(sizeof(*res));
 
@@ -87,29 +92,47 @@ nfc_context_new(void)
   res->log_level = 1;
 #endif
 
-  // Clear user defined devices array
-  for (int i = 0; i < MAX_USER_DEFINED_DEVICES; i++) {
-    strcpy(res->user_defined_devices[i].name, "");
-    strcpy(res->user_defined_devices[i].connstring, "");
-    res->user_defined_devices[i].optional = false;
-  }
-  res->user_defined_device_count = 0;
+  // No user defined device yet
+  nfc_registry_init(&res->registry);
+
+  // Discovery cache is disabled by default: every nfc_list_devices() rescans
+  res->discovery_cache_ttl = 0;
+  res->cached_device_count = 0;
+  pthread_mutex_init(&res->lock, NULL);
+  res->cached_at = 0;
+  res->cache_valid = false;
+
+  // PC/SC handles are disconnected by nfc_close() by default
+  res->pcsc_handle_ttl = 0;
+  // Intrusive scans probe up to 8 serial, SPI or I2C ports at once
+  res->scan_concurrency = 8;
+  // PN532 chips are powered down by nfc_idle() at once by default
+  res->power_idle_timeout = 0;
+  // Timeouts only change with NP_TIMEOUT_* properties by default
+  res->adaptive_timeout_margin = 0;
+  res->hotplug = NULL;
+  res->trace = NULL;
 
 #ifdef ENVVARS
   // Load user defined device from environment variable at first
   char *envvar = getenv("LIBNFC_DEFAULT_DEVICE");
   if (envvar) {
-    strcpy(res->user_defined_devices[0].name, "user defined default device");
-    strncpy(res->user_defined_devices[0].connstring, envvar, NFC_BUFSIZE_CONNSTRING);
-    res->user_defined_devices[0].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
-    res->user_defined_device_count++;
+    const int i = nfc_registry_append(&res->registry);
+    if (i >= 0)
+      nfc_registry_set(&res->registry, i, "user defined default device", envvar, false);
   }
 
 #endif // ENVVARS
 
 #ifdef CONFFILES
   // Load options from configuration file (ie. /etc/nfc/libnfc.conf)
-  conf_load(res);
+  if (pbtConfig)
+    conf_apply(res, pbtConfig, szConfig);
+  else
+    conf_load(res);
+#else
+  (void) pbtConfig;
+  (void) szConfig;
 #endif // CONFFILES
 
 #ifdef ENVVARS
@@ -118,10 +141,10 @@ nfc_context_new(void)
   // Load user defined device from environment variable as the only reader
   envvar = getenv("LIBNFC_DEVICE");
   if (envvar) {
-    strcpy(res->user_defined_devices[0].name, "user defined device");
-    strncpy(res->user_defined_devices[0].connstring, envvar, NFC_BUFSIZE_CONNSTRING);
-    res->user_defined_devices[0].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
-    res->user_defined_device_count = 1;
+    nfc_registry_clear(&res->registry);
+    const int i = nfc_registry_append(&res->registry);
+    if (i >= 0)
+      nfc_registry_set(&res->registry, i, "user defined device", envvar, false);
   }
 
   // Load "auto scan" option
@@ -137,6 +160,12 @@ nfc_context_new(void)
   if (envvar) {
     res->log_level = atoi(envvar);
   }
+
+  // Capture of all the devices, scan probes included: appended as a new section
+  envvar = getenv("LIBNFC_TRACE_FILE");
+  if (envvar) {
+    res->trace = nfc_trace_file_open(envvar, "ab");
+  }
 #endif // ENVVARS
 
   // Initialize log before use it...
@@ -151,10 +180,13 @@ nfc_context_new(void)
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "allow_autoscan is set to %s", (res->allow_autoscan) ? "true" : "false");
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "allow_intrusive_scan is set to %s", (res->allow_intrusive_scan) ? "true" : "false");
 
-  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d device(s) defined by user", res->user_defined_device_count);
-  for (uint32_t i = 0; i < res->user_defined_device_count; i++) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "  #%d name: \"%s\", connstring: \"%s\"", i, res->user_defined_devices[i].name, res->user_defined_devices[i].connstring);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d device(s) defined by user", (int) res->registry.szDevices);
+#ifdef LOG
+  for (size_t i = 0; i < res->registry.szDevices; i++) {
+    const struct nfc_user_defined_device *pudd = &res->registry.devices[i];
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "  #%d name: \"%s\", connstring: \"%s\"", (int) i, pudd->name ? pudd->name : "", pudd->connstring ? pudd->connstring : "");
   }
+#endif // LOG
   return res;
 }
 
@@ -162,6 +194,9 @@ void
 nfc_context_free(nfc_context *context)
 {
   log_exit();
+  nfc_registry_free(&context->registry);
+  nfc_trace_file_close(context->trace);
+  pthread_mutex_destroy(&context->lock);
   free(context);
 }
 
@@ -209,6 +244,74 @@ prepare_initiator_data(const nfc_modulation nm, uint8_t **ppbtInitiatorData, siz
   }
 }
 
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct nfc_pool *pools = NULL;
+
+void *
+nfc_pool_alloc(struct nfc_pool *pool)
+{
+  if (!pool->pbtBlocks)
+    return malloc(pool->szBlock);
+
+  void *res = NULL;
+  pthread_mutex_lock(&pools_lock);
+  if (!pool->bRegistered) {
+    // nfc_pool_free() recognizes pool blocks by address
+    pool->next = pools;
+    pools = pool;
+    pool->bRegistered = true;
+  }
+  for (size_t i = 0; i < pool->szBlocks; i++) {
+    if (!pool->pbUsed[i]) {
+      pool->pbUsed[i] = true;
+      res = pool->pbtBlocks + (i * pool->szBlock);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pools_lock);
+
+  if (!res) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Pool %s exhausted (%" PRIuPTR " blocks)", pool->name, pool->szBlocks);
+    errno = ENOMEM;
+  }
+  return res;
+}
+
+void *
+nfc_pool_zalloc(struct nfc_pool *pool)
+{
+  void *res = nfc_pool_alloc(pool);
+  if (res)
+    memset(res, 0, pool->szBlock);
+  return res;
+}
+
+/**
+ * @brief Give a block back to its pool
+ *
+ * Anything that does not belong to a pool came from the heap and is passed to free().
+ */
+void
+nfc_pool_free(void *p)
+{
+  if (!p)
+    return;
+
+  pthread_mutex_lock(&pools_lock);
+  for (struct nfc_pool *pool = pools; pool; pool = pool->next) {
+    const uint8_t *pbt = p;
+    if ((pbt >= pool->pbtBlocks) && (pbt < pool->pbtBlocks + (pool->szBlocks * pool->szBlock))) {
+      pool->pbUsed[(size_t)(pbt - pool->pbtBlocks) / pool->szBlock] = false;
+      pthread_mutex_unlock(&pools_lock);
+      return;
+    }
+  }
+  pthread_mutex_unlock(&pools_lock);
+  free(p);
+}
+
+NFC_POOL(connstring_pool, nfc_connstring, 3 * NFC_POOL_DEVICES);
+
 int
 connstring_decode(const nfc_connstring connstring, const char *driver_name, const char *bus_name, char **pparam1, char **pparam2)
 {
@@ -219,22 +322,22 @@ connstring_decode(const nfc_connstring connstring, const char *driver_name, cons
     bus_name = "";
   }
   int n = strlen(connstring) + 1;
-  char *param0 = malloc(n);
+  char *param0 = nfc_pool_alloc(&connstring_pool);
   if (param0 == NULL) {
     perror("malloc");
     return 0;
   }
-  char *param1 = malloc(n);
+  char *param1 = nfc_pool_alloc(&connstring_pool);
   if (param1 == NULL) {
     perror("malloc");
-    free(param0);
+    nfc_pool_free(param0);
     return 0;
   }
-  char *param2    = malloc(n);
+  char *param2    = nfc_pool_alloc(&connstring_pool);
   if (param2 == NULL) {
     perror("malloc");
-    free(param0);
-    free(param1);
+    nfc_pool_free(param0);
+    nfc_pool_free(param1);
     return 0;
   }
 
@@ -247,27 +350,313 @@ connstring_decode(const nfc_connstring connstring, const char *driver_name, cons
     // Driver name does not match.
     res = 0;
   }
+  // "key=value" options are not positional parameters, see connstring_get_option()
+  if ((res >= 3) && strchr(param2, '='))
+    res = 2;
+  if ((res >= 2) && strchr(param1, '='))
+    res = 1;
   if (pparam1 != NULL) {
     if (res < 2) {
-      free(param1);
+      nfc_pool_free(param1);
       *pparam1 = NULL;
     } else {
       *pparam1 = param1;
     }
   } else {
-    free(param1);
+    nfc_pool_free(param1);
   }
   if (pparam2 != NULL) {
     if (res < 3) {
-      free(param2);
+      nfc_pool_free(param2);
       *pparam2 = NULL;
     } else {
       *pparam2 = param2;
     }
   } else {
-    free(param2);
+    nfc_pool_free(param2);
   }
-  free(param0);
+  nfc_pool_free(param0);
   return res;
 }
 
+/**
+ * @brief Tell whether the answer of a batch frame ends with an unexpected status word
+ *
+ * The batch then stops without error, frames not sent keep \c NFC_EOPABORTED as result.
+ */
+bool
+nfc_batch_frame_sw_mismatch(const struct nfc_batch_frame *frame, const int res)
+{
+  if (!frame->ui16SwMask || (res < 0))
+    return false;
+  if (res < 2)
+    return true;
+  const uint16_t ui16Sw = (frame->pbtRx[res - 2] << 8) | frame->pbtRx[res - 1];
+  return ((ui16Sw ^ frame->ui16Sw) & frame->ui16SwMask) != 0;
+}
+
+/**
+ * @brief UID (PUPI, NFCID2, NFCID3...) of a target
+ * @return Returns its length, 0 for an unknown modulation type
+ */
+size_t
+nfc_target_uid(const nfc_target *pnt, const uint8_t **ppbtUid)
+{
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      *ppbtUid = pnt->nti.nai.abtUid;
+      return pnt->nti.nai.szUidLen;
+    case NMT_ISO14443B:
+      *ppbtUid = pnt->nti.nbi.abtPupi;
+      return sizeof(pnt->nti.nbi.abtPupi);
+    case NMT_ISO14443BI:
+      *ppbtUid = pnt->nti.nii.abtDIV;
+      return sizeof(pnt->nti.nii.abtDIV);
+    case NMT_ISO14443B2SR:
+      *ppbtUid = pnt->nti.nsi.abtUID;
+      return sizeof(pnt->nti.nsi.abtUID);
+    case NMT_ISO14443B2CT:
+      *ppbtUid = pnt->nti.nci.abtUID;
+      return sizeof(pnt->nti.nci.abtUID);
+    case NMT_FELICA:
+      *ppbtUid = pnt->nti.nfi.abtId;
+      return sizeof(pnt->nti.nfi.abtId);
+    case NMT_JEWEL:
+      *ppbtUid = pnt->nti.nji.btId;
+      return sizeof(pnt->nti.nji.btId);
+    case NMT_BARCODE:
+      *ppbtUid = pnt->nti.nti.abtData;
+      return pnt->nti.nti.szDataLen;
+    case NMT_DEP:
+      *ppbtUid = pnt->nti.ndi.abtNFCID3;
+      return sizeof(pnt->nti.ndi.abtNFCID3);
+  }
+  *ppbtUid = NULL;
+  return 0;
+}
+
+static uint32_t
+nfc_fnv1a(const uint8_t *pbt, const size_t sz)
+{
+  uint32_t ui32Hash = 2166136261u;
+  for (size_t i = 0; i < sz; i++) {
+    ui32Hash ^= pbt[i];
+    ui32Hash *= 16777619u;
+  }
+  return ui32Hash;
+}
+
+/**
+ * @brief Build the key of a UID, see nfc_target_key
+ */
+void
+nfc_target_key_from_uid(nfc_target_key *pntk, const nfc_modulation_type nmt, const uint8_t *pbtUid, const size_t szUid)
+{
+  memset(pntk, 0, sizeof(*pntk));
+  pntk->nmt = (uint8_t) nmt;
+  pntk->uid_len = (uint8_t) szUid;
+  if (szUid <= NFC_TARGET_KEY_UID_LEN) {
+    memcpy(pntk->uid, pbtUid, szUid);
+  } else {
+    const uint32_t ui32Hash = nfc_fnv1a(pbtUid, szUid);
+    memcpy(pntk->uid, pbtUid, NFC_TARGET_KEY_UID_LEN - 4);
+    for (size_t i = 0; i < 4; i++)
+      pntk->uid[NFC_TARGET_KEY_UID_LEN - 4 + i] = ui32Hash >> (8 * i);
+  }
+}
+
+/**
+ * @brief FNV-1a hash of a target key
+ */
+uint32_t
+nfc_target_key_hash(const nfc_target_key *pntk)
+{
+  return nfc_fnv1a((const uint8_t *) pntk, sizeof(*pntk));
+}
+
+static size_t
+nfc_target_key_slot(const nfc_target_key *pntk)
+{
+  return nfc_target_key_hash(pntk) % NFC_TARGET_SET_SLOTS;
+}
+
+void
+nfc_target_set_init(struct nfc_target_set *pts, const nfc_target ant[])
+{
+  pts->ant = ant;
+  pts->szTargets = 0;
+  pts->szHashed = 0;
+  memset(pts->antkSlots, 0, sizeof(pts->antkSlots));
+}
+
+/**
+ * @brief Tell whether a target with the same UID was already added
+ */
+bool
+nfc_target_set_contains(const struct nfc_target_set *pts, const nfc_target *pnt)
+{
+  nfc_target_key ntk;
+  nfc_target_get_key(pnt, &ntk);
+  size_t n = nfc_target_key_slot(&ntk);
+  while (pts->antkSlots[n].nmt) {
+    if (memcmp(&pts->antkSlots[n], &ntk, sizeof(ntk)) == 0)
+      return true;
+    n = (n + 1) % NFC_TARGET_SET_SLOTS;
+  }
+  for (size_t i = pts->szHashed; i < pts->szTargets; i++) {
+    nfc_target_key ntkAdded;
+    nfc_target_get_key(&pts->ant[i], &ntkAdded);
+    if (memcmp(&ntkAdded, &ntk, sizeof(ntk)) == 0)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Add the target that was just stored after the previous ones in the array
+ */
+void
+nfc_target_set_add(struct nfc_target_set *pts)
+{
+  if ((pts->szHashed == pts->szTargets) && (pts->szHashed < NFC_TARGET_SET_SLOTS / 2)) {
+    nfc_target_key ntk;
+    nfc_target_get_key(&pts->ant[pts->szTargets], &ntk);
+    size_t n = nfc_target_key_slot(&ntk);
+    while (pts->antkSlots[n].nmt)
+      n = (n + 1) % NFC_TARGET_SET_SLOTS;
+    pts->antkSlots[n] = ntk;
+    pts->szHashed++;
+  }
+  pts->szTargets++;
+}
+
+/**
+ * @brief Look for a "key=value" option after the positional parameters of a connstring
+ * @return a copy of the value to release with nfc_pool_free(), NULL if the option is not set
+ *
+ * E.g. "pn532_spi:/dev/spidev0.0:500000:irq=gpiochip0/25" has option "irq" set to "gpiochip0/25".
+ */
+char *
+connstring_get_option(const nfc_connstring connstring, const char *key)
+{
+  const size_t szKey = strlen(key);
+  const char *pcField = strchr(connstring, ':');
+
+  while (pcField) {
+    pcField++;
+    const char *pcEnd = strchr(pcField, ':');
+    const size_t szField = pcEnd ? (size_t)(pcEnd - pcField) : strlen(pcField);
+    if ((szField > szKey) && (strncmp(pcField, key, szKey) == 0) && (pcField[szKey] == '=')) {
+      char *value = nfc_pool_alloc(&connstring_pool);
+      if (value == NULL) {
+        perror("malloc");
+        return NULL;
+      }
+      memcpy(value, pcField + szKey + 1, szField - szKey - 1);
+      value[szField - szKey - 1] = '\0';
+      return value;
+    }
+    pcField = pcEnd;
+  }
+  return NULL;
+}
+
+struct port_probe {
+  const nfc_context *context;
+  char **ports;
+  size_t szPorts;
+  nfc_port_probe probe;
+  size_t szWanted;
+  pthread_mutex_t lock;
+  size_t szNext;
+  size_t szFound;
+  bool *abFound;
+  nfc_connstring *acConnstrings;
+};
+
+static void *
+port_probe_run(void *arg)
+{
+  struct port_probe *pp = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&pp->lock);
+    if ((pp->szNext == pp->szPorts) || (pp->szFound >= pp->szWanted)) {
+      pthread_mutex_unlock(&pp->lock);
+      return NULL;
+    }
+    const size_t n = pp->szNext++;
+    pthread_mutex_unlock(&pp->lock);
+
+    const bool bFound = pp->probe(pp->context, pp->ports[n], pp->acConnstrings[n]);
+    pthread_mutex_lock(&pp->lock);
+    pp->abFound[n] = bFound;
+    if (bFound)
+      pp->szFound++;
+    pthread_mutex_unlock(&pp->lock);
+  }
+}
+
+/**
+ * @brief Probe ports for a device, several at a time
+ * @return the number of connstrings filled, in \a ports order
+ *
+ * Each port is handed to \a probe, which fills the connstring and returns
+ * true when it finds a device there. Up to \e scan_concurrency ports are
+ * probed at once, so that a scan takes about as long as its slowest port
+ * rather than the sum of them. \a ports, as returned by uart_list_ports()
+ * and alike, is released.
+ */
+size_t
+nfc_probe_ports(const nfc_context *context, char **ports, nfc_port_probe probe, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  pthread_t threads[NFC_PROBE_MAX_THREADS];
+  size_t szThreads = 0;
+  size_t device_found = 0;
+  struct port_probe pp = {
+    .context = context,
+    .ports = ports,
+    .szPorts = 0,
+    .probe = probe,
+    .szWanted = connstrings_len,
+    .szNext = 0,
+    .szFound = 0,
+  };
+
+  while (ports[pp.szPorts])
+    pp.szPorts++;
+  pp.abFound = calloc(pp.szPorts + 1, sizeof(bool));
+  pp.acConnstrings = malloc((pp.szPorts + 1) * sizeof(nfc_connstring));
+  if (!pp.abFound || !pp.acConnstrings) {
+    perror("malloc");
+    goto free_mem;
+  }
+  pthread_mutex_init(&pp.lock, NULL);
+
+  // The calling thread probes too
+  size_t szConcurrency = MIN(MAX(context->scan_concurrency, 1), NFC_PROBE_MAX_THREADS + 1);
+#ifdef STATIC_POOLS
+  // Each probe holds a device of the pool: more of them would only fail to get one
+  szConcurrency = MIN(szConcurrency, NFC_POOL_DEVICES);
+#endif
+  while ((szThreads + 1 < MIN(szConcurrency, pp.szPorts)) &&
+         (pthread_create(&threads[szThreads], NULL, port_probe_run, &pp) == 0))
+    szThreads++;
+  port_probe_run(&pp);
+  for (size_t n = 0; n < szThreads; n++)
+    pthread_join(threads[n], NULL);
+  pthread_mutex_destroy(&pp.lock);
+
+  for (size_t n = 0; (n < pp.szPorts) && (device_found < connstrings_len); n++) {
+    if (pp.abFound[n])
+      memcpy(connstrings[device_found++], pp.acConnstrings[n], sizeof(nfc_connstring));
+  }
+
+free_mem:
+  free(pp.abFound);
+  free(pp.acConnstrings);
+  for (size_t n = 0; ports[n]; n++)
+    free(ports[n]);
+  free(ports);
+  return device_found;
+}
@@ -33,24 +33,60 @@
 #define __NFC_INTERNAL_H__
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <err.h>
+#include <pthread.h>
+#include <time.h>
 #  include <sys/time.h>
 
 #include "nfc/nfc.h"
 
 #include "log.h"
+#include "nfc-probes.h"
 
 /**
  * @macro HAL
  * @brief Execute corresponding driver function if exists.
+ *
+ * The device lock is held during the call, so that a device can be shared
+ * between threads; see nfc_abort_command() for the only exception. Waiting
+ * threads get the device at the end of the call, by priority class.
+ */
+#define HAL( FUNCTION, ... ) do { \
+    int __res; \
+    nfc_device_lock(pnd); \
+    pnd->last_error = 0; \
+    if (NFC_DRIVER(pnd)->FUNCTION) { \
+      __res = NFC_DRIVER(pnd)->FUNCTION( __VA_ARGS__ ); \
+    } else { \
+      pnd->last_error = NFC_EDEVNOTSUPP; \
+      __res = false; \
+    } \
+    nfc_device_unlock(pnd); \
+    return __res; \
+  } while (0)
+
+/**
+ * @macro HAL_RETRY
+ * @brief Same as HAL() but repeats failed calls as the device retry policy allows
  */
-#define HAL( FUNCTION, ... ) pnd->last_error = 0; \
-  if (pnd->driver->FUNCTION) { \
-    return pnd->driver->FUNCTION( __VA_ARGS__ ); \
-  } else { \
-    pnd->last_error = NFC_EDEVNOTSUPP; \
-    return false; \
-  }
+#define HAL_RETRY( FUNCTION, ... ) do { \
+    int __res; \
+    struct nfc_retry_state __state; \
+    nfc_device_lock(pnd); \
+    nfc_retry_start(pnd, &__state); \
+    do { \
+      pnd->last_error = 0; \
+      if (NFC_DRIVER(pnd)->FUNCTION) { \
+        __res = NFC_DRIVER(pnd)->FUNCTION( __VA_ARGS__ ); \
+      } else { \
+        pnd->last_error = NFC_EDEVNOTSUPP; \
+        __res = false; \
+      } \
+    } while (nfc_retry_next(pnd, &__state, __res)); \
+    nfc_device_unlock(pnd); \
+    return __res; \
+  } while (0)
 
 #ifndef MIN
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
@@ -83,6 +119,13 @@
   uint8_t buffer_name[size]; \
   size_t __##buffer_name##_n = 0
 
+/*
+ * Same as BUFFER_INIT() but on memory borrowed elsewhere, e.g. pn53x_scratch_get()
+ */
+#define BUFFER_INIT_AT(buffer_name, ptr) \
+  uint8_t *buffer_name = (ptr); \
+  size_t __##buffer_name##_n = 0
+
 /*
  * Create a wrapper for an existing buffer.
  * BEWARE!  It eats children!
@@ -113,12 +156,52 @@
     } \
   } while (0)
 
+/**
+ * @struct nfc_batch_frame
+ * @brief Frame queued by nfc_batch_append() until nfc_batch_commit()
+ */
+struct nfc_batch_frame {
+  const uint8_t *pbtTx;
+  size_t szTx;
+  uint8_t *pbtRx;
+  size_t szRx;
+  int *pres;
+  /** Status word expected at the end of the answer, bits set in the mask are compared */
+  uint16_t ui16Sw;
+  /** Left to 0 by nfc_batch_append(), the batch stops early on a mismatching answer otherwise */
+  uint16_t ui16SwMask;
+};
+
+#define NFC_BATCH_MAX_FRAMES 16
+
+bool nfc_batch_frame_sw_mismatch(const struct nfc_batch_frame *frame, const int res);
+
+/**
+ * @struct nfc_isodep
+ * @brief State of the host side ISO14443-4 block protocol
+ */
+struct nfc_isodep {
+  /** Has nfc_initiator_isodep_activate() been called for the current target */
+  bool bActive;
+  /** Block number of the next I-block we send */
+  uint8_t btBlockNumber;
+  /** Target frame size, PCB and CRC included */
+  size_t szFsc;
+  /** Frame waiting time, in ms */
+  int iFwt;
+  /** Last NP_TIMEOUT_COM value set, -1 if none */
+  int iChipTimeout;
+};
+
 typedef enum {
   NOT_INTRUSIVE,
   INTRUSIVE,
   NOT_AVAILABLE,
 } scan_type_enum;
 
+// See nfc/nfc-emulation.h
+struct nfc_emulation_raw_rule;
+
 struct nfc_driver {
   const char *name;
   const scan_type_enum scan_type;
@@ -131,6 +214,10 @@ struct nfc_driver {
   int (*initiator_init_secure_element)(struct nfc_device *pnd);
   int (*initiator_select_passive_target)(struct nfc_device *pnd,  const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
   int (*initiator_poll_target)(struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t btPeriod, nfc_target *pnt);
+  int (*initiator_list_passive_targets)(struct nfc_device *pnd, const nfc_modulation nm, nfc_target ant[], const size_t szTargets);
+  int (*initiator_discover_targets)(struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, nfc_target ant[], const size_t szTargets);
+  int (*initiator_inventory_iso14443a)(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+  int (*initiator_reactivate_target)(struct nfc_device *pnd, const nfc_target *pnt);
   int (*initiator_select_dep_target)(struct nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
   int (*initiator_deselect_target)(struct nfc_device *pnd);
   int (*initiator_transceive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
@@ -138,35 +225,108 @@ struct nfc_driver {
   int (*initiator_transceive_bytes_timed)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
   int (*initiator_transceive_bits_timed)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles);
   int (*initiator_target_is_present)(struct nfc_device *pnd, const nfc_target *pnt);
+  int (*initiator_transceive_bytes_batch)(struct nfc_device *pnd, const struct nfc_batch_frame *frames, const size_t szFrames, int timeout);
+  int (*initiator_transceive_bytes_async)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_transceive_callback callback, void *user_data);
 
   int (*target_init)(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout);
   int (*target_send_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
   int (*target_receive_bytes)(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout);
+  int (*target_transceive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
   int (*target_send_bits)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
   int (*target_receive_bits)(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtRxPar);
+  /** Answers the initiator from a rules table until a command is not in it, see nfc_emulate_raw() */
+  int (*target_emulate_raw)(struct nfc_device *pnd, const struct nfc_emulation_raw_rule *rules, const size_t szRules, uint8_t *pbtRx, const size_t szRxLen);
+
+  int (*dep_write)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
+  int (*dep_read)(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout);
 
   int (*device_set_property_bool)(struct nfc_device *pnd, const nfc_property property, const bool bEnable);
   int (*device_set_property_int)(struct nfc_device *pnd, const nfc_property property, const int value);
+  int (*device_set_properties)(struct nfc_device *pnd, const nfc_property_setting *pSettings, const size_t szSettings);
   int (*get_supported_modulation)(struct nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt);
   int (*get_supported_baud_rate)(struct nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
   int (*device_get_information_about)(struct nfc_device *pnd, char **buf);
+  /** Fills the chip fields of pcaps, the lists are built from the ops above */
+  int (*device_get_capabilities)(struct nfc_device *pnd, nfc_device_capabilities *pcaps);
+  /** Fills pnd->name, for drivers leaving it empty at open as it is costly to get */
+  void (*device_get_name)(struct nfc_device *pnd);
 
   int (*abort_command)(struct nfc_device *pnd);
   int (*idle)(struct nfc_device *pnd);
   int (*powerdown)(struct nfc_device *pnd);
+  int (*get_pollable_fd)(struct nfc_device *pnd);
+  int (*process_events)(struct nfc_device *pnd);
 };
 
+/**
+ * @macro NFC_DRIVER
+ * @brief Driver of a device
+ *
+ * When libnfc is built for a single driver (LIBNFC_SINGLE_DRIVER), that driver
+ * is known at compile time so its functions can be called directly and inlined.
+ */
+#if defined (NFC_SINGLE_DRIVER)
+extern const struct nfc_driver NFC_SINGLE_DRIVER;
+#  define NFC_DRIVER(pnd) (&NFC_SINGLE_DRIVER)
+#else
+#  define NFC_DRIVER(pnd) ((pnd)->driver)
+#endif /* NFC_SINGLE_DRIVER */
+
 #  define DEVICE_NAME_LENGTH  256
 #  define DEVICE_PORT_LENGTH  64
 
-#define MAX_USER_DEFINED_DEVICES 4
+#define MAX_CACHED_DEVICES 16
 
+/**
+ * @struct nfc_user_defined_device
+ * @brief Device set by the user, in the configuration or with nfc_context_add_device()
+ */
 struct nfc_user_defined_device {
-  char name[DEVICE_NAME_LENGTH];
-  nfc_connstring connstring;
+  /** Heap strings, NULL until set */
+  char *name;
+  char *connstring;
   bool optional;
+  /** Result of the last probe of an optional device and when it was made (0: never) */
+  bool bPresent;
+  time_t probed_at;
 };
 
+/**
+ * @struct nfc_device_registry
+ * @brief User defined devices, in the order they were defined
+ *
+ * Hash tables of indexes into \a devices give lookups by name and by
+ * connstring; they are rebuilt whenever the registry changes.
+ */
+struct nfc_device_registry {
+  struct nfc_user_defined_device *devices;
+  size_t szDevices;
+  size_t szAlloc;
+  int32_t *aiNameSlots;
+  int32_t *aiConnstringSlots;
+  size_t szSlots;
+  pthread_mutex_t lock;
+};
+
+/*
+ * pcapng capture file: one section, holding an interface per device that
+ * exchanged frames with it
+ */
+struct nfc_trace_file {
+  FILE *f;
+  /** Interfaces described so far */
+  uint32_t uiInterfaces;
+  pthread_mutex_t lock;
+};
+
+void nfc_registry_init(struct nfc_device_registry *pndr);
+void nfc_registry_free(struct nfc_device_registry *pndr);
+void nfc_registry_clear(struct nfc_device_registry *pndr);
+int  nfc_registry_append(struct nfc_device_registry *pndr);
+int  nfc_registry_set(struct nfc_device_registry *pndr, const size_t szIndex, const char *name, const char *connstring, const int iOptional);
+bool nfc_registry_get_name(struct nfc_device_registry *pndr, const char *connstring, char *name, const size_t szName);
+bool nfc_registry_get_connstring(struct nfc_device_registry *pndr, const char *name, nfc_connstring connstring);
+
 /**
  * @struct nfc_context
  * @brief NFC library context
@@ -176,12 +336,37 @@ struct nfc_context {
   bool allow_autoscan;
   bool allow_intrusive_scan;
   uint32_t  log_level;
-  struct nfc_user_defined_device user_defined_devices[MAX_USER_DEFINED_DEVICES];
-  unsigned int user_defined_device_count;
+  struct nfc_device_registry registry;
+  /** Lifetime, in seconds, of the nfc_list_devices() result cache (0: disabled) */
+  unsigned int discovery_cache_ttl;
+  nfc_connstring cached_connstrings[MAX_CACHED_DEVICES];
+  size_t cached_device_count;
+  time_t cached_at;
+  bool cache_valid;
+  /** Lifetime, in seconds, of acr122_pcsc card handles kept by nfc_close() for the next nfc_open() (0: disabled) */
+  unsigned int pcsc_handle_ttl;
+  /** Number of ports intrusive scans probe at once (1: one after the other) */
+  unsigned int scan_concurrency;
+  /** Longest time, in ms, nfc_idle() leaves a busy PN532 awake before powering it down (0: at once) */
+  unsigned int power_idle_timeout;
+  /** Percent above the observed p99 response time adaptive timeouts are set to (0: fixed timeouts) */
+  unsigned int adaptive_timeout_margin;
+  /** Protects the discovery cache */
+  pthread_mutex_t lock;
+  /** Set by nfc_context_set_hotplug_callback() */
+  struct nfc_hotplug *hotplug;
+  /** Opened from LIBNFC_TRACE_FILE, shared by all the devices of the context */
+  struct nfc_trace_file *trace;
 };
 
-nfc_context *nfc_context_new(void);
+nfc_context *nfc_context_new(const uint8_t *pbtConfig, const size_t szConfig);
 void nfc_context_free(nfc_context *context);
+void nfc_hotplug_stop(nfc_context *context);
+
+// Class of the threads which waited for a device longer than its aging time
+#define NFC_PRIORITY_AGED (NFC_PRIORITY_TRANSACTION + 1)
+// Default aging time, in ms
+#define NFC_PRIORITY_AGING_MS 200
 
 /**
  * @struct nfc_device
@@ -208,14 +393,112 @@ struct nfc_device {
   /** Should the chip switch automatically activate ISO14443-4 when
       selecting tags supporting it? */
   bool    bAutoIso14443_4;
+  /** Should the chip raise the bit rate of ISO14443-4 targets after selecting them? */
+  bool    bAutoBitrate;
   /** Supported modulation encoded in a byte */
   uint8_t  btSupportByte;
   /** Last reported error */
   int     last_error;
+  /** I/O counters */
+  nfc_device_stats stats;
+  /** NP_COMMAND_TIMING: command being timed, if bTimingActive, and last one timed */
+  bool    bTiming;
+  bool    bTimingActive;
+  struct timespec tsTimingStart;
+  nfc_command_timing timing;
+  nfc_command_timing last_timing;
+  /** pcapng capture file, if any, owned unless it is the context one */
+  struct nfc_trace_file *trace;
+  bool    bTraceOwned;
+  bool    bTraceStarted;
+  uint32_t uiTraceInterface;
+  /** Frames queued between nfc_batch_begin() and nfc_batch_commit() */
+  struct nfc_batch_frame batch_frames[NFC_BATCH_MAX_FRAMES];
+  /** Number of queued frames */
+  size_t  szBatchFrames;
+  /** Is a batch being collected */
+  bool    bBatch;
+  /** Host side ISO14443-4 */
+  struct nfc_isodep isodep;
+  /** Set by nfc_device_set_retry_policy(), uiRetryGeneration counts the changes */
+  nfc_retry_policy retry_policy;
+  unsigned int uiRetryGeneration;
+  /** Host retries left, in hundredths, and state of the backoff jitter */
+  unsigned int uiRetryCredit;
+  uint32_t ui32RetrySeed;
+  /** Loaded at open, as long as bCaps is set, by nfc_device_load_capabilities().
+   * bCaps is read without the lock: access it with __atomic builtins only */
+  nfc_device_capabilities caps;
+  bool    bCaps;
+  /** nfc_device_get_information_about() report, built on first request */
+  char   *pcInformation;
+  /** Set by nfc_device_set_poll_policy() */
+  nfc_poll_policy poll_policy;
+  /** Set by nfc_abort_command(), cleared when a software poll starts */
+  volatile bool bPollAbort;
+  /** Serializes the calls to the driver, see nfc_device_lock() */
+  pthread_mutex_t lock;
+  pthread_cond_t lock_cond;
+  pthread_t tLockOwner;
+  unsigned int uiLockDepth;
+  /** Times the device was taken, so that a thread releasing it for a while knows whether it was used meanwhile */
+  unsigned int uiLockGeneration;
+  /** Threads waiting for the device, by class, aged ones last */
+  unsigned int auiLockWaiting[NFC_PRIORITY_AGED + 1];
+  /** Set by nfc_device_set_priority_aging() */
+  unsigned int uiAgingMs;
+  /** Ticket lock giving the device to remote clients in turn */
+  pthread_mutex_t turn_lock;
+  pthread_cond_t turn_cond;
+  unsigned int uiTurnNext;
+  unsigned int uiTurnServing;
 };
 
+/**
+ * @struct nfc_retry_state
+ * @brief Progress of one call made through HAL_RETRY()
+ */
+struct nfc_retry_state {
+  unsigned int uiAttempts;
+  unsigned int uiBackoffMs;
+  struct timeval tvStart;
+};
+
+#define NFC_RETRY_CREDIT_MAX 1000
+
+void nfc_retry_start(nfc_device *pnd, struct nfc_retry_state *prs);
+bool nfc_retry_next(nfc_device *pnd, struct nfc_retry_state *prs, const int res);
+
+int nfc_device_validate_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation *nm);
+int nfc_poll_software(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations,
+                      const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt);
+
 nfc_device *nfc_device_new(const nfc_context *context, const nfc_connstring connstring);
 void        nfc_device_free(nfc_device *dev);
+void        nfc_device_lock(nfc_device *dev);
+void        nfc_device_unlock(nfc_device *dev);
+void        nfc_device_turn_take(nfc_device *dev);
+void        nfc_device_turn_release(nfc_device *dev);
+void        nfc_device_resolve_name(nfc_device *dev);
+int         nfc_device_load_capabilities(nfc_device *dev);
+
+struct nfc_trace_file *nfc_trace_file_open(const char *pcFilename, const char *pcMode);
+void nfc_trace_file_close(struct nfc_trace_file *ptf);
+int  nfc_trace_open(nfc_device *pnd, const char *pcFilename);
+void nfc_trace_frame(nfc_device *pnd, const bool bOutbound, const uint8_t *pbtFrame, const size_t szFrame);
+void nfc_trace_close(nfc_device *pnd);
+#define NFC_TRACE_FRAME(pnd, bOutbound, pbtFrame, szFrame) do { \
+    if ((pnd)->trace) \
+      nfc_trace_frame((pnd), (bOutbound), (pbtFrame), (szFrame)); \
+  } while (0)
+
+void nfc_timing_start(nfc_device *pnd, const uint8_t btCommand);
+void nfc_timing_mark(nfc_device *pnd, const nfc_command_phase phase);
+void nfc_timing_done(nfc_device *pnd);
+#define NFC_TIMING_MARK(pnd, phase) do { \
+    if ((pnd)->bTimingActive) \
+      nfc_timing_mark((pnd), (phase)); \
+  } while (0)
 
 void string_as_boolean(const char *s, bool *value);
 
@@ -223,6 +506,77 @@ void iso14443_cascade_uid(const uint8_t abtUID[], const size_t szUID, uint8_t *p
 
 void prepare_initiator_data(const nfc_modulation nm, uint8_t **ppbtInitiatorData, size_t *pszInitiatorData);
 
+size_t nfc_target_uid(const nfc_target *pnt, const uint8_t **ppbtUid);
+void nfc_target_key_from_uid(nfc_target_key *pntk, const nfc_modulation_type nmt, const uint8_t *pbtUid, const size_t szUid);
+uint32_t nfc_target_key_hash(const nfc_target_key *pntk);
+
+/**
+ * @struct nfc_target_set
+ * @brief Targets already found by an inventory, looked up by UID
+ *
+ * Slots hold the keys of the targets of the caller's array, in open
+ * addressing, so that lookups do not touch the targets themselves. Once half
+ * of the slots are used, following targets are only compared one by one.
+ */
+#define NFC_TARGET_SET_SLOTS 64
+struct nfc_target_set {
+  const nfc_target *ant;
+  size_t szTargets;
+  size_t szHashed;
+  nfc_target_key antkSlots[NFC_TARGET_SET_SLOTS];
+};
+
+void nfc_target_set_init(struct nfc_target_set *pts, const nfc_target ant[]);
+bool nfc_target_set_contains(const struct nfc_target_set *pts, const nfc_target *pnt);
+void nfc_target_set_add(struct nfc_target_set *pts);
+
+/**
+ * @struct nfc_pool
+ * @brief Fixed-size blocks allocator
+ *
+ * Built with STATIC_POOLS, blocks are served from a static array of \a szBlocks
+ * entries and running out of them is reported as a failed allocation; otherwise
+ * they come from the heap. Pools are declared with NFC_POOL() next to their users.
+ */
+struct nfc_pool {
+  const char *name;
+  size_t szBlock;
+  size_t szBlocks;
+  uint8_t *pbtBlocks;
+  bool *pbUsed;
+  bool bRegistered;
+  struct nfc_pool *next;
+};
+
+#ifndef NFC_POOL_DEVICES
+#  define NFC_POOL_DEVICES 4
+#endif
+#ifndef NFC_POOL_TARGETS
+#  define NFC_POOL_TARGETS 4
+#endif
+
+#ifdef STATIC_POOLS
+#  define NFC_POOL(pool_name, type, count) \
+  static type pool_name##_blocks[count]; \
+  static bool pool_name##_used[count]; \
+  static struct nfc_pool pool_name = { #pool_name, sizeof(type), (count), (uint8_t *) pool_name##_blocks, pool_name##_used, false, NULL }
+#else
+#  define NFC_POOL(pool_name, type, count) \
+  static struct nfc_pool pool_name = { #pool_name, sizeof(type), 0, NULL, NULL, false, NULL }
+#endif
+
+void *nfc_pool_alloc(struct nfc_pool *pool);
+void *nfc_pool_zalloc(struct nfc_pool *pool);
+void nfc_pool_free(void *p);
+
 int connstring_decode(const nfc_connstring connstring, const char *driver_name, const char *bus_name, char **pparam1, char **pparam2);
+char *connstring_get_option(const nfc_connstring connstring, const char *key);
+
+/** Probe of one port by an intrusive scan, fills \a connstring and returns true if a device answers there */
+typedef bool (*nfc_port_probe)(const nfc_context *context, const char *port, nfc_connstring connstring);
+
+#define NFC_PROBE_MAX_THREADS 31
+
+size_t nfc_probe_ports(const nfc_context *context, char **ports, nfc_port_probe probe, nfc_connstring connstrings[], const size_t connstrings_len);
 
 #endif // __NFC_INTERNAL_H__
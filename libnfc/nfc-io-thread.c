@@ -0,0 +1,455 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-io-thread.c
+ * @brief Run the exchanges of a device on a dedicated, optionally real-time, thread
+ *
+ * The application queues exchanges, the I/O thread runs them one after the
+ * other and queues their results back. Both queues are single producer,
+ * single consumer rings: the thread never takes a lock the application may
+ * hold, and while exchanges keep coming it makes no system call but the ones
+ * of the exchanges themselves.
+ */
+
+#ifdef __linux__
+// pthread_attr_setaffinity_np() and CPU_SET(), before any system header
+#  define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <nfc/nfc.h>
+
+#ifndef WIN32
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Exchanges per queue, must be a power of two
+#define IO_THREAD_QUEUE_SIZE 64
+// Stack of the thread when it is locked in memory
+#define IO_THREAD_STACK_SIZE (256 * 1024)
+
+struct io_request {
+  const uint8_t *pbtTx;
+  size_t szTx;
+  uint8_t *pbtRx;
+  size_t szRx;
+  int timeout;
+  int res;
+  nfc_transceive_callback callback;
+  void *user_data;
+};
+
+// Single producer, single consumer ring: the producer owns tail, the consumer head
+struct io_queue {
+  size_t head;
+  uint8_t pad0[64 - sizeof(size_t)];
+  size_t tail;
+  uint8_t pad1[64 - sizeof(size_t)];
+  struct io_request requests[IO_THREAD_QUEUE_SIZE];
+};
+
+struct nfc_io_thread {
+  struct io_queue submissions;
+  struct io_queue completions;
+  nfc_device *pnd;
+  nfc_io_thread_config config;
+  pthread_t thread;
+  void *pStack;
+  // Wake pipes of the thread and of nfc_io_thread_process()
+  int thread_fds[2];
+  int caller_fds[2];
+  // 1 while the thread, or the caller, sleeps on its pipe, cleared by whoever wakes it
+  int thread_sleeping;
+  int caller_sleeping;
+  int stop;
+};
+
+static bool
+io_queue_push(struct io_queue *q, const struct io_request *pr)
+{
+  const size_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == IO_THREAD_QUEUE_SIZE)
+    return false; // Full
+  q->requests[tail & (IO_THREAD_QUEUE_SIZE - 1)] = *pr;
+  __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool
+io_queue_pop(struct io_queue *q, struct io_request *pr)
+{
+  const size_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  if (head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE))
+    return false; // Empty
+  *pr = q->requests[head & (IO_THREAD_QUEUE_SIZE - 1)];
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool
+io_queue_is_empty(struct io_queue *q)
+{
+  return __atomic_load_n(&q->head, __ATOMIC_SEQ_CST) == __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST);
+}
+
+static void
+io_thread_wake(int *psleeping, const int fd)
+{
+  const uint8_t btWake = 1;
+  int expected = 1;
+  if (!__atomic_compare_exchange_n(psleeping, &expected, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    return;
+  if (write(fd, &btWake, 1) < 0) {
+    // Pipe already full of wake-ups
+  }
+}
+
+// Sleeps on fd until q is not empty any more, for ms milliseconds at most (-1: forever)
+static void
+io_thread_sleep(struct io_queue *q, int *psleeping, const int fd, const int ms, const int *pstop)
+{
+  int expected = 1;
+  // Pairs with io_thread_wake(), called after a push
+  __atomic_store_n(psleeping, 1, __ATOMIC_SEQ_CST);
+  if (io_queue_is_empty(q) && !(pstop && __atomic_load_n(pstop, __ATOMIC_ACQUIRE))) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, ms) > 0) {
+      uint8_t abtBuf[16];
+      while (read(fd, abtBuf, sizeof(abtBuf)) > 0) {
+      }
+    }
+  }
+  __atomic_compare_exchange_n(psleeping, &expected, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static int64_t
+io_thread_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Busy waits for q not to be empty any more, returns false after spin_us microseconds
+static bool
+io_thread_spin(struct io_queue *q, const unsigned int spin_us)
+{
+  if (spin_us == 0)
+    return !io_queue_is_empty(q);
+  const int64_t iSpinEnd = io_thread_now_ns() + (int64_t) spin_us * 1000;
+  while (io_queue_is_empty(q)) {
+    if (io_thread_now_ns() >= iSpinEnd)
+      return false;
+  }
+  return true;
+}
+
+static void *
+io_thread_run(void *arg)
+{
+  nfc_io_thread *pit = arg;
+  struct io_request r;
+
+  while (!__atomic_load_n(&pit->stop, __ATOMIC_ACQUIRE)) {
+    if (!io_queue_pop(&pit->submissions, &r)) {
+      if (!io_thread_spin(&pit->submissions, pit->config.spin_us))
+        io_thread_sleep(&pit->submissions, &pit->thread_sleeping, pit->thread_fds[0], -1, &pit->stop);
+      continue;
+    }
+    r.res = nfc_initiator_transceive_bytes(pit->pnd, r.pbtTx, r.szTx, r.pbtRx, r.szRx, r.timeout);
+    // The caller sized the completion queue with its submissions, it cannot be full
+    io_queue_push(&pit->completions, &r);
+    io_thread_wake(&pit->caller_sleeping, pit->caller_fds[1]);
+  }
+  return NULL;
+}
+
+static bool
+io_thread_pipe(int fds[2])
+{
+  if (pipe(fds) < 0) {
+    fds[0] = fds[1] = -1;
+    return false;
+  }
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  return true;
+}
+
+static void
+io_thread_free(nfc_io_thread *pit)
+{
+  for (size_t i = 0; i < 2; i++) {
+    if (pit->thread_fds[i] >= 0)
+      close(pit->thread_fds[i]);
+    if (pit->caller_fds[i] >= 0)
+      close(pit->caller_fds[i]);
+  }
+  if (pit->pStack) {
+    munlock(pit->pStack, IO_THREAD_STACK_SIZE);
+    free(pit->pStack);
+  }
+  if (pit->config.lock_memory)
+    munlock(pit, sizeof(nfc_io_thread));
+  free(pit);
+}
+
+// Sets the scheduling, affinity and stack asked for, returns false with errno set on failure
+static bool
+io_thread_attr(nfc_io_thread *pit, pthread_attr_t *pattr)
+{
+  int res = 0;
+
+  if (pit->config.lock_memory) {
+    if ((res = posix_memalign(&pit->pStack, sysconf(_SC_PAGESIZE), IO_THREAD_STACK_SIZE)) != 0) {
+      pit->pStack = NULL;
+      errno = res;
+      return false;
+    }
+    // Locking faults every page in, the thread never waits for one
+    if ((mlock(pit, sizeof(nfc_io_thread)) < 0) || (mlock(pit->pStack, IO_THREAD_STACK_SIZE) < 0))
+      return false;
+    if ((res = pthread_attr_setstack(pattr, pit->pStack, IO_THREAD_STACK_SIZE)) != 0)
+      goto error;
+  }
+  if (pit->config.priority > 0) {
+    struct sched_param param = { .sched_priority = pit->config.priority };
+    if (((res = pthread_attr_setinheritsched(pattr, PTHREAD_EXPLICIT_SCHED)) != 0) ||
+        ((res = pthread_attr_setschedpolicy(pattr, SCHED_FIFO)) != 0) ||
+        ((res = pthread_attr_setschedparam(pattr, &param)) != 0))
+      goto error;
+  }
+  if (pit->config.cpu >= 0) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(pit->config.cpu, &set);
+    if ((res = pthread_attr_setaffinity_np(pattr, sizeof(set), &set)) != 0)
+      goto error;
+#else
+    res = ENOTSUP;
+    goto error;
+#endif
+  }
+  return true;
+error:
+  errno = res;
+  return false;
+}
+
+/** @ingroup dev
+ * @brief Start a thread running the exchanges of a device
+ * @return Returns the I/O thread to give to nfc_io_thread_submit(), or \e NULL on error
+ *
+ * @param pnd \a nfc_device struct pointer that represents currently used device, with a target selected
+ * @param pconfig scheduling of the thread, or \e NULL for the default scheduling
+ *
+ * Exchanges queued with nfc_io_thread_submit() run on this thread, their
+ * callbacks are called by nfc_io_thread_process(). With a \a priority, the
+ * thread runs under \c SCHED_FIFO and is not preempted by ordinary threads,
+ * which usually needs \c CAP_SYS_NICE or an \c RLIMIT_RTPRIO. With
+ * \a lock_memory, its queues and stack are locked in RAM: buffers given to
+ * nfc_io_thread_submit() should be locked by the application as well.
+ * Starting fails when the system refuses any of these settings, \e errno
+ * telling why (e.g. \c EPERM).
+ *
+ * @note The device should not be used by another thread until nfc_io_thread_stop().
+ */
+nfc_io_thread *
+nfc_io_thread_start(nfc_device *pnd, const nfc_io_thread_config *pconfig)
+{
+  nfc_io_thread *pit;
+  pthread_attr_t attr;
+
+  if ((pit = calloc(1, sizeof(nfc_io_thread))) == NULL)
+    return NULL;
+  pit->pnd = pnd;
+  pit->config.cpu = -1;
+  if (pconfig)
+    pit->config = *pconfig;
+  pit->thread_fds[0] = pit->thread_fds[1] = pit->caller_fds[0] = pit->caller_fds[1] = -1;
+  if (!io_thread_pipe(pit->thread_fds) || !io_thread_pipe(pit->caller_fds)) {
+    io_thread_free(pit);
+    return NULL;
+  }
+
+  pthread_attr_init(&attr);
+  int res = io_thread_attr(pit, &attr) ? 0 : errno;
+  if (res == 0)
+    res = pthread_create(&pit->thread, &attr, io_thread_run, pit);
+  pthread_attr_destroy(&attr);
+  if (res != 0) {
+    io_thread_free(pit);
+    errno = res;
+    return NULL;
+  }
+  return pit;
+}
+
+/** @ingroup dev
+ * @brief Queue an exchange with the selected target on the I/O thread
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pit I/O thread returned by nfc_io_thread_start()
+ * @param pbtTx frame to transmit, must stay valid until \a callback is called
+ * @param szTx length of \a pbtTx
+ * @param[out] pbtRx response from the target, must stay valid until \a callback is called
+ * @param szRx size of \a pbtRx
+ * @param timeout in milliseconds, as for nfc_initiator_transceive_bytes()
+ * @param callback function called by nfc_io_thread_process() with the received bytes count or libnfc's error code
+ * @param user_data pointer passed as is to \a callback
+ *
+ * The same as nfc_initiator_transceive_bytes_async(), but exchanges queue up:
+ * up to 64 can be waiting for the thread or for nfc_io_thread_process(),
+ * further ones fail with NFC_EOVFLOW. Exchanges run in the order they were
+ * queued. To be called from one thread at a time, callbacks included.
+ */
+int
+nfc_io_thread_submit(nfc_io_thread *pit, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout,
+                     nfc_transceive_callback callback, void *user_data)
+{
+  const struct io_request r = { pbtTx, szTx, pbtRx, szRx, timeout, 0, callback, user_data };
+
+  // Completions count too, so that the thread always has room to queue one
+  if (__atomic_load_n(&pit->submissions.tail, __ATOMIC_RELAXED) - __atomic_load_n(&pit->completions.head, __ATOMIC_ACQUIRE) >= IO_THREAD_QUEUE_SIZE)
+    return NFC_EOVFLOW;
+  io_queue_push(&pit->submissions, &r);
+  io_thread_wake(&pit->thread_sleeping, pit->thread_fds[1]);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup dev
+ * @brief Call the callbacks of the exchanges done by the I/O thread
+ * @return Returns the number of callbacks called, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pit I/O thread returned by nfc_io_thread_start()
+ * @param timeout in milliseconds to wait for an exchange to complete when none did yet, 0 not to wait, -1 to wait forever
+ *
+ * Callbacks run on the calling thread, and may queue further exchanges.
+ */
+int
+nfc_io_thread_process(nfc_io_thread *pit, int timeout)
+{
+  struct io_request r;
+  int count = 0;
+
+  if (timeout && !io_thread_spin(&pit->completions, pit->config.spin_us))
+    io_thread_sleep(&pit->completions, &pit->caller_sleeping, pit->caller_fds[0], timeout, NULL);
+  while (io_queue_pop(&pit->completions, &r)) {
+    if (r.callback)
+      r.callback(pit->pnd, r.res, r.user_data);
+    count++;
+  }
+  return count;
+}
+
+/** @ingroup dev
+ * @brief Stop the I/O thread and free it
+ * @return Returns the number of queued exchanges that were never run, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pit I/O thread returned by nfc_io_thread_start()
+ *
+ * The exchange being run is waited for. Callbacks not called yet by
+ * nfc_io_thread_process() are dropped. Must not be called from a callback.
+ */
+int
+nfc_io_thread_stop(nfc_io_thread *pit)
+{
+  struct io_request r;
+  int dropped = 0;
+
+  if (pit == NULL)
+    return NFC_EINVARG;
+  __atomic_store_n(&pit->stop, 1, __ATOMIC_RELEASE);
+  // Sleeping or about to, the thread finds the byte and sees stop
+  const uint8_t btWake = 1;
+  if (write(pit->thread_fds[1], &btWake, 1) < 0) {
+    // Pipe already full of wake-ups
+  }
+  pthread_join(pit->thread, NULL);
+  while (io_queue_pop(&pit->submissions, &r))
+    dropped++;
+  io_thread_free(pit);
+  return dropped;
+}
+
+#else // WIN32
+
+// No pipe(), poll() nor mlock() there: the I/O thread is not available
+
+nfc_io_thread *
+nfc_io_thread_start(nfc_device *pnd, const nfc_io_thread_config *pconfig)
+{
+  (void) pnd;
+  (void) pconfig;
+  errno = ENOTSUP;
+  return NULL;
+}
+
+int
+nfc_io_thread_submit(nfc_io_thread *pit, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout,
+                     nfc_transceive_callback callback, void *user_data)
+{
+  (void) pit;
+  (void) pbtTx;
+  (void) szTx;
+  (void) pbtRx;
+  (void) szRx;
+  (void) timeout;
+  (void) callback;
+  (void) user_data;
+  return NFC_EDEVNOTSUPP;
+}
+
+int
+nfc_io_thread_process(nfc_io_thread *pit, int timeout)
+{
+  (void) pit;
+  (void) timeout;
+  return NFC_EDEVNOTSUPP;
+}
+
+int
+nfc_io_thread_stop(nfc_io_thread *pit)
+{
+  (void) pit;
+  return NFC_EDEVNOTSUPP;
+}
+
+#endif // WIN32
@@ -0,0 +1,375 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-isodep.c
+ * @brief ISO14443-4 block transmission protocol run by the host
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+#define LOG_CATEGORY "libnfc.isodep"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+// Largest frame, PCB and CRC included, PN53x chips exchange in raw mode
+#define ISODEP_MAX_FRAME 256
+// FSDI announced in RATS, matching ISODEP_MAX_FRAME
+#define ISODEP_FSDI 8
+// R(NAK) sent for a block before giving up
+#define ISODEP_MAX_RETRIES 2
+// Margin given to the host between the chip timeout and its own
+#define ISODEP_HOST_MARGIN 100
+
+#define PCB_I_BLOCK     0x02
+#define PCB_R_ACK       0xa2
+#define PCB_R_NAK       0xb2
+#define PCB_S_DESELECT  0xc2
+#define PCB_S_WTX       0xf2
+#define PCB_CHAINING    0x10
+#define PCB_BLOCK_NUMBER 0x01
+
+static const uint16_t isodep_fsc[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256, 512, 1024, 2048, 4096 };
+
+// FWT = 256 * 16 / fc * 2^FWI, that is about 302 us * 2^FWI
+static int
+isodep_fwt_to_ms(const uint8_t ui8Fwi)
+{
+  return (int)(((302L << ui8Fwi) + 999) / 1000);
+}
+
+static long
+isodep_elapsed_ms(const struct timeval *ptvStart)
+{
+  struct timeval tvNow;
+  gettimeofday(&tvNow, NULL);
+  return (tvNow.tv_sec - ptvStart->tv_sec) * 1000L + (tvNow.tv_usec - ptvStart->tv_usec) / 1000L;
+}
+
+// Raw frames with CRC, the block protocol being ours
+static int
+isodep_set_raw_mode(nfc_device *pnd)
+{
+  const nfc_property_setting settings[] = {
+    { NP_EASY_FRAMING, false },
+    { NP_HANDLE_CRC, true },
+    { NP_HANDLE_PARITY, true },
+  };
+  return nfc_device_set_properties(pnd, settings, sizeof(settings) / sizeof(settings[0]));
+}
+
+/*
+ * One block exchange, the chip waiting ui8Wtxm times FWT. Transmission
+ * errors and timeouts are reported as NFC_ERFTRANS, for the caller to send
+ * R(NAK).
+ */
+static int
+isodep_exchange(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const uint8_t ui8Wtxm,
+                const struct timeval *ptvStart, const int timeout)
+{
+  const int iWait = pnd->isodep.iFwt * ui8Wtxm;
+  int res;
+
+  if ((timeout > 0) && (isodep_elapsed_ms(ptvStart) >= timeout))
+    return NFC_ETIMEOUT;
+  if (iWait != pnd->isodep.iChipTimeout) {
+    if ((res = nfc_device_set_property_int(pnd, NP_TIMEOUT_COM, iWait)) < 0)
+      return res;
+    pnd->isodep.iChipTimeout = iWait;
+  }
+  res = nfc_initiator_transceive_bytes(pnd, pbtTx, szTx, pbtRx, ISODEP_MAX_FRAME, iWait + ISODEP_HOST_MARGIN);
+  if (res == NFC_ETIMEOUT)
+    res = NFC_ERFTRANS;
+  if (res == 0)
+    res = NFC_ERFTRANS;
+  return res;
+}
+
+/*
+ * Sends a block (or R(NAK) again when it got lost) until the answer is not
+ * an S(WTX) request. Returns the answer length.
+ */
+static int
+isodep_transceive_block(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                        const struct timeval *ptvStart, const int timeout)
+{
+  uint8_t abtAnswer[2];
+  const uint8_t *pbtFrame = pbtTx;
+  size_t szFrame = szTx;
+  uint8_t ui8Wtxm = 1;
+  int iRetries = 0;
+  int res;
+
+  for (;;) {
+    res = isodep_exchange(pnd, pbtFrame, szFrame, pbtRx, ui8Wtxm, ptvStart, timeout);
+    ui8Wtxm = 1;
+    if (res == NFC_ERFTRANS) {
+      if (iRetries++ == ISODEP_MAX_RETRIES)
+        return res;
+      // The block is sent again only when R(NAK) gets R(ACK) back, see below
+      abtAnswer[0] = PCB_R_NAK | pnd->isodep.btBlockNumber;
+      pbtFrame = abtAnswer;
+      szFrame = 1;
+      continue;
+    }
+    if (res < 0)
+      return res;
+    if ((pbtRx[0] & 0xf7) == PCB_S_WTX) {
+      if (res < 2)
+        return NFC_ERFTRANS;
+      // Only the next answer is given more time, not the whole exchange
+      ui8Wtxm = pbtRx[1] & 0x3f;
+      if ((ui8Wtxm == 0) || (ui8Wtxm > 59))
+        return NFC_ERFTRANS;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "WTX x%u", ui8Wtxm);
+      abtAnswer[0] = PCB_S_WTX;
+      abtAnswer[1] = ui8Wtxm;
+      pbtFrame = abtAnswer;
+      szFrame = 2;
+      continue;
+    }
+    if ((pbtFrame != pbtTx) && (pbtFrame[0] == (PCB_R_NAK | pnd->isodep.btBlockNumber)) &&
+        (pbtRx[0] == (PCB_R_ACK | (pnd->isodep.btBlockNumber ^ PCB_BLOCK_NUMBER)))) {
+      // Our block got lost: the target acknowledges the previous one
+      pbtFrame = pbtTx;
+      szFrame = szTx;
+      continue;
+    }
+    return res;
+  }
+}
+
+/** @ingroup initiator
+ * @brief Start the host side ISO14443-4 block protocol with the selected target
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt \a nfc_target struct pointer of the target just selected,
+ * updated with the ATS when RATS is sent
+ *
+ * ISO14443A targets selected with NP_AUTO_ISO14443_4 disabled are sent RATS
+ * with the largest FSD raw PN53x frames allow; targets already activated by
+ * the chip (ATS, or ATTRIB for ISO14443B) are taken over from their ATS or
+ * ATQB. Frame sizes and waiting time come from there.
+ *
+ * @note NP_EASY_FRAMING is disabled and NP_TIMEOUT_COM follows the target
+ * waiting time until another target is selected.
+ */
+int
+nfc_initiator_isodep_activate(nfc_device *pnd, nfc_target *pnt)
+{
+  uint8_t abtRx[ISODEP_MAX_FRAME];
+  uint8_t ui8Fsci = 2;
+  uint8_t ui8Fwi = 4;
+  uint8_t ui8Sfgi = 0;
+  const uint8_t *pbtAts = NULL;
+  size_t szAts = 0;
+  int res;
+
+  pnd->last_error = 0;
+  pnd->isodep.bActive = false;
+  if ((res = isodep_set_raw_mode(pnd)) < 0)
+    return res;
+
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      if (!(pnt->nti.nai.btSak & 0x20)) {
+        pnd->last_error = NFC_EDEVNOTSUPP;
+        return pnd->last_error;
+      }
+      if (pnt->nti.nai.szAtsLen == 0) {
+        const uint8_t abtRats[] = { 0xe0, (ISODEP_FSDI << 4) | 0x00 }; // CID 0
+        if ((res = nfc_initiator_transceive_bytes(pnd, abtRats, sizeof(abtRats), abtRx, sizeof(abtRx), -1)) < 0)
+          return res;
+        if ((res < 1) || (abtRx[0] != res) || ((size_t) res - 1 > sizeof(pnt->nti.nai.abtAts))) {
+          pnd->last_error = NFC_ERFTRANS;
+          return pnd->last_error;
+        }
+        pnt->nti.nai.szAtsLen = res - 1;
+        memcpy(pnt->nti.nai.abtAts, abtRx + 1, pnt->nti.nai.szAtsLen);
+      }
+      pbtAts = pnt->nti.nai.abtAts;
+      szAts = pnt->nti.nai.szAtsLen;
+      break;
+    case NMT_ISO14443B:
+      // Max_Frame_Size, then FWI
+      ui8Fsci = pnt->nti.nbi.abtProtocolInfo[1] >> 4;
+      ui8Fwi = pnt->nti.nbi.abtProtocolInfo[2] >> 4;
+      break;
+    default:
+      pnd->last_error = NFC_EDEVNOTSUPP;
+      return pnd->last_error;
+  }
+
+  if (szAts > 0) {
+    // T0 then, when present, TA(1), TB(1) and TC(1)
+    size_t i = 1;
+    ui8Fsci = pbtAts[0] & 0x0f;
+    if (pbtAts[0] & 0x10)
+      i++;
+    if ((pbtAts[0] & 0x20) && (i < szAts)) {
+      ui8Fwi = pbtAts[i] >> 4;
+      ui8Sfgi = pbtAts[i] & 0x0f;
+    }
+  }
+  if (ui8Fsci >= sizeof(isodep_fsc) / sizeof(isodep_fsc[0]))
+    ui8Fsci = 8;
+  if (ui8Fwi == 15)
+    ui8Fwi = 4;
+  if ((ui8Sfgi > 0) && (ui8Sfgi < 15))
+    usleep(302L << ui8Sfgi);
+
+  pnd->isodep.szFsc = (isodep_fsc[ui8Fsci] > ISODEP_MAX_FRAME) ? ISODEP_MAX_FRAME : isodep_fsc[ui8Fsci];
+  pnd->isodep.iFwt = isodep_fwt_to_ms(ui8Fwi);
+  pnd->isodep.iChipTimeout = -1;
+  pnd->isodep.btBlockNumber = 0;
+  pnd->isodep.bActive = true;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "FSC %" PRIuPTR ", FWT %d ms", pnd->isodep.szFsc, pnd->isodep.iFwt);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Exchange an APDU through the host side ISO14443-4 block protocol
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx APDU to send, of any length
+ * @param szTx size of \a pbtTx
+ * @param[out] pbtRx response APDU
+ * @param szRx size of \a pbtRx
+ * @param timeout in milliseconds, for the whole exchange (0 or -1: no limit but the target waiting time of each block)
+ *
+ * The APDU is chained over as many I-blocks as the target frame size requires
+ * and so is the response. Lost blocks are recovered with R(NAK) and each
+ * S(WTX) request extends the waiting time of the next block only.
+ *
+ * @note nfc_initiator_isodep_activate() must have been called first.
+ */
+int
+nfc_initiator_isodep_transceive(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx,
+                                int timeout)
+{
+  uint8_t abtBlock[ISODEP_MAX_FRAME];
+  uint8_t abtAnswer[ISODEP_MAX_FRAME];
+  struct timeval tvStart;
+  size_t szSent = 0;
+  size_t szReceived = 0;
+  int res;
+
+  pnd->last_error = 0;
+  if (!pnd->isodep.bActive) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if ((res = isodep_set_raw_mode(pnd)) < 0)
+    return res;
+  gettimeofday(&tvStart, NULL);
+
+  // PCB and CRC take 3 bytes of each frame
+  const size_t szInf = pnd->isodep.szFsc - 3;
+  do {
+    const size_t szChunk = ((szTx - szSent) > szInf) ? szInf : (szTx - szSent);
+    const bool bChaining = (szSent + szChunk < szTx);
+
+    abtBlock[0] = PCB_I_BLOCK | (bChaining ? PCB_CHAINING : 0) | pnd->isodep.btBlockNumber;
+    memcpy(abtBlock + 1, pbtTx + szSent, szChunk);
+    if ((res = isodep_transceive_block(pnd, abtBlock, szChunk + 1, abtAnswer, &tvStart, timeout)) < 0)
+      goto error;
+    if (bChaining) {
+      if (abtAnswer[0] != (PCB_R_ACK | pnd->isodep.btBlockNumber)) {
+        res = NFC_ERFTRANS;
+        goto error;
+      }
+      pnd->isodep.btBlockNumber ^= PCB_BLOCK_NUMBER;
+    }
+    szSent += szChunk;
+  } while (szSent < szTx);
+
+  // abtAnswer holds the answer to the last I-block, the response may be chained too
+  for (;;) {
+    if ((abtAnswer[0] & 0xe2) != PCB_I_BLOCK || ((abtAnswer[0] & PCB_BLOCK_NUMBER) != pnd->isodep.btBlockNumber)) {
+      res = NFC_ERFTRANS;
+      goto error;
+    }
+    pnd->isodep.btBlockNumber ^= PCB_BLOCK_NUMBER;
+    if (szReceived + res - 1 > szRx) {
+      res = NFC_EOVFLOW;
+      goto error;
+    }
+    memcpy(pbtRx + szReceived, abtAnswer + 1, res - 1);
+    szReceived += res - 1;
+    if (!(abtAnswer[0] & PCB_CHAINING))
+      break;
+    abtBlock[0] = PCB_R_ACK | pnd->isodep.btBlockNumber;
+    if ((res = isodep_transceive_block(pnd, abtBlock, 1, abtAnswer, &tvStart, timeout)) < 0)
+      goto error;
+  }
+  return (int) szReceived;
+
+error:
+  pnd->last_error = res;
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief End the host side ISO14443-4 block protocol with S(DESELECT)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ */
+int
+nfc_initiator_isodep_deselect(nfc_device *pnd)
+{
+  const uint8_t abtDeselect[] = { PCB_S_DESELECT };
+  uint8_t abtAnswer[ISODEP_MAX_FRAME];
+  int res;
+
+  pnd->last_error = 0;
+  if (!pnd->isodep.bActive) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  pnd->isodep.bActive = false;
+  if ((res = isodep_set_raw_mode(pnd)) < 0)
+    return res;
+  if ((res = nfc_initiator_transceive_bytes(pnd, abtDeselect, sizeof(abtDeselect), abtAnswer, sizeof(abtAnswer), -1)) < 0)
+    return res;
+  if ((res < 1) || (abtAnswer[0] != PCB_S_DESELECT)) {
+    pnd->last_error = NFC_ERFTRANS;
+    return pnd->last_error;
+  }
+  return NFC_SUCCESS;
+}
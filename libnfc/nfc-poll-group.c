@@ -0,0 +1,357 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-poll-group.c
+ * @brief Poll several NFC devices at the same time
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <nfc/nfc.h>
+
+struct poll_group;
+
+// Field turns of the devices of one interference group
+struct poll_group_slot {
+  int iGroup;
+  unsigned int uiNext;
+  unsigned int uiServing;
+};
+
+struct poll_group_worker {
+  struct poll_group *group;
+  nfc_device *pnd;
+  struct poll_group_slot *slot;
+  pthread_t thread;
+  nfc_target nt;
+  int res;
+  bool started;
+  bool running;
+};
+
+struct poll_group {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  // Serializes the callbacks, which run without lock held
+  pthread_mutex_t callback_lock;
+  const nfc_modulation *pnmModulations;
+  size_t szModulations;
+  uint8_t uiPollNr;
+  uint8_t uiPeriod;
+  nfc_poll_group_callback callback;
+  void *user_data;
+  struct poll_group_worker *workers;
+  size_t szWorkers;
+  int found;
+  bool stop;
+};
+
+// Must be called with group->lock held
+static void
+poll_group_stop(struct poll_group *group)
+{
+  group->stop = true;
+  for (size_t i = 0; i < group->szWorkers; i++) {
+    if (group->workers[i].running)
+      nfc_abort_command(group->workers[i].pnd);
+  }
+  pthread_cond_broadcast(&group->cond);
+}
+
+/*
+ * Hands the target found by worker to the callback, one device at a time.
+ * Meanwhile the other devices keep polling and taking their turns.
+ * Returns true when polling ends because of this target.
+ */
+static bool
+poll_group_report(struct poll_group_worker *worker)
+{
+  struct poll_group *group = worker->group;
+  bool bEnd = false;
+
+  pthread_mutex_lock(&group->callback_lock);
+  pthread_mutex_lock(&group->lock);
+  // An earlier callback may have ended polling while this one waited
+  const bool stop = group->stop;
+  if (!stop)
+    group->found++;
+  pthread_mutex_unlock(&group->lock);
+  if (!stop && ((group->callback == NULL) || (group->callback(worker->pnd, &worker->nt, group->user_data) != 0))) {
+    pthread_mutex_lock(&group->lock);
+    poll_group_stop(group);
+    pthread_mutex_unlock(&group->lock);
+    bEnd = true;
+  }
+  pthread_mutex_unlock(&group->callback_lock);
+  return bEnd;
+}
+
+static void *
+poll_group_worker_run(void *arg)
+{
+  struct poll_group_worker *worker = arg;
+  struct poll_group *group = worker->group;
+  int res;
+
+  pthread_mutex_lock(&group->lock);
+  bool stop = group->stop;
+  worker->running = !stop;
+  pthread_mutex_unlock(&group->lock);
+  if (stop) {
+    worker->res = NFC_EOPABORTED;
+    return NULL;
+  }
+
+  res = nfc_initiator_poll_target(worker->pnd, group->pnmModulations, group->szModulations,
+                                  group->uiPollNr, group->uiPeriod, &worker->nt);
+
+  pthread_mutex_lock(&group->lock);
+  worker->running = false;
+  worker->res = res;
+  pthread_mutex_unlock(&group->lock);
+  if (res > 0)
+    poll_group_report(worker);
+  return NULL;
+}
+
+/*
+ * Polls in turns with the other devices of the interference group: the field
+ * is only on from the start of a turn, a single poll of uiPeriod, to the end
+ * of the callback of the target found in it, if any.
+ */
+static void *
+poll_group_worker_run_slotted(void *arg)
+{
+  struct poll_group_worker *worker = arg;
+  struct poll_group *group = worker->group;
+  struct poll_group_slot *slot = worker->slot;
+  int res;
+
+  res = nfc_device_set_property_bool(worker->pnd, NP_ACTIVATE_FIELD, false);
+  for (size_t n = 0; (res >= 0) && ((group->uiPollNr == 0xff) || (n < group->uiPollNr)); n++) {
+    pthread_mutex_lock(&group->lock);
+    const unsigned int uiTurn = slot->uiNext++;
+    while (!group->stop && (slot->uiServing != uiTurn))
+      pthread_cond_wait(&group->cond, &group->lock);
+    const bool stop = group->stop;
+    worker->running = !stop;
+    pthread_mutex_unlock(&group->lock);
+    if (stop) {
+      res = NFC_EOPABORTED;
+      break;
+    }
+
+    if ((res = nfc_device_set_property_bool(worker->pnd, NP_ACTIVATE_FIELD, true)) >= 0)
+      res = nfc_initiator_poll_target(worker->pnd, group->pnmModulations, group->szModulations,
+                                      1, group->uiPeriod, &worker->nt);
+
+    pthread_mutex_lock(&group->lock);
+    worker->running = false;
+    pthread_mutex_unlock(&group->lock);
+    // The field stays on for the target which ends polling
+    const bool bFieldOn = (res > 0) && poll_group_report(worker);
+    if (!bFieldOn) {
+      const int r = nfc_device_set_property_bool(worker->pnd, NP_ACTIVATE_FIELD, false);
+      // A target found stays reported unless the field could not be switched off
+      if (((res >= 0) && (r < 0)) || (res == NFC_ETIMEOUT) || (res == NFC_ERFTRANS))
+        res = r;
+    }
+
+    pthread_mutex_lock(&group->lock);
+    slot->uiServing++;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    // A device reports one target, as with nfc_poll_group()
+    if (res > 0)
+      break;
+    // Noise and collisions are no reason to stop polling
+    if ((res == NFC_ETIMEOUT) || (res == NFC_ERFTRANS))
+      res = 0;
+  }
+  worker->res = res;
+  return NULL;
+}
+
+static int
+poll_group_run(nfc_device *pnds[], const int aiGroups[], const size_t szDevices, const bool bSlotted,
+               const nfc_modulation *pnmModulations, const size_t szModulations,
+               const uint8_t uiPollNr, const uint8_t uiPeriod,
+               nfc_poll_group_callback callback, void *user_data)
+{
+  struct poll_group group;
+  int res = 0;
+
+  if ((pnds == NULL) || (szDevices == 0))
+    return NFC_EINVARG;
+
+  group.workers = calloc(szDevices, sizeof(struct poll_group_worker));
+  if (group.workers == NULL)
+    return NFC_ESOFT;
+  struct poll_group_slot *slots = NULL;
+  if (bSlotted) {
+    if ((slots = calloc(szDevices, sizeof(struct poll_group_slot))) == NULL) {
+      free(group.workers);
+      return NFC_ESOFT;
+    }
+  }
+
+  pthread_mutex_init(&group.lock, NULL);
+  pthread_cond_init(&group.cond, NULL);
+  pthread_mutex_init(&group.callback_lock, NULL);
+  group.pnmModulations = pnmModulations;
+  group.szModulations = szModulations;
+  group.uiPollNr = uiPollNr;
+  group.uiPeriod = uiPeriod;
+  group.callback = callback;
+  group.user_data = user_data;
+  group.szWorkers = szDevices;
+  group.found = 0;
+  group.stop = false;
+
+  size_t szSlots = 0;
+  for (size_t i = 0; i < szDevices; i++) {
+    struct poll_group_worker *worker = &group.workers[i];
+    worker->group = &group;
+    worker->pnd = pnds[i];
+    if (bSlotted) {
+      const int iGroup = aiGroups ? aiGroups[i] : 0;
+      size_t s = 0;
+      while ((s < szSlots) && (slots[s].iGroup != iGroup))
+        s++;
+      if (s == szSlots)
+        slots[szSlots++].iGroup = iGroup;
+      worker->slot = &slots[s];
+    }
+  }
+
+  for (size_t i = 0; i < szDevices; i++) {
+    struct poll_group_worker *worker = &group.workers[i];
+    if (pthread_create(&worker->thread, NULL, bSlotted ? poll_group_worker_run_slotted : poll_group_worker_run, worker) == 0) {
+      worker->started = true;
+    } else {
+      worker->res = NFC_ESOFT;
+    }
+  }
+
+  for (size_t i = 0; i < szDevices; i++) {
+    if (group.workers[i].started)
+      pthread_join(group.workers[i].thread, NULL);
+  }
+
+  if (group.found > 0) {
+    res = group.found;
+  } else {
+    // Nothing found: report the first real error, if any
+    for (size_t i = 0; i < szDevices; i++) {
+      if ((group.workers[i].res < 0) && (group.workers[i].res != NFC_EOPABORTED)) {
+        res = group.workers[i].res;
+        break;
+      }
+    }
+  }
+
+  pthread_mutex_destroy(&group.callback_lock);
+  pthread_cond_destroy(&group.cond);
+  pthread_mutex_destroy(&group.lock);
+  free(slots);
+  free(group.workers);
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Poll for NFC targets on several devices at the same time
+ * @return Returns the number of devices that reported a target on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnds array of \a nfc_device struct pointers, each already opened and initialized as initiator
+ * @param szDevices number of devices in \a pnds
+ * @param pnmModulations desired modulations
+ * @param szModulations size of \a pnmModulations
+ * @param uiPollNr specifies the number of polling (0x01 – 0xFE: 1 up to 254 polling, 0xFF: Endless polling)
+ * @param uiPeriod indicates the polling period in units of 150 ms (0x01 – 0x0F: 150ms – 2.25s)
+ * @param callback function called for each target found, can be \e NULL
+ * @param user_data opaque pointer handed back to \a callback
+ *
+ * Each device runs nfc_initiator_poll_target() in its own thread, so polling
+ * N devices takes as long as polling the slowest one instead of the sum.
+ * Calls to \a callback are serialized. When \a callback returns a non-zero
+ * value (or is \e NULL, at the first target found), polling is aborted with
+ * nfc_abort_command() on the devices still polling and no further target is
+ * reported.
+ *
+ * @note A device must not be used by another thread while the group polls.
+ */
+int
+nfc_poll_group(nfc_device *pnds[], const size_t szDevices,
+               const nfc_modulation *pnmModulations, const size_t szModulations,
+               const uint8_t uiPollNr, const uint8_t uiPeriod,
+               nfc_poll_group_callback callback, void *user_data)
+{
+  return poll_group_run(pnds, NULL, szDevices, false, pnmModulations, szModulations,
+                        uiPollNr, uiPeriod, callback, user_data);
+}
+
+/** @ingroup initiator
+ * @brief Poll for NFC targets on devices whose fields interfere, in turns
+ * @return Returns the number of devices that reported a target on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnds array of \a nfc_device struct pointers, each already opened and initialized as initiator
+ * @param aiGroups interference group of each device of \a pnds, \e NULL to put them all in the same group
+ * @param szDevices number of devices in \a pnds
+ * @param pnmModulations desired modulations
+ * @param szModulations size of \a pnmModulations
+ * @param uiPollNr specifies the number of turns of each device (0x01 – 0xFE: 1 up to 254 turns, 0xFF: Endless polling)
+ * @param uiPeriod indicates the polling period of a turn in units of 150 ms (0x01 – 0x0F: 150ms – 2.25s)
+ * @param callback function called for each target found, can be \e NULL
+ * @param user_data opaque pointer handed back to \a callback
+ *
+ * Same as nfc_poll_group(), for readers mounted close enough to disturb one
+ * another, e.g. the lanes of a gate. Devices of the same interference group
+ * have their field on in turns, one after the other: a turn is one poll of
+ * \a uiPeriod, the call to \a callback for the target found in it included,
+ * so that exchanges with the target are not disturbed either. Their field is
+ * off outside of their turns. Groups are polled at the same time.
+ *
+ * The field of the device which found the target ending polling is left on,
+ * the target selected; the field of the other devices is left off, it is
+ * switched on again by nfc_initiator_init() or \a NP_ACTIVATE_FIELD.
+ *
+ * @note A device must not be used by another thread while the group polls.
+ */
+int
+nfc_poll_group_slotted(nfc_device *pnds[], const int aiGroups[], const size_t szDevices,
+                       const nfc_modulation *pnmModulations, const size_t szModulations,
+                       const uint8_t uiPollNr, const uint8_t uiPeriod,
+                       nfc_poll_group_callback callback, void *user_data)
+{
+  return poll_group_run(pnds, aiGroups, szDevices, true, pnmModulations, szModulations,
+                        uiPollNr, uiPeriod, callback, user_data);
+}
@@ -0,0 +1,272 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-poll-session.c
+ * @brief Report targets entering and leaving the field across poll cycles
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+// Half of the slots at most are used, which keeps probe sequences short
+#define POLL_SESSION_SLOTS 32
+#define POLL_SESSION_MAX_TARGETS (POLL_SESSION_SLOTS / 2)
+
+struct poll_session_entry {
+  nfc_target_key ntk;
+  nfc_target nt;
+  long lLastSeen;
+};
+
+struct nfc_poll_session {
+  nfc_device *pnd;
+  nfc_modulation *pnmModulations;
+  size_t szModulations;
+  int ttl;
+  nfc_poll_session_callback callback;
+  void *user_data;
+  struct poll_session_entry aEntries[POLL_SESSION_MAX_TARGETS];
+  size_t szEntries;
+  int8_t aiSlots[POLL_SESSION_SLOTS];
+  // Entry left selected after the last inventory, or -1
+  int iSelected;
+  long lLastInventory;
+  nfc_target antFound[POLL_SESSION_MAX_TARGETS];
+};
+
+static long
+poll_session_now_ms(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+static int
+poll_session_find(const nfc_poll_session *ps, const nfc_target_key *pntk)
+{
+  size_t n = nfc_target_key_hash(pntk) % POLL_SESSION_SLOTS;
+  while (ps->aiSlots[n] >= 0) {
+    if (memcmp(&ps->aEntries[ps->aiSlots[n]].ntk, pntk, sizeof(*pntk)) == 0)
+      return ps->aiSlots[n];
+    n = (n + 1) % POLL_SESSION_SLOTS;
+  }
+  return -1;
+}
+
+static void
+poll_session_index(nfc_poll_session *ps, const size_t szEntry)
+{
+  size_t n = nfc_target_key_hash(&ps->aEntries[szEntry].ntk) % POLL_SESSION_SLOTS;
+  while (ps->aiSlots[n] >= 0)
+    n = (n + 1) % POLL_SESSION_SLOTS;
+  ps->aiSlots[n] = (int8_t) szEntry;
+}
+
+// Entries are packed again after removals, so the slots are rebuilt from scratch
+static void
+poll_session_reindex(nfc_poll_session *ps)
+{
+  memset(ps->aiSlots, 0xff, sizeof(ps->aiSlots));
+  for (size_t i = 0; i < ps->szEntries; i++)
+    poll_session_index(ps, i);
+}
+
+static void
+poll_session_report(nfc_poll_session *ps, const nfc_poll_event npe, const nfc_target *pnt, int *pnEvents)
+{
+  (*pnEvents)++;
+  if (ps->callback)
+    ps->callback(ps->pnd, npe, pnt, ps->user_data);
+}
+
+// Lists the targets of every modulation, returns the number found or libnfc's error code
+static int
+poll_session_inventory(nfc_poll_session *ps, const long lNow, int *pnEvents)
+{
+  int iLast = -1;
+  int res;
+  size_t szFound = 0;
+
+  for (size_t i = 0; i < ps->szModulations; i++) {
+    res = nfc_initiator_list_passive_targets(ps->pnd, ps->pnmModulations[i], ps->antFound, POLL_SESSION_MAX_TARGETS);
+    // Modulations the device lacks are left out, as nfc_initiator_poll_target() does
+    if (res == NFC_EDEVNOTSUPP)
+      continue;
+    if (res < 0)
+      return res;
+    for (int j = 0; j < res; j++) {
+      nfc_target_key ntk;
+      nfc_target_get_key(&ps->antFound[j], &ntk);
+      int iEntry = poll_session_find(ps, &ntk);
+      if (iEntry < 0) {
+        if (ps->szEntries == POLL_SESSION_MAX_TARGETS)
+          continue;
+        iEntry = (int) ps->szEntries++;
+        ps->aEntries[iEntry].ntk = ntk;
+        ps->aEntries[iEntry].nt = ps->antFound[j];
+        poll_session_index(ps, iEntry);
+        poll_session_report(ps, NFC_POLL_ARRIVED, &ps->antFound[j], pnEvents);
+      }
+      ps->aEntries[iEntry].lLastSeen = lNow;
+      iLast = iEntry;
+    }
+    szFound += res;
+  }
+  ps->lLastInventory = lNow;
+  // A lone target is woken up again so that next steps only check its presence
+  if ((szFound == 1) && (iLast >= 0) && (nfc_initiator_reactivate_target(ps->pnd, &ps->aEntries[iLast].nt) > 0))
+    ps->iSelected = iLast;
+  return (int) szFound;
+}
+
+/** @ingroup initiator
+ * @brief Create a session reporting targets entering and leaving the field
+ * @return Returns a session to step with nfc_poll_session_step(), \e NULL on failure
+ *
+ * @param pnd \a nfc_device struct pointer, already initialized as initiator
+ * @param pnmModulations modulations to list at each inventory, copied
+ * @param szModulations size of \a pnmModulations
+ * @param ttl time in milliseconds a target has to stay unseen before its departure is reported
+ * @param callback function called for each arrival and departure, can be \e NULL
+ * @param user_data opaque pointer handed back to \a callback
+ *
+ * The session remembers the UIDs of the targets found by the previous
+ * inventories, so that a card lingering on the reader is reported once when
+ * it arrives and once when it leaves, instead of at every poll cycle. A card
+ * missed by one inventory is not reported as departed until \a ttl elapsed.
+ *
+ * @note At most 16 targets are tracked at the same time, others are ignored.
+ */
+nfc_poll_session *
+nfc_poll_session_new(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations,
+                     const int ttl, nfc_poll_session_callback callback, void *user_data)
+{
+  nfc_poll_session *ps;
+
+  if ((pnd == NULL) || (pnmModulations == NULL) || (szModulations == 0) || (ttl <= 0))
+    return NULL;
+  if ((ps = malloc(sizeof(nfc_poll_session))) == NULL)
+    return NULL;
+  if ((ps->pnmModulations = malloc(szModulations * sizeof(nfc_modulation))) == NULL) {
+    free(ps);
+    return NULL;
+  }
+  memcpy(ps->pnmModulations, pnmModulations, szModulations * sizeof(nfc_modulation));
+  ps->pnd = pnd;
+  ps->szModulations = szModulations;
+  ps->ttl = ttl;
+  ps->callback = callback;
+  ps->user_data = user_data;
+  ps->szEntries = 0;
+  ps->iSelected = -1;
+  ps->lLastInventory = 0;
+  memset(ps->aiSlots, 0xff, sizeof(ps->aiSlots));
+  return ps;
+}
+
+/** @ingroup initiator
+ * @brief Run one poll cycle of a session
+ * @return Returns the number of arrivals and departures reported on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param ps \a nfc_poll_session struct pointer returned by nfc_poll_session_new()
+ *
+ * When the previous inventory found a single target, it was left selected
+ * and this cycle only sends it the presence check of
+ * nfc_initiator_target_is_present(). Modulations are listed again once it
+ * does not answer anymore, and at least every TTL so that new targets are
+ * noticed meanwhile. Otherwise every modulation is listed with
+ * nfc_initiator_list_passive_targets().
+ *
+ * @note A session is not thread-safe, the device must not be used by another
+ * thread while it steps.
+ */
+int
+nfc_poll_session_step(nfc_poll_session *ps)
+{
+  const long lNow = poll_session_now_ms();
+  int nEvents = 0;
+  int res = 0;
+  bool bInventory = true;
+
+  if (ps->iSelected >= 0) {
+    if ((lNow - ps->lLastInventory < ps->ttl) &&
+        (nfc_initiator_target_is_present(ps->pnd, &ps->aEntries[ps->iSelected].nt) == NFC_SUCCESS)) {
+      ps->aEntries[ps->iSelected].lLastSeen = lNow;
+      bInventory = false;
+    } else {
+      ps->iSelected = -1;
+    }
+  }
+  if (bInventory && ((res = poll_session_inventory(ps, lNow, &nEvents)) < 0))
+    return res;
+
+  // Departures, the list is packed by moving the last entry in the hole
+  bool bRemoved = false;
+  for (size_t i = 0; i < ps->szEntries;) {
+    if (lNow - ps->aEntries[i].lLastSeen < ps->ttl) {
+      i++;
+      continue;
+    }
+    poll_session_report(ps, NFC_POLL_DEPARTED, &ps->aEntries[i].nt, &nEvents);
+    ps->szEntries--;
+    if (ps->iSelected == (int) i)
+      ps->iSelected = -1;
+    else if (ps->iSelected == (int) ps->szEntries)
+      ps->iSelected = (int) i;
+    ps->aEntries[i] = ps->aEntries[ps->szEntries];
+    bRemoved = true;
+  }
+  if (bRemoved)
+    poll_session_reindex(ps);
+  return nEvents;
+}
+
+/** @ingroup initiator
+ * @brief Free a poll session
+ *
+ * @param ps \a nfc_poll_session struct pointer, can be \e NULL
+ *
+ * Targets still tracked are dropped without reporting their departure.
+ */
+void
+nfc_poll_session_free(nfc_poll_session *ps)
+{
+  if (ps == NULL)
+    return;
+  free(ps->pnmModulations);
+  free(ps);
+}
@@ -0,0 +1,233 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-presence.c
+ * @brief Watch a selected target in the background until it is removed
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+struct nfc_presence_monitor {
+  nfc_device *pnd;
+  nfc_target nt;
+  int min_interval;
+  int max_interval;
+  nfc_presence_callback callback;
+  void *user_data;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  // Read end is handed to the application, written once on removal
+  int fds[2];
+  int res;
+  bool stop;
+};
+
+// Waits for ms milliseconds, returns false if stopped meanwhile
+static bool
+presence_monitor_sleep(nfc_presence_monitor *pm, const int ms)
+{
+  struct timeval now;
+  struct timespec deadline;
+  bool stop;
+
+  gettimeofday(&now, NULL);
+  deadline.tv_sec = now.tv_sec + (ms / 1000);
+  deadline.tv_nsec = (now.tv_usec + (ms % 1000) * 1000) * 1000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&pm->lock);
+  while (!pm->stop) {
+    if (pthread_cond_timedwait(&pm->cond, &pm->lock, &deadline) == ETIMEDOUT)
+      break;
+  }
+  stop = pm->stop;
+  pthread_mutex_unlock(&pm->lock);
+  return !stop;
+}
+
+static void *
+presence_monitor_run(void *arg)
+{
+  nfc_presence_monitor *pm = arg;
+  int interval = pm->min_interval;
+  int res;
+
+  // Probes wait for the transactions of other threads on the device
+  nfc_thread_set_priority_class(NFC_PRIORITY_BACKGROUND);
+  while (presence_monitor_sleep(pm, interval)) {
+    res = nfc_initiator_target_is_present(pm->pnd, &pm->nt);
+    if (res == NFC_SUCCESS) {
+      // The longer the target stays, the less it is likely to go away soon
+      interval = (interval * 2 > pm->max_interval) ? pm->max_interval : interval * 2;
+      continue;
+    }
+    if ((res != NFC_ETGRELEASED) && (res != NFC_EDEVNOTSUPP) && (res != NFC_EINVARG)) {
+      // Card being torn off or transient error, look closer
+      interval = pm->min_interval;
+      continue;
+    }
+    // Only read after the thread is joined
+    pm->res = res;
+    if (pm->callback)
+      pm->callback(pm->pnd, &pm->nt, res, pm->user_data);
+    const uint8_t btEvent = 1;
+    if (write(pm->fds[1], &btEvent, 1) != 1)
+      pm->res = NFC_ESOFT;
+    break;
+  }
+  return NULL;
+}
+
+/** @ingroup initiator
+ * @brief Start watching a target in the background
+ * @return Returns a monitor to give to nfc_presence_monitor_stop(), or \e NULL on error
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt \a nfc_target struct pointer of the currently selected target
+ * @param min_interval shortest period between two probes, in milliseconds
+ * @param max_interval longest period between two probes, in milliseconds
+ * @param callback function called from the monitor thread once the target is gone, can be \e NULL
+ * @param user_data opaque pointer handed back to \a callback
+ *
+ * A thread probes the target with nfc_initiator_target_is_present(). The
+ * period starts at \a min_interval and doubles after each successful probe up
+ * to \a max_interval; it falls back to \a min_interval as soon as a probe fails
+ * without the target being reported released. Once the target is gone (or can
+ * not be monitored), \a callback is called with the probe result and the file
+ * descriptor returned by nfc_presence_monitor_get_fd() becomes readable, so
+ * that many readers can be watched from a single poll()/select() loop.
+ *
+ * MIFARE Classic targets are refused (\e NULL with \c errno set to \c ENOTSUP):
+ * probing them halts and selects them again, which ends the Crypto1 session
+ * of the sector the application authenticated, between two of its commands.
+ *
+ * @note Probes take the device lock and leave the target in the state they
+ * found it, so the application can keep exchanging with it meanwhile. The
+ * monitor thread is of class \a NFC_PRIORITY_BACKGROUND, so that a probe
+ * delays an exchange by one probe at most; \a callback is called with that
+ * class too.
+ */
+nfc_presence_monitor *
+nfc_presence_monitor_start(nfc_device *pnd, const nfc_target *pnt, const int min_interval, const int max_interval,
+                           nfc_presence_callback callback, void *user_data)
+{
+  nfc_presence_monitor *pm;
+
+  if ((pnd == NULL) || (pnt == NULL) || (min_interval <= 0) || (max_interval < min_interval))
+    return NULL;
+  // Same test as the driver to pick the MIFARE Classic probe
+  if ((pnt->nm.nmt == NMT_ISO14443A) && (pnt->nti.nai.btSak & 0x08) && !(pnt->nti.nai.btSak & 0x20)) {
+    errno = ENOTSUP;
+    return NULL;
+  }
+  if ((pm = malloc(sizeof(nfc_presence_monitor))) == NULL)
+    return NULL;
+  if (pipe(pm->fds) < 0) {
+    free(pm);
+    return NULL;
+  }
+  pm->pnd = pnd;
+  memcpy(&pm->nt, pnt, sizeof(nfc_target));
+  pm->min_interval = min_interval;
+  pm->max_interval = max_interval;
+  pm->callback = callback;
+  pm->user_data = user_data;
+  pm->res = NFC_SUCCESS;
+  pm->stop = false;
+  pthread_mutex_init(&pm->lock, NULL);
+  pthread_cond_init(&pm->cond, NULL);
+  if (pthread_create(&pm->thread, NULL, presence_monitor_run, pm) != 0) {
+    pthread_cond_destroy(&pm->cond);
+    pthread_mutex_destroy(&pm->lock);
+    close(pm->fds[0]);
+    close(pm->fds[1]);
+    free(pm);
+    return NULL;
+  }
+  return pm;
+}
+
+/** @ingroup initiator
+ * @brief Get a file descriptor which becomes readable once the target is gone
+ * @return Returns the file descriptor, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pm monitor returned by nfc_presence_monitor_start()
+ *
+ * It stays owned by the monitor: do not read nor close it.
+ */
+int
+nfc_presence_monitor_get_fd(const nfc_presence_monitor *pm)
+{
+  if (pm == NULL)
+    return NFC_EINVARG;
+  return pm->fds[0];
+}
+
+/** @ingroup initiator
+ * @brief Stop watching and free the monitor
+ * @return Returns \c NFC_ETGRELEASED if the target was reported gone, \c NFC_SUCCESS if it was still there, otherwise libnfc's error code of the last probe
+ *
+ * @param pm monitor returned by nfc_presence_monitor_start()
+ *
+ * Waits for a probe in progress, if any. Must not be called from the monitor callback.
+ */
+int
+nfc_presence_monitor_stop(nfc_presence_monitor *pm)
+{
+  int res;
+
+  if (pm == NULL)
+    return NFC_EINVARG;
+  pthread_mutex_lock(&pm->lock);
+  pm->stop = true;
+  pthread_cond_signal(&pm->cond);
+  pthread_mutex_unlock(&pm->lock);
+  pthread_join(pm->thread, NULL);
+
+  res = pm->res;
+  pthread_cond_destroy(&pm->cond);
+  pthread_mutex_destroy(&pm->lock);
+  close(pm->fds[0]);
+  close(pm->fds[1]);
+  free(pm);
+  return res;
+}
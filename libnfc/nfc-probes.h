@@ -0,0 +1,64 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-probes.h
+ * @brief Static tracepoints (USDT) on the command path
+ *
+ * Built with PROBES, each probe is a single nop instruction plus a note in
+ * the ELF file telling where its arguments are. Tools like bpftrace,
+ * SystemTap or DTrace patch it when attached, otherwise it costs nothing.
+ * Without PROBES, probes and their arguments vanish.
+ *
+ * All probes belong to the "libnfc" provider:
+ * - transceive__start(cmd, tx_len, timeout), transceive__done(cmd, res):
+ *   around each PN53x command
+ * - io__send(cmd, tx_len, timeout, res), io__receive(rx_len, timeout, res):
+ *   each frame handed to or read from a PN53x driver
+ * - writeback(registers, res): registers flushed by pn53x_writeback_register()
+ * - uart__receive(rx_len, timeout, res)
+ * - usb__bulk_read(rx_len, timeout, res), usb__bulk_write(tx_len, timeout, res)
+ * - select__start(nmt, nbr, init_len), select__done(nmt, res):
+ *   around nfc_initiator_select_passive_target()
+ *
+ * E.g. bpftrace -e 'usdt:/usr/lib/libnfc.so:libnfc:transceive__done { @[arg0] = count(); }'
+ */
+
+#ifndef __NFC_PROBES_H__
+#define __NFC_PROBES_H__
+
+#ifdef PROBES
+#  include <sys/sdt.h>
+#  define NFC_PROBE2(name, a1, a2) DTRACE_PROBE2(libnfc, name, a1, a2)
+#  define NFC_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(libnfc, name, a1, a2, a3)
+#  define NFC_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(libnfc, name, a1, a2, a3, a4)
+#else
+#  define NFC_PROBE2(name, a1, a2) do {} while (0)
+#  define NFC_PROBE3(name, a1, a2, a3) do {} while (0)
+#  define NFC_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#endif // PROBES
+
+#endif // __NFC_PROBES_H__
@@ -0,0 +1,321 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file nfc-registry.c
+ * @brief Growable registry of user defined devices
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+#define LOG_CATEGORY "libnfc.general"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+void
+nfc_registry_init(struct nfc_device_registry *pndr)
+{
+  pndr->devices = NULL;
+  pndr->szDevices = 0;
+  pndr->szAlloc = 0;
+  pndr->aiNameSlots = NULL;
+  pndr->aiConnstringSlots = NULL;
+  pndr->szSlots = 0;
+  pthread_mutex_init(&pndr->lock, NULL);
+}
+
+void
+nfc_registry_clear(struct nfc_device_registry *pndr)
+{
+  for (size_t n = 0; n < pndr->szDevices; n++) {
+    free(pndr->devices[n].name);
+    free(pndr->devices[n].connstring);
+  }
+  pndr->szDevices = 0;
+  for (size_t n = 0; n < pndr->szSlots; n++)
+    pndr->aiNameSlots[n] = pndr->aiConnstringSlots[n] = -1;
+}
+
+void
+nfc_registry_free(struct nfc_device_registry *pndr)
+{
+  nfc_registry_clear(pndr);
+  free(pndr->devices);
+  free(pndr->aiNameSlots);
+  free(pndr->aiConnstringSlots);
+  pthread_mutex_destroy(&pndr->lock);
+}
+
+// FNV-1a
+static uint32_t
+nfc_registry_hash(const char *s)
+{
+  uint32_t h = 2166136261u;
+  while (*s) {
+    h ^= (uint8_t) * s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void
+nfc_registry_slot_add(int32_t *aiSlots, const size_t szSlots, const char *key, const int32_t iIndex)
+{
+  if (!key)
+    return;
+  size_t n = nfc_registry_hash(key) & (szSlots - 1);
+  while (aiSlots[n] >= 0)
+    n = (n + 1) & (szSlots - 1);
+  aiSlots[n] = iIndex;
+}
+
+// Rebuilds both tables, at most half full, after any change
+static int
+nfc_registry_rehash(struct nfc_device_registry *pndr)
+{
+  size_t szSlots = pndr->szSlots ? pndr->szSlots : 16;
+  while (szSlots < pndr->szDevices * 2)
+    szSlots *= 2;
+  if (szSlots != pndr->szSlots) {
+    int32_t *aiName = malloc(szSlots * sizeof(int32_t));
+    int32_t *aiConnstring = malloc(szSlots * sizeof(int32_t));
+    if (!aiName || !aiConnstring) {
+      // Lookups find nothing rather than stale indexes
+      free(aiName);
+      free(aiConnstring);
+      free(pndr->aiNameSlots);
+      free(pndr->aiConnstringSlots);
+      pndr->aiNameSlots = pndr->aiConnstringSlots = NULL;
+      pndr->szSlots = 0;
+      return NFC_ESOFT;
+    }
+    free(pndr->aiNameSlots);
+    free(pndr->aiConnstringSlots);
+    pndr->aiNameSlots = aiName;
+    pndr->aiConnstringSlots = aiConnstring;
+    pndr->szSlots = szSlots;
+  }
+  for (size_t n = 0; n < pndr->szSlots; n++)
+    pndr->aiNameSlots[n] = pndr->aiConnstringSlots[n] = -1;
+  for (size_t n = 0; n < pndr->szDevices; n++) {
+    nfc_registry_slot_add(pndr->aiNameSlots, pndr->szSlots, pndr->devices[n].name, (int32_t) n);
+    nfc_registry_slot_add(pndr->aiConnstringSlots, pndr->szSlots, pndr->devices[n].connstring, (int32_t) n);
+  }
+  return NFC_SUCCESS;
+}
+
+/*
+ * Index of the first device whose name (bName) or connstring is key, -1 if
+ * none. Called with the lock held.
+ */
+static int
+nfc_registry_find(const struct nfc_device_registry *pndr, const char *key, const bool bName)
+{
+  if (!pndr->szSlots)
+    return -1;
+  const int32_t *aiSlots = bName ? pndr->aiNameSlots : pndr->aiConnstringSlots;
+  int iFound = -1;
+  for (size_t n = nfc_registry_hash(key) & (pndr->szSlots - 1); aiSlots[n] >= 0; n = (n + 1) & (pndr->szSlots - 1)) {
+    const struct nfc_user_defined_device *pudd = &pndr->devices[aiSlots[n]];
+    const char *pcKey = bName ? pudd->name : pudd->connstring;
+    if ((strcmp(pcKey, key) == 0) && ((iFound < 0) || (aiSlots[n] < iFound)))
+      iFound = aiSlots[n];
+  }
+  return iFound;
+}
+
+// nfc_registry_append(), called with the lock held
+static int
+nfc_registry_append_locked(struct nfc_device_registry *pndr)
+{
+  if (pndr->szDevices == pndr->szAlloc) {
+    const size_t szAlloc = pndr->szAlloc ? pndr->szAlloc * 2 : 4;
+    struct nfc_user_defined_device *devices = realloc(pndr->devices, szAlloc * sizeof(*devices));
+    if (!devices)
+      return NFC_ESOFT;
+    pndr->devices = devices;
+    pndr->szAlloc = szAlloc;
+  }
+  memset(&pndr->devices[pndr->szDevices], 0, sizeof(pndr->devices[0]));
+  return (int) pndr->szDevices++;
+}
+
+// Adds an empty device at the end, returns its index
+int
+nfc_registry_append(struct nfc_device_registry *pndr)
+{
+  pthread_mutex_lock(&pndr->lock);
+  const int res = nfc_registry_append_locked(pndr);
+  pthread_mutex_unlock(&pndr->lock);
+  return res;
+}
+
+// nfc_registry_set(), called with the lock held
+static int
+nfc_registry_set_locked(struct nfc_device_registry *pndr, const size_t szIndex, const char *name, const char *connstring, const int iOptional)
+{
+  int res = NFC_SUCCESS;
+  struct nfc_user_defined_device *pudd = &pndr->devices[szIndex];
+  if (name) {
+    char *pcName = strdup(name);
+    if (!pcName) {
+      res = NFC_ESOFT;
+    } else {
+      // Kept as long as pnd->name
+      if (strlen(pcName) >= DEVICE_NAME_LENGTH)
+        pcName[DEVICE_NAME_LENGTH - 1] = '\0';
+      free(pudd->name);
+      pudd->name = pcName;
+    }
+  }
+  if (connstring && (res == NFC_SUCCESS)) {
+    const size_t szLen = MIN(strlen(connstring), NFC_BUFSIZE_CONNSTRING - 1);
+    char *pcConnstring = malloc(szLen + 1);
+    if (!pcConnstring) {
+      res = NFC_ESOFT;
+    } else {
+      memcpy(pcConnstring, connstring, szLen);
+      pcConnstring[szLen] = '\0';
+      free(pudd->connstring);
+      pudd->connstring = pcConnstring;
+      pudd->probed_at = 0;
+    }
+  }
+  if (iOptional >= 0)
+    pudd->optional = iOptional;
+  if (res == NFC_SUCCESS)
+    res = nfc_registry_rehash(pndr);
+  return res;
+}
+
+/*
+ * Sets what is given of a device: name and connstring unless NULL, optional
+ * unless iOptional is negative.
+ */
+int
+nfc_registry_set(struct nfc_device_registry *pndr, const size_t szIndex, const char *name, const char *connstring, const int iOptional)
+{
+  pthread_mutex_lock(&pndr->lock);
+  const int res = nfc_registry_set_locked(pndr, szIndex, name, connstring, iOptional);
+  pthread_mutex_unlock(&pndr->lock);
+  return res;
+}
+
+// Copies the name of the device with that connstring, returns false if there is none
+bool
+nfc_registry_get_name(struct nfc_device_registry *pndr, const char *connstring, char *name, const size_t szName)
+{
+  pthread_mutex_lock(&pndr->lock);
+  const int i = nfc_registry_find(pndr, connstring, false);
+  const bool bFound = (i >= 0) && pndr->devices[i].name;
+  if (bFound) {
+    strncpy(name, pndr->devices[i].name, szName - 1);
+    name[szName - 1] = '\0';
+  }
+  pthread_mutex_unlock(&pndr->lock);
+  return bFound;
+}
+
+// Copies the connstring of the device with that name, returns false if there is none
+bool
+nfc_registry_get_connstring(struct nfc_device_registry *pndr, const char *name, nfc_connstring connstring)
+{
+  pthread_mutex_lock(&pndr->lock);
+  const int i = nfc_registry_find(pndr, name, true);
+  const bool bFound = (i >= 0) && pndr->devices[i].connstring;
+  if (bFound)
+    strcpy(connstring, pndr->devices[i].connstring);
+  pthread_mutex_unlock(&pndr->lock);
+  return bFound;
+}
+
+/** @ingroup dev
+ * @brief Add a user defined device to a context
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param context The context to operate on
+ * @param name device name, which nfc_open() also accepts instead of the connstring
+ * @param connstring device connection string
+ * @param optional when set, nfc_list_devices() only lists the device if it can be opened
+ *
+ * A device already defined with the same connstring is updated instead.
+ * Devices are listed by nfc_list_devices() in the order they were defined,
+ * before auto-detected ones.
+ */
+int
+nfc_context_add_device(nfc_context *context, const char *name, const char *connstring, const bool optional)
+{
+  struct nfc_device_registry *pndr = &context->registry;
+  // Looked up and added at once, or two threads could add the same connstring
+  pthread_mutex_lock(&pndr->lock);
+  int i = nfc_registry_find(pndr, connstring, false);
+  if ((i < 0) && ((i = nfc_registry_append_locked(pndr)) < 0)) {
+    pthread_mutex_unlock(&pndr->lock);
+    return i;
+  }
+  const int res = nfc_registry_set_locked(pndr, (size_t) i, name, connstring, optional);
+  pthread_mutex_unlock(&pndr->lock);
+  nfc_list_devices_invalidate(context);
+  return res;
+}
+
+/** @ingroup dev
+ * @brief Remove a user defined device from a context
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param context The context to operate on
+ * @param connstring connection string of the device, or its name
+ *
+ * Devices already opened stay open.
+ */
+int
+nfc_context_remove_device(nfc_context *context, const char *connstring)
+{
+  struct nfc_device_registry *pndr = &context->registry;
+  pthread_mutex_lock(&pndr->lock);
+  int i = nfc_registry_find(pndr, connstring, false);
+  if (i < 0)
+    i = nfc_registry_find(pndr, connstring, true);
+  if (i < 0) {
+    pthread_mutex_unlock(&pndr->lock);
+    return NFC_EINVARG;
+  }
+  free(pndr->devices[i].name);
+  free(pndr->devices[i].connstring);
+  memmove(&pndr->devices[i], &pndr->devices[i + 1], (pndr->szDevices - i - 1) * sizeof(pndr->devices[0]));
+  pndr->szDevices--;
+  const int res = nfc_registry_rehash(pndr);
+  pthread_mutex_unlock(&pndr->lock);
+  nfc_list_devices_invalidate(context);
+  return res;
+}
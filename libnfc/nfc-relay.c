@@ -0,0 +1,432 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-relay.c
+ * @brief Forward frames between an emulated target and a genuine one
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#else
+#  include <io.h>
+#endif
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+// Records of the remote transport: type, length on two bytes big endian, payload
+#define RELAY_RECORD_COMMAND   0x01
+#define RELAY_RECORD_ANSWER    0x02
+#define RELAY_RECORD_NO_ANSWER 0x03
+#define RELAY_RECORD_TARGET    0x04
+#define RELAY_RECORD_HEADER_LEN 3
+#define RELAY_RECORD_MAX_LEN 0xFFFF
+
+struct relay_buffers {
+  uint8_t abtCommand[RELAY_RECORD_MAX_LEN];
+  uint8_t abtCommandPar[RELAY_RECORD_MAX_LEN / 8 + 1];
+  uint8_t abtAnswer[RELAY_RECORD_MAX_LEN];
+  uint8_t abtAnswerPar[RELAY_RECORD_MAX_LEN / 8 + 1];
+  // Outgoing record, built in place to be written at once
+  uint8_t abtRecord[RELAY_RECORD_HEADER_LEN + RELAY_RECORD_MAX_LEN];
+};
+
+static int
+relay_read_full(const nfc_relay_options *pnro, uint8_t *pbtData, const size_t szData)
+{
+  size_t szDone = 0;
+
+  while (szDone < szData) {
+    const ssize_t res = read(pnro->iFdIn, pbtData + szDone, szData - szDone);
+    if (res > 0) {
+      szDone += res;
+    } else if (res == 0) {
+      // Remote side closed, this ends the relay
+      return NFC_ETGRELEASED;
+    } else if ((errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+      return NFC_EIO;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+relay_write_record(const nfc_relay_options *pnro, uint8_t *pbtRecord, const uint8_t btType, const size_t szPayload)
+{
+  size_t szDone = 0;
+  const size_t szRecord = RELAY_RECORD_HEADER_LEN + szPayload;
+
+  pbtRecord[0] = btType;
+  pbtRecord[1] = szPayload >> 8;
+  pbtRecord[2] = szPayload & 0xff;
+  while (szDone < szRecord) {
+    const ssize_t res = write(pnro->iFdOut, pbtRecord + szDone, szRecord - szDone);
+    if (res > 0)
+      szDone += res;
+    else if ((res < 0) && (errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+      return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+}
+
+// Returns the payload length, otherwise libnfc's error code
+static int
+relay_read_record(const nfc_relay_options *pnro, uint8_t *pbtType, uint8_t *pbtPayload, const size_t szPayload)
+{
+  uint8_t abtHeader[RELAY_RECORD_HEADER_LEN];
+  int res;
+
+  if ((res = relay_read_full(pnro, abtHeader, sizeof(abtHeader))) < 0)
+    return res;
+  const size_t szLen = (abtHeader[1] << 8) | abtHeader[2];
+  if (szLen > szPayload)
+    return NFC_EOVFLOW;
+  if ((res = relay_read_full(pnro, pbtPayload, szLen)) < 0)
+    return res;
+  *pbtType = abtHeader[0];
+  return (int) szLen;
+}
+
+static size_t
+relay_frame_len(const nfc_relay_options *pnro, const size_t szFrame)
+{
+  // Raw frames carry their parity bits after the data bytes
+  return (pnro->nrm == NFC_RELAY_FRAMES) ? 2 * ((szFrame + 7) / 8) : szFrame;
+}
+
+static int
+relay_send_frame(const nfc_relay_options *pnro, struct relay_buffers *prb, const uint8_t btType,
+                 const uint8_t *pbtFrame, const size_t szFrame, const uint8_t *pbtPar)
+{
+  uint8_t *pbtPayload = prb->abtRecord + RELAY_RECORD_HEADER_LEN;
+
+  if (pnro->nrm == NFC_RELAY_FRAMES) {
+    const size_t szBytes = (szFrame + 7) / 8;
+    // Records count bits for raw frames
+    pbtPayload[0] = szFrame >> 8;
+    pbtPayload[1] = szFrame & 0xff;
+    memcpy(pbtPayload + 2, pbtFrame, szBytes);
+    memcpy(pbtPayload + 2 + szBytes, pbtPar, szBytes);
+    return relay_write_record(pnro, prb->abtRecord, btType, 2 + 2 * szBytes);
+  }
+  memcpy(pbtPayload, pbtFrame, szFrame);
+  return relay_write_record(pnro, prb->abtRecord, btType, szFrame);
+}
+
+// Returns the frame length (bits for raw frames), otherwise libnfc's error code
+static int
+relay_receive_frame(const nfc_relay_options *pnro, struct relay_buffers *prb, uint8_t *pbtType, uint8_t *pbtFrame, uint8_t *pbtPar)
+{
+  int res;
+
+  if (pnro->nrm != NFC_RELAY_FRAMES)
+    return relay_read_record(pnro, pbtType, pbtFrame, RELAY_RECORD_MAX_LEN);
+
+  uint8_t *pbtPayload = prb->abtRecord + RELAY_RECORD_HEADER_LEN;
+  if ((res = relay_read_record(pnro, pbtType, pbtPayload, RELAY_RECORD_MAX_LEN)) < 0)
+    return res;
+  if (*pbtType == RELAY_RECORD_NO_ANSWER)
+    return 0;
+  if (res < 2)
+    return NFC_EIO;
+  const size_t szBits = (pbtPayload[0] << 8) | pbtPayload[1];
+  const size_t szBytes = (szBits + 7) / 8;
+  if ((size_t) res != relay_frame_len(pnro, szBits) + 2)
+    return NFC_EIO;
+  memcpy(pbtFrame, pbtPayload + 2, szBytes);
+  memcpy(pbtPar, pbtPayload + 2 + szBytes, szBytes);
+  return (int) szBits;
+}
+
+// Gets the genuine target answer, the relay stays silent (0) when it did not answer
+static int
+relay_local_answer(nfc_device *pndInitiator, const nfc_relay_options *pnro, struct relay_buffers *prb, const size_t szCommand)
+{
+  int res;
+
+  if (pnro->nrm == NFC_RELAY_FRAMES) {
+    // REQA starts a new session: cycle the field so that the genuine tag reboots too
+    if ((szCommand == 7) && (prb->abtCommand[0] == 0x26)) {
+      if (((res = nfc_device_set_property_bool(pndInitiator, NP_ACTIVATE_FIELD, false)) < 0) ||
+          ((res = nfc_device_set_property_bool(pndInitiator, NP_ACTIVATE_FIELD, true)) < 0))
+        return res;
+    }
+    res = nfc_initiator_transceive_bits(pndInitiator, prb->abtCommand, szCommand, prb->abtCommandPar,
+                                        prb->abtAnswer, sizeof(prb->abtAnswer), prb->abtAnswerPar);
+  } else {
+    res = nfc_initiator_transceive_bytes(pndInitiator, prb->abtCommand, szCommand, prb->abtAnswer, sizeof(prb->abtAnswer), -1);
+  }
+  return (res < 0) ? 0 : res;
+}
+
+static int
+relay_remote_answer(const nfc_relay_options *pnro, struct relay_buffers *prb, const size_t szCommand)
+{
+  uint8_t btType;
+  int res;
+
+  if ((res = relay_send_frame(pnro, prb, RELAY_RECORD_COMMAND, prb->abtCommand, szCommand, prb->abtCommandPar)) < 0)
+    return res;
+  if ((res = relay_receive_frame(pnro, prb, &btType, prb->abtAnswer, prb->abtAnswerPar)) < 0)
+    return res;
+  if (btType == RELAY_RECORD_NO_ANSWER)
+    return 0;
+  return (btType == RELAY_RECORD_ANSWER) ? res : NFC_EIO;
+}
+
+// usleep() is only specified below one second, which iDelay may exceed
+static void
+relay_sleep(const int ms)
+{
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (long)(ms % 1000) * 1000000;
+  nanosleep(&ts, NULL);
+}
+
+static int
+relay_loop(nfc_device *pndTarget, nfc_device *pndInitiator, const nfc_relay_options *pnro, struct relay_buffers *prb)
+{
+  uint8_t btType;
+  int iCommand = 0, iAnswer;
+  int res;
+
+  if (pndTarget) {
+    iCommand = (pnro->nrm == NFC_RELAY_FRAMES) ?
+               nfc_target_receive_bits(pndTarget, prb->abtCommand, sizeof(prb->abtCommand), prb->abtCommandPar) :
+               nfc_target_receive_bytes(pndTarget, prb->abtCommand, sizeof(prb->abtCommand), 0);
+  }
+  for (;;) {
+    if (pndTarget == NULL) {
+      if ((iCommand = relay_receive_frame(pnro, prb, &btType, prb->abtCommand, prb->abtCommandPar)) < 0)
+        return iCommand;
+      if (btType != RELAY_RECORD_COMMAND)
+        return NFC_EIO;
+    } else if (iCommand <= 0) {
+      // Garbled raw frames are expected while the reader runs anticollision
+      if ((pnro->nrm != NFC_RELAY_FRAMES) || (iCommand == NFC_EIO) || (iCommand == NFC_ENOTSUCHDEV))
+        return iCommand;
+      iCommand = nfc_target_receive_bits(pndTarget, prb->abtCommand, sizeof(prb->abtCommand), prb->abtCommandPar);
+      continue;
+    }
+
+    if (pndInitiator) {
+      if ((iAnswer = relay_local_answer(pndInitiator, pnro, prb, iCommand)) < 0)
+        return iAnswer;
+    } else if ((iAnswer = relay_remote_answer(pnro, prb, iCommand)) < 0) {
+      return iAnswer;
+    }
+
+    if (pnro->iDelay > 0)
+      relay_sleep(pnro->iDelay);
+    // The answer goes to the reader first, the callback only runs after
+    bool bReceived = false;
+    if (pndTarget == NULL) {
+      res = iAnswer ?
+            relay_send_frame(pnro, prb, RELAY_RECORD_ANSWER, prb->abtAnswer, iAnswer, prb->abtAnswerPar) :
+            relay_write_record(pnro, prb->abtRecord, RELAY_RECORD_NO_ANSWER, 0);
+      if (res < 0)
+        return res;
+    } else if (iAnswer && (pnro->nrm == NFC_RELAY_FRAMES)) {
+      if ((res = nfc_target_send_bits(pndTarget, prb->abtAnswer, iAnswer, prb->abtAnswerPar)) < 0)
+        return res;
+    } else if (iAnswer && pnro->callback) {
+      // The callback still needs the command: no single round trip here
+      if ((res = nfc_target_send_bytes(pndTarget, prb->abtAnswer, iAnswer, 0)) < 0)
+        return res;
+    } else if (iAnswer) {
+      // Answer and wait for the next command in a single round trip with the chip
+      iCommand = nfc_target_transceive_bytes(pndTarget, prb->abtAnswer, iAnswer, prb->abtCommand, sizeof(prb->abtCommand), 0);
+      bReceived = true;
+    }
+
+    if (pnro->callback &&
+        (pnro->callback(prb->abtCommand, iCommand, (pnro->nrm == NFC_RELAY_FRAMES) ? prb->abtCommandPar : NULL,
+                        iAnswer ? prb->abtAnswer : NULL, iAnswer, (iAnswer && (pnro->nrm == NFC_RELAY_FRAMES)) ? prb->abtAnswerPar : NULL,
+                        pnro->user_data) < 0))
+      return NFC_SUCCESS;
+
+    if ((pndTarget == NULL) || bReceived)
+      continue;
+    iCommand = (pnro->nrm == NFC_RELAY_FRAMES) ?
+               nfc_target_receive_bits(pndTarget, prb->abtCommand, sizeof(prb->abtCommand), prb->abtCommandPar) :
+               nfc_target_receive_bytes(pndTarget, prb->abtCommand, sizeof(prb->abtCommand), 0);
+  }
+}
+
+/** @ingroup misc
+ * @brief Relay frames between an emulated target and a genuine one
+ * @return Returns \c NFC_SUCCESS once the callback stopped the relay, otherwise returns libnfc's error code
+ *
+ * @param pndTarget device emulating the target in front of the genuine reader, or \e NULL if remote
+ * @param pndInitiator device in front of the genuine target, or \e NULL if remote
+ * @param pnro relay options
+ *
+ * Both devices must already be set up: \a pndTarget initialised with
+ * nfc_target_init() and \a pndInitiator with nfc_initiator_init() (in
+ * \c NFC_RELAY_FRAMES mode, with \c NP_HANDLE_CRC and \c NP_HANDLE_PARITY
+ * disabled on both; in \c NFC_RELAY_APDUS mode, with the genuine target
+ * selected). Frames then go straight from one device to the other through
+ * buffers allocated once, and in \c NFC_RELAY_APDUS mode each answer is sent
+ * along with the request for the next command.
+ *
+ * When one of the devices is \e NULL, its side of the relay is run by a peer
+ * process reached through \a iFdIn and \a iFdOut (e.g. a socket), which runs
+ * nfc_relay_run() with the other device. Frames are exchanged as binary records
+ * made of a type byte, a payload length on two bytes (big endian) and the
+ * payload. In \c NFC_RELAY_FRAMES mode, the payload is the frame length in bits
+ * on two bytes followed by its data and parity bytes.
+ *
+ * The callback, if any, is called after each exchange, once the answer was
+ * forwarded to the reader, and stops the relay by returning a negative value.
+ * In \c NFC_RELAY_APDUS mode, a callback costs the single round trip which
+ * otherwise sends each answer along with the request for the next command.
+ *
+ * @note The relay also ends with \c NFC_ETGRELEASED when the peer process
+ * closes its side of the transport.
+ */
+int
+nfc_relay_run(nfc_device *pndTarget, nfc_device *pndInitiator, const nfc_relay_options *pnro)
+{
+  nfc_device *pnd = pndTarget ? pndTarget : pndInitiator;
+  struct relay_buffers *prb;
+  int res;
+
+  if (pnd == NULL)
+    return NFC_EINVARG;
+  if ((pnro == NULL) || (((pndTarget == NULL) || (pndInitiator == NULL)) && ((pnro->iFdIn < 0) || (pnro->iFdOut < 0)))) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if ((prb = malloc(sizeof(struct relay_buffers))) == NULL) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+
+#ifndef WIN32
+  // Spin on the transport instead of sleeping in read(), wakeups are costly
+  const int iFlags = (pndTarget && pndInitiator) ? -1 : fcntl(pnro->iFdIn, F_GETFL);
+  if (pnro->bBusyPoll && (iFlags >= 0))
+    fcntl(pnro->iFdIn, F_SETFL, iFlags | O_NONBLOCK);
+#endif
+
+  res = relay_loop(pndTarget, pndInitiator, pnro, prb);
+
+#ifndef WIN32
+  if (pnro->bBusyPoll && (iFlags >= 0))
+    fcntl(pnro->iFdIn, F_SETFL, iFlags);
+#endif
+  free(prb);
+  if (res < 0)
+    pnd->last_error = res;
+  return res;
+}
+
+/** @ingroup misc
+ * @brief Send the description of the genuine target to the remote side of a relay
+ * @return Returns \c NFC_SUCCESS, otherwise returns libnfc's error code
+ *
+ * @param pnro relay options giving the transport
+ * @param pnt genuine target, only ISO/IEC 14443 type A targets are supported
+ *
+ * This lets the remote side emulate a target looking like the genuine one,
+ * see nfc_relay_receive_target().
+ */
+int
+nfc_relay_send_target(const nfc_relay_options *pnro, const nfc_target *pnt)
+{
+  uint8_t abtRecord[RELAY_RECORD_HEADER_LEN + sizeof(nfc_iso14443a_info)];
+  uint8_t *pbtPayload = abtRecord + RELAY_RECORD_HEADER_LEN;
+
+  if ((pnro == NULL) || (pnt == NULL) || (pnt->nm.nmt != NMT_ISO14443A))
+    return NFC_EINVARG;
+  const nfc_iso14443a_info *pnai = &(pnt->nti.nai);
+  if ((pnai->szUidLen > sizeof(pnai->abtUid)) || (pnai->szAtsLen > sizeof(pnai->abtAts)))
+    return NFC_EINVARG;
+
+  size_t szPayload = 0;
+  memcpy(pbtPayload, pnai->abtAtqa, 2);
+  szPayload += 2;
+  pbtPayload[szPayload++] = pnai->btSak;
+  pbtPayload[szPayload++] = pnai->szUidLen;
+  memcpy(pbtPayload + szPayload, pnai->abtUid, pnai->szUidLen);
+  szPayload += pnai->szUidLen;
+  pbtPayload[szPayload++] = pnai->szAtsLen;
+  memcpy(pbtPayload + szPayload, pnai->abtAts, pnai->szAtsLen);
+  szPayload += pnai->szAtsLen;
+  return relay_write_record(pnro, abtRecord, RELAY_RECORD_TARGET, szPayload);
+}
+
+/** @ingroup misc
+ * @brief Receive the description of the genuine target from the remote side of a relay
+ * @return Returns \c NFC_SUCCESS, otherwise returns libnfc's error code
+ *
+ * @param pnro relay options giving the transport
+ * @param[out] pnt genuine target, as sent by nfc_relay_send_target()
+ */
+int
+nfc_relay_receive_target(const nfc_relay_options *pnro, nfc_target *pnt)
+{
+  uint8_t abtPayload[sizeof(nfc_iso14443a_info)];
+  uint8_t btType;
+  int res;
+
+  if ((pnro == NULL) || (pnt == NULL))
+    return NFC_EINVARG;
+  if ((res = relay_read_record(pnro, &btType, abtPayload, sizeof(abtPayload))) < 0)
+    return res;
+  if ((btType != RELAY_RECORD_TARGET) || (res < 5))
+    return NFC_EIO;
+
+  const size_t szPayload = res;
+  nfc_iso14443a_info *pnai = &(pnt->nti.nai);
+  memset(pnt, 0, sizeof(nfc_target));
+  pnt->nm.nmt = NMT_ISO14443A;
+  pnt->nm.nbr = NBR_106;
+  memcpy(pnai->abtAtqa, abtPayload, 2);
+  pnai->btSak = abtPayload[2];
+  pnai->szUidLen = abtPayload[3];
+  if ((pnai->szUidLen > sizeof(pnai->abtUid)) || (szPayload < 5 + pnai->szUidLen))
+    return NFC_EIO;
+  memcpy(pnai->abtUid, abtPayload + 4, pnai->szUidLen);
+  pnai->szAtsLen = abtPayload[4 + pnai->szUidLen];
+  if ((pnai->szAtsLen > sizeof(pnai->abtAts)) || (szPayload != 5 + pnai->szUidLen + pnai->szAtsLen))
+    return NFC_EIO;
+  memcpy(pnai->abtAts, abtPayload + 5 + pnai->szUidLen, pnai->szAtsLen);
+  return NFC_SUCCESS;
+}
@@ -0,0 +1,162 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file nfc-retry.c
+ * @brief Host-level retries with jittered backoff and retry credits
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <time.h>
+#include <sys/time.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+#define LOG_CATEGORY "libnfc.general"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+static uint64_t
+nfc_retry_elapsed_ms(const struct timeval *start)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const int64_t ms = ((int64_t)(now.tv_sec - start->tv_sec) * 1000) + (now.tv_usec - start->tv_usec) / 1000;
+  return (ms > 0) ? (uint64_t) ms : 0;
+}
+
+static void
+nfc_retry_sleep(const unsigned int ms)
+{
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (long)(ms % 1000) * 1000000;
+  nanosleep(&ts, NULL);
+}
+
+void
+nfc_retry_start(nfc_device *pnd, struct nfc_retry_state *prs)
+{
+  prs->uiAttempts = 0;
+  prs->uiBackoffMs = pnd->retry_policy.backoff_ms;
+  if (pnd->retry_policy.host_retries)
+    gettimeofday(&prs->tvStart, NULL);
+}
+
+/*
+ * Called by HAL_RETRY() after each attempt, with its result. Returns true
+ * after waiting the backoff when the call has to be made again. The device
+ * lock taken by HAL_RETRY() is released during the backoff; when another
+ * thread used the device meanwhile, the call is not retried and keeps its
+ * error.
+ */
+bool
+nfc_retry_next(nfc_device *pnd, struct nfc_retry_state *prs, const int res)
+{
+  const nfc_retry_policy *pnrp = &pnd->retry_policy;
+
+  if (!pnrp->host_retries)
+    return false;
+  if (res >= 0) {
+    pnd->uiRetryCredit = MIN(pnd->uiRetryCredit + pnrp->credit_percent, NFC_RETRY_CREDIT_MAX);
+    return false;
+  }
+  // Only RF transmission errors may go away by themselves
+  if ((res != NFC_ERFTRANS) || (prs->uiAttempts >= pnrp->host_retries))
+    return false;
+  if (pnd->uiRetryCredit < 100) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "No retry credit left, giving up");
+    return false;
+  }
+  if (pnrp->budget_ms && (nfc_retry_elapsed_ms(&prs->tvStart) + prs->uiBackoffMs > pnrp->budget_ms))
+    return false;
+
+  pnd->uiRetryCredit -= 100;
+  prs->uiAttempts++;
+  if (prs->uiBackoffMs) {
+    // Waits between half and all of the backoff, so that readers hit together do not retry together
+    pnd->ui32RetrySeed ^= pnd->ui32RetrySeed << 13;
+    pnd->ui32RetrySeed ^= pnd->ui32RetrySeed >> 17;
+    pnd->ui32RetrySeed ^= pnd->ui32RetrySeed << 5;
+    const unsigned int uiSleepMs = prs->uiBackoffMs / 2 + pnd->ui32RetrySeed % (prs->uiBackoffMs / 2 + 1);
+    prs->uiBackoffMs = MIN(prs->uiBackoffMs * 2, MAX(pnrp->backoff_max_ms, pnrp->backoff_ms));
+    // The device is released during the backoff, but the call is only retried
+    // if no other thread took it meanwhile: the chip and target states it
+    // relies on would be gone. Taking the device back counts once.
+    const unsigned int uiGeneration = pnd->uiLockGeneration;
+    nfc_device_unlock(pnd);
+    nfc_retry_sleep(uiSleepMs);
+    nfc_device_lock(pnd);
+    if (pnd->uiLockGeneration - uiGeneration > 1) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Device used during the backoff, giving up");
+      pnd->last_error = res;
+      return false;
+    }
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Retry %u of %u", prs->uiAttempts, pnrp->host_retries);
+  return true;
+}
+
+/** @ingroup properties
+ * @brief Set how a device retries failing operations
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnrp \a nfc_retry_policy struct pointer holding the new policy
+ *
+ * Chip-level retries are sent to the chip before its next select or exchange.
+ * Host-level retries apply to nfc_initiator_select_passive_target(),
+ * nfc_initiator_select_dep_target() and nfc_initiator_transceive_bytes().
+ * @note Retried exchanges may reach the target twice: only enable host retries
+ * for commands the target can safely run again.
+ */
+int
+nfc_device_set_retry_policy(nfc_device *pnd, const nfc_retry_policy *pnrp)
+{
+  nfc_device_lock(pnd);
+  pnd->retry_policy = *pnrp;
+  pnd->uiRetryGeneration++;
+  pnd->uiRetryCredit = NFC_RETRY_CREDIT_MAX;
+  nfc_device_unlock(pnd);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup properties
+ * @brief Get the retry policy of a device
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pnrp \a nfc_retry_policy struct pointer where the policy will be copied
+ */
+int
+nfc_device_get_retry_policy(const nfc_device *pnd, nfc_retry_policy *pnrp)
+{
+  *pnrp = pnd->retry_policy;
+  return NFC_SUCCESS;
+}
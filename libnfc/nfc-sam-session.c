@@ -0,0 +1,179 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-sam-session.c
+ * @brief Keep a wired secure element selected across the steps of a transaction
+ *
+ * A PN532 reaches either its SAM (wired card mode) or the RF field, never both
+ * at once. Going through nfc_initiator_init_secure_element() and
+ * nfc_initiator_init() at each step also drops the field, sets every device
+ * property again and runs the anti-collision to find the SAM. A session only
+ * sends the mode change when the other side is needed, and selects the SAM
+ * again by the UID found when it was opened. Whichever side is left loses its
+ * carrier, so the SAM, as the targets in the field, has to be selected again
+ * after each switch: nothing is sent to deselect it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+struct nfc_sam_session {
+  nfc_device *pnd;
+  nfc_target ntSam;
+  // The device is in wired card mode with the SAM selected
+  bool bOnSam;
+};
+
+// Switch the device between its SAM and the RF field, without resetting its properties
+static int
+sam_session_switch(nfc_sam_session *pss, const bool bOnSam)
+{
+  nfc_device *pnd = pss->pnd;
+  int res;
+
+  if (pss->bOnSam == bOnSam)
+    return NFC_SUCCESS;
+  nfc_device_lock(pnd);
+  pnd->last_error = 0;
+  res = bOnSam ? NFC_DRIVER(pnd)->initiator_init_secure_element(pnd) : NFC_DRIVER(pnd)->initiator_init(pnd);
+  nfc_device_unlock(pnd);
+  if (res < 0)
+    return res;
+  pss->bOnSam = bOnSam;
+  if (bOnSam && ((res = nfc_initiator_reactivate_target(pnd, &pss->ntSam)) <= 0)) {
+    pss->bOnSam = false;
+    return (res < 0) ? res : NFC_ENOTSUCHDEV;
+  }
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Select the secure element of a device and start a session with it
+ * @return Returns the session, or \e NULL on error (see nfc_device_get_last_error())
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * The device is left in wired card mode with the SAM selected. Until
+ * nfc_sam_session_close(), switch sides with nfc_sam_session_run() and
+ * nfc_sam_session_select_target() rather than nfc_initiator_init() and
+ * nfc_initiator_init_secure_element().
+ */
+nfc_sam_session *
+nfc_sam_session_open(nfc_device *pnd)
+{
+  const nfc_modulation nmSam = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  nfc_sam_session *pss;
+  int res;
+
+  if (NFC_DRIVER(pnd)->initiator_init_secure_element == NULL) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return NULL;
+  }
+  if ((pss = calloc(1, sizeof(nfc_sam_session))) == NULL) {
+    pnd->last_error = NFC_ESOFT;
+    return NULL;
+  }
+  pss->pnd = pnd;
+  if ((res = nfc_initiator_init_secure_element(pnd)) >= 0)
+    res = nfc_initiator_select_passive_target(pnd, nmSam, NULL, 0, &pss->ntSam);
+  if (res <= 0) {
+    pnd->last_error = (res < 0) ? res : NFC_ENOTSUCHDEV;
+    free(pss);
+    return NULL;
+  }
+  pss->bOnSam = true;
+  return pss;
+}
+
+/** @ingroup initiator
+ * @brief Run an APDU script against the secure element of a session
+ * @return Same as nfc_apdu_script_run()
+ *
+ * @param pss session opened by nfc_sam_session_open()
+ * @param pas script loaded by nfc_apdu_script_load()
+ * @param timeout in milliseconds, applied to each APDU
+ *
+ * The device goes back to its SAM only if a target was selected since the
+ * previous script. Scripts run back to back (e.g. the key diversifications
+ * of a batch of cards whose UIDs are already known) thus share one switch,
+ * and the APDUs of each script are pipelined with nfc_batch_commit().
+ */
+int
+nfc_sam_session_run(nfc_sam_session *pss, nfc_apdu_script *pas, int timeout)
+{
+  int res;
+
+  if ((res = sam_session_switch(pss, true)) < 0)
+    return res;
+  return nfc_apdu_script_run(pss->pnd, pas, timeout);
+}
+
+/** @ingroup initiator
+ * @brief Select a target in the field during a session
+ * @return Same as nfc_initiator_select_passive_target()
+ *
+ * @param pss session opened by nfc_sam_session_open()
+ *
+ * The device leaves its SAM for the RF field. The selected target is
+ * then used as usual, e.g. with nfc_apdu_script_run() or
+ * nfc_initiator_transceive_bytes(), until the next nfc_sam_session_run().
+ * The field goes off while the SAM is used, so a target has to be selected
+ * again (with its UID as \a pbtInitData, to wake it up) after each script.
+ */
+int
+nfc_sam_session_select_target(nfc_sam_session *pss, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt)
+{
+  int res;
+
+  if ((res = sam_session_switch(pss, false)) < 0)
+    return res;
+  return nfc_initiator_select_passive_target(pss->pnd, nm, pbtInitData, szInitData, pnt);
+}
+
+/** @ingroup initiator
+ * @brief End a session and set the device back as a plain initiator
+ * @return Same as nfc_initiator_init()
+ *
+ * @param pss session opened by nfc_sam_session_open(), can be \e NULL
+ */
+int
+nfc_sam_session_close(nfc_sam_session *pss)
+{
+  if (pss == NULL)
+    return NFC_SUCCESS;
+  nfc_device *pnd = pss->pnd;
+  nfc_initiator_deselect_target(pnd);
+  free(pss);
+  return nfc_initiator_init(pnd);
+}
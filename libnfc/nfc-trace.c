@@ -0,0 +1,251 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-trace.c
+ * @brief Binary (pcapng) capture of the frames exchanged with a NFC device
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+// pcapng block types
+#define PCAPNG_SHB             0x0A0D0D0A
+#define PCAPNG_IDB             0x00000001
+#define PCAPNG_EPB             0x00000006
+#define PCAPNG_BYTE_ORDER      0x1A2B3C4D
+
+// pcapng options
+#define PCAPNG_OPT_ENDOFOPT    0
+#define PCAPNG_OPT_IF_NAME     2
+#define PCAPNG_OPT_IF_DESC     3
+#define PCAPNG_OPT_EPB_FLAGS   2
+#define PCAPNG_EPB_INBOUND     0x1
+#define PCAPNG_EPB_OUTBOUND    0x2
+
+// Frames are raw PN53x commands/answers (command code first), there is no
+// registered link type for them.
+#define PCAPNG_LINKTYPE_USER0  147
+
+#define PCAPNG_PAD(x) (((x) + 3) & ~((size_t) 3))
+
+static const uint8_t abtPadding[4] = { 0x00, 0x00, 0x00, 0x00 };
+
+static void
+pcapng_put_u16(uint8_t *pbt, const uint16_t u16)
+{
+  memcpy(pbt, &u16, sizeof(u16));
+}
+
+static void
+pcapng_put_u32(uint8_t *pbt, const uint32_t u32)
+{
+  memcpy(pbt, &u32, sizeof(u32));
+}
+
+static void
+pcapng_write_string_option(FILE *f, const uint16_t code, const char *pcValue)
+{
+  const size_t szValue = strlen(pcValue);
+  uint8_t abtHeader[4];
+
+  pcapng_put_u16(abtHeader, code);
+  pcapng_put_u16(abtHeader + 2, (uint16_t) szValue);
+  fwrite(abtHeader, sizeof(abtHeader), 1, f);
+  fwrite(pcValue, szValue, 1, f);
+  fwrite(abtPadding, PCAPNG_PAD(szValue) - szValue, 1, f);
+}
+
+static void
+pcapng_write_section_header(FILE *f)
+{
+  uint8_t abtShb[28];
+  pcapng_put_u32(abtShb, PCAPNG_SHB);
+  pcapng_put_u32(abtShb + 4, sizeof(abtShb));
+  pcapng_put_u32(abtShb + 8, PCAPNG_BYTE_ORDER);
+  pcapng_put_u16(abtShb + 12, 1); // major version
+  pcapng_put_u16(abtShb + 14, 0); // minor version
+  memset(abtShb + 16, 0xff, 8);   // unspecified section length
+  pcapng_put_u32(abtShb + 24, sizeof(abtShb));
+  fwrite(abtShb, sizeof(abtShb), 1, f);
+}
+
+static void
+pcapng_write_interface(FILE *f, const nfc_device *pnd)
+{
+  const size_t szName = strlen(pnd->connstring);
+  // Drivers' scan() may exchange frames before pnd->driver is set
+  const char *pcDesc = pnd->driver ? pnd->driver->name : "";
+  const size_t szDesc = strlen(pcDesc);
+  const uint32_t ui32IdbLen = 16 + 4 + PCAPNG_PAD(szName) + 4 + PCAPNG_PAD(szDesc) + 4 + 4;
+  uint8_t abtIdb[16];
+  pcapng_put_u32(abtIdb, PCAPNG_IDB);
+  pcapng_put_u32(abtIdb + 4, ui32IdbLen);
+  pcapng_put_u16(abtIdb + 8, PCAPNG_LINKTYPE_USER0);
+  pcapng_put_u16(abtIdb + 10, 0);
+  pcapng_put_u32(abtIdb + 12, 0); // no snapshot length limit
+  fwrite(abtIdb, sizeof(abtIdb), 1, f);
+  pcapng_write_string_option(f, PCAPNG_OPT_IF_NAME, pnd->connstring);
+  pcapng_write_string_option(f, PCAPNG_OPT_IF_DESC, pcDesc);
+  uint8_t abtTrailer[8];
+  pcapng_put_u32(abtTrailer, PCAPNG_OPT_ENDOFOPT);
+  pcapng_put_u32(abtTrailer + 4, ui32IdbLen);
+  fwrite(abtTrailer, sizeof(abtTrailer), 1, f);
+}
+
+void
+nfc_trace_frame(nfc_device *pnd, const bool bOutbound, const uint8_t *pbtFrame, const size_t szFrame)
+{
+  struct nfc_trace_file *ptf = pnd->trace;
+  FILE *f = ptf->f;
+  pthread_mutex_lock(&ptf->lock);
+  // The interface needs pnd->driver, which is not known yet when capture starts from nfc_device_new()
+  if (!pnd->bTraceStarted) {
+    pcapng_write_interface(f, pnd);
+    pnd->uiTraceInterface = ptf->uiInterfaces++;
+    pnd->bTraceStarted = true;
+  }
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  const uint64_t ui64Timestamp = ((uint64_t) tv.tv_sec * 1000000) + tv.tv_usec;
+
+  // Enhanced Packet Block: header, data, epb_flags option, end of options, trailer
+  const uint32_t ui32Len = 28 + PCAPNG_PAD(szFrame) + 8 + 4 + 4;
+  uint8_t abtHeader[28];
+  pcapng_put_u32(abtHeader, PCAPNG_EPB);
+  pcapng_put_u32(abtHeader + 4, ui32Len);
+  pcapng_put_u32(abtHeader + 8, pnd->uiTraceInterface);
+  pcapng_put_u32(abtHeader + 12, (uint32_t)(ui64Timestamp >> 32));
+  pcapng_put_u32(abtHeader + 16, (uint32_t) ui64Timestamp);
+  pcapng_put_u32(abtHeader + 20, (uint32_t) szFrame);
+  pcapng_put_u32(abtHeader + 24, (uint32_t) szFrame);
+
+  uint8_t abtTrailer[16];
+  pcapng_put_u16(abtTrailer, PCAPNG_OPT_EPB_FLAGS);
+  pcapng_put_u16(abtTrailer + 2, 4);
+  pcapng_put_u32(abtTrailer + 4, bOutbound ? PCAPNG_EPB_OUTBOUND : PCAPNG_EPB_INBOUND);
+  pcapng_put_u32(abtTrailer + 8, PCAPNG_OPT_ENDOFOPT);
+  pcapng_put_u32(abtTrailer + 12, ui32Len);
+
+  fwrite(abtHeader, sizeof(abtHeader), 1, f);
+  fwrite(pbtFrame, szFrame, 1, f);
+  fwrite(abtPadding, PCAPNG_PAD(szFrame) - szFrame, 1, f);
+  fwrite(abtTrailer, sizeof(abtTrailer), 1, f);
+  // Keep the capture usable if the application dies
+  fflush(f);
+  pthread_mutex_unlock(&ptf->lock);
+}
+
+// Opens pcFilename with fopen() mode pcMode and starts a new section in it
+struct nfc_trace_file *
+nfc_trace_file_open(const char *pcFilename, const char *pcMode)
+{
+  struct nfc_trace_file *ptf = malloc(sizeof(*ptf));
+  if (ptf == NULL)
+    return NULL;
+  if ((ptf->f = fopen(pcFilename, pcMode)) == NULL) {
+    free(ptf);
+    return NULL;
+  }
+  ptf->uiInterfaces = 0;
+  pthread_mutex_init(&ptf->lock, NULL);
+  pcapng_write_section_header(ptf->f);
+  fflush(ptf->f);
+  return ptf;
+}
+
+void
+nfc_trace_file_close(struct nfc_trace_file *ptf)
+{
+  if (ptf) {
+    fclose(ptf->f);
+    pthread_mutex_destroy(&ptf->lock);
+    free(ptf);
+  }
+}
+
+int
+nfc_trace_open(nfc_device *pnd, const char *pcFilename)
+{
+  struct nfc_trace_file *ptf = nfc_trace_file_open(pcFilename, "wb");
+  if (ptf == NULL)
+    return NFC_ESOFT;
+  pnd->trace = ptf;
+  pnd->bTraceOwned = true;
+  pnd->bTraceStarted = false;
+  return NFC_SUCCESS;
+}
+
+void
+nfc_trace_close(nfc_device *pnd)
+{
+  if (pnd->trace && pnd->bTraceOwned)
+    nfc_trace_file_close(pnd->trace);
+  pnd->trace = NULL;
+  pnd->bTraceOwned = false;
+}
+
+/** @ingroup dev
+ * @brief Capture the frames exchanged with a NFC device into a pcapng file
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pcFilename path of the capture file (truncated if it exists), or \e NULL to stop capturing
+ *
+ * Each PN53x command and answer is stored, without bus framing, as a packet
+ * timestamped with microsecond resolution and flagged outbound (to the chip)
+ * or inbound. The capture uses the LINKTYPE_USER0 link type and names the
+ * interface after the device connstring and driver.
+ * The capture file is closed by nfc_close().
+ *
+ * @note To also capture the frames exchanged while the device is opened, set
+ * the \e LIBNFC_TRACE_FILE environment variable before calling nfc_init().
+ * That file is appended to, and holds an interface per device of the context,
+ * scan probes included.
+ */
+int
+nfc_device_set_trace(nfc_device *pnd, const char *pcFilename)
+{
+  nfc_trace_close(pnd);
+  if (pcFilename == NULL)
+    return NFC_SUCCESS;
+
+  if (nfc_trace_open(pnd, pcFilename) < 0) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  return NFC_SUCCESS;
+}
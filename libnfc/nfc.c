@@ -49,6 +49,10 @@
  * @defgroup target  NFC target
  * This page details how to act as tag (i.e. MIFARE Classic) or NFC target device.
  */
+/**
+ * @defgroup dep  NFC D.E.P. streaming
+ * This page details how to exchange payloads larger than a frame with a D.E.P. peer.
+ */
 /**
  * @defgroup error  Error reporting
  * Most libnfc functions return 0 on success or one of error codes defined on failure.
@@ -81,9 +85,15 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined (DRIVER_PLUGINS)
+#  include <dlfcn.h>
+#  include <limits.h>
+#endif /* DRIVER_PLUGINS */
+
 #include <nfc/nfc.h>
 
 #include "nfc-internal.h"
+#include "conf.h"
 #include "target-subr.h"
 #include "drivers.h"
 
@@ -119,6 +129,22 @@
 #  include "drivers/pn532_i2c.h"
 #endif /* DRIVER_PN532_I2C_ENABLED */
 
+#if defined (DRIVER_REPLAY_ENABLED)
+#  include "drivers/replay.h"
+#endif /* DRIVER_REPLAY_ENABLED */
+
+#if defined (DRIVER_SIM_ENABLED)
+#  include "drivers/sim.h"
+#endif /* DRIVER_SIM_ENABLED */
+
+#if defined (DRIVER_TCP_ENABLED)
+#  include "drivers/tcp.h"
+#endif /* DRIVER_TCP_ENABLED */
+
+#if defined (DRIVER_NFCD_ENABLED)
+#  include "drivers/nfcd.h"
+#endif /* DRIVER_NFCD_ENABLED */
+
 
 #define LOG_CATEGORY "libnfc.general"
 #define LOG_GROUP    NFC_LOG_GROUP_GENERAL
@@ -128,62 +154,191 @@ struct nfc_driver_list {
   const struct nfc_driver *driver;
 };
 
+// Registry of drivers, shared by all contexts: looked up by every
+// nfc_open()/nfc_list_devices(), written only by nfc_register_driver() and
+// when the last context is released.
 const struct nfc_driver_list *nfc_drivers = NULL;
+static pthread_rwlock_t nfc_drivers_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned int nfc_contexts_count = 0;
+
+static int
+nfc_register_driver_locked(const struct nfc_driver *ndr)
+{
+  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
+  if (!pndl)
+    return NFC_ESOFT;
+
+  pndl->driver = ndr;
+  pndl->next = nfc_drivers;
+  nfc_drivers = pndl;
+
+  return NFC_SUCCESS;
+}
+
+#if defined (DRIVER_PLUGINS)
+/*
+ * Drivers built as plugins, so that libusb or pcsclite are only loaded by the
+ * processes that use them. A plugin exports the driver as <name>_driver and
+ * is kept loaded once opened, the driver registry may refer to it.
+ */
+struct nfc_driver_plugin {
+  const char *name;
+  const char *module;
+  scan_type_enum scan_type;
+  void *handle;
+  bool bRegistered;
+  bool bFailed;
+};
+
+static struct nfc_driver_plugin nfc_driver_plugins[] = {
+#if defined (DRIVER_PN53X_USB_PLUGIN)
+  { "pn53x_usb", "nfc_usb", NOT_INTRUSIVE, NULL, false, false },
+#endif /* DRIVER_PN53X_USB_PLUGIN */
+#if defined (DRIVER_ACR122_PCSC_PLUGIN)
+  { "acr122_pcsc", "nfc_pcsc", NOT_INTRUSIVE, NULL, false, false },
+#endif /* DRIVER_ACR122_PCSC_PLUGIN */
+#if defined (DRIVER_ACR122_USB_PLUGIN)
+  { "acr122_usb", "nfc_usb", NOT_INTRUSIVE, NULL, false, false },
+#endif /* DRIVER_ACR122_USB_PLUGIN */
+};
+
+// Must be called with nfc_drivers_lock held for writing
+static void
+nfc_driver_plugin_register(struct nfc_driver_plugin *pndp)
+{
+  if (!pndp->handle) {
+    const char *pcDir = LIBNFC_PLUGINDIR;
+#ifdef ENVVARS
+    const char *envvar = getenv("LIBNFC_PLUGIN_DIR");
+    if (envvar)
+      pcDir = envvar;
+#endif // ENVVARS
+    char acPath[PATH_MAX];
+    snprintf(acPath, sizeof(acPath), "%s/%s%s", pcDir, pndp->module, NFC_PLUGIN_SUFFIX);
+    pndp->handle = dlopen(acPath, RTLD_NOW | RTLD_LOCAL);
+    if (!pndp->handle) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to load %s driver: %s", pndp->name, dlerror());
+      pndp->bFailed = true;
+      return;
+    }
+  }
+  char acSymbol[64];
+  snprintf(acSymbol, sizeof(acSymbol), "%s_driver", pndp->name);
+  const struct nfc_driver *ndr = dlsym(pndp->handle, acSymbol);
+  if (!ndr) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s does not provide %s", pndp->module, acSymbol);
+    pndp->bFailed = true;
+    return;
+  }
+  if (nfc_register_driver_locked(ndr) == NFC_SUCCESS) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s driver loaded from %s", pndp->name, pndp->module);
+    pndp->bRegistered = true;
+  }
+}
+
+static bool
+nfc_driver_plugin_wanted(const nfc_context *context, const struct nfc_driver_plugin *pndp, const char *connstring)
+{
+  if (pndp->bRegistered || pndp->bFailed)
+    return false;
+  if (connstring) {
+    const size_t szName = strlen(pndp->name);
+    // "usb" is handled by any *_usb driver
+    return (strncmp(pndp->name, connstring, szName) == 0) ||
+           ((strncmp("usb", connstring, strlen("usb")) == 0) && (szName > 4) && (strcmp("_usb", pndp->name + szName - 4) == 0));
+  }
+  return context->allow_autoscan &&
+         ((pndp->scan_type == NOT_INTRUSIVE) || (context->allow_intrusive_scan && (pndp->scan_type == INTRUSIVE)));
+}
+
+// Loads the plugins needed to open connstring, or to scan if it is NULL
+static void
+nfc_drivers_load(const nfc_context *context, const char *connstring)
+{
+  pthread_rwlock_wrlock(&nfc_drivers_lock);
+  for (size_t n = 0; n < sizeof(nfc_driver_plugins) / sizeof(nfc_driver_plugins[0]); n++) {
+    struct nfc_driver_plugin *pndp = &nfc_driver_plugins[n];
+    if (nfc_driver_plugin_wanted(context, pndp, connstring))
+      nfc_driver_plugin_register(pndp);
+  }
+  pthread_rwlock_unlock(&nfc_drivers_lock);
+}
 
+// Must be called with nfc_drivers_lock held for writing, once the registry is emptied
+static void
+nfc_driver_plugins_reset(void)
+{
+  for (size_t n = 0; n < sizeof(nfc_driver_plugins) / sizeof(nfc_driver_plugins[0]); n++)
+    nfc_driver_plugins[n].bRegistered = nfc_driver_plugins[n].bFailed = false;
+}
+#else
+#  define nfc_drivers_load(context, connstring) do {} while (0)
+#endif /* DRIVER_PLUGINS */
+
+// Must be called with nfc_drivers_lock held for writing
 static void
 nfc_drivers_init(void)
 {
 #if defined (DRIVER_PN53X_USB_ENABLED)
-  nfc_register_driver(&pn53x_usb_driver);
+  nfc_register_driver_locked(&pn53x_usb_driver);
 #endif /* DRIVER_PN53X_USB_ENABLED */
 #if defined (DRIVER_ACR122_PCSC_ENABLED)
-  nfc_register_driver(&acr122_pcsc_driver);
+  nfc_register_driver_locked(&acr122_pcsc_driver);
 #endif /* DRIVER_ACR122_PCSC_ENABLED */
 #if defined (DRIVER_ACR122_USB_ENABLED)
-  nfc_register_driver(&acr122_usb_driver);
+  nfc_register_driver_locked(&acr122_usb_driver);
 #endif /* DRIVER_ACR122_USB_ENABLED */
 #if defined (DRIVER_ACR122S_ENABLED)
-  nfc_register_driver(&acr122s_driver);
+  nfc_register_driver_locked(&acr122s_driver);
 #endif /* DRIVER_ACR122S_ENABLED */
 #if defined (DRIVER_PN532_UART_ENABLED)
-  nfc_register_driver(&pn532_uart_driver);
+  nfc_register_driver_locked(&pn532_uart_driver);
 #endif /* DRIVER_PN532_UART_ENABLED */
 #if defined (DRIVER_PN532_SPI_ENABLED)
-  nfc_register_driver(&pn532_spi_driver);
+  nfc_register_driver_locked(&pn532_spi_driver);
 #endif /* DRIVER_PN532_SPI_ENABLED */
 #if defined (DRIVER_PN532_I2C_ENABLED)
-  nfc_register_driver(&pn532_i2c_driver);
+  nfc_register_driver_locked(&pn532_i2c_driver);
 #endif /* DRIVER_PN532_I2C_ENABLED */
 #if defined (DRIVER_ARYGON_ENABLED)
-  nfc_register_driver(&arygon_driver);
+  nfc_register_driver_locked(&arygon_driver);
 #endif /* DRIVER_ARYGON_ENABLED */
+#if defined (DRIVER_REPLAY_ENABLED)
+  nfc_register_driver_locked(&replay_driver);
+#endif /* DRIVER_REPLAY_ENABLED */
+#if defined (DRIVER_SIM_ENABLED)
+  nfc_register_driver_locked(&sim_driver);
+#endif /* DRIVER_SIM_ENABLED */
+#if defined (DRIVER_TCP_ENABLED)
+  nfc_register_driver_locked(&tcp_driver);
+#endif /* DRIVER_TCP_ENABLED */
+#if defined (DRIVER_NFCD_ENABLED)
+  nfc_register_driver_locked(&nfcd_driver);
+#endif /* DRIVER_NFCD_ENABLED */
 }
 
-static int
-nfc_device_validate_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation *nm);
-
 /** @ingroup lib
  * @brief Register an NFC device driver with libnfc.
  * This function registers a driver with libnfc, the caller is responsible of managing the lifetime of the
  * driver and make sure that any resources associated with the driver are available after registration.
  * @param pnd Pointer to an NFC device driver to be registered.
  * @retval NFC_SUCCESS If the driver registration succeeds.
+ * @retval NFC_ENOTIMPL If libnfc was built for a single driver.
  */
 int
 nfc_register_driver(const struct nfc_driver *ndr)
 {
   if (!ndr)
     return NFC_EINVARG;
-
-  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
-  if (!pndl)
-    return NFC_ESOFT;
-
-  pndl->driver = ndr;
-  pndl->next = nfc_drivers;
-  nfc_drivers = pndl;
-
-  return NFC_SUCCESS;
+#if defined (NFC_SINGLE_DRIVER)
+  // Devices of another driver would be dispatched to the built-in one
+  return NFC_ENOTIMPL;
+#else
+  pthread_rwlock_wrlock(&nfc_drivers_lock);
+  int res = nfc_register_driver_locked(ndr);
+  pthread_rwlock_unlock(&nfc_drivers_lock);
+  return res;
+#endif /* NFC_SINGLE_DRIVER */
 }
 
 /** @ingroup lib
@@ -194,32 +349,110 @@ nfc_register_driver(const struct nfc_driver *ndr)
 void
 nfc_init(nfc_context **context)
 {
-  *context = nfc_context_new();
+  nfc_init_with_config(context, NULL, 0);
+}
+
+/** @ingroup lib
+ * @brief Initialize libnfc from a compiled configuration.
+ * Same as nfc_init() but options and user defined devices come from \a pbtConfig
+ * instead of the configuration files, so that no file system access is made.
+ * @param context Output location for nfc_context
+ * @param pbtConfig configuration returned by nfc_config_build(), NULL to read the configuration files
+ * @param szConfig length of \a pbtConfig
+ *
+ * Environment variables still override the configuration.
+ */
+void
+nfc_init_with_config(nfc_context **context, const uint8_t *pbtConfig, const size_t szConfig)
+{
+  *context = nfc_context_new(pbtConfig, szConfig);
   if (!*context) {
     perror("malloc");
     return;
   }
+  pthread_rwlock_wrlock(&nfc_drivers_lock);
   if (!nfc_drivers)
     nfc_drivers_init();
+  nfc_contexts_count++;
+  pthread_rwlock_unlock(&nfc_drivers_lock);
+}
+
+/** @ingroup lib
+ * @brief Compile the configuration files.
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param[out] ppbtConfig compiled configuration, to be freed with nfc_free()
+ * @param[out] pszConfig length of \a ppbtConfig
+ *
+ * The result can be handed to nfc_init_with_config(), e.g. by a parent process
+ * to its short-lived workers, or saved to a file. The files are only parsed
+ * again when they changed since the previous compilation in this process,
+ * which nfc_init() takes advantage of as well.
+ */
+int
+nfc_config_build(uint8_t **ppbtConfig, size_t *pszConfig)
+{
+#ifdef CONFFILES
+  return conf_build(ppbtConfig, pszConfig);
+#else
+  (void) ppbtConfig;
+  (void) pszConfig;
+  return NFC_ENOTIMPL;
+#endif // CONFFILES
 }
 
 /** @ingroup lib
  * @brief Deinitialize libnfc.
  * Should be called after closing all open devices and before your application terminates.
  * @param context The context to deinitialize
+ *
+ * Registered drivers are released with the last context.
  */
 void
 nfc_exit(nfc_context *context)
 {
-  while (nfc_drivers) {
-    struct nfc_driver_list *pndl = (struct nfc_driver_list *) nfc_drivers;
-    nfc_drivers = pndl->next;
-    free(pndl);
+  // Its thread may be scanning, drivers must still be there
+  nfc_hotplug_stop(context);
+  pthread_rwlock_wrlock(&nfc_drivers_lock);
+  if ((nfc_contexts_count == 0) || (--nfc_contexts_count == 0)) {
+    while (nfc_drivers) {
+      struct nfc_driver_list *pndl = (struct nfc_driver_list *) nfc_drivers;
+      nfc_drivers = pndl->next;
+      free(pndl);
+    }
+#if defined (DRIVER_PLUGINS)
+    nfc_driver_plugins_reset();
+#endif /* DRIVER_PLUGINS */
   }
+  pthread_rwlock_unlock(&nfc_drivers_lock);
 
   nfc_context_free(context);
 }
 
+/** @ingroup lib
+ * @brief Change the log level at runtime.
+ * @param log_level New log level, using the same encoding as LIBNFC_LOG_LEVEL
+ *
+ * The log level is process-wide: it applies to every context and may be
+ * changed while other threads use devices. Each nfc_init() sets it from the
+ * configuration files and LIBNFC_LOG_LEVEL, parsed once; once this function
+ * was called, contexts created afterwards no longer change it.
+ */
+void
+nfc_set_log_level(const uint32_t log_level)
+{
+  log_set_level(log_level);
+}
+
+/** @ingroup lib
+ * @brief Get the current log level.
+ * @return Returns the process-wide log level in effect, 0 when libnfc is built without logging
+ */
+uint32_t
+nfc_get_log_level(void)
+{
+  return log_get_level();
+}
+
 /** @ingroup dev
  * @brief Open a NFC device
  * @param context The context to operate on.
@@ -229,6 +462,7 @@ nfc_exit(nfc_context *context)
  * If \e connstring is \c NULL, the first available device from \a nfc_list_devices function is used.
  *
  * If \e connstring is set, this function will try to claim the right device using information provided by \e connstring.
+ * The name of a user defined device (see nfc_context_add_device()) is also accepted.
  *
  * When it has successfully claimed a NFC device, memory is allocated to save the device information.
  * It will return a pointer to a \a nfc_device struct.
@@ -247,12 +481,15 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
     if (!nfc_list_devices(context, &ncs, 1)) {
       return NULL;
     }
-  } else {
+  } else if (!nfc_registry_get_connstring(&context->registry, connstring, ncs)) {
     strncpy(ncs, connstring, sizeof(nfc_connstring));
     ncs[sizeof(nfc_connstring) - 1] = '\0';
   }
 
+  nfc_drivers_load(context, ncs);
+
   // Search through the device list for an available device
+  pthread_rwlock_rdlock(&nfc_drivers_lock);
   const struct nfc_driver_list *pndl = nfc_drivers;
   while (pndl) {
     const struct nfc_driver *ndr = pndl->driver;
@@ -274,19 +511,20 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
         pndl = pndl->next;
         continue;
       }
+      pthread_rwlock_unlock(&nfc_drivers_lock);
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to open \"%s\".", ncs);
       return NULL;
     }
-    for (uint32_t i = 0; i < context->user_defined_device_count; i++) {
-      if (strcmp(ncs, context->user_defined_devices[i].connstring) == 0) {
-        // This is a device sets by user, we use the device name given by user
-        strcpy(pnd->name, context->user_defined_devices[i].name);
-        break;
-      }
-    }
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" (%s) has been claimed.", pnd->name, pnd->connstring);
+    // This may be a device sets by user, we use the device name given by user
+    nfc_registry_get_name(&context->registry, ncs, pnd->name, sizeof(pnd->name));
+    pthread_rwlock_unlock(&nfc_drivers_lock);
+    // Not fatal: the driver is then asked each time
+    if (nfc_device_load_capabilities(pnd) < 0)
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Capabilities of \"%s\" not cached.", pnd->connstring);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" (%s) has been claimed.", *pnd->name ? pnd->name : NFC_DRIVER(pnd)->name, pnd->connstring);
     return pnd;
   }
+  pthread_rwlock_unlock(&nfc_drivers_lock);
 
   // Too bad, no driver can decode connstring
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "No driver available to handle \"%s\".", ncs);
@@ -304,82 +542,87 @@ nfc_close(nfc_device *pnd)
 {
   if (pnd) {
     // Close, clean up and release the device
-    pnd->driver->close(pnd);
+    NFC_DRIVER(pnd)->close(pnd);
   }
 }
 
-/** @ingroup dev
- * @brief Scan for discoverable supported devices (ie. only available for some drivers)
- * @return Returns the number of devices found.
- * @param context The context to operate on, or NULL for the default context.
- * @param connstrings array of \a nfc_connstring.
- * @param connstrings_len size of the \a connstrings array.
- *
- */
-size_t
-nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static size_t
+nfc_scan_devices(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
 {
   size_t device_found = 0;
 
-#ifdef CONFFILES
-  // Load manually configured devices (from config file and env variables)
-  // TODO From env var...
-  for (uint32_t i = 0; i < context->user_defined_device_count; i++) {
-    if (context->user_defined_devices[i].optional) {
-      // let's make sure the device exists
-      nfc_device *pnd = NULL;
+  // Load manually configured devices (from config file, env variables and nfc_context_add_device())
+  struct nfc_device_registry *pndr = &context->registry;
+  for (size_t i = 0; device_found < connstrings_len; i++) {
+    // Work on a copy so the registry is not locked while probing
+    nfc_connstring ncs;
+    char acName[DEVICE_NAME_LENGTH] = "";
+    bool bOptional, bPresent;
+    time_t probed_at;
+    pthread_mutex_lock(&pndr->lock);
+    if (i >= pndr->szDevices) {
+      pthread_mutex_unlock(&pndr->lock);
+      break;
+    }
+    const struct nfc_user_defined_device *pudd = &pndr->devices[i];
+    if (!pudd->connstring) {
+      pthread_mutex_unlock(&pndr->lock);
+      continue;
+    }
+    strcpy(ncs, pudd->connstring);
+    if (pudd->name)
+      strcpy(acName, pudd->name);
+    bOptional = pudd->optional;
+    bPresent = pudd->bPresent;
+    probed_at = pudd->probed_at;
+    pthread_mutex_unlock(&pndr->lock);
+
+    if (bOptional) {
+      // let's make sure the device exists, unless it was checked less than discovery_cache_ttl seconds ago
+      const time_t now = time(NULL);
+      if ((context->discovery_cache_ttl == 0) || (probed_at == 0) || (now < probed_at) || ((unsigned int)(now - probed_at) >= context->discovery_cache_ttl)) {
+        // do it silently, without muting the other threads
+        log_mute_thread(true);
+        nfc_device *pnd = nfc_open(context, ncs);
+        log_mute_thread(false);
+
+        bPresent = (pnd != NULL);
+        nfc_close(pnd);
 
-#ifdef ENVVARS
-      char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
-      char *old_env_log_level = NULL;
-      // do it silently
-      if (env_log_level) {
-        if ((old_env_log_level = malloc(strlen(env_log_level) + 1)) == NULL) {
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to malloc()");
-          return 0;
+        // The registry may have changed meanwhile: store the result by connstring
+        pthread_mutex_lock(&pndr->lock);
+        for (size_t n = 0; n < pndr->szDevices; n++) {
+          if (pndr->devices[n].connstring && (strcmp(pndr->devices[n].connstring, ncs) == 0)) {
+            pndr->devices[n].bPresent = bPresent;
+            pndr->devices[n].probed_at = now;
+          }
         }
-        strcpy(old_env_log_level, env_log_level);
+        pthread_mutex_unlock(&pndr->lock);
       }
-      setenv("LIBNFC_LOG_LEVEL", "0", 1);
-#endif // ENVVARS
-
-      pnd = nfc_open(context, context->user_defined_devices[i].connstring);
-
-#ifdef ENVVARS
-      if (old_env_log_level) {
-        setenv("LIBNFC_LOG_LEVEL", old_env_log_level, 1);
-        free(old_env_log_level);
-      } else {
-        unsetenv("LIBNFC_LOG_LEVEL");
-      }
-#endif // ENVVARS
-
-      if (pnd) {
-        nfc_close(pnd);
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "User device %s found", context->user_defined_devices[i].name);
-        strcpy((char *)(connstrings + device_found), context->user_defined_devices[i].connstring);
-        device_found ++;
-        if (device_found == connstrings_len)
-          break;
+      if (bPresent) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "User device %s found", acName);
+        strcpy((char *)(connstrings + device_found), ncs);
+        device_found++;
       }
     } else {
       // manual choice is not marked as optional so let's take it blindly
-      strcpy((char *)(connstrings + device_found), context->user_defined_devices[i].connstring);
+      strcpy((char *)(connstrings + device_found), ncs);
       device_found++;
-      if (device_found >= connstrings_len)
-        return device_found;
     }
   }
-#endif // CONFFILES
+  if (device_found >= connstrings_len)
+    return device_found;
 
   // Device auto-detection
   if (context->allow_autoscan) {
+    nfc_drivers_load(context, NULL);
+    pthread_rwlock_rdlock(&nfc_drivers_lock);
     const struct nfc_driver_list *pndl = nfc_drivers;
     while (pndl) {
       const struct nfc_driver *ndr = pndl->driver;
       if ((ndr->scan_type == NOT_INTRUSIVE) || ((context->allow_intrusive_scan) && (ndr->scan_type == INTRUSIVE))) {
         size_t _device_found = ndr->scan(context, connstrings + (device_found), connstrings_len - (device_found));
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%ld device(s) found using %s driver", (unsigned long) _device_found, ndr->name);
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%lu device(s) found using %s driver", (unsigned long) _device_found, ndr->name);
         if (_device_found > 0) {
           device_found += _device_found;
           if (device_found == connstrings_len)
@@ -388,13 +631,68 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
       } // scan_type is INTRUSIVE but not allowed or NOT_AVAILABLE
       pndl = pndl->next;
     }
-  } else if (context->user_defined_device_count == 0) {
+    pthread_rwlock_unlock(&nfc_drivers_lock);
+  } else if (context->registry.szDevices == 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: %s", "user must specify device(s) manually when autoscan is disabled");
   }
 
   return device_found;
 }
 
+/** @ingroup dev
+ * @brief Scan for discoverable supported devices (ie. only available for some drivers)
+ * @return Returns the number of devices found.
+ * @param context The context to operate on, or NULL for the default context.
+ * @param connstrings array of \a nfc_connstring.
+ * @param connstrings_len size of the \a connstrings array.
+ *
+ * When the \e discovery_cache_ttl option is set, the result of a scan is kept
+ * in \a context for that many seconds and returned without probing again.
+ * @see nfc_list_devices_invalidate
+ */
+size_t
+nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  if (context->discovery_cache_ttl == 0)
+    return nfc_scan_devices(context, connstrings, connstrings_len);
+
+  pthread_mutex_lock(&context->lock);
+  const time_t now = time(NULL);
+  if (!context->cache_valid || (now < context->cached_at) || ((unsigned int)(now - context->cached_at) >= context->discovery_cache_ttl)) {
+    context->cached_device_count = nfc_scan_devices(context, context->cached_connstrings, MAX_CACHED_DEVICES);
+    context->cached_at = now;
+    context->cache_valid = true;
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%lu device(s) found in discovery cache", (unsigned long) context->cached_device_count);
+  }
+
+  const size_t device_found = MIN(context->cached_device_count, connstrings_len);
+  memcpy(connstrings, context->cached_connstrings, device_found * sizeof(nfc_connstring));
+  pthread_mutex_unlock(&context->lock);
+  return device_found;
+}
+
+/** @ingroup dev
+ * @brief Drop the devices cached by nfc_list_devices()
+ * @param context The context to operate on.
+ *
+ * Next call to nfc_list_devices() will scan again, e.g. after a device was plugged or unplugged.
+ */
+void
+nfc_list_devices_invalidate(nfc_context *context)
+{
+  pthread_mutex_lock(&context->lock);
+  context->cache_valid = false;
+  context->cached_device_count = 0;
+  pthread_mutex_unlock(&context->lock);
+
+  // Optional user defined devices are probed again too
+  pthread_mutex_lock(&context->registry.lock);
+  for (size_t n = 0; n < context->registry.szDevices; n++)
+    context->registry.devices[n].probed_at = 0;
+  pthread_mutex_unlock(&context->registry.lock);
+}
+
 /** @ingroup properties
  * @brief Set a device's integer-property value
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -431,6 +729,46 @@ nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const
   HAL(device_set_property_bool, pnd, property, bEnable);
 }
 
+/** @ingroup properties
+ * @brief Set several device's properties at once
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pSettings array of \a nfc_property_setting to apply, in order
+ * @param szSettings number of entries of \a pSettings
+ *
+ * Same result as calling nfc_device_set_property_int() or
+ * nfc_device_set_property_bool() for each entry, but the driver may merge
+ * them: only the final state is sent to the device, in as few commands as
+ * possible, and settings the device already holds are skipped.
+ * As a consequence a property listed twice is only applied with its last
+ * value, e.g. the field cannot be cycled within one call.
+ */
+int
+nfc_device_set_properties(nfc_device *pnd, const nfc_property_setting *pSettings, const size_t szSettings)
+{
+  size_t i;
+  int res = 0;
+
+  if (NFC_DRIVER(pnd)->device_set_properties) {
+    HAL(device_set_properties, pnd, pSettings, szSettings);
+  }
+  for (i = 0; i < szSettings; i++) {
+    switch (pSettings[i].property) {
+      case NP_TIMEOUT_COMMAND:
+      case NP_TIMEOUT_ATR:
+      case NP_TIMEOUT_COM:
+        res = nfc_device_set_property_int(pnd, pSettings[i].property, pSettings[i].value);
+        break;
+      default:
+        res = nfc_device_set_property_bool(pnd, pSettings[i].property, pSettings[i].value != 0);
+        break;
+    }
+    if (res < 0)
+      return res;
+  }
+  return NFC_SUCCESS;
+}
+
 /** @ingroup initiator
  * @brief Initialize NFC device as initiator (reader)
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -455,29 +793,26 @@ int
 nfc_initiator_init(nfc_device *pnd)
 {
   int res = 0;
+  const nfc_property_setting settings[] = {
+    // Enable field so more power consuming cards can power themselves up
+    { NP_ACTIVATE_FIELD, true },
+    // Let the device try forever to find a target/tag
+    { NP_INFINITE_SELECT, true },
+    // Activate auto ISO14443-4 switching by default
+    { NP_AUTO_ISO14443_4, true },
+    // Force 14443-A mode
+    { NP_FORCE_ISO14443_A, true },
+    // Force speed at 106kbps
+    { NP_FORCE_SPEED_106, true },
+    // Disallow invalid frame
+    { NP_ACCEPT_INVALID_FRAMES, false },
+    // Disallow multiple frames
+    { NP_ACCEPT_MULTIPLE_FRAMES, false },
+  };
   // Drop the field for a while
   if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0)
     return res;
-  // Enable field so more power consuming cards can power themselves up
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true)) < 0)
-    return res;
-  // Let the device try forever to find a target/tag
-  if ((res = nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, true)) < 0)
-    return res;
-  // Activate auto ISO14443-4 switching by default
-  if ((res = nfc_device_set_property_bool(pnd, NP_AUTO_ISO14443_4, true)) < 0)
-    return res;
-  // Force 14443-A mode
-  if ((res = nfc_device_set_property_bool(pnd, NP_FORCE_ISO14443_A, true)) < 0)
-    return res;
-  // Force speed at 106kbps
-  if ((res = nfc_device_set_property_bool(pnd, NP_FORCE_SPEED_106, true)) < 0)
-    return res;
-  // Disallow invalid frame
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_INVALID_FRAMES, false)) < 0)
-    return res;
-  // Disallow multiple frames
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_MULTIPLE_FRAMES, false)) < 0)
+  if ((res = nfc_device_set_properties(pnd, settings, sizeof(settings) / sizeof(settings[0]))) < 0)
     return res;
   HAL(initiator_init, pnd);
 }
@@ -497,6 +832,13 @@ nfc_initiator_init_secure_element(nfc_device *pnd)
   HAL(initiator_init_secure_element, pnd);
 }
 
+static int
+nfc_initiator_select_passive_target_hal(nfc_device *pnd, const nfc_modulation nm,
+                                        const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt)
+{
+  HAL_RETRY(initiator_select_passive_target, pnd, nm, pbtInitData, szInitData, pnt);
+}
+
 /** @ingroup initiator
  * @brief Select a passive or emulated tag
  * @return Returns selected passive target count on success, otherwise returns libnfc's error code (negative value)
@@ -530,8 +872,12 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
   uint8_t abtTmpInit[MAX(12, szInitData)];
   size_t  szInit = 0;
   int res;
-  if ((res = nfc_device_validate_modulation(pnd, N_INITIATOR, &nm)) != NFC_SUCCESS)
+  NFC_PROBE3(select__start, nm.nmt, nm.nbr, szInitData);
+  if ((res = nfc_device_validate_modulation(pnd, N_INITIATOR, &nm)) != NFC_SUCCESS) {
+    NFC_PROBE2(select__done, nm.nmt, res);
     return res;
+  }
+  pnd->isodep.bActive = false;
   if (szInitData == 0) {
     // Provide default values, if any
     prepare_initiator_data(nm, &abtInit, &szInit);
@@ -544,7 +890,9 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
     szInit = szInitData;
   }
 
-  HAL(initiator_select_passive_target, pnd, nm, abtInit, szInit, pnt);
+  res = nfc_initiator_select_passive_target_hal(pnd, nm, abtInit, szInit, pnt);
+  NFC_PROBE2(select__done, nm.nmt, res);
+  return res;
 }
 
 /** @ingroup initiator
@@ -562,6 +910,15 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
  * communications. The chip needs to know with what kind of tag it is dealing
  * with, therefore the initial modulation and speed (106, 212 or 424 kbps)
  * should be supplied.
+ *
+ * Drivers able to, list several targets per command; otherwise targets are
+ * selected then deselected one after the other. Either way, a target is only
+ * reported once per UID.
+ *
+ * On PN53x devices, FeliCa cards are polled over several timeslots,
+ * ISO14443B PICCs answer REQB slot markers and ST SRx chips go through their
+ * own anticollision, so that several of them can be found even though they
+ * can not be deselected. ISO14443B and SRx targets are left halted.
  */
 int
 nfc_initiator_list_passive_targets(nfc_device *pnd,
@@ -572,6 +929,7 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
   size_t  szTargetFound = 0;
   uint8_t *pbtInitData = NULL;
   size_t  szInitDataLen = 0;
+  struct nfc_target_set ts;
   int res = 0;
 
   pnd->last_error = 0;
@@ -582,21 +940,32 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
     return res;
   }
 
+  if (NFC_DRIVER(pnd)->initiator_list_passive_targets) {
+    nfc_device_lock(pnd);
+    res = NFC_DRIVER(pnd)->initiator_list_passive_targets(pnd, nm, ant, szTargets);
+    nfc_device_unlock(pnd);
+    if (res != NFC_ENOTIMPL) {
+      if (bInfiniteSelect) {
+        int res2;
+        if ((res2 = nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, true)) < 0)
+          return res2;
+      }
+      return res;
+    }
+    // Not for this modulation, select them one by one
+    pnd->last_error = 0;
+  }
+
   prepare_initiator_data(nm, &pbtInitData, &szInitDataLen);
+  nfc_target_set_init(&ts, ant);
 
   while (nfc_initiator_select_passive_target(pnd, nm, pbtInitData, szInitDataLen, &nt) > 0) {
-    size_t i;
-    bool seen = false;
     // Check if we've already seen this tag
-    for (i = 0; i < szTargetFound; i++) {
-      if (memcmp(&(ant[i]), &nt, sizeof(nfc_target)) == 0) {
-        seen = true;
-      }
-    }
-    if (seen) {
+    if (nfc_target_set_contains(&ts, &nt)) {
       break;
     }
     memcpy(&(ant[szTargetFound]), &nt, sizeof(nfc_target));
+    nfc_target_set_add(&ts);
     szTargetFound++;
     if (szTargets == szTargetFound) {
       break;
@@ -617,6 +986,72 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
   return szTargetFound;
 }
 
+/** @ingroup initiator
+ * @brief Inventory ISO14443A tags through a bit level anticollision
+ * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] ant array of \a nfc_target that will be filled with targets info
+ * @param szTargets size of \a ant (will be the max targets listed)
+ *
+ * Unlike nfc_initiator_list_passive_targets(), the anticollision loops are run
+ * by the library in raw mode: each collision splits the UID space in two
+ * branches which are walked one after the other, so that fields with more tags
+ * than the chip resolves by itself are fully listed. Each tag found is halted
+ * (HLTA) and left in that state; targets only carry UID and SAK, plus ATQA
+ * when every tag answered the same. A field too crowded to walk within the
+ * exchange budget of the driver reports the targets found until then, or
+ * NFC_ETIMEOUT if there are none.
+ *
+ * @note The device must have been initialized as initiator. NP_HANDLE_CRC,
+ * NP_HANDLE_PARITY and NP_EASY_FRAMING are restored afterwards.
+ */
+int
+nfc_initiator_inventory_iso14443a(nfc_device *pnd, nfc_target ant[], const size_t szTargets)
+{
+  HAL(initiator_inventory_iso14443a, pnd, ant, szTargets);
+}
+
+/** @ingroup initiator
+ * @brief Select again a target which was selected before
+ * @return Returns selected passive target count on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt \a nfc_target struct pointer filled by a previous select
+ *
+ * This is meant for targets which went halted or idle, e.g. after a failed
+ * MIFARE Classic authentication. When the driver is able to, ISO14443A targets
+ * are woken up (WUPA) and selected straight from their known UID and SAK,
+ * without anticollision nor decoding their information again; \a pnt is then
+ * left untouched. Other targets go through
+ * nfc_initiator_select_passive_target() with their UID and \a pnt is updated.
+ *
+ * Returns 0 if the target did not answer as expected.
+ */
+int
+nfc_initiator_reactivate_target(nfc_device *pnd, nfc_target *pnt)
+{
+  const uint8_t *pbtUid = NULL;
+  size_t szUid = 0;
+  int res;
+
+  pnd->last_error = 0;
+  if (NFC_DRIVER(pnd)->initiator_reactivate_target) {
+    nfc_device_lock(pnd);
+    res = NFC_DRIVER(pnd)->initiator_reactivate_target(pnd, pnt);
+    nfc_device_unlock(pnd);
+    if (res != NFC_ENOTIMPL)
+      return res;
+    pnd->last_error = 0;
+  }
+  // The init data of other modulations is not an UID
+  if (pnt->nm.nmt == NMT_ISO14443A) {
+    pbtUid = pnt->nti.nai.abtUid;
+    szUid = pnt->nti.nai.szUidLen;
+  }
+  return nfc_initiator_select_passive_target(pnd, pnt->nm, pbtUid, szUid, pnt);
+}
+
 /** @ingroup initiator
  * @brief Polling for NFC targets
  * @return Returns polled targets count, otherwise returns libnfc's error code (negative value).
@@ -629,6 +1064,9 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
  * @param uiPeriod indicates the polling period in units of 150 ms (0x01 – 0x0F: 150ms – 2.25s)
  * @note e.g. if uiPeriod=10, it will poll each desired target type during 1.5s
  * @param[out] pnt pointer on \a nfc_target (over)writable struct
+ *
+ * Devices which cannot poll by themselves, or not for all of \a pnmModulations,
+ * are polled by the library as set by nfc_device_set_poll_policy().
  */
 int
 nfc_initiator_poll_target(nfc_device *pnd,
@@ -636,7 +1074,67 @@ nfc_initiator_poll_target(nfc_device *pnd,
                           const uint8_t uiPollNr, const uint8_t uiPeriod,
                           nfc_target *pnt)
 {
-  HAL(initiator_poll_target, pnd, pnmModulations, szModulations, uiPollNr, uiPeriod, pnt);
+  int res = NFC_ENOTIMPL;
+
+  pnd->isodep.bActive = false;
+  nfc_device_lock(pnd);
+  pnd->last_error = 0;
+  if (NFC_DRIVER(pnd)->initiator_poll_target && !pnd->poll_policy.software)
+    res = NFC_DRIVER(pnd)->initiator_poll_target(pnd, pnmModulations, szModulations, uiPollNr, uiPeriod, pnt);
+  if (res == NFC_ENOTIMPL)
+    res = nfc_poll_software(pnd, pnmModulations, szModulations, uiPollNr, uiPeriod, pnt);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Find the targets of several modulations at once
+ * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnmModulations desired modulations
+ * @param szModulations size of \a pnmModulations
+ * @param[out] ant array of \a nfc_target that will be filled with targets info
+ * @param szTargets size of \a ant (will be the max targets listed)
+ *
+ * Devices able to poll several target types in one command do so: PN532
+ * devices send a single InAutoPoll for ISO14443A, ISO14443B, FeliCa and Jewel,
+ * sent again only after a type answered, for the types after it. Other
+ * modulations, and all of them on other devices, are listed one after the
+ * other as nfc_initiator_list_passive_targets() does. Modulations the device
+ * does not support are skipped.
+ *
+ * InAutoPoll reports at most two targets of a type, use
+ * nfc_initiator_list_passive_targets() for a full inventory of a modulation.
+ * No target is left selected.
+ */
+int
+nfc_initiator_discover_targets(nfc_device *pnd,
+                               const nfc_modulation *pnmModulations, const size_t szModulations,
+                               nfc_target ant[], const size_t szTargets)
+{
+  size_t szFound = 0;
+  int res;
+
+  pnd->isodep.bActive = false;
+  if (NFC_DRIVER(pnd)->initiator_discover_targets) {
+    nfc_device_lock(pnd);
+    pnd->last_error = 0;
+    res = NFC_DRIVER(pnd)->initiator_discover_targets(pnd, pnmModulations, szModulations, ant, szTargets);
+    nfc_device_unlock(pnd);
+    if (res != NFC_ENOTIMPL)
+      return res;
+  }
+
+  for (size_t n = 0; (n < szModulations) && (szFound < szTargets); n++) {
+    if ((res = nfc_initiator_list_passive_targets(pnd, pnmModulations[n], ant + szFound, szTargets - szFound)) > 0)
+      szFound += res;
+    else if ((res == NFC_EIO) || (res == NFC_ENOTSUCHDEV))
+      return res;
+  }
+  nfc_initiator_deselect_target(pnd);
+  pnd->last_error = 0;
+  return szFound;
 }
 
 
@@ -665,7 +1163,7 @@ nfc_initiator_select_dep_target(nfc_device *pnd,
                                 const nfc_dep_mode ndm, const nfc_baud_rate nbr,
                                 const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout)
 {
-  HAL(initiator_select_dep_target, pnd, ndm, nbr, pndiInitiator, pnt, timeout);
+  HAL_RETRY(initiator_select_dep_target, pnd, ndm, nbr, pndiInitiator, pnt, timeout);
 }
 
 /** @ingroup initiator
@@ -736,6 +1234,7 @@ end:
 int
 nfc_initiator_deselect_target(nfc_device *pnd)
 {
+  pnd->isodep.bActive = false;
   HAL(initiator_deselect_target, pnd);
 }
 
@@ -771,7 +1270,7 @@ int
 nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
                                const size_t szRx, int timeout)
 {
-  HAL(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout)
+  HAL_RETRY(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
 }
 
 /** @ingroup initiator
@@ -903,6 +1402,191 @@ nfc_initiator_transceive_bits_timed(nfc_device *pnd,
   HAL(initiator_transceive_bits_timed, pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, pbtRxPar, cycles);
 }
 
+/** @ingroup initiator
+ * @brief Start collecting frames to be exchanged in a single batch
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ *
+ * Frames appended with nfc_batch_append() are not sent until nfc_batch_commit()
+ * is called. Any batch previously started but not committed is discarded.
+ */
+int
+nfc_batch_begin(nfc_device *pnd)
+{
+  pnd->szBatchFrames = 0;
+  pnd->bBatch = true;
+  pnd->last_error = NFC_SUCCESS;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Queue a frame in the current batch
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted.
+ * @param szTx contains the length in bytes.
+ * @param[out] pbtRx response from the target
+ * @param szRx size of \a pbtRx
+ * @param[out] pres will receive the value nfc_initiator_transceive_bytes() would have returned for this frame
+ *
+ * Buffers are not copied: \a pbtTx, \a pbtRx and \a pres must remain valid until nfc_batch_commit() returns.
+ * At most \c NFC_BATCH_MAX_FRAMES (16) frames can be queued in one batch.
+ */
+int
+nfc_batch_append(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int *pres)
+{
+  if (!pnd->bBatch) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if (pnd->szBatchFrames >= NFC_BATCH_MAX_FRAMES) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  struct nfc_batch_frame *frame = &(pnd->batch_frames[pnd->szBatchFrames]);
+  frame->pbtTx = pbtTx;
+  frame->szTx = szTx;
+  frame->pbtRx = pbtRx;
+  frame->szRx = szRx;
+  frame->pres = pres;
+  frame->ui16Sw = 0;
+  frame->ui16SwMask = 0;
+  if (pres)
+    *pres = NFC_EOPABORTED;
+  pnd->szBatchFrames++;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Exchange all the frames queued since nfc_batch_begin()
+ * @return Returns 0 when every frame has been exchanged, otherwise returns the error code of the first failing frame
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param timeout in milliseconds, applied to each frame
+ *
+ * Frames are exchanged in order, just like successive calls to nfc_initiator_transceive_bytes(),
+ * but the driver sets up the chip once for the whole batch and sends each frame as soon as the
+ * previous answer is received.
+ * The exchange stops at the first failing frame: frames which were not sent keep \c NFC_EOPABORTED as result.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_batch_commit(nfc_device *pnd, int timeout)
+{
+  if (!pnd->bBatch) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  const size_t szFrames = pnd->szBatchFrames;
+  pnd->bBatch = false;
+  pnd->szBatchFrames = 0;
+
+  if (NFC_DRIVER(pnd)->initiator_transceive_bytes_batch) {
+    nfc_device_lock(pnd);
+    pnd->last_error = 0;
+    int res = NFC_DRIVER(pnd)->initiator_transceive_bytes_batch(pnd, pnd->batch_frames, szFrames, timeout);
+    nfc_device_unlock(pnd);
+    return res;
+  }
+
+  // Driver does not know how to batch frames: send them one by one
+  for (size_t i = 0; i < szFrames; i++) {
+    const struct nfc_batch_frame *frame = &(pnd->batch_frames[i]);
+    int res = nfc_initiator_transceive_bytes(pnd, frame->pbtTx, frame->szTx, frame->pbtRx, frame->szRx, timeout);
+    if (frame->pres)
+      *(frame->pres) = res;
+    if (res < 0)
+      return res;
+    if (nfc_batch_frame_sw_mismatch(frame, res))
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Start a non-blocking exchange with the selected target
+ * @return Returns 0 on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted.
+ * @param szTx contains the length in bytes.
+ * @param[out] pbtRx response from the target, must stay valid until \a callback is called
+ * @param szRx size of \a pbtRx (the callback gets NFC_EOVFLOW if RX exceeds this size)
+ * @param timeout in milliseconds
+ * @param callback function called with the received bytes count or libnfc's error code
+ * @param user_data pointer passed as is to \a callback
+ *
+ * This function sends the frame like nfc_initiator_transceive_bytes() but returns
+ * as soon as the device has accepted the command. The answer is collected by
+ * nfc_device_process_events(), which calls \a callback once the exchange completes.
+ * Only one exchange can be pending per device: any other command fails with
+ * NFC_EINVARG until then. The callback may start the next exchange.
+ *
+ * @note When the bus already holds the answer after the command was sent,
+ * \a callback is called before this function returns.
+ *
+ * If timeout equals to 0, the exchange waits indefinitely for the answer
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_initiator_transceive_bytes_async(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout,
+                                     nfc_transceive_callback callback, void *user_data)
+{
+  // HAL() would report success for drivers lacking this feature
+  if (!NFC_DRIVER(pnd)->initiator_transceive_bytes_async) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(initiator_transceive_bytes_async, pnd, pbtTx, szTx, pbtRx, szRx, timeout, callback, user_data);
+}
+
+/** @ingroup dev
+ * @brief Get a file descriptor signalling the answer of a pending exchange
+ * @return Returns a file descriptor on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * The descriptor becomes readable when the device starts answering to a command
+ * sent by nfc_initiator_transceive_bytes_async(): add it to your poll()/select()
+ * loop and call nfc_device_process_events() when it fires.
+ * Only serial devices have such a descriptor, other ones return NFC_EDEVNOTSUPP:
+ * call nfc_device_process_events() directly, it will block until the answer comes.
+ * On Windows, the value is an event HANDLE cast to int: wait for it with
+ * WaitForMultipleObjects() instead of poll().
+ *
+ * @warning Never read from or write to this descriptor.
+ */
+int
+nfc_device_get_pollable_fd(nfc_device *pnd)
+{
+  if (!NFC_DRIVER(pnd)->get_pollable_fd) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(get_pollable_fd, pnd);
+}
+
+/** @ingroup dev
+ * @brief Complete the pending asynchronous exchange
+ * @return Returns 1 if a callback was called, 0 if no exchange was pending, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * This function receives the answer of the exchange started by
+ * nfc_initiator_transceive_bytes_async(), waiting at most for what is left of
+ * its timeout, then calls its callback from the current thread.
+ */
+int
+nfc_device_process_events(nfc_device *pnd)
+{
+  if (!NFC_DRIVER(pnd)->process_events) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(process_events, pnd);
+}
+
 /** @ingroup target
  * @brief Initialize NFC device as an emulated tag
  * @return Returns received bytes count on success, otherwise returns libnfc's error code
@@ -940,28 +1624,24 @@ int
 nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
 {
   int res = 0;
-  // Disallow invalid frame
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_INVALID_FRAMES, false)) < 0)
-    return res;
-  // Disallow multiple frames
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_MULTIPLE_FRAMES, false)) < 0)
-    return res;
-  // Make sure we reset the CRC and parity to chip handling.
-  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0)
-    return res;
-  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0)
-    return res;
-  // Activate auto ISO14443-4 switching by default
-  if ((res = nfc_device_set_property_bool(pnd, NP_AUTO_ISO14443_4, true)) < 0)
-    return res;
-  // Activate "easy framing" feature by default
-  if ((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true)) < 0)
-    return res;
-  // Deactivate the CRYPTO1 cipher, it may could cause problems when still active
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_CRYPTO1, false)) < 0)
-    return res;
-  // Drop explicitely the field
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0)
+  const nfc_property_setting settings[] = {
+    // Disallow invalid frame
+    { NP_ACCEPT_INVALID_FRAMES, false },
+    // Disallow multiple frames
+    { NP_ACCEPT_MULTIPLE_FRAMES, false },
+    // Make sure we reset the CRC and parity to chip handling.
+    { NP_HANDLE_CRC, true },
+    { NP_HANDLE_PARITY, true },
+    // Activate auto ISO14443-4 switching by default
+    { NP_AUTO_ISO14443_4, true },
+    // Activate "easy framing" feature by default
+    { NP_EASY_FRAMING, true },
+    // Deactivate the CRYPTO1 cipher, it may could cause problems when still active
+    { NP_ACTIVATE_CRYPTO1, false },
+    // Drop explicitely the field
+    { NP_ACTIVATE_FIELD, false },
+  };
+  if ((res = nfc_device_set_properties(pnd, settings, sizeof(settings) / sizeof(settings[0]))) < 0)
     return res;
 
   HAL(target_init, pnd, pnt, pbtRx, szRx, timeout);
@@ -993,11 +1673,17 @@ nfc_idle(nfc_device *pnd)
  * This function attempt to abort the current running command.
  *
  * @note The blocking function (ie. nfc_target_init()) will failed with DEABORT error.
+ * @note This function does not wait for the device lock, so it can be called
+ * from another thread while a command is running.
  */
 int
 nfc_abort_command(nfc_device *pnd)
 {
-  HAL(abort_command, pnd);
+  // Unlike HAL(), must not wait for the command we want to abort
+  pnd->bPollAbort = true;
+  if (NFC_DRIVER(pnd)->abort_command)
+    return NFC_DRIVER(pnd)->abort_command(pnd);
+  return NFC_EDEVNOTSUPP;
 }
 
 /** @ingroup target
@@ -1041,6 +1727,40 @@ nfc_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int
   HAL(target_receive_bytes, pnd, pbtRx, szRx, timeout);
 }
 
+/** @ingroup target
+ * @brief Send bytes and APDU frames then receive the next ones
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx pointer to Tx buffer
+ * @param szTx size of Tx buffer
+ * @param pbtRx pointer to Rx buffer
+ * @param szRx size of Rx buffer
+ * @param timeout in milliseconds, applied to each direction
+ *
+ * Same as nfc_target_send_bytes() followed by nfc_target_receive_bytes(), but
+ * the device is kept locked and the command asking for the next frame is sent
+ * to the chip right after the answer, without going back to the application.
+ * Frames longer than the chip buffer are chained when the chip handles the
+ * protocol (D.E.P. or PN532 ISO/IEC 14443-4 emulation), so extended length
+ * APDUs can be exchanged.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_target_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  int res;
+
+  if (NFC_DRIVER(pnd)->target_transceive_bytes) {
+    HAL(target_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+  }
+  if ((res = nfc_target_send_bytes(pnd, pbtTx, szTx, timeout)) < 0)
+    return res;
+  return nfc_target_receive_bytes(pnd, pbtRx, szRx, timeout);
+}
+
 /** @ingroup target
  * @brief Send raw bit-frames
  * @return Returns sent bits count on success, otherwise returns libnfc's error code.
@@ -1080,6 +1800,54 @@ nfc_target_receive_bits(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, uint
   HAL(target_receive_bits, pnd, pbtRx, szRx, pbtRxPar);
 }
 
+/** @ingroup dep
+ * @brief Write a D.E.P. payload of any size
+ * @return Returns the number of bytes taken, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx pointer to payload
+ * @param szTx size of payload
+ * @param timeout timeout in milliseconds for each chained frame
+ *
+ * The payload is split in frames linked with the MI (More Information) bit,
+ * the chip taking care of the ACK PDUs in between.
+ *
+ * As \e initiator (after nfc_initiator_select_dep_target()), full frames are
+ * sent right away and the tail is kept until nfc_dep_read(), which sends it as
+ * the last frame of the message and fetches the answer: several writes thus
+ * make a single D.E.P. message, and the target only answers once it is
+ * complete.
+ *
+ * As \e target (after nfc_target_init() with a D.E.P. target), the whole
+ * payload is sent as the answer to the message just received.
+ *
+ * @note Set NP_AUTO_BITRATE before selecting the target to stream at the
+ * highest bit rate both sides support.
+ */
+int
+nfc_dep_write(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+{
+  HAL(dep_write, pnd, pbtTx, szTx, timeout);
+}
+
+/** @ingroup dep
+ * @brief Read a whole D.E.P. message
+ * @return Returns the number of bytes received, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtRx pointer to Rx buffer
+ * @param szRx size of Rx buffer
+ * @param timeout timeout in milliseconds for each chained frame
+ *
+ * Chained frames are gathered until the one without MI bit. As \e initiator,
+ * the payload queued by nfc_dep_write() is sent first.
+ */
+int
+nfc_dep_read(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  HAL(dep_read, pnd, pbtRx, szRx, timeout);
+}
+
 static struct sErrorMessage {
   int     iErrorCode;
   const char *pcErrorMsg;
@@ -1159,6 +1927,142 @@ nfc_device_get_last_error(const nfc_device *pnd)
   return pnd->last_error;
 }
 
+/** @ingroup dev
+ * @brief Attach a simulated card to a simulated device (sim driver)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer opened with a "sim" connstring
+ * @param pnt \a nfc_target struct pointer describing the card (NMT_ISO14443A or NMT_FELICA)
+ * @param pbtMemory card memory (MIFARE blocks or Ultralight pages), can be \e NULL
+ * @param szMemory size of \a pbtMemory
+ *
+ * \a pbtMemory is used in place: writes sent to the card update it. It must
+ * stay valid until the card is detached or replaced.
+ */
+int
+nfc_sim_attach_target(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtMemory, const size_t szMemory)
+{
+#if defined (DRIVER_SIM_ENABLED)
+  pnd->last_error = sim_attach_target(pnd, pnt, pbtMemory, szMemory);
+#else
+  (void) pnt;
+  (void) pbtMemory;
+  (void) szMemory;
+  pnd->last_error = NFC_EDEVNOTSUPP;
+#endif /* DRIVER_SIM_ENABLED */
+  return pnd->last_error;
+}
+
+/** @ingroup dev
+ * @brief Remove the simulated card from a simulated device (sim driver)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer opened with a "sim" connstring
+ */
+int
+nfc_sim_detach_target(nfc_device *pnd)
+{
+#if defined (DRIVER_SIM_ENABLED)
+  pnd->last_error = sim_detach_target(pnd);
+#else
+  pnd->last_error = NFC_EDEVNOTSUPP;
+#endif /* DRIVER_SIM_ENABLED */
+  return pnd->last_error;
+}
+
+/** @ingroup dev
+ * @brief Export a device to a remote application (tcp driver)
+ * @return Returns 0 when the remote application closed the connection, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent the device to export
+ * @param fd connected socket
+ *
+ * Requests sent on \a fd by a device opened with a "tcp:host:port" connstring
+ * are run against \a pnd until the connection is closed. The device is left
+ * idle afterwards and can be served again. \a fd is not closed.
+ */
+int
+nfc_tcp_serve(nfc_device *pnd, int fd)
+{
+#if defined (DRIVER_TCP_ENABLED)
+  pnd->last_error = tcp_serve(pnd, fd);
+#else
+  (void) fd;
+  pnd->last_error = NFC_EDEVNOTSUPP;
+#endif /* DRIVER_TCP_ENABLED */
+  return pnd->last_error;
+}
+
+/** @ingroup dev
+ * @brief Share devices with other processes (nfcd driver)
+ * @return Returns 0 when the client process closed the connection, otherwise returns libnfc's error code (negative value)
+ *
+ * @param apnd devices that can be shared
+ * @param szDevices number of entries of \a apnd
+ * @param fd UNIX socket accepted from a client process
+ *
+ * The client opens the device with a "nfcd:index" connstring, \a index
+ * being the one of the device in \a apnd. Requests are then exchanged
+ * through shared memory rings until the client closes the device. Several
+ * clients can be served at the same time, from different threads: their
+ * requests are run in turn. \a fd is not closed.
+ */
+int
+nfc_daemon_serve(nfc_device *apnd[], const size_t szDevices, int fd)
+{
+#if defined (DRIVER_NFCD_ENABLED)
+  return nfcd_serve(apnd, szDevices, fd);
+#else
+  (void) apnd;
+  (void) szDevices;
+  (void) fd;
+  return NFC_EDEVNOTSUPP;
+#endif /* DRIVER_NFCD_ENABLED */
+}
+
+/** @ingroup error
+ * @brief Get I/O counters of a nfc_device
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pstats \a nfc_device_stats struct pointer where counters will be copied
+ */
+int
+nfc_device_get_stats(const nfc_device *pnd, nfc_device_stats *pstats)
+{
+  *pstats = pnd->stats;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup error
+ * @brief Reset I/O counters of a nfc_device
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ */
+void
+nfc_device_reset_stats(nfc_device *pnd)
+{
+  memset(&pnd->stats, 0, sizeof(pnd->stats));
+}
+
+/** @ingroup error
+ * @brief Get the phases timing of the last command answered by a nfc_device
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] ptiming \a nfc_command_timing struct pointer where the timing will be copied
+ *
+ * Commands are only timed once NP_COMMAND_TIMING is enabled, until then the
+ * timing has no phase. Time spent in each phase by all timed commands is summed
+ * up in \a nfc_device_stats.
+ */
+int
+nfc_device_get_last_timing(const nfc_device *pnd, nfc_command_timing *ptiming)
+{
+  *ptiming = pnd->last_timing;
+  return NFC_SUCCESS;
+}
+
 /* Special data accessors */
 
 /** @ingroup data
@@ -1170,6 +2074,7 @@ nfc_device_get_last_error(const nfc_device *pnd)
 const char *
 nfc_device_get_name(nfc_device *pnd)
 {
+  nfc_device_resolve_name(pnd);
   return pnd->name;
 }
 
@@ -1196,9 +2101,29 @@ nfc_device_get_connstring(nfc_device *pnd)
 int
 nfc_device_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt)
 {
+  if (__atomic_load_n(&pnd->bCaps, __ATOMIC_ACQUIRE)) {
+    if ((mode != N_TARGET) && (mode != N_INITIATOR))
+      return NFC_EINVARG;
+    *supported_mt = pnd->caps.modulations[mode];
+    return NFC_SUCCESS;
+  }
   HAL(get_supported_modulation, pnd, mode, supported_mt);
 }
 
+static bool
+nfc_device_get_cached_baud_rate(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br, int *pres)
+{
+  if (!__atomic_load_n(&pnd->bCaps, __ATOMIC_ACQUIRE))
+    return false;
+  if ((nmt < NMT_ISO14443A) || (nmt > NMT_DEP)) {
+    *pres = NFC_EINVARG;
+  } else {
+    *supported_br = pnd->caps.baud_rates[mode][nmt];
+    *pres = NFC_SUCCESS;
+  }
+  return true;
+}
+
 /** @ingroup data
  * @brief Get supported baud rates (initiator mode).
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -1210,6 +2135,9 @@ nfc_device_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const
 int
 nfc_device_get_supported_baud_rate(nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br)
 {
+  int res;
+  if (nfc_device_get_cached_baud_rate(pnd, N_INITIATOR, nmt, supported_br, &res))
+    return res;
   HAL(get_supported_baud_rate, pnd, N_INITIATOR, nmt, supported_br);
 }
 
@@ -1224,6 +2152,9 @@ nfc_device_get_supported_baud_rate(nfc_device *pnd, const nfc_modulation_type nm
 int
 nfc_device_get_supported_baud_rate_target_mode(nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br)
 {
+  int res;
+  if (nfc_device_get_cached_baud_rate(pnd, N_TARGET, nmt, supported_br, &res))
+    return res;
   HAL(get_supported_baud_rate, pnd, N_TARGET, nmt, supported_br);
 }
 
@@ -1235,7 +2166,7 @@ nfc_device_get_supported_baud_rate_target_mode(nfc_device *pnd, const nfc_modula
  * @param nm \a nfc_modulation.
  *
  */
-static int
+int
 nfc_device_validate_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation *nm)
 {
   int res;
@@ -1293,7 +2224,7 @@ nfc_version(void)
 void
 nfc_free(void *p)
 {
-  free(p);
+  nfc_pool_free(p);
 }
 
 /** @ingroup misc
@@ -1302,12 +2233,89 @@ nfc_free(void *p)
  * @param pnd \a nfc_device struct pointer that represent currently used device
  * @param buf pointer where string will be allocated, then information printed
  *
+ * The report is only built once, later calls get a copy of it.
+ *
  * @warning *buf must be freed using nfc_free()
  */
 int
 nfc_device_get_information_about(nfc_device *pnd, char **buf)
 {
-  HAL(device_get_information_about, pnd, buf);
+  int res = NFC_SUCCESS;
+
+  nfc_device_lock(pnd);
+  pnd->last_error = 0;
+  if (!pnd->pcInformation) {
+    if (!NFC_DRIVER(pnd)->device_get_information_about) {
+      pnd->last_error = NFC_EDEVNOTSUPP;
+      res = pnd->last_error;
+    } else {
+      res = NFC_DRIVER(pnd)->device_get_information_about(pnd, &pnd->pcInformation);
+      if (res < 0)
+        pnd->pcInformation = NULL;
+    }
+  }
+  if (res >= 0) {
+    if ((*buf = strdup(pnd->pcInformation)) == NULL) {
+      pnd->last_error = NFC_ESOFT;
+      res = pnd->last_error;
+    } else {
+      res = strlen(*buf);
+    }
+  }
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup data
+ * @brief Get what a device is and supports
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] ppcaps pointer on the \a nfc_device_capabilities of the device
+ *
+ * The descriptor is filled when the device is opened and stays valid until it
+ * is closed: reading it costs no I/O, so that it can be polled by health
+ * checks. nfc_device_refresh_capabilities() reads it again from the device.
+ */
+int
+nfc_device_get_capabilities(nfc_device *pnd, const nfc_device_capabilities **ppcaps)
+{
+  int res = NFC_SUCCESS;
+
+  if (!__atomic_load_n(&pnd->bCaps, __ATOMIC_ACQUIRE)) {
+    nfc_device_lock(pnd);
+    if (!__atomic_load_n(&pnd->bCaps, __ATOMIC_RELAXED))
+      res = nfc_device_load_capabilities(pnd);
+    nfc_device_unlock(pnd);
+    if (res < 0) {
+      pnd->last_error = res;
+      return res;
+    }
+  }
+  *ppcaps = &pnd->caps;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup data
+ * @brief Read the capabilities of a device again
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Only needed when the device may have changed behind libnfc's back, e.g. a
+ * remote device reopened by its server. The information report is also built
+ * again on its next request.
+ * @note The descriptor is updated in place: do not call it while another
+ * thread reads the descriptor.
+ */
+int
+nfc_device_refresh_capabilities(nfc_device *pnd)
+{
+  int res;
+
+  nfc_device_lock(pnd);
+  if ((res = nfc_device_load_capabilities(pnd)) < 0)
+    pnd->last_error = res;
+  nfc_device_unlock(pnd);
+  return res;
 }
 
 /** @ingroup string-converter
@@ -1366,6 +2374,9 @@ str_nfc_modulation_type(const nfc_modulation_type nmt)
   return "???";
 }
 
+typedef char nfc_target_string[4096];
+NFC_POOL(nfc_target_string_pool, nfc_target_string, NFC_POOL_TARGETS);
+
 /** @ingroup string-converter
  * @brief Convert \a nfc_target content to string
  * @return Upon successful return, this function returns the number of characters printed (excluding the null byte used to end output to strings), otherwise returns libnfc's error code (negative value)
@@ -1378,10 +2389,10 @@ str_nfc_modulation_type(const nfc_modulation_type nmt)
 int
 str_nfc_target(char **buf, const nfc_target *pnt, bool verbose)
 {
-  *buf = malloc(4096);
+  *buf = nfc_pool_alloc(&nfc_target_string_pool);
   if (! *buf)
     return NFC_ESOFT;
   (*buf)[0] = '\0';
-  snprint_nfc_target(*buf, 4096, pnt, verbose);
+  snprint_nfc_target(*buf, sizeof(nfc_target_string), pnt, verbose);
   return strlen(*buf);
 }
@@ -0,0 +1,405 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file target-codec.c
+ * @brief Binary (TLV) and JSON encodings of nfc_target
+ *
+ * A TLV record is the modulation type and the baud rate (1 byte each), the
+ * length of the fields (2 bytes, big endian) and the fields, each one as a
+ * tag, a length and a value (1 byte each but the value). Tags are numbered
+ * per modulation type, see target_fields. Empty fields are left out.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+enum target_field_kind {
+  // Fixed size byte array, or a single byte
+  TFK_BYTES,
+  // Byte array whose length is held by a size_t
+  TFK_VAR,
+  // size_t or enum value, below 256
+  TFK_SIZE,
+  TFK_ENUM,
+};
+
+struct target_field {
+  nfc_modulation_type nmt;
+  uint8_t btTag;
+  const char *pcName;
+  enum target_field_kind kind;
+  size_t szOffset;
+  size_t szMax;
+  size_t szLenOffset;
+};
+
+#define TF_MEMBER_SIZE(member) sizeof(((nfc_target_info *) 0)->member)
+#define TF_BYTES(nmt, tag, name, member) { nmt, tag, name, TFK_BYTES, offsetof(nfc_target_info, member), TF_MEMBER_SIZE(member), 0 }
+#define TF_VAR(nmt, tag, name, member, len) { nmt, tag, name, TFK_VAR, offsetof(nfc_target_info, member), TF_MEMBER_SIZE(member), offsetof(nfc_target_info, len) }
+#define TF_SIZE(nmt, tag, name, member) { nmt, tag, name, TFK_SIZE, offsetof(nfc_target_info, member), 1, 0 }
+#define TF_ENUM(nmt, tag, name, member) { nmt, tag, name, TFK_ENUM, offsetof(nfc_target_info, member), 1, 0 }
+
+static const struct target_field target_fields[] = {
+  TF_BYTES(NMT_ISO14443A, 1, "atqa", nai.abtAtqa),
+  TF_BYTES(NMT_ISO14443A, 2, "sak", nai.btSak),
+  TF_VAR(NMT_ISO14443A, 3, "uid", nai.abtUid, nai.szUidLen),
+  TF_VAR(NMT_ISO14443A, 4, "ats", nai.abtAts, nai.szAtsLen),
+  TF_SIZE(NMT_FELICA, 1, "len", nfi.szLen),
+  TF_BYTES(NMT_FELICA, 2, "res_code", nfi.btResCode),
+  TF_BYTES(NMT_FELICA, 3, "id", nfi.abtId),
+  TF_BYTES(NMT_FELICA, 4, "pad", nfi.abtPad),
+  TF_BYTES(NMT_FELICA, 5, "sys_code", nfi.abtSysCode),
+  TF_BYTES(NMT_ISO14443B, 1, "pupi", nbi.abtPupi),
+  TF_BYTES(NMT_ISO14443B, 2, "application_data", nbi.abtApplicationData),
+  TF_BYTES(NMT_ISO14443B, 3, "protocol_info", nbi.abtProtocolInfo),
+  TF_BYTES(NMT_ISO14443B, 4, "cid", nbi.ui8CardIdentifier),
+  TF_BYTES(NMT_ISO14443BI, 1, "div", nii.abtDIV),
+  TF_BYTES(NMT_ISO14443BI, 2, "ver_log", nii.btVerLog),
+  TF_BYTES(NMT_ISO14443BI, 3, "config", nii.btConfig),
+  TF_VAR(NMT_ISO14443BI, 4, "atr", nii.abtAtr, nii.szAtrLen),
+  TF_BYTES(NMT_ISO14443B2SR, 1, "uid", nsi.abtUID),
+  TF_BYTES(NMT_ISO14443B2CT, 1, "uid", nci.abtUID),
+  TF_BYTES(NMT_ISO14443B2CT, 2, "prod_code", nci.btProdCode),
+  TF_BYTES(NMT_ISO14443B2CT, 3, "fab_code", nci.btFabCode),
+  TF_BYTES(NMT_JEWEL, 1, "sens_res", nji.btSensRes),
+  TF_BYTES(NMT_JEWEL, 2, "id", nji.btId),
+  TF_VAR(NMT_BARCODE, 1, "data", nti.abtData, nti.szDataLen),
+  TF_BYTES(NMT_DEP, 1, "nfcid3", ndi.abtNFCID3),
+  TF_BYTES(NMT_DEP, 2, "did", ndi.btDID),
+  TF_BYTES(NMT_DEP, 3, "bs", ndi.btBS),
+  TF_BYTES(NMT_DEP, 4, "br", ndi.btBR),
+  TF_BYTES(NMT_DEP, 5, "to", ndi.btTO),
+  TF_BYTES(NMT_DEP, 6, "pp", ndi.btPP),
+  TF_VAR(NMT_DEP, 7, "gb", ndi.abtGB, ndi.szGB),
+  TF_ENUM(NMT_DEP, 8, "mode", ndi.ndm),
+};
+
+#define TARGET_FIELDS (sizeof(target_fields) / sizeof(target_fields[0]))
+
+// Bytes of a field, in pbtValue for numbers; returns their count
+static size_t
+target_field_get(const nfc_target_info *pnti, const struct target_field *ptf, const uint8_t **ppbtValue, uint8_t *pbtValue)
+{
+  const uint8_t *pbtField = (const uint8_t *) pnti + ptf->szOffset;
+  size_t szLen;
+  switch (ptf->kind) {
+    case TFK_BYTES:
+      *ppbtValue = pbtField;
+      return ptf->szMax;
+    case TFK_VAR:
+      memcpy(&szLen, (const uint8_t *) pnti + ptf->szLenOffset, sizeof(szLen));
+      *ppbtValue = pbtField;
+      return MIN(szLen, ptf->szMax);
+    case TFK_SIZE:
+      memcpy(&szLen, pbtField, sizeof(szLen));
+      *pbtValue = (uint8_t) szLen;
+      break;
+    case TFK_ENUM: {
+      int iValue;
+      memcpy(&iValue, pbtField, sizeof(iValue));
+      *pbtValue = (uint8_t) iValue;
+      break;
+    }
+  }
+  *ppbtValue = pbtValue;
+  return 1;
+}
+
+struct target_writer {
+  uint8_t *pbtBuf;
+  size_t szBuf;
+  size_t szOff;
+};
+
+static void
+tw_write(struct target_writer *ptw, const void *pData, const size_t szData)
+{
+  if (ptw->szOff + szData <= ptw->szBuf)
+    memcpy(ptw->pbtBuf + ptw->szOff, pData, szData);
+  ptw->szOff += szData;
+}
+
+static void
+tw_puts(struct target_writer *ptw, const char *pcText)
+{
+  tw_write(ptw, pcText, strlen(pcText));
+}
+
+static void
+tw_hex(struct target_writer *ptw, const uint8_t *pbtData, const size_t szData)
+{
+  static const char acDigits[] = "0123456789abcdef";
+  for (size_t n = 0; n < szData; n++) {
+    const char acByte[2] = { acDigits[pbtData[n] >> 4], acDigits[pbtData[n] & 0x0f] };
+    tw_write(ptw, acByte, sizeof(acByte));
+  }
+}
+
+static void
+tw_number(struct target_writer *ptw, const unsigned int uiValue)
+{
+  char acNumber[3];
+  size_t n = sizeof(acNumber);
+  unsigned int ui = uiValue;
+  do {
+    acNumber[--n] = '0' + (ui % 10);
+    ui /= 10;
+  } while (ui && n);
+  tw_write(ptw, acNumber + n, sizeof(acNumber) - n);
+}
+
+static void
+target_encode_tlv(struct target_writer *ptw, const nfc_target *pnt)
+{
+  const uint8_t abtHeader[4] = { (uint8_t) pnt->nm.nmt, (uint8_t) pnt->nm.nbr, 0, 0 };
+  const size_t szStart = ptw->szOff;
+  tw_write(ptw, abtHeader, sizeof(abtHeader));
+  for (size_t n = 0; n < TARGET_FIELDS; n++) {
+    const struct target_field *ptf = &target_fields[n];
+    if (ptf->nmt != pnt->nm.nmt)
+      continue;
+    const uint8_t *pbtValue;
+    uint8_t btValue;
+    const size_t szValue = target_field_get(&pnt->nti, ptf, &pbtValue, &btValue);
+    if (!szValue)
+      continue;
+    const uint8_t abtField[2] = { ptf->btTag, (uint8_t) szValue };
+    tw_write(ptw, abtField, sizeof(abtField));
+    tw_write(ptw, pbtValue, szValue);
+  }
+  const size_t szFields = ptw->szOff - szStart - sizeof(abtHeader);
+  if (ptw->szOff <= ptw->szBuf) {
+    ptw->pbtBuf[szStart + 2] = (uint8_t)(szFields >> 8);
+    ptw->pbtBuf[szStart + 3] = (uint8_t) szFields;
+  }
+}
+
+static void
+target_encode_json(struct target_writer *ptw, const nfc_target *pnt)
+{
+  tw_puts(ptw, "{\"modulation\":\"");
+  tw_puts(ptw, str_nfc_modulation_type(pnt->nm.nmt));
+  tw_puts(ptw, "\",\"baud_rate\":\"");
+  tw_puts(ptw, str_nfc_baud_rate(pnt->nm.nbr));
+  tw_puts(ptw, "\"");
+  for (size_t n = 0; n < TARGET_FIELDS; n++) {
+    const struct target_field *ptf = &target_fields[n];
+    if (ptf->nmt != pnt->nm.nmt)
+      continue;
+    const uint8_t *pbtValue;
+    uint8_t btValue;
+    const size_t szValue = target_field_get(&pnt->nti, ptf, &pbtValue, &btValue);
+    if (!szValue)
+      continue;
+    tw_puts(ptw, ",\"");
+    tw_puts(ptw, ptf->pcName);
+    tw_puts(ptw, "\":");
+    if ((ptf->kind == TFK_SIZE) || (ptf->kind == TFK_ENUM)) {
+      tw_number(ptw, btValue);
+    } else {
+      tw_puts(ptw, "\"");
+      tw_hex(ptw, pbtValue, szValue);
+      tw_puts(ptw, "\"");
+    }
+  }
+  tw_write(ptw, "}", 2);
+}
+
+/** @ingroup string-converter
+ * @brief Encode a target into a buffer, without allocating memory
+ * @return Returns the length of the encoding on success, otherwise returns libnfc's error code (negative value)
+ * @param pbtBuf buffer to write to
+ * @param szBuf size of \a pbtBuf
+ * @param pnt \a nfc_target to encode
+ * @param nte \a NTE_TLV for a compact binary record that nfc_target_decode() reads back,
+ * \a NTE_JSON for one JSON object, NUL terminated (the NUL is not counted in the length)
+ *
+ * When \a szBuf is too small, \c NFC_EOVFLOW is returned and the content of
+ * \a pbtBuf is undefined.
+ */
+int
+nfc_target_encode(uint8_t *pbtBuf, const size_t szBuf, const nfc_target *pnt, const nfc_target_encoding nte)
+{
+  struct target_writer tw = { pbtBuf, szBuf, 0 };
+  if ((pnt->nm.nmt < NMT_ISO14443A) || (pnt->nm.nmt > NMT_DEP))
+    return NFC_EINVARG;
+  switch (nte) {
+    case NTE_TLV:
+      target_encode_tlv(&tw, pnt);
+      break;
+    case NTE_JSON:
+      target_encode_json(&tw, pnt);
+      if (tw.szOff <= tw.szBuf)
+        return tw.szOff - 1;
+      break;
+    default:
+      return NFC_EINVARG;
+  }
+  return (tw.szOff <= tw.szBuf) ? (int) tw.szOff : NFC_EOVFLOW;
+}
+
+/** @ingroup string-converter
+ * @brief Decode a target encoded with \a NTE_TLV
+ * @return Returns the length of the record on success, otherwise returns libnfc's error code (negative value)
+ * @param pnt \a nfc_target to fill
+ * @param pbtBuf buffer holding the record, possibly followed by other ones
+ * @param szBuf size of \a pbtBuf
+ *
+ * Fields this version of libnfc does not know are skipped.
+ */
+int
+nfc_target_decode(nfc_target *pnt, const uint8_t *pbtBuf, const size_t szBuf)
+{
+  if (szBuf < 4)
+    return NFC_EINVARG;
+  const size_t szRecord = 4 + ((pbtBuf[2] << 8) | pbtBuf[3]);
+  if ((pbtBuf[0] < NMT_ISO14443A) || (pbtBuf[0] > NMT_DEP) || (pbtBuf[1] > NBR_847) || (szRecord > szBuf))
+    return NFC_EINVARG;
+
+  memset(pnt, 0, sizeof(*pnt));
+  pnt->nm.nmt = (nfc_modulation_type) pbtBuf[0];
+  pnt->nm.nbr = (nfc_baud_rate) pbtBuf[1];
+  for (size_t szOff = 4; szOff < szRecord;) {
+    if (szOff + 2 > szRecord)
+      return NFC_EINVARG;
+    const uint8_t btTag = pbtBuf[szOff];
+    const size_t szValue = pbtBuf[szOff + 1];
+    const uint8_t *pbtValue = pbtBuf + szOff + 2;
+    szOff += 2 + szValue;
+    if (szOff > szRecord)
+      return NFC_EINVARG;
+
+    const struct target_field *ptf = NULL;
+    for (size_t n = 0; n < TARGET_FIELDS; n++) {
+      if ((target_fields[n].nmt == pnt->nm.nmt) && (target_fields[n].btTag == btTag)) {
+        ptf = &target_fields[n];
+        break;
+      }
+    }
+    if (!ptf)
+      continue;
+    uint8_t *pbtField = (uint8_t *) &pnt->nti + ptf->szOffset;
+    switch (ptf->kind) {
+      case TFK_BYTES:
+        if (szValue != ptf->szMax)
+          return NFC_EINVARG;
+        memcpy(pbtField, pbtValue, szValue);
+        break;
+      case TFK_VAR:
+        if (szValue > ptf->szMax)
+          return NFC_EINVARG;
+        memcpy(pbtField, pbtValue, szValue);
+        memcpy((uint8_t *) &pnt->nti + ptf->szLenOffset, &szValue, sizeof(szValue));
+        break;
+      case TFK_SIZE: {
+        if (szValue != 1)
+          return NFC_EINVARG;
+        const size_t sz = pbtValue[0];
+        memcpy(pbtField, &sz, sizeof(sz));
+        break;
+      }
+      case TFK_ENUM: {
+        if (szValue != 1)
+          return NFC_EINVARG;
+        const int i = pbtValue[0];
+        memcpy(pbtField, &i, sizeof(i));
+        break;
+      }
+    }
+  }
+  return szRecord;
+}
+
+/** @ingroup string-converter
+ * @brief Get the fixed size key of a target
+ * @param pnt \a nfc_target to identify
+ * @param pntk \a nfc_target_key to fill
+ *
+ * Keys are meant for the lookups of large sets of targets, e.g. inventory
+ * histories held as \a NTE_TLV records: comparing two keys costs a 16 bytes
+ * memcmp() instead of looking into the whole \a nfc_target.
+ */
+void
+nfc_target_get_key(const nfc_target *pnt, nfc_target_key *pntk)
+{
+  const uint8_t *pbtUid;
+  const size_t szUid = nfc_target_uid(pnt, &pbtUid);
+  nfc_target_key_from_uid(pntk, pnt->nm.nmt, pbtUid, szUid);
+}
+
+// Tag of the field nfc_target_get_key() takes the UID from, per modulation type
+static const uint8_t target_uid_tags[NMT_DEP + 1] = {
+  [NMT_ISO14443A] = 3,
+  [NMT_JEWEL] = 2,
+  [NMT_BARCODE] = 1,
+  [NMT_ISO14443B] = 1,
+  [NMT_ISO14443BI] = 1,
+  [NMT_ISO14443B2SR] = 1,
+  [NMT_ISO14443B2CT] = 1,
+  [NMT_FELICA] = 3,
+  [NMT_DEP] = 1,
+};
+
+/** @ingroup string-converter
+ * @brief Get the key of a target encoded with \a NTE_TLV, without decoding the whole record
+ * @return Returns the length of the record on success, otherwise returns libnfc's error code (negative value)
+ * @param pntk \a nfc_target_key to fill, the same as nfc_target_get_key() on the decoded target
+ * @param pbtBuf buffer holding the record, possibly followed by other ones
+ * @param szBuf size of \a pbtBuf
+ */
+int
+nfc_target_decode_key(nfc_target_key *pntk, const uint8_t *pbtBuf, const size_t szBuf)
+{
+  if (szBuf < 4)
+    return NFC_EINVARG;
+  const size_t szRecord = 4 + ((pbtBuf[2] << 8) | pbtBuf[3]);
+  if ((pbtBuf[0] < NMT_ISO14443A) || (pbtBuf[0] > NMT_DEP) || (szRecord > szBuf))
+    return NFC_EINVARG;
+
+  const nfc_modulation_type nmt = (nfc_modulation_type) pbtBuf[0];
+  nfc_target_key_from_uid(pntk, nmt, NULL, 0);
+  for (size_t szOff = 4; szOff + 2 <= szRecord;) {
+    const size_t szValue = pbtBuf[szOff + 1];
+    if (szOff + 2 + szValue > szRecord)
+      return NFC_EINVARG;
+    if (pbtBuf[szOff] == target_uid_tags[nmt]) {
+      nfc_target_key_from_uid(pntk, nmt, pbtBuf + szOff + 2, szValue);
+      break;
+    }
+    szOff += 2 + szValue;
+  }
+  return szRecord;
+}
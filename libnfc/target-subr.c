@@ -29,10 +29,17 @@
  * @brief Target-related subroutines. (ie. determine target type, print target, etc.)
  */
 #include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 #include <nfc/nfc.h>
 
 #include "target-subr.h"
 
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
 struct card_atqa {
   uint16_t atqa;
   uint16_t mask;
@@ -122,559 +129,563 @@ struct card_sak const_cs[] = {
   {0x00, 0x00, "" },                      // 12 SmartMX
 };
 
+/*
+ * Output of the formatters: writes what fits in dst, always NUL terminated,
+ * and counts the length the whole text needs, like snprintf().
+ */
+struct target_printer {
+  char *dst;
+  size_t size;
+  size_t off;
+};
+
+static void
+tp_write(struct target_printer *ptp, const char *pcData, size_t szData)
+{
+  if (ptp->off + 1 < ptp->size) {
+    const size_t szCopy = MIN(szData, ptp->size - ptp->off - 1);
+    memcpy(ptp->dst + ptp->off, pcData, szCopy);
+    ptp->dst[ptp->off + szCopy] = '\0';
+  }
+  ptp->off += szData;
+}
+
+static void
+tp_puts(struct target_printer *ptp, const char *pcText)
+{
+  tp_write(ptp, pcText, strlen(pcText));
+}
+
+static void
+tp_printf(struct target_printer *ptp, const char *pcFormat, ...)
+{
+  char acLine[128];
+  va_list args;
+  va_start(args, pcFormat);
+  const int res = vsnprintf(acLine, sizeof(acLine), pcFormat, args);
+  va_end(args);
+  if (res > 0)
+    tp_write(ptp, acLine, MIN((size_t) res, sizeof(acLine) - 1));
+}
+
+static void
+tp_hex(struct target_printer *ptp, const uint8_t *pbtData, const size_t szBytes)
+{
+  static const char acDigits[] = "0123456789abcdef";
+  for (size_t szPos = 0; szPos < szBytes; szPos++) {
+    const char acByte[4] = { acDigits[pbtData[szPos] >> 4], acDigits[pbtData[szPos] & 0x0f], ' ', ' ' };
+    tp_write(ptp, acByte, sizeof(acByte));
+  }
+  tp_write(ptp, "\n", 1);
+}
+
+// Text of the bits set in a byte, in table order
+struct target_flag {
+  uint8_t mask;
+  const char *text;
+};
+
+static void
+tp_flags(struct target_printer *ptp, const uint8_t bt, const struct target_flag *ptf, const size_t szFlags)
+{
+  for (size_t n = 0; n < szFlags; n++) {
+    if (bt & ptf[n].mask)
+      tp_puts(ptp, ptf[n].text);
+  }
+}
+
+// Text of a value, or of the last entry (value ignored) when none matches
+struct target_choice {
+  uint32_t value;
+  const char *text;
+};
+
+static void
+tp_choice(struct target_printer *ptp, const uint32_t value, const struct target_choice *ptc, const size_t szChoices)
+{
+  size_t n;
+  for (n = 0; n < szChoices - 1; n++) {
+    if (ptc[n].value == value)
+      break;
+  }
+  tp_puts(ptp, ptc[n].text);
+}
+
+#define TP_FLAGS(ptp, bt, table) tp_flags(ptp, bt, table, sizeof(table) / sizeof(table[0]))
+#define TP_CHOICE(ptp, value, table) tp_choice(ptp, value, table, sizeof(table) / sizeof(table[0]))
+
 int
 snprint_hex(char *dst, size_t size, const uint8_t *pbtData, const size_t szBytes)
 {
-  size_t  szPos;
-  size_t res = 0;
-  for (szPos = 0; szPos < szBytes; szPos++) {
-    res += snprintf(dst + res, size - res, "%02x  ", pbtData[szPos]);
-  }
-  res += snprintf(dst + res, size - res, "\n");
-  return res;
+  struct target_printer tp = { dst, size, 0 };
+  tp_hex(&tp, pbtData, szBytes);
+  return tp.off;
 }
 
 #define SAK_UID_NOT_COMPLETE     0x04
 #define SAK_ISO14443_4_COMPLIANT 0x20
 #define SAK_ISO18092_COMPLIANT   0x40
 
-void
-snprint_nfc_iso14443a_info(char *dst, size_t size, const nfc_iso14443a_info *pnai, bool verbose)
+static const char *const iso14443a_uid_sizes[] = { "single\n", "double\n", "triple\n", "RFU\n" };
+
+static const int iso14443_max_frame_sizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+// TA(1) of the ATS (ISO/IEC 14443-4 5.2.4)
+static const struct target_flag iso14443a_ta_flags[] = {
+  { 1 << 7, "  * Same bitrate in both directions mandatory\n" },
+  { 1 << 4, "  * PICC to PCD, DS=2, bitrate 212 kbits/s supported\n" },
+  { 1 << 5, "  * PICC to PCD, DS=4, bitrate 424 kbits/s supported\n" },
+  { 1 << 6, "  * PICC to PCD, DS=8, bitrate 847 kbits/s supported\n" },
+  { 1 << 0, "  * PCD to PICC, DR=2, bitrate 212 kbits/s supported\n" },
+  { 1 << 1, "  * PCD to PICC, DR=4, bitrate 424 kbits/s supported\n" },
+  { 1 << 2, "  * PCD to PICC, DR=8, bitrate 847 kbits/s supported\n" },
+  { 1 << 3, "  * ERROR unknown value\n" },
+};
+
+// Historical bytes of MIFARE cards (tag 0xc1)
+static const struct target_choice mifare_chip_types[] = {
+  { 0x00, "(Multiple) Virtual Cards\n" },
+  { 0x10, "Mifare DESFire\n" },
+  { 0x20, "Mifare Plus\n" },
+  { 0, "RFU\n" },
+};
+
+static const struct target_choice mifare_memory_sizes[] = {
+  { 0x00, "<1 kbyte\n" },
+  { 0x01, "1 kbyte\n" },
+  { 0x02, "2 kbyte\n" },
+  { 0x03, "4 kbyte\n" },
+  { 0x04, "8 kbyte\n" },
+  { 0x0f, "Unspecified\n" },
+  { 0, "RFU\n" },
+};
+
+static const struct target_choice mifare_chip_status[] = {
+  { 0x00, "Engineering sample\n" },
+  { 0x20, "Released\n" },
+  { 0, "RFU\n" },
+};
+
+static const struct target_choice mifare_chip_generations[] = {
+  { 0x00, "Generation 1\n" },
+  { 0x01, "Generation 2\n" },
+  { 0x02, "Generation 3\n" },
+  { 0x0f, "Unspecified\n" },
+  { 0, "RFU\n" },
+};
+
+// Other matches not described in AN10833 MIFARE Type Identification
+// Procedure but seen in the field, by ATQA and SAK
+static const struct target_choice iso14443a_seen_cards[] = {
+  { 0x000488, "* Mifare Classic 1K Infineon\n" },
+  { 0x000298, "* Gemplus MPCOS\n" },
+  { 0x030428, "* JCOP31\n" },
+  { 0x004820, "* JCOP31 v2.4.1\n" },
+  { 0x004820, "* JCOP31 v2.2\n" },
+  { 0x000428, "* JCOP31 v2.3.1\n" },
+  { 0x000453, "* Fudan FM1208SH01\n" },
+  { 0x000820, "* Fudan FM1208\n" },
+  { 0x000238, "* MFC 4K emulated by Nokia 6212 Classic\n" },
+  { 0x000838, "* MFC 4K emulated by Nokia 6131 NFC\n" },
+};
+
+static void
+print_mifare_historical_bytes(struct target_printer *ptp, const nfc_iso14443a_info *pnai, size_t offset)
 {
-  int off = 0;
-  off += snprintf(dst + off, size - off, "    ATQA (SENS_RES): ");
-  off += snprint_hex(dst + off, size - off, pnai->abtAtqa, 2);
-  if (verbose) {
-    off += snprintf(dst + off, size - off, "* UID size: ");
-    switch ((pnai->abtAtqa[1] & 0xc0) >> 6) {
-      case 0:
-        off += snprintf(dst + off, size - off, "single\n");
-        break;
-      case 1:
-        off += snprintf(dst + off, size - off, "double\n");
-        break;
-      case 2:
-        off += snprintf(dst + off, size - off, "triple\n");
-        break;
-      case 3:
-        off += snprintf(dst + off, size - off, "RFU\n");
-        break;
-    }
-    off += snprintf(dst + off, size - off, "* bit frame anticollision ");
-    switch (pnai->abtAtqa[1] & 0x1f) {
-      case 0x01:
-      case 0x02:
-      case 0x04:
-      case 0x08:
-      case 0x10:
-        off += snprintf(dst + off, size - off, "supported\n");
-        break;
-      default:
-        off += snprintf(dst + off, size - off, "not supported\n");
-        break;
-    }
+  uint8_t L = pnai->abtAts[offset];
+  offset++;
+  if (L != (pnai->szAtsLen - offset)) {
+    tp_printf(ptp, "    * Warning: Type Identification Coding length (%i)", L);
+    tp_printf(ptp, " not matching Tk length (%" PRIdPTR ")\n", (pnai->szAtsLen - offset));
   }
-  off += snprintf(dst + off, size - off, "       UID (NFCID%c): ", (pnai->abtUid[0] == 0x08 ? '3' : '1'));
-  off += snprint_hex(dst + off, size - off, pnai->abtUid, pnai->szUidLen);
-  if (verbose) {
-    if (pnai->abtUid[0] == 0x08) {
-      off += snprintf(dst + off, size - off, "* Random UID\n");
-    }
+  if ((pnai->szAtsLen - offset - 2) > 0) { // Omit 2 CRC bytes
+    uint8_t CTC = pnai->abtAts[offset];
+    offset++;
+    tp_puts(ptp, "    * Chip Type: ");
+    TP_CHOICE(ptp, CTC & 0xf0, mifare_chip_types);
+    tp_puts(ptp, "    * Memory size: ");
+    TP_CHOICE(ptp, CTC & 0x0f, mifare_memory_sizes);
   }
-  off += snprintf(dst + off, size - off, "      SAK (SEL_RES): ");
-  off += snprint_hex(dst + off, size - off, &pnai->btSak, 1);
-  if (verbose) {
-    if (pnai->btSak & SAK_UID_NOT_COMPLETE) {
-      off += snprintf(dst + off, size - off, "* Warning! Cascade bit set: UID not complete\n");
+  if ((pnai->szAtsLen - offset) > 0) { // Omit 2 CRC bytes
+    uint8_t CVC = pnai->abtAts[offset];
+    offset++;
+    tp_puts(ptp, "    * Chip Status: ");
+    TP_CHOICE(ptp, CVC & 0xf0, mifare_chip_status);
+    tp_puts(ptp, "    * Chip Generation: ");
+    TP_CHOICE(ptp, CVC & 0x0f, mifare_chip_generations);
+  }
+  if ((pnai->szAtsLen - offset) > 0) { // Omit 2 CRC bytes
+    uint8_t VCS = pnai->abtAts[offset];
+    tp_puts(ptp, "    * Specifics (Virtual Card Selection):\n");
+    if ((VCS & 0x09) == 0x00) {
+      tp_puts(ptp, "      * Only VCSL supported\n");
+    } else if ((VCS & 0x09) == 0x01) {
+      tp_puts(ptp, "      * VCS, VCSL and SVC supported\n");
     }
-    if (pnai->btSak & SAK_ISO14443_4_COMPLIANT) {
-      off += snprintf(dst + off, size - off, "* Compliant with ISO/IEC 14443-4\n");
+    if ((VCS & 0x0e) == 0x00) {
+      tp_puts(ptp, "      * SL1, SL2(?), SL3 supported\n");
+    } else if ((VCS & 0x0e) == 0x02) {
+      tp_puts(ptp, "      * SL3 only card\n");
+    } else if ((VCS & 0x0f) == 0x0e) {
+      tp_puts(ptp, "      * No VCS command supported\n");
+    } else if ((VCS & 0x0f) == 0x0f) {
+      tp_puts(ptp, "      * Unspecified\n");
     } else {
-      off += snprintf(dst + off, size - off, "* Not compliant with ISO/IEC 14443-4\n");
+      tp_puts(ptp, "      * RFU\n");
     }
-    if (pnai->btSak & SAK_ISO18092_COMPLIANT) {
-      off += snprintf(dst + off, size - off, "* Compliant with ISO/IEC 18092\n");
+  }
+}
+
+// Decode ATS according to ISO/IEC 14443-4 (5.2 Answer to select)
+static void
+print_iso14443a_ats(struct target_printer *ptp, const nfc_iso14443a_info *pnai)
+{
+  if ((pnai->abtAts[0] & 0x0F) < sizeof(iso14443_max_frame_sizes) / sizeof(iso14443_max_frame_sizes[0])) {
+    tp_printf(ptp, "* Max Frame Size accepted by PICC: %d bytes\n", iso14443_max_frame_sizes[pnai->abtAts[0] & 0x0F]);
+  } else {
+    tp_puts(ptp, "* Max Frame Size accepted by PICC: RFU\n");
+  }
+
+  size_t offset = 1;
+  if (pnai->abtAts[0] & 0x10) { // TA(1) present
+    uint8_t TA = pnai->abtAts[offset];
+    offset++;
+    tp_puts(ptp, "* Bit Rate Capability:\n");
+    if (TA == 0) {
+      tp_puts(ptp, "  * PICC supports only 106 kbits/s in both directions\n");
+    }
+    TP_FLAGS(ptp, TA, iso14443a_ta_flags);
+  }
+  if (pnai->abtAts[0] & 0x20) { // TB(1) present
+    uint8_t TB = pnai->abtAts[offset];
+    offset++;
+    tp_printf(ptp, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((TB & 0xf0) >> 4)) / 13560.0);
+    if ((TB & 0x0f) == 0) {
+      tp_puts(ptp, "* No Start-up Frame Guard Time required\n");
     } else {
-      off += snprintf(dst + off, size - off, "* Not compliant with ISO/IEC 18092\n");
+      tp_printf(ptp, "* Start-up Frame Guard Time: %.4g ms\n", 256.0 * 16.0 * (1 << (TB & 0x0f)) / 13560.0);
     }
   }
-  if (pnai->szAtsLen) {
-    off += snprintf(dst + off, size - off, "                ATS: ");
-    off += snprint_hex(dst + off, size - off, pnai->abtAts, pnai->szAtsLen);
+  if (pnai->abtAts[0] & 0x40) { // TC(1) present
+    uint8_t TC = pnai->abtAts[offset];
+    offset++;
+    tp_puts(ptp, (TC & 0x1) ? "* Node Address supported\n" : "* Node Address not supported\n");
+    tp_puts(ptp, (TC & 0x2) ? "* Card IDentifier supported\n" : "* Card IDentifier not supported\n");
   }
-  if (pnai->szAtsLen && verbose) {
-    // Decode ATS according to ISO/IEC 14443-4 (5.2 Answer to select)
-    const int iMaxFrameSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
-    off += snprintf(dst + off, size - off, "* Max Frame Size accepted by PICC: %d bytes\n", iMaxFrameSizes[pnai->abtAts[0] & 0x0F]);
-
-    size_t offset = 1;
-    if (pnai->abtAts[0] & 0x10) { // TA(1) present
-      uint8_t TA = pnai->abtAts[offset];
-      offset++;
-      off += snprintf(dst + off, size - off, "* Bit Rate Capability:\n");
-      if (TA == 0) {
-        off += snprintf(dst + off, size - off, "  * PICC supports only 106 kbits/s in both directions\n");
-      }
-      if (TA & 1 << 7) {
-        off += snprintf(dst + off, size - off, "  * Same bitrate in both directions mandatory\n");
-      }
-      if (TA & 1 << 4) {
-        off += snprintf(dst + off, size - off, "  * PICC to PCD, DS=2, bitrate 212 kbits/s supported\n");
-      }
-      if (TA & 1 << 5) {
-        off += snprintf(dst + off, size - off, "  * PICC to PCD, DS=4, bitrate 424 kbits/s supported\n");
-      }
-      if (TA & 1 << 6) {
-        off += snprintf(dst + off, size - off, "  * PICC to PCD, DS=8, bitrate 847 kbits/s supported\n");
+  if (pnai->szAtsLen > offset) {
+    tp_puts(ptp, "* Historical bytes Tk: ");
+    tp_hex(ptp, pnai->abtAts + offset, (pnai->szAtsLen - offset));
+    uint8_t CIB = pnai->abtAts[offset];
+    offset++;
+    if (CIB != 0x00 && CIB != 0x10 && (CIB & 0xf0) != 0x80) {
+      tp_puts(ptp, "  * Proprietary format\n");
+      if (CIB == 0xc1) {
+        tp_puts(ptp, "    * Tag byte: Mifare or virtual cards of various types\n");
+        print_mifare_historical_bytes(ptp, pnai, offset);
       }
-      if (TA & 1 << 0) {
-        off += snprintf(dst + off, size - off, "  * PCD to PICC, DR=2, bitrate 212 kbits/s supported\n");
-      }
-      if (TA & 1 << 1) {
-        off += snprintf(dst + off, size - off, "  * PCD to PICC, DR=4, bitrate 424 kbits/s supported\n");
-      }
-      if (TA & 1 << 2) {
-        off += snprintf(dst + off, size - off, "  * PCD to PICC, DR=8, bitrate 847 kbits/s supported\n");
-      }
-      if (TA & 1 << 3) {
-        off += snprintf(dst + off, size - off, "  * ERROR unknown value\n");
-      }
-    }
-    if (pnai->abtAts[0] & 0x20) { // TB(1) present
-      uint8_t TB = pnai->abtAts[offset];
-      offset++;
-      off += snprintf(dst + off, size - off, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((TB & 0xf0) >> 4)) / 13560.0);
-      if ((TB & 0x0f) == 0) {
-        off += snprintf(dst + off, size - off, "* No Start-up Frame Guard Time required\n");
-      } else {
-        off += snprintf(dst + off, size - off, "* Start-up Frame Guard Time: %.4g ms\n", 256.0 * 16.0 * (1 << (TB & 0x0f)) / 13560.0);
-      }
-    }
-    if (pnai->abtAts[0] & 0x40) { // TC(1) present
-      uint8_t TC = pnai->abtAts[offset];
-      offset++;
-      if (TC & 0x1) {
-        off += snprintf(dst + off, size - off, "* Node Address supported\n");
-      } else {
-        off += snprintf(dst + off, size - off, "* Node Address not supported\n");
+    } else {
+      if (CIB == 0x00) {
+        tp_puts(ptp, "  * Tk after 0x00 consist of optional consecutive COMPACT-TLV data objects\n"
+                "    followed by a mandatory status indicator (the last three bytes, not in TLV)\n"
+                "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
       }
-      if (TC & 0x2) {
-        off += snprintf(dst + off, size - off, "* Card IDentifier supported\n");
-      } else {
-        off += snprintf(dst + off, size - off, "* Card IDentifier not supported\n");
+      if (CIB == 0x10) {
+        tp_printf(ptp, "  * DIR data reference: %02x\n", pnai->abtAts[offset]);
       }
-    }
-    if (pnai->szAtsLen > offset) {
-      off += snprintf(dst + off, size - off, "* Historical bytes Tk: ");
-      off += snprint_hex(dst + off, size - off, pnai->abtAts + offset, (pnai->szAtsLen - offset));
-      uint8_t CIB = pnai->abtAts[offset];
-      offset++;
-      if (CIB != 0x00 && CIB != 0x10 && (CIB & 0xf0) != 0x80) {
-        off += snprintf(dst + off, size - off, "  * Proprietary format\n");
-        if (CIB == 0xc1) {
-          off += snprintf(dst + off, size - off, "    * Tag byte: Mifare or virtual cards of various types\n");
-          uint8_t L = pnai->abtAts[offset];
-          offset++;
-          if (L != (pnai->szAtsLen - offset)) {
-            off += snprintf(dst + off, size - off, "    * Warning: Type Identification Coding length (%i)", L);
-            off += snprintf(dst + off, size - off, " not matching Tk length (%" PRIdPTR ")\n", (pnai->szAtsLen - offset));
-          }
-          if ((pnai->szAtsLen - offset - 2) > 0) { // Omit 2 CRC bytes
-            uint8_t CTC = pnai->abtAts[offset];
-            offset++;
-            off += snprintf(dst + off, size - off, "    * Chip Type: ");
-            switch (CTC & 0xf0) {
-              case 0x00:
-                off += snprintf(dst + off, size - off, "(Multiple) Virtual Cards\n");
-                break;
-              case 0x10:
-                off += snprintf(dst + off, size - off, "Mifare DESFire\n");
-                break;
-              case 0x20:
-                off += snprintf(dst + off, size - off, "Mifare Plus\n");
-                break;
-              default:
-                off += snprintf(dst + off, size - off, "RFU\n");
-                break;
-            }
-            off += snprintf(dst + off, size - off, "    * Memory size: ");
-            switch (CTC & 0x0f) {
-              case 0x00:
-                off += snprintf(dst + off, size - off, "<1 kbyte\n");
-                break;
-              case 0x01:
-                off += snprintf(dst + off, size - off, "1 kbyte\n");
-                break;
-              case 0x02:
-                off += snprintf(dst + off, size - off, "2 kbyte\n");
-                break;
-              case 0x03:
-                off += snprintf(dst + off, size - off, "4 kbyte\n");
-                break;
-              case 0x04:
-                off += snprintf(dst + off, size - off, "8 kbyte\n");
-                break;
-              case 0x0f:
-                off += snprintf(dst + off, size - off, "Unspecified\n");
-                break;
-              default:
-                off += snprintf(dst + off, size - off, "RFU\n");
-                break;
-            }
-          }
-          if ((pnai->szAtsLen - offset) > 0) { // Omit 2 CRC bytes
-            uint8_t CVC = pnai->abtAts[offset];
-            offset++;
-            off += snprintf(dst + off, size - off, "    * Chip Status: ");
-            switch (CVC & 0xf0) {
-              case 0x00:
-                off += snprintf(dst + off, size - off, "Engineering sample\n");
-                break;
-              case 0x20:
-                off += snprintf(dst + off, size - off, "Released\n");
-                break;
-              default:
-                off += snprintf(dst + off, size - off, "RFU\n");
-                break;
-            }
-            off += snprintf(dst + off, size - off, "    * Chip Generation: ");
-            switch (CVC & 0x0f) {
-              case 0x00:
-                off += snprintf(dst + off, size - off, "Generation 1\n");
-                break;
-              case 0x01:
-                off += snprintf(dst + off, size - off, "Generation 2\n");
-                break;
-              case 0x02:
-                off += snprintf(dst + off, size - off, "Generation 3\n");
-                break;
-              case 0x0f:
-                off += snprintf(dst + off, size - off, "Unspecified\n");
-                break;
-              default:
-                off += snprintf(dst + off, size - off, "RFU\n");
-                break;
-            }
-          }
-          if ((pnai->szAtsLen - offset) > 0) { // Omit 2 CRC bytes
-            uint8_t VCS = pnai->abtAts[offset];
-            offset++;
-            off += snprintf(dst + off, size - off, "    * Specifics (Virtual Card Selection):\n");
-            if ((VCS & 0x09) == 0x00) {
-              off += snprintf(dst + off, size - off, "      * Only VCSL supported\n");
-            } else if ((VCS & 0x09) == 0x01) {
-              off += snprintf(dst + off, size - off, "      * VCS, VCSL and SVC supported\n");
-            }
-            if ((VCS & 0x0e) == 0x00) {
-              off += snprintf(dst + off, size - off, "      * SL1, SL2(?), SL3 supported\n");
-            } else if ((VCS & 0x0e) == 0x02) {
-              off += snprintf(dst + off, size - off, "      * SL3 only card\n");
-            } else if ((VCS & 0x0f) == 0x0e) {
-              off += snprintf(dst + off, size - off, "      * No VCS command supported\n");
-            } else if ((VCS & 0x0f) == 0x0f) {
-              off += snprintf(dst + off, size - off, "      * Unspecified\n");
-            } else {
-              off += snprintf(dst + off, size - off, "      * RFU\n");
-            }
-          }
-        }
-      } else {
-        if (CIB == 0x00) {
-          off += snprintf(dst + off, size - off, "  * Tk after 0x00 consist of optional consecutive COMPACT-TLV data objects\n");
-          off += snprintf(dst + off, size - off, "    followed by a mandatory status indicator (the last three bytes, not in TLV)\n");
-          off += snprintf(dst + off, size - off, "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
-        }
-        if (CIB == 0x10) {
-          off += snprintf(dst + off, size - off, "  * DIR data reference: %02x\n", pnai->abtAts[offset]);
-        }
-        if (CIB == 0x80) {
-          if (pnai->szAtsLen == offset) {
-            off += snprintf(dst + off, size - off, "  * No COMPACT-TLV objects found, no status found\n");
-          } else {
-            off += snprintf(dst + off, size - off, "  * Tk after 0x80 consist of optional consecutive COMPACT-TLV data objects;\n");
-            off += snprintf(dst + off, size - off, "    the last data object may carry a status indicator of one, two or three bytes.\n");
-            off += snprintf(dst + off, size - off, "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
-          }
+      if (CIB == 0x80) {
+        if (pnai->szAtsLen == offset) {
+          tp_puts(ptp, "  * No COMPACT-TLV objects found, no status found\n");
+        } else {
+          tp_puts(ptp, "  * Tk after 0x80 consist of optional consecutive COMPACT-TLV data objects;\n"
+                  "    the last data object may carry a status indicator of one, two or three bytes.\n"
+                  "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
         }
       }
     }
   }
-  if (verbose) {
-    off += snprintf(dst + off, size - off, "\nFingerprinting based on MIFARE type Identification Procedure:\n"); // AN10833
-    uint16_t atqa = 0;
-    uint8_t sak = 0;
-    uint8_t i, j;
-    bool found_possible_match = false;
-
-    atqa = (((uint16_t)pnai->abtAtqa[0] & 0xff) << 8);
-    atqa += (((uint16_t)pnai->abtAtqa[1] & 0xff));
-    sak = ((uint8_t)pnai->btSak & 0xff);
-
-    for (i = 0; i < sizeof(const_ca) / sizeof(const_ca[0]); i++) {
-      if ((atqa & const_ca[i].mask) == const_ca[i].atqa) {
-        for (j = 0; (j < sizeof(const_ca[i].saklist) / sizeof(const_ca[i].saklist[0])) && (const_ca[i].saklist[j] >= 0); j++) {
-          int sakindex = const_ca[i].saklist[j];
-          if ((sak & const_cs[sakindex].mask) == const_cs[sakindex].sak) {
-            off += snprintf(dst + off, size - off, "* %s%s\n", const_ca[i].type, const_cs[sakindex].type);
-            found_possible_match = true;
-          }
+}
+
+// Fingerprinting based on MIFARE type Identification Procedure (AN10833)
+static void
+print_iso14443a_fingerprint(struct target_printer *ptp, const nfc_iso14443a_info *pnai)
+{
+  tp_puts(ptp, "\nFingerprinting based on MIFARE type Identification Procedure:\n");
+  const uint16_t atqa = (((uint16_t)pnai->abtAtqa[0] & 0xff) << 8) | ((uint16_t)pnai->abtAtqa[1] & 0xff);
+  const uint8_t sak = ((uint8_t)pnai->btSak & 0xff);
+  bool found_possible_match = false;
+
+  for (size_t i = 0; i < sizeof(const_ca) / sizeof(const_ca[0]); i++) {
+    if ((atqa & const_ca[i].mask) == const_ca[i].atqa) {
+      for (size_t j = 0; (j < sizeof(const_ca[i].saklist) / sizeof(const_ca[i].saklist[0])) && (const_ca[i].saklist[j] >= 0); j++) {
+        int sakindex = const_ca[i].saklist[j];
+        if ((sak & const_cs[sakindex].mask) == const_cs[sakindex].sak) {
+          tp_printf(ptp, "* %s%s\n", const_ca[i].type, const_cs[sakindex].type);
+          found_possible_match = true;
         }
       }
     }
-    // Other matches not described in
-    // AN10833 MIFARE Type Identification Procedure
-    // but seen in the field:
-    off += snprintf(dst + off, size - off, "Other possible matches based on ATQA & SAK values:\n");
-    uint32_t atqasak = 0;
-    atqasak += (((uint32_t)pnai->abtAtqa[0] & 0xff) << 16);
-    atqasak += (((uint32_t)pnai->abtAtqa[1] & 0xff) << 8);
-    atqasak += ((uint32_t)pnai->btSak & 0xff);
-    switch (atqasak) {
-      case 0x000488:
-        off += snprintf(dst + off, size - off, "* Mifare Classic 1K Infineon\n");
-        found_possible_match = true;
-        break;
-      case 0x000298:
-        off += snprintf(dst + off, size - off, "* Gemplus MPCOS\n");
-        found_possible_match = true;
-        break;
-      case 0x030428:
-        off += snprintf(dst + off, size - off, "* JCOP31\n");
-        found_possible_match = true;
-        break;
-      case 0x004820:
-        off += snprintf(dst + off, size - off, "* JCOP31 v2.4.1\n");
-        off += snprintf(dst + off, size - off, "* JCOP31 v2.2\n");
-        found_possible_match = true;
-        break;
-      case 0x000428:
-        off += snprintf(dst + off, size - off, "* JCOP31 v2.3.1\n");
-        found_possible_match = true;
-        break;
-      case 0x000453:
-        off += snprintf(dst + off, size - off, "* Fudan FM1208SH01\n");
-        found_possible_match = true;
-        break;
-      case 0x000820:
-        off += snprintf(dst + off, size - off, "* Fudan FM1208\n");
-        found_possible_match = true;
-        break;
-      case 0x000238:
-        off += snprintf(dst + off, size - off, "* MFC 4K emulated by Nokia 6212 Classic\n");
-        found_possible_match = true;
+  }
+  tp_puts(ptp, "Other possible matches based on ATQA & SAK values:\n");
+  const uint32_t atqasak = ((uint32_t) atqa << 8) | sak;
+  for (size_t i = 0; i < sizeof(iso14443a_seen_cards) / sizeof(iso14443a_seen_cards[0]); i++) {
+    if (iso14443a_seen_cards[i].value == atqasak) {
+      tp_puts(ptp, iso14443a_seen_cards[i].text);
+      found_possible_match = true;
+    }
+  }
+  if (! found_possible_match) {
+    tp_puts(ptp, "* Unknown card, sorry\n");
+  }
+}
+
+static void
+print_nfc_iso14443a_info(struct target_printer *ptp, const nfc_iso14443a_info *pnai, bool verbose)
+{
+  tp_puts(ptp, "    ATQA (SENS_RES): ");
+  tp_hex(ptp, pnai->abtAtqa, 2);
+  if (verbose) {
+    tp_puts(ptp, "* UID size: ");
+    tp_puts(ptp, iso14443a_uid_sizes[(pnai->abtAtqa[1] & 0xc0) >> 6]);
+    tp_puts(ptp, "* bit frame anticollision ");
+    switch (pnai->abtAtqa[1] & 0x1f) {
+      case 0x01:
+      case 0x02:
+      case 0x04:
+      case 0x08:
+      case 0x10:
+        tp_puts(ptp, "supported\n");
         break;
-      case 0x000838:
-        off += snprintf(dst + off, size - off, "* MFC 4K emulated by Nokia 6131 NFC\n");
-        found_possible_match = true;
+      default:
+        tp_puts(ptp, "not supported\n");
         break;
     }
-    if (! found_possible_match) {
-      snprintf(dst + off, size - off, "* Unknown card, sorry\n");
+  }
+  tp_puts(ptp, (pnai->abtUid[0] == 0x08) ? "       UID (NFCID3): " : "       UID (NFCID1): ");
+  tp_hex(ptp, pnai->abtUid, pnai->szUidLen);
+  if (verbose && (pnai->abtUid[0] == 0x08)) {
+    tp_puts(ptp, "* Random UID\n");
+  }
+  tp_puts(ptp, "      SAK (SEL_RES): ");
+  tp_hex(ptp, &pnai->btSak, 1);
+  if (verbose) {
+    if (pnai->btSak & SAK_UID_NOT_COMPLETE) {
+      tp_puts(ptp, "* Warning! Cascade bit set: UID not complete\n");
     }
+    tp_puts(ptp, (pnai->btSak & SAK_ISO14443_4_COMPLIANT) ? "* Compliant with ISO/IEC 14443-4\n" : "* Not compliant with ISO/IEC 14443-4\n");
+    tp_puts(ptp, (pnai->btSak & SAK_ISO18092_COMPLIANT) ? "* Compliant with ISO/IEC 18092\n" : "* Not compliant with ISO/IEC 18092\n");
+  }
+  if (pnai->szAtsLen) {
+    tp_puts(ptp, "                ATS: ");
+    tp_hex(ptp, pnai->abtAts, pnai->szAtsLen);
+    if (verbose)
+      print_iso14443a_ats(ptp, pnai);
   }
+  if (verbose)
+    print_iso14443a_fingerprint(ptp, pnai);
 }
 
-void
-snprint_nfc_felica_info(char *dst, size_t size, const nfc_felica_info *pnfi, bool verbose)
+static void
+print_nfc_felica_info(struct target_printer *ptp, const nfc_felica_info *pnfi, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "        ID (NFCID2): ");
-  off += snprint_hex(dst + off, size - off, pnfi->abtId, 8);
-  off += snprintf(dst + off, size - off, "    Parameter (PAD): ");
-  off += snprint_hex(dst + off, size - off, pnfi->abtPad, 8);
-  off += snprintf(dst + off, size - off, "   System Code (SC): ");
-  snprint_hex(dst + off, size - off, pnfi->abtSysCode, 2);
+  tp_puts(ptp, "        ID (NFCID2): ");
+  tp_hex(ptp, pnfi->abtId, 8);
+  tp_puts(ptp, "    Parameter (PAD): ");
+  tp_hex(ptp, pnfi->abtPad, 8);
+  tp_puts(ptp, "   System Code (SC): ");
+  tp_hex(ptp, pnfi->abtSysCode, 2);
 }
 
-void
-snprint_nfc_jewel_info(char *dst, size_t size, const nfc_jewel_info *pnji, bool verbose)
+static void
+print_nfc_jewel_info(struct target_printer *ptp, const nfc_jewel_info *pnji, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "    ATQA (SENS_RES): ");
-  off += snprint_hex(dst + off, size - off, pnji->btSensRes, 2);
-  off += snprintf(dst + off, size - off, "      4-LSB JEWELID: ");
-  snprint_hex(dst + off, size - off, pnji->btId, 4);
+  tp_puts(ptp, "    ATQA (SENS_RES): ");
+  tp_hex(ptp, pnji->btSensRes, 2);
+  tp_puts(ptp, "      4-LSB JEWELID: ");
+  tp_hex(ptp, pnji->btId, 4);
 }
 
-void
-snprint_nfc_barcode_info(char *dst, size_t size, const nfc_barcode_info *pnti, bool verbose)
+static void
+print_nfc_barcode_info(struct target_printer *ptp, const nfc_barcode_info *pnti, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "        Size (bits): %lu\n", pnti->szDataLen * 8);
-  off += snprintf(dst + off, size - off, "            Content: ");
+  tp_printf(ptp, "        Size (bits): %lu\n", (unsigned long)(pnti->szDataLen * 8));
+  tp_puts(ptp, "            Content: ");
   for (uint8_t i = 0; i < pnti->szDataLen; i++) {
-    off += snprintf(dst + off, size - off, "%02X", pnti->abtData[i]);
+    tp_printf(ptp, "%02X", pnti->abtData[i]);
     if ((i % 8 == 7) && (i < (pnti->szDataLen - 1))) {
-      off += snprintf(dst + off, size - off, "\n                     ");
+      tp_puts(ptp, "\n                     ");
     }
   }
-  snprintf(dst + off, size - off, "\n");
+  tp_puts(ptp, "\n");
 }
 
 #define PI_ISO14443_4_SUPPORTED 0x01
 #define PI_NAD_SUPPORTED        0x01
 #define PI_CID_SUPPORTED        0x02
-void
-snprint_nfc_iso14443b_info(char *dst, size_t size, const nfc_iso14443b_info *pnbi, bool verbose)
+
+// First byte of the ATQB Protocol Info (ISO/IEC 14443-3 7.9.3)
+static const struct target_flag iso14443b_bitrate_flags[] = {
+  { 1 << 7, " * Same bitrate in both directions mandatory\n" },
+  { 1 << 4, " * PICC to PCD, 1etu=64/fc, bitrate 212 kbits/s supported\n" },
+  { 1 << 5, " * PICC to PCD, 1etu=32/fc, bitrate 424 kbits/s supported\n" },
+  { 1 << 6, " * PICC to PCD, 1etu=16/fc, bitrate 847 kbits/s supported\n" },
+  { 1 << 0, " * PCD to PICC, 1etu=64/fc, bitrate 212 kbits/s supported\n" },
+  { 1 << 1, " * PCD to PICC, 1etu=32/fc, bitrate 424 kbits/s supported\n" },
+  { 1 << 2, " * PCD to PICC, 1etu=16/fc, bitrate 847 kbits/s supported\n" },
+  { 1 << 3, " * ERROR unknown value\n" },
+};
+
+static const struct target_flag iso14443b_frame_options[] = {
+  { PI_NAD_SUPPORTED, "NAD " },
+  { PI_CID_SUPPORTED, "CID " },
+};
+
+static void
+print_nfc_iso14443b_info(struct target_printer *ptp, const nfc_iso14443b_info *pnbi, bool verbose)
 {
-  int off = 0;
-  off += snprintf(dst + off, size - off, "               PUPI: ");
-  off += snprint_hex(dst + off, size - off, pnbi->abtPupi, 4);
-  off += snprintf(dst + off, size - off, "   Application Data: ");
-  off += snprint_hex(dst + off, size - off, pnbi->abtApplicationData, 4);
-  off += snprintf(dst + off, size - off, "      Protocol Info: ");
-  off += snprint_hex(dst + off, size - off, pnbi->abtProtocolInfo, 3);
+  tp_puts(ptp, "               PUPI: ");
+  tp_hex(ptp, pnbi->abtPupi, 4);
+  tp_puts(ptp, "   Application Data: ");
+  tp_hex(ptp, pnbi->abtApplicationData, 4);
+  tp_puts(ptp, "      Protocol Info: ");
+  tp_hex(ptp, pnbi->abtProtocolInfo, 3);
   if (verbose) {
-    off += snprintf(dst + off, size - off, "* Bit Rate Capability:\n");
+    tp_puts(ptp, "* Bit Rate Capability:\n");
     if (pnbi->abtProtocolInfo[0] == 0) {
-      off += snprintf(dst + off, size - off, " * PICC supports only 106 kbits/s in both directions\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 7) {
-      off += snprintf(dst + off, size - off, " * Same bitrate in both directions mandatory\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 4) {
-      off += snprintf(dst + off, size - off, " * PICC to PCD, 1etu=64/fc, bitrate 212 kbits/s supported\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 5) {
-      off += snprintf(dst + off, size - off, " * PICC to PCD, 1etu=32/fc, bitrate 424 kbits/s supported\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 6) {
-      off += snprintf(dst + off, size - off, " * PICC to PCD, 1etu=16/fc, bitrate 847 kbits/s supported\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 0) {
-      off += snprintf(dst + off, size - off, " * PCD to PICC, 1etu=64/fc, bitrate 212 kbits/s supported\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 1) {
-      off += snprintf(dst + off, size - off, " * PCD to PICC, 1etu=32/fc, bitrate 424 kbits/s supported\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 2) {
-      off += snprintf(dst + off, size - off, " * PCD to PICC, 1etu=16/fc, bitrate 847 kbits/s supported\n");
-    }
-    if (pnbi->abtProtocolInfo[0] & 1 << 3) {
-      off += snprintf(dst + off, size - off, " * ERROR unknown value\n");
+      tp_puts(ptp, " * PICC supports only 106 kbits/s in both directions\n");
     }
+    TP_FLAGS(ptp, pnbi->abtProtocolInfo[0], iso14443b_bitrate_flags);
     if ((pnbi->abtProtocolInfo[1] & 0xf0) <= 0x80) {
-      const int iMaxFrameSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
-      off += snprintf(dst + off, size - off, "* Maximum frame sizes: %d bytes\n", iMaxFrameSizes[((pnbi->abtProtocolInfo[1] & 0xf0) >> 4)]);
+      tp_printf(ptp, "* Maximum frame sizes: %d bytes\n", iso14443_max_frame_sizes[((pnbi->abtProtocolInfo[1] & 0xf0) >> 4)]);
     }
     if ((pnbi->abtProtocolInfo[1] & 0x01) == PI_ISO14443_4_SUPPORTED) {
       // in principle low nibble could only be 0000 or 0001 and other values are RFU
       // but in practice we found 0011 so let's use only last bit for -4 compatibility
-      off += snprintf(dst + off, size - off, "* Protocol types supported: ISO/IEC 14443-4\n");
+      tp_puts(ptp, "* Protocol types supported: ISO/IEC 14443-4\n");
     }
-    off += snprintf(dst + off, size - off, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((pnbi->abtProtocolInfo[2] & 0xf0) >> 4)) / 13560.0);
+    tp_printf(ptp, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((pnbi->abtProtocolInfo[2] & 0xf0) >> 4)) / 13560.0);
     if ((pnbi->abtProtocolInfo[2] & (PI_NAD_SUPPORTED | PI_CID_SUPPORTED)) != 0) {
-      off += snprintf(dst + off, size - off, "* Frame options supported: ");
-      if ((pnbi->abtProtocolInfo[2] & PI_NAD_SUPPORTED) != 0) off += snprintf(dst + off, size - off, "NAD ");
-      if ((pnbi->abtProtocolInfo[2] & PI_CID_SUPPORTED) != 0) off += snprintf(dst + off, size - off, "CID ");
-      snprintf(dst + off, size - off, "\n");
+      tp_puts(ptp, "* Frame options supported: ");
+      TP_FLAGS(ptp, pnbi->abtProtocolInfo[2], iso14443b_frame_options);
+      tp_puts(ptp, "\n");
     }
   }
 }
 
-void
-snprint_nfc_iso14443bi_info(char *dst, size_t size, const nfc_iso14443bi_info *pnii, bool verbose)
+static void
+print_nfc_iso14443bi_info(struct target_printer *ptp, const nfc_iso14443bi_info *pnii, bool verbose)
 {
-  int off = 0;
-  off += snprintf(dst + off, size - off, "                DIV: ");
-  off += snprint_hex(dst + off, size - off, pnii->abtDIV, 4);
+  tp_puts(ptp, "                DIV: ");
+  tp_hex(ptp, pnii->abtDIV, 4);
   if (verbose) {
     int version = (pnii->btVerLog & 0x1e) >> 1;
-    off += snprintf(dst + off, size - off, "   Software Version: ");
+    tp_puts(ptp, "   Software Version: ");
     if (version == 15) {
-      off += snprintf(dst + off, size - off, "Undefined\n");
+      tp_puts(ptp, "Undefined\n");
     } else {
-      off += snprintf(dst + off, size - off, "%i\n", version);
+      tp_printf(ptp, "%i\n", version);
     }
 
     if ((pnii->btVerLog & 0x80) && (pnii->btConfig & 0x80)) {
-      off += snprintf(dst + off, size - off, "        Wait Enable: yes");
+      tp_puts(ptp, "        Wait Enable: yes");
     }
   }
   if ((pnii->btVerLog & 0x80) && (pnii->btConfig & 0x40)) {
-    off += snprintf(dst + off, size - off, "                ATS: ");
-    snprint_hex(dst + off, size - off, pnii->abtAtr, pnii->szAtrLen);
+    tp_puts(ptp, "                ATS: ");
+    tp_hex(ptp, pnii->abtAtr, pnii->szAtrLen);
   }
 }
 
-void
-snprint_nfc_iso14443b2sr_info(char *dst, size_t size, const nfc_iso14443b2sr_info *pnsi, bool verbose)
+static void
+print_nfc_iso14443b2sr_info(struct target_printer *ptp, const nfc_iso14443b2sr_info *pnsi, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "                UID: ");
-  snprint_hex(dst + off, size - off, pnsi->abtUID, 8);
+  tp_puts(ptp, "                UID: ");
+  tp_hex(ptp, pnsi->abtUID, 8);
 }
 
-void
-snprint_nfc_iso14443b2ct_info(char *dst, size_t size, const nfc_iso14443b2ct_info *pnci, bool verbose)
+static void
+print_nfc_iso14443b2ct_info(struct target_printer *ptp, const nfc_iso14443b2ct_info *pnci, bool verbose)
 {
   (void) verbose;
-  int off = 0;
   uint32_t uid;
   uid = (pnci->abtUID[3] << 24) + (pnci->abtUID[2] << 16) + (pnci->abtUID[1] << 8) + pnci->abtUID[0];
-  off += snprintf(dst + off, size - off, "                UID: ");
-  off += snprint_hex(dst + off, size - off, pnci->abtUID, sizeof(pnci->abtUID));
-  off += snprintf(dst + off, size - off, "      UID (decimal): %010u\n", uid);
-  off += snprintf(dst + off, size - off, "       Product Code: %02X\n", pnci->btProdCode);
-  snprintf(dst + off, size - off, "           Fab Code: %02X\n", pnci->btFabCode);
+  tp_puts(ptp, "                UID: ");
+  tp_hex(ptp, pnci->abtUID, sizeof(pnci->abtUID));
+  tp_printf(ptp, "      UID (decimal): %010u\n", uid);
+  tp_printf(ptp, "       Product Code: %02X\n", pnci->btProdCode);
+  tp_printf(ptp, "           Fab Code: %02X\n", pnci->btFabCode);
 }
 
-void
-snprint_nfc_dep_info(char *dst, size_t size, const nfc_dep_info *pndi, bool verbose)
+static void
+print_nfc_dep_info(struct target_printer *ptp, const nfc_dep_info *pndi, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "       NFCID3: ");
-  off += snprint_hex(dst + off, size - off, pndi->abtNFCID3, 10);
-  off += snprintf(dst + off, size - off, "           BS: %02x\n", pndi->btBS);
-  off += snprintf(dst + off, size - off, "           BR: %02x\n", pndi->btBR);
-  off += snprintf(dst + off, size - off, "           TO: %02x\n", pndi->btTO);
-  off += snprintf(dst + off, size - off, "           PP: %02x\n", pndi->btPP);
+  tp_puts(ptp, "       NFCID3: ");
+  tp_hex(ptp, pndi->abtNFCID3, 10);
+  tp_printf(ptp, "           BS: %02x\n", pndi->btBS);
+  tp_printf(ptp, "           BR: %02x\n", pndi->btBR);
+  tp_printf(ptp, "           TO: %02x\n", pndi->btTO);
+  tp_printf(ptp, "           PP: %02x\n", pndi->btPP);
   if (pndi->szGB) {
-    off += snprintf(dst + off, size - off, "General Bytes: ");
-    snprint_hex(dst + off, size - off, pndi->abtGB, pndi->szGB);
+    tp_puts(ptp, "General Bytes: ");
+    tp_hex(ptp, pndi->abtGB, pndi->szGB);
   }
 }
 
-void
+/** @ingroup string-converter
+ * @brief Convert \a nfc_target content to printable string, in a caller buffer
+ * @return Returns the length of the string, like snprintf(): it was truncated if this is \a size or more
+ * @param dst buffer to write to, always NUL terminated unless \a size is 0
+ * @param size size of \a dst
+ * @param pnt \a nfc_target struct pointer where target information are stored
+ * @param verbose false for essential, true for full details
+ *
+ * Same as str_nfc_target() but nothing is allocated.
+ */
+int
 snprint_nfc_target(char *dst, size_t size, const nfc_target *pnt, bool verbose)
 {
+  struct target_printer tp = { dst, size, 0 };
+  if (size)
+    dst[0] = '\0';
   if (NULL != pnt) {
-    int off = 0;
-    off += snprintf(dst + off, size - off, "%s (%s%s) target:\n", str_nfc_modulation_type(pnt->nm.nmt), str_nfc_baud_rate(pnt->nm.nbr), (pnt->nm.nmt != NMT_DEP) ? "" : (pnt->nti.ndi.ndm == NDM_ACTIVE) ? "active mode" : "passive mode");
+    tp_puts(&tp, str_nfc_modulation_type(pnt->nm.nmt));
+    tp_puts(&tp, " (");
+    tp_puts(&tp, str_nfc_baud_rate(pnt->nm.nbr));
+    tp_puts(&tp, (pnt->nm.nmt != NMT_DEP) ? "" : (pnt->nti.ndi.ndm == NDM_ACTIVE) ? "active mode" : "passive mode");
+    tp_puts(&tp, ") target:\n");
     switch (pnt->nm.nmt) {
       case NMT_ISO14443A:
-        snprint_nfc_iso14443a_info(dst + off, size - off, &pnt->nti.nai, verbose);
+        print_nfc_iso14443a_info(&tp, &pnt->nti.nai, verbose);
         break;
       case NMT_JEWEL:
-        snprint_nfc_jewel_info(dst + off, size - off, &pnt->nti.nji, verbose);
+        print_nfc_jewel_info(&tp, &pnt->nti.nji, verbose);
         break;
       case NMT_BARCODE:
-        snprint_nfc_barcode_info(dst + off, size - off, &pnt->nti.nti, verbose);
+        print_nfc_barcode_info(&tp, &pnt->nti.nti, verbose);
         break;
       case NMT_FELICA:
-        snprint_nfc_felica_info(dst + off, size - off, &pnt->nti.nfi, verbose);
+        print_nfc_felica_info(&tp, &pnt->nti.nfi, verbose);
         break;
       case NMT_ISO14443B:
-        snprint_nfc_iso14443b_info(dst + off, size - off, &pnt->nti.nbi, verbose);
+        print_nfc_iso14443b_info(&tp, &pnt->nti.nbi, verbose);
         break;
       case NMT_ISO14443BI:
-        snprint_nfc_iso14443bi_info(dst + off, size - off, &pnt->nti.nii, verbose);
+        print_nfc_iso14443bi_info(&tp, &pnt->nti.nii, verbose);
         break;
       case NMT_ISO14443B2SR:
-        snprint_nfc_iso14443b2sr_info(dst + off, size - off, &pnt->nti.nsi, verbose);
+        print_nfc_iso14443b2sr_info(&tp, &pnt->nti.nsi, verbose);
         break;
       case NMT_ISO14443B2CT:
-        snprint_nfc_iso14443b2ct_info(dst + off, size - off, &pnt->nti.nci, verbose);
+        print_nfc_iso14443b2ct_info(&tp, &pnt->nti.nci, verbose);
         break;
       case NMT_DEP:
-        snprint_nfc_dep_info(dst + off, size - off, &pnt->nti.ndi, verbose);
+        print_nfc_dep_info(&tp, &pnt->nti.ndi, verbose);
         break;
     }
   }
+  return tp.off;
 }
-
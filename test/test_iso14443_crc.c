@@ -0,0 +1,54 @@
+#include <cutter.h>
+
+#include <nfc/nfc.h>
+
+/*
+ * Check CRC_A and CRC_B against ISO/IEC 14443-3 Annex B examples and
+ * ensure incremental computation gives the same result.
+ */
+void test_iso14443a_crc(void);
+void test_iso14443b_crc(void);
+void test_iso14443_crc_update(void);
+
+void
+test_iso14443a_crc(void)
+{
+  uint8_t abtData[] = { 0x00, 0x00 };
+  uint8_t abtCrc[2];
+
+  iso14443a_crc(abtData, sizeof(abtData), abtCrc);
+  cut_assert_equal_memory("\xa0\x1e", 2, abtCrc, sizeof(abtCrc), cut_message("CRC_A of 00 00"));
+
+  uint8_t abtData2[] = { 0x12, 0x34 };
+  iso14443a_crc(abtData2, sizeof(abtData2), abtCrc);
+  cut_assert_equal_memory("\x26\xcf", 2, abtCrc, sizeof(abtCrc), cut_message("CRC_A of 12 34"));
+}
+
+void
+test_iso14443b_crc(void)
+{
+  uint8_t abtData[] = { 0x00, 0x00, 0x00 };
+  uint8_t abtCrc[2];
+
+  iso14443b_crc(abtData, sizeof(abtData), abtCrc);
+  cut_assert_equal_memory("\xcc\xc6", 2, abtCrc, sizeof(abtCrc), cut_message("CRC_B of 00 00 00"));
+
+  uint8_t abtData2[] = { 0x0f, 0xaa, 0xff };
+  iso14443b_crc(abtData2, sizeof(abtData2), abtCrc);
+  cut_assert_equal_memory("\xfc\xd1", 2, abtCrc, sizeof(abtCrc), cut_message("CRC_B of 0f aa ff"));
+}
+
+void
+test_iso14443_crc_update(void)
+{
+  uint8_t abtData[64 + 2];
+  for (size_t i = 0; i < 64; i++)
+    abtData[i] = (uint8_t)(i * 37 + 11);
+  iso14443a_crc_append(abtData, 64);
+
+  for (size_t szSplit = 0; szSplit <= 64; szSplit++) {
+    uint16_t wCrc = iso14443a_crc_update(ISO14443A_CRC_INIT, abtData, szSplit);
+    wCrc = iso14443a_crc_update(wCrc, abtData + szSplit, 64 - szSplit);
+    cut_assert_equal_uint(abtData[64] | (abtData[65] << 8), wCrc, cut_message("split at %d", (int)szSplit));
+  }
+}
@@ -0,0 +1,213 @@
+#include <cutter.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "nfc/nfc.h"
+#include "../utils/llcp.h"
+#include "../utils/snep.h"
+
+/*
+ * Push an NDEF message from an initiator to a target over SNEP, with the
+ * largest LLCP receive window and the default MIU on the target: the message
+ * goes in about 150 SDUs, the send window filling up and sliding many times.
+ */
+void test_llcp_snep_put(void);
+
+#define INITIATOR 0
+#define TARGET    1
+
+#define NDEF_LEN  20000
+
+pthread_t threads[2];
+nfc_context *context;
+nfc_connstring connstrings[2];
+nfc_device *devices[2];
+intptr_t result[2];
+
+static llcp_link links[2];
+static uint8_t abtNdef[NDEF_LEN];
+
+static void
+abort_test_by_keypress(int sig)
+{
+  (void) sig;
+  printf("\033[0;1;31mSIGINT\033[0m");
+
+  nfc_abort_command(devices[INITIATOR]);
+  nfc_abort_command(devices[TARGET]);
+}
+
+void
+cut_setup(void)
+{
+  nfc_init(&context);
+  size_t n = nfc_list_devices(context, connstrings, 2);
+  if (n < 2) {
+    cut_omit("At least two NFC devices must be plugged-in to run this test");
+  }
+  devices[TARGET] = nfc_open(context, connstrings[TARGET]);
+  devices[INITIATOR] = nfc_open(context, connstrings[INITIATOR]);
+
+  signal(SIGINT, abort_test_by_keypress);
+}
+
+void
+cut_teardown(void)
+{
+  nfc_close(devices[TARGET]);
+  nfc_close(devices[INITIATOR]);
+  nfc_exit(context);
+}
+
+struct thread_data {
+  nfc_device *device;
+  void *cut_test_context;
+};
+
+static void *
+target_thread(void *arg)
+{
+  intptr_t thread_res = 0;
+  nfc_device *device = ((struct thread_data *) arg)->device;
+  cut_set_current_test_context(((struct thread_data *) arg)->cut_test_context);
+  llcp_link *pll = &links[TARGET];
+  llcp_connection lc;
+
+  printf("=========== TARGET %s =========\n", nfc_device_get_name(device));
+  int res = llcp_link_init(pll, device, false, LLCP_MIU, LLCP_RW_MAX);
+  cut_assert_equal_int(0, res, cut_message("Can't initialize LLCP link"));
+  res = snep_server_listen(pll, &lc);
+  cut_assert_equal_int(0, res, cut_message("Can't listen to SNEP"));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  nfc_target nt = {
+    .nm = {
+      .nmt = NMT_DEP,
+      .nbr = NBR_UNDEFINED
+    },
+    .nti = {
+      .ndi = {
+        .abtNFCID3 = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA },
+        .ndm = NDM_PASSIVE,
+        .btPP = 0x32,
+      },
+    },
+  };
+  nt.nti.ndi.szGB = llcp_link_general_bytes(pll, nt.nti.ndi.abtGB, sizeof(nt.nti.ndi.abtGB));
+
+  uint8_t abtRx[1024];
+  res = nfc_target_init(device, &nt, abtRx, sizeof(abtRx), 0);
+  cut_assert_operator_int(res, >, 0, cut_message("Can't initialize NFC device as target: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+  res = llcp_link_activate(pll, abtRx, (size_t) res);
+  cut_assert_equal_int(0, res, cut_message("Can't activate LLCP link as target"));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  uint8_t *pbtRx = malloc(NDEF_LEN);
+  res = snep_server_receive(pll, &lc, pbtRx, NDEF_LEN);
+  cut_assert_equal_int(NDEF_LEN, res, cut_message("Can't receive NDEF message: %s", nfc_strerror(device)));
+  if (res == NDEF_LEN)
+    cut_assert_equal_memory(abtNdef, NDEF_LEN, pbtRx, NDEF_LEN, cut_message("Invalid received NDEF message"));
+  free(pbtRx);
+  if (res != NDEF_LEN) { thread_res = -1; return (void *) thread_res; }
+
+  // Serve the link until the initiator deactivates it
+  while ((res = llcp_link_turn(pll)) >= 0)
+    ;
+  cut_assert_equal_int(NFC_ETGRELEASED, res, cut_message("LLCP link not deactivated: %s", nfc_strerror(device)));
+  llcp_disconnect(pll, &lc);
+  if (res != NFC_ETGRELEASED) { thread_res = -1; return (void *) thread_res; }
+
+  return (void *) thread_res;
+}
+
+static void *
+initiator_thread(void *arg)
+{
+  intptr_t thread_res = 0;
+  nfc_device *device = ((struct thread_data *) arg)->device;
+  cut_set_current_test_context(((struct thread_data *) arg)->cut_test_context);
+  llcp_link *pll = &links[INITIATOR];
+  llcp_connection lc;
+
+  /*
+   * Wait some time for the other thread to initialise NFC device as target
+   */
+  sleep(1);
+  printf("=========== INITIATOR %s =========\n", nfc_device_get_name(device));
+  int res = nfc_initiator_init(device);
+  cut_assert_equal_int(0, res, cut_message("Can't initialize NFC device as initiator: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+  res = llcp_link_init(pll, device, true, 0, LLCP_RW_MAX);
+  cut_assert_equal_int(0, res, cut_message("Can't initialize LLCP link"));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  nfc_dep_info ndi = {
+    .abtNFCID3 = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xff, 0x00, 0x00 },
+    .ndm = NDM_PASSIVE,
+  };
+  ndi.szGB = llcp_link_general_bytes(pll, ndi.abtGB, sizeof(ndi.abtGB));
+
+  nfc_target nt;
+  res = nfc_initiator_select_dep_target(device, NDM_PASSIVE, NBR_424, &ndi, &nt, 1000);
+  cut_assert_operator_int(res, >, 0, cut_message("Can't select any DEP target: %s", nfc_strerror(device)));
+  if (res <= 0) { thread_res = -1; return (void *) thread_res; }
+  res = llcp_link_activate(pll, nt.nti.ndi.abtGB, nt.nti.ndi.szGB);
+  cut_assert_equal_int(0, res, cut_message("Can't activate LLCP link as initiator"));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  res = snep_client_connect(pll, &lc);
+  cut_assert_equal_int(0, res, cut_message("Can't connect to SNEP server: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+  cut_assert_equal_int(LLCP_RW_MAX, lc.ui8PeerRw, cut_message("Invalid receive window of the SNEP server"));
+
+  res = snep_put(pll, &lc, abtNdef, NDEF_LEN);
+  cut_assert_equal_int(SNEP_RES_SUCCESS, res, cut_message("Can't push NDEF message: %s", nfc_strerror(device)));
+  if (res != SNEP_RES_SUCCESS) { thread_res = -1; return (void *) thread_res; }
+
+  res = llcp_disconnect(pll, &lc);
+  cut_assert_equal_int(0, res, cut_message("Can't disconnect from SNEP server: %s", nfc_strerror(device)));
+  res = llcp_link_deactivate(pll);
+  cut_assert_equal_int(0, res, cut_message("Can't deactivate LLCP link: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+  res = nfc_initiator_deselect_target(device);
+  cut_assert_operator_int(res, >=, 0, cut_message("Can't deselect target: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  return (void *) thread_res;
+}
+
+void
+test_llcp_snep_put(void)
+{
+  for (size_t i = 0; i < NDEF_LEN; i++)
+    abtNdef[i] = (uint8_t)(i * 37 + 11);
+
+  CutTestContext *test_context = cut_get_current_test_context();
+  struct thread_data target_data = {
+    .device = devices[TARGET],
+    .cut_test_context = test_context,
+  };
+
+  struct thread_data initiator_data = {
+    .device = devices[INITIATOR],
+    .cut_test_context = test_context,
+  };
+
+  int res;
+
+  if ((res = pthread_create(&(threads[TARGET]), NULL, target_thread, &target_data)))
+    cut_fail("pthread_create() returned %d", res);
+  if ((res = pthread_create(&(threads[INITIATOR]), NULL, initiator_thread, &initiator_data)))
+    cut_fail("pthread_create() returned %d", res);
+
+  if ((res = pthread_join(threads[INITIATOR], (void *) &result[INITIATOR])))
+    cut_fail("pthread_join() returned %d", res);
+  if ((res = pthread_join(threads[TARGET], (void *) &result[TARGET])))
+    cut_fail("pthread_join() returned %d", res);
+
+  cut_assert_equal_int(0, result[INITIATOR], cut_message("Unexpected initiator return code"));
+  cut_assert_equal_int(0, result[TARGET], cut_message("Unexpected target return code"));
+}
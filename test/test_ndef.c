@@ -0,0 +1,77 @@
+#include <cutter.h>
+#include <string.h>
+
+#include "../utils/ndef.h"
+
+/*
+ * Write a single record NDEF message in a Type 2 tag memory and read it back,
+ * around the switch from a one to a three bytes TLV length, with and without
+ * room for the Terminator TLV.
+ */
+void test_ndef_tlv_round_trip(void);
+void test_ndef_tlv_too_short(void);
+
+// Record header, type length, payload length and a one byte type
+#define RECORD_HEADER_LEN 4
+
+static uint8_t abtPayload[0x100];
+
+static void
+round_trip(const size_t szMessage, const bool bTerminator)
+{
+  const size_t szLenLen = (szMessage < 0xFF) ? 1 : 3;
+  const size_t szPayload = szMessage - RECORD_HEADER_LEN;
+  const size_t szBuf = 1 + szLenLen + szMessage + (bTerminator ? 1 : 0);
+  uint8_t abtBuf[0x200];
+  ndef_writer nw;
+
+  for (size_t i = 0; i < szPayload; i++)
+    abtPayload[i] = (uint8_t)(i * 37 + 11);
+  memset(abtBuf, 0xAA, sizeof(abtBuf));
+
+  ndef_writer_init(&nw, abtBuf, szBuf, NDEF_FRAMING_TLV);
+  int res = ndef_writer_add_record(&nw, NDEF_TNF_WELL_KNOWN, (const uint8_t *) "T", 1, abtPayload, szPayload);
+  cut_assert_equal_int(0, res, cut_message("Can't add a %d bytes message to %d bytes", (int) szMessage, (int) szBuf));
+  res = ndef_writer_finish(&nw);
+  cut_assert_equal_int((int) szBuf, res, cut_message("Bad length of a %d bytes message", (int) szMessage));
+  cut_assert_equal_int(0xAA, abtBuf[szBuf], cut_message("Written past a %d bytes buffer", (int) szBuf));
+  if (bTerminator)
+    cut_assert_equal_int(NDEF_TLV_TERMINATOR, abtBuf[szBuf - 1], cut_message("No Terminator TLV"));
+
+  size_t szFound;
+  const uint8_t *pbtMessage = ndef_tlv_find_message(abtBuf, szBuf, &szFound);
+  cut_assert_not_null(pbtMessage, cut_message("No NDEF Message TLV in %d bytes", (int) szBuf));
+  cut_assert_equal_uint(szMessage, szFound, cut_message("Bad NDEF Message TLV length"));
+
+  ndef_iter ni;
+  ndef_record rec;
+  ndef_iter_init(&ni, pbtMessage, szFound);
+  cut_assert_equal_int(1, ndef_record_next(&ni, &rec), cut_message("Can't read the record back"));
+  cut_assert_equal_int(NDEF_MB | NDEF_ME, rec.btHeader & (NDEF_MB | NDEF_ME), cut_message("Record not flagged MB and ME"));
+  cut_assert_equal_memory("T", 1, rec.pbtType, rec.szType, cut_message("Bad record type"));
+  cut_assert_equal_memory(abtPayload, szPayload, rec.pbtPayload, rec.szPayload, cut_message("Bad record payload"));
+  cut_assert_equal_int(0, ndef_record_next(&ni, &rec), cut_message("Unexpected second record"));
+}
+
+void
+test_ndef_tlv_round_trip(void)
+{
+  round_trip(254, false);
+  round_trip(254, true);
+  round_trip(255, false);
+  round_trip(255, true);
+  round_trip(256, false);
+  round_trip(256, true);
+}
+
+void
+test_ndef_tlv_too_short(void)
+{
+  // A 255 bytes message takes 258 bytes with its TLV header
+  uint8_t abtBuf[257];
+  ndef_writer nw;
+
+  ndef_writer_init(&nw, abtBuf, sizeof(abtBuf), NDEF_FRAMING_TLV);
+  ndef_writer_add_record(&nw, NDEF_TNF_WELL_KNOWN, (const uint8_t *) "T", 1, abtPayload, 255 - RECORD_HEADER_LEN);
+  cut_assert_equal_int(-1, ndef_writer_finish(&nw), cut_message("A 255 bytes message fit in 257 bytes"));
+}
@@ -0,0 +1,475 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+/**
+ * @file dump-log.c
+ * @brief Append-only log of card dumps, for reading one card after the other
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "dump-log.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef _WIN32
+#  include <io.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+static const uint8_t abtLogMagic[8] = { 'N', 'F', 'C', 'D', 'U', 'M', 'P', '1' };
+static const uint8_t abtRecordMagic[4] = { 'N', 'D', 'L', 'R' };
+
+static uint32_t
+get_le32(const uint8_t *pbt)
+{
+  return pbt[0] | (pbt[1] << 8) | (pbt[2] << 16) | ((uint32_t) pbt[3] << 24);
+}
+
+static void
+set_le32(uint8_t *pbt, const uint32_t ui32)
+{
+  for (size_t i = 0; i < 4; i++)
+    pbt[i] = ui32 >> (8 * i);
+}
+
+static uint64_t
+get_le64(const uint8_t *pbt)
+{
+  return get_le32(pbt) | ((uint64_t) get_le32(pbt + 4) << 32);
+}
+
+static void
+set_le64(uint8_t *pbt, const uint64_t ui64)
+{
+  set_le32(pbt, (uint32_t) ui64);
+  set_le32(pbt + 4, (uint32_t)(ui64 >> 32));
+}
+
+// Dumps are padded so record headers stay 8 bytes aligned
+static size_t
+dump_log_record_len(const size_t szData)
+{
+  return DUMP_LOG_RECORD_LEN + ((szData + 7) & ~(size_t) 7);
+}
+
+// CRC-32 (IEEE 802.3), a nibble at a time
+static uint32_t
+dump_log_crc(uint32_t ui32Crc, const uint8_t *pbtData, const size_t szData)
+{
+  static const uint32_t aui32Table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+  };
+
+  ui32Crc = ~ui32Crc;
+  for (size_t i = 0; i < szData; i++) {
+    ui32Crc = aui32Table[(ui32Crc ^ pbtData[i]) & 0x0f] ^ (ui32Crc >> 4);
+    ui32Crc = aui32Table[(ui32Crc ^ (pbtData[i] >> 4)) & 0x0f] ^ (ui32Crc >> 4);
+  }
+  return ~ui32Crc;
+}
+
+static uint32_t
+dump_log_record_crc(const uint8_t *pbtRecord, const size_t szData)
+{
+  static const uint8_t abtZero[4] = { 0 };
+  uint32_t ui32Crc;
+
+  ui32Crc = dump_log_crc(0, pbtRecord, 16);
+  ui32Crc = dump_log_crc(ui32Crc, abtZero, sizeof(abtZero));
+  return dump_log_crc(ui32Crc, pbtRecord + 20, DUMP_LOG_RECORD_LEN - 20 + szData);
+}
+
+static int
+dump_log_uid_cmp(const struct dump_log_uid *pdlu, const uint8_t *pbtUid, const size_t szUid)
+{
+  if (pdlu->szUid != szUid)
+    return (pdlu->szUid < szUid) ? -1 : 1;
+  return memcmp(pdlu->abtUid, pbtUid, szUid);
+}
+
+// Index of the UID in the index, or where it would be inserted
+static size_t
+dump_log_uid_search(const dump_log *pdl, const uint8_t *pbtUid, const size_t szUid, bool *pbFound)
+{
+  size_t szLow = 0;
+  size_t szHigh = pdl->szUids;
+
+  *pbFound = false;
+  while (szLow < szHigh) {
+    const size_t szMid = szLow + (szHigh - szLow) / 2;
+    const int iCmp = dump_log_uid_cmp(&(pdl->aUids[szMid]), pbtUid, szUid);
+    if (iCmp == 0) {
+      *pbFound = true;
+      return szMid;
+    }
+    if (iCmp < 0)
+      szLow = szMid + 1;
+    else
+      szHigh = szMid;
+  }
+  return szLow;
+}
+
+// Returns the number of records of the UID before this one, -1 without memory
+static int
+dump_log_index(dump_log *pdl, const uint8_t *pbtUid, const size_t szUid, const size_t szOffset)
+{
+  bool bFound;
+  const size_t szPos = dump_log_uid_search(pdl, pbtUid, szUid, &bFound);
+  struct dump_log_uid *pdlu;
+
+  if (!bFound) {
+    if (pdl->szUids == pdl->szUidsAlloc) {
+      const size_t szAlloc = pdl->szUidsAlloc ? 2 * pdl->szUidsAlloc : 64;
+      struct dump_log_uid *aUids = realloc(pdl->aUids, szAlloc * sizeof(*aUids));
+      if (aUids == NULL)
+        return -1;
+      pdl->aUids = aUids;
+      pdl->szUidsAlloc = szAlloc;
+    }
+    memmove(&(pdl->aUids[szPos + 1]), &(pdl->aUids[szPos]), (pdl->szUids - szPos) * sizeof(*pdl->aUids));
+    pdl->szUids++;
+    pdlu = &(pdl->aUids[szPos]);
+    memcpy(pdlu->abtUid, pbtUid, szUid);
+    pdlu->szUid = szUid;
+    pdlu->uiCount = 0;
+  } else {
+    pdlu = &(pdl->aUids[szPos]);
+  }
+  pdlu->szLast = szOffset;
+  return pdlu->uiCount++;
+}
+
+/**
+ * @brief Decode the record at \a szOffset of a mapped log
+ * @return Returns 1 on success, 0 if no valid record starts there
+ */
+int
+dump_log_get(const dump_log *pdl, const size_t szOffset, dump_log_record *pdlr)
+{
+  const uint8_t *pbtRecord = pdl->pbtMap + szOffset;
+  size_t szData;
+
+  if ((pdl->pbtMap == NULL) || (szOffset > pdl->szMap) || (pdl->szMap - szOffset < DUMP_LOG_RECORD_LEN))
+    return 0;
+  if (memcmp(pbtRecord, abtRecordMagic, sizeof(abtRecordMagic)) != 0)
+    return 0;
+  // Bound szData first: on 32-bit hosts, its padded record length may overflow
+  szData = get_le32(pbtRecord + 4);
+  if ((szData > pdl->szMap - szOffset - DUMP_LOG_RECORD_LEN) ||
+      (dump_log_record_len(szData) > pdl->szMap - szOffset) || (pbtRecord[21] > DUMP_LOG_UID_MAX))
+    return 0;
+
+  pdlr->type = pbtRecord[20];
+  pdlr->ui64Time = get_le64(pbtRecord + 8);
+  pdlr->szUid = pbtRecord[21];
+  memcpy(pdlr->abtUid, pbtRecord + 22, DUMP_LOG_UID_MAX);
+  pdlr->pbtData = pbtRecord + DUMP_LOG_RECORD_LEN;
+  pdlr->szData = szData;
+  pdlr->szOffset = szOffset;
+  return 1;
+}
+
+// Walks the records, checking their CRC, to find where the valid part of the log ends
+static int
+dump_log_scan(dump_log *pdl)
+{
+  dump_log_record dlr;
+  size_t szHeader;
+
+  pdl->szEnd = 0;
+  pdl->szRecords = 0;
+  if (pdl->szMap == 0)
+    return 0;
+  if ((pdl->szMap < DUMP_LOG_HEADER_LEN) || (memcmp(pdl->pbtMap, abtLogMagic, sizeof(abtLogMagic)) != 0))
+    return -1;
+  szHeader = get_le32(pdl->pbtMap + 8);
+  if ((szHeader < DUMP_LOG_HEADER_LEN) || (szHeader > pdl->szMap) || (szHeader % 8))
+    return -1;
+
+  pdl->szEnd = szHeader;
+  while (dump_log_get(pdl, pdl->szEnd, &dlr)) {
+    if (dump_log_record_crc(pdl->pbtMap + pdl->szEnd, dlr.szData) != get_le32(pdl->pbtMap + pdl->szEnd + 16))
+      break;
+    if (dump_log_index(pdl, dlr.abtUid, dlr.szUid, pdl->szEnd) < 0)
+      return -1;
+    pdl->szRecords++;
+    pdl->szEnd += dump_log_record_len(dlr.szData);
+  }
+  return 0;
+}
+
+// A missing file maps as an empty one
+static int
+dump_log_map_file(dump_log *pdl, const char *pcFilename)
+{
+#ifdef _WIN32
+  FILE *pf;
+  long lSize;
+  uint8_t *pbtMap;
+
+  if ((pf = fopen(pcFilename, "rb")) == NULL)
+    return (errno == ENOENT) ? 0 : -1;
+  if ((fseek(pf, 0, SEEK_END) != 0) || ((lSize = ftell(pf)) < 0) || (fseek(pf, 0, SEEK_SET) != 0)) {
+    fclose(pf);
+    return -1;
+  }
+  if (lSize == 0) {
+    fclose(pf);
+    return 0;
+  }
+  if ((pbtMap = malloc(lSize)) == NULL) {
+    fclose(pf);
+    return -1;
+  }
+  if (fread(pbtMap, 1, lSize, pf) != (size_t) lSize) {
+    free(pbtMap);
+    fclose(pf);
+    return -1;
+  }
+  fclose(pf);
+  pdl->pbtMap = pbtMap;
+  pdl->szMap = lSize;
+#else
+  struct stat st;
+  void *pMap;
+  int fd;
+
+  if ((fd = open(pcFilename, O_RDONLY)) < 0)
+    return (errno == ENOENT) ? 0 : -1;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  pMap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (pMap == MAP_FAILED)
+    return -1;
+  pdl->pbtMap = pMap;
+  pdl->szMap = st.st_size;
+#endif
+  return 0;
+}
+
+static void
+dump_log_unmap_file(dump_log *pdl)
+{
+  if (pdl->pbtMap) {
+#ifdef _WIN32
+    free((void *) pdl->pbtMap);
+#else
+    munmap((void *) pdl->pbtMap, pdl->szMap);
+#endif
+  }
+  pdl->pbtMap = NULL;
+  pdl->szMap = 0;
+}
+
+/**
+ * @brief Map a log to read it in place
+ * @return Returns 0 on success, -1 if the file can not be read or is not a log
+ *
+ * Records are checked and indexed by UID once, a record which fails its CRC
+ * ends the log.
+ */
+int
+dump_log_map(dump_log *pdl, const char *pcFilename)
+{
+  memset(pdl, 0, sizeof(*pdl));
+  if (dump_log_map_file(pdl, pcFilename) < 0)
+    return -1;
+  if ((pdl->pbtMap == NULL) || (dump_log_scan(pdl) < 0)) {
+    dump_log_close(pdl);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Get the record following \a *pszOffset, 0 to get the first one
+ * @return Returns 1 and updates \a *pszOffset if there is a record, 0 at the end of the log
+ */
+int
+dump_log_next(const dump_log *pdl, size_t *pszOffset, dump_log_record *pdlr)
+{
+  size_t szOffset;
+  dump_log_record dlr;
+
+  if (*pszOffset == 0)
+    szOffset = get_le32(pdl->pbtMap + 8);
+  else if (dump_log_get(pdl, *pszOffset, &dlr))
+    szOffset = *pszOffset + dump_log_record_len(dlr.szData);
+  else
+    return 0;
+  if ((szOffset >= pdl->szEnd) || !dump_log_get(pdl, szOffset, pdlr))
+    return 0;
+  *pszOffset = szOffset;
+  return 1;
+}
+
+/**
+ * @brief Look a UID up in the index of a log
+ * @return Returns the index entry, which tells how many records the UID has and where the last one is, or NULL
+ */
+const struct dump_log_uid *
+dump_log_find(const dump_log *pdl, const uint8_t *pbtUid, const size_t szUid)
+{
+  bool bFound;
+  const size_t szPos = dump_log_uid_search(pdl, pbtUid, szUid, &bFound);
+
+  return bFound ? &(pdl->aUids[szPos]) : NULL;
+}
+
+/**
+ * @brief Open a log to append dumps, it is created if missing
+ * @return Returns 0 on success, -1 on failure or if the file is not a log
+ *
+ * The existing records are indexed, whatever follows the last valid one (a
+ * record cut by a crash) is truncated.
+ */
+int
+dump_log_open(dump_log *pdl, const char *pcFilename)
+{
+  size_t szMap;
+
+  memset(pdl, 0, sizeof(*pdl));
+  if ((dump_log_map_file(pdl, pcFilename) < 0) || (dump_log_scan(pdl) < 0)) {
+    dump_log_close(pdl);
+    return -1;
+  }
+  szMap = pdl->szMap;
+  dump_log_unmap_file(pdl);
+
+  if ((pdl->pf = fopen(pcFilename, "ab")) == NULL) {
+    dump_log_close(pdl);
+    return -1;
+  }
+  if (pdl->szEnd < szMap) {
+#ifdef _WIN32
+    const int iRes = _chsize(_fileno(pdl->pf), pdl->szEnd);
+#else
+    const int iRes = ftruncate(fileno(pdl->pf), pdl->szEnd);
+#endif
+    if (iRes < 0) {
+      dump_log_close(pdl);
+      return -1;
+    }
+  }
+  if (pdl->szEnd == 0) {
+    uint8_t abtHeader[DUMP_LOG_HEADER_LEN] = { 0 };
+
+    memcpy(abtHeader, abtLogMagic, sizeof(abtLogMagic));
+    set_le32(abtHeader + 8, DUMP_LOG_HEADER_LEN);
+    if ((fwrite(abtHeader, 1, sizeof(abtHeader), pdl->pf) != sizeof(abtHeader)) || (fflush(pdl->pf) != 0)) {
+      dump_log_close(pdl);
+      return -1;
+    }
+    pdl->szEnd = DUMP_LOG_HEADER_LEN;
+  }
+  return 0;
+}
+
+/**
+ * @brief Append a dump to a log opened by dump_log_open()
+ * @return Returns the number of dumps of the same UID already in the log, -1 on failure
+ *
+ * The record is written at once and flushed. After a failed write the log is
+ * closed, so that no record follows a partial one.
+ */
+int
+dump_log_append(dump_log *pdl, const dump_log_type type, const uint8_t *pbtUid, const size_t szUid,
+                const void *pData, const size_t szData)
+{
+  uint8_t *pbtRecord;
+  struct timeval tv;
+  int res;
+
+  if ((pdl->pf == NULL) || (szUid > DUMP_LOG_UID_MAX) || (szData > UINT32_MAX) ||
+      (szData > SIZE_MAX - DUMP_LOG_RECORD_LEN - 7))
+    return -1;
+  const size_t szRecord = dump_log_record_len(szData);
+  if ((pbtRecord = calloc(1, szRecord)) == NULL)
+    return -1;
+
+  gettimeofday(&tv, NULL);
+  memcpy(pbtRecord, abtRecordMagic, sizeof(abtRecordMagic));
+  set_le32(pbtRecord + 4, szData);
+  set_le64(pbtRecord + 8, (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec);
+  pbtRecord[20] = type;
+  pbtRecord[21] = szUid;
+  memcpy(pbtRecord + 22, pbtUid, szUid);
+  memcpy(pbtRecord + DUMP_LOG_RECORD_LEN, pData, szData);
+  set_le32(pbtRecord + 16, dump_log_record_crc(pbtRecord, szData));
+
+  if ((fwrite(pbtRecord, 1, szRecord, pdl->pf) != szRecord) || (fflush(pdl->pf) != 0)) {
+    free(pbtRecord);
+    fclose(pdl->pf);
+    pdl->pf = NULL;
+    return -1;
+  }
+  free(pbtRecord);
+
+  res = dump_log_index(pdl, pbtUid, szUid, pdl->szEnd);
+  pdl->szEnd += szRecord;
+  pdl->szRecords++;
+  return res;
+}
+
+/**
+ * @brief Close a log opened by dump_log_open() or dump_log_map()
+ */
+void
+dump_log_close(dump_log *pdl)
+{
+  if (pdl->pf)
+    fclose(pdl->pf);
+  dump_log_unmap_file(pdl);
+  free(pdl->aUids);
+  memset(pdl, 0, sizeof(*pdl));
+}
@@ -0,0 +1,117 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file dump-log.h
+ * @brief Append-only log of card dumps, for reading one card after the other
+ *
+ * A log starts with a 16 bytes header: the "NFCDUMP1" magic, the header length
+ * and reserved flags. Each dump follows as a 32 bytes record header and the dump
+ * itself, padded to 8 bytes so the next record header stays aligned:
+ *
+ *   0  "NDLR"                    4  dump length
+ *   8  time (us since the epoch) 16 CRC-32 of the record, this field zeroed
+ *   20 dump type                 21 UID length       22 UID (10 bytes)
+ *
+ * Integers are little-endian. A record is only appended once whole, a record
+ * cut by a crash fails its CRC and is dropped when the log is opened again.
+ * Logs are read in place from a memory mapping, the UID index is rebuilt from
+ * the record headers when a log is opened.
+ */
+
+#ifndef _LIBNFC_DUMP_LOG_H_
+#  define _LIBNFC_DUMP_LOG_H_
+
+#  include <stdbool.h>
+#  include <stddef.h>
+#  include <stdint.h>
+#  include <stdio.h>
+
+#  define DUMP_LOG_HEADER_LEN 16
+#  define DUMP_LOG_RECORD_LEN 32
+#  define DUMP_LOG_UID_MAX    10
+
+typedef enum {
+  DUMP_LOG_MIFARE_CLASSIC = 1,
+  DUMP_LOG_MIFARE_ULTRALIGHT = 2,
+  DUMP_LOG_JEWEL = 3,
+} dump_log_type;
+
+typedef struct {
+  dump_log_type type;
+  uint64_t ui64Time;
+  uint8_t abtUid[DUMP_LOG_UID_MAX];
+  size_t  szUid;
+  // Points into the mapping
+  const uint8_t *pbtData;
+  size_t  szData;
+  // Offset of the record header in the log
+  size_t  szOffset;
+} dump_log_record;
+
+// One entry per UID, sorted by UID length then UID
+struct dump_log_uid {
+  uint8_t abtUid[DUMP_LOG_UID_MAX];
+  uint8_t szUid;
+  uint32_t uiCount;
+  // Offset of the last record of this UID
+  size_t  szLast;
+};
+
+typedef struct {
+  const uint8_t *pbtMap;
+  size_t  szMap;
+  // End of the last valid record
+  size_t  szEnd;
+  size_t  szRecords;
+  struct dump_log_uid *aUids;
+  size_t  szUids;
+  size_t  szUidsAlloc;
+  // Set while appending
+  FILE   *pf;
+} dump_log;
+
+int     dump_log_map(dump_log *pdl, const char *pcFilename);
+int     dump_log_next(const dump_log *pdl, size_t *pszOffset, dump_log_record *pdlr);
+const struct dump_log_uid *dump_log_find(const dump_log *pdl, const uint8_t *pbtUid, const size_t szUid);
+int     dump_log_get(const dump_log *pdl, const size_t szOffset, dump_log_record *pdlr);
+
+int     dump_log_open(dump_log *pdl, const char *pcFilename);
+int     dump_log_append(dump_log *pdl, const dump_log_type type, const uint8_t *pbtUid, const size_t szUid,
+                        const void *pData, const size_t szData);
+void    dump_log_close(dump_log *pdl);
+
+#endif // _LIBNFC_DUMP_LOG_H_
@@ -0,0 +1,254 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+/**
+ * @file felica.c
+ * @brief provide samples structs and functions to access FeliCa blocks using libnfc
+ */
+#include "felica.h"
+
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+/**
+ * @brief Prepare the blocks access to a selected FeliCa target
+ * @param pft The tag to initialize
+ * @param pnd The device the target was selected with
+ * @param pnt The FeliCa target
+ *
+ * Commands access one block at a time until felica_tag_set_limits() is called.
+ */
+void
+felica_tag_init(felica_tag *pft, nfc_device *pnd, const nfc_target *pnt)
+{
+  pft->pnd = pnd;
+  memcpy(pft->abtIdm, pnt->nti.nfi.abtId, sizeof(pft->abtIdm));
+  pft->ui8Nbr = 1;
+  pft->ui8Nbw = 1;
+  memset(pft->abtStatus, 0x00, sizeof(pft->abtStatus));
+}
+
+/**
+ * @brief Set the largest block counts the tag accepts, i.e. Nbr and Nbw of the NFC Forum Tag Type 3 attribute block
+ * @param pft The tag
+ * @param ui8Nbr Blocks per CHECK, clamped to what fits a frame
+ * @param ui8Nbw Blocks per UPDATE, clamped to what fits a frame
+ */
+void
+felica_tag_set_limits(felica_tag *pft, const uint8_t ui8Nbr, const uint8_t ui8Nbw)
+{
+  pft->ui8Nbr = (ui8Nbr > FELICA_CHECK_MAX_BLOCKS) ? FELICA_CHECK_MAX_BLOCKS : (ui8Nbr ? ui8Nbr : 1);
+  pft->ui8Nbw = (ui8Nbw > FELICA_UPDATE_MAX_BLOCKS) ? FELICA_UPDATE_MAX_BLOCKS : (ui8Nbw ? ui8Nbw : 1);
+}
+
+// Builds LEN CMD IDm then the services and block lists, returns the frame length so far or a negative error
+static int
+felica_build_request(const felica_tag *pft, const uint8_t btCmd, const uint16_t *aui16Services, const size_t szServices,
+                     const felica_block *afb, const size_t szBlocks, const size_t szDataLen, uint8_t *pbtFrame)
+{
+  size_t szLen = 1 + 1 + 8 + 1 + (2 * szServices) + 1 + szDataLen;
+  size_t n;
+
+  if ((szServices == 0) || (szServices > FELICA_MAX_SERVICES) || (szBlocks == 0))
+    return NFC_EINVARG;
+  for (n = 0; n < szBlocks; n++) {
+    if (afb[n].ui8Service >= szServices)
+      return NFC_EINVARG;
+    szLen += (afb[n].ui16Block < 0x100) ? 2 : 3;
+  }
+  if (szLen > FELICA_FRAME_MAX_LEN)
+    return NFC_EINVARG;
+
+  szLen = 1;
+  pbtFrame[szLen++] = btCmd;
+  memcpy(pbtFrame + szLen, pft->abtIdm, 8);
+  szLen += 8;
+  pbtFrame[szLen++] = szServices;
+  for (n = 0; n < szServices; n++) {
+    // Service codes are little endian
+    pbtFrame[szLen++] = aui16Services[n] & 0xff;
+    pbtFrame[szLen++] = aui16Services[n] >> 8;
+  }
+  pbtFrame[szLen++] = szBlocks;
+  for (n = 0; n < szBlocks; n++) {
+    if (afb[n].ui16Block < 0x100) {
+      // Two bytes element
+      pbtFrame[szLen++] = 0x80 | afb[n].ui8Service;
+      pbtFrame[szLen++] = afb[n].ui16Block;
+    } else {
+      // Three bytes element, block number little endian
+      pbtFrame[szLen++] = afb[n].ui8Service;
+      pbtFrame[szLen++] = afb[n].ui16Block & 0xff;
+      pbtFrame[szLen++] = afb[n].ui16Block >> 8;
+    }
+  }
+  return szLen;
+}
+
+// Sends the frame completed with its LEN byte, returns the checked answer length or a negative error
+static int
+felica_transceive(felica_tag *pft, uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx)
+{
+  int res;
+
+  pbtTx[0] = szTx;
+  if ((res = nfc_initiator_transceive_bytes(pft->pnd, pbtTx, szTx, pbtRx, FELICA_FRAME_MAX_LEN, 0)) < 0)
+    return res;
+  // LEN + CMD + IDm + status flags
+  if ((res < 1 + 1 + 8 + 2) || (pbtRx[0] != res) || (pbtRx[1] != pbtTx[1] + 1) || (memcmp(pbtRx + 2, pft->abtIdm, 8) != 0))
+    return NFC_ERFTRANS;
+  memcpy(pft->abtStatus, pbtRx + 10, 2);
+  if (pft->abtStatus[0] || pft->abtStatus[1])
+    return NFC_ERFTRANS;
+  return res;
+}
+
+/**
+ * @brief Read blocks of one or several services with a single CHECK command
+ * @return Returns the number of blocks read, otherwise returns libnfc's error code (the tag refused the command if status flags are set in \a pft)
+ * @param pft The tag
+ * @param aui16Services The services list
+ * @param szServices Number of services
+ * @param afb The blocks, each referencing a service of the list
+ * @param szBlocks Number of blocks, up to the tag Nbr
+ * @param pbtData Receives the blocks, FELICA_BLOCK_LEN bytes each
+ */
+int
+nfc_initiator_felica_check(felica_tag *pft, const uint16_t *aui16Services, const size_t szServices,
+                           const felica_block *afb, const size_t szBlocks, uint8_t *pbtData)
+{
+  uint8_t abtTx[FELICA_FRAME_MAX_LEN];
+  uint8_t abtRx[FELICA_FRAME_MAX_LEN];
+  const size_t szRx = 1 + 1 + 8 + 2 + 1 + (szBlocks * FELICA_BLOCK_LEN);
+  int res;
+
+  if ((szBlocks > pft->ui8Nbr) || (szRx > FELICA_FRAME_MAX_LEN))
+    return NFC_EINVARG;
+  if ((res = felica_build_request(pft, FC_CHECK, aui16Services, szServices, afb, szBlocks, 0, abtTx)) < 0)
+    return res;
+  if ((res = felica_transceive(pft, abtTx, res, abtRx)) < 0)
+    return res;
+  if (((size_t) res != szRx) || (abtRx[12] != szBlocks))
+    return NFC_ERFTRANS;
+  memcpy(pbtData, abtRx + 13, szBlocks * FELICA_BLOCK_LEN);
+  return szBlocks;
+}
+
+/**
+ * @brief Write blocks of one or several services with a single UPDATE command
+ * @return Returns the number of blocks written, otherwise returns libnfc's error code (the tag refused the command if status flags are set in \a pft)
+ * @param pft The tag
+ * @param aui16Services The services list
+ * @param szServices Number of services
+ * @param afb The blocks, each referencing a service of the list
+ * @param szBlocks Number of blocks, up to the tag Nbw
+ * @param pbtData The blocks data, FELICA_BLOCK_LEN bytes each
+ */
+int
+nfc_initiator_felica_update(felica_tag *pft, const uint16_t *aui16Services, const size_t szServices,
+                            const felica_block *afb, const size_t szBlocks, const uint8_t *pbtData)
+{
+  uint8_t abtTx[FELICA_FRAME_MAX_LEN];
+  uint8_t abtRx[FELICA_FRAME_MAX_LEN];
+  int res;
+
+  if (szBlocks > pft->ui8Nbw)
+    return NFC_EINVARG;
+  if ((res = felica_build_request(pft, FC_UPDATE, aui16Services, szServices, afb, szBlocks, szBlocks * FELICA_BLOCK_LEN, abtTx)) < 0)
+    return res;
+  memcpy(abtTx + res, pbtData, szBlocks * FELICA_BLOCK_LEN);
+  if ((res = felica_transceive(pft, abtTx, res + (szBlocks * FELICA_BLOCK_LEN), abtRx)) < 0)
+    return res;
+  return szBlocks;
+}
+
+/**
+ * @brief Read consecutive blocks of a service, with as few CHECK commands as the tag allows
+ * @return Returns the number of blocks read, otherwise returns libnfc's error code
+ * @param pft The tag
+ * @param ui16Service The service code
+ * @param ui16Block The first block
+ * @param szBlocks Number of blocks
+ * @param pbtData Receives the blocks, FELICA_BLOCK_LEN bytes each
+ */
+int
+felica_read_blocks(felica_tag *pft, const uint16_t ui16Service, const uint16_t ui16Block, const size_t szBlocks, uint8_t *pbtData)
+{
+  felica_block afb[FELICA_CHECK_MAX_BLOCKS];
+  size_t szDone = 0;
+  int res;
+
+  while (szDone < szBlocks) {
+    const size_t szChunk = ((szBlocks - szDone) < pft->ui8Nbr) ? (szBlocks - szDone) : pft->ui8Nbr;
+    for (size_t n = 0; n < szChunk; n++) {
+      afb[n].ui8Service = 0;
+      afb[n].ui16Block = ui16Block + szDone + n;
+    }
+    if ((res = nfc_initiator_felica_check(pft, &ui16Service, 1, afb, szChunk, pbtData + (szDone * FELICA_BLOCK_LEN))) < 0)
+      return res;
+    szDone += szChunk;
+  }
+  return szDone;
+}
+
+/**
+ * @brief Write consecutive blocks of a service, with as few UPDATE commands as the tag allows
+ * @return Returns the number of blocks written, otherwise returns libnfc's error code
+ * @param pft The tag
+ * @param ui16Service The service code
+ * @param ui16Block The first block
+ * @param szBlocks Number of blocks
+ * @param pbtData The blocks data, FELICA_BLOCK_LEN bytes each
+ */
+int
+felica_write_blocks(felica_tag *pft, const uint16_t ui16Service, const uint16_t ui16Block, const size_t szBlocks, const uint8_t *pbtData)
+{
+  felica_block afb[FELICA_UPDATE_MAX_BLOCKS];
+  size_t szDone = 0;
+  int res;
+
+  while (szDone < szBlocks) {
+    const size_t szChunk = ((szBlocks - szDone) < pft->ui8Nbw) ? (szBlocks - szDone) : pft->ui8Nbw;
+    for (size_t n = 0; n < szChunk; n++) {
+      afb[n].ui8Service = 0;
+      afb[n].ui16Block = ui16Block + szDone + n;
+    }
+    if ((res = nfc_initiator_felica_update(pft, &ui16Service, 1, afb, szChunk, pbtData + (szDone * FELICA_BLOCK_LEN))) < 0)
+      return res;
+    szDone += szChunk;
+  }
+  return szDone;
+}
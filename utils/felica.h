@@ -0,0 +1,91 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file felica.h
+ * @brief provide samples structs and functions to access FeliCa blocks using libnfc
+ */
+
+#ifndef _LIBNFC_FELICA_H_
+#  define _LIBNFC_FELICA_H_
+
+#  include <nfc/nfc-types.h>
+
+#  define FELICA_BLOCK_LEN 16
+// Services a single command can list
+#  define FELICA_MAX_SERVICES 16
+// LEN byte included, the frame has to fit a PN53x normal frame with TFI, command and status bytes
+#  define FELICA_FRAME_MAX_LEN 251
+
+// Largest block counts fitting a frame with a single service, three bytes block list elements
+#  define FELICA_CHECK_MAX_BLOCKS ((FELICA_FRAME_MAX_LEN - 13) / FELICA_BLOCK_LEN)
+#  define FELICA_UPDATE_MAX_BLOCKS ((FELICA_FRAME_MAX_LEN - 14) / (3 + FELICA_BLOCK_LEN))
+
+// NFC Forum Tag Type 3 services
+#  define FELICA_SERVICE_NDEF_RO 0x000B
+#  define FELICA_SERVICE_NDEF_RW 0x0009
+
+typedef enum {
+  FC_CHECK = 0x06,	// Read Without Encryption
+  FC_UPDATE = 0x08	// Write Without Encryption
+} felica_cmd;
+
+// Block list element
+typedef struct {
+  uint8_t  ui8Service;	// Index of the service in the services list of the command
+  uint16_t ui16Block;
+} felica_block;
+
+typedef struct {
+  nfc_device *pnd;
+  uint8_t abtIdm[8];
+  // Largest block counts of CHECK and UPDATE, Nbr and Nbw on NFC Forum Tag Type 3
+  uint8_t  ui8Nbr;
+  uint8_t  ui8Nbw;
+  // Status flags of the last answer
+  uint8_t abtStatus[2];
+} felica_tag;
+
+void    felica_tag_init(felica_tag *pft, nfc_device *pnd, const nfc_target *pnt);
+void    felica_tag_set_limits(felica_tag *pft, const uint8_t ui8Nbr, const uint8_t ui8Nbw);
+int     nfc_initiator_felica_check(felica_tag *pft, const uint16_t *aui16Services, const size_t szServices,
+                                   const felica_block *afb, const size_t szBlocks, uint8_t *pbtData);
+int     nfc_initiator_felica_update(felica_tag *pft, const uint16_t *aui16Services, const size_t szServices,
+                                    const felica_block *afb, const size_t szBlocks, const uint8_t *pbtData);
+int     felica_read_blocks(felica_tag *pft, const uint16_t ui16Service, const uint16_t ui16Block, const size_t szBlocks, uint8_t *pbtData);
+int     felica_write_blocks(felica_tag *pft, const uint16_t ui16Service, const uint16_t ui16Block, const size_t szBlocks, const uint8_t *pbtData);
+
+#endif // _LIBNFC_FELICA_H_
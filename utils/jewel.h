@@ -45,6 +45,10 @@
 
 #  include <nfc/nfc-types.h>
 
+// Header ROM (HR0) of the static (Topaz 96) and dynamic (Topaz 512) memory models
+#  define JEWEL_HR0_STATIC   0x11
+#  define JEWEL_HR0_DYNAMIC  0x12
+
 // Compiler directive, set struct alignment to 1 uint8_t for compatibility
 #  pragma pack(1)
 
@@ -130,7 +134,7 @@ typedef struct {
 
 typedef struct {
   uint8_t abtHr[2];
-  uint8_t abtDat[104];		// Block 0 - E, but not block D (reserved)
+  uint8_t abtDat[120];		// Block 0 - E, block D (reserved) included
 } jewel_res_rall;
 
 typedef struct {
@@ -200,7 +204,7 @@ typedef struct {
 } jewel_tag_blocks;
 
 typedef struct {
-  uint8_t abtData[120];
+  uint8_t abtData[512];		// Topaz 96 only uses the first 120 bytes
 } jewel_tag_data;
 
 typedef union {
@@ -0,0 +1,793 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+/**
+ * @file llcp.c
+ * @brief NFC Forum LLCP link over NFC-DEP, with connection-oriented transport
+ */
+#include "llcp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// PDU types
+#define LLCP_SYMM    0x0
+#define LLCP_PAX     0x1
+#define LLCP_AGF     0x2
+#define LLCP_UI      0x3
+#define LLCP_CONNECT 0x4
+#define LLCP_DISC    0x5
+#define LLCP_CC      0x6
+#define LLCP_DM      0x7
+#define LLCP_FRMR    0x8
+#define LLCP_I       0xc
+#define LLCP_RR      0xd
+#define LLCP_RNR     0xe
+
+// Parameters
+#define LLCP_PARAM_VERSION 0x01
+#define LLCP_PARAM_MIUX    0x02
+#define LLCP_PARAM_WKS     0x03
+#define LLCP_PARAM_LTO     0x04
+#define LLCP_PARAM_RW      0x05
+#define LLCP_PARAM_SN      0x06
+
+// DM reasons
+#define LLCP_DM_DISCONNECTED  0x00
+#define LLCP_DM_NO_CONNECTION 0x01
+#define LLCP_DM_NO_SERVICE    0x02
+#define LLCP_DM_REJECTED      0x03
+
+// SAPs given to the connections we open
+#define LLCP_SAP_CLIENT_FIRST 0x20
+#define LLCP_SAP_CLIENT_LAST  0x3f
+
+// Waited for on top of the peer link timeout
+#define LLCP_LTO_MARGIN_MS 100
+
+static const uint8_t abtLlcpMagic[] = { 0x46, 0x66, 0x6d };
+
+static size_t
+llcp_pdu_header(uint8_t *pbt, const uint8_t ui8Dsap, const uint8_t ui8Ptype, const uint8_t ui8Ssap)
+{
+  pbt[0] = (uint8_t)((ui8Dsap << 2) | (ui8Ptype >> 2));
+  pbt[1] = (uint8_t)(((ui8Ptype & 0x03) << 6) | ui8Ssap);
+  return 2;
+}
+
+static size_t
+llcp_param_miux(uint8_t *pbt, const uint16_t ui16Miu)
+{
+  const uint16_t ui16Miux = ui16Miu - LLCP_MIU;
+  pbt[0] = LLCP_PARAM_MIUX;
+  pbt[1] = 2;
+  pbt[2] = (uint8_t)(ui16Miux >> 8);
+  pbt[3] = (uint8_t) ui16Miux;
+  return 4;
+}
+
+// Reads the MIUX, RW and SN parameters of a CONNECT or CC PDU, absent ones leave their default
+static void
+llcp_parse_params(const uint8_t *pbt, const size_t sz, uint16_t *pui16Miu, uint8_t *pui8Rw,
+                  const uint8_t **ppbtSn, size_t *pszSn)
+{
+  size_t szPos = 0;
+
+  while (szPos + 2 <= sz) {
+    const uint8_t btType = pbt[szPos];
+    const size_t szLen = pbt[szPos + 1];
+    const uint8_t *pbtValue = pbt + szPos + 2;
+    if (szPos + 2 + szLen > sz)
+      break;
+    if ((btType == LLCP_PARAM_MIUX) && (szLen == 2) && pui16Miu)
+      *pui16Miu = LLCP_MIU + (((pbtValue[0] << 8) | pbtValue[1]) & 0x7ff);
+    else if ((btType == LLCP_PARAM_RW) && (szLen == 1) && pui8Rw)
+      *pui8Rw = pbtValue[0] & 0x0f;
+    else if ((btType == LLCP_PARAM_SN) && ppbtSn) {
+      *ppbtSn = pbtValue;
+      *pszSn = szLen;
+    }
+    szPos += 2 + szLen;
+  }
+}
+
+static llcp_connection *
+llcp_link_find(const llcp_link *pll, const uint8_t ui8Sap, const uint8_t ui8PeerSap)
+{
+  for (size_t i = 0; i < LLCP_MAX_CONNECTIONS; i++) {
+    llcp_connection *plc = pll->aplc[i];
+    if (plc && (plc->ui8Sap == ui8Sap) && (plc->ui8PeerSap == ui8PeerSap) &&
+        (plc->state != LLCP_LISTENING) && (plc->state != LLCP_CLOSED))
+      return plc;
+  }
+  return NULL;
+}
+
+static void
+llcp_link_queue_dm(llcp_link *pll, const uint8_t ui8Dsap, const uint8_t ui8Ssap, const uint8_t ui8Reason)
+{
+  // Lost when full: the peer will time out on the connection
+  if (pll->szDm < LLCP_MAX_CONNECTIONS) {
+    pll->abtDm[pll->szDm][0] = ui8Dsap;
+    pll->abtDm[pll->szDm][1] = ui8Ssap;
+    pll->abtDm[pll->szDm][2] = ui8Reason;
+    pll->szDm++;
+  }
+}
+
+static int
+llcp_connection_open(llcp_link *pll, llcp_connection *plc)
+{
+  size_t i;
+
+  for (i = 0; (i < LLCP_MAX_CONNECTIONS) && pll->aplc[i]; i++)
+    ;
+  if (i == LLCP_MAX_CONNECTIONS)
+    return NFC_EOVFLOW;
+  plc->ui8Rw = pll->ui8Rw;
+  if ((plc->pbtRx = malloc((size_t) plc->ui8Rw * (2 + pll->ui16Miu))) == NULL)
+    return NFC_ESOFT;
+  plc->ui8PeerRw = 1;
+  plc->ui16PeerMiu = LLCP_MIU;
+  plc->ui8Vs = plc->ui8Vsa = plc->ui8Vr = plc->ui8Vra = 0;
+  plc->bPeerBusy = false;
+  plc->ui8Control = 0;
+  plc->ui8DmReason = 0;
+  plc->pbtTx = NULL;
+  plc->ui8RxHead = plc->ui8RxCount = 0;
+  pll->aplc[i] = plc;
+  return NFC_SUCCESS;
+}
+
+static void
+llcp_connection_close(llcp_link *pll, llcp_connection *plc)
+{
+  for (size_t i = 0; i < LLCP_MAX_CONNECTIONS; i++) {
+    if (pll->aplc[i] == plc)
+      pll->aplc[i] = NULL;
+  }
+  free(plc->pbtRx);
+  plc->pbtRx = NULL;
+  plc->state = LLCP_CLOSED;
+}
+
+// N(R) to send: received SDUs are acknowledged once read, which bounds the peer to our buffer
+static uint8_t
+llcp_connection_ack(const llcp_connection *plc)
+{
+  return (uint8_t)((plc->ui8Vr - plc->ui8RxCount) & 0x0f);
+}
+
+/*
+ * Writes the PDUs of a connection which are due: its control PDU, then an
+ * I PDU if the window is open, else an RR one if the last SDUs read are not
+ * acknowledged yet. Each PDU is preceded by its length, as in an AGF PDU.
+ */
+static size_t
+llcp_connection_build(llcp_link *pll, llcp_connection *plc, uint8_t *pbt, const size_t szRoom, size_t *pszPdus)
+{
+  uint8_t abtPdu[2 + 4 + 3 + 2 + 255];
+  size_t szPos = 0;
+  size_t sz = 0;
+
+  if (plc->ui8Control) {
+    sz = llcp_pdu_header(abtPdu, plc->ui8PeerSap, plc->ui8Control, plc->ui8Sap);
+    switch (plc->ui8Control) {
+      case LLCP_CONNECT:
+      case LLCP_CC:
+        if (pll->ui16Miu > LLCP_MIU)
+          sz += llcp_param_miux(abtPdu + sz, pll->ui16Miu);
+        abtPdu[sz++] = LLCP_PARAM_RW;
+        abtPdu[sz++] = 1;
+        abtPdu[sz++] = plc->ui8Rw;
+        if ((plc->ui8Control == LLCP_CONNECT) && plc->pcService) {
+          const size_t szSn = strlen(plc->pcService);
+          abtPdu[sz++] = LLCP_PARAM_SN;
+          abtPdu[sz++] = (uint8_t) szSn;
+          memcpy(abtPdu + sz, plc->pcService, szSn);
+          sz += szSn;
+        }
+        break;
+      case LLCP_DM:
+        abtPdu[sz++] = plc->ui8DmReason;
+        break;
+    }
+    if (2 + sz > szRoom)
+      return 0;
+    pbt[szPos++] = (uint8_t)(sz >> 8);
+    pbt[szPos++] = (uint8_t) sz;
+    memcpy(pbt + szPos, abtPdu, sz);
+    szPos += sz;
+    (*pszPdus)++;
+    plc->ui8Control = 0;
+    // Data waits for the next turn
+    return szPos;
+  }
+  if (plc->state != LLCP_CONNECTED)
+    return szPos;
+
+  const uint8_t ui8Ack = llcp_connection_ack(plc);
+  if (plc->pbtTx && !plc->bPeerBusy && (((plc->ui8Vs - plc->ui8Vsa) & 0x0f) < plc->ui8PeerRw)) {
+    sz = 3 + plc->szTx;
+    if (szPos + 2 + sz > szRoom)
+      return szPos;
+    pbt[szPos++] = (uint8_t)(sz >> 8);
+    pbt[szPos++] = (uint8_t) sz;
+    szPos += llcp_pdu_header(pbt + szPos, plc->ui8PeerSap, LLCP_I, plc->ui8Sap);
+    pbt[szPos++] = (uint8_t)((plc->ui8Vs << 4) | ui8Ack);
+    memcpy(pbt + szPos, plc->pbtTx, plc->szTx);
+    szPos += plc->szTx;
+    plc->ui8Vs = (plc->ui8Vs + 1) & 0x0f;
+    plc->ui8Vra = ui8Ack;
+    plc->pbtTx = NULL;
+    (*pszPdus)++;
+  } else if (ui8Ack != plc->ui8Vra) {
+    if (szPos + 2 + 3 > szRoom)
+      return szPos;
+    pbt[szPos++] = 0;
+    pbt[szPos++] = 3;
+    szPos += llcp_pdu_header(pbt + szPos, plc->ui8PeerSap, LLCP_RR, plc->ui8Sap);
+    pbt[szPos++] = ui8Ack;
+    plc->ui8Vra = ui8Ack;
+    (*pszPdus)++;
+  }
+  return szPos;
+}
+
+/*
+ * Builds the PDU of this turn in abtTx: all that is due, aggregated when there
+ * is more than one PDU, SYMM only when there is nothing to send.
+ */
+static size_t
+llcp_link_build(llcp_link *pll)
+{
+  uint8_t *pbt = pll->abtTx;
+  size_t szPos = 2;
+  size_t szPdus = 0;
+
+  if (pll->bDeactivate)
+    return llcp_pdu_header(pbt, 0, LLCP_DISC, 0);
+
+  while (pll->szDm && (szPos + 5 <= 2 + (size_t) pll->ui16PeerMiu)) {
+    pll->szDm--;
+    pbt[szPos++] = 0;
+    pbt[szPos++] = 3;
+    szPos += llcp_pdu_header(pbt + szPos, pll->abtDm[pll->szDm][0], LLCP_DM, pll->abtDm[pll->szDm][1]);
+    pbt[szPos++] = pll->abtDm[pll->szDm][2];
+    szPdus++;
+  }
+  // Connections take turns in being served first
+  for (size_t n = 0; n < LLCP_MAX_CONNECTIONS; n++) {
+    llcp_connection *plc = pll->aplc[(pll->szNext + n) % LLCP_MAX_CONNECTIONS];
+    if (!plc)
+      continue;
+    // A lone PDU goes up to the connection MIU, an AGF one up to the link MIU
+    const size_t szLimit = szPdus ? (2 + (size_t) pll->ui16PeerMiu) : sizeof(pll->abtTx);
+    if (szPos < szLimit)
+      szPos += llcp_connection_build(pll, plc, pbt + szPos, szLimit - szPos, &szPdus);
+  }
+  pll->szNext = (pll->szNext + 1) % LLCP_MAX_CONNECTIONS;
+
+  if (szPdus == 0)
+    return llcp_pdu_header(pbt, 0, LLCP_SYMM, 0);
+  if (szPdus == 1) {
+    const size_t sz = szPos - 4;
+    memmove(pbt, pbt + 4, sz);
+    return sz;
+  }
+  llcp_pdu_header(pbt, 0, LLCP_AGF, 0);
+  return szPos;
+}
+
+static int
+llcp_link_process(llcp_link *pll, const uint8_t *pbt, const size_t sz)
+{
+  if (sz < 2)
+    return NFC_EIO;
+
+  const uint8_t ui8Dsap = pbt[0] >> 2;
+  const uint8_t ui8Ptype = (uint8_t)(((pbt[0] & 0x03) << 2) | (pbt[1] >> 6));
+  const uint8_t ui8Ssap = pbt[1] & 0x3f;
+  llcp_connection *plc = llcp_link_find(pll, ui8Dsap, ui8Ssap);
+  int res;
+
+  switch (ui8Ptype) {
+    case LLCP_AGF:
+      for (size_t szPos = 2; szPos + 2 <= sz;) {
+        const size_t szPdu = (pbt[szPos] << 8) | pbt[szPos + 1];
+        if (szPos + 2 + szPdu > sz)
+          return NFC_EIO;
+        if ((res = llcp_link_process(pll, pbt + szPos + 2, szPdu)) < 0)
+          return res;
+        szPos += 2 + szPdu;
+      }
+      break;
+
+    case LLCP_CONNECT: {
+      const uint8_t *pbtSn = NULL;
+      size_t szSn = 0;
+      uint16_t ui16Miu = LLCP_MIU;
+      uint8_t ui8Rw = 1;
+      llcp_parse_params(pbt + 2, sz - 2, &ui16Miu, &ui8Rw, &pbtSn, &szSn);
+      plc = NULL;
+      for (size_t i = 0; (i < LLCP_MAX_CONNECTIONS) && !plc; i++) {
+        llcp_connection *p = pll->aplc[i];
+        if (!p || (p->state != LLCP_LISTENING))
+          continue;
+        if ((ui8Dsap == LLCP_SAP_SDP) && pbtSn) {
+          if (p->pcService && (strlen(p->pcService) == szSn) && !memcmp(p->pcService, pbtSn, szSn))
+            plc = p;
+        } else if (p->ui8Sap == ui8Dsap) {
+          plc = p;
+        }
+      }
+      if (!plc) {
+        llcp_link_queue_dm(pll, ui8Ssap, ui8Dsap, LLCP_DM_NO_SERVICE);
+        break;
+      }
+      plc->ui8PeerSap = ui8Ssap;
+      plc->ui16PeerMiu = ui16Miu;
+      plc->ui8PeerRw = ui8Rw;
+      plc->state = LLCP_CONNECTED;
+      plc->ui8Control = LLCP_CC;
+    }
+    break;
+
+    case LLCP_CC:
+      for (size_t i = 0; i < LLCP_MAX_CONNECTIONS; i++) {
+        llcp_connection *p = pll->aplc[i];
+        if (p && (p->state == LLCP_CONNECTING) && (p->ui8Sap == ui8Dsap)) {
+          p->ui8PeerSap = ui8Ssap;
+          p->ui16PeerMiu = LLCP_MIU;
+          p->ui8PeerRw = 1;
+          llcp_parse_params(pbt + 2, sz - 2, &p->ui16PeerMiu, &p->ui8PeerRw, NULL, NULL);
+          p->state = LLCP_CONNECTED;
+        }
+      }
+      break;
+
+    case LLCP_DM:
+      for (size_t i = 0; i < LLCP_MAX_CONNECTIONS; i++) {
+        llcp_connection *p = pll->aplc[i];
+        // A refused CONNECT sent to the SDP is answered from there
+        if (p && (p->ui8Sap == ui8Dsap) && ((p->ui8PeerSap == ui8Ssap) || (p->state == LLCP_CONNECTING)) &&
+            (p->state != LLCP_LISTENING) && (p->state != LLCP_CLOSED)) {
+          p->ui8DmReason = (sz > 2) ? pbt[2] : LLCP_DM_DISCONNECTED;
+          p->state = LLCP_CLOSED;
+        }
+      }
+      break;
+
+    case LLCP_DISC:
+      if ((ui8Dsap == 0) && (ui8Ssap == 0)) {
+        pll->bActive = false;
+        return NFC_ETGRELEASED;
+      }
+      if (plc) {
+        plc->state = LLCP_CLOSED;
+        plc->ui8Control = LLCP_DM;
+        plc->ui8DmReason = LLCP_DM_DISCONNECTED;
+      } else {
+        llcp_link_queue_dm(pll, ui8Ssap, ui8Dsap, LLCP_DM_NO_CONNECTION);
+      }
+      break;
+
+    case LLCP_I:
+    case LLCP_RR:
+    case LLCP_RNR:
+      if (!plc || (plc->state != LLCP_CONNECTED)) {
+        llcp_link_queue_dm(pll, ui8Ssap, ui8Dsap, LLCP_DM_NO_CONNECTION);
+        break;
+      }
+      if (sz < 3)
+        return NFC_EIO;
+      plc->ui8Vsa = pbt[2] & 0x0f;
+      if (ui8Ptype != LLCP_I) {
+        plc->bPeerBusy = (ui8Ptype == LLCP_RNR);
+        break;
+      }
+      // Out of sequence, beyond our window or larger than our MIU: the peer is broken
+      if (((pbt[2] >> 4) != plc->ui8Vr) || (plc->ui8RxCount >= plc->ui8Rw) || (sz - 3 > pll->ui16Miu))
+        return NFC_EIO;
+      {
+        uint8_t *pbtSlot = plc->pbtRx + (size_t)((plc->ui8RxHead + plc->ui8RxCount) % plc->ui8Rw) * (2 + pll->ui16Miu);
+        pbtSlot[0] = (uint8_t)((sz - 3) >> 8);
+        pbtSlot[1] = (uint8_t)(sz - 3);
+        memcpy(pbtSlot + 2, pbt + 3, sz - 3);
+      }
+      plc->ui8RxCount++;
+      plc->ui8Vr = (plc->ui8Vr + 1) & 0x0f;
+      break;
+
+    case LLCP_FRMR:
+      if (plc)
+        plc->state = LLCP_CLOSED;
+      break;
+
+    default:
+      // SYMM, PAX, UI, SNL and reserved types: nothing to do
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Set a link up, before the D.E.P. activation
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ * @param pll The link to initialize
+ * @param pnd Device the link runs on
+ * @param bInitiator true when \a pnd is the D.E.P. initiator
+ * @param ui16Miu Largest SDU received, from \a LLCP_MIU to \a LLCP_MIU_MAX, 0 for the largest
+ * @param ui8Rw Receive window of the connections, up to \a LLCP_RW_MAX, 0 for the largest
+ *
+ * SDUs go in D.E.P. chained frames (see nfc_dep_write()), so the MIU is not
+ * bound to the frame size of the device. Each connection buffers a whole
+ * receive window, \a ui8Rw SDUs of \a ui16Miu bytes.
+ */
+int
+llcp_link_init(llcp_link *pll, nfc_device *pnd, const bool bInitiator, const uint16_t ui16Miu, const uint8_t ui8Rw)
+{
+  if ((ui16Miu && (ui16Miu < LLCP_MIU)) || (ui16Miu > LLCP_MIU_MAX) || (ui8Rw > LLCP_RW_MAX))
+    return NFC_EINVARG;
+  memset(pll, 0, sizeof(*pll));
+  pll->pnd = pnd;
+  pll->bInitiator = bInitiator;
+  pll->ui16Miu = ui16Miu ? ui16Miu : LLCP_MIU_MAX;
+  pll->ui8Rw = ui8Rw ? ui8Rw : LLCP_RW_MAX;
+  pll->ui16PeerMiu = LLCP_MIU;
+  pll->iPeerLto = LLCP_LTO;
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Write the general bytes announcing the link
+ * @return Number of bytes written, 0 if \a szGB is too small
+ *
+ * They go in the \a nfc_dep_info given to nfc_initiator_select_dep_target()
+ * or nfc_target_init(). Services listening on a well-known SAP are announced:
+ * call llcp_listen() for them first.
+ */
+size_t
+llcp_link_general_bytes(const llcp_link *pll, uint8_t *pbtGB, const size_t szGB)
+{
+  uint16_t ui16Wks = 0x0001;
+  size_t sz = 0;
+
+  if (szGB < sizeof(abtLlcpMagic) + 3 + 4 + 4 + 3)
+    return 0;
+  for (size_t i = 0; i < LLCP_MAX_CONNECTIONS; i++) {
+    if (pll->aplc[i] && (pll->aplc[i]->state == LLCP_LISTENING) && (pll->aplc[i]->ui8Sap < 16))
+      ui16Wks |= (uint16_t)(1 << pll->aplc[i]->ui8Sap);
+  }
+  memcpy(pbtGB, abtLlcpMagic, sizeof(abtLlcpMagic));
+  sz += sizeof(abtLlcpMagic);
+  pbtGB[sz++] = LLCP_PARAM_VERSION;
+  pbtGB[sz++] = 1;
+  pbtGB[sz++] = LLCP_VERSION;
+  sz += llcp_param_miux(pbtGB + sz, pll->ui16Miu);
+  pbtGB[sz++] = LLCP_PARAM_WKS;
+  pbtGB[sz++] = 2;
+  pbtGB[sz++] = (uint8_t)(ui16Wks >> 8);
+  pbtGB[sz++] = (uint8_t) ui16Wks;
+  pbtGB[sz++] = LLCP_PARAM_LTO;
+  pbtGB[sz++] = 1;
+  pbtGB[sz++] = LLCP_LTO / 10;
+  return sz;
+}
+
+/**
+ * @brief Start the link with the parameters of the peer
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ * @param pll The link
+ * @param pbtPeer General bytes of the peer, or the whole ATR_REQ or ATR_RES holding them
+ * @param szPeer Length of \a pbtPeer
+ *
+ * As initiator, the general bytes of the target are in the \a nfc_dep_info of
+ * the target selected; as target, those of the initiator end the ATR_REQ
+ * returned by nfc_target_init(). Fails with \a NFC_EDEVNOTSUPP when the peer
+ * does not speak LLCP 1.x.
+ */
+int
+llcp_link_activate(llcp_link *pll, const uint8_t *pbtPeer, const size_t szPeer)
+{
+  size_t szPos = 0;
+
+  while ((szPos + sizeof(abtLlcpMagic) <= szPeer) && memcmp(pbtPeer + szPos, abtLlcpMagic, sizeof(abtLlcpMagic)))
+    szPos++;
+  if (szPos + sizeof(abtLlcpMagic) > szPeer)
+    return NFC_EDEVNOTSUPP;
+  szPos += sizeof(abtLlcpMagic);
+
+  pll->ui8PeerVersion = 0;
+  pll->ui16PeerMiu = LLCP_MIU;
+  pll->ui16PeerWks = 0;
+  pll->iPeerLto = LLCP_LTO;
+  while (szPos + 2 <= szPeer) {
+    const uint8_t btType = pbtPeer[szPos];
+    const size_t szLen = pbtPeer[szPos + 1];
+    const uint8_t *pbtValue = pbtPeer + szPos + 2;
+    if (szPos + 2 + szLen > szPeer)
+      break;
+    if ((btType == LLCP_PARAM_VERSION) && (szLen == 1))
+      pll->ui8PeerVersion = pbtValue[0];
+    else if ((btType == LLCP_PARAM_MIUX) && (szLen == 2))
+      pll->ui16PeerMiu = LLCP_MIU + (((pbtValue[0] << 8) | pbtValue[1]) & 0x7ff);
+    else if ((btType == LLCP_PARAM_WKS) && (szLen == 2))
+      pll->ui16PeerWks = (uint16_t)((pbtValue[0] << 8) | pbtValue[1]);
+    else if ((btType == LLCP_PARAM_LTO) && (szLen == 1) && pbtValue[0])
+      pll->iPeerLto = pbtValue[0] * 10;
+    szPos += 2 + szLen;
+  }
+  // Minor versions are compatible with each other
+  if ((pll->ui8PeerVersion >> 4) != (LLCP_VERSION >> 4))
+    return NFC_EDEVNOTSUPP;
+  pll->bActive = true;
+  pll->bDeactivate = false;
+  pll->szDm = 0;
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Exchange one PDU each way
+ * @return 0 on success, otherwise a libnfc error code (negative value),
+ * \a NFC_ETGRELEASED once the link is deactivated
+ *
+ * The PDU sent holds everything due, aggregated if needed: SDUs the send
+ * windows let go, acknowledgements and connection management. SYMM is only
+ * sent when there is none of them. The initiator sends first, the target
+ * waits for the PDU of the initiator then answers it.
+ */
+int
+llcp_link_turn(llcp_link *pll)
+{
+  const int iTimeout = pll->iPeerLto + LLCP_LTO_MARGIN_MS;
+  int res;
+
+  if (!pll->bActive)
+    return NFC_ETGRELEASED;
+  if (!pll->bInitiator) {
+    if ((res = nfc_dep_read(pll->pnd, pll->abtRx, sizeof(pll->abtRx), iTimeout)) < 0)
+      return res;
+    if ((res = llcp_link_process(pll, pll->abtRx, (size_t) res)) < 0)
+      return res;
+  }
+  const size_t szTx = llcp_link_build(pll);
+  if ((res = nfc_dep_write(pll->pnd, pll->abtTx, szTx, iTimeout)) < 0)
+    return res;
+  if (pll->bDeactivate) {
+    // Nothing is expected after the DISC PDU
+    pll->bActive = false;
+    return NFC_SUCCESS;
+  }
+  if (pll->bInitiator) {
+    if ((res = nfc_dep_read(pll->pnd, pll->abtRx, sizeof(pll->abtRx), iTimeout)) < 0)
+      return res;
+    if ((res = llcp_link_process(pll, pll->abtRx, (size_t) res)) < 0)
+      return res;
+  }
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Deactivate the link, with a DISC PDU to SAP 0
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ *
+ * Connections still open are closed without notice, call llcp_disconnect()
+ * on each of them to release them.
+ */
+int
+llcp_link_deactivate(llcp_link *pll)
+{
+  if (!pll->bActive)
+    return NFC_SUCCESS;
+  pll->bDeactivate = true;
+  return llcp_link_turn(pll);
+}
+
+/**
+ * @brief Wait for connections to a service
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ * @param pll The link
+ * @param plc The connection to set up, which must stay valid until llcp_disconnect()
+ * @param ui8Sap SAP of the service, from 2 to 63
+ * @param pcService Service name, e.g. "urn:nfc:sn:snep", connected to through the SDP, can be NULL
+ *
+ * Call llcp_accept() to have the connection set up. The connection serves a
+ * single peer connection, other connections being refused meanwhile.
+ */
+int
+llcp_listen(llcp_link *pll, llcp_connection *plc, const uint8_t ui8Sap, const char *pcService)
+{
+  int res;
+
+  if ((ui8Sap < 2) || (ui8Sap > 63) || (pcService && (strlen(pcService) > 255)))
+    return NFC_EINVARG;
+  if ((res = llcp_connection_open(pll, plc)) < 0)
+    return res;
+  plc->ui8Sap = ui8Sap;
+  plc->ui8PeerSap = 0;
+  plc->pcService = pcService;
+  plc->state = LLCP_LISTENING;
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Wait until a peer connects to a listening connection
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ */
+int
+llcp_accept(llcp_link *pll, llcp_connection *plc)
+{
+  int res;
+
+  while (plc->state == LLCP_LISTENING) {
+    if ((res = llcp_link_turn(pll)) < 0)
+      return res;
+  }
+  return (plc->state == LLCP_CONNECTED) ? NFC_SUCCESS : NFC_ETGRELEASED;
+}
+
+/**
+ * @brief Connect to a service of the peer
+ * @return 0 on success, otherwise a libnfc error code (negative value),
+ * \a NFC_EOPABORTED when the peer refuses the connection
+ * @param pll The link
+ * @param plc The connection to set up, which must stay valid until llcp_disconnect()
+ * @param ui8Sap SAP of the service, ignored when \a pcService is set
+ * @param pcService Service name, e.g. "urn:nfc:sn:snep", can be NULL
+ *
+ * The receive windows and MIUs of both sides are exchanged in the CONNECT and
+ * CC PDUs: llcp_send() then has up to the window of the peer SDUs in flight.
+ */
+int
+llcp_connect(llcp_link *pll, llcp_connection *plc, const uint8_t ui8Sap, const char *pcService)
+{
+  uint8_t ui8Local;
+  int res;
+
+  if (pcService && (strlen(pcService) > 255))
+    return NFC_EINVARG;
+  for (ui8Local = LLCP_SAP_CLIENT_FIRST; ui8Local <= LLCP_SAP_CLIENT_LAST; ui8Local++) {
+    size_t i;
+    for (i = 0; (i < LLCP_MAX_CONNECTIONS) && !(pll->aplc[i] && (pll->aplc[i]->ui8Sap == ui8Local)); i++)
+      ;
+    if (i == LLCP_MAX_CONNECTIONS)
+      break;
+  }
+  if ((res = llcp_connection_open(pll, plc)) < 0)
+    return res;
+  plc->ui8Sap = ui8Local;
+  plc->ui8PeerSap = pcService ? LLCP_SAP_SDP : ui8Sap;
+  plc->pcService = pcService;
+  plc->state = LLCP_CONNECTING;
+  plc->ui8Control = LLCP_CONNECT;
+
+  while (plc->state == LLCP_CONNECTING) {
+    if ((res = llcp_link_turn(pll)) < 0)
+      break;
+  }
+  if (plc->state == LLCP_CONNECTED)
+    return NFC_SUCCESS;
+  llcp_connection_close(pll, plc);
+  return (res < 0) ? res : NFC_EOPABORTED;
+}
+
+/**
+ * @brief Send an SDU
+ * @return \a szTx on success, otherwise a libnfc error code (negative value),
+ * \a NFC_ETGRELEASED when the connection was closed by the peer
+ *
+ * Returns as soon as the SDU is sent, without waiting for it to be
+ * acknowledged as long as the receive window of the peer is not full: SDUs
+ * sent in a row go one per turn. \a szTx must not exceed the MIU of the peer,
+ * \a ui16PeerMiu.
+ */
+int
+llcp_send(llcp_link *pll, llcp_connection *plc, const uint8_t *pbtTx, const size_t szTx)
+{
+  int res;
+
+  if (plc->state != LLCP_CONNECTED)
+    return NFC_ETGRELEASED;
+  if (szTx > plc->ui16PeerMiu)
+    return NFC_EOVFLOW;
+  plc->pbtTx = pbtTx;
+  plc->szTx = szTx;
+  while (plc->pbtTx && (plc->state == LLCP_CONNECTED)) {
+    if ((res = llcp_link_turn(pll)) < 0) {
+      plc->pbtTx = NULL;
+      return res;
+    }
+  }
+  if (plc->pbtTx) {
+    plc->pbtTx = NULL;
+    return NFC_ETGRELEASED;
+  }
+  return (int) szTx;
+}
+
+/**
+ * @brief Receive an SDU
+ * @return Length of the SDU, otherwise a libnfc error code (negative value),
+ * \a NFC_ETGRELEASED when the connection was closed by the peer
+ *
+ * SDUs received before the connection was closed are still returned. An SDU
+ * larger than \a szRx is left in place, \a NFC_EOVFLOW being returned.
+ */
+int
+llcp_recv(llcp_link *pll, llcp_connection *plc, uint8_t *pbtRx, const size_t szRx)
+{
+  int res;
+
+  while (!plc->ui8RxCount && (plc->state == LLCP_CONNECTED)) {
+    if ((res = llcp_link_turn(pll)) < 0)
+      return res;
+  }
+  if (!plc->ui8RxCount)
+    return NFC_ETGRELEASED;
+  const uint8_t *pbtSlot = plc->pbtRx + (size_t) plc->ui8RxHead * (2 + pll->ui16Miu);
+  const size_t sz = (pbtSlot[0] << 8) | pbtSlot[1];
+  if (sz > szRx)
+    return NFC_EOVFLOW;
+  memcpy(pbtRx, pbtSlot + 2, sz);
+  plc->ui8RxHead = (plc->ui8RxHead + 1) % plc->ui8Rw;
+  plc->ui8RxCount--;
+  return (int) sz;
+}
+
+/**
+ * @brief Close a connection and release it
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ *
+ * A connection still open is closed with a DISC PDU, the link turning until
+ * the peer confirms.
+ */
+int
+llcp_disconnect(llcp_link *pll, llcp_connection *plc)
+{
+  int res = NFC_SUCCESS;
+
+  if (plc->state == LLCP_CONNECTED) {
+    plc->state = LLCP_DISCONNECTING;
+    plc->ui8Control = LLCP_DISC;
+    while ((plc->state == LLCP_DISCONNECTING) && ((res = llcp_link_turn(pll)) >= 0))
+      ;
+  }
+  // The DM answering a DISC of the peer may still be due
+  while (plc->ui8Control && pll->bActive && ((res = llcp_link_turn(pll)) >= 0))
+    ;
+  llcp_connection_close(pll, plc);
+  return (res < 0) ? res : NFC_SUCCESS;
+}
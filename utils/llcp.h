@@ -0,0 +1,146 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file llcp.h
+ * @brief NFC Forum LLCP link over NFC-DEP, with connection-oriented transport
+ *
+ * One PDU goes each way per D.E.P. exchange, the initiator speaking first.
+ * Nothing runs in the background: the link only moves when llcp_link_turn()
+ * is called, which llcp_connect(), llcp_accept(), llcp_send(), llcp_recv()
+ * and llcp_disconnect() do until they are done. As the peer expects an answer
+ * within its link timeout, they must be called without long pauses.
+ */
+
+#ifndef _LIBNFC_LLCP_H_
+#  define _LIBNFC_LLCP_H_
+
+#  include <stdbool.h>
+#  include <stddef.h>
+#  include <stdint.h>
+
+#  include <nfc/nfc.h>
+
+#  define LLCP_VERSION    0x11
+// Default MIU, extended by the MIUX parameter
+#  define LLCP_MIU        128
+#  define LLCP_MIU_MAX    (LLCP_MIU + 0x7ff)
+#  define LLCP_RW_MAX     15
+// Default link timeout, in ms
+#  define LLCP_LTO        100
+
+// Well-known SAPs
+#  define LLCP_SAP_SDP    0x01
+#  define LLCP_SAP_SNEP   0x04
+
+// Connections a link serves at once
+#  define LLCP_MAX_CONNECTIONS 8
+
+typedef enum {
+  LLCP_CLOSED,
+  LLCP_LISTENING,
+  LLCP_CONNECTING,
+  LLCP_CONNECTED,
+  LLCP_DISCONNECTING,
+} llcp_state;
+
+typedef struct {
+  llcp_state state;
+  // Local and peer SAPs
+  uint8_t ui8Sap;
+  uint8_t ui8PeerSap;
+  // Service name asked for, or served, can be NULL
+  const char *pcService;
+  // Receive window and MIU of each side
+  uint8_t ui8Rw;
+  uint8_t ui8PeerRw;
+  uint16_t ui16PeerMiu;
+  // Sequence numbers, modulo 16: sent, acknowledged by the peer, received
+  uint8_t ui8Vs;
+  uint8_t ui8Vsa;
+  uint8_t ui8Vr;
+  // Last N(R) sent, received SDUs are acknowledged once read
+  uint8_t ui8Vra;
+  bool    bPeerBusy;
+  // Control PDU to send: CONNECT, CC, DISC or DM
+  uint8_t ui8Control;
+  uint8_t ui8DmReason;
+  // SDU given to llcp_send(), sent at the next turn the window allows
+  const uint8_t *pbtTx;
+  size_t  szTx;
+  // Received SDUs not read yet: ui8Rw slots of 2 length bytes and MIU bytes
+  uint8_t *pbtRx;
+  uint8_t ui8RxHead;
+  uint8_t ui8RxCount;
+} llcp_connection;
+
+typedef struct {
+  nfc_device *pnd;
+  bool    bInitiator;
+  bool    bActive;
+  // Own link parameters, as sent in the general bytes
+  uint16_t ui16Miu;
+  uint8_t ui8Rw;
+  // Peer link parameters
+  uint8_t ui8PeerVersion;
+  uint16_t ui16PeerMiu;
+  uint16_t ui16PeerWks;
+  int     iPeerLto;
+  // Pending DM answers to PDUs of unknown connections: DSAP, SSAP, reason
+  uint8_t abtDm[LLCP_MAX_CONNECTIONS][3];
+  size_t  szDm;
+  bool    bDeactivate;
+  llcp_connection *aplc[LLCP_MAX_CONNECTIONS];
+  size_t  szNext;
+  // One PDU each way, an AGF one taking several
+  uint8_t abtTx[LLCP_MIU_MAX + 8];
+  uint8_t abtRx[LLCP_MIU_MAX + 8];
+} llcp_link;
+
+int     llcp_link_init(llcp_link *pll, nfc_device *pnd, const bool bInitiator, const uint16_t ui16Miu, const uint8_t ui8Rw);
+size_t  llcp_link_general_bytes(const llcp_link *pll, uint8_t *pbtGB, const size_t szGB);
+int     llcp_link_activate(llcp_link *pll, const uint8_t *pbtPeer, const size_t szPeer);
+int     llcp_link_turn(llcp_link *pll);
+int     llcp_link_deactivate(llcp_link *pll);
+
+int     llcp_listen(llcp_link *pll, llcp_connection *plc, const uint8_t ui8Sap, const char *pcService);
+int     llcp_accept(llcp_link *pll, llcp_connection *plc);
+int     llcp_connect(llcp_link *pll, llcp_connection *plc, const uint8_t ui8Sap, const char *pcService);
+int     llcp_send(llcp_link *pll, llcp_connection *plc, const uint8_t *pbtTx, const size_t szTx);
+int     llcp_recv(llcp_link *pll, llcp_connection *plc, uint8_t *pbtRx, const size_t szRx);
+int     llcp_disconnect(llcp_link *pll, llcp_connection *plc);
+
+#endif // _LIBNFC_LLCP_H_
@@ -39,25 +39,90 @@
  */
 #include "mifare.h"
 
+#include <pthread.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <nfc/nfc.h>
 
-/**
- * @brief Execute a MIFARE Classic Command
- * @return Returns true if action was successfully performed; otherwise returns false.
- * @param pmp Some commands need additional information. This information should be supplied in the mifare_param union.
- *
- * The specified MIFARE command will be executed on the tag. There are different commands possible, they all require the destination block number.
- * @note There are three different types of information (Authenticate, Data and Value).
- *
- * First an authentication must take place using Key A or B. It requires a 48 bit Key (6 bytes) and the UID.
- * They are both used to initialize the internal cipher-state of the PN53X chip.
- * After a successful authentication it will be possible to execute other commands (e.g. Read/Write).
- * The MIFARE Classic Specification (http://www.nxp.com/acrobat/other/identification/M001053_MF1ICS50_rev5_3.pdf) explains more about this process.
+// Devices which have a mifare_cache between mifare_cache_begin() and mifare_cache_end()
+#define MIFARE_CACHE_DEVICES 4
+
+static mifare_cache *apmcActive[MIFARE_CACHE_DEVICES];
+// Protects apmcActive, caches of different devices are used from different threads
+static pthread_mutex_t mtxActive = PTHREAD_MUTEX_INITIALIZER;
+
+static mifare_cache *
+mifare_cache_find(const nfc_device *pnd)
+{
+  mifare_cache *pmc = NULL;
+
+  pthread_mutex_lock(&mtxActive);
+  for (size_t i = 0; (i < MIFARE_CACHE_DEVICES) && !pmc; i++) {
+    if (apmcActive[i] && (apmcActive[i]->pnd == pnd))
+      pmc = apmcActive[i];
+  }
+  pthread_mutex_unlock(&mtxActive);
+  return pmc;
+}
+
+static bool mifare_cmd_exchange(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp);
+
+// Send the authentication held back by nfc_initiator_mifare_cmd(), if any
+static bool
+mifare_cache_send_auth(mifare_cache *pmc)
+{
+  mifare_param mp;
+
+  if (!pmc->bAuthPending)
+    return true;
+  pmc->bAuthPending = false;
+  mp.mpa = pmc->mpaAuth;
+  if (!mifare_cmd_exchange(pmc->pnd, pmc->mcAuth, pmc->ui8AuthBlock, &mp))
+    return false;
+
+  const size_t szType = pmc->mcAuth - MC_AUTH_A;
+  const uint8_t ui8Sector = mifare_classic_block_sector(pmc->ui8AuthBlock);
+  pmc->abtAccepted[szType][ui8Sector / 8] |= 1 << (ui8Sector % 8);
+  memcpy(pmc->abtAcceptedKeys[szType][ui8Sector], pmc->mpaAuth.abtKey, 6);
+  return true;
+}
+
+/*
+ * Tells whether the card would answer a READ of ui8Block: on MIFARE Classic,
+ * the last authentication must be for its sector, with a key the card
+ * accepted during this tap. Returns 1 if so, 0 if the block has to be read
+ * from the card, -1 if the card refused the authentication.
  */
-bool
-nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp)
+static int
+mifare_cache_read_allowed(mifare_cache *pmc, const uint8_t ui8Block)
+{
+  if (!pmc->bClassic)
+    return 1;
+
+  const uint8_t ui8Sector = mifare_classic_block_sector(ui8Block);
+  if (!pmc->bAuth || (mifare_classic_block_sector(pmc->ui8AuthBlock) != ui8Sector))
+    return 0;
+  const size_t szType = pmc->mcAuth - MC_AUTH_A;
+  if ((pmc->abtAccepted[szType][ui8Sector / 8] & (1 << (ui8Sector % 8))) &&
+      !memcmp(pmc->abtAcceptedKeys[szType][ui8Sector], pmc->mpaAuth.abtKey, 6))
+    return 1;
+  // First time with this key on this sector: the card has to accept it once
+  if (!pmc->bAuthPending)
+    return 0;
+  return mifare_cache_send_auth(pmc) ? 1 : -1;
+}
+
+// The content is being changed from this reader: drop what was read from the card
+static void
+mifare_cache_forget(mifare_cache *pmc)
+{
+  memset(pmc->pCard->abtCached, 0, sizeof(pmc->pCard->abtCached));
+}
+
+// Send one MIFARE command to the tag, see nfc_initiator_mifare_cmd()
+static bool
+mifare_cmd_exchange(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp)
 {
   uint8_t  abtRx[265];
   size_t  szParamLen;
@@ -74,6 +139,13 @@ nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8
       szParamLen = 0;
       break;
 
+    // Fast read command has the end page as parameter
+    case MC_FAST_READ:
+      if ((pmp->mpfr.ui8EndPage < ui8Block) || (pmp->mpfr.ui8EndPage - ui8Block >= MIFARE_FAST_READ_MAX_PAGES))
+        return false;
+      szParamLen = 1;
+      break;
+
     // Authenticate command
     case MC_AUTH_A:
     case MC_AUTH_B:
@@ -136,6 +208,643 @@ nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8
       return false;
     }
   }
+  if (mc == MC_FAST_READ) {
+    const int iLen = (pmp->mpfr.ui8EndPage - ui8Block + 1) * 4;
+    if (res == iLen) {
+      memcpy(pmp->mpfr.abtData, abtRx, iLen);
+    } else {
+      return false;
+    }
+  }
   // Command succesfully executed
   return true;
 }
+
+/**
+ * @brief Execute a MIFARE Classic Command
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ * @param pmp Some commands need additional information. This information should be supplied in the mifare_param union.
+ *
+ * The specified MIFARE command will be executed on the tag. There are different commands possible, they all require the destination block number.
+ * @note There are three different types of information (Authenticate, Data and Value).
+ *
+ * First an authentication must take place using Key A or B. It requires a 48 bit Key (6 bytes) and the UID.
+ * They are both used to initialize the internal cipher-state of the PN53X chip.
+ * After a successful authentication it will be possible to execute other commands (e.g. Read/Write).
+ * The MIFARE Classic Specification (http://www.nxp.com/acrobat/other/identification/M001053_MF1ICS50_rev5_3.pdf) explains more about this process.
+ *
+ * MC_FAST_READ (NTAG21x, MIFARE Ultralight EV1) reads pages \a ui8Block to
+ * \a pmp->mpfr.ui8EndPage in one exchange, up to MIFARE_FAST_READ_MAX_PAGES.
+ *
+ * When a mifare_cache is in use on \a pnd (see mifare_cache_begin()), MC_READ
+ * answers already read from the card are returned without any exchange, and
+ * MC_AUTH_A or MC_AUTH_B is held back until a command really needs the tag:
+ * a wrong key is then reported by that command instead of the authentication.
+ * A MIFARE Classic sector is still authenticated with the card once per tap
+ * and key before its cached blocks are returned.
+ */
+bool
+nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp)
+{
+  mifare_cache *pmc = mifare_cache_find(pnd);
+
+  if (!pmc)
+    return mifare_cmd_exchange(pnd, mc, ui8Block, pmp);
+
+  struct mifare_cache_card *pCard = pmc->pCard;
+  const uint8_t btBit = 1 << (ui8Block % 8);
+  switch (mc) {
+    case MC_AUTH_A:
+    case MC_AUTH_B:
+      pmc->bAuth = true;
+      pmc->bAuthPending = true;
+      pmc->mcAuth = mc;
+      pmc->ui8AuthBlock = ui8Block;
+      pmc->mpaAuth = pmp->mpa;
+      return true;
+
+    case MC_READ:
+      if (pCard->abtCached[ui8Block / 8] & btBit) {
+        const int res = mifare_cache_read_allowed(pmc, ui8Block);
+        if (res < 0)
+          return false;
+        if (res > 0) {
+          memcpy(pmp->mpd.abtData, pCard->abtBlocks[ui8Block], 16);
+          return true;
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if (!mifare_cache_send_auth(pmc))
+    return false;
+  if (!mifare_cmd_exchange(pnd, mc, ui8Block, pmp))
+    return false;
+  if (mc == MC_READ) {
+    memcpy(pCard->abtBlocks[ui8Block], pmp->mpd.abtData, 16);
+    pCard->abtCached[ui8Block / 8] |= btBit;
+  } else if (mc != MC_FAST_READ) {
+    mifare_cache_forget(pmc);
+  }
+  return true;
+}
+
+/**
+ * @brief Execute MIFARE WRITE commands back to back
+ * @return Returns the number of blocks written before the first failure (\a szBlocks if all went well)
+ * @param pui8Blocks destination block numbers
+ * @param ampd data to write, one entry per block
+ *
+ * Same as nfc_initiator_mifare_cmd() with MC_WRITE for each block, but the
+ * commands are pipelined by groups of MIFARE_WRITE_BATCH_MAX with
+ * nfc_batch_commit(): the next one is sent as soon as the previous one is
+ * acknowledged.
+ */
+size_t
+nfc_initiator_mifare_write_batch(nfc_device *pnd, const uint8_t *pui8Blocks, const struct mifare_param_data *ampd, const size_t szBlocks)
+{
+  uint8_t  abtCmds[MIFARE_WRITE_BATCH_MAX][2 + sizeof(struct mifare_param_data)];
+  uint8_t  abtRx[265];
+  int      aiRes[MIFARE_WRITE_BATCH_MAX];
+  size_t   szDone = 0;
+  mifare_cache *pmc = mifare_cache_find(pnd);
+
+  if (pmc) {
+    if (!mifare_cache_send_auth(pmc))
+      return 0;
+    mifare_cache_forget(pmc);
+  }
+  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true) < 0) {
+    nfc_perror(pnd, "nfc_device_set_property_bool");
+    return 0;
+  }
+  while (szDone < szBlocks) {
+    const size_t szBatch = (szBlocks - szDone < MIFARE_WRITE_BATCH_MAX) ? szBlocks - szDone : MIFARE_WRITE_BATCH_MAX;
+    nfc_batch_begin(pnd);
+    for (size_t i = 0; i < szBatch; i++) {
+      abtCmds[i][0] = MC_WRITE;
+      abtCmds[i][1] = pui8Blocks[szDone + i];
+      memcpy(abtCmds[i] + 2, ampd[szDone + i].abtData, sizeof(struct mifare_param_data));
+      // Answers are empty, they can share the buffer
+      if (nfc_batch_append(pnd, abtCmds[i], sizeof(abtCmds[i]), abtRx, sizeof(abtRx), &(aiRes[i])) < 0) {
+        nfc_perror(pnd, "nfc_batch_append");
+        return szDone;
+      }
+    }
+    int res = nfc_batch_commit(pnd, -1);
+    for (size_t i = 0; i < szBatch; i++) {
+      if (aiRes[i] < 0) {
+        if (res != NFC_ERFTRANS)
+          nfc_perror(pnd, "nfc_batch_commit");
+        return szDone;
+      }
+      szDone++;
+    }
+  }
+  return szDone;
+}
+
+/**
+ * @brief Authenticate then read a whole MIFARE Classic sector
+ * @return Returns the number of blocks read, or -1 if the authentication failed
+ * @param mc MC_AUTH_A or MC_AUTH_B
+ * @param ui8Block first block of the sector
+ * @param pmpa key and UID to authenticate with
+ * @param amb will receive the blocks of the sector, trailer included
+ *
+ * The authentication and the READ commands are exchanged with
+ * nfc_batch_commit(), each command being sent as soon as the previous answer
+ * is received. As with nfc_initiator_mifare_cmd(), the tag must be selected
+ * again after a failure.
+ */
+int
+nfc_initiator_mifare_read_sector(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, const struct mifare_param_auth *pmpa, mifare_classic_block *amb)
+{
+  const size_t szBlocks = (ui8Block < 128) ? 4 : 16;
+  uint8_t  abtAuth[2 + sizeof(struct mifare_param_auth)];
+  uint8_t  abtReads[16][2];
+  uint8_t  abtRx[MIFARE_WRITE_BATCH_MAX][265];
+  int      aiRes[MIFARE_WRITE_BATCH_MAX];
+  size_t   szRead = 0;
+  bool     bAuthenticated = false;
+
+  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true) < 0) {
+    nfc_perror(pnd, "nfc_device_set_property_bool");
+    return -1;
+  }
+  abtAuth[0] = mc;
+  abtAuth[1] = ui8Block;
+  memcpy(abtAuth + 2, pmpa, sizeof(struct mifare_param_auth));
+
+  // A 16 blocks sector does not fit in one batch with its authentication
+  while (szRead < szBlocks) {
+    size_t szFrames = 0;
+    nfc_batch_begin(pnd);
+    if (!bAuthenticated) {
+      nfc_batch_append(pnd, abtAuth, sizeof(abtAuth), abtRx[0], sizeof(abtRx[0]), &(aiRes[0]));
+      szFrames++;
+    }
+    for (size_t i = szRead; (i < szBlocks) && (szFrames < MIFARE_WRITE_BATCH_MAX); i++) {
+      abtReads[i][0] = MC_READ;
+      abtReads[i][1] = ui8Block + i;
+      nfc_batch_append(pnd, abtReads[i], sizeof(abtReads[i]), abtRx[szFrames], sizeof(abtRx[szFrames]), &(aiRes[szFrames]));
+      szFrames++;
+    }
+    nfc_batch_commit(pnd, -1);
+
+    size_t szFrame = 0;
+    if (!bAuthenticated) {
+      if (aiRes[0] < 0)
+        return -1;
+      bAuthenticated = true;
+      szFrame++;
+    }
+    for (; szFrame < szFrames; szFrame++) {
+      if (aiRes[szFrame] != 16)
+        return (int) szRead;
+      memcpy(amb[szRead].mbd.abtData, abtRx[szFrame], 16);
+      szRead++;
+    }
+  }
+  return (int) szRead;
+}
+
+// Decode a value block: value, ~value, value, then addr, ~addr, addr, ~addr
+static bool
+mifare_classic_value_decode(const uint8_t *pbtBlock, int32_t *piValue)
+{
+  for (size_t i = 0; i < 4; i++) {
+    if ((pbtBlock[i] != pbtBlock[8 + i]) || (pbtBlock[i] != (uint8_t) ~pbtBlock[4 + i]))
+      return false;
+  }
+  if ((pbtBlock[12] != pbtBlock[14]) || (pbtBlock[13] != pbtBlock[15]) || (pbtBlock[12] != (uint8_t) ~pbtBlock[13]))
+    return false;
+  *piValue = (int32_t)(pbtBlock[0] | (pbtBlock[1] << 8) | (pbtBlock[2] << 16) | ((uint32_t) pbtBlock[3] << 24));
+  return true;
+}
+
+/**
+ * @brief Authenticate, then decrement or increment a MIFARE Classic value block and check the result
+ * @return Returns 0 on success, NFC_EMFCAUTHFAIL if the authentication failed,
+ * NFC_ERFTRANS if the tag refused a command, NFC_EIO if a block read is not a
+ * value block or the new value is not the expected one
+ * @param mc MC_AUTH_A or MC_AUTH_B
+ * @param ui8Block value block
+ * @param pmpa key and UID to authenticate with
+ * @param mcOp MC_DECREMENT or MC_INCREMENT
+ * @param uiAmount amount to take from or add to the value
+ * @param piBefore if not NULL, will receive the value before the operation
+ * @param piAfter if not NULL, will receive the value after the operation
+ *
+ * AUTH, READ, DECREMENT or INCREMENT, TRANSFER and READ again are exchanged in
+ * one nfc_batch_commit(), so the host makes no decision between them: the tag
+ * itself refuses to operate on a block which is not a value block, while a
+ * minimum balance, if any, must be checked by the caller beforehand. As with
+ * nfc_initiator_mifare_cmd(), the tag must be selected again after a failure.
+ */
+int
+nfc_initiator_mifare_value_transaction(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, const struct mifare_param_auth *pmpa,
+                                       const mifare_cmd mcOp, const uint32_t uiAmount, int32_t *piBefore, int32_t *piAfter)
+{
+  enum { FRAME_AUTH, FRAME_READ_BEFORE, FRAME_OP, FRAME_TRANSFER, FRAME_READ_AFTER, FRAMES };
+  uint8_t  abtAuth[2 + sizeof(struct mifare_param_auth)];
+  uint8_t  abtRead[2] = { MC_READ, ui8Block };
+  uint8_t  abtOp[2 + sizeof(struct mifare_param_value)];
+  uint8_t  abtTransfer[2] = { MC_TRANSFER, ui8Block };
+  uint8_t  abtRx[FRAMES][265];
+  int      aiRes[FRAMES];
+  int32_t  iBefore, iAfter;
+  mifare_cache *pmc = mifare_cache_find(pnd);
+
+  if ((mcOp != MC_DECREMENT) && (mcOp != MC_INCREMENT))
+    return NFC_EINVARG;
+  if (pmc)
+    mifare_cache_forget(pmc);
+  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true) < 0) {
+    nfc_perror(pnd, "nfc_device_set_property_bool");
+    return nfc_device_get_last_error(pnd);
+  }
+  abtAuth[0] = mc;
+  abtAuth[1] = ui8Block;
+  memcpy(abtAuth + 2, pmpa, sizeof(struct mifare_param_auth));
+  abtOp[0] = mcOp;
+  abtOp[1] = ui8Block;
+  for (size_t i = 0; i < 4; i++)
+    abtOp[2 + i] = uiAmount >> (8 * i);
+
+  nfc_batch_begin(pnd);
+  nfc_batch_append(pnd, abtAuth, sizeof(abtAuth), abtRx[FRAME_AUTH], sizeof(abtRx[FRAME_AUTH]), &(aiRes[FRAME_AUTH]));
+  nfc_batch_append(pnd, abtRead, sizeof(abtRead), abtRx[FRAME_READ_BEFORE], sizeof(abtRx[FRAME_READ_BEFORE]), &(aiRes[FRAME_READ_BEFORE]));
+  nfc_batch_append(pnd, abtOp, sizeof(abtOp), abtRx[FRAME_OP], sizeof(abtRx[FRAME_OP]), &(aiRes[FRAME_OP]));
+  nfc_batch_append(pnd, abtTransfer, sizeof(abtTransfer), abtRx[FRAME_TRANSFER], sizeof(abtRx[FRAME_TRANSFER]), &(aiRes[FRAME_TRANSFER]));
+  nfc_batch_append(pnd, abtRead, sizeof(abtRead), abtRx[FRAME_READ_AFTER], sizeof(abtRx[FRAME_READ_AFTER]), &(aiRes[FRAME_READ_AFTER]));
+  const int res = nfc_batch_commit(pnd, -1);
+
+  if (aiRes[FRAME_AUTH] < 0)
+    return aiRes[FRAME_AUTH];
+  if (aiRes[FRAME_READ_BEFORE] < 0)
+    return aiRes[FRAME_READ_BEFORE];
+  if ((aiRes[FRAME_READ_BEFORE] != 16) || !mifare_classic_value_decode(abtRx[FRAME_READ_BEFORE], &iBefore))
+    return NFC_EIO;
+  if (piBefore)
+    *piBefore = iBefore;
+  if (res < 0)
+    return res;
+  if ((aiRes[FRAME_READ_AFTER] != 16) || !mifare_classic_value_decode(abtRx[FRAME_READ_AFTER], &iAfter))
+    return NFC_EIO;
+  if (piAfter)
+    *piAfter = iAfter;
+  const uint32_t uiExpected = (mcOp == MC_DECREMENT) ? (uint32_t) iBefore - uiAmount : (uint32_t) iBefore + uiAmount;
+  return ((uint32_t) iAfter == uiExpected) ? 0 : NFC_EIO;
+}
+
+/**
+ * @brief Get the sector holding a MIFARE Classic block
+ */
+uint8_t
+mifare_classic_block_sector(const uint32_t uiBlock)
+{
+  return (uiBlock < 128) ? uiBlock / 4 : 32 + (uiBlock - 128) / 16;
+}
+
+/**
+ * @brief Empty a key cache
+ *
+ * The cache tells which keys worked for each sector, so that the next cards
+ * of a batch sharing the same keys authenticate on the first try.
+ */
+void
+mifare_key_cache_init(mifare_key_cache *pmkc)
+{
+  memset(pmkc, 0, sizeof(mifare_key_cache));
+}
+
+static int
+mifare_key_cache_auth_index(const mifare_cmd mc)
+{
+  return (mc == MC_AUTH_A) ? 0 : 1;
+}
+
+static struct mifare_key_uid *
+mifare_key_cache_find_uid(const mifare_key_cache *pmkc, const uint8_t *pbtUid, const mifare_cmd mc, const uint8_t ui8Sector)
+{
+  for (size_t i = 0; i < pmkc->szUids; i++) {
+    const struct mifare_key_uid *pmku = &(pmkc->aUids[i]);
+    if ((pmku->ui8Sector == ui8Sector) && (pmku->btAuth == mc) && (memcmp(pmku->abtUid, pbtUid, 4) == 0))
+      return (struct mifare_key_uid *) pmku;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Get the keys to try for a sector, likeliest first
+ * @return Returns the number of keys stored in \a aabtKeys
+ * @param pbtUid 4 bytes of UID used to authenticate
+ *
+ * The key last used for this very card comes first, then the keys which
+ * worked for this sector ordered by number of hits.
+ */
+size_t
+mifare_key_cache_get(const mifare_key_cache *pmkc, const uint8_t *pbtUid, const mifare_cmd mc, const uint8_t ui8Sector, uint8_t aabtKeys[][6], const size_t szKeys)
+{
+  const struct mifare_key_hit *amkh;
+  const struct mifare_key_uid *pmku;
+  size_t szFound = 0;
+
+  if (ui8Sector >= MIFARE_CLASSIC_SECTORS)
+    return 0;
+  if ((szFound < szKeys) && ((pmku = mifare_key_cache_find_uid(pmkc, pbtUid, mc, ui8Sector)) != NULL))
+    memcpy(aabtKeys[szFound++], pmku->abtKey, 6);
+  amkh = pmkc->aHits[mifare_key_cache_auth_index(mc)][ui8Sector];
+  for (size_t i = 0; (i < MIFARE_KEY_CACHE_KEYS) && amkh[i].uiHits && (szFound < szKeys); i++) {
+    if (pmku && (memcmp(pmku->abtKey, amkh[i].abtKey, 6) == 0))
+      continue;
+    memcpy(aabtKeys[szFound++], amkh[i].abtKey, 6);
+  }
+  return szFound;
+}
+
+static void
+mifare_key_cache_add_hits(mifare_key_cache *pmkc, const mifare_cmd mc, const uint8_t ui8Sector, const uint8_t *pbtKey, const uint32_t uiHits)
+{
+  struct mifare_key_hit *amkh = pmkc->aHits[mifare_key_cache_auth_index(mc)][ui8Sector];
+  size_t i;
+
+  // Known key, otherwise it replaces the least used one
+  for (i = 0; (i < MIFARE_KEY_CACHE_KEYS - 1) && amkh[i].uiHits && (memcmp(amkh[i].abtKey, pbtKey, 6) != 0); i++)
+    ;
+  if (memcmp(amkh[i].abtKey, pbtKey, 6) != 0) {
+    memcpy(amkh[i].abtKey, pbtKey, 6);
+    amkh[i].uiHits = 0;
+  }
+  amkh[i].uiHits += uiHits;
+  // Keep the order by hits
+  for (; (i > 0) && (amkh[i].uiHits > amkh[i - 1].uiHits); i--) {
+    const struct mifare_key_hit mkh = amkh[i - 1];
+    amkh[i - 1] = amkh[i];
+    amkh[i] = mkh;
+  }
+}
+
+static void
+mifare_key_cache_set_uid(mifare_key_cache *pmkc, const uint8_t *pbtUid, const mifare_cmd mc, const uint8_t ui8Sector, const uint8_t *pbtKey)
+{
+  struct mifare_key_uid *pmku = mifare_key_cache_find_uid(pmkc, pbtUid, mc, ui8Sector);
+
+  if (pmku == NULL) {
+    pmku = &(pmkc->aUids[pmkc->szNextUid]);
+    pmkc->szNextUid = (pmkc->szNextUid + 1) % MIFARE_KEY_CACHE_UIDS;
+    if (pmkc->szUids < MIFARE_KEY_CACHE_UIDS)
+      pmkc->szUids++;
+    memcpy(pmku->abtUid, pbtUid, 4);
+    pmku->ui8Sector = ui8Sector;
+    pmku->btAuth = mc;
+  }
+  memcpy(pmku->abtKey, pbtKey, 6);
+}
+
+/**
+ * @brief Record a key which authenticated a sector
+ */
+void
+mifare_key_cache_hit(mifare_key_cache *pmkc, const uint8_t *pbtUid, const mifare_cmd mc, const uint8_t ui8Sector, const uint8_t *pbtKey)
+{
+  if (ui8Sector >= MIFARE_CLASSIC_SECTORS)
+    return;
+  mifare_key_cache_add_hits(pmkc, mc, ui8Sector, pbtKey, 1);
+  mifare_key_cache_set_uid(pmkc, pbtUid, mc, ui8Sector, pbtKey);
+}
+
+static bool
+mifare_key_cache_parse_hex(const char *pcHex, uint8_t *pbtData, const size_t szData)
+{
+  for (size_t i = 0; i < szData; i++) {
+    unsigned int uiByte;
+    if (sscanf(pcHex + 2 * i, "%2x", &uiByte) != 1)
+      return false;
+    pbtData[i] = uiByte;
+  }
+  return true;
+}
+
+/**
+ * @brief Load a key cache saved by mifare_key_cache_save()
+ * @return Returns false if the file exists but can not be read
+ *
+ * The cache is emptied first; a missing file leaves it empty.
+ */
+bool
+mifare_key_cache_load(mifare_key_cache *pmkc, const char *pcFilename)
+{
+  char acLine[64];
+  FILE *pf;
+
+  mifare_key_cache_init(pmkc);
+  if ((pf = fopen(pcFilename, "r")) == NULL)
+    return true;
+  while (fgets(acLine, sizeof(acLine), pf)) {
+    char acUid[9], acKey[13], cAuth;
+    unsigned int uiSector;
+    unsigned long ulHits;
+    uint8_t abtUid[4], abtKey[6];
+
+    // "S <sector> <A|B> <key> <hits>" or "U <uid> <sector> <A|B> <key>"
+    if ((sscanf(acLine, "S %u %c %12s %lu", &uiSector, &cAuth, acKey, &ulHits) == 4) &&
+        (uiSector < MIFARE_CLASSIC_SECTORS) && ((cAuth == 'A') || (cAuth == 'B')) && mifare_key_cache_parse_hex(acKey, abtKey, 6)) {
+      mifare_key_cache_add_hits(pmkc, (cAuth == 'A') ? MC_AUTH_A : MC_AUTH_B, uiSector, abtKey, ulHits);
+    } else if ((sscanf(acLine, "U %8s %u %c %12s", acUid, &uiSector, &cAuth, acKey) == 4) &&
+               (uiSector < MIFARE_CLASSIC_SECTORS) && ((cAuth == 'A') || (cAuth == 'B')) &&
+               mifare_key_cache_parse_hex(acUid, abtUid, 4) && mifare_key_cache_parse_hex(acKey, abtKey, 6)) {
+      mifare_key_cache_set_uid(pmkc, abtUid, (cAuth == 'A') ? MC_AUTH_A : MC_AUTH_B, uiSector, abtKey);
+    } else {
+      fclose(pf);
+      return false;
+    }
+  }
+  fclose(pf);
+  return true;
+}
+
+/**
+ * @brief Save a key cache as text, one key per line
+ * @return Returns true on success
+ */
+bool
+mifare_key_cache_save(const mifare_key_cache *pmkc, const char *pcFilename)
+{
+  FILE *pf;
+  bool bOk = true;
+
+  if ((pf = fopen(pcFilename, "w")) == NULL)
+    return false;
+  for (int iAuth = 0; iAuth < 2; iAuth++) {
+    for (int iSector = 0; iSector < MIFARE_CLASSIC_SECTORS; iSector++) {
+      const struct mifare_key_hit *amkh = pmkc->aHits[iAuth][iSector];
+      for (size_t i = 0; (i < MIFARE_KEY_CACHE_KEYS) && amkh[i].uiHits; i++) {
+        const uint8_t *k = amkh[i].abtKey;
+        if (fprintf(pf, "S %d %c %02x%02x%02x%02x%02x%02x %lu\n", iSector, iAuth ? 'B' : 'A',
+                    k[0], k[1], k[2], k[3], k[4], k[5], (unsigned long) amkh[i].uiHits) < 0)
+          bOk = false;
+      }
+    }
+  }
+  // Oldest first so that loading rebuilds the same ring
+  for (size_t n = 0; n < pmkc->szUids; n++) {
+    const size_t i = (pmkc->szUids < MIFARE_KEY_CACHE_UIDS) ? n : (pmkc->szNextUid + n) % MIFARE_KEY_CACHE_UIDS;
+    const struct mifare_key_uid *pmku = &(pmkc->aUids[i]);
+    const uint8_t *u = pmku->abtUid, *k = pmku->abtKey;
+    if (fprintf(pf, "U %02x%02x%02x%02x %d %c %02x%02x%02x%02x%02x%02x\n", u[0], u[1], u[2], u[3], pmku->ui8Sector,
+                (pmku->btAuth == MC_AUTH_A) ? 'A' : 'B', k[0], k[1], k[2], k[3], k[4], k[5]) < 0)
+      bOk = false;
+  }
+  if (fclose(pf) != 0)
+    bOk = false;
+  return bOk;
+}
+
+/**
+ * @brief Empty a card content cache
+ * @param mci how the cards tell their content changed
+ * @param ui8Indicator block read for MIFARE_CACHE_VERSION_BLOCK, counter number for MIFARE_CACHE_COUNTER
+ *
+ * The cache remembers what nfc_initiator_mifare_cmd() read from the last
+ * MIFARE_CACHE_CARDS cards, keyed by their UID and by the value of the change
+ * indicator. The indicator is only worth something if whoever writes the
+ * cards changes it along with the content.
+ *
+ * @warning Neither the UID nor the indicator authenticate the card: a card
+ * cloned with both gets the content of the original. MIFARE Classic blocks
+ * are only returned once the card accepted the key of their sector, which
+ * catches a changed key or a clone without the keys, but MIFARE Ultralight
+ * and NTAG content is returned on the UID and indicator alone. Do not use the
+ * cache where the content read decides access.
+ */
+void
+mifare_cache_init(mifare_cache *pmc, const mifare_cache_indicator mci, const uint8_t ui8Indicator)
+{
+  memset(pmc, 0, sizeof(mifare_cache));
+  pmc->mci = mci;
+  pmc->ui8Indicator = ui8Indicator;
+}
+
+/**
+ * @brief Read the change indicator of the selected card and use the cache for it
+ * @return Returns 1 if the card is known and its indicator did not change, 0
+ * if its content will be read again, or a libnfc error code
+ * @param pnt selected ISO14443A target
+ * @param mc MC_AUTH_A or MC_AUTH_B, when \a pmpa is not NULL
+ * @param pmpa key and UID to authenticate the sector of the version block
+ * with (MIFARE Classic), or NULL
+ *
+ * Until mifare_cache_end(), nfc_initiator_mifare_cmd() on \a pnd goes through
+ * the cache: a known card with an unchanged indicator costs one exchange for
+ * the indicator (two with the authentication) instead of all its reads.
+ * Commands changing the card from this reader drop what was read of it.
+ */
+int
+mifare_cache_begin(mifare_cache *pmc, nfc_device *pnd, const nfc_target *pnt, const mifare_cmd mc, const struct mifare_param_auth *pmpa)
+{
+  uint8_t  abtIndicator[16];
+  size_t   szIndicatorLen;
+  struct mifare_cache_card *pCard = NULL;
+  size_t   szFree = MIFARE_CACHE_DEVICES;
+
+  mifare_cache_end(pmc);
+  if (pnt->nm.nmt != NMT_ISO14443A)
+    return NFC_EINVARG;
+
+  if (pmc->mci == MIFARE_CACHE_COUNTER) {
+    uint8_t  abtCmd[2] = { 0x39, pmc->ui8Indicator };
+    int res;
+    if ((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true)) < 0)
+      return res;
+    if ((res = nfc_initiator_transceive_bytes(pnd, abtCmd, sizeof(abtCmd), abtIndicator, sizeof(abtIndicator), -1)) < 0)
+      return res;
+    if (res != 3)
+      return NFC_EIO;
+    szIndicatorLen = 3;
+  } else {
+    mifare_param mp;
+    if (pmpa) {
+      mp.mpa = *pmpa;
+      if (!mifare_cmd_exchange(pnd, mc, pmc->ui8Indicator, &mp))
+        return NFC_EMFCAUTHFAIL;
+    }
+    if (!mifare_cmd_exchange(pnd, MC_READ, pmc->ui8Indicator, &mp))
+      return NFC_EIO;
+    memcpy(abtIndicator, mp.mpd.abtData, 16);
+    szIndicatorLen = 16;
+  }
+
+  pthread_mutex_lock(&mtxActive);
+  for (size_t i = 0; i < MIFARE_CACHE_DEVICES; i++) {
+    if (!apmcActive[i])
+      szFree = i;
+  }
+  if (szFree == MIFARE_CACHE_DEVICES) {
+    pthread_mutex_unlock(&mtxActive);
+    return NFC_ESOFT;
+  }
+
+  // Same UID, else the least recently used entry
+  for (size_t i = 0; i < MIFARE_CACHE_CARDS; i++) {
+    struct mifare_cache_card *pEntry = &(pmc->aCards[i]);
+    if (pEntry->uiLastUse && (pEntry->szUidLen == pnt->nti.nai.szUidLen) && !memcmp(pEntry->abtUid, pnt->nti.nai.abtUid, pEntry->szUidLen)) {
+      pCard = pEntry;
+      break;
+    }
+    if (!pCard || (pEntry->uiLastUse < pCard->uiLastUse))
+      pCard = pEntry;
+  }
+
+  int res = 1;
+  if ((pCard->szUidLen != pnt->nti.nai.szUidLen) || memcmp(pCard->abtUid, pnt->nti.nai.abtUid, pCard->szUidLen) || !pCard->uiLastUse ||
+      (pCard->szIndicatorLen != szIndicatorLen) || memcmp(pCard->abtIndicator, abtIndicator, szIndicatorLen)) {
+    memset(pCard, 0, sizeof(struct mifare_cache_card));
+    memcpy(pCard->abtUid, pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen);
+    pCard->szUidLen = pnt->nti.nai.szUidLen;
+    memcpy(pCard->abtIndicator, abtIndicator, szIndicatorLen);
+    pCard->szIndicatorLen = szIndicatorLen;
+    res = 0;
+  }
+  pCard->uiLastUse = ++pmc->uiClock;
+
+  pmc->pnd = pnd;
+  pmc->pCard = pCard;
+  pmc->bClassic = (pnt->nti.nai.btSak & 0x08) != 0;
+  pmc->bAuth = false;
+  pmc->bAuthPending = false;
+  memset(pmc->abtAccepted, 0, sizeof(pmc->abtAccepted));
+  if (pmpa && (pmc->mci == MIFARE_CACHE_VERSION_BLOCK)) {
+    const size_t szType = mc - MC_AUTH_A;
+    const uint8_t ui8Sector = mifare_classic_block_sector(pmc->ui8Indicator);
+    pmc->abtAccepted[szType][ui8Sector / 8] |= 1 << (ui8Sector % 8);
+    memcpy(pmc->abtAcceptedKeys[szType][ui8Sector], pmpa->abtKey, 6);
+  }
+  apmcActive[szFree] = pmc;
+  pthread_mutex_unlock(&mtxActive);
+  return res;
+}
+
+/**
+ * @brief Stop using the cache, e.g. when the card left the field
+ *
+ * An authentication still held back is dropped.
+ */
+void
+mifare_cache_end(mifare_cache *pmc)
+{
+  pthread_mutex_lock(&mtxActive);
+  for (size_t i = 0; i < MIFARE_CACHE_DEVICES; i++) {
+    if (apmcActive[i] == pmc)
+      apmcActive[i] = NULL;
+  }
+  pthread_mutex_unlock(&mtxActive);
+  pmc->pnd = NULL;
+  pmc->pCard = NULL;
+  pmc->bAuth = false;
+  pmc->bAuthPending = false;
+}
@@ -52,6 +52,7 @@ typedef enum {
   MC_AUTH_A = 0x60,
   MC_AUTH_B = 0x61,
   MC_READ = 0x30,
+  MC_FAST_READ = 0x3A,
   MC_WRITE = 0xA0,
   MC_TRANSFER = 0xB0,
   MC_DECREMENT = 0xC0,
@@ -59,6 +60,13 @@ typedef enum {
   MC_STORE = 0xC2
 } mifare_cmd;
 
+// Pages returned by one FAST_READ: an extended frame (PN53x_EXTENDED_FRAME__DATA_MAX_LEN,
+// 264 bytes) less the chip answer code and status byte
+#  define MIFARE_FAST_READ_MAX_PAGES ((264 - 3) / 4)
+
+// MIFARE WRITE commands queued in one nfc_batch_commit()
+#  define MIFARE_WRITE_BATCH_MAX 16
+
 // MIFARE command params
 struct mifare_param_auth {
   uint8_t  abtKey[6];
@@ -69,6 +77,11 @@ struct mifare_param_data {
   uint8_t  abtData[16];
 };
 
+struct mifare_param_fast_read {
+  uint8_t  ui8EndPage;
+  uint8_t  abtData[MIFARE_FAST_READ_MAX_PAGES * 4];
+};
+
 struct mifare_param_value {
   uint8_t  abtValue[4];
 };
@@ -82,6 +95,7 @@ struct mifare_param_trailer {
 typedef union {
   struct mifare_param_auth mpa;
   struct mifare_param_data mpd;
+  struct mifare_param_fast_read mpfr;
   struct mifare_param_value mpv;
   struct mifare_param_trailer mpt;
 } mifare_param;
@@ -90,6 +104,7 @@ typedef union {
 #  pragma pack()
 
 bool    nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp);
+size_t  nfc_initiator_mifare_write_batch(nfc_device *pnd, const uint8_t *pui8Blocks, const struct mifare_param_data *ampd, const size_t szBlocks);
 
 // Compiler directive, set struct alignment to 1 uint8_t for compatibility
 #  pragma pack(1)
@@ -287,4 +302,92 @@ typedef union {
 // Reset struct alignment to default
 #  pragma pack()
 
+int     nfc_initiator_mifare_read_sector(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, const struct mifare_param_auth *pmpa, mifare_classic_block *amb);
+int     nfc_initiator_mifare_value_transaction(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, const struct mifare_param_auth *pmpa,
+                                               const mifare_cmd mcOp, const uint32_t uiAmount, int32_t *piBefore, int32_t *piAfter);
+
+// MIFARE Classic 4K: 32 sectors of 4 blocks then 8 sectors of 16 blocks
+#  define MIFARE_CLASSIC_SECTORS 40
+// Keys remembered per sector and key type
+#  define MIFARE_KEY_CACHE_KEYS 8
+// (UID, sector, key type) remembered with the key which worked
+#  define MIFARE_KEY_CACHE_UIDS 1024
+
+struct mifare_key_hit {
+  uint8_t  abtKey[6];
+  uint32_t uiHits;
+};
+
+struct mifare_key_uid {
+  uint8_t  abtUid[4];
+  uint8_t  ui8Sector;
+  uint8_t  btAuth;
+  uint8_t  abtKey[6];
+};
+
+typedef struct {
+  // Sorted by decreasing hits, unused entries have no hit
+  struct mifare_key_hit aHits[2][MIFARE_CLASSIC_SECTORS][MIFARE_KEY_CACHE_KEYS];
+  // Ring of the last cards seen
+  struct mifare_key_uid aUids[MIFARE_KEY_CACHE_UIDS];
+  size_t   szUids;
+  size_t   szNextUid;
+} mifare_key_cache;
+
+uint8_t mifare_classic_block_sector(const uint32_t uiBlock);
+void    mifare_key_cache_init(mifare_key_cache *pmkc);
+bool    mifare_key_cache_load(mifare_key_cache *pmkc, const char *pcFilename);
+bool    mifare_key_cache_save(const mifare_key_cache *pmkc, const char *pcFilename);
+size_t  mifare_key_cache_get(const mifare_key_cache *pmkc, const uint8_t *pbtUid, const mifare_cmd mc, const uint8_t ui8Sector, uint8_t aabtKeys[][6], const size_t szKeys);
+void    mifare_key_cache_hit(mifare_key_cache *pmkc, const uint8_t *pbtUid, const mifare_cmd mc, const uint8_t ui8Sector, const uint8_t *pbtKey);
+
+// Cards remembered by a mifare_cache
+#  define MIFARE_CACHE_CARDS 8
+// READ answers remembered per card, one per block (or page) address
+#  define MIFARE_CACHE_BLOCKS 256
+
+typedef enum {
+  // A block read with MC_READ, which the writer changes with the content
+  MIFARE_CACHE_VERSION_BLOCK,
+  // A READ_CNT counter (MIFARE Ultralight EV1 counters 0 to 2, NTAG21x
+  // counter 2), which the writer increments with the content
+  MIFARE_CACHE_COUNTER,
+} mifare_cache_indicator;
+
+struct mifare_cache_card {
+  uint8_t  abtUid[10];
+  size_t   szUidLen;
+  uint8_t  abtIndicator[16];
+  size_t   szIndicatorLen;
+  // Zero when the entry is unused
+  uint32_t uiLastUse;
+  uint8_t  abtCached[MIFARE_CACHE_BLOCKS / 8];
+  uint8_t  abtBlocks[MIFARE_CACHE_BLOCKS][16];
+};
+
+typedef struct {
+  mifare_cache_indicator mci;
+  uint8_t  ui8Indicator;
+  struct mifare_cache_card aCards[MIFARE_CACHE_CARDS];
+  uint32_t uiClock;
+  // Card in the field, between mifare_cache_begin() and mifare_cache_end()
+  nfc_device *pnd;
+  struct mifare_cache_card *pCard;
+  // MIFARE Classic: cached blocks are only given out behind an accepted authentication
+  bool     bClassic;
+  // Last authentication asked for, held back until a command needs the tag
+  bool     bAuth;
+  bool     bAuthPending;
+  mifare_cmd mcAuth;
+  uint8_t  ui8AuthBlock;
+  struct mifare_param_auth mpaAuth;
+  // Sectors (per key type) and keys the card accepted since mifare_cache_begin()
+  uint8_t  abtAccepted[2][(MIFARE_CLASSIC_SECTORS + 7) / 8];
+  uint8_t  abtAcceptedKeys[2][MIFARE_CLASSIC_SECTORS][6];
+} mifare_cache;
+
+void    mifare_cache_init(mifare_cache *pmc, const mifare_cache_indicator mci, const uint8_t ui8Indicator);
+int     mifare_cache_begin(mifare_cache *pmc, nfc_device *pnd, const nfc_target *pnt, const mifare_cmd mc, const struct mifare_param_auth *pmpa);
+void    mifare_cache_end(mifare_cache *pmc);
+
 #endif // _LIBNFC_MIFARE_H_
@@ -0,0 +1,389 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+/**
+ * @file ndef.c
+ * @brief NDEF TLVs and records, read in place and written straight into tag memory
+ */
+#include "ndef.h"
+
+#include <string.h>
+
+/**
+ * @brief Start walking the TLVs or the records of a buffer
+ * @param pni The iterator to initialize
+ * @param pbtBuf Tag memory (TLVs) or NDEF message (records), which must outlive the iterator
+ * @param szBuf Length of \a pbtBuf
+ */
+void
+ndef_iter_init(ndef_iter *pni, const uint8_t *pbtBuf, const size_t szBuf)
+{
+  pni->pbtBuf = pbtBuf;
+  pni->szBuf = szBuf;
+  pni->szPos = 0;
+  pni->bEnd = false;
+}
+
+/**
+ * @brief Get the next TLV, NULL TLVs skipped
+ * @return 1 when \a ptlv was set, 0 at the Terminator TLV or the end of the buffer, -1 on a truncated TLV
+ *
+ * \a ptlv value points into the walked buffer.
+ */
+int
+ndef_tlv_next(ndef_iter *pni, ndef_tlv *ptlv)
+{
+  const uint8_t *pbt = pni->pbtBuf;
+
+  while (!pni->bEnd && (pni->szPos < pni->szBuf)) {
+    const uint8_t btType = pbt[pni->szPos++];
+    if (btType == NDEF_TLV_NULL)
+      continue;
+    if (btType == NDEF_TLV_TERMINATOR)
+      break;
+
+    size_t szLen;
+    if (pni->szPos >= pni->szBuf)
+      goto truncated;
+    szLen = pbt[pni->szPos++];
+    if (szLen == 0xFF) {
+      if (pni->szBuf - pni->szPos < 2)
+        goto truncated;
+      szLen = (pbt[pni->szPos] << 8) | pbt[pni->szPos + 1];
+      pni->szPos += 2;
+    }
+    if (pni->szBuf - pni->szPos < szLen)
+      goto truncated;
+    ptlv->btType = btType;
+    ptlv->pbtValue = pbt + pni->szPos;
+    ptlv->szValue = szLen;
+    pni->szPos += szLen;
+    return 1;
+  }
+  pni->bEnd = true;
+  return 0;
+
+truncated:
+  pni->bEnd = true;
+  return -1;
+}
+
+/**
+ * @brief Find the NDEF message of Type 1 or 2 tag memory
+ * @return A pointer to the message in \a pbtBuf, NULL if there is none
+ * @param pbtBuf Data area of the tag
+ * @param szBuf Length of \a pbtBuf
+ * @param[out] pszMessage Length of the message
+ */
+const uint8_t *
+ndef_tlv_find_message(const uint8_t *pbtBuf, const size_t szBuf, size_t *pszMessage)
+{
+  ndef_iter ni;
+  ndef_tlv tlv;
+
+  ndef_iter_init(&ni, pbtBuf, szBuf);
+  while (ndef_tlv_next(&ni, &tlv) > 0) {
+    if (tlv.btType == NDEF_TLV_MESSAGE) {
+      *pszMessage = tlv.szValue;
+      return tlv.pbtValue;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Get the next record of a NDEF message
+ * @return 1 when \a prec was set, 0 after the record flagged ME or at the end of the buffer, -1 on a truncated record
+ *
+ * Type, ID and payload of \a prec point into the walked message. Chunked
+ * records (CF) are returned chunk by chunk.
+ */
+int
+ndef_record_next(ndef_iter *pni, ndef_record *prec)
+{
+  const uint8_t *pbt = pni->pbtBuf + pni->szPos;
+  const size_t szLeft = pni->szBuf - pni->szPos;
+
+  if (pni->bEnd || (szLeft == 0)) {
+    pni->bEnd = true;
+    return 0;
+  }
+
+  const uint8_t btHeader = pbt[0];
+  const size_t szHeader = 2 + ((btHeader & NDEF_SR) ? 1 : 4) + ((btHeader & NDEF_IL) ? 1 : 0);
+  if (szLeft < szHeader)
+    goto truncated;
+
+  size_t szPos = 1;
+  const size_t szType = pbt[szPos++];
+  uint32_t ui32Payload;
+  if (btHeader & NDEF_SR) {
+    ui32Payload = pbt[szPos++];
+  } else {
+    ui32Payload = ((uint32_t) pbt[szPos] << 24) | ((uint32_t) pbt[szPos + 1] << 16) | ((uint32_t) pbt[szPos + 2] << 8) | pbt[szPos + 3];
+    szPos += 4;
+  }
+  const size_t szId = (btHeader & NDEF_IL) ? pbt[szPos++] : 0;
+  if ((szLeft - szHeader < szType + szId) || (szLeft - szHeader - szType - szId < ui32Payload))
+    goto truncated;
+
+  prec->btHeader = btHeader;
+  prec->btTnf = btHeader & 0x07;
+  prec->pbtType = pbt + szPos;
+  prec->szType = szType;
+  szPos += szType;
+  prec->pbtId = pbt + szPos;
+  prec->szId = szId;
+  szPos += szId;
+  prec->pbtPayload = pbt + szPos;
+  prec->szPayload = ui32Payload;
+  pni->szPos += szPos + ui32Payload;
+  pni->bEnd = (btHeader & NDEF_ME) != 0;
+  return 1;
+
+truncated:
+  pni->bEnd = true;
+  return -1;
+}
+
+/**
+ * @brief Start writing a NDEF message
+ * @param pnw The writer to initialize
+ * @param pbtBuf Where the message goes, e.g. the data area of the tag memory to write or emulate
+ * @param szBuf Length of \a pbtBuf
+ * @param framing What wraps the records
+ *
+ * The TLV length takes three bytes when \a pbtBuf could hold a message of 255
+ * bytes or more, ndef_writer_finish() only moves the message back to a one
+ * byte length when it turns out shorter. A 255 bytes message filling the
+ * buffer with a one byte length, the Terminator TLV left out, does not fit.
+ */
+void
+ndef_writer_init(ndef_writer *pnw, uint8_t *pbtBuf, const size_t szBuf, const ndef_framing framing)
+{
+  pnw->pbtBuf = pbtBuf;
+  pnw->szBuf = szBuf;
+  pnw->framing = framing;
+  pnw->szLast = SIZE_MAX;
+  pnw->szPayloadLenLen = 0;
+  pnw->bOverflow = false;
+  switch (framing) {
+    case NDEF_FRAMING_NONE:
+      pnw->szLenLen = 0;
+      pnw->szPos = 0;
+      break;
+    case NDEF_FRAMING_TLV:
+      // Type, length and Terminator TLV
+      pnw->szLenLen = ((szBuf < 3) || (szBuf - 3 < 0xFF)) ? 1 : 3;
+      pnw->szPos = 1 + pnw->szLenLen;
+      break;
+    case NDEF_FRAMING_NLEN:
+      pnw->szLenLen = 2;
+      pnw->szPos = 2;
+      break;
+  }
+  if (pnw->szPos > szBuf)
+    pnw->bOverflow = true;
+}
+
+// Writes a record header for a payload of up to szPayloadMax bytes
+static uint8_t *
+ndef_writer_header(ndef_writer *pnw, const uint8_t btTnf, const uint8_t *pbtType, const size_t szType,
+                   const uint8_t *pbtId, const size_t szId, const size_t szPayloadMax, size_t *pszRoom)
+{
+  if (pnw->bOverflow || pnw->szPayloadLenLen || (szType > 0xFF) || (szId > 0xFF) || (btTnf > NDEF_TNF_UNCHANGED)) {
+    pnw->bOverflow = true;
+    return NULL;
+  }
+
+  const size_t szLeft = pnw->szBuf - pnw->szPos;
+  const size_t szShort = 3 + (pbtId ? 1 : 0) + szType + szId;
+  if (szLeft < szShort) {
+    pnw->bOverflow = true;
+    return NULL;
+  }
+  const bool bShort = (szPayloadMax <= 0xFF) || (szLeft - szShort <= 0xFF);
+  const size_t szHeader = szShort + (bShort ? 0 : 3);
+  if (szLeft < szHeader) {
+    pnw->bOverflow = true;
+    return NULL;
+  }
+
+  uint8_t *pbt = pnw->pbtBuf + pnw->szPos;
+  size_t szPos = 0;
+  pbt[szPos++] = ((pnw->szLast == SIZE_MAX) ? NDEF_MB : 0) | (bShort ? NDEF_SR : 0) | (pbtId ? NDEF_IL : 0) | btTnf;
+  pbt[szPos++] = (uint8_t) szType;
+  pnw->szPayloadLenPos = pnw->szPos + szPos;
+  pnw->szPayloadLenLen = bShort ? 1 : 4;
+  szPos += pnw->szPayloadLenLen;
+  if (pbtId)
+    pbt[szPos++] = (uint8_t) szId;
+  if (szType)
+    memcpy(pbt + szPos, pbtType, szType);
+  szPos += szType;
+  if (szId)
+    memcpy(pbt + szPos, pbtId, szId);
+  szPos += szId;
+
+  pnw->szLast = pnw->szPos;
+  pnw->szPos += szPos;
+  *pszRoom = pnw->szBuf - pnw->szPos;
+  if (bShort && (*pszRoom > 0xFF))
+    *pszRoom = 0xFF;
+  return pnw->pbtBuf + pnw->szPos;
+}
+
+/**
+ * @brief Start a record whose payload the caller writes in place
+ * @return Where the payload goes, NULL if the record header does not fit
+ * @param pnw The writer
+ * @param btTnf Type Name Format of the record
+ * @param pbtType Record type
+ * @param szType Length of \a pbtType
+ * @param pbtId Record ID, NULL for none
+ * @param szId Length of \a pbtId
+ * @param[out] pszRoom Room left for the payload
+ *
+ * The payload, up to \a pszRoom bytes, is then written at the returned address
+ * and the record closed by ndef_writer_end_record(). A nested message (e.g.
+ * of a Smart Poster) can be written there by a second writer without framing.
+ */
+uint8_t *
+ndef_writer_begin_record(ndef_writer *pnw, const uint8_t btTnf, const uint8_t *pbtType, const size_t szType,
+                         const uint8_t *pbtId, const size_t szId, size_t *pszRoom)
+{
+  return ndef_writer_header(pnw, btTnf, pbtType, szType, pbtId, szId, SIZE_MAX, pszRoom);
+}
+
+/**
+ * @brief Close the record started by ndef_writer_begin_record()
+ * @return 0 on success, -1 if \a szPayload exceeds the room that was left
+ */
+int
+ndef_writer_end_record(ndef_writer *pnw, const size_t szPayload)
+{
+  if (pnw->bOverflow || !pnw->szPayloadLenLen)
+    return -1;
+
+  const size_t szRoom = pnw->szBuf - pnw->szPos;
+  if ((szPayload > szRoom) || ((pnw->szPayloadLenLen == 1) && (szPayload > 0xFF)) || (szPayload > UINT32_MAX)) {
+    pnw->bOverflow = true;
+    return -1;
+  }
+  uint8_t *pbt = pnw->pbtBuf + pnw->szPayloadLenPos;
+  if (pnw->szPayloadLenLen == 1) {
+    pbt[0] = (uint8_t) szPayload;
+  } else {
+    pbt[0] = (uint8_t)(szPayload >> 24);
+    pbt[1] = (uint8_t)(szPayload >> 16);
+    pbt[2] = (uint8_t)(szPayload >> 8);
+    pbt[3] = (uint8_t) szPayload;
+  }
+  pnw->szPayloadLenLen = 0;
+  pnw->szPos += szPayload;
+  return 0;
+}
+
+/**
+ * @brief Append a record without ID whose payload is already at hand
+ * @return 0 on success, -1 if it does not fit
+ */
+int
+ndef_writer_add_record(ndef_writer *pnw, const uint8_t btTnf, const uint8_t *pbtType, const size_t szType,
+                       const uint8_t *pbtPayload, const size_t szPayload)
+{
+  size_t szRoom;
+  uint8_t *pbt;
+
+  if (!(pbt = ndef_writer_header(pnw, btTnf, pbtType, szType, NULL, 0, szPayload, &szRoom)))
+    return -1;
+  if (szPayload > szRoom) {
+    pnw->bOverflow = true;
+    return -1;
+  }
+  if (szPayload)
+    memcpy(pbt, pbtPayload, szPayload);
+  return ndef_writer_end_record(pnw, szPayload);
+}
+
+/**
+ * @brief Flag the last record and fill the framing in
+ * @return Bytes written in the buffer, framing included, or -1 if the message did not fit
+ */
+int
+ndef_writer_finish(ndef_writer *pnw)
+{
+  if (pnw->bOverflow || pnw->szPayloadLenLen)
+    return -1;
+  if (pnw->szLast != SIZE_MAX)
+    pnw->pbtBuf[pnw->szLast] |= NDEF_ME;
+
+  const size_t szMessage = pnw->szPos - (pnw->szLenLen + ((pnw->framing == NDEF_FRAMING_TLV) ? 1 : 0));
+  uint8_t *pbt = pnw->pbtBuf;
+  switch (pnw->framing) {
+    case NDEF_FRAMING_NONE:
+      break;
+    case NDEF_FRAMING_TLV:
+      if (szMessage > 0xFFFE)
+        return -1;
+      pbt[0] = NDEF_TLV_MESSAGE;
+      if (szMessage < 0xFF) {
+        if (pnw->szLenLen == 3) {
+          memmove(pbt + 2, pbt + 4, szMessage);
+          pnw->szPos -= 2;
+          pnw->szLenLen = 1;
+        }
+        pbt[1] = (uint8_t) szMessage;
+      } else {
+        // Widening the length in place would overwrite the first record
+        if (pnw->szLenLen != 3)
+          return -1;
+        pbt[1] = 0xFF;
+        pbt[2] = (uint8_t)(szMessage >> 8);
+        pbt[3] = (uint8_t) szMessage;
+      }
+      // The Terminator TLV may be left out when the message fills the memory
+      if (pnw->szPos < pnw->szBuf)
+        pbt[pnw->szPos++] = NDEF_TLV_TERMINATOR;
+      break;
+    case NDEF_FRAMING_NLEN:
+      if (szMessage > 0xFFFF)
+        return -1;
+      pbt[0] = (uint8_t)(szMessage >> 8);
+      pbt[1] = (uint8_t) szMessage;
+      break;
+  }
+  return (int) pnw->szPos;
+}
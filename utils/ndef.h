@@ -0,0 +1,139 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file ndef.h
+ * @brief NDEF TLVs and records, read in place and written straight into tag memory
+ *
+ * Readers hand out views (pointer and length) into the buffer they walk, which
+ * is never copied. Writers lay records out directly in the buffer that is then
+ * written to the tag or emulated, payloads being filled in place by the caller.
+ */
+
+#ifndef _LIBNFC_NDEF_H_
+#  define _LIBNFC_NDEF_H_
+
+#  include <stdbool.h>
+#  include <stddef.h>
+#  include <stdint.h>
+
+// TLV blocks of NFC Forum Type 1 and 2 tags
+#  define NDEF_TLV_NULL           0x00
+#  define NDEF_TLV_LOCK_CONTROL   0x01
+#  define NDEF_TLV_MEMORY_CONTROL 0x02
+#  define NDEF_TLV_MESSAGE        0x03
+#  define NDEF_TLV_PROPRIETARY    0xFD
+#  define NDEF_TLV_TERMINATOR     0xFE
+
+// Record header flags
+#  define NDEF_MB 0x80
+#  define NDEF_ME 0x40
+#  define NDEF_CF 0x20
+#  define NDEF_SR 0x10
+#  define NDEF_IL 0x08
+
+// Type Name Format
+#  define NDEF_TNF_EMPTY      0x00
+#  define NDEF_TNF_WELL_KNOWN 0x01
+#  define NDEF_TNF_MEDIA      0x02
+#  define NDEF_TNF_URI        0x03
+#  define NDEF_TNF_EXTERNAL   0x04
+#  define NDEF_TNF_UNKNOWN    0x05
+#  define NDEF_TNF_UNCHANGED  0x06
+
+typedef struct {
+  uint8_t btType;
+  const uint8_t *pbtValue;
+  size_t  szValue;
+} ndef_tlv;
+
+typedef struct {
+  uint8_t btHeader;
+  uint8_t btTnf;
+  const uint8_t *pbtType;
+  size_t  szType;
+  const uint8_t *pbtId;
+  size_t  szId;
+  const uint8_t *pbtPayload;
+  size_t  szPayload;
+} ndef_record;
+
+// Walks TLVs or records of a buffer
+typedef struct {
+  const uint8_t *pbtBuf;
+  size_t  szBuf;
+  size_t  szPos;
+  bool    bEnd;
+} ndef_iter;
+
+typedef enum {
+  // Records only
+  NDEF_FRAMING_NONE,
+  // NDEF Message TLV then Terminator TLV (Type 1 and 2 tags)
+  NDEF_FRAMING_TLV,
+  // Two bytes NLEN (Type 4 tags)
+  NDEF_FRAMING_NLEN,
+} ndef_framing;
+
+typedef struct {
+  uint8_t *pbtBuf;
+  size_t  szBuf;
+  size_t  szPos;
+  ndef_framing framing;
+  // Bytes of the length field of the message TLV or NLEN
+  size_t  szLenLen;
+  // Offset of the last record header, SIZE_MAX if none
+  size_t  szLast;
+  // Offset of the payload length of the record being written and its size
+  size_t  szPayloadLenPos;
+  size_t  szPayloadLenLen;
+  bool    bOverflow;
+} ndef_writer;
+
+void    ndef_iter_init(ndef_iter *pni, const uint8_t *pbtBuf, const size_t szBuf);
+int     ndef_tlv_next(ndef_iter *pni, ndef_tlv *ptlv);
+const uint8_t *ndef_tlv_find_message(const uint8_t *pbtBuf, const size_t szBuf, size_t *pszMessage);
+int     ndef_record_next(ndef_iter *pni, ndef_record *prec);
+
+void    ndef_writer_init(ndef_writer *pnw, uint8_t *pbtBuf, const size_t szBuf, const ndef_framing framing);
+uint8_t *ndef_writer_begin_record(ndef_writer *pnw, const uint8_t btTnf, const uint8_t *pbtType, const size_t szType,
+                                  const uint8_t *pbtId, const size_t szId, size_t *pszRoom);
+int     ndef_writer_end_record(ndef_writer *pnw, const size_t szPayload);
+int     ndef_writer_add_record(ndef_writer *pnw, const uint8_t btTnf, const uint8_t *pbtType, const size_t szType,
+                               const uint8_t *pbtPayload, const size_t szPayload);
+int     ndef_writer_finish(ndef_writer *pnw);
+
+#endif // _LIBNFC_NDEF_H_
@@ -0,0 +1,525 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-bench-rf.c
+ * @brief Measures RF operations throughput and latency with a reader and a test card
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+// PN53x timer runs at 13.56 MHz
+#define CYCLES_PER_US 13.56
+
+struct bench_rf;
+
+struct bench_rf_run {
+  const struct bench_rf *test;
+  nfc_target nt;
+  nfc_baud_rate nbr;
+  bool bEasyFraming;
+  uint8_t ui8BlockNumber;
+  bool bTimed;
+};
+
+struct bench_rf {
+  const char *name;
+  nfc_modulation_type nmt;
+  // Whether the test can run with NP_EASY_FRAMING disabled
+  bool bRaw;
+  // Returns false when the selected target can not run the test
+  bool (*applicable)(const nfc_target *pnt);
+  // Optional preparation once the target is selected
+  int (*setup)(nfc_device *pnd, const nfc_target *pnt);
+  // One operation; returns libnfc's error code (negative value) on failure
+  int (*op)(nfc_device *pnd, struct bench_rf_run *run, uint32_t *pui32Cycles);
+};
+
+static nfc_device *pnd;
+static FILE *out;
+static bool bFirstResult = true;
+
+static double
+now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+static void
+json_string(const char *s)
+{
+  fputc('"', out);
+  for (; *s; s++) {
+    if ((*s == '"') || (*s == '\\'))
+      fprintf(out, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20)
+      fprintf(out, "\\u%04x", (unsigned char) *s);
+    else
+      fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+// Sends a frame, using the cycle counter when NP_EASY_FRAMING is off and the driver has one
+static int
+transceive(nfc_device *dev, struct bench_rf_run *run, const uint8_t *pbtTx, const size_t szTx,
+           uint8_t *pbtRx, const size_t szRx, uint32_t *pui32Cycles)
+{
+  if (run->bTimed) {
+    uint32_t cycles = 0;
+    int res = nfc_initiator_transceive_bytes_timed(dev, pbtTx, szTx, pbtRx, szRx, &cycles);
+    if ((res != NFC_ENOTIMPL) && (res != NFC_EDEVNOTSUPP)) {
+      if (res >= 0)
+        *pui32Cycles = cycles;
+      return res;
+    }
+    run->bTimed = false;
+  }
+  return nfc_initiator_transceive_bytes(dev, pbtTx, szTx, pbtRx, szRx, 0);
+}
+
+static bool
+is_any(const nfc_target *pnt)
+{
+  (void) pnt;
+  return true;
+}
+
+static bool
+is_mifare_classic(const nfc_target *pnt)
+{
+  return (pnt->nti.nai.btSak & 0x08) != 0;
+}
+
+static bool
+is_mifare_ultralight(const nfc_target *pnt)
+{
+  return (pnt->nti.nai.btSak == 0x00) && (pnt->nti.nai.abtAtqa[1] == 0x44);
+}
+
+static bool
+is_iso14443_4(const nfc_target *pnt)
+{
+  return (pnt->nti.nai.btSak & 0x20) != 0;
+}
+
+static int
+op_select_deselect(nfc_device *dev, struct bench_rf_run *run, uint32_t *pui32Cycles)
+{
+  (void) pui32Cycles;
+  const nfc_modulation nm = { .nmt = run->test->nmt, .nbr = run->nbr };
+  nfc_target nt;
+  int res;
+  if ((res = nfc_initiator_select_passive_target(dev, nm, NULL, 0, &nt)) <= 0)
+    return (res == 0) ? NFC_ENOTSUCHDEV : res;
+  return nfc_initiator_deselect_target(dev);
+}
+
+static int
+mifare_authenticate(nfc_device *dev, const nfc_target *pnt)
+{
+  // Key A of the first sector, as shipped
+  uint8_t abtAuth[12] = { 0x60, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  memcpy(abtAuth + 8, pnt->nti.nai.abtUid + pnt->nti.nai.szUidLen - 4, 4);
+  uint8_t abtRx[1];
+  return nfc_initiator_transceive_bytes(dev, abtAuth, sizeof(abtAuth), abtRx, sizeof(abtRx), 0);
+}
+
+static int
+op_mifare_read(nfc_device *dev, struct bench_rf_run *run, uint32_t *pui32Cycles)
+{
+  const uint8_t abtRead[] = { 0x30, 0x00 };
+  uint8_t abtRx[16];
+  return transceive(dev, run, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), pui32Cycles);
+}
+
+static int
+op_felica_check(nfc_device *dev, struct bench_rf_run *run, uint32_t *pui32Cycles)
+{
+  // CHECK (Read Without Encryption) of block 0 of the NFC Forum Tag Type 3 service
+  uint8_t abtCheck[16] = { 16, 0x06 };
+  memcpy(abtCheck + 2, run->nt.nti.nfi.abtId, 8);
+  memcpy(abtCheck + 10, "\x01\x0b\x00\x01\x80\x00", 6);
+  uint8_t abtRx[64];
+  int res = transceive(dev, run, abtCheck, sizeof(abtCheck), abtRx, sizeof(abtRx), pui32Cycles);
+  if ((res >= 2) && (abtRx[1] != 0x07))
+    return NFC_ERFTRANS;
+  return res;
+}
+
+static int
+op_apdu_echo(nfc_device *dev, struct bench_rf_run *run, uint32_t *pui32Cycles)
+{
+  // SELECT of the default application, the answer does not matter
+  uint8_t abtApdu[] = { 0x02, 0x00, 0xa4, 0x04, 0x00, 0x00 };
+  uint8_t abtRx[264];
+  if (run->bEasyFraming)
+    return transceive(dev, run, abtApdu + 1, sizeof(abtApdu) - 1, abtRx, sizeof(abtRx), pui32Cycles);
+
+  // Without easy framing, we have to build the I-block ourselves
+  abtApdu[0] |= run->ui8BlockNumber;
+  run->ui8BlockNumber ^= 0x01;
+  return transceive(dev, run, abtApdu, sizeof(abtApdu), abtRx, sizeof(abtRx), pui32Cycles);
+}
+
+static int
+op_dep_exchange(nfc_device *dev, struct bench_rf_run *run, uint32_t *pui32Cycles)
+{
+  (void) pui32Cycles;
+  (void) run;
+  // nfc-dep-target answers any message
+  const uint8_t abtTx[] = "Hello Mars!";
+  uint8_t abtRx[264];
+  return nfc_initiator_transceive_bytes(dev, abtTx, sizeof(abtTx), abtRx, sizeof(abtRx), 0);
+}
+
+static int
+op_target_is_present(nfc_device *dev, struct bench_rf_run *run, uint32_t *pui32Cycles)
+{
+  (void) run;
+  (void) pui32Cycles;
+  return nfc_initiator_target_is_present(dev, NULL);
+}
+
+static const struct bench_rf tests[] = {
+  { "select_deselect",   NMT_ISO14443A, false, is_any,               NULL,                op_select_deselect },
+  { "mifare_read",       NMT_ISO14443A, false, is_mifare_classic,    mifare_authenticate, op_mifare_read },
+  { "ultralight_read",   NMT_ISO14443A, true,  is_mifare_ultralight, NULL,                op_mifare_read },
+  { "felica_check",      NMT_FELICA,    true,  is_any,               NULL,                op_felica_check },
+  { "apdu_echo",         NMT_ISO14443A, true,  is_iso14443_4,        NULL,                op_apdu_echo },
+  { "dep_exchange",      NMT_DEP,       false, is_any,               NULL,                op_dep_exchange },
+  { "target_is_present", NMT_ISO14443A, false, is_any,               NULL,                op_target_is_present },
+};
+
+static int
+compare_double(const void *a, const void *b)
+{
+  const double da = *(const double *) a;
+  const double db = *(const double *) b;
+  return (da > db) - (da < db);
+}
+
+static double
+percentile(const double *pdSorted, const size_t szCount, const double dPercent)
+{
+  size_t i = (size_t)((dPercent / 100.0) * szCount + 0.999999);
+  if (i > 0)
+    i--;
+  return pdSorted[(i < szCount) ? i : szCount - 1];
+}
+
+static void
+print_distribution(const char *pcName, double *pdValues, const size_t szCount)
+{
+  qsort(pdValues, szCount, sizeof(double), compare_double);
+  fprintf(out, ", \"%s\": { \"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f }",
+          pcName, pdValues[0], percentile(pdValues, szCount, 50), percentile(pdValues, szCount, 90),
+          percentile(pdValues, szCount, 99), pdValues[szCount - 1]);
+}
+
+static void
+print_result_header(const struct bench_rf *test, const nfc_baud_rate nbr, const bool bEasyFraming)
+{
+  fprintf(out, "%s\n    { \"test\": ", bFirstResult ? "" : ",");
+  bFirstResult = false;
+  json_string(test->name);
+  fprintf(out, ", \"modulation\": ");
+  json_string(str_nfc_modulation_type(test->nmt));
+  fprintf(out, ", \"baud_rate\": ");
+  json_string(str_nfc_baud_rate(nbr));
+  fprintf(out, ", \"easy_framing\": %s", bEasyFraming ? "true" : "false");
+}
+
+static void
+print_skipped(const struct bench_rf *test, const nfc_baud_rate nbr, const bool bEasyFraming, const char *pcReason)
+{
+  print_result_header(test, nbr, bEasyFraming);
+  fprintf(out, ", \"skipped\": ");
+  json_string(pcReason);
+  fprintf(out, " }");
+}
+
+static int
+select_target(const struct bench_rf *test, const nfc_baud_rate nbr, nfc_target *pnt)
+{
+  if (test->nmt == NMT_DEP)
+    return nfc_initiator_select_dep_target(pnd, NDM_PASSIVE, nbr, NULL, pnt, 1000);
+
+  const nfc_modulation nm = { .nmt = test->nmt, .nbr = nbr };
+  return nfc_initiator_select_passive_target(pnd, nm, NULL, 0, pnt);
+}
+
+static void
+bench_run(const struct bench_rf *test, const nfc_baud_rate nbr, const bool bEasyFraming, const size_t szIterations)
+{
+  struct bench_rf_run run = {
+    .test = test,
+    .nbr = nbr,
+    .bEasyFraming = bEasyFraming,
+    .ui8BlockNumber = 0,
+    .bTimed = !bEasyFraming,
+  };
+
+  if (nfc_initiator_init(pnd) < 0) {
+    print_skipped(test, nbr, bEasyFraming, nfc_strerror(pnd));
+    return;
+  }
+  if (select_target(test, nbr, &run.nt) <= 0) {
+    print_skipped(test, nbr, bEasyFraming, "no target");
+    return;
+  }
+  if (!test->applicable(&run.nt)) {
+    nfc_initiator_deselect_target(pnd);
+    print_skipped(test, nbr, bEasyFraming, "target does not support this test");
+    return;
+  }
+  if (test->setup && (test->setup(pnd, &run.nt) < 0)) {
+    nfc_initiator_deselect_target(pnd);
+    print_skipped(test, nbr, bEasyFraming, nfc_strerror(pnd));
+    return;
+  }
+  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming) < 0) {
+    nfc_initiator_deselect_target(pnd);
+    print_skipped(test, nbr, bEasyFraming, nfc_strerror(pnd));
+    return;
+  }
+
+  double *pdLatencies = malloc(szIterations * sizeof(double));
+  double *pdCycles = malloc(szIterations * sizeof(double));
+  if ((pdLatencies == NULL) || (pdCycles == NULL))
+    errx(EXIT_FAILURE, "malloc");
+
+  size_t szDone = 0, szCycles = 0, szErrors = 0;
+  int iLastError = 0;
+  const double dStart = now_us();
+  for (size_t i = 0; i < szIterations; i++) {
+    uint32_t ui32Cycles = 0;
+    const double dOpStart = now_us();
+    int res = test->op(pnd, &run, &ui32Cycles);
+    const double dOpEnd = now_us();
+    if (res < 0) {
+      szErrors++;
+      iLastError = res;
+      continue;
+    }
+    pdLatencies[szDone++] = dOpEnd - dOpStart;
+    if (run.bTimed && ui32Cycles)
+      pdCycles[szCycles++] = ui32Cycles / CYCLES_PER_US;
+  }
+  const double dElapsed = now_us() - dStart;
+
+  nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true);
+  nfc_initiator_deselect_target(pnd);
+
+  print_result_header(test, nbr, bEasyFraming);
+  fprintf(out, ", \"iterations\": %zu, \"errors\": %zu", szIterations, szErrors);
+  if (szErrors) {
+    fprintf(out, ", \"last_error\": ");
+    json_string(nfc_strerror(pnd) ? nfc_strerror(pnd) : "");
+    fprintf(out, ", \"last_error_code\": %d", iLastError);
+  }
+  fprintf(out, ", \"ops_per_sec\": %.1f", (dElapsed > 0) ? (szDone * 1e6 / dElapsed) : 0.0);
+  if (szDone)
+    print_distribution("latency_us", pdLatencies, szDone);
+  if (szCycles)
+    print_distribution("rf_us", pdCycles, szCycles);
+  fprintf(out, " }");
+
+  free(pdLatencies);
+  free(pdCycles);
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("Usage: %s [OPTIONS]\n", progname);
+  printf("Options:\n");
+  printf("\t-h\tPrint this help message.\n");
+  printf("\t-d CONNSTRING\tUse this device (default: first device found).\n");
+  printf("\t-n N\tNumber of operations per measurement (default: 200).\n");
+  printf("\t-t TEST\tOnly run this test, can be repeated. Tests are:\n\t\t");
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    printf("%s%s", tests[i].name, (i + 1 < sizeof(tests) / sizeof(tests[0])) ? ", " : "\n");
+  printf("\t-o FILE\tWrite the JSON report to FILE instead of stdout.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *pcConnstring = NULL;
+  const char *pcOutput = NULL;
+  const char *apcTests[sizeof(tests) / sizeof(tests[0])];
+  size_t szTests = 0;
+  size_t szIterations = 200;
+  int ch;
+
+  while ((ch = getopt(argc, argv, "hd:n:t:o:")) != -1) {
+    switch (ch) {
+      case 'h':
+        print_usage(argv[0]);
+        exit(EXIT_SUCCESS);
+      case 'd':
+        pcConnstring = optarg;
+        break;
+      case 'n':
+        if (atoi(optarg) < 1)
+          errx(EXIT_FAILURE, "number of operations must be positive");
+        szIterations = atoi(optarg);
+        break;
+      case 't':
+        if (szTests == sizeof(apcTests) / sizeof(apcTests[0]))
+          errx(EXIT_FAILURE, "too many tests");
+        apcTests[szTests++] = optarg;
+        break;
+      case 'o':
+        pcOutput = optarg;
+        break;
+      default:
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  for (size_t i = 0; i < szTests; i++) {
+    size_t j;
+    for (j = 0; j < sizeof(tests) / sizeof(tests[0]); j++) {
+      if (strcmp(apcTests[i], tests[j].name) == 0)
+        break;
+    }
+    if (j == sizeof(tests) / sizeof(tests[0]))
+      errx(EXIT_FAILURE, "unknown test: %s", apcTests[i]);
+  }
+
+  out = stdout;
+  if (pcOutput && ((out = fopen(pcOutput, "w")) == NULL))
+    err(EXIT_FAILURE, "%s", pcOutput);
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL)
+    errx(EXIT_FAILURE, "Unable to init libnfc (malloc)");
+
+  if (pcConnstring) {
+    nfc_connstring connstring;
+    strncpy(connstring, pcConnstring, sizeof(connstring) - 1);
+    connstring[sizeof(connstring) - 1] = '\0';
+    pnd = nfc_open(context, connstring);
+  } else {
+    pnd = nfc_open(context, NULL);
+  }
+  if (pnd == NULL) {
+    nfc_exit(context);
+    errx(EXIT_FAILURE, "Unable to open NFC device");
+  }
+  if (nfc_initiator_init(pnd) < 0) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  // The driver name is the connstring prefix
+  char acDriver[NFC_BUFSIZE_CONNSTRING];
+  strncpy(acDriver, nfc_device_get_connstring(pnd), sizeof(acDriver) - 1);
+  acDriver[sizeof(acDriver) - 1] = '\0';
+  acDriver[strcspn(acDriver, ":")] = '\0';
+
+  struct utsname un;
+  if (uname(&un) < 0)
+    memset(&un, 0, sizeof(un));
+
+  fprintf(out, "{\n  \"libnfc\": ");
+  json_string(nfc_version());
+  fprintf(out, ",\n  \"host\": { \"system\": ");
+  json_string(un.sysname);
+  fprintf(out, ", \"release\": ");
+  json_string(un.release);
+  fprintf(out, ", \"machine\": ");
+  json_string(un.machine);
+  fprintf(out, " },\n  \"device\": { \"name\": ");
+  json_string(nfc_device_get_name(pnd));
+  fprintf(out, ", \"connstring\": ");
+  json_string(nfc_device_get_connstring(pnd));
+  fprintf(out, ", \"driver\": ");
+  json_string(acDriver);
+  fprintf(out, " },\n  \"iterations\": %zu,\n  \"results\": [", szIterations);
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    const struct bench_rf *test = &tests[i];
+    if (szTests) {
+      bool bSelected = false;
+      for (size_t j = 0; j < szTests; j++)
+        bSelected |= (strcmp(apcTests[j], test->name) == 0);
+      if (!bSelected)
+        continue;
+    }
+
+    const nfc_baud_rate *supported_br;
+    if (nfc_device_get_supported_baud_rate(pnd, test->nmt, &supported_br) < 0) {
+      print_skipped(test, NBR_UNDEFINED, true, "modulation not supported by the device");
+      continue;
+    }
+    for (size_t j = 0; supported_br[j]; j++) {
+      bench_run(test, supported_br[j], true, szIterations);
+      if (test->bRaw)
+        bench_run(test, supported_br[j], false, szIterations);
+    }
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  if (out != stdout)
+    fclose(out);
+  nfc_close(pnd);
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}
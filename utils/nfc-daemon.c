@@ -0,0 +1,226 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-daemon.c
+ * @brief Shares local NFC devices between processes
+ *
+ * The daemon keeps the devices opened and serves each client process from
+ * its own thread; clients open them with "nfcd:index" connstrings.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+#define MAX_DEVICE_COUNT 16
+// Directory and socket of a daemon run by root, as looked for by the nfcd driver
+#define SYSTEM_SOCKET_DIR "/run/libnfc"
+#define SYSTEM_SOCKET SYSTEM_SOCKET_DIR "/nfcd.sock"
+// Socket of a daemon run by a user, in $XDG_RUNTIME_DIR
+#define USER_SOCKET "libnfc-nfcd.sock"
+
+static nfc_device *apnd[MAX_DEVICE_COUNT];
+static size_t szDevices = 0;
+static bool quiet_output = false;
+static const char *pcSocket = NULL;
+static char acUserSocket[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+static void
+print_usage(const char *argv[])
+{
+  printf("Usage: %s [OPTIONS] [connstring...]\n", argv[0]);
+  printf("Options:\n");
+  printf("\t-h\tPrint this help message.\n");
+  printf("\t-q\tQuiet mode, do not print clients.\n");
+  printf("\t-s path\tUNIX socket clients connect to (default: %s when run by root,\n", SYSTEM_SOCKET);
+  printf("\t\t$XDG_RUNTIME_DIR/%s otherwise).\n", USER_SOCKET);
+  printf("Devices given by connstring are shared, otherwise all the devices found.\n");
+}
+
+/*
+ * The socket goes where other users can not create it first: a root owned
+ * directory for root, the private runtime directory of the user otherwise.
+ */
+static const char *
+default_socket(void)
+{
+  struct stat st;
+
+  if (geteuid() == 0) {
+    if ((mkdir(SYSTEM_SOCKET_DIR, 0755) < 0) && (errno != EEXIST))
+      return NULL;
+    if ((lstat(SYSTEM_SOCKET_DIR, &st) < 0) || !S_ISDIR(st.st_mode) || (st.st_uid != 0) || (st.st_mode & 0022))
+      return NULL;
+    return SYSTEM_SOCKET;
+  }
+  const char *pcRuntimeDir = getenv("XDG_RUNTIME_DIR");
+  if (!pcRuntimeDir || (*pcRuntimeDir != '/') ||
+      (snprintf(acUserSocket, sizeof(acUserSocket), "%s/%s", pcRuntimeDir, USER_SOCKET) >= (int) sizeof(acUserSocket)))
+    return NULL;
+  return acUserSocket;
+}
+
+static void
+stop(int sig)
+{
+  (void) sig;
+  unlink(pcSocket);
+  _exit(EXIT_SUCCESS);
+}
+
+static void *
+serve_client(void *arg)
+{
+  const int fd = (int)(intptr_t) arg;
+
+  const int res = nfc_daemon_serve(apnd, szDevices, fd);
+  if (!quiet_output && (res < 0))
+    printf("Client left: error %d\n", res);
+  close(fd);
+  return NULL;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  nfc_connstring connstrings[MAX_DEVICE_COUNT];
+  size_t szConnstrings = 0;
+  struct sockaddr_un sa;
+  int arg;
+
+  for (arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-q")) {
+      quiet_output = true;
+    } else if ((0 == strcmp(argv[arg], "-s")) && (arg + 1 < argc)) {
+      pcSocket = argv[++arg];
+    } else if (argv[arg][0] == '-') {
+      ERR("%s is not supported option.", argv[arg]);
+      print_usage(argv);
+      exit(EXIT_FAILURE);
+    } else if (szConnstrings < MAX_DEVICE_COUNT) {
+      snprintf(connstrings[szConnstrings++], sizeof(nfc_connstring), "%s", argv[arg]);
+    }
+  }
+  if (!pcSocket && !(pcSocket = default_socket())) {
+    ERR("No safe default socket, run as root, set XDG_RUNTIME_DIR or use -s.");
+    exit(EXIT_FAILURE);
+  }
+  if (strlen(pcSocket) >= sizeof(sa.sun_path)) {
+    ERR("Socket path too long: %s", pcSocket);
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  if (szConnstrings == 0)
+    szConnstrings = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+  for (size_t i = 0; i < szConnstrings; i++) {
+    // Shared devices must not be listed again through this daemon
+    if (0 == strncmp(connstrings[i], "nfcd:", 5))
+      continue;
+    if ((apnd[szDevices] = nfc_open(context, connstrings[i])) == NULL) {
+      ERR("Unable to open NFC device: %s", connstrings[i]);
+      continue;
+    }
+    printf("nfcd:%u: %s\n", (unsigned int) szDevices, nfc_device_get_name(apnd[szDevices]));
+    szDevices++;
+  }
+  if (szDevices == 0) {
+    ERR("No NFC device to share.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, pcSocket);
+  unlink(pcSocket);
+  // Access to the devices is granted by the socket permissions, set at creation
+  const mode_t mask = umask(0117);
+  const int res = (fd < 0) ? -1 : bind(fd, (struct sockaddr *) &sa, sizeof(sa));
+  umask(mask);
+  if ((res < 0) || (listen(fd, 8) < 0)) {
+    ERR("Unable to listen on %s", pcSocket);
+    for (size_t i = 0; i < szDevices; i++)
+      nfc_close(apnd[i]);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    pthread_t thread;
+    const int fdClient = accept(fd, NULL, NULL);
+    if (fdClient < 0) {
+      warn("accept");
+      continue;
+    }
+    if (pthread_create(&thread, NULL, serve_client, (void *)(intptr_t) fdClient) != 0) {
+      close(fdClient);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
@@ -61,6 +61,16 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#ifndef WIN32
+#  include <sys/mman.h>
+#  include <unistd.h>
+#else
+#  include <io.h>
+#endif
+#ifndef O_BINARY
+#  define O_BINARY 0
+#endif
 
 #include <errno.h>
 #include <signal.h>
@@ -85,15 +95,27 @@ static int type4v = 2;
 
 typedef enum { NONE, CC_FILE, NDEF_FILE } file;
 
+// NDEF file as seen by the reader: NLEN (ENLEN on mapping 3.0) then the message
 struct nfcforum_tag4_ndef_data {
   uint8_t *ndef_file;
   size_t   ndef_file_len;
+  // Largest NDEF file, length field included
+  size_t   ndef_file_max_len;
+  // Length field size, 2 or 4
+  size_t   nlen_len;
+  bool     dirty;
+  // Mapping (or allocation) holding ndef_file
+  uint8_t *storage;
+  size_t   storage_len;
 };
 
 struct nfcforum_tag4_state_machine_data {
   file     current_file;
 };
 
+// Largest NDEF file emulated with mapping 3.0, pages are only backed once written
+#define NDEF_EXTENDED_FILE_MAX_LEN (16 * 1024 * 1024)
+
 uint8_t nfcforum_capability_container[] = {
   0x00, 0x0F, /* CCLEN 15 bytes */
   0x20,       /* Mapping version 2.0, use option -1 to force v1.0 */
@@ -110,18 +132,124 @@ uint8_t nfcforum_capability_container[] = {
   0xFF, 0xFE, /* Maximum NDEF Size */
   0x00,       /* NDEF file read access condition */
   0x00,       /* NDEF file write access condition */
+  0x00, 0x00, /* Room for the 4 bytes Maximum NDEF Size of mapping 3.0 */
 };
 
+// Mapping 3.0: extended length APDUs and Extended NDEF File-Control TLV
+static void
+capability_container_set_v3(const size_t ndef_file_max_len)
+{
+  const uint8_t cc[] = {
+    0x00, 0x11, /* CCLEN 17 bytes */
+    0x30,       /* Mapping version 3.0 */
+    0xFF, 0xFF, /* MLe */
+    0xFF, 0xFF, /* MLc */
+    0x06,       /* T field of the Extended NDEF File-Control TLV */
+    0x08,       /* L field of the Extended NDEF File-Control TLV */
+    0xE1, 0x04, /* File identifier */
+    (uint8_t)(ndef_file_max_len >> 24), (uint8_t)(ndef_file_max_len >> 16), (uint8_t)(ndef_file_max_len >> 8), (uint8_t)(ndef_file_max_len),
+    0x00,       /* NDEF file read access condition */
+    0x00,       /* NDEF file write access condition */
+  };
+  memcpy(nfcforum_capability_container, cc, sizeof(cc));
+}
+
 /* C-ADPU offsets */
 #define CLA  0
 #define INS  1
 #define P1   2
 #define P2   3
-#define LC   4
-#define DATA 5
 
 #define ISO144434A_RATS 0xE0
 
+struct c_apdu {
+  const uint8_t *data;
+  size_t lc;
+  // 0 when absent
+  size_t le;
+};
+
+// Splits a short or extended length C-APDU, returns false if malformed
+static bool
+c_apdu_parse(const uint8_t *in, const size_t len, struct c_apdu *apdu)
+{
+  apdu->data = NULL;
+  apdu->lc = 0;
+  apdu->le = 0;
+  if (len == 4)
+    return true;
+  if (len == 5) {
+    apdu->le = in[4] ? in[4] : 256;
+    return true;
+  }
+  if (in[4] != 0) {
+    apdu->lc = in[4];
+    apdu->data = in + 5;
+    if (len == 5 + apdu->lc)
+      return true;
+    if (len == 6 + apdu->lc) {
+      apdu->le = in[5 + apdu->lc] ? in[5 + apdu->lc] : 256;
+      return true;
+    }
+    return false;
+  }
+  if (len < 7)
+    return false;
+  if (len == 7) {
+    apdu->le = ((in[5] << 8) + in[6]) ? (size_t)((in[5] << 8) + in[6]) : 65536;
+    return true;
+  }
+  apdu->lc = (in[5] << 8) + in[6];
+  apdu->data = in + 7;
+  if ((apdu->lc == 0) || (len < 7 + apdu->lc))
+    return false;
+  if (len == 7 + apdu->lc)
+    return true;
+  if (len == 9 + apdu->lc) {
+    apdu->le = ((in[7 + apdu->lc] << 8) + in[8 + apdu->lc]) ? (size_t)((in[7 + apdu->lc] << 8) + in[8 + apdu->lc]) : 65536;
+    return true;
+  }
+  return false;
+}
+
+// Reads a BER-TLV with the given tag, returns its value length or -1
+static int
+ber_tlv_get(const uint8_t *in, const size_t len, const uint8_t tag, const uint8_t **value)
+{
+  size_t header = 2;
+  size_t value_len;
+
+  if ((len < 2) || (in[0] != tag))
+    return -1;
+  if (in[1] < 0x80) {
+    value_len = in[1];
+  } else if ((in[1] == 0x81) && (len >= 3)) {
+    value_len = in[2];
+    header = 3;
+  } else if ((in[1] == 0x82) && (len >= 4)) {
+    value_len = (in[2] << 8) + in[3];
+    header = 4;
+  } else {
+    return -1;
+  }
+  if (header + value_len > len)
+    return -1;
+  *value = in + header;
+  return value_len;
+}
+
+// Offset Data Object of READ/UPDATE BINARY with odd instruction
+static bool
+odo_get(const uint8_t *in, const size_t len, size_t *offset, const uint8_t **next)
+{
+  const uint8_t *value;
+  if (ber_tlv_get(in, len, 0x54, &value) != 3)
+    return false;
+  *offset = (value[0] << 16) + (value[1] << 8) + value[2];
+  *next = value + 3;
+  return true;
+}
+
 static int
 nfcforum_tag4_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
 {
@@ -129,6 +257,10 @@ nfcforum_tag4_io(struct nfc_emulator *emulator, const uint8_t *data_in, const si
 
   struct nfcforum_tag4_ndef_data *ndef_data = (struct nfcforum_tag4_ndef_data *)(emulator->user_data);
   struct nfcforum_tag4_state_machine_data *state_machine_data = (struct nfcforum_tag4_state_machine_data *)(emulator->state_machine->data);
+  struct c_apdu apdu;
+  size_t offset = 0;
+  const uint8_t *data = NULL;
+  size_t len = 0;
 
   if (data_in_len == 0) {
     // No input data, nothing to do
@@ -141,13 +273,15 @@ nfcforum_tag4_io(struct nfc_emulator *emulator, const uint8_t *data_in, const si
     print_hex(data_in, data_in_len);
   }
 
-  if (data_in_len >= 4) {
+  if ((data_in_len >= 4) && c_apdu_parse(data_in, data_in_len, &apdu)) {
     if (data_in[CLA] != 0x00)
       return -ENOTSUP;
 
-#define ISO7816_SELECT         0xA4
-#define ISO7816_READ_BINARY    0xB0
-#define ISO7816_UPDATE_BINARY  0xD6
+#define ISO7816_SELECT             0xA4
+#define ISO7816_READ_BINARY        0xB0
+#define ISO7816_READ_BINARY_ODO    0xB1
+#define ISO7816_UPDATE_BINARY      0xD6
+#define ISO7816_UPDATE_BINARY_ODO  0xD7
 
     switch (data_in[INS]) {
       case ISO7816_SELECT:
@@ -159,10 +293,10 @@ nfcforum_tag4_io(struct nfc_emulator *emulator, const uint8_t *data_in, const si
 
             const uint8_t ndef_capability_container[] = { 0xE1, 0x03 };
             const uint8_t ndef_file[] = { 0xE1, 0x04 };
-            if ((data_in[LC] == sizeof(ndef_capability_container)) && (0 == memcmp(ndef_capability_container, data_in + DATA, data_in[LC]))) {
+            if ((apdu.lc == sizeof(ndef_capability_container)) && (0 == memcmp(ndef_capability_container, apdu.data, apdu.lc))) {
               memcpy(data_out, "\x90\x00", res = 2);
               state_machine_data->current_file = CC_FILE;
-            } else if ((data_in[LC] == sizeof(ndef_file)) && (0 == memcmp(ndef_file, data_in + DATA, data_in[LC]))) {
+            } else if ((apdu.lc == sizeof(ndef_file)) && (0 == memcmp(ndef_file, apdu.data, apdu.lc))) {
               memcpy(data_out, "\x90\x00", res = 2);
               state_machine_data->current_file = NDEF_FILE;
             } else {
@@ -177,9 +311,9 @@ nfcforum_tag4_io(struct nfc_emulator *emulator, const uint8_t *data_in, const si
 
             const uint8_t ndef_tag_application_name_v1[] = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x00 };
             const uint8_t ndef_tag_application_name_v2[] = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01 };
-            if ((type4v == 1) && (data_in[LC] == sizeof(ndef_tag_application_name_v1)) && (0 == memcmp(ndef_tag_application_name_v1, data_in + DATA, data_in[LC])))
+            if ((type4v == 1) && (apdu.lc == sizeof(ndef_tag_application_name_v1)) && (0 == memcmp(ndef_tag_application_name_v1, apdu.data, apdu.lc)))
               memcpy(data_out, "\x90\x00", res = 2);
-            else if ((type4v == 2) && (data_in[LC] == sizeof(ndef_tag_application_name_v2)) && (0 == memcmp(ndef_tag_application_name_v2, data_in + DATA, data_in[LC])))
+            else if ((type4v >= 2) && (apdu.lc == sizeof(ndef_tag_application_name_v2)) && (0 == memcmp(ndef_tag_application_name_v2, apdu.data, apdu.lc)))
               memcpy(data_out, "\x90\x00", res = 2);
             else
               memcpy(data_out, "\x6a\x82", res = 2);
@@ -191,33 +325,102 @@ nfcforum_tag4_io(struct nfc_emulator *emulator, const uint8_t *data_in, const si
 
         break;
       case ISO7816_READ_BINARY:
-        if ((size_t)(data_in[LC] + 2) > data_out_len) {
+      case ISO7816_READ_BINARY_ODO: {
+        const uint8_t *file_data = NULL;
+        size_t file_len = 0;
+        size_t header = 0;
+
+        if ((apdu.le + 2) > data_out_len) {
           return -ENOSPC;
         }
+        if (data_in[INS] == ISO7816_READ_BINARY) {
+          offset = (data_in[P1] << 8) + data_in[P2];
+          len = apdu.le;
+        } else {
+          if (!odo_get(apdu.data, apdu.lc, &offset, &data)) {
+            memcpy(data_out, "\x6a\x80", res = 2);
+            break;
+          }
+          // The answer goes in a discretionary data object, 53 L V
+          header = (apdu.le <= 0x81) ? 2 : ((apdu.le <= 0x102) ? 3 : 4);
+          len = (apdu.le > header) ? apdu.le - header : 0;
+        }
         switch (state_machine_data->current_file) {
           case NONE:
-            memcpy(data_out, "\x6a\x82", res = 2);
             break;
           case CC_FILE:
-            memcpy(data_out, nfcforum_capability_container + (data_in[P1] << 8) + data_in[P2], data_in[LC]);
-            memcpy(data_out + data_in[LC], "\x90\x00", 2);
-            res = data_in[LC] + 2;
+            file_data = nfcforum_capability_container;
+            file_len = (nfcforum_capability_container[0] << 8) + nfcforum_capability_container[1];
             break;
           case NDEF_FILE:
-            memcpy(data_out, ndef_data->ndef_file + (data_in[P1] << 8) + data_in[P2], data_in[LC]);
-            memcpy(data_out + data_in[LC], "\x90\x00", 2);
-            res = data_in[LC] + 2;
+            file_data = ndef_data->ndef_file;
+            file_len = ndef_data->ndef_file_max_len;
             break;
         }
+        if (!file_data) {
+          memcpy(data_out, "\x6a\x82", res = 2);
+          break;
+        }
+        if (offset >= file_len) {
+          memcpy(data_out, "\x6b\x00", res = 2);
+          break;
+        }
+        if (len > file_len - offset)
+          len = file_len - offset;
+        if (header == 2) {
+          data_out[0] = 0x53;
+          data_out[1] = len;
+        } else if (header == 3) {
+          data_out[0] = 0x53;
+          data_out[1] = 0x81;
+          data_out[2] = len;
+        } else if (header == 4) {
+          data_out[0] = 0x53;
+          data_out[1] = 0x82;
+          data_out[2] = len >> 8;
+          data_out[3] = len;
+        }
+        memcpy(data_out + header, file_data + offset, len);
+        memcpy(data_out + header + len, "\x90\x00", 2);
+        res = header + len + 2;
         break;
+      }
 
       case ISO7816_UPDATE_BINARY:
-        memcpy(ndef_data->ndef_file + (data_in[P1] << 8) + data_in[P2], data_in + DATA, data_in[LC]);
-        if ((data_in[P1] << 8) + data_in[P2] == 0) {
-          ndef_data->ndef_file_len = (ndef_data->ndef_file[0] << 8) + ndef_data->ndef_file[1] + 2;
+      case ISO7816_UPDATE_BINARY_ODO: {
+        int data_len;
+
+        if (state_machine_data->current_file != NDEF_FILE) {
+          memcpy(data_out, "\x69\x86", res = 2);
+          break;
+        }
+        if (data_in[INS] == ISO7816_UPDATE_BINARY) {
+          offset = (data_in[P1] << 8) + data_in[P2];
+          data = apdu.data;
+          len = apdu.lc;
+        } else if (odo_get(apdu.data, apdu.lc, &offset, &data) &&
+                   ((data_len = ber_tlv_get(data, apdu.lc - (data - apdu.data), 0x53, &data)) >= 0)) {
+          len = data_len;
+        } else {
+          memcpy(data_out, "\x6a\x80", res = 2);
+          break;
+        }
+        if ((offset > ndef_data->ndef_file_max_len) || (len > ndef_data->ndef_file_max_len - offset)) {
+          memcpy(data_out, "\x6b\x00", res = 2);
+          break;
+        }
+        // Private mapping: the first write to a page copies it, the input file is left untouched
+        memcpy(ndef_data->ndef_file + offset, data, len);
+        ndef_data->dirty = true;
+        if (offset < ndef_data->nlen_len) {
+          size_t nlen = 0;
+          for (size_t n = 0; n < ndef_data->nlen_len; n++)
+            nlen = (nlen << 8) + ndef_data->ndef_file[n];
+          ndef_data->ndef_file_len = nlen + ndef_data->nlen_len;
         }
         memcpy(data_out, "\x90\x00", res = 2);
         break;
+      }
       default: // Unknown
         if (!quiet_output) {
           printf("Unknown frame, emulated target abort.\n");
@@ -251,68 +454,144 @@ static void stop_emulation(int sig)
   }
 }
 
+// Reserves the NDEF file storage, mapping the message of fd (if not -1) right after the length field
+static int
+ndef_storage_init(struct nfcforum_tag4_ndef_data *tag_data, const size_t nlen_len, const size_t max_len, const int fd, const size_t message_len)
+{
+  tag_data->nlen_len = nlen_len;
+  tag_data->ndef_file_max_len = max_len;
+  tag_data->dirty = false;
+#ifndef WIN32
+  // The message starts on a page boundary so that the file can be mapped there
+  const size_t page = sysconf(_SC_PAGESIZE);
+  tag_data->storage_len = page + max_len;
+  // Private mapping of /dev/zero: anonymous memory without leaving POSIX
+  const int zero_fd = open("/dev/zero", O_RDWR);
+  if (zero_fd < 0)
+    return -1;
+  tag_data->storage = mmap(NULL, tag_data->storage_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, zero_fd, 0);
+  close(zero_fd);
+  if (tag_data->storage == MAP_FAILED) {
+    tag_data->storage = NULL;
+    return -1;
+  }
+  if ((message_len > 0) &&
+      (mmap(tag_data->storage + page, message_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+    munmap(tag_data->storage, tag_data->storage_len);
+    tag_data->storage = NULL;
+    return -1;
+  }
+  tag_data->ndef_file = tag_data->storage + page - nlen_len;
+#else
+  tag_data->storage_len = max_len;
+  if (!(tag_data->storage = calloc(1, max_len)))
+    return -1;
+  if ((message_len > 0) && (read(fd, tag_data->storage + nlen_len, message_len) != (int) message_len)) {
+    free(tag_data->storage);
+    tag_data->storage = NULL;
+    return -1;
+  }
+  tag_data->ndef_file = tag_data->storage;
+#endif
+  for (size_t n = 0; n < nlen_len; n++)
+    tag_data->ndef_file[n] = (uint8_t)(message_len >> (8 * (nlen_len - 1 - n)));
+  tag_data->ndef_file_len = nlen_len + message_len;
+  return 0;
+}
+
+static void
+ndef_storage_free(struct nfcforum_tag4_ndef_data *tag_data)
+{
+  if (!tag_data->storage)
+    return;
+#ifndef WIN32
+  munmap(tag_data->storage, tag_data->storage_len);
+#else
+  free(tag_data->storage);
+#endif
+  tag_data->storage = NULL;
+}
+
 static int
 ndef_message_load(char *filename, struct nfcforum_tag4_ndef_data *tag_data)
 {
   struct stat sb;
-  FILE *F;
-  if (!(F = fopen(filename, "r"))) {
+  int fd;
+  if ((fd = open(filename, O_RDONLY | O_BINARY)) < 0) {
     printf("File not found or not accessible '%s'\n", filename);
     return -1;
   }
-  if (stat(filename, &sb) < 0) {
+  if (fstat(fd, &sb) < 0) {
     printf("File not found or not accessible '%s'\n", filename);
-    fclose(F);
+    close(fd);
     return -1;
   }
 
-  /* Check file size */
-  if (sb.st_size > 0xFFFF) {
+  /* Check file size, mapping 3.0 is needed past 2.0 NLEN range */
+  if ((sb.st_size > 0xFFFE - 2) && (type4v < 3)) {
+    if (type4v == 1) {
+      printf("File size too large '%s'\n", filename);
+      close(fd);
+      return -1;
+    }
+    type4v = 3;
+  }
+  if (sb.st_size > NDEF_EXTENDED_FILE_MAX_LEN - 4) {
     printf("File size too large '%s'\n", filename);
-    fclose(F);
+    close(fd);
     return -1;
   }
 
-  tag_data->ndef_file_len = sb.st_size + 2;
-
-  tag_data->ndef_file[0] = (uint8_t)(sb.st_size >> 8);
-  tag_data->ndef_file[1] = (uint8_t)(sb.st_size);
-
-
-  if (1 != fread(tag_data->ndef_file + 2, sb.st_size, 1, F)) {
+  const int res = (type4v == 3) ?
+                  ndef_storage_init(tag_data, 4, NDEF_EXTENDED_FILE_MAX_LEN, fd, sb.st_size) :
+                  ndef_storage_init(tag_data, 2, 0xFFFE, fd, sb.st_size);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (res < 0) {
     printf("Can't read from %s\n", filename);
-    fclose(F);
     return -1;
   }
-
-  fclose(F);
   return sb.st_size;
 }
 
+// Only writes when the reader updated the message, through a temporary file since outfile may be the mapped infile
 static int
-ndef_message_save(char *filename, struct nfcforum_tag4_ndef_data *tag_data)
+ndef_message_save(char *filename, char *infilename, struct nfcforum_tag4_ndef_data *tag_data)
 {
+  const size_t message_len = tag_data->ndef_file_len - tag_data->nlen_len;
+  if (!tag_data->dirty && infilename && (0 == strcmp(filename, infilename)))
+    return message_len;
+
+  char tmpname[BUFSIZ];
   FILE *F;
-  if (!(F = fopen(filename, "w"))) {
-    printf("fopen (%s, w)\n", filename);
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+  if (!(F = fopen(tmpname, "wb"))) {
+    printf("fopen (%s, w)\n", tmpname);
     return -1;
   }
 
-  if (1 != fwrite(tag_data->ndef_file + 2, tag_data->ndef_file_len - 2, 1, F)) {
-    printf("fwrite (%d)\n", (int) tag_data->ndef_file_len - 2);
+  if ((message_len > tag_data->ndef_file_max_len - tag_data->nlen_len) ||
+      (message_len && (1 != fwrite(tag_data->ndef_file + tag_data->nlen_len, message_len, 1, F)))) {
+    printf("fwrite (%d)\n", (int) message_len);
     fclose(F);
+    remove(tmpname);
     return -1;
   }
 
-  fclose(F);
-  return tag_data->ndef_file_len - 2;
+  if ((fclose(F) != 0) || (rename(tmpname, filename) < 0)) {
+    printf("rename (%s, %s)\n", tmpname, filename);
+    remove(tmpname);
+    return -1;
+  }
+  return message_len;
 }
 
 static void
 usage(char *progname)
 {
-  fprintf(stderr, "usage: %s [-1] [infile [outfile]]\n", progname);
+  fprintf(stderr, "usage: %s [-1|-3] [infile [outfile]]\n", progname);
   fprintf(stderr, "      -1: force Tag Type 4 v1.0 (default is v2.0)\n");
+  fprintf(stderr, "      -3: force Tag Type 4 v3.0 (default for infile larger than 65532 bytes)\n");
 }
 
 int
@@ -336,8 +615,7 @@ main(int argc, char *argv[])
     },
   };
 
-  uint8_t ndef_file[0xfffe] = {
-    0x00, 33,
+  const uint8_t default_ndef_message[] = {
     0xd1, 0x02, 0x1c, 0x53, 0x70, 0x91, 0x01, 0x09, 0x54, 0x02,
     0x65, 0x6e, 0x4c, 0x69, 0x62, 0x6e, 0x66, 0x63, 0x51, 0x01,
     0x0b, 0x55, 0x03, 0x6c, 0x69, 0x62, 0x6e, 0x66, 0x63, 0x2e,
@@ -345,8 +623,7 @@ main(int argc, char *argv[])
   };
 
   struct nfcforum_tag4_ndef_data nfcforum_tag4_data = {
-    .ndef_file = ndef_file,
-    .ndef_file_len = ndef_file[1] + 2,
+    .storage = NULL,
   };
 
   struct nfcforum_tag4_state_machine_data state_machine_data = {
@@ -374,6 +651,10 @@ main(int argc, char *argv[])
     nfcforum_capability_container[2] = 0x10;
     options += 1;
   }
+  else if ((argc > (1 + options)) && (0 == strcmp("-3", argv[1 + options]))) {
+    type4v = 3;
+    options += 1;
+  }
 
   if (argc > (3 + options)) {
     usage(argv[0]);
@@ -386,7 +667,19 @@ main(int argc, char *argv[])
       printf("Can't load NDEF file '%s'\n", argv[1 + options]);
       exit(EXIT_FAILURE);
     }
+  } else {
+    if (((type4v == 3) ?
+         ndef_storage_init(&nfcforum_tag4_data, 4, NDEF_EXTENDED_FILE_MAX_LEN, -1, 0) :
+         ndef_storage_init(&nfcforum_tag4_data, 2, 0xFFFE, -1, 0)) < 0) {
+      ERR("Unable to allocate the NDEF file");
+      exit(EXIT_FAILURE);
+    }
+    memcpy(nfcforum_tag4_data.ndef_file + nfcforum_tag4_data.nlen_len, default_ndef_message, sizeof(default_ndef_message));
+    nfcforum_tag4_data.ndef_file[nfcforum_tag4_data.nlen_len - 1] = sizeof(default_ndef_message);
+    nfcforum_tag4_data.ndef_file_len = nfcforum_tag4_data.nlen_len + sizeof(default_ndef_message);
   }
+  if (type4v == 3)
+    capability_container_set_v3(nfcforum_tag4_data.ndef_file_max_len);
 
   nfc_init(&context);
   if (context == NULL) {
@@ -410,20 +703,23 @@ main(int argc, char *argv[])
 
   if (0 != nfc_emulate_target(pnd, &emulator, 0)) {  // contains already nfc_target_init() call
     nfc_perror(pnd, "nfc_emulate_target");
+    ndef_storage_free(&nfcforum_tag4_data);
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
 
   if (argc == (3 + options)) {
-    if (ndef_message_save(argv[2 + options], &nfcforum_tag4_data) < 0) {
+    if (ndef_message_save(argv[2 + options], argv[1 + options], &nfcforum_tag4_data) < 0) {
       printf("Can't save NDEF file '%s'", argv[2 + options]);
+      ndef_storage_free(&nfcforum_tag4_data);
       nfc_close(pnd);
       nfc_exit(context);
       exit(EXIT_FAILURE);
     }
   }
 
+  ndef_storage_free(&nfcforum_tag4_data);
   nfc_close(pnd);
   nfc_exit(context);
   exit(EXIT_SUCCESS);
@@ -52,9 +52,11 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 
 #include <nfc/nfc.h>
 
+#include "dump-log.h"
 #include "nfc-utils.h"
 #include "jewel.h"
 
@@ -65,6 +67,8 @@ static jewel_res res;
 static jewel_tag ttDump;
 static uint32_t uiBlocks = 0x0E;
 static uint32_t uiBytesPerBlock = 0x08;
+static bool bDynamic = false;
+static volatile sig_atomic_t bStop = false;
 
 static const nfc_modulation nmJewel = {
   .nmt = NMT_JEWEL,
@@ -79,29 +83,98 @@ print_success_or_failure(bool bFailure, uint32_t *uiCounter)
     *uiCounter += (bFailure) ? 0 : 1;
 }
 
+static bool
+reselect_card(void)
+{
+  // After a failed command the tag is halted, redo the anti-collision
+  return nfc_initiator_select_passive_target(pnd, nmJewel, NULL, 0, &nt) > 0;
+}
+
+// The header ROM tells the memory model, Topaz 512 cards use the dynamic one
+static void
+detect_memory_model(void)
+{
+  uiBlocks = 0x0E;
+  bDynamic = false;
+  req.rid.btCmd = TC_RID;
+  if (!nfc_initiator_jewel_cmd(pnd, req, &res)) {
+    reselect_card();
+    return;
+  }
+  if (res.rid.abtHr[0] == JEWEL_HR0_DYNAMIC) {
+    bDynamic = true;
+    uiBlocks = 0x3F;
+  }
+}
+
+// Fallback for the first 16 blocks, one READ per byte
+static bool
+read_block_per_byte(uint32_t block)
+{
+  uint32_t byte;
+
+  for (byte = 0; byte < uiBytesPerBlock; byte++) {
+    req.read.btCmd = TC_READ;
+    req.read.btAdd = (block << 3) + byte;
+    if (!nfc_initiator_jewel_cmd(pnd, req, &res))
+      return false;
+    ttDump.ttd.abtData[(block << 3) + byte] = res.read.btDat;
+  }
+  return true;
+}
+
+static bool
+read_block(uint32_t block)
+{
+  if (bDynamic) {
+    req.read8.btCmd = TC_READ8;
+    req.read8.btAdd8 = block;
+    if (nfc_initiator_jewel_cmd(pnd, req, &res)) {
+      memcpy(ttDump.ttd.abtData + (block << 3), res.read8.abtDat, sizeof(res.read8.abtDat));
+      return true;
+    }
+    // READ can only address the first 128 bytes
+    if ((block > 0x0F) || !reselect_card())
+      return false;
+  }
+  return read_block_per_byte(block);
+}
+
 static  bool
 read_card(void)
 {
-  uint32_t   block;
-  uint32_t   byte;
-  bool      bFailure = false;
+  uint32_t block = 0;
   uint32_t uiReadBlocks = 0;
+  bool     bFailure = false;
 
   printf("Reading %d blocks |", uiBlocks + 1);
 
-  for (block = 0; block <= uiBlocks; block++) {
-    for (byte = 0; byte < uiBytesPerBlock; byte++) {
-
-      // Try to read the byte
-      req.read.btCmd = TC_READ;
-      req.read.btAdd = (block << 3) + byte;
-      if (nfc_initiator_jewel_cmd(pnd, req, &res)) {
-        ttDump.ttd.abtData[(block << 3) + byte] = res.read.btDat;
-      } else {
-        bFailure = true;
+  // Whole static memory with RALL, or 16 blocks segments with RSEG
+  if (!bDynamic) {
+    req.rall.btCmd = TC_RALL;
+    if (nfc_initiator_jewel_cmd(pnd, req, &res)) {
+      memcpy(ttDump.ttd.abtData, res.rall.abtDat, sizeof(res.rall.abtDat));
+      block = uiBlocks + 1;
+    }
+  } else {
+    while (block <= uiBlocks) {
+      req.rseg.btCmd = TC_RSEG;
+      req.rseg.btAddS = (block >> 4) << 4;
+      if (!nfc_initiator_jewel_cmd(pnd, req, &res))
         break;
-      }
+      memcpy(ttDump.ttd.abtData + (block << 3), res.rseg.abtDat, sizeof(res.rseg.abtDat));
+      block += 16;
     }
+  }
+  for (uint32_t i = 0; i < block; i++)
+    print_success_or_failure(false, &uiReadBlocks);
+
+  // Block by block for what the bulk command could not read
+  if ((block <= uiBlocks) && !reselect_card())
+    bFailure = true;
+  for (; block <= uiBlocks; block++) {
+    if (!bFailure)
+      bFailure = !read_block(block);
 
     print_success_or_failure(bFailure, &uiReadBlocks);
     fflush(stdout);
@@ -112,11 +185,130 @@ read_card(void)
   return (!bFailure);
 }
 
+static void
+identify_card(void)
+{
+  // Get the info from the current tag
+  printf("Found Jewel card with UID: ");
+  size_t  szPos;
+  for (szPos = 0; szPos < 4; szPos++) {
+    printf("%02x", nt.nti.nji.btId[szPos]);
+  }
+  printf("\n");
+
+  detect_memory_model();
+  printf("Memory model: %s, %d bytes\n", bDynamic ? "dynamic (Topaz 512)" : "static (Topaz 96)", (uiBlocks + 1) * uiBytesPerBlock);
+}
+
+static void
+stop_reading(int sig)
+{
+  (void) sig;
+  bStop = true;
+}
+
+// Reads card after card into a dump log, until interrupted
+static bool
+read_cards_to_log(const char *pcLog)
+{
+  dump_log dl;
+  size_t szCards = 0;
+  bool bSuccess = true;
+  int res;
+
+  if (dump_log_open(&dl, pcLog) < 0) {
+    ERR("Could not open dump log: %s\n", pcLog);
+    return false;
+  }
+  printf("Appending to dump log %s (%lu dumps), waiting for cards, Ctrl-C to stop\n", pcLog, (unsigned long) dl.szRecords);
+  signal(SIGINT, stop_reading);
+
+  while ((res = wait_for_target(pnd, nmJewel, NULL, 0, &nt, &bStop)) > 0) {
+    memset(&ttDump, 0x00, sizeof(ttDump));
+    identify_card();
+    if (read_card()) {
+      res = dump_log_append(&dl, DUMP_LOG_JEWEL, nt.nti.nji.btId, sizeof(nt.nti.nji.btId),
+                            &ttDump, (uiBlocks + 1) * uiBytesPerBlock);
+      if (res < 0) {
+        ERR("Could not append to dump log: %s\n", pcLog);
+        bSuccess = false;
+        break;
+      }
+      szCards++;
+      if (res > 0)
+        printf("Card logged, UID already logged %d time(s)\n", res);
+      else
+        printf("Card logged\n");
+    } else {
+      printf("Card not logged\n");
+    }
+    printf("Waiting for the card to be removed\n");
+    wait_for_removal(pnd, nmJewel, &bStop);
+  }
+  if (res < 0 && bSuccess) {
+    nfc_perror(pnd, "nfc_initiator_select_passive_target");
+    bSuccess = false;
+  }
+  printf("%lu cards logged\n", (unsigned long) szCards);
+  dump_log_close(&dl);
+  return bSuccess;
+}
+
+static bool
+byte_is_written(uint32_t block, uint32_t byte, bool write_lock, bool write_otp)
+{
+  // Block 0x0E holds the lock bytes then the OTP bytes
+  if (block == 0x0E)
+    return (byte < 2) ? write_lock : write_otp;
+  // On Topaz 512, block 0x0F holds 2 reserved bytes then the dynamic lock bytes
+  if (bDynamic && (block == 0x0F))
+    return (byte < 2) ? false : write_lock;
+  return true;
+}
+
+static bool
+write_block(uint32_t block, bool write_lock, bool write_otp)
+{
+  const uint8_t *pbtData = ttDump.ttd.abtData + (block << 3);
+  uint32_t byte;
+  bool     bFull = true;
+  bool     bFailure = false;
+
+  for (byte = 0; byte < uiBytesPerBlock; byte++)
+    bFull = bFull && byte_is_written(block, byte, write_lock, write_otp);
+
+  // Topaz 96 only knows single byte writes
+  if (bDynamic && bFull) {
+    req.writee8.btCmd = TC_WRITEE8;
+    req.writee8.btAdd8 = block;
+    memcpy(req.writee8.abtDat, pbtData, sizeof(req.writee8.abtDat));
+    // The tag answers with the block content once written
+    if (nfc_initiator_jewel_cmd(pnd, req, &res) && (memcmp(res.writee8.abtDat, pbtData, sizeof(res.writee8.abtDat)) == 0))
+      return true;
+    // WRITE-E can only address the first 128 bytes
+    if ((block > 0x0F) || !reselect_card())
+      return false;
+  }
+
+  for (byte = 0; byte < uiBytesPerBlock; byte++) {
+    if (!byte_is_written(block, byte, write_lock, write_otp))
+      continue;
+    if (bFailure && !reselect_card())
+      return false;
+
+    req.writee.btCmd = TC_WRITEE;
+    req.writee.btAdd = (block << 3) + byte;
+    req.writee.btDat = pbtData[byte];
+    if (!nfc_initiator_jewel_cmd(pnd, req, &res))
+      bFailure = true;
+  }
+  return !bFailure;
+}
+
 static  bool
 write_card(void)
 {
   uint32_t block;
-  uint32_t byte;
   bool     bFailure = false;
   uint32_t uiWrittenBlocks = 0;
   uint32_t uiSkippedBlocks = 0;
@@ -157,37 +349,24 @@ write_card(void)
       uiSkippedBlocks++;
       continue;
     }
-    // Write block 0x0E partially if lock-bits or OTP shouldn't be written
-    if ((block == 0x0E) && (!write_lock || !write_otp)) {
+    // Skip block 0x0F of Topaz 512 if dynamic lock-bits shouldn't be written
+    if (bDynamic && (block == 0x0F) && (!write_lock)) {
+      printf("s");
+      uiSkippedBlocks++;
+      continue;
+    }
+    // Write block 0x0E (and 0x0F of Topaz 512) partially if lock-bits or OTP shouldn't be written
+    if (((block == 0x0E) && (!write_lock || !write_otp)) || (bDynamic && (block == 0x0F))) {
       printf("p");
       uiPartialBlocks++;
     }
 
-    for (byte = 0; byte < uiBytesPerBlock; byte++) {
-      if ((block == 0x0E) && (byte == 0 || byte == 1) && (!write_lock)) {
-        continue;
-      }
-      if ((block == 0x0E) && (byte > 1) && (!write_otp)) {
-        continue;
-      }
-
-      // Show if the readout went well
-      if (bFailure) {
-        // When a failure occured we need to redo the anti-collision
-        if (nfc_initiator_select_passive_target(pnd, nmJewel, NULL, 0, &nt) <= 0) {
-          ERR("tag was removed");
-          return false;
-        }
-        bFailure = false;
-      }
-
-      req.writee.btCmd = TC_WRITEE;
-      req.writee.btAdd = (block << 3) + byte;
-      req.writee.btDat = ttDump.ttd.abtData[(block << 3) + byte];
-      if (!nfc_initiator_jewel_cmd(pnd, req, &res)) {
-        bFailure = true;
-      }
+    // When a failure occured we need to redo the anti-collision
+    if (bFailure && !reselect_card()) {
+      ERR("tag was removed");
+      return false;
     }
+    bFailure = !write_block(block, write_lock, write_otp);
     print_success_or_failure(bFailure, &uiWrittenBlocks);
     fflush(stdout);
   }
@@ -201,14 +380,17 @@ int
 main(int argc, const char *argv[])
 {
   bool    bReadAction;
+  bool    bContinuous = (argc > 3) && (strcmp(argv[3], "--continuous") == 0);
   FILE   *pfDump;
+  size_t  szDump = 0;
 
   if (argc < 3) {
     printf("\n");
-    printf("%s r|w <dump.jwd>\n", argv[0]);
+    printf("%s r|w <dump.jwd> [--continuous]\n", argv[0]);
     printf("\n");
-    printf("r|w         - Perform read from or write to card\n");
-    printf("<dump.jwd>  - JeWel Dump (JWD) used to write (card to JWD) or (JWD to card)\n");
+    printf("r|w           - Perform read from or write to card\n");
+    printf("<dump.jwd>    - JeWel Dump (JWD) used to write (card to JWD) or (JWD to card)\n");
+    printf("--continuous  - Read card after card until interrupted, appending each dump to <dump.jwd> as a dump log\n");
     printf("\n");
     exit(EXIT_FAILURE);
   }
@@ -216,6 +398,10 @@ main(int argc, const char *argv[])
   DBG("\nChecking arguments and settings\n");
 
   bReadAction = tolower((int)((unsigned char) * (argv[1])) == 'r');
+  if (bContinuous && !bReadAction) {
+    ERR("--continuous only applies to reading\n");
+    exit(EXIT_FAILURE);
+  }
 
   if (bReadAction) {
     memset(&ttDump, 0x00, sizeof(ttDump));
@@ -227,7 +413,9 @@ main(int argc, const char *argv[])
       exit(EXIT_FAILURE);
     }
 
-    if (fread(&ttDump, 1, sizeof(ttDump), pfDump) != sizeof(ttDump)) {
+    // Topaz 96 dumps are shorter, the size is checked against the card later
+    memset(&ttDump, 0x00, sizeof(ttDump));
+    if ((szDump = fread(&ttDump, 1, sizeof(ttDump), pfDump)) == 0) {
       ERR("Could not read from dump file: %s\n", argv[2]);
       fclose(pfDump);
       exit(EXIT_FAILURE);
@@ -268,6 +456,13 @@ main(int argc, const char *argv[])
 
   printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
 
+  if (bContinuous) {
+    const bool bSuccess = read_cards_to_log(argv[2]);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(bSuccess ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
   // Try to find a Jewel tag
   if (nfc_initiator_select_passive_target(pnd, nmJewel, NULL, 0, &nt) <= 0) {
     ERR("no tag was found\n");
@@ -276,13 +471,15 @@ main(int argc, const char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  // Get the info from the current tag
-  printf("Found Jewel card with UID: ");
-  size_t  szPos;
-  for (szPos = 0; szPos < 4; szPos++) {
-    printf("%02x", nt.nti.nji.btId[szPos]);
+  identify_card();
+
+  if (!bReadAction && (szDump != (uiBlocks + 1) * uiBytesPerBlock)) {
+    ERR("Dump file size (%d bytes) does not match the card\n", (int) szDump);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
   }
-  printf("\n");
+  szDump = (uiBlocks + 1) * uiBytesPerBlock;
 
   if (bReadAction) {
     if (read_card()) {
@@ -295,7 +492,7 @@ main(int argc, const char *argv[])
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (fwrite(&ttDump, 1, sizeof(ttDump), pfDump) != sizeof(ttDump)) {
+      if (fwrite(&ttDump, 1, szDump, pfDump) != szDump) {
         printf("Could not write to file: %s\n", argv[2]);
         fclose(pfDump);
         nfc_close(pnd);
@@ -58,11 +58,29 @@
 
 static nfc_device *pnd;
 
+// Target types, in the order of the -t bitfield
+static const struct {
+  nfc_modulation nm;
+  const char *name;
+} types[] = {
+  { { NMT_ISO14443A, NBR_106 }, "ISO14443A" },
+  { { NMT_FELICA, NBR_212 }, "Felica (212 kbps)" },
+  { { NMT_FELICA, NBR_424 }, "Felica (424 kbps)" },
+  { { NMT_ISO14443B, NBR_106 }, "ISO14443B" },
+  { { NMT_ISO14443BI, NBR_106 }, "ISO14443B'" },
+  { { NMT_ISO14443B2SR, NBR_106 }, "ISO14443B-2 ST SRx" },
+  { { NMT_ISO14443B2CT, NBR_106 }, "ISO14443B-2 ASK CTx" },
+  { { NMT_JEWEL, NBR_106 }, "ISO14443A-3 Jewel" },
+  { { NMT_BARCODE, NBR_106 }, "ISO14443A-2 NFC Barcode" },
+};
+#define TYPE_COUNT (sizeof(types) / sizeof(types[0]))
+
 static void
 print_usage(const char *progname)
 {
-  printf("usage: %s [-v] [-t X]\n", progname);
+  printf("usage: %s [-v] [-d] [-t X]\n", progname);
   printf("  -v\t verbose display\n");
+  printf("  -d\t discover all the types at once, in as few polls as the device allows\n");
   printf("  -t X\t poll only for types according to bitfield X:\n");
   printf("\t   1: ISO14443A\n");
   printf("\t   2: Felica (212 kbps)\n");
@@ -84,6 +102,7 @@ main(int argc, const char *argv[])
   const char *acLibnfcVersion;
   size_t  i;
   bool verbose = false;
+  bool discover = false;
   int res = 0;
   int mask = 0x1ff;
   int arg;
@@ -106,6 +125,8 @@ main(int argc, const char *argv[])
       exit(EXIT_SUCCESS);
     } else if (0 == strcmp(argv[arg], "-v")) {
       verbose = true;
+    } else if (0 == strcmp(argv[arg], "-d")) {
+      discover = true;
     } else if ((0 == strcmp(argv[arg], "-t")) && (arg + 1 < argc)) {
       arg++;
       mask = atoi(argv[arg]);
@@ -158,143 +179,36 @@ main(int argc, const char *argv[])
 
     printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
 
-    nfc_modulation nm;
-
-    if (mask & 0x1) {
-      nm.nmt = NMT_ISO14443A;
-      nm.nbr = NBR_106;
-      // List ISO14443A targets
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
-        if (verbose || (res > 0)) {
-          printf("%d ISO14443A passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-        }
-        for (n = 0; n < res; n++) {
-          print_nfc_target(&ant[n], verbose);
-          printf("\n");
-        }
-      }
-    }
-
-    if (mask & 0x02) {
-      nm.nmt = NMT_FELICA;
-      nm.nbr = NBR_212;
-      // List Felica tags
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
-        if (verbose || (res > 0)) {
-          printf("%d Felica (212 kbps) passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-        }
-        for (n = 0; n < res; n++) {
-          print_nfc_target(&ant[n], verbose);
-          printf("\n");
-        }
-      }
-    }
-
-    if (mask & 0x04) {
-      nm.nmt = NMT_FELICA;
-      nm.nbr = NBR_424;
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
-        if (verbose || (res > 0)) {
-          printf("%d Felica (424 kbps) passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-        }
-        for (n = 0; n < res; n++) {
-          print_nfc_target(&ant[n], verbose);
-          printf("\n");
-        }
-      }
-    }
-
-    if (mask & 0x08) {
-      nm.nmt = NMT_ISO14443B;
-      nm.nbr = NBR_106;
-      // List ISO14443B targets
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
-        if (verbose || (res > 0)) {
-          printf("%d ISO14443B passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-        }
-        for (n = 0; n < res; n++) {
-          print_nfc_target(&ant[n], verbose);
-          printf("\n");
-        }
-      }
-    }
-
-    if (mask & 0x10) {
-      nm.nmt = NMT_ISO14443BI;
-      nm.nbr = NBR_106;
-      // List ISO14443B' targets
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
-        if (verbose || (res > 0)) {
-          printf("%d ISO14443B' passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-        }
-        for (n = 0; n < res; n++) {
-          print_nfc_target(&ant[n], verbose);
-          printf("\n");
-        }
+    if (discover) {
+      // All the types at once, with as few polls as the device allows
+      nfc_modulation anm[TYPE_COUNT];
+      size_t szModulations = 0;
+      for (size_t t = 0; t < TYPE_COUNT; t++) {
+        if (mask & (1 << t))
+          anm[szModulations++] = types[t].nm;
       }
-    }
-
-    if (mask & 0x20) {
-      nm.nmt = NMT_ISO14443B2SR;
-      nm.nbr = NBR_106;
-      // List ISO14443B-2 ST SRx family targets
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
+      if ((res = nfc_initiator_discover_targets(pnd, anm, szModulations, ant, MAX_TARGET_COUNT)) >= 0) {
         if (verbose || (res > 0)) {
-          printf("%d ISO14443B-2 ST SRx passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
+          printf("%d passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
         }
-        for (n = 0; n < res; n++) {
-          print_nfc_target(&ant[n], verbose);
-          printf("\n");
-        }
-      }
-    }
-
-    if (mask & 0x40) {
-      nm.nmt = NMT_ISO14443B2CT;
-      nm.nbr = NBR_106;
-      // List ISO14443B-2 ASK CTx family targets
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
-        if (verbose || (res > 0)) {
-          printf("%d ISO14443B-2 ASK CTx passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-        }
-        for (n = 0; n < res; n++) {
-          print_nfc_target(&ant[n], verbose);
-          printf("\n");
-        }
-      }
-    }
-
-    if (mask & 0x80) {
-      nm.nmt = NMT_JEWEL;
-      nm.nbr = NBR_106;
-      // List Jewel targets
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-        int n;
-        if (verbose || (res > 0)) {
-          printf("%d ISO14443A-3 Jewel passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-        }
-        for (n = 0; n < res; n++) {
+        for (int n = 0; n < res; n++) {
           print_nfc_target(&ant[n], verbose);
           printf("\n");
         }
+      } else {
+        nfc_perror(pnd, "nfc_initiator_discover_targets");
       }
+      nfc_close(pnd);
+      continue;
     }
 
-    if (mask & 0x100) {
-      nm.nmt = NMT_BARCODE;
-      nm.nbr = NBR_106;
-      // List NFC Barcode targets
-      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
+    for (size_t t = 0; t < TYPE_COUNT; t++) {
+      if (!(mask & (1 << t)))
+        continue;
+      if ((res = nfc_initiator_list_passive_targets(pnd, types[t].nm, ant, MAX_TARGET_COUNT)) >= 0) {
         int n;
         if (verbose || (res > 0)) {
-          printf("%d ISO14443A-2 NFC Barcode passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
+          printf("%d %s passive target(s) found%s\n", res, types[t].name, (res == 0) ? ".\n" : ":");
         }
         for (n = 0; n < res; n++) {
           print_nfc_target(&ant[n], verbose);
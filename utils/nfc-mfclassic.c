@@ -52,9 +52,11 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 
 #include <nfc/nfc.h>
 
+#include "dump-log.h"
 #include "mifare.h"
 #include "nfc-utils.h"
 
@@ -64,14 +66,18 @@ static nfc_target nt;
 static mifare_param mp;
 static mifare_classic_tag mtKeys;
 static mifare_classic_tag mtDump;
+static mifare_key_cache mkcKeys;
+static const char *pcKeyFile;
 static bool bUseKeyA;
 static bool bUseKeyFile;
 static bool bForceKeyFile;
 static bool bTolerateFailures;
 static bool bFormatCard;
+static bool bDiffWrite;
 static bool magic2 = false;
 static bool unlocked = false;
 static uint8_t uiBlocks;
+static volatile sig_atomic_t bStop = false;
 static uint8_t keys[] = {
   0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
   0xd3, 0xf7, 0xd3, 0xf7, 0xd3, 0xf7,
@@ -210,18 +216,22 @@ authenticate(uint32_t uiBlock)
       return true;
   }
 
-  // If formatting or not using key file, try to guess the right key
+  // If formatting or not using key file, try to guess the right key, starting with the ones which worked before
   if (bFormatCard || !bUseKeyFile) {
-    for (size_t key_index = 0; key_index < num_keys; key_index++) {
-      memcpy(mp.mpa.abtKey, keys + (key_index * 6), 6);
+    uint8_t aabtCached[MIFARE_KEY_CACHE_KEYS + 1][6];
+    const uint8_t ui8Sector = mifare_classic_block_sector(uiBlock);
+    const size_t szCached = mifare_key_cache_get(&mkcKeys, mp.mpa.abtAuthUid, mc, ui8Sector, aabtCached, MIFARE_KEY_CACHE_KEYS + 1);
+    for (size_t key_index = 0; key_index < szCached + num_keys; key_index++) {
+      memcpy(mp.mpa.abtKey, (key_index < szCached) ? aabtCached[key_index] : keys + ((key_index - szCached) * 6), 6);
       if (nfc_initiator_mifare_cmd(pnd, mc, uiBlock, &mp)) {
+        mifare_key_cache_hit(&mkcKeys, mp.mpa.abtAuthUid, mc, ui8Sector, mp.mpa.abtKey);
         if (bUseKeyA)
           memcpy(mtKeys.amb[uiBlock].mbt.abtKeyA, &mp.mpa.abtKey, sizeof(mtKeys.amb[uiBlock].mbt.abtKeyA));
         else
           memcpy(mtKeys.amb[uiBlock].mbt.abtKeyB, &mp.mpa.abtKey, sizeof(mtKeys.amb[uiBlock].mbt.abtKeyB));
         return true;
       }
-      if (nfc_initiator_select_passive_target(pnd, nmMifare, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, NULL) <= 0) {
+      if (nfc_initiator_reactivate_target(pnd, &nt) <= 0) {
         ERR("tag was removed");
         return false;
       }
@@ -231,6 +241,46 @@ authenticate(uint32_t uiBlock)
   return false;
 }
 
+// Authenticates and reads a whole sector at once, returns the number of blocks read or -1
+static int
+read_sector(uint32_t uiFirstBlock, mifare_classic_block *amb)
+{
+  const uint32_t uiTrailerBlock = get_trailer_block(uiFirstBlock);
+  const uint8_t ui8Sector = mifare_classic_block_sector(uiFirstBlock);
+  const mifare_cmd mc = (bUseKeyA) ? MC_AUTH_A : MC_AUTH_B;
+  uint8_t aabtCached[MIFARE_KEY_CACHE_KEYS + 1][6];
+  struct mifare_param_auth mpa;
+  size_t szCached;
+
+  memcpy(mpa.abtAuthUid, nt.nti.nai.abtUid + nt.nti.nai.szUidLen - 4, 4);
+  if (bUseKeyFile) {
+    // Only the key from the key file
+    memcpy(aabtCached[0], (bUseKeyA) ? mtKeys.amb[uiTrailerBlock].mbt.abtKeyA : mtKeys.amb[uiTrailerBlock].mbt.abtKeyB, 6);
+    szCached = 1;
+  } else {
+    szCached = mifare_key_cache_get(&mkcKeys, mpa.abtAuthUid, mc, ui8Sector, aabtCached, MIFARE_KEY_CACHE_KEYS + 1);
+  }
+  const size_t szKeys = szCached + (bUseKeyFile ? 0 : num_keys);
+  for (size_t key_index = 0; key_index < szKeys; key_index++) {
+    const uint8_t *pbtKey = (key_index < szCached) ? aabtCached[key_index] : keys + ((key_index - szCached) * 6);
+    memcpy(mpa.abtKey, pbtKey, 6);
+    int res = nfc_initiator_mifare_read_sector(pnd, mc, uiFirstBlock, &mpa, amb);
+    if (res >= 0) {
+      mifare_key_cache_hit(&mkcKeys, mpa.abtAuthUid, mc, ui8Sector, mpa.abtKey);
+      if (bUseKeyA)
+        memcpy(mtKeys.amb[uiTrailerBlock].mbt.abtKeyA, mpa.abtKey, sizeof(mtKeys.amb[uiTrailerBlock].mbt.abtKeyA));
+      else
+        memcpy(mtKeys.amb[uiTrailerBlock].mbt.abtKeyB, mpa.abtKey, sizeof(mtKeys.amb[uiTrailerBlock].mbt.abtKeyB));
+      return res;
+    }
+    if (nfc_initiator_reactivate_target(pnd, &nt) <= 0) {
+      ERR("tag was removed");
+      return -1;
+    }
+  }
+  return -1;
+}
+
 static bool
 unlock_card(void)
 {
@@ -327,8 +377,48 @@ read_card(int read_unlocked)
   }
 
   printf("Reading out %d blocks |", uiBlocks + 1);
+  // Sector by sector, authentication and reads are sent at once
+  for (int iSector = mifare_classic_block_sector(uiBlocks); !read_unlocked && (iSector >= 0); iSector--) {
+    mifare_classic_block amb[16];
+    const uint32_t uiFirstBlock = (iSector < 32) ? iSector * 4 : 128 + (iSector - 32) * 16;
+    const uint32_t uiTrailerBlock = get_trailer_block(uiFirstBlock);
+
+    if (bFailure) {
+      // When a failure occured we need to redo the anti-collision
+      if (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
+        printf("!\nError: tag was removed\n");
+        return false;
+      }
+      bFailure = false;
+    }
+    fflush(stdout);
+
+    const int iRead = read_sector(uiFirstBlock, amb);
+    if (iRead < 0) {
+      printf("!\nError: authentication failed for block 0x%02x\n", uiTrailerBlock);
+      return false;
+    }
+    // Show if the readout went well for each block, from end to begin
+    for (iBlock = uiTrailerBlock; iBlock >= (int32_t) uiFirstBlock; iBlock--) {
+      if (iBlock - (int32_t) uiFirstBlock >= iRead) {
+        if (!bFailure)
+          printf("!\nError: unable to read block 0x%02x\n", uiFirstBlock + iRead);
+        bFailure = true;
+      } else if ((uint32_t) iBlock == uiTrailerBlock) {
+        // Copy the keys over from our key dump and store the retrieved access bits
+        memcpy(mtDump.amb[iBlock].mbt.abtKeyA, mtKeys.amb[iBlock].mbt.abtKeyA, sizeof(mtDump.amb[iBlock].mbt.abtKeyA));
+        memcpy(mtDump.amb[iBlock].mbt.abtAccessBits, amb[iBlock - uiFirstBlock].mbt.abtAccessBits, sizeof(mtDump.amb[iBlock].mbt.abtAccessBits));
+        memcpy(mtDump.amb[iBlock].mbt.abtKeyB, mtKeys.amb[iBlock].mbt.abtKeyB, sizeof(mtDump.amb[iBlock].mbt.abtKeyB));
+      } else {
+        memcpy(mtDump.amb[iBlock].mbd.abtData, amb[iBlock - uiFirstBlock].mbd.abtData, sizeof(mtDump.amb[iBlock].mbd.abtData));
+      }
+      print_success_or_failure(iBlock - (int32_t) uiFirstBlock >= iRead, &uiReadBlocks);
+      if ((!bTolerateFailures) && bFailure)
+        return false;
+    }
+  }
   // Read the card from end to begin
-  for (iBlock = uiBlocks; iBlock >= 0; iBlock--) {
+  for (iBlock = uiBlocks; read_unlocked && (iBlock >= 0); iBlock--) {
     // Authenticate everytime we reach a trailer block
     if (is_trailer_block(iBlock)) {
       if (bFailure) {
@@ -342,21 +432,9 @@ read_card(int read_unlocked)
 
       fflush(stdout);
 
-      // Try to authenticate for the current sector
-      if (!read_unlocked && !authenticate(iBlock)) {
-        printf("!\nError: authentication failed for block 0x%02x\n", iBlock);
-        return false;
-      }
-      // Try to read out the trailer
+      // Unlocked, no authentication: try to read out the trailer
       if (nfc_initiator_mifare_cmd(pnd, MC_READ, iBlock, &mp)) {
-        if (read_unlocked) {
-          memcpy(mtDump.amb[iBlock].mbd.abtData, mp.mpd.abtData, sizeof(mtDump.amb[iBlock].mbd.abtData));
-        } else {
-          // Copy the keys over from our key dump and store the retrieved access bits
-          memcpy(mtDump.amb[iBlock].mbt.abtKeyA, mtKeys.amb[iBlock].mbt.abtKeyA, sizeof(mtDump.amb[iBlock].mbt.abtKeyA));
-          memcpy(mtDump.amb[iBlock].mbt.abtAccessBits, mp.mpt.abtAccessBits, sizeof(mtDump.amb[iBlock].mbt.abtAccessBits));
-          memcpy(mtDump.amb[iBlock].mbt.abtKeyB, mtKeys.amb[iBlock].mbt.abtKeyB, sizeof(mtDump.amb[iBlock].mbt.abtKeyB));
-        }
+        memcpy(mtDump.amb[iBlock].mbd.abtData, mp.mpd.abtData, sizeof(mtDump.amb[iBlock].mbd.abtData));
       } else {
         printf("!\nfailed to read trailer block 0x%02x\n", iBlock);
         bFailure = true;
@@ -484,6 +562,261 @@ write_card(int write_block_zero)
   return true;
 }
 
+// Reads a block as read_card() stores it in the dump: keys come from the key dump
+static bool
+read_block(uint32_t uiBlock, mifare_classic_block *pmb)
+{
+  if (!nfc_initiator_mifare_cmd(pnd, MC_READ, uiBlock, &mp))
+    return false;
+  if (is_trailer_block(uiBlock)) {
+    memcpy(pmb->mbt.abtKeyA, mtKeys.amb[uiBlock].mbt.abtKeyA, sizeof(pmb->mbt.abtKeyA));
+    memcpy(pmb->mbt.abtAccessBits, mp.mpt.abtAccessBits, sizeof(pmb->mbt.abtAccessBits));
+    memcpy(pmb->mbt.abtKeyB, mtKeys.amb[uiBlock].mbt.abtKeyB, sizeof(pmb->mbt.abtKeyB));
+  } else {
+    memcpy(pmb->mbd.abtData, mp.mpd.abtData, sizeof(pmb->mbd.abtData));
+  }
+  return true;
+}
+
+// Writes a block of the dump then reads it back
+static bool
+write_and_verify_block(uint32_t uiBlock)
+{
+  mifare_classic_block mb;
+
+  memcpy(mp.mpd.abtData, mtDump.amb[uiBlock].mbd.abtData, sizeof(mp.mpd.abtData));
+  if (!nfc_initiator_mifare_cmd(pnd, MC_WRITE, uiBlock, &mp))
+    return false;
+  if (!read_block(uiBlock, &mb)) {
+    // New access bits may forbid to read the trailer back
+    return is_trailer_block(uiBlock);
+  }
+  if (is_trailer_block(uiBlock))
+    return memcmp(mb.mbt.abtAccessBits, mtDump.amb[uiBlock].mbt.abtAccessBits, sizeof(mb.mbt.abtAccessBits)) == 0;
+  return memcmp(mb.mbd.abtData, mtDump.amb[uiBlock].mbd.abtData, sizeof(mb.mbd.abtData)) == 0;
+}
+
+static bool
+write_card_diff(int write_block_zero)
+{
+  mifare_classic_block ambCard[16];
+  bool bFailure = false;
+  uint32_t uiWriteBlocks = 0;
+  uint32_t uiChangedBlocks = 0;
+
+  if (write_block_zero && magic2) {
+    printf("Note: This card does not require an unlocked write (W) \n");
+    write_block_zero = 0;
+  }
+  if (write_block_zero && !unlock_card())
+    return false;
+
+  printf("Writing changed blocks of %d |", uiBlocks + 1);
+  for (uint32_t uiFirstBlock = 0; uiFirstBlock <= uiBlocks; uiFirstBlock = get_trailer_block(uiFirstBlock) + 1) {
+    const uint32_t uiTrailerBlock = get_trailer_block(uiFirstBlock);
+    const mifare_classic_block *pmbCard;
+    bool bAuthenticated = write_block_zero;
+
+    if (bFailure) {
+      // When a failure occured we need to redo the anti-collision
+      if (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
+        printf("!\nError: tag was removed\n");
+        return false;
+      }
+      bFailure = false;
+    }
+    fflush(stdout);
+
+    if (bUseKeyFile) {
+      // The key dump is taken as what the card holds, sectors alike are not even authenticated
+      pmbCard = mtKeys.amb + uiFirstBlock;
+    } else {
+      if (!bAuthenticated && !authenticate(uiTrailerBlock)) {
+        printf("!\nError: authentication failed for block %02x\n", uiFirstBlock);
+        if (!bTolerateFailures)
+          return false;
+        bFailure = true;
+        continue;
+      }
+      bAuthenticated = true;
+      for (uint32_t uiBlock = uiFirstBlock; uiBlock <= uiTrailerBlock; uiBlock++) {
+        if (!read_block(uiBlock, &ambCard[uiBlock - uiFirstBlock])) {
+          printf("!\nError: unable to read block 0x%02x\n", uiBlock);
+          return false;
+        }
+      }
+      pmbCard = ambCard;
+    }
+
+    for (uint32_t uiBlock = uiFirstBlock; uiBlock <= uiTrailerBlock; uiBlock++) {
+      // The first block 0x00 is read only, skip this
+      if ((uiBlock == 0 && !write_block_zero && !magic2) ||
+          (memcmp(&mtDump.amb[uiBlock], pmbCard + (uiBlock - uiFirstBlock), sizeof(mifare_classic_block)) == 0)) {
+        printf("-");
+        continue;
+      }
+      uiChangedBlocks++;
+      // do not write a block 0 with incorrect BCC - card will be made invalid!
+      if (uiBlock == 0) {
+        const uint8_t *pbtData = mtDump.amb[0].mbd.abtData;
+        if ((pbtData[0] ^ pbtData[1] ^ pbtData[2] ^ pbtData[3] ^ pbtData[4]) != 0x00 && !magic2) {
+          printf("!\nError: incorrect BCC in MFD file!\n");
+          printf("Expecting BCC=%02X\n", pbtData[0] ^ pbtData[1] ^ pbtData[2] ^ pbtData[3]);
+          return false;
+        }
+      }
+      if (!bAuthenticated) {
+        if (!authenticate(uiTrailerBlock)) {
+          printf("!\nError: authentication failed for block %02x\n", uiFirstBlock);
+          if (!bTolerateFailures)
+            return false;
+          bFailure = true;
+          break;
+        }
+        bAuthenticated = true;
+      }
+      bFailure = !write_and_verify_block(uiBlock);
+      print_success_or_failure(bFailure, &uiWriteBlocks);
+      if (bFailure) {
+        if (!bTolerateFailures)
+          return false;
+        break;
+      }
+    }
+  }
+  printf("|\n");
+  printf("Done, %d of %d changed blocks written and verified.\n", uiWriteBlocks, uiChangedBlocks);
+  fflush(stdout);
+
+  return true;
+}
+
+// Checks the selected card against the key file, guesses its size and loads the keys
+static bool
+setup_card(void)
+{
+  const uint8_t *pbtUID = nt.nti.nai.abtUid;
+  int res;
+
+// Test if we are dealing with a MIFARE compatible tag
+  if ((nt.nti.nai.btSak & 0x08) == 0) {
+    printf("Warning: tag is probably not a MFC!\n");
+  }
+
+  if (bUseKeyFile) {
+    uint8_t fileUid[4];
+    memcpy(fileUid, mtKeys.amb[0].mbm.abtUID, 4);
+// Compare if key dump UID is the same as the current tag UID, at least for the first 4 bytes
+    if (memcmp(pbtUID, fileUid, 4) != 0) {
+      printf("Expected MIFARE Classic card with UID starting as: %02x%02x%02x%02x\n",
+             fileUid[0], fileUid[1], fileUid[2], fileUid[3]);
+      printf("Got card with UID starting as:                     %02x%02x%02x%02x\n",
+             pbtUID[0], pbtUID[1], pbtUID[2], pbtUID[3]);
+      if (!bForceKeyFile) {
+        printf("Aborting!\n");
+        return false;
+      }
+    }
+  }
+  printf("Found MIFARE Classic card:\n");
+  print_nfc_target(&nt, false);
+
+// Guessing size
+  magic2 = false;
+  if ((nt.nti.nai.abtAtqa[1] & 0x02) == 0x02 || nt.nti.nai.btSak == 0x18)
+// 4K
+    uiBlocks = 0xff;
+  else if (nt.nti.nai.btSak == 0x09)
+// 320b
+    uiBlocks = 0x13;
+  else
+// 1K/2K, checked through RATS
+    uiBlocks = 0x3f;
+// Testing RATS
+  if ((res = get_rats()) > 0) {
+    if ((res >= 10) && (abtRx[5] == 0xc1) && (abtRx[6] == 0x05)
+        && (abtRx[7] == 0x2f) && (abtRx[8] == 0x2f)
+        && ((nt.nti.nai.abtAtqa[1] & 0x02) == 0x00)) {
+      // MIFARE Plus 2K
+      uiBlocks = 0x7f;
+    }
+    // Chinese magic emulation card, ATS=0978009102:dabc1910
+    if ((res == 9)  && (abtRx[5] == 0xda) && (abtRx[6] == 0xbc)
+        && (abtRx[7] == 0x19) && (abtRx[8] == 0x10)) {
+      magic2 = true;
+    }
+  }
+  printf("Guessing size: seems to be a %lu-byte card\n", (uiBlocks + 1) * sizeof(mifare_classic_block));
+
+  if (bUseKeyFile) {
+    FILE *pfKeys = fopen(pcKeyFile, "rb");
+    if (pfKeys == NULL) {
+      printf("Could not open keys file: %s\n", pcKeyFile);
+      return false;
+    }
+    if (fread(&mtKeys, 1, (uiBlocks + 1) * sizeof(mifare_classic_block), pfKeys) != (uiBlocks + 1) * sizeof(mifare_classic_block)) {
+      printf("Could not read keys file: %s\n", pcKeyFile);
+      fclose(pfKeys);
+      return false;
+    }
+    fclose(pfKeys);
+  }
+  return true;
+}
+
+static void
+stop_reading(int sig)
+{
+  (void) sig;
+  bStop = true;
+}
+
+// Reads card after card into a dump log, until interrupted
+static bool
+read_cards_to_log(const char *pcLog, const uint8_t *pbtUid, int unlock)
+{
+  dump_log dl;
+  size_t szCards = 0;
+  bool bSuccess = true;
+  int res;
+
+  if (dump_log_open(&dl, pcLog) < 0) {
+    printf("Could not open dump log: %s\n", pcLog);
+    return false;
+  }
+  printf("Appending to dump log %s (%lu dumps), waiting for cards, Ctrl-C to stop\n", pcLog, (unsigned long) dl.szRecords);
+  signal(SIGINT, stop_reading);
+
+  while ((res = wait_for_target(pnd, nmMifare, pbtUid, (pbtUid == NULL) ? 0 : 4, &nt, &bStop)) > 0) {
+    memset(&mtDump, 0x00, sizeof(mtDump));
+    if (setup_card() && read_card(unlock)) {
+      res = dump_log_append(&dl, DUMP_LOG_MIFARE_CLASSIC, nt.nti.nai.abtUid, nt.nti.nai.szUidLen,
+                            &mtDump, (uiBlocks + 1) * sizeof(mifare_classic_block));
+      if (res < 0) {
+        printf("Could not append to dump log: %s\n", pcLog);
+        bSuccess = false;
+        break;
+      }
+      szCards++;
+      if (res > 0)
+        printf("Card logged, UID already logged %d time(s)\n", res);
+      else
+        printf("Card logged\n");
+    } else {
+      printf("Card not logged\n");
+    }
+    printf("Waiting for the card to be removed\n");
+    wait_for_removal(pnd, nmMifare, &bStop);
+  }
+  if (res < 0 && bSuccess) {
+    nfc_perror(pnd, "nfc_initiator_select_passive_target");
+    bSuccess = false;
+  }
+  printf("%lu cards logged\n", (unsigned long) szCards);
+  dump_log_close(&dl);
+  return bSuccess;
+}
+
 typedef enum {
   ACTION_READ,
   ACTION_WRITE,
@@ -494,17 +827,22 @@ static void
 print_usage(const char *pcProgramName)
 {
   printf("Usage: ");
-  printf("%s f|r|R|w|W a|b u|U<01ab23cd> <dump.mfd> [<keys.mfd> [f]]\n", pcProgramName);
-  printf("  f|r|R|w|W     - Perform format (f) or read from (r) or unlocked read from (R) or write to (w) or unlocked write to (W) card\n");
+  printf("%s f|r|R|w|W|d|D a|b u|U<01ab23cd> <dump.mfd> [<keys.mfd> [f]] [--key-cache <cache.txt>] [--continuous]\n", pcProgramName);
+  printf("  f|r|R|w|W|d|D - Perform format (f) or read from (r) or unlocked read from (R) or write to (w) or unlocked write to (W) card\n");
+  printf("                  or write only the blocks which differ from the card (d), unlocked (D)\n");
   printf("                  *** format will reset all keys to FFFFFFFFFFFF and all data to 00 and all ACLs to default\n");
   printf("                  *** unlocked read does not require authentication and will reveal A and B keys\n");
   printf("                  *** note that unlocked write will attempt to overwrite block 0 including UID\n");
   printf("                  *** unlocking only works with special Mifare 1K cards (Chinese clones)\n");
+  printf("                  *** diff write compares with <keys.mfd> if given, otherwise reads the card first,\n");
+  printf("                      then reads back each written block\n");
   printf("  a|A|b|B       - Use A or B keys for action; Halt on errors (a|b) or tolerate errors (A|B)\n");
   printf("  u|U           - Use any (u) uid or supply a uid specifically as U01ab23cd.\n");
   printf("  <dump.mfd>    - MiFare Dump (MFD) used to write (card to MFD) or (MFD to card)\n");
   printf("  <keys.mfd>    - MiFare Dump (MFD) that contain the keys (optional)\n");
   printf("  f             - Force using the keyfile even if UID does not match (optional)\n");
+  printf("  --key-cache   - File remembering the keys which worked for each sector, tried first on next cards (optional)\n");
+  printf("  --continuous  - Read card after card until interrupted, appending each dump to <dump.mfd> as a dump log (optional)\n");
   printf("Examples: \n\n");
   printf("  Read card to file, using key A:\n\n");
   printf("    %s r a u mycard.mfd\n\n", pcProgramName);
@@ -512,22 +850,55 @@ print_usage(const char *pcProgramName)
   printf("    %s w a u mycard.mfd\n\n", pcProgramName);
   printf("  Write new data and/or keys to previously written card, using key A:\n\n");
   printf("    %s w a u newdata.mfd mycard.mfd\n\n", pcProgramName);
+  printf("  Only update the blocks of a previously written card which changed, using key A:\n\n");
+  printf("    %s d a u newdata.mfd mycard.mfd\n\n", pcProgramName);
   printf("  Format/wipe card (note two passes required to ensure writes for all ACL cases):\n\n");
   printf("    %s f A u dummy.mfd keyfile.mfd f\n", pcProgramName);
   printf("    %s f B u dummy.mfd keyfile.mfd f\n\n", pcProgramName);
   printf("  Read card to file, using key A and uid 0x01 0xab 0x23 0xcd:\n\n");
   printf("    %s r a U01ab23cd mycard.mfd\n\n", pcProgramName);
+  printf("  Read cards one after the other to a dump log, using key A:\n\n");
+  printf("    %s r a u cards.ndl --key-cache keys.txt --continuous\n\n", pcProgramName);
 }
 
 int
 main(int argc, const char *argv[])
 {
   action_t atAction = ACTION_USAGE;
-  uint8_t *pbtUID;
   uint8_t _tag_uid[4];
   uint8_t *tag_uid = _tag_uid;
 
   int    unlock = 0;
+  const char *pcKeyCache = NULL;
+  bool   bContinuous = false;
+
+  // Take the options out, positional arguments keep their place
+  for (int arg = 1; arg < argc;) {
+    int iOption = 0;
+
+    if (strcmp(argv[arg], "--key-cache") == 0) {
+      if (arg + 1 == argc) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      pcKeyCache = argv[arg + 1];
+      iOption = 2;
+    } else if (strcmp(argv[arg], "--continuous") == 0) {
+      bContinuous = true;
+      iOption = 1;
+    } else {
+      arg++;
+      continue;
+    }
+    for (int i = arg; i + iOption < argc; i++)
+      argv[i] = argv[i + iOption];
+    argc -= iOption;
+  }
+  mifare_key_cache_init(&mkcKeys);
+  if (pcKeyCache && !mifare_key_cache_load(&mkcKeys, pcKeyCache)) {
+    printf("Could not read key cache: %s\n", pcKeyCache);
+    exit(EXIT_FAILURE);
+  }
 
   if (argc < 2) {
     print_usage(argv[0]);
@@ -547,11 +918,13 @@ main(int argc, const char *argv[])
     bTolerateFailures = tolower((int)((unsigned char) * (argv[2]))) != (int)((unsigned char) * (argv[2]));
     bUseKeyFile = (argc > 5);
     bForceKeyFile = ((argc > 6) && (strcmp((char *)argv[6], "f") == 0));
-  } else if (strcmp(command, "w") == 0 || strcmp(command, "W") == 0 || strcmp(command, "f") == 0) {
+  } else if (strcmp(command, "w") == 0 || strcmp(command, "W") == 0 || strcmp(command, "f") == 0 ||
+             strcmp(command, "d") == 0 || strcmp(command, "D") == 0) {
     atAction = ACTION_WRITE;
-    if (strcmp(command, "W") == 0)
+    if (strcmp(command, "W") == 0 || strcmp(command, "D") == 0)
       unlock = 1;
     bFormatCard = (strcmp(command, "f") == 0);
+    bDiffWrite = (strcmp(command, "d") == 0 || strcmp(command, "D") == 0);
     bUseKeyA = tolower((int)((unsigned char) * (argv[2]))) == 'a';
     bTolerateFailures = tolower((int)((unsigned char) * (argv[2]))) != (int)((unsigned char) * (argv[2]));
     bUseKeyFile = (argc > 5);
@@ -576,12 +949,13 @@ main(int argc, const char *argv[])
     tag_uid = NULL;
   }
 
-  if (atAction == ACTION_USAGE) {
+  if ((atAction == ACTION_USAGE) || (bContinuous && (atAction != ACTION_READ))) {
     print_usage(argv[0]);
     exit(EXIT_FAILURE);
   }
   // We don't know yet the card size so let's read only the UID from the keyfile for the moment
   if (bUseKeyFile) {
+    pcKeyFile = argv[5];
     FILE *pfKeys = fopen(argv[5], "rb");
     if (pfKeys == NULL) {
       printf("Could not open keys file: %s\n", argv[5]);
@@ -632,6 +1006,15 @@ main(int argc, const char *argv[])
 
   printf("NFC reader: %s opened\n", nfc_device_get_name(pnd));
 
+  if (bContinuous) {
+    const bool bSuccess = read_cards_to_log(argv[4], tag_uid, unlock);
+    if (pcKeyCache && !mifare_key_cache_save(&mkcKeys, pcKeyCache))
+      printf("Could not write key cache: %s\n", pcKeyCache);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(bSuccess ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
 // Try to find a MIFARE Classic tag
   int tags;
 
@@ -642,73 +1025,10 @@ main(int argc, const char *argv[])
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
-// Test if we are dealing with a MIFARE compatible tag
-  if ((nt.nti.nai.btSak & 0x08) == 0) {
-    printf("Warning: tag is probably not a MFC!\n");
-  }
-
-// Get the info from the current tag
-  pbtUID = nt.nti.nai.abtUid;
-
-  if (bUseKeyFile) {
-    uint8_t fileUid[4];
-    memcpy(fileUid, mtKeys.amb[0].mbm.abtUID, 4);
-// Compare if key dump UID is the same as the current tag UID, at least for the first 4 bytes
-    if (memcmp(pbtUID, fileUid, 4) != 0) {
-      printf("Expected MIFARE Classic card with UID starting as: %02x%02x%02x%02x\n",
-             fileUid[0], fileUid[1], fileUid[2], fileUid[3]);
-      printf("Got card with UID starting as:                     %02x%02x%02x%02x\n",
-             pbtUID[0], pbtUID[1], pbtUID[2], pbtUID[3]);
-      if (!bForceKeyFile) {
-        printf("Aborting!\n");
-        nfc_close(pnd);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-    }
-  }
-  printf("Found MIFARE Classic card:\n");
-  print_nfc_target(&nt, false);
-
-// Guessing size
-  if ((nt.nti.nai.abtAtqa[1] & 0x02) == 0x02 || nt.nti.nai.btSak == 0x18)
-// 4K
-    uiBlocks = 0xff;
-  else if (nt.nti.nai.btSak == 0x09)
-// 320b
-    uiBlocks = 0x13;
-  else
-// 1K/2K, checked through RATS
-    uiBlocks = 0x3f;
-// Testing RATS
-  int res;
-  if ((res = get_rats()) > 0) {
-    if ((res >= 10) && (abtRx[5] == 0xc1) && (abtRx[6] == 0x05)
-        && (abtRx[7] == 0x2f) && (abtRx[8] == 0x2f)
-        && ((nt.nti.nai.abtAtqa[1] & 0x02) == 0x00)) {
-      // MIFARE Plus 2K
-      uiBlocks = 0x7f;
-    }
-    // Chinese magic emulation card, ATS=0978009102:dabc1910
-    if ((res == 9)  && (abtRx[5] == 0xda) && (abtRx[6] == 0xbc)
-        && (abtRx[7] == 0x19) && (abtRx[8] == 0x10)) {
-      magic2 = true;
-    }
-  }
-  printf("Guessing size: seems to be a %lu-byte card\n", (uiBlocks + 1) * sizeof(mifare_classic_block));
-
-  if (bUseKeyFile) {
-    FILE *pfKeys = fopen(argv[5], "rb");
-    if (pfKeys == NULL) {
-      printf("Could not open keys file: %s\n", argv[5]);
-      exit(EXIT_FAILURE);
-    }
-    if (fread(&mtKeys, 1, (uiBlocks + 1) * sizeof(mifare_classic_block), pfKeys) != (uiBlocks + 1) * sizeof(mifare_classic_block)) {
-      printf("Could not read keys file: %s\n", argv[5]);
-      fclose(pfKeys);
-      exit(EXIT_FAILURE);
-    }
-    fclose(pfKeys);
+  if (!setup_card()) {
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
   }
 
   if (atAction == ACTION_READ) {
@@ -753,8 +1073,13 @@ main(int argc, const char *argv[])
       fclose(pfDump);
     }
   } else if (atAction == ACTION_WRITE) {
-    write_card(unlock);
+    if (bDiffWrite)
+      write_card_diff(unlock);
+    else
+      write_card(unlock);
   }
+  if (pcKeyCache && !mifare_key_cache_save(&mkcKeys, pcKeyCache))
+    printf("Could not write key cache: %s\n", pcKeyCache);
 
   nfc_close(pnd);
   nfc_exit(context);
@@ -52,9 +52,11 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 
 #include <nfc/nfc.h>
 
+#include "dump-log.h"
 #include "nfc-utils.h"
 #include "mifare.h"
 
@@ -74,12 +76,14 @@ static nfc_device *pnd;
 static nfc_target nt;
 static mifare_param mp;
 static maxtag mtDump; // use the largest tag type for internal storage
+static maxtag mtCard; // content of the card, for differential writes
 static uint32_t uiBlocks = 0x10;
 static uint32_t uiReadPages = 0;
 static uint8_t iPWD[4] = { 0x0 };
 static uint8_t iPACK[2] = { 0x0 };
 static uint8_t iEV1Type = EV1_NONE;
 static uint8_t iNTAGType = NTAG_NONE;
+static volatile sig_atomic_t bStop = false;
 
 // special unlock command
 uint8_t  abtUnlock1[1] = { 0x40 };
@@ -114,25 +118,55 @@ print_success_or_failure(bool bFailure, uint32_t *uiOkCounter, uint32_t *uiFaile
 }
 
 static  bool
-read_card(void)
+read_pages(maxtag *pmt, uint32_t *puiReadPages, uint32_t *puiFailedPages)
 {
   uint32_t page;
   bool    bFailure = false;
-  uint32_t uiFailedPages = 0;
 
-  printf("Reading %d pages |", uiBlocks);
+  // EV1 and NTAG return as many pages as a frame holds with FAST_READ
+  page = 0;
+  if ((iEV1Type != EV1_NONE) || (iNTAGType != NTAG_NONE)) {
+    while (page < uiBlocks) {
+      const uint32_t uiPages = (uiBlocks - page < MIFARE_FAST_READ_MAX_PAGES) ? uiBlocks - page : MIFARE_FAST_READ_MAX_PAGES;
+      mp.mpfr.ui8EndPage = page + uiPages - 1;
+      if (!nfc_initiator_mifare_cmd(pnd, MC_FAST_READ, page, &mp)) {
+        // Not supported after all: redo the anti-collision and finish with READ
+        if (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
+          ERR("tag was removed");
+          return false;
+        }
+        break;
+      }
+      memcpy(((uint8_t *) pmt) + page * 4, mp.mpfr.abtData, uiPages * 4);
+      for (uint32_t i = 0; i < uiPages; i++) {
+        print_success_or_failure(false, puiReadPages, puiFailedPages);
+      }
+      page += uiPages;
+    }
+  }
 
-  for (page = 0; page < uiBlocks; page += 4) {
+  for (; page < uiBlocks; page += 4) {
     // Try to read out the data block
     if (nfc_initiator_mifare_cmd(pnd, MC_READ, page, &mp)) {
-      memcpy(mtDump.ul[page / 4].mbd.abtData, mp.mpd.abtData, uiBlocks - page < 4 ? (uiBlocks - page) * 4 : 16);
+      memcpy(pmt->ul[page / 4].mbd.abtData, mp.mpd.abtData, uiBlocks - page < 4 ? (uiBlocks - page) * 4 : 16);
     } else {
       bFailure = true;
     }
     for (uint8_t i = 0; i < (uiBlocks - page < 4 ? uiBlocks - page : 4); i++) {
-      print_success_or_failure(bFailure, &uiReadPages, &uiFailedPages);
+      print_success_or_failure(bFailure, puiReadPages, puiFailedPages);
     }
   }
+  return !bFailure;
+}
+
+static  bool
+read_card(void)
+{
+  bool    bFailure;
+  uint32_t uiFailedPages = 0;
+
+  printf("Reading %d pages |", uiBlocks);
+  bFailure = !read_pages(&mtDump, &uiReadPages, &uiFailedPages);
   printf("|\n");
   printf("Done, %d of %d pages read (%d pages failed).\n", uiReadPages, uiBlocks, uiFailedPages);
   fflush(stdout);
@@ -338,10 +372,51 @@ static bool check_magic()
 
 }
 
+// Writes a run of pages, redoing the anti-collision after a failed one
 static  bool
-write_card(bool write_otp, bool write_lock, bool write_dyn_lock, bool write_uid)
+write_pages(const uint8_t *pui8Pages, const size_t szPages, bool *pbFailure, uint32_t *puiWrittenPages, uint32_t *puiFailedPages)
 {
-  uint32_t uiBlock = 0;
+  struct mifare_param_data ampd[MIFARE_WRITE_BATCH_MAX];
+  size_t  szDone = 0;
+
+  // For the Mifare Ultralight, this write command can be used
+  // in compatibility mode, which only actually writes the first
+  // page (4 bytes). The Ultralight-specific Write command only
+  // writes one page at a time.
+  for (size_t i = 0; i < szPages; i++) {
+    memcpy(ampd[i].abtData, mtDump.ul[pui8Pages[i] / 4].mbd.abtData + ((pui8Pages[i] % 4) * 4), 4);
+    memset(ampd[i].abtData + 4, 0, 12);
+  }
+  while (szDone < szPages) {
+    // Check if the previous write went well
+    if (*pbFailure) {
+      if (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
+        ERR("tag was removed");
+        return false;
+      }
+      *pbFailure = false;
+    }
+    const size_t szWritten = nfc_initiator_mifare_write_batch(pnd, pui8Pages + szDone, ampd + szDone, szPages - szDone);
+    for (size_t i = 0; i < szWritten; i++) {
+      print_success_or_failure(false, puiWrittenPages, puiFailedPages);
+    }
+    szDone += szWritten;
+    if (szDone < szPages) {
+      *pbFailure = true;
+      print_success_or_failure(true, puiWrittenPages, puiFailedPages);
+      szDone++;
+    }
+  }
+  return true;
+}
+
+static  bool
+write_card(bool write_otp, bool write_lock, bool write_dyn_lock, bool write_uid, bool write_diff)
+{
+  bool    abWritten[sizeof(maxtag) / 4] = { false };
+  uint32_t uiUnchangedPages = 0;
+  uint8_t aui8Pages[MIFARE_WRITE_BATCH_MAX];
+  size_t  szPages = 0;
   bool    bFailure = false;
   uint32_t uiWrittenPages = 0;
   uint32_t uiSkippedPages = 0;
@@ -383,6 +458,18 @@ write_card(bool write_otp, bool write_lock, bool write_dyn_lock, bool write_uid)
     write_uid = ((buffer[0] == 'y') || (buffer[0] == 'Y'));
   }
 
+  if (write_diff) {
+    uint32_t uiCardPages = 0;
+    uint32_t uiCardFailedPages = 0;
+    printf("Reading %d pages |", uiBlocks);
+    bool bRead = read_pages(&mtCard, &uiCardPages, &uiCardFailedPages);
+    printf("|\n");
+    if (!bRead) {
+      printf("Unable to read the card to compare with the dump.\n");
+      return false;
+    }
+  }
+
   printf("Writing %d pages |", uiBlocks);
   /* We may need to skip 2 first pages. */
   if (!write_uid) {
@@ -396,48 +483,76 @@ write_card(bool write_otp, bool write_lock, bool write_dyn_lock, bool write_uid)
   }
 
   for (uint32_t page = uiSkippedPages; page < uiBlocks; page++) {
+    bool bSkip = false;
     if ((!write_lock) && page == 0x2) {
-      printf("s");
-      uiSkippedPages++;
-      continue;
+      bSkip = true;
     }
     // OTP/Capability blocks
     if ((page == 0x3) && (!write_otp)) {
-      printf("s");
-      uiSkippedPages++;
-      continue;
+      bSkip = true;
     }
     // NTAG and MF0UL21 have Dynamic Lock Bytes
     if (((iEV1Type == EV1_UL21 && page == 0x24) || \
-        (iNTAGType == NTAG_213 && page == 0x28) || \
-        (iNTAGType == NTAG_215 && page == 0x82) || \
-        (iNTAGType == NTAG_216 && page == 0xe2)) && (!write_dyn_lock)) {
+         (iNTAGType == NTAG_213 && page == 0x28) || \
+         (iNTAGType == NTAG_215 && page == 0x82) || \
+         (iNTAGType == NTAG_216 && page == 0xe2)) && (!write_dyn_lock)) {
+      bSkip = true;
+    }
+    // Pages the card already holds are left untouched
+    const bool bUnchanged = !bSkip && write_diff && (memcmp(((uint8_t *) &mtCard) + page * 4, ((uint8_t *) &mtDump) + page * 4, 4) == 0);
+    if (!bSkip && !bUnchanged) {
+      // Pages are written by runs, pipelined
+      abWritten[page] = true;
+      aui8Pages[szPages++] = page;
+      if (szPages < MIFARE_WRITE_BATCH_MAX)
+        continue;
+    }
+    if (szPages) {
+      if (!write_pages(aui8Pages, szPages, &bFailure, &uiWrittenPages, &uiFailedPages))
+        return false;
+      szPages = 0;
+    }
+    if (bSkip) {
       printf("s");
       uiSkippedPages++;
-      continue;
     }
-    // Check if the previous readout went well
-    if (bFailure) {
-      // When a failure occured we need to redo the anti-collision
-      if (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
-        ERR("tag was removed");
-        return false;
-      }
-      bFailure = false;
+    if (bUnchanged) {
+      printf("-");
+      uiUnchangedPages++;
     }
-    // For the Mifare Ultralight, this write command can be used
-    // in compatibility mode, which only actually writes the first
-    // page (4 bytes). The Ultralight-specific Write command only
-    // writes one page at a time.
-    uiBlock = page / 4;
-    memcpy(mp.mpd.abtData, mtDump.ul[uiBlock].mbd.abtData + ((page % 4) * 4), 4);
-    memset(mp.mpd.abtData + 4, 0, 12);
-    if (!nfc_initiator_mifare_cmd(pnd, MC_WRITE, page, &mp))
-      bFailure = true;
-    print_success_or_failure(bFailure, &uiWrittenPages, &uiFailedPages);
   }
+  if (szPages && !write_pages(aui8Pages, szPages, &bFailure, &uiWrittenPages, &uiFailedPages))
+    return false;
   printf("|\n");
-  printf("Done, %d of %d pages written (%d pages skipped, %d pages failed).\n", uiWrittenPages, uiBlocks, uiSkippedPages, uiFailedPages);
+  if (write_diff) {
+    printf("Done, %d of %d pages written (%d pages skipped, %d pages unchanged, %d pages failed).\n", uiWrittenPages, uiBlocks, uiSkippedPages, uiUnchangedPages, uiFailedPages);
+  } else {
+    printf("Done, %d of %d pages written (%d pages skipped, %d pages failed).\n", uiWrittenPages, uiBlocks, uiSkippedPages, uiFailedPages);
+  }
+
+  if (write_diff) {
+    uint32_t uiCardPages = 0;
+    uint32_t uiCardFailedPages = 0;
+    uint32_t uiMismatchPages = 0;
+    if (bFailure && nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
+      ERR("tag was removed");
+      return false;
+    }
+    printf("Verifying %d pages |", uiBlocks);
+    bool bRead = read_pages(&mtCard, &uiCardPages, &uiCardFailedPages);
+    printf("|\n");
+    for (uint32_t page = 0; bRead && (page < uiBlocks); page++) {
+      if (abWritten[page] && (memcmp(((uint8_t *) &mtCard) + page * 4, ((uint8_t *) &mtDump) + page * 4, 4) != 0))
+        uiMismatchPages++;
+    }
+    if (!bRead) {
+      printf("Unable to read the card back.\n");
+      return false;
+    }
+    printf("Done, %d written pages do not match the dump.\n", uiMismatchPages);
+    if (uiMismatchPages)
+      return false;
+  }
 
   return true;
 }
@@ -493,6 +608,139 @@ static size_t str_to_uid(const char *str, uint8_t *uid)
   return i >> 1;
 }
 
+// Checks the selected card is an Ultralight, finds its type then authenticates if asked to
+static bool
+setup_card(bool bPWD, const uint8_t *pbtUID, const size_t szUID, size_t *pszDumpSize)
+{
+  uiBlocks = 0x10;
+  iEV1Type = EV1_NONE;
+  iNTAGType = NTAG_NONE;
+  *pszDumpSize = sizeof(mifareul_tag);
+
+  // Test if we are dealing with a MIFARE compatible tag
+  if (nt.nti.nai.abtAtqa[1] != 0x44) {
+    ERR("tag is not a MIFARE Ultralight card\n");
+    return false;
+  }
+  // Get the info from the current tag
+  printf("Using MIFARE Ultralight card with UID: ");
+  size_t  szPos;
+  for (szPos = 0; szPos < nt.nti.nai.szUidLen; szPos++) {
+    printf("%02x", nt.nti.nai.abtUid[szPos]);
+  }
+  printf("\n");
+
+  // test if tag is EV1 or NTAG
+  if (get_ev1_version()) {
+    if (!bPWD)
+      printf("WARNING: Tag is EV1 or NTAG - PASSWORD may be required\n");
+    if (abtRx[6] == 0x0b) {
+      printf("EV1 type: MF0UL11 (48 bytes)\n");
+      uiBlocks = 20; // total number of 4 byte 'pages'
+      *pszDumpSize = uiBlocks * 4;
+      iEV1Type = EV1_UL11;
+    } else if (abtRx[6] == 0x0e) {
+      printf("EV1 type: MF0UL21 (128 user bytes)\n");
+      uiBlocks = 41; 
+      *pszDumpSize = uiBlocks * 4;
+      iEV1Type = EV1_UL21;
+    } else if (abtRx[6] == 0x0f) {
+      printf("NTAG Type: NTAG213 (144 user bytes)\n");
+      uiBlocks = 45;
+      *pszDumpSize = uiBlocks * 4;
+      iNTAGType = NTAG_213;
+    } else if (abtRx[6] == 0x11) {
+      printf("NTAG Type: NTAG215 (504 user bytes)\n");
+      uiBlocks = 135;
+      *pszDumpSize = uiBlocks * 4;
+      iNTAGType = NTAG_215;
+    } else if (abtRx[6] == 0x13) {
+      printf("NTAG Type: NTAG216 (888 user bytes)\n");
+      uiBlocks = 231;
+      *pszDumpSize = uiBlocks * 4;
+      iNTAGType = NTAG_216;
+    } else {
+      printf("unknown! (0x%02x)\n", abtRx[6]);
+      return false;
+    }
+  } else {
+    // re-init non EV1 tag
+    if (nfc_initiator_select_passive_target(pnd, nmMifare, pbtUID, szUID, &nt) <= 0) {
+      ERR("no tag was found\n");
+      return false;
+    }
+  }
+
+  // EV1 login required
+  if (bPWD) {
+    printf("Authing with PWD: %02x%02x%02x%02x ", iPWD[0], iPWD[1], iPWD[2], iPWD[3]);
+    if (!ev1_pwd_auth(iPWD)) {
+      printf("\n");
+      ERR("AUTH failed!\n");
+      return false;
+    } else {
+      printf("Success - PACK: %02x%02x\n", abtRx[0], abtRx[1]);
+      memcpy(iPACK, abtRx, 2);
+    }
+  }
+  return true;
+}
+
+static void
+stop_reading(int sig)
+{
+  (void) sig;
+  bStop = true;
+}
+
+// Reads card after card into a dump log, until interrupted
+static bool
+read_cards_to_log(const char *pcLog, bool bPWD, const uint8_t *pbtUID, const size_t szUID)
+{
+  dump_log dl;
+  size_t szCards = 0;
+  size_t szDumpSize;
+  bool bSuccess = true;
+  int res;
+
+  if (dump_log_open(&dl, pcLog) < 0) {
+    ERR("Could not open dump log: %s\n", pcLog);
+    return false;
+  }
+  printf("Appending to dump log %s (%lu dumps), waiting for cards, Ctrl-C to stop\n", pcLog, (unsigned long) dl.szRecords);
+  signal(SIGINT, stop_reading);
+
+  while ((res = wait_for_target(pnd, nmMifare, pbtUID, szUID, &nt, &bStop)) > 0) {
+    memset(&mtDump, 0x00, sizeof(mtDump));
+    uiReadPages = 0;
+    if (setup_card(bPWD, pbtUID, szUID, &szDumpSize) && read_card()) {
+      res = dump_log_append(&dl, DUMP_LOG_MIFARE_ULTRALIGHT, nt.nti.nai.abtUid, nt.nti.nai.szUidLen,
+                            &mtDump, uiReadPages * 4);
+      if (res < 0) {
+        ERR("Could not append to dump log: %s\n", pcLog);
+        bSuccess = false;
+        break;
+      }
+      szCards++;
+      if (res > 0)
+        printf("Card logged, UID already logged %d time(s)\n", res);
+      else
+        printf("Card logged\n");
+    } else {
+      printf("Card not logged\n");
+    }
+    printf("Waiting for the card to be removed\n");
+    wait_for_removal(pnd, nmMifare, &bStop);
+  }
+  if (res < 0 && bSuccess) {
+    nfc_perror(pnd, "nfc_initiator_select_passive_target");
+    bSuccess = false;
+  }
+  printf("%lu cards logged\n", (unsigned long) szCards);
+  dump_log_close(&dl);
+  return bSuccess;
+}
+
 static void
 print_usage(const char *argv[])
 {
@@ -509,6 +757,8 @@ print_usage(const char *argv[])
   printf("\t--with-uid <UID>    - Specify UID to read/write from\n");
   printf("\t--pw <PWD>          - Specify 8 HEX digit PASSWORD for EV1\n");
   printf("\t--partial           - Allow source data size to be other than tag capacity\n");
+  printf("\t--diff              - Only write the pages which differ from the card, then read them back\n");
+  printf("\t--continuous        - Read card after card until interrupted, appending each dump to <dump.mfd> as a dump log\n");
 }
 
 int
@@ -524,6 +774,8 @@ main(int argc, const char *argv[])
   bool    bUID = false;
   bool    bPWD = false;
   bool    bPart = false;
+  bool    bDiff = false;
+  bool    bContinuous = false;
   bool    bFilename = false;
   FILE   *pfDump;
 
@@ -563,6 +815,10 @@ main(int argc, const char *argv[])
       iAction = 3;
     } else if (0 == strcmp(argv[arg], "--partial")) {
       bPart = true;
+    } else if (0 == strcmp(argv[arg], "--diff")) {
+      bDiff = true;
+    } else if (0 == strcmp(argv[arg], "--continuous")) {
+      bContinuous = true;
     } else if (0 == strcmp(argv[arg], "--pw")) {
       bPWD = true;
       if (arg + 1 == argc || strlen(argv[++arg]) != 8 || ! ev1_load_pwd(iPWD, argv[arg])) {
@@ -584,6 +840,10 @@ main(int argc, const char *argv[])
     ERR("Please supply a Mifare Dump filename");
     exit(EXIT_FAILURE);
   }
+  if (bContinuous && (iAction != 1)) {
+    ERR("--continuous only applies to reading");
+    exit(EXIT_FAILURE);
+  }
 
   nfc_context *context;
   nfc_init(&context);
@@ -623,6 +883,13 @@ main(int argc, const char *argv[])
     exit(EXIT_FAILURE);
   }
 
+  if (bContinuous) {
+    const bool bSuccess = read_cards_to_log(argv[2], bPWD, (szUID) ? iUID : NULL, szUID);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(bSuccess ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
   // Try to find a MIFARE Ultralight tag
   if (nfc_initiator_select_passive_target(pnd, nmMifare, (szUID) ? iUID : NULL, szUID, &nt) <= 0) {
     ERR("no tag was found\n");
@@ -631,76 +898,11 @@ main(int argc, const char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  // Test if we are dealing with a MIFARE compatible tag
-  if (nt.nti.nai.abtAtqa[1] != 0x44) {
-    ERR("tag is not a MIFARE Ultralight card\n");
+  if (!setup_card(bPWD, (szUID) ? iUID : NULL, szUID, &iDumpSize)) {
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
-  // Get the info from the current tag
-  printf("Using MIFARE Ultralight card with UID: ");
-  size_t  szPos;
-  for (szPos = 0; szPos < nt.nti.nai.szUidLen; szPos++) {
-    printf("%02x", nt.nti.nai.abtUid[szPos]);
-  }
-  printf("\n");
-
-  // test if tag is EV1 or NTAG
-  if (get_ev1_version()) {
-    if (!bPWD)
-      printf("WARNING: Tag is EV1 or NTAG - PASSWORD may be required\n");
-    if (abtRx[6] == 0x0b) {
-      printf("EV1 type: MF0UL11 (48 bytes)\n");
-      uiBlocks = 20; // total number of 4 byte 'pages'
-      iDumpSize = uiBlocks * 4;
-      iEV1Type = EV1_UL11;
-    } else if (abtRx[6] == 0x0e) {
-      printf("EV1 type: MF0UL21 (128 user bytes)\n");
-      uiBlocks = 41; 
-      iDumpSize = uiBlocks * 4;
-      iEV1Type = EV1_UL21;
-    } else if (abtRx[6] == 0x0f) {
-      printf("NTAG Type: NTAG213 (144 user bytes)\n");
-      uiBlocks = 45;
-      iDumpSize = uiBlocks * 4;
-      iNTAGType = NTAG_213;
-    } else if (abtRx[6] == 0x11) {
-      printf("NTAG Type: NTAG215 (504 user bytes)\n");
-      uiBlocks = 135;
-      iDumpSize = uiBlocks * 4;
-      iNTAGType = NTAG_215;
-    } else if (abtRx[6] == 0x13) {
-      printf("NTAG Type: NTAG216 (888 user bytes)\n");
-      uiBlocks = 231;
-      iDumpSize = uiBlocks * 4;
-      iNTAGType = NTAG_216;
-    } else {
-      printf("unknown! (0x%02x)\n", abtRx[6]);
-      exit(EXIT_FAILURE);
-    }
-  } else {
-    // re-init non EV1 tag
-    if (nfc_initiator_select_passive_target(pnd, nmMifare, (szUID) ? iUID : NULL, szUID, &nt) <= 0) {
-      ERR("no tag was found\n");
-      nfc_close(pnd);
-      nfc_exit(context);
-      exit(EXIT_FAILURE);
-    }
-  }
-
-  // EV1 login required
-  if (bPWD) {
-    printf("Authing with PWD: %02x%02x%02x%02x ", iPWD[0], iPWD[1], iPWD[2], iPWD[3]);
-    if (!ev1_pwd_auth(iPWD)) {
-      printf("\n");
-      ERR("AUTH failed!\n");
-      exit(EXIT_FAILURE);
-    } else {
-      printf("Success - PACK: %02x%02x\n", abtRx[0], abtRx[1]);
-      memcpy(iPACK, abtRx, 2);
-    }
-  }
 
   if (iAction == 1) {
     memset(&mtDump, 0x00, sizeof(mtDump));
@@ -752,7 +954,7 @@ main(int argc, const char *argv[])
     if (!bRF)
       printf("Warning! Read failed - partial data written to file!\n");
   } else if (iAction == 2) {
-    write_card(bOTP, bLock, bDynLock, bUID);
+    write_card(bOTP, bLock, bDynLock, bUID, bDiff);
   } else if (iAction == 3) {
     if (!check_magic()) {
       printf("Card is not magic\n");
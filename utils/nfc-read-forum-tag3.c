@@ -54,6 +54,7 @@
 #endif // HAVE_CONFIG_H
 
 #include <errno.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -61,6 +62,8 @@
 #include <nfc/nfc.h>
 
 #include "nfc-utils.h"
+#include "felica.h"
+#include "ndef.h"
 
 #if defined(WIN32) && defined(__GNUC__) /* mingw compiler */
 #include <getopt.h>
@@ -90,80 +93,6 @@ static void stop_select(int sig)
   }
 }
 
-static void
-build_felica_frame(const nfc_felica_info nfi, const uint8_t command, const uint8_t *payload, const size_t payload_len, uint8_t *frame, size_t *frame_len)
-{
-  frame[0] = 1 + 1 + 8 + payload_len;
-  *frame_len = frame[0];
-  frame[1] = command;
-  memcpy(frame + 2, nfi.abtId, 8);
-  memcpy(frame + 10, payload, payload_len);
-}
-
-#define CHECK 0x06
-static int
-nfc_forum_tag_type3_check(nfc_device *dev, const nfc_target *nt, const uint16_t block, const uint8_t block_count, uint8_t *data, size_t *data_len)
-{
-  uint8_t payload[1024] = {
-    1, // Services
-    0x0B, 0x00, // NFC Forum Tag Type 3's Service code
-    block_count,
-    0x80, block, // block 0
-  };
-
-  size_t payload_len = 1 + 2 + 1;
-  for (uint8_t b = 0; b < block_count; b++) {
-    if (block < 0x100) {
-      payload[payload_len++] = 0x80;
-      payload[payload_len++] = block + b;
-    } else {
-      payload[payload_len++] = 0x00;
-      payload[payload_len++] = (block + b) >> 8;
-      payload[payload_len++] = (block + b) & 0xff;
-    }
-  }
-
-  uint8_t frame[1024];
-  size_t frame_len = sizeof(frame);
-  build_felica_frame(nt->nti.nfi, CHECK, payload, payload_len, frame, &frame_len);
-
-  uint8_t rx[1024];
-  int res;
-  if ((res = nfc_initiator_transceive_bytes(dev, frame, frame_len, rx, sizeof(rx), 0)) < 0) {
-    return res;
-  }
-
-  const int res_overhead = 1 + 1 + 8 + 2;  // 1+1+8+2: LEN + CMD + NFCID2 + STATUS
-  if (res < res_overhead) {
-    // Not enough data
-    return -1;
-  }
-  uint8_t felica_res_len = rx[0];
-  if (res != felica_res_len) {
-    // Error while receiving felica frame
-    return -1;
-  }
-  if ((CHECK + 1) != rx[1]) {
-    // Command return does not match
-    return -1;
-  }
-  if (0 != memcmp(&rx[2], nt->nti.nfi.abtId, 8)) {
-    // NFCID2 does not match
-    return -1;
-  }
-  const uint8_t status_flag1 = rx[10];
-  const uint8_t status_flag2 = rx[11];
-  if ((status_flag1) || (status_flag2)) {
-    // Felica card's error
-    fprintf(stderr, "Status bytes: %02x, %02x\n", status_flag1, status_flag2);
-    return -1;
-  }
-  // const uint8_t res_block_count = res[12];
-  *data_len = res - res_overhead + 1; // +1 => block count is stored on 1 byte
-  memcpy(data, &rx[res_overhead + 1], *data_len);
-  return *data_len;
-}
-
 int
 main(int argc, char *argv[])
 {
@@ -291,11 +220,14 @@ main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  uint8_t data[1024];
-  size_t data_len = sizeof(data);
+  felica_tag ft;
+  uint8_t attribute[FELICA_BLOCK_LEN];
+  uint8_t *data = attribute;
+  int res;
 
-  if (nfc_forum_tag_type3_check(pnd, &nt, 0, 1, data, &data_len) <= 0) {
-    nfc_perror(pnd, "nfc_forum_tag_type3_check");
+  felica_tag_init(&ft, pnd, &nt);
+  if ((res = felica_read_blocks(&ft, FELICA_SERVICE_NDEF_RO, 0, 1, attribute)) <= 0) {
+    fprintf(stderr, "Could not read the Attribute Block (error %d, status bytes: %02x, %02x).\n", res, ft.abtStatus[0], ft.abtStatus[1]);
     fclose(ndef_stream);
     nfc_close(pnd);
     nfc_exit(context);
@@ -369,24 +301,29 @@ main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  const uint8_t block_max_per_check = data[1];
-  const uint16_t block_count_to_check = (ndef_data_len / 16) + 1;
+  // Largest multi-block commands the tag accepts
+  felica_tag_set_limits(&ft, ndef_nbr, ndef_nbw);
+  const size_t block_count_to_check = (ndef_data_len + FELICA_BLOCK_LEN - 1) / FELICA_BLOCK_LEN;
 
-  data_len = 0;
-  for (uint16_t b = 0; b < ((block_count_to_check - 1) / block_max_per_check + 1); b += block_max_per_check) {
-    size_t size = sizeof(data) - data_len;
-    if (!nfc_forum_tag_type3_check(pnd, &nt, 1 + b, MIN(block_max_per_check, (block_count_to_check - (b * block_max_per_check))), data + data_len, &size)) {
-      nfc_perror(pnd, "nfc_forum_tag_type3_check");
-      fclose(ndef_stream);
-      nfc_close(pnd);
-      nfc_exit(context);
-      exit(EXIT_FAILURE);
-    }
-    data_len += size;
+  if ((block_count_to_check > (size_t) ndef_nmaxb) || ((data = malloc(block_count_to_check * FELICA_BLOCK_LEN)) == NULL)) {
+    fprintf(stderr, "Error: NDEF message length exceeds the tag capacity.\n");
+    fclose(ndef_stream);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if ((res = felica_read_blocks(&ft, FELICA_SERVICE_NDEF_RO, 1, block_count_to_check, data)) < 0) {
+    fprintf(stderr, "Could not read the NDEF message (error %d, status bytes: %02x, %02x).\n", res, ft.abtStatus[0], ft.abtStatus[1]);
+    free(data);
+    fclose(ndef_stream);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
   }
 
   if (fwrite(data, 1, ndef_data_len, ndef_stream) != ndef_data_len) {
     fprintf(stderr, "Error: could not write to file.\n");
+    free(data);
     fclose(ndef_stream);
     nfc_close(pnd);
     nfc_exit(context);
@@ -396,7 +333,19 @@ main(int argc, char *argv[])
       fprintf(stderr, "%i bytes written to %s\n", ndef_data_len, ndef_output);
     }
   }
+  if (!quiet) {
+    ndef_iter ni;
+    ndef_record rec;
+    ndef_iter_init(&ni, data, ndef_data_len);
+    while ((res = ndef_record_next(&ni, &rec)) > 0) {
+      fprintf(message_stream, "* Record: TNF %d, type \"%.*s\", %" PRIuPTR " bytes payload\n", rec.btTnf, (int) rec.szType, (const char *) rec.pbtType, rec.szPayload);
+    }
+    if (res < 0) {
+      fprintf(message_stream, "* Truncated record\n");
+    }
+  }
 
+  free(data);
   fclose(ndef_stream);
   nfc_close(pnd);
   nfc_exit(context);
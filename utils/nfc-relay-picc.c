@@ -56,8 +56,6 @@
 #include <string.h>
 #include <signal.h>
 
-#include <unistd.h>
-
 #include <nfc/nfc.h>
 
 #include "nfc-utils.h"
@@ -66,9 +64,6 @@
 #define MAX_DEVICE_COUNT 2
 
 static uint8_t abtCapdu[MAX_FRAME_LEN];
-static size_t szCapduLen;
-static uint8_t abtRapdu[MAX_FRAME_LEN];
-static size_t szRapduLen;
 static nfc_device *pndInitiator;
 static nfc_device *pndTarget;
 static bool quitting = false;
@@ -76,9 +71,8 @@ static bool quiet_output = false;
 static bool initiator_only_mode = false;
 static bool target_only_mode = false;
 static bool swap_devices = false;
+static bool busy_poll = false;
 static unsigned int waiting_time = 0;
-FILE *fd3;
-FILE *fd4;
 
 static void
 intr_hdlr(int sig)
@@ -101,60 +95,26 @@ print_usage(char *argv[])
   printf("\t-i\tInitiator mode only (the one on tag side). Data expected from FD3 to FD4.\n");
   printf("\t-s\tSwap roles of found devices.\n");
   printf("\t-n N\tAdds a waiting time of N seconds (integer) in the relay to mimic long distance.\n");
+  printf("\t-p\tBusy-poll FD3 in target or initiator mode only (lowers latency, keeps a CPU busy).\n");
 }
 
-static int print_hex_fd4(const uint8_t *pbtData, const size_t szBytes, const char *pchPrefix)
-{
-  size_t  szPos;
-  if (szBytes > MAX_FRAME_LEN) {
-    return -1;
-  }
-  if (fprintf(fd4, "#%s %04" PRIxPTR ": ", pchPrefix, szBytes) < 0) {
-    return -1;
-  }
-
-  for (szPos = 0; szPos < szBytes; szPos++) {
-    if (fprintf(fd4, "%02x ", pbtData[szPos]) < 0) {
-      return -1;
-    }
-  }
-  if (fprintf(fd4, "\n") < 0) {
-    return -1;
-  }
-  fflush(fd4);
-  return 0;
-}
-
-static int scan_hex_fd3(uint8_t *pbtData, size_t *pszBytes, const char *pchPrefix)
+static int
+relay_apdu(const uint8_t *pbtCommand, const size_t szCommand, const uint8_t *pbtCommandPar,
+           const uint8_t *pbtAnswer, const size_t szAnswer, const uint8_t *pbtAnswerPar, void *user_data)
 {
-  size_t  szPos;
-  unsigned int uiBytes;
-  unsigned int uiData;
-  char pchScan[256];
-  int c;
-  // Look for our next sync marker
-  while ((c = fgetc(fd3)) != '#') {
-    if (c == EOF) {
-      return -1;
-    }
-  }
-  strncpy(pchScan, pchPrefix, 250);
-  pchScan[sizeof(pchScan) - 1] = '\0';
-  strcat(pchScan, " %04x:");
-  if (fscanf(fd3, pchScan, &uiBytes) < 1) {
-    return -1;
-  }
-  *pszBytes = uiBytes;
-  if (*pszBytes > MAX_FRAME_LEN) {
-    return -1;
-  }
-  for (szPos = 0; szPos < *pszBytes; szPos++) {
-    if (fscanf(fd3, "%02x", &uiData) < 1) {
-      return -1;
+  (void) pbtCommandPar;
+  (void) pbtAnswerPar;
+  (void) user_data;
+  // Show transmitted frames
+  if (!quiet_output) {
+    printf("Forwarding C-APDU: ");
+    print_hex(pbtCommand, szCommand);
+    if (szAnswer) {
+      printf("Forwarding R-APDU: ");
+      print_hex(pbtAnswer, szAnswer);
     }
-    pbtData[szPos] = uiData;
   }
-  return 0;
+  return quitting ? -1 : 0;
 }
 
 int
@@ -163,6 +123,12 @@ main(int argc, char *argv[])
   int     arg;
   const char *acLibnfcVersion = nfc_version();
   nfc_target ntRealTarget;
+  nfc_relay_options nro = {
+    .nrm = NFC_RELAY_APDUS,
+    .iFdIn = -1,
+    .iFdOut = -1,
+    .callback = relay_apdu,
+  };
 
   // Get commandline options
   for (arg = 1; arg < argc; arg++) {
@@ -182,6 +148,8 @@ main(int argc, char *argv[])
     } else if (0 == strcmp(argv[arg], "-s")) {
       printf("INFO: %s\n", "Swapping devices.");
       swap_devices = true;
+    } else if (0 == strcmp(argv[arg], "-p")) {
+      busy_poll = true;
     } else if (0 == strcmp(argv[arg], "-n")) {
       if (++arg == argc || (sscanf(argv[arg], "%10u", &waiting_time) < 1)) {
         ERR("Missing or wrong waiting time value: %s.", argv[arg]);
@@ -222,16 +190,10 @@ main(int argc, char *argv[])
       nfc_exit(context);
       exit(EXIT_FAILURE);
     }
-    if ((fd3 = fdopen(3, "r")) == NULL) {
-      ERR("Could not open file descriptor 3");
-      nfc_exit(context);
-      exit(EXIT_FAILURE);
-    }
-    if ((fd4 = fdopen(4, "w")) == NULL) {
-      ERR("Could not open file descriptor 4");
-      nfc_exit(context);
-      exit(EXIT_FAILURE);
-    }
+    // Relayed frames go through FD3 and FD4 as binary records
+    nro.iFdIn = 3;
+    nro.iFdOut = 4;
+    nro.bBusyPoll = busy_poll;
   } else {
     if (szFound < 2) {
       ERR("%" PRIdPTR " device found but two opened devices are needed to relay NFC.", szFound);
@@ -282,26 +244,8 @@ main(int argc, char *argv[])
     printf("Found tag:\n");
     print_nfc_target(&ntRealTarget, false);
     if (initiator_only_mode) {
-      if (print_hex_fd4(ntRealTarget.nti.nai.abtUid, ntRealTarget.nti.nai.szUidLen, "UID") < 0) {
-        fprintf(stderr, "Error while printing UID to FD4\n");
-        nfc_close(pndInitiator);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (print_hex_fd4(ntRealTarget.nti.nai.abtAtqa, 2, "ATQA") < 0) {
-        fprintf(stderr, "Error while printing ATQA to FD4\n");
-        nfc_close(pndInitiator);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (print_hex_fd4(&(ntRealTarget.nti.nai.btSak), 1, "SAK") < 0) {
-        fprintf(stderr, "Error while printing SAK to FD4\n");
-        nfc_close(pndInitiator);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (print_hex_fd4(ntRealTarget.nti.nai.abtAts, ntRealTarget.nti.nai.szAtsLen, "ATS") < 0) {
-        fprintf(stderr, "Error while printing ATS to FD4\n");
+      if (nfc_relay_send_target(&nro, &ntRealTarget) < 0) {
+        fprintf(stderr, "Error while sending target to FD4\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
         exit(EXIT_FAILURE);
@@ -323,28 +267,8 @@ main(int argc, char *argv[])
       },
     };
     if (target_only_mode) {
-      size_t foo;
-      if (scan_hex_fd3(ntEmulatedTarget.nti.nai.abtUid, &(ntEmulatedTarget.nti.nai.szUidLen), "UID") < 0) {
-        fprintf(stderr, "Error while scanning UID from FD3\n");
-        nfc_close(pndInitiator);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (scan_hex_fd3(ntEmulatedTarget.nti.nai.abtAtqa, &foo, "ATQA") < 0) {
-        fprintf(stderr, "Error while scanning ATQA from FD3\n");
-        nfc_close(pndInitiator);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (scan_hex_fd3(&(ntEmulatedTarget.nti.nai.btSak), &foo, "SAK") < 0) {
-        fprintf(stderr, "Error while scanning SAK from FD3\n");
-        nfc_close(pndInitiator);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (scan_hex_fd3(ntEmulatedTarget.nti.nai.abtAts, &(ntEmulatedTarget.nti.nai.szAtsLen), "ATS") < 0) {
-        fprintf(stderr, "Error while scanning ATS from FD3\n");
-        nfc_close(pndInitiator);
+      if (nfc_relay_receive_target(&nro, &ntEmulatedTarget) < 0) {
+        fprintf(stderr, "Error while receiving target from FD3\n");
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
@@ -411,95 +335,20 @@ main(int argc, char *argv[])
     printf("%s\n", "Done, relaying frames now!");
   }
 
-  while (!quitting) {
-    bool ret;
-    int res = 0;
-    if (!initiator_only_mode) {
-      // Receive external reader command through target
-      if ((res = nfc_target_receive_bytes(pndTarget, abtCapdu, sizeof(abtCapdu), 0)) < 0) {
-        nfc_perror(pndTarget, "nfc_target_receive_bytes");
-        if (!target_only_mode) {
-          nfc_close(pndInitiator);
-        }
-        nfc_close(pndTarget);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      szCapduLen = (size_t) res;
-      if (target_only_mode) {
-        if (print_hex_fd4(abtCapdu, szCapduLen, "C-APDU") < 0) {
-          fprintf(stderr, "Error while printing C-APDU to FD4\n");
-          nfc_close(pndTarget);
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-      }
-    } else {
-      if (scan_hex_fd3(abtCapdu, &szCapduLen, "C-APDU") < 0) {
-        fprintf(stderr, "Error while scanning C-APDU from FD3\n");
-        nfc_close(pndInitiator);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-    }
-    // Show transmitted response
-    if (!quiet_output) {
-      printf("Forwarding C-APDU: ");
-      print_hex(abtCapdu, szCapduLen);
-    }
-
+  nro.iDelay = waiting_time * 1000;
+  if (waiting_time != 0 && !quiet_output) {
+    printf("Waiting %us before each answer to simulate longer relay.\n", waiting_time);
+  }
+  if (nfc_relay_run(initiator_only_mode ? NULL : pndTarget, target_only_mode ? NULL : pndInitiator, &nro) < 0) {
+    nfc_perror(initiator_only_mode ? pndInitiator : pndTarget, "nfc_relay_run");
     if (!target_only_mode) {
-      // Forward the frame to the original tag
-      if ((res = nfc_initiator_transceive_bytes(pndInitiator, abtCapdu, szCapduLen, abtRapdu, sizeof(abtRapdu), -1)) < 0) {
-        ret = false;
-      } else {
-        szRapduLen = (size_t) res;
-        ret = true;
-      }
-    } else {
-      if (scan_hex_fd3(abtRapdu, &szRapduLen, "R-APDU") < 0) {
-        fprintf(stderr, "Error while scanning R-APDU from FD3\n");
-        nfc_close(pndTarget);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      ret = true;
+      nfc_close(pndInitiator);
     }
-    if (ret) {
-      // Redirect the answer back to the external reader
-      if (waiting_time != 0) {
-        if (!quiet_output) {
-          printf("Waiting %us to simulate longer relay...\n", waiting_time);
-        }
-        sleep(waiting_time);
-      }
-      // Show transmitted response
-      if (!quiet_output) {
-        printf("Forwarding R-APDU: ");
-        print_hex(abtRapdu, szRapduLen);
-      }
-      if (!initiator_only_mode) {
-        // Transmit the response bytes
-        if (nfc_target_send_bytes(pndTarget, abtRapdu, szRapduLen, 0) < 0) {
-          nfc_perror(pndTarget, "nfc_target_send_bytes");
-          if (!target_only_mode) {
-            nfc_close(pndInitiator);
-          }
-          if (!initiator_only_mode) {
-            nfc_close(pndTarget);
-          }
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-      } else {
-        if (print_hex_fd4(abtRapdu, szRapduLen, "R-APDU") < 0) {
-          fprintf(stderr, "Error while printing R-APDU to FD4\n");
-          nfc_close(pndInitiator);
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-      }
+    if (!initiator_only_mode) {
+      nfc_close(pndTarget);
     }
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
   }
 
   if (!target_only_mode) {
@@ -0,0 +1,226 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-server.c
+ * @brief Exports local NFC devices to remote applications
+ *
+ * Each device is served on its own port, by its own thread, so that one
+ * process can export all the readers of a host. A remote application opens
+ * it with a "tcp:host:port" connstring.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+#define MAX_DEVICE_COUNT 16
+#define DEFAULT_PORT "7700"
+// The protocol has no authentication: other hosts are served on request only
+#define DEFAULT_ADDRESS "127.0.0.1"
+
+struct served_device {
+  nfc_device *pnd;
+  int fd;
+  char acPort[8];
+};
+
+static bool quiet_output = false;
+
+static void
+print_usage(const char *argv[])
+{
+  printf("Usage: %s [OPTIONS] [connstring...]\n", argv[0]);
+  printf("Options:\n");
+  printf("\t-h\tPrint this help message.\n");
+  printf("\t-q\tQuiet mode, do not print connections.\n");
+  printf("\t-l addr\tListen on this address, \"all\" for every address (default: %s).\n", DEFAULT_ADDRESS);
+  printf("\t-p port\tPort of the first device, the next ones use the following ports (default: %s).\n", DEFAULT_PORT);
+  printf("Devices given by connstring are served, otherwise all the devices found.\n");
+}
+
+static int
+listen_on(const char *pcAddress, const char *pcPort)
+{
+  struct addrinfo hints, *pai, *p;
+  int fd = -1;
+  const int one = 1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(pcAddress, pcPort, &hints, &pai) != 0)
+    return -1;
+  for (p = pai; p; p = p->ai_next) {
+    if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+      continue;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if ((bind(fd, p->ai_addr, p->ai_addrlen) == 0) && (listen(fd, 1) == 0))
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(pai);
+  return fd;
+}
+
+static void *
+serve_device(void *arg)
+{
+  struct served_device *psd = arg;
+
+  // One client at a time, the device stays opened between clients
+  for (;;) {
+    const int fd = accept(psd->fd, NULL, NULL);
+    if (fd < 0) {
+      warn("accept");
+      continue;
+    }
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    if (!quiet_output)
+      printf("%s: client connected on port %s\n", nfc_device_get_name(psd->pnd), psd->acPort);
+    const int res = nfc_tcp_serve(psd->pnd, fd);
+    close(fd);
+    if (!quiet_output)
+      printf("%s: client %s\n", nfc_device_get_name(psd->pnd), (res < 0) ? nfc_strerror(psd->pnd) : "disconnected");
+  }
+  return NULL;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *pcAddress = DEFAULT_ADDRESS;
+  int iPort = atoi(DEFAULT_PORT);
+  nfc_connstring connstrings[MAX_DEVICE_COUNT];
+  size_t szDevices = 0;
+  struct served_device asd[MAX_DEVICE_COUNT];
+  pthread_t athreads[MAX_DEVICE_COUNT];
+  size_t szServed = 0;
+  int arg;
+
+  for (arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-q")) {
+      quiet_output = true;
+    } else if ((0 == strcmp(argv[arg], "-l")) && (arg + 1 < argc)) {
+      pcAddress = argv[++arg];
+      if (0 == strcmp(pcAddress, "all"))
+        pcAddress = NULL;
+    } else if ((0 == strcmp(argv[arg], "-p")) && (arg + 1 < argc)) {
+      iPort = atoi(argv[++arg]);
+      if ((iPort <= 0) || (iPort > 0xffff)) {
+        ERR("Invalid port: %s", argv[arg]);
+        exit(EXIT_FAILURE);
+      }
+    } else if (argv[arg][0] == '-') {
+      ERR("%s is not supported option.", argv[arg]);
+      print_usage(argv);
+      exit(EXIT_FAILURE);
+    } else if (szDevices < MAX_DEVICE_COUNT) {
+      snprintf(connstrings[szDevices++], sizeof(nfc_connstring), "%s", argv[arg]);
+    }
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  if (szDevices == 0)
+    szDevices = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+  if (szDevices == 0) {
+    ERR("No NFC device found.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < szDevices; i++) {
+    struct served_device *psd = &(asd[szServed]);
+
+    if ((psd->pnd = nfc_open(context, connstrings[i])) == NULL) {
+      ERR("Unable to open NFC device: %s", connstrings[i]);
+      continue;
+    }
+    snprintf(psd->acPort, sizeof(psd->acPort), "%d", (int)(iPort + i));
+    if ((psd->fd = listen_on(pcAddress, psd->acPort)) < 0) {
+      ERR("Unable to listen on port %s", psd->acPort);
+      nfc_close(psd->pnd);
+      continue;
+    }
+    if (pthread_create(&(athreads[szServed]), NULL, serve_device, psd) != 0) {
+      ERR("Unable to start serving %s", nfc_device_get_name(psd->pnd));
+      close(psd->fd);
+      nfc_close(psd->pnd);
+      continue;
+    }
+    printf("NFC device: %s served on port %s\n", nfc_device_get_name(psd->pnd), psd->acPort);
+    szServed++;
+  }
+  if (szServed == 0) {
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  // Devices are served until the process is killed
+  for (size_t i = 0; i < szServed; i++)
+    pthread_join(athreads[i], NULL);
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}
@@ -37,11 +37,32 @@
  * @file nfc-utils.c
  * @brief Provide some examples shared functions like print, parity calculation, options parsing.
  */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
 #include <nfc/nfc.h>
 #include <err.h>
+#include <string.h>
 
 #include "nfc-utils.h"
 
+#ifndef _WIN32
+#  include <time.h>
+#  define msleep(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = x / 1000; \
+    xsleep.tv_nsec = (x - xsleep.tv_sec * 1000) * 1000 * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <winbase.h>
+#  define msleep Sleep
+#endif
+
+// Delay between two selects or presence checks when waiting for cards
+#define WAIT_PERIOD_MS 100
+
 uint8_t
 oddparity(const uint8_t bt)
 {
@@ -52,9 +73,19 @@ oddparity(const uint8_t bt)
 void
 oddparity_bytes_ts(const uint8_t *pbtData, const size_t szLen, uint8_t *pbtPar)
 {
-  size_t  szByteNr;
-  // Calculate the parity bits for the command
-  for (szByteNr = 0; szByteNr < szLen; szByteNr++) {
+  size_t  szByteNr = 0;
+  // Calculate the parity bits for the command, 8 bytes at a time:
+  // folding each byte on itself leaves its parity in its lowest bit
+  for (; szByteNr + 8 <= szLen; szByteNr += 8) {
+    uint64_t u64Data;
+    memcpy(&u64Data, pbtData + szByteNr, sizeof(u64Data));
+    u64Data ^= u64Data >> 4;
+    u64Data ^= u64Data >> 2;
+    u64Data ^= u64Data >> 1;
+    u64Data = ~u64Data & 0x0101010101010101ULL;
+    memcpy(pbtPar + szByteNr, &u64Data, sizeof(u64Data));
+  }
+  for (; szByteNr < szLen; szByteNr++) {
     pbtPar[szByteNr] = oddparity(pbtData[szByteNr]);
   }
 }
@@ -127,3 +158,45 @@ print_nfc_target(const nfc_target *pnt, bool verbose)
   printf("%s", s);
   nfc_free(s);
 }
+
+/**
+ * @brief Select a target, trying again until one is found or \a *pbStop is set
+ * @return Returns 1 once a target is selected, 0 if stopped, a negative value on device error
+ *
+ * Meant to be used with NP_INFINITE_SELECT disabled, RF errors (collisions,
+ * cards leaving the field) are retried.
+ */
+int
+wait_for_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData,
+                nfc_target *pnt, volatile sig_atomic_t *pbStop)
+{
+  int res;
+
+  while (!*pbStop) {
+    if ((res = nfc_initiator_select_passive_target(pnd, nm, pbtInitData, szInitData, pnt)) > 0)
+      return 1;
+    if ((res == NFC_EIO) || (res == NFC_ENOTSUCHDEV))
+      return res;
+    msleep(WAIT_PERIOD_MS);
+  }
+  return 0;
+}
+
+/**
+ * @brief Wait until the selected target leaves the field or \a *pbStop is set
+ *
+ * A failed presence check is confirmed by a select finding no card, so that a
+ * card which does not answer the check is not taken for a new one.
+ */
+void
+wait_for_removal(nfc_device *pnd, const nfc_modulation nm, volatile sig_atomic_t *pbStop)
+{
+  nfc_target nt;
+
+  while (!*pbStop) {
+    if ((nfc_initiator_target_is_present(pnd, NULL) != NFC_SUCCESS) &&
+        (nfc_initiator_select_passive_target(pnd, nm, NULL, 0, &nt) <= 0))
+      return;
+    msleep(WAIT_PERIOD_MS);
+  }
+}
@@ -42,6 +42,7 @@
 #ifndef _EXAMPLES_NFC_UTILS_H_
 #  define _EXAMPLES_NFC_UTILS_H_
 
+#  include <signal.h>
 #  include <stdlib.h>
 #  include <string.h>
 #  include <err.h>
@@ -101,4 +102,8 @@ void    print_hex_par(const uint8_t *pbtData, const size_t szBits, const uint8_t
 
 void    print_nfc_target(const nfc_target *pnt, bool verbose);
 
+int     wait_for_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData,
+                        nfc_target *pnt, volatile sig_atomic_t *pbStop);
+void    wait_for_removal(nfc_device *pnd, const nfc_modulation nm, volatile sig_atomic_t *pbStop);
+
 #endif
@@ -0,0 +1,194 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+/**
+ * @file snep.c
+ * @brief NFC Forum SNEP client and server, to push NDEF messages over LLCP
+ *
+ * A message larger than the MIU of the receiver is fragmented: the first
+ * fragment goes alone, the others all follow the CONTINUE answer, in a row,
+ * as far as the receive window of the LLCP connection allows.
+ */
+#include "snep.h"
+
+#include <string.h>
+
+static size_t
+snep_header(uint8_t *pbt, const uint8_t ui8Code, const uint32_t ui32Len)
+{
+  pbt[0] = SNEP_VERSION;
+  pbt[1] = ui8Code;
+  pbt[2] = (uint8_t)(ui32Len >> 24);
+  pbt[3] = (uint8_t)(ui32Len >> 16);
+  pbt[4] = (uint8_t)(ui32Len >> 8);
+  pbt[5] = (uint8_t) ui32Len;
+  return SNEP_HEADER_LEN;
+}
+
+static int
+snep_respond(llcp_link *pll, llcp_connection *plc, const uint8_t ui8Code)
+{
+  uint8_t abtHeader[SNEP_HEADER_LEN];
+  const int res = llcp_send(pll, plc, abtHeader, snep_header(abtHeader, ui8Code, 0));
+  return (res < 0) ? res : NFC_SUCCESS;
+}
+
+/**
+ * @brief Connect to the default SNEP server of the peer
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ */
+int
+snep_client_connect(llcp_link *pll, llcp_connection *plc)
+{
+  return llcp_connect(pll, plc, LLCP_SAP_SNEP, SNEP_SERVICE_NAME);
+}
+
+/**
+ * @brief Push an NDEF message with a PUT request
+ * @return The response code of the server, e.g. \a SNEP_RES_SUCCESS, otherwise a libnfc error code (negative value)
+ *
+ * Fragments after the first one are sent straight from \a pbtNdef.
+ */
+int
+snep_put(llcp_link *pll, llcp_connection *plc, const uint8_t *pbtNdef, const size_t szNdef)
+{
+  uint8_t abtFragment[LLCP_MIU_MAX];
+  const size_t szMiu = plc->ui16PeerMiu;
+  int res;
+
+  if (szNdef > UINT32_MAX)
+    return NFC_EINVARG;
+  const size_t szFirst = (SNEP_HEADER_LEN + szNdef > szMiu) ? szMiu - SNEP_HEADER_LEN : szNdef;
+  snep_header(abtFragment, SNEP_REQ_PUT, (uint32_t) szNdef);
+  memcpy(abtFragment + SNEP_HEADER_LEN, pbtNdef, szFirst);
+  if ((res = llcp_send(pll, plc, abtFragment, SNEP_HEADER_LEN + szFirst)) < 0)
+    return res;
+
+  if (szFirst < szNdef) {
+    if ((res = llcp_recv(pll, plc, abtFragment, sizeof(abtFragment))) < 0)
+      return res;
+    if (res < SNEP_HEADER_LEN)
+      return NFC_EIO;
+    if (abtFragment[1] != SNEP_RES_CONTINUE)
+      return abtFragment[1];
+    for (size_t szPos = szFirst; szPos < szNdef;) {
+      const size_t sz = (szNdef - szPos > szMiu) ? szMiu : szNdef - szPos;
+      if ((res = llcp_send(pll, plc, pbtNdef + szPos, sz)) < 0)
+        return res;
+      szPos += sz;
+    }
+  }
+
+  if ((res = llcp_recv(pll, plc, abtFragment, sizeof(abtFragment))) < 0)
+    return res;
+  if (res < SNEP_HEADER_LEN)
+    return NFC_EIO;
+  return abtFragment[1];
+}
+
+/**
+ * @brief Serve the default SNEP service
+ * @return 0 on success, otherwise a libnfc error code (negative value)
+ *
+ * Call it before llcp_link_general_bytes(), so that the service is announced.
+ */
+int
+snep_server_listen(llcp_link *pll, llcp_connection *plc)
+{
+  return llcp_listen(pll, plc, LLCP_SAP_SNEP, SNEP_SERVICE_NAME);
+}
+
+/**
+ * @brief Wait for an NDEF message pushed with a PUT request
+ * @return Length of the NDEF message, otherwise a libnfc error code (negative value)
+ *
+ * Waits for a client to connect first if none is connected. GET requests are
+ * answered as not implemented. A message larger than \a szNdef is rejected,
+ * \a NFC_EOVFLOW being returned.
+ */
+int
+snep_server_receive(llcp_link *pll, llcp_connection *plc, uint8_t *pbtNdef, const size_t szNdef)
+{
+  uint8_t abtFragment[LLCP_MIU_MAX];
+  int res;
+
+  if ((plc->state == LLCP_LISTENING) && ((res = llcp_accept(pll, plc)) < 0))
+    return res;
+
+  for (;;) {
+    if ((res = llcp_recv(pll, plc, abtFragment, sizeof(abtFragment))) < 0)
+      return res;
+    const size_t szFragment = (size_t) res;
+    if (szFragment < SNEP_HEADER_LEN) {
+      if ((res = snep_respond(pll, plc, SNEP_RES_BAD_REQUEST)) < 0)
+        return res;
+      continue;
+    }
+    if ((abtFragment[0] >> 4) != (SNEP_VERSION >> 4)) {
+      if ((res = snep_respond(pll, plc, SNEP_RES_UNSUPPORTED_VERSION)) < 0)
+        return res;
+      continue;
+    }
+    if (abtFragment[1] != SNEP_REQ_PUT) {
+      if ((res = snep_respond(pll, plc, SNEP_RES_NOT_IMPLEMENTED)) < 0)
+        return res;
+      continue;
+    }
+
+    const uint32_t ui32Len = ((uint32_t) abtFragment[2] << 24) | ((uint32_t) abtFragment[3] << 16) |
+                             ((uint32_t) abtFragment[4] << 8) | abtFragment[5];
+    size_t szPos = szFragment - SNEP_HEADER_LEN;
+    if ((ui32Len > szNdef) || (szPos > ui32Len)) {
+      if ((res = snep_respond(pll, plc, (ui32Len > szNdef) ? SNEP_RES_REJECT : SNEP_RES_BAD_REQUEST)) < 0)
+        return res;
+      if (ui32Len > szNdef)
+        return NFC_EOVFLOW;
+      continue;
+    }
+    memcpy(pbtNdef, abtFragment + SNEP_HEADER_LEN, szPos);
+    if (szPos < ui32Len) {
+      if ((res = snep_respond(pll, plc, SNEP_RES_CONTINUE)) < 0)
+        return res;
+      while (szPos < ui32Len) {
+        if ((res = llcp_recv(pll, plc, pbtNdef + szPos, ui32Len - szPos)) < 0)
+          return res;
+        szPos += (size_t) res;
+      }
+    }
+    if ((res = snep_respond(pll, plc, SNEP_RES_SUCCESS)) < 0)
+      return res;
+    return (int) ui32Len;
+  }
+}
@@ -0,0 +1,76 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file snep.h
+ * @brief NFC Forum SNEP client and server, to push NDEF messages over LLCP
+ */
+
+#ifndef _LIBNFC_SNEP_H_
+#  define _LIBNFC_SNEP_H_
+
+#  include <stddef.h>
+#  include <stdint.h>
+
+#  include "llcp.h"
+
+#  define SNEP_VERSION      0x10
+#  define SNEP_SERVICE_NAME "urn:nfc:sn:snep"
+#  define SNEP_HEADER_LEN   6
+
+// Requests
+#  define SNEP_REQ_CONTINUE 0x00
+#  define SNEP_REQ_GET      0x01
+#  define SNEP_REQ_PUT      0x02
+#  define SNEP_REQ_REJECT   0x7f
+
+// Responses
+#  define SNEP_RES_CONTINUE            0x80
+#  define SNEP_RES_SUCCESS             0x81
+#  define SNEP_RES_NOT_FOUND           0xc0
+#  define SNEP_RES_EXCESS_DATA         0xc1
+#  define SNEP_RES_BAD_REQUEST         0xc2
+#  define SNEP_RES_NOT_IMPLEMENTED     0xe0
+#  define SNEP_RES_UNSUPPORTED_VERSION 0xe1
+#  define SNEP_RES_REJECT              0xff
+
+int     snep_client_connect(llcp_link *pll, llcp_connection *plc);
+int     snep_put(llcp_link *pll, llcp_connection *plc, const uint8_t *pbtNdef, const size_t szNdef);
+
+int     snep_server_listen(llcp_link *pll, llcp_connection *plc);
+int     snep_server_receive(llcp_link *pll, llcp_connection *plc, uint8_t *pbtNdef, const size_t szNdef);
+
+#endif // _LIBNFC_SNEP_H_